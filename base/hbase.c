@@ -388,6 +388,16 @@ char* hv_random_string(char *buf, int len) {
     return buf;
 }
 
+uint32_t hv_hash(const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 bool hv_getboolean(const char* str) {
     if (str == NULL) return false;
     int len = strlen(str);
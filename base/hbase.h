@@ -110,6 +110,9 @@ HV_EXPORT char* get_run_dir(char* buf, int size);
 HV_EXPORT int   hv_rand(int min, int max);
 HV_EXPORT char* hv_random_string(char *buf, int len);
 
+// FNV-1a 32-bit hash
+HV_EXPORT uint32_t hv_hash(const void* data, size_t len);
+
 // 1 y on yes true enable => true
 HV_EXPORT bool   hv_getboolean(const char* str);
 // 1T2G3M4K5B => ?B
@@ -46,6 +46,7 @@ set(CPPUTIL_HEADERS
     cpputil/hthreadpool.h
     cpputil/hasync.h
     cpputil/hobjectpool.h
+    cpputil/hsnapshot.h
     cpputil/ifconfig.h
     cpputil/iniparser.h
     cpputil/json.hpp
@@ -56,6 +57,7 @@ set(CPPUTIL_HEADERS
 set(EVPP_HEADERS
     evpp/Buffer.h
     evpp/Channel.h
+    evpp/Coroutine.h
     evpp/Event.h
     evpp/EventLoop.h
     evpp/EventLoopThread.h
@@ -71,7 +73,11 @@ set(PROTOCOL_HEADERS
     protocol/icmp.h
     protocol/dns.h
     protocol/ftp.h
+    protocol/ftp_client.h
     protocol/smtp.h
+    protocol/smtp_client.h
+    protocol/probe.h
+    protocol/proxy_server.h
 )
 
 set(HTTP_HEADERS
@@ -82,6 +88,8 @@ set(HTTP_HEADERS
     http/HttpParser.h
     http/WebSocketParser.h
     http/WebSocketChannel.h
+    http/WebSocketDeflate.h
+    http/HttpCompressor.h
 )
 
 set(HTTP2_HEADERS
@@ -94,17 +102,37 @@ set(HTTP_CLIENT_HEADERS
     http/client/requests.h
     http/client/axios.h
     http/client/AsyncHttpClient.h
+    http/client/ServiceDiscovery.h
     http/client/WebSocketClient.h)
 
 set(HTTP_SERVER_HEADERS
     http/server/HttpServer.h
     http/server/HttpService.h
     http/server/HttpContext.h
+    http/server/HttpUpstream.h
+    http/server/HttpProxyCache.h
     http/server/HttpResponseWriter.h
+    http/server/HttpMetrics.h
+    http/server/HttpSharedStats.h
+    http/server/HttpAdmission.h
     http/server/WebSocketServer.h
 )
 
 set(MQTT_HEADERS
     mqtt/mqtt_protocol.h
     mqtt/mqtt_client.h
+    mqtt/MqttBroker.h
+)
+
+set(REDIS_HEADERS
+    redis/RedisParser.h
+    redis/RedisClient.h
+)
+
+set(HRPC_HEADERS
+    hrpc/hrpc.h
+    hrpc/RpcCodec.h
+    hrpc/RpcProtobuf.h
+    hrpc/RpcClient.h
+    hrpc/RpcServer.h
 )
@@ -8,6 +8,8 @@ WITH_HTTP=yes
 WITH_HTTP_SERVER=yes
 WITH_HTTP_CLIENT=yes
 WITH_MQTT=no
+WITH_REDIS=no
+WITH_HRPC=no
 ENABLE_UDS=no
 ENABLE_WINDUMP=no
 USE_MULTIMAP=no
@@ -16,5 +18,7 @@ WITH_NGHTTP2=no
 WITH_OPENSSL=no
 WITH_GNUTLS=no
 WITH_MBEDTLS=no
+WITH_ZLIB=no
+WITH_BROTLI=no
 WITH_KCP=no
 CONFIG_DATE=20220224
@@ -42,6 +42,12 @@ public:
     static void cleanup() {
         GlobalThreadPool::exitInstance();
     }
+
+    // fire-and-forget, cheaper than async(fn) if the future is not needed.
+    template<class Fn>
+    static void post(Fn&& fn) {
+        GlobalThreadPool::instance()->post(std::forward<Fn>(fn));
+    }
 };
 
 } // end namespace hv
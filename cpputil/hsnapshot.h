@@ -0,0 +1,93 @@
+#ifndef HV_SNAPSHOT_H_
+#define HV_SNAPSHOT_H_
+
+/*
+ * HSnapshot<T>: an immutable T published by writers, read by any thread.
+ *
+ * Writers copy, modify and Store a new T under their own lock, which bumps the version.
+ * Load keeps the last snapshot per thread, and reloads it by std::atomic_load,
+ * which takes a mutex from the std library's pool, only if the version changed.
+ * Between updates, Load is an atomic load of the version, a lookup in a thread_local map
+ * and a shared_ptr copy, no lock.
+ *
+ * NOTE: Load may return the previous snapshot while Store is in progress.
+ *
+ * @usage unittest/snapshot_test.cpp
+ */
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+template<class T>
+class HSnapshot {
+public:
+    typedef std::shared_ptr<const T> Ptr;
+
+    explicit HSnapshot(const Ptr& ptr = std::make_shared<T>())
+        : id_(nextId())
+        , version_(1)
+        , ptr_(ptr)
+    {}
+
+    // NOTE: writers Store with their own lock held
+    void Store(const Ptr& ptr) {
+        std::atomic_store(&ptr_, ptr);
+        version_.fetch_add(1, std::memory_order_release);
+    }
+
+    // the last stored snapshot, for writers
+    Ptr Latest() const {
+        return std::atomic_load(&ptr_);
+    }
+
+    // the snapshot cached by this thread, refreshed if the version changed
+    Ptr Load() const {
+        uint64_t version = version_.load(std::memory_order_acquire);
+        Cache& cache = threadCache();
+        Entry& entry = cache[id_];
+        if (entry.version != version) {
+            entry.ptr = Latest();
+            entry.version = version;
+            // drop snapshots only held by this cache, i.e. replaced or of a destroyed HSnapshot
+            for (auto iter = cache.begin(); iter != cache.end(); ) {
+                if (iter->first != id_ && iter->second.ptr.use_count() == 1) {
+                    iter = cache.erase(iter);
+                } else {
+                    ++iter;
+                }
+            }
+        }
+        return entry.ptr;
+    }
+
+    uint64_t Version() const {
+        return version_.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Entry {
+        uint64_t    version;
+        Ptr         ptr;
+        Entry() : version(0) {}
+    };
+    // id => Entry, ids are never reused
+    typedef std::unordered_map<uint64_t, Entry> Cache;
+
+    static uint64_t nextId() {
+        static std::atomic<uint64_t> s_id(0);
+        return ++s_id;
+    }
+
+    static Cache& threadCache() {
+        static thread_local Cache s_cache;
+        return s_cache;
+    }
+
+    const uint64_t          id_;
+    std::atomic<uint64_t>   version_;
+    Ptr                     ptr_;
+};
+
+#endif // HV_SNAPSHOT_H_
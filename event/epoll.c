@@ -52,6 +52,13 @@ int iowatcher_add_event(hloop_t* loop, int fd, int events) {
     struct epoll_event ee;
     memset(&ee, 0, sizeof(ee));
     ee.data.fd = fd;
+#ifdef EPOLLET
+    if (loop->flags & HLOOP_FLAG_EDGE_TRIGGERED) {
+        // NOTE: registered once for both directions, io->events filters revents.
+        if (io->events) return 0;
+        ee.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    }
+#endif
     // pre events
     if (io->events & HV_READ) {
         ee.events |= EPOLLIN;
@@ -68,6 +75,7 @@ int iowatcher_add_event(hloop_t* loop, int fd, int events) {
     }
     int op = io->events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
     epoll_ctl(epoll_ctx->epfd, op, fd, &ee);
+    HLOOP_METRICS_ADD(loop, poll_ctls, 1);
     if (op == EPOLL_CTL_ADD) {
         if (epoll_ctx->events.size == epoll_ctx->events.maxsize) {
             events_double_resize(&epoll_ctx->events);
@@ -99,8 +107,13 @@ int iowatcher_del_event(hloop_t* loop, int fd, int events) {
     if (events & HV_WRITE) {
         ee.events &= ~EPOLLOUT;
     }
+#ifdef EPOLLET
+    // NOTE: edge-triggered: keep registered until no events left.
+    if ((loop->flags & HLOOP_FLAG_EDGE_TRIGGERED) && ee.events) return 0;
+#endif
     int op = ee.events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
     epoll_ctl(epoll_ctx->epfd, op, fd, &ee);
+    HLOOP_METRICS_ADD(loop, poll_ctls, 1);
     if (op == EPOLL_CTL_DEL) {
         epoll_ctx->events.size--;
     }
@@ -102,6 +102,7 @@ void hio_ready(hio_t* io) {
     io->last_read_hrtime = io->last_write_hrtime = io->loop->cur_hrtime;
     // readbuf
     io->alloced_readbuf = 0;
+    io->released_readbuf = 0;
     hio_use_loop_readbuf(io);
     io->readbuf.head = io->readbuf.tail = 0;
     io->read_flags = 0;
@@ -133,8 +134,10 @@ void hio_ready(hio_t* io) {
     io->heartbeat_timer = NULL;
     // upstream
     io->upstream_io = NULL;
+    io->relay = NULL;
     // unpack
     io->unpack_setting = NULL;
+    io->codec = NULL;
     // ssl
     io->ssl = NULL;
     io->ssl_ctx = NULL;
@@ -181,6 +184,7 @@ void hio_done(hio_t* io) {
         write_queue_pop_front(&io->write_queue);
     }
     write_queue_cleanup(&io->write_queue);
+    HLOOP_METRICS_ATOMIC_ADD(io->loop, write_queue_bytes, -(int64_t)io->write_bufsize);
     hrecursive_mutex_unlock(&io->write_mutex);
 
 #if WITH_RUDP
@@ -335,7 +339,10 @@ void hio_handle_read(hio_t* io, void* buf, int readbytes) {
     }
 #endif
 
-    if (io->unpack_setting) {
+    if (io->codec) {
+        // hio_set_codec
+        hio_unpack_by_codec(io, buf, readbytes);
+    } else if (io->unpack_setting) {
         // hio_set_unpack
         hio_unpack(io, buf, readbytes);
     } else {
@@ -353,18 +360,16 @@ void hio_handle_read(hio_t* io, void* buf, int readbytes) {
             }
         } else if (io->read_flags & HIO_READ_UNTIL_DELIM) {
             // hio_read_until_delim
-            const unsigned char* p = (const unsigned char*)buf;
-            for (int i = 0; i < readbytes; ++i, ++p) {
-                if (*p == io->read_until_delim) {
-                    int len = p - sp + 1;
-                    io->readbuf.head += len;
-                    if (io->readbuf.head == io->readbuf.tail) {
-                        io->readbuf.head = io->readbuf.tail = 0;
-                    }
-                    io->read_flags &= ~HIO_READ_UNTIL_DELIM;
-                    hio_read_cb(io, (void*)sp, len);
-                    return;
+            const unsigned char* p = (const unsigned char*)memchr(buf, io->read_until_delim, readbytes);
+            if (p) {
+                int len = p - sp + 1;
+                io->readbuf.head += len;
+                if (io->readbuf.head == io->readbuf.tail) {
+                    io->readbuf.head = io->readbuf.tail = 0;
                 }
+                io->read_flags &= ~HIO_READ_UNTIL_DELIM;
+                hio_read_cb(io, (void*)sp, len);
+                return;
             }
         } else {
             // hio_read
@@ -693,6 +698,50 @@ void hio_set_heartbeat(hio_t* io, int interval_ms, hio_send_heartbeat_fn fn) {
 }
 
 //-----------------iobuf---------------------------------------------
+// @return index of loop->readbuf_pool, -1 if len is not a pooled size.
+static int readbuf_pool_class(size_t len) {
+    size_t size = HLOOP_READ_BUFSIZE;
+    for (int i = 0; i < READBUF_POOL_CLASSES; ++i, size <<= 1) {
+        if (len == size) return i;
+    }
+    return -1;
+}
+
+static char* readbuf_pool_get(hloop_t* loop, size_t len) {
+    char* buf = NULL;
+    int i = readbuf_pool_class(len);
+    if (i >= 0 && loop->readbuf_pool[i]) {
+        buf = (char*)loop->readbuf_pool[i];
+        loop->readbuf_pool[i] = *(void**)buf;
+        loop->readbuf_pool_bytes -= len;
+        return buf;
+    }
+    HV_ALLOC(buf, len);
+    return buf;
+}
+
+static void readbuf_pool_put(hloop_t* loop, char* buf, size_t len) {
+    int i = readbuf_pool_class(len);
+    if (i < 0 || loop->readbuf_pool_bytes + len > READBUF_POOL_MAX_BYTES) {
+        HV_FREE(buf);
+        return;
+    }
+    *(void**)buf = loop->readbuf_pool[i];
+    loop->readbuf_pool[i] = buf;
+    loop->readbuf_pool_bytes += len;
+}
+
+void hloop_cleanup_readbuf_pool(hloop_t* loop) {
+    for (int i = 0; i < READBUF_POOL_CLASSES; ++i) {
+        while (loop->readbuf_pool[i]) {
+            void* buf = loop->readbuf_pool[i];
+            loop->readbuf_pool[i] = *(void**)buf;
+            HV_FREE(buf);
+        }
+    }
+    loop->readbuf_pool_bytes = 0;
+}
+
 void hio_alloc_readbuf(hio_t* io, int len) {
     if (len > io->max_read_bufsize) {
         hloge("read bufsize > %u, close it!", io->max_read_bufsize);
@@ -700,26 +749,68 @@ void hio_alloc_readbuf(hio_t* io, int len) {
         hio_close_async(io);
         return;
     }
-    if (hio_is_alloced_readbuf(io)) {
-        io->readbuf.base = (char*)hv_realloc(io->readbuf.base, len, io->readbuf.len);
+    char* base = NULL;
+    bool owned = hio_is_alloced_readbuf(io) && !io->released_readbuf;
+    if ((io->loop->flags & HLOOP_FLAG_RELEASE_IDLE_BUFFERS) && io->readbuf.head == io->readbuf.tail) {
+        // NOTE: nothing to keep, acquire it when readable.
+        if (owned) {
+            readbuf_pool_put(io->loop, io->readbuf.base, io->readbuf.len);
+        }
+        io->readbuf.base = NULL;
+        io->readbuf.head = io->readbuf.tail = 0;
+        io->readbuf.len = len;
+        io->alloced_readbuf = 1;
+        io->released_readbuf = 1;
+        io->small_readbytes_cnt = 0;
+        return;
+    }
+    if (owned && readbuf_pool_class(io->readbuf.len) < 0 && readbuf_pool_class(len) < 0) {
+        base = (char*)hv_realloc(io->readbuf.base, len, io->readbuf.len);
     } else {
-        HV_ALLOC(io->readbuf.base, len);
+        base = readbuf_pool_get(io->loop, len);
+        // NOTE: unread data is in [head, tail)
+        if (io->readbuf.base && io->readbuf.tail) {
+            memcpy(base, io->readbuf.base, MIN(io->readbuf.tail, (size_t)len));
+        }
+        if (owned) {
+            readbuf_pool_put(io->loop, io->readbuf.base, io->readbuf.len);
+        }
     }
+    io->readbuf.base = base;
     io->readbuf.len = len;
     io->alloced_readbuf = 1;
+    io->released_readbuf = 0;
     io->small_readbytes_cnt = 0;
 }
 
 void hio_free_readbuf(hio_t* io) {
     if (hio_is_alloced_readbuf(io)) {
-        HV_FREE(io->readbuf.base);
+        if (!io->released_readbuf) {
+            readbuf_pool_put(io->loop, io->readbuf.base, io->readbuf.len);
+        }
         io->alloced_readbuf = 0;
+        io->released_readbuf = 0;
         // reset to loop->readbuf
         io->readbuf.base = io->loop->readbuf.base;
         io->readbuf.len = io->loop->readbuf.len;
     }
 }
 
+void hio_release_readbuf(hio_t* io) {
+    if (!hio_is_alloced_readbuf(io) || io->released_readbuf) return;
+    if (io->readbuf.head != io->readbuf.tail) return;
+    readbuf_pool_put(io->loop, io->readbuf.base, io->readbuf.len);
+    io->readbuf.base = NULL;
+    io->readbuf.head = io->readbuf.tail = 0;
+    io->released_readbuf = 1;
+}
+
+void hio_acquire_readbuf(hio_t* io) {
+    if (!io->released_readbuf) return;
+    io->readbuf.base = readbuf_pool_get(io->loop, io->readbuf.len);
+    io->released_readbuf = 0;
+}
+
 void hio_memmove_readbuf(hio_t* io) {
     fifo_buf_t* buf = &io->readbuf;
     if (buf->tail == buf->head) {
@@ -745,6 +836,7 @@ void hio_set_readbuf(hio_t* io, void* buf, size_t len) {
 }
 
 hio_readbuf_t* hio_get_readbuf(hio_t* io) {
+    hio_acquire_readbuf(io);
     return &io->readbuf;
 }
 
@@ -793,19 +885,15 @@ int hio_read_until_length(hio_t* io, unsigned int len) {
 int hio_read_until_delim(hio_t* io, unsigned char delim) {
     if (io->readbuf.tail - io->readbuf.head > 0) {
         const unsigned char* sp = (const unsigned char*)io->readbuf.base + io->readbuf.head;
-        const unsigned char* ep = (const unsigned char*)io->readbuf.base + io->readbuf.tail;
-        const unsigned char* p = sp;
-        while (p <= ep) {
-            if (*p == delim) {
-                int len = p - sp + 1;
-                io->readbuf.head += len;
-                if (io->readbuf.head == io->readbuf.tail) {
-                    io->readbuf.head = io->readbuf.tail = 0;
-                }
-                hio_read_cb(io, (void*)sp, len);
-                return len;
+        const unsigned char* p = (const unsigned char*)memchr(sp, delim, io->readbuf.tail - io->readbuf.head);
+        if (p) {
+            int len = p - sp + 1;
+            io->readbuf.head += len;
+            if (io->readbuf.head == io->readbuf.tail) {
+                io->readbuf.head = io->readbuf.tail = 0;
             }
-            ++p;
+            hio_read_cb(io, (void*)sp, len);
+            return len;
         }
     }
     io->read_flags = HIO_READ_UNTIL_DELIM;
@@ -830,6 +918,7 @@ int hio_read_remain(hio_t* io) {
 
 //-----------------unpack---------------------------------------------
 void hio_set_unpack(hio_t* io, unpack_setting_t* setting) {
+    hio_unset_codec(io);
     hio_unset_unpack(io);
     if (setting == NULL) return;
 
@@ -856,13 +945,13 @@ void hio_set_unpack(hio_t* io, unpack_setting_t* setting) {
     }
 
     // NOTE: unpack must have own readbuf
+    int len = MIN(HLOOP_READ_BUFSIZE, io->unpack_setting->package_max_length);
     if (io->unpack_setting->mode == UNPACK_BY_FIXED_LENGTH) {
-        io->readbuf.len = io->unpack_setting->fixed_length;
-    } else {
-        io->readbuf.len = MIN(HLOOP_READ_BUFSIZE, io->unpack_setting->package_max_length);
+        // read as many packages as fit at once
+        len = MAX(len, io->unpack_setting->fixed_length);
     }
     io->max_read_bufsize = io->unpack_setting->package_max_length;
-    hio_alloc_readbuf(io, io->readbuf.len);
+    hio_alloc_readbuf(io, len);
 }
 
 void hio_unset_unpack(hio_t* io) {
@@ -873,6 +962,55 @@ void hio_unset_unpack(hio_t* io) {
     }
 }
 
+//-----------------codec---------------------------------------------
+void hio_set_codec(hio_t* io, hio_codec_t* codec) {
+    hio_unset_unpack(io);
+    hio_unset_codec(io);
+    if (codec == NULL) return;
+
+    io->codec = codec;
+    if (codec->max_frame_length == 0) {
+        codec->max_frame_length = DEFAULT_PACKAGE_MAX_LENGTH;
+    }
+    // NOTE: codec must have own readbuf
+    io->max_read_bufsize = codec->max_frame_length;
+    hio_alloc_readbuf(io, MIN(HLOOP_READ_BUFSIZE, codec->max_frame_length));
+}
+
+void hio_unset_codec(hio_t* io) {
+    if (io->codec) {
+        io->codec = NULL;
+        // NOTE: codec has own readbuf
+        hio_free_readbuf(io);
+    }
+}
+
+int hio_write_codec(hio_t* io, const void* buf, size_t len) {
+    hio_codec_t* codecs[HIO_CODEC_MAX_DEPTH];
+    int depth = 0;
+    for (hio_codec_t* codec = io->codec; codec; codec = codec->next) {
+        if (depth == HIO_CODEC_MAX_DEPTH) {
+            hloge("codec stack over %d!", HIO_CODEC_MAX_DEPTH);
+            return -ERR_OVER_LIMIT;
+        }
+        codecs[depth++] = codec;
+    }
+    hio_iovec_t iov[HIO_CODEC_MAX_IOVCNT];
+    iov[0].base = buf;
+    iov[0].len = len;
+    int iovcnt = 1;
+    char scratch[HIO_CODEC_MAX_DEPTH][HIO_CODEC_SCRATCH_BYTES];
+    // top to bottom
+    while (depth--) {
+        hio_codec_t* codec = codecs[depth];
+        if (codec->encode == NULL) continue;
+        iovcnt = codec->encode(codec, io, iov, iovcnt, scratch[depth]);
+        if (iovcnt < 0) return iovcnt;
+        assert(iovcnt <= HIO_CODEC_MAX_IOVCNT);
+    }
+    return hio_writev(io, iov, iovcnt);
+}
+
 //-----------------upstream---------------------------------------------
 void hio_read_upstream(hio_t* io) {
     hio_t* upstream_io = io->upstream_io;
@@ -910,6 +1048,13 @@ void hio_close_upstream(hio_t* io) {
 }
 
 void hio_setup_upstream(hio_t* io1, hio_t* io2) {
+    if (io2 == NULL) {
+        if (io1->upstream_io && io1->upstream_io->upstream_io == io1) {
+            io1->upstream_io->upstream_io = NULL;
+        }
+        io1->upstream_io = NULL;
+        return;
+    }
     io1->upstream_io = io2;
     io2->upstream_io = io1;
 }
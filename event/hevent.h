@@ -18,6 +18,11 @@
 #define WRITE_BUFSIZE_HIGH_WATER    (1U << 23)  // 8M
 #define MAX_READ_BUFSIZE            (1U << 24)  // 16M
 #define MAX_WRITE_BUFSIZE           (1U << 24)  // 16M
+#define HIO_READ_BUDGET             (1U << 18)  // 256K per io per loop iteration, for HLOOP_FLAG_EDGE_TRIGGERED
+#define READBUF_POOL_CLASSES        8           // HLOOP_READ_BUFSIZE << 0..7 => 8K ~ 1M
+#define READBUF_POOL_MAX_BYTES      (1U << 24)  // 16M per loop
+#define HRELAY_PIPE_SIZE            (1U << 18)  // 256K, F_SETPIPE_SZ, for hio_setup_relay
+#define HRELAY_PIPE_POOL_SIZE       64          // idle pipes per loop
 
 // hio_read_flags
 #define HIO_READ_ONCE           0x1
@@ -61,11 +66,27 @@ struct hloop_s {
     uint32_t                    nios;
     // one loop per thread, so one readbuf per loop is OK.
     hbuf_t                      readbuf;
+    // free lists of alloced readbufs sized HLOOP_READ_BUFSIZE << i
+    void*                       readbuf_pool[READBUF_POOL_CLASSES];
+    uint32_t                    readbuf_pool_bytes;
+    // idle pipes for splice of hio_setup_relay
+    int                         relay_pipes[HRELAY_PIPE_POOL_SIZE][2];
+    uint32_t                    nrelay_pipes;
     void*                       iowatcher;
+    // HLOOP_FLAG_EDGE_TRIGGERED: ios which used up HIO_READ_BUDGET or maybe missed an edge
+    struct list_head            ready_ios;
     // custom_events
     int                         eventfds[2];
     event_queue                 custom_events;
     hmutex_t                    custom_events_mutex;
+    // NULL unless hloop_enable_metrics
+    hloop_metrics_t*            metrics;
+    // watchdog: 0 unless hloop_enable_watchdog
+    volatile uint32_t           stall_ms;
+    // odd when in callback, changed by each callback
+    volatile uint32_t           cb_seq;
+    volatile int                cur_event_type;
+    void* volatile              cur_event_cb;
 };
 
 uint64_t hloop_next_event_id();
@@ -119,6 +140,8 @@ struct hio_s {
     unsigned    close       :1;
     unsigned    alloced_readbuf :1; // for hio_alloc_readbuf
     unsigned    alloced_ssl_ctx :1; // for hio_new_ssl_ctx
+    unsigned    read_again  :1; // in loop->ready_ios
+    unsigned    released_readbuf :1; // alloced readbuf is in loop->readbuf_pool while idle
 // public:
     hio_type_e  io_type;
     uint32_t    id; // fd cannot be used as unique identifier, so we provide an id
@@ -140,6 +163,7 @@ struct hio_s {
     };
     uint32_t            max_read_bufsize;
     uint32_t            small_readbytes_cnt; // for readbuf autosize
+    struct list_node    ready_node;          // for hio_read_again
     // write
     struct write_queue  write_queue;
     hrecursive_mutex_t  write_mutex; // lock write and write_queue
@@ -167,8 +191,10 @@ struct hio_s {
     htimer_t*   heartbeat_timer;
     // upstream
     struct hio_s*       upstream_io;    // for hio_setup_upstream
+    struct hrelay_s*    relay;          // for hio_setup_relay
     // unpack
     unpack_setting_t*   unpack_setting; // for hio_set_unpack
+    hio_codec_t*        codec;          // for hio_set_codec
     // ssl
     void*       ssl;        // for hio_set_ssl
     void*       ssl_ctx;    // for hio_set_ssl_ctx
@@ -216,6 +242,9 @@ void hio_read_cb(hio_t* io, void* buf, int len);
 void hio_write_cb(hio_t* io, const void* buf, int len);
 void hio_close_cb(hio_t* io);
 
+// HLOOP_FLAG_EDGE_TRIGGERED: read io in the next loop iteration without waiting for an edge.
+void hio_read_again(hio_t* io);
+
 void hio_del_connect_timer(hio_t* io);
 void hio_del_close_timer(hio_t* io);
 void hio_del_read_timer(hio_t* io);
@@ -240,12 +269,38 @@ static inline bool hio_is_alloced_readbuf(hio_t* io) {
 }
 void hio_alloc_readbuf(hio_t* io, int len);
 void hio_free_readbuf(hio_t* io);
+// HLOOP_FLAG_RELEASE_IDLE_BUFFERS
+void hio_release_readbuf(hio_t* io);
+void hio_acquire_readbuf(hio_t* io);
+void hloop_cleanup_readbuf_pool(hloop_t* loop);
+void hloop_cleanup_relay_pipes(hloop_t* loop);
 void hio_memmove_readbuf(hio_t* io);
 
 #define EVENT_ENTRY(p)          container_of(p, hevent_t, pending_node)
 #define IDLE_ENTRY(p)           container_of(p, hidle_t,  node)
 #define TIMER_ENTRY(p)          container_of(p, htimer_t, node)
 
+// metrics updated in loop thread
+#define HLOOP_METRICS_ADD(loop, field, n) \
+    do {\
+        if ((loop)->metrics) (loop)->metrics->field += (n);\
+    } while(0)
+
+// metrics maybe updated in other threads, e.g. hio_write
+#if defined(_MSC_VER)
+#define HLOOP_METRICS_ATOMIC_ADD(loop, field, n) \
+    do {\
+        if ((loop)->metrics) InterlockedExchangeAdd64((volatile LONG64*)&(loop)->metrics->field, (LONG64)(n));\
+    } while(0)
+#elif defined(__GNUC__) || defined(__clang__)
+#define HLOOP_METRICS_ATOMIC_ADD(loop, field, n) \
+    do {\
+        if ((loop)->metrics) __atomic_fetch_add(&(loop)->metrics->field, (n), __ATOMIC_RELAXED);\
+    } while(0)
+#else
+#define HLOOP_METRICS_ATOMIC_ADD    HLOOP_METRICS_ADD
+#endif
+
 #define EVENT_ACTIVE(ev) \
     if (!ev->active) {\
         ev->active = 1;\
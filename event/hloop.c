@@ -61,6 +61,9 @@ static int __hloop_process_timers(struct heap* timers, uint64_t timeout) {
         if (timer->next_timeout > timeout) {
             break;
         }
+        if (timer->loop->metrics) {
+            hloop_histogram_observe(&timer->loop->metrics->lag, timeout - timer->next_timeout);
+        }
         if (timer->repeat != INFINITE) {
             --timer->repeat;
         }
@@ -106,12 +109,39 @@ static int hloop_process_ios(hloop_t* loop, int timeout) {
     return nevents < 0 ? 0 : nevents;
 }
 
+static int hloop_process_ready_ios(hloop_t* loop) {
+    int nios = 0;
+    struct list_node* node = loop->ready_ios.next;
+    while (node != &loop->ready_ios) {
+        hio_t* io = container_of(node, hio_t, ready_node);
+        node = node->next;
+        list_del(&io->ready_node);
+        io->read_again = 0;
+        if (io->active && (io->events & HV_READ)) {
+            io->revents |= HV_READ;
+            EVENT_PENDING(io);
+            ++nios;
+        }
+    }
+    return nios;
+}
+
+void hio_read_again(hio_t* io) {
+    if (io->read_again) return;
+    io->read_again = 1;
+    list_add_tail(&io->ready_node, &io->loop->ready_ios);
+}
+
 static int hloop_process_pendings(hloop_t* loop) {
     if (loop->npendings == 0) return 0;
 
     hevent_t* cur = NULL;
     hevent_t* next = NULL;
     int ncbs = 0;
+    hloop_metrics_t* metrics = loop->metrics;
+    int watched = loop->stall_ms != 0;
+    uint64_t ready_hrtime = loop->cur_hrtime;
+    uint64_t begin_hrtime = 0;
     // NOTE: invoke event callback from high to low sorted by priority.
     for (int i = HEVENT_PRIORITY_SIZE-1; i >= 0; --i) {
         cur = loop->pendings[i];
@@ -119,7 +149,25 @@ static int hloop_process_pendings(hloop_t* loop) {
             next = cur->pending_next;
             if (cur->pending) {
                 if (cur->active && cur->cb) {
-                    cur->cb(cur);
+                    if (watched) {
+                        loop->cur_event_type = cur->event_type;
+                        loop->cur_event_cb = (void*)cur->cb;
+                        ++loop->cb_seq;
+                    }
+                    if (metrics) {
+                        begin_hrtime = gethrtime_us();
+                        // NOTE: lag of timers is observed in hloop_process_timers
+                        if (cur->event_type != HEVENT_TYPE_TIMEOUT && cur->event_type != HEVENT_TYPE_PERIOD) {
+                            hloop_histogram_observe(&metrics->lag, begin_hrtime - ready_hrtime);
+                        }
+                        cur->cb(cur);
+                        hloop_histogram_observe(&metrics->callback, gethrtime_us() - begin_hrtime);
+                    } else {
+                        cur->cb(cur);
+                    }
+                    if (watched) {
+                        ++loop->cb_seq;
+                    }
                     ++ncbs;
                 }
                 cur->pending = 0;
@@ -160,12 +208,23 @@ int hloop_process_events(hloop_t* loop, int timeout_ms) {
         blocktime_ms = MIN(blocktime_ms, timeout_ms);
     }
 
+    // NOTE: do not block if some ios are still readable
+    if (!list_empty(&loop->ready_ios)) {
+        blocktime_ms = 0;
+    }
+
+    uint64_t poll_begin_hrtime = loop->metrics ? gethrtime_us() : 0;
     if (loop->nios) {
         nios = hloop_process_ios(loop, blocktime_ms);
+        nios += hloop_process_ready_ios(loop);
     } else {
         hv_msleep(blocktime_ms);
     }
     hloop_update_time(loop);
+    if (loop->metrics) {
+        ++loop->metrics->loops;
+        hloop_histogram_observe(&loop->metrics->poll_wait, loop->cur_hrtime - poll_begin_hrtime);
+    }
     // wakeup by hloop_stop
     if (loop->status == HLOOP_STATUS_STOP) {
         return 0;
@@ -224,6 +283,7 @@ static void eventfd_read_cb(hio_t* io, void* buf, int readbytes) {
         event_queue_pop_front(&loop->custom_events);
         // NOTE: unlock before cb, avoid deadlock if hloop_post_event called in cb.
         hmutex_unlock(&loop->custom_events_mutex);
+        HLOOP_METRICS_ADD(loop, custom_events, 1);
         if (ev.cb) {
             ev.cb(&ev);
         }
@@ -307,10 +367,89 @@ void hloop_post_event(hloop_t* loop, hevent_t* ev) {
         event_queue_init(&loop->custom_events, CUSTOM_EVENT_QUEUE_INIT_SIZE);
     }
     event_queue_push_back(&loop->custom_events, ev);
+    HLOOP_METRICS_ADD(loop, custom_events_posted, 1);
 unlock:
     hmutex_unlock(&loop->custom_events_mutex);
 }
 
+// loops with metrics enabled
+static honce_t      s_metrics_once = HONCE_INIT;
+static hmutex_t     s_metrics_mutex;
+static hloop_t**    s_metrics_loops = NULL;
+static int          s_metrics_nloops = 0;
+static int          s_metrics_maxloops = 0;
+
+static void hloop_metrics_mutex_init() {
+    hmutex_init(&s_metrics_mutex);
+}
+
+static void hloop_metrics_register(hloop_t* loop) {
+    honce(&s_metrics_once, hloop_metrics_mutex_init);
+    hmutex_lock(&s_metrics_mutex);
+    if (s_metrics_nloops == s_metrics_maxloops) {
+        int maxloops = s_metrics_maxloops ? s_metrics_maxloops * 2 : 16;
+        s_metrics_loops = (hloop_t**)hv_realloc(s_metrics_loops,
+                sizeof(hloop_t*) * maxloops, sizeof(hloop_t*) * s_metrics_maxloops);
+        s_metrics_maxloops = maxloops;
+    }
+    s_metrics_loops[s_metrics_nloops++] = loop;
+    hmutex_unlock(&s_metrics_mutex);
+}
+
+static void hloop_metrics_unregister(hloop_t* loop) {
+    hmutex_lock(&s_metrics_mutex);
+    for (int i = 0; i < s_metrics_nloops; ++i) {
+        if (s_metrics_loops[i] == loop) {
+            s_metrics_loops[i] = s_metrics_loops[--s_metrics_nloops];
+            break;
+        }
+    }
+    hmutex_unlock(&s_metrics_mutex);
+}
+
+void hloop_histogram_observe(hloop_histogram_t* histogram, uint64_t us) {
+    int i = 0;
+    if (us > 1) {
+#if defined(__GNUC__) || defined(__clang__)
+        i = 64 - __builtin_clzll(us - 1);
+#else
+        uint64_t n = us - 1;
+        while (n) { ++i; n >>= 1; }
+#endif
+        if (i > HLOOP_HISTOGRAM_BUCKETS) i = HLOOP_HISTOGRAM_BUCKETS;
+    }
+    ++histogram->buckets[i];
+    ++histogram->count;
+    histogram->sum += us;
+}
+
+int hloop_enable_metrics(hloop_t* loop) {
+    if (loop->metrics) return 0;
+    hloop_metrics_t* metrics = NULL;
+    HV_ALLOC_SIZEOF(metrics);
+    loop->metrics = metrics;
+    hloop_metrics_register(loop);
+    return 0;
+}
+
+hloop_metrics_t* hloop_metrics(hloop_t* loop) {
+    return loop->metrics;
+}
+
+void hloop_metrics_foreach(hloop_metrics_cb cb, void* userdata) {
+    honce(&s_metrics_once, hloop_metrics_mutex_init);
+    hmutex_lock(&s_metrics_mutex);
+    for (int i = 0; i < s_metrics_nloops; ++i) {
+        cb(s_metrics_loops[i], s_metrics_loops[i]->metrics, userdata);
+    }
+    hmutex_unlock(&s_metrics_mutex);
+}
+
+int hloop_enable_idle_release(hloop_t* loop) {
+    loop->flags |= HLOOP_FLAG_RELEASE_IDLE_BUFFERS;
+    return 0;
+}
+
 static void hloop_init(hloop_t* loop) {
 #ifdef OS_WIN
     WSAInit();
@@ -327,6 +466,9 @@ static void hloop_init(hloop_t* loop) {
     // idles
     list_init(&loop->idles);
 
+    // ready ios
+    list_init(&loop->ready_ios);
+
     // timers
     heap_init(&loop->timers, timers_compare);
     heap_init(&loop->realtimers, timers_compare);
@@ -381,6 +523,9 @@ static void hloop_cleanup(hloop_t* loop) {
     }
     list_init(&loop->idles);
 
+    // ready ios
+    list_init(&loop->ready_ios);
+
     // timers
     printd("cleanup timers...\n");
     htimer_t* timer;
@@ -411,6 +556,8 @@ static void hloop_cleanup(hloop_t* loop) {
         loop->readbuf.base = NULL;
         loop->readbuf.len = 0;
     }
+    hloop_cleanup_readbuf_pool(loop);
+    hloop_cleanup_relay_pipes(loop);
 
     // iowatcher
     iowatcher_cleanup(loop);
@@ -421,6 +568,17 @@ static void hloop_cleanup(hloop_t* loop) {
     event_queue_cleanup(&loop->custom_events);
     hmutex_unlock(&loop->custom_events_mutex);
     hmutex_destroy(&loop->custom_events_mutex);
+
+    // watchdog
+    if (loop->stall_ms) {
+        hloop_disable_watchdog(loop);
+    }
+
+    // metrics
+    if (loop->metrics) {
+        hloop_metrics_unregister(loop);
+        HV_FREE(loop->metrics);
+    }
 }
 
 hloop_t* hloop_new(int flags) {
@@ -428,6 +586,10 @@ hloop_t* hloop_new(int flags) {
     HV_ALLOC_SIZEOF(loop);
     hloop_init(loop);
     loop->flags |= flags;
+#if !defined(EVENT_EPOLL) || defined(OS_WIN)
+    // NOTE: wepoll does not support EPOLLET
+    loop->flags &= ~HLOOP_FLAG_EDGE_TRIGGERED;
+#endif
     hlogd("hloop_new tid=%ld", loop->tid);
     return loop;
 }
@@ -853,6 +1015,11 @@ int hio_add(hio_t* io, hio_cb cb, int events) {
     }
 
     if (!(io->events & events)) {
+        // NOTE: edge-triggered: an edge maybe missed while not reading, so read it once.
+        if ((loop->flags & HLOOP_FLAG_EDGE_TRIGGERED) &&
+            io->events && (events & HV_READ) && !(io->events & HV_READ)) {
+            hio_read_again(io);
+        }
         iowatcher_add_event(loop, io->fd, events);
         io->events |= events;
     }
@@ -872,6 +1039,10 @@ int hio_del(hio_t* io, int events) {
         io->events &= ~events;
     }
     if (io->events == 0) {
+        if (io->read_again) {
+            io->read_again = 0;
+            list_del(&io->ready_node);
+        }
         io->loop->nios--;
         // NOTE: not EVENT_DEL, avoid free
         EVENT_INACTIVE(io);
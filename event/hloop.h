@@ -131,6 +131,13 @@ BEGIN_EXTERN_C
 #define HLOOP_FLAG_RUN_ONCE                     0x00000001
 #define HLOOP_FLAG_AUTO_FREE                    0x00000002
 #define HLOOP_FLAG_QUIT_WHEN_NO_ACTIVE_EVENTS   0x00000004
+// NOTE: epoll only, ignored by other iowatchers.
+// Register each fd once with EPOLLIN|EPOLLOUT|EPOLLET, read until EAGAIN within HIO_READ_BUDGET bytes,
+// ios still readable after that are read again in the next loop iteration.
+#define HLOOP_FLAG_EDGE_TRIGGERED               0x00000008
+// Give alloced readbufs back to a per-loop pool when drained, and free empty write queues,
+// so idle connections hold no buffers, @see hloop_enable_idle_release
+#define HLOOP_FLAG_RELEASE_IDLE_BUFFERS         0x00000010
 HV_EXPORT hloop_t* hloop_new(int flags DEFAULT(HLOOP_FLAG_AUTO_FREE));
 
 // WARN: Forbid to call hloop_free if HLOOP_FLAG_AUTO_FREE set.
@@ -175,6 +182,80 @@ HV_EXPORT uint32_t hloop_nactives(hloop_t* loop);
 HV_EXPORT void  hloop_set_userdata(hloop_t* loop, void* userdata);
 HV_EXPORT void* hloop_userdata(hloop_t* loop);
 
+// metrics
+// NOTE: buckets[i] counts values <= 2^i us (1us ~ 16.7s), buckets[HLOOP_HISTOGRAM_BUCKETS] counts the rest.
+#define HLOOP_HISTOGRAM_BUCKETS     25
+typedef struct hloop_histogram_s {
+    uint64_t    buckets[HLOOP_HISTOGRAM_BUCKETS + 1];
+    uint64_t    count;
+    uint64_t    sum;    // us
+} hloop_histogram_t;
+
+HV_EXPORT void hloop_histogram_observe(hloop_histogram_t* histogram, uint64_t us);
+
+// NOTE: Only written by the loop thread (except write counters updated atomically by hio_write),
+// readers in other threads get a slightly stale view without lock.
+typedef struct hloop_metrics_s {
+    hloop_histogram_t   poll_wait;      // us blocked in poll
+    hloop_histogram_t   callback;       // us spent in each callback
+    hloop_histogram_t   lag;            // us from event ready (poll returned or timer due) to callback
+    uint64_t            loops;
+    uint64_t            accepts;
+    uint64_t            connects;
+    uint64_t            closes;
+    uint64_t            reads;
+    uint64_t            read_bytes;
+    uint64_t            read_eagains;
+    uint64_t            writes;
+    uint64_t            write_bytes;
+    uint64_t            write_eagains;
+    int64_t             write_queue_bytes;      // bytes waiting in write queues
+    uint64_t            custom_events_posted;   // by hloop_post_event
+    uint64_t            custom_events;          // handled
+    uint64_t            stalls;                 // reported by watchdog
+    uint64_t            poll_ctls;              // epoll_ctl calls
+} hloop_metrics_t;
+
+// NOTE: metrics are disabled by default, enable it before hloop_run to avoid the cost.
+HV_EXPORT int hloop_enable_metrics(hloop_t* loop);
+// @return NULL if not enabled
+HV_EXPORT hloop_metrics_t* hloop_metrics(hloop_t* loop);
+// call cb for each loop with metrics enabled, loops can not be freed during it.
+typedef void (*hloop_metrics_cb)(hloop_t* loop, hloop_metrics_t* metrics, void* userdata);
+HV_EXPORT void hloop_metrics_foreach(hloop_metrics_cb cb, void* userdata);
+
+// set HLOOP_FLAG_RELEASE_IDLE_BUFFERS, call it in loop thread.
+HV_EXPORT int hloop_enable_idle_release(hloop_t* loop);
+
+// watchdog
+/*
+ * A watchdog thread checks the watched loops, when a callback has been
+ * running longer than stall_ms, it logs the event type, the callback and
+ * the stack of the stuck loop thread, and counts it in metrics->stalls.
+ *
+ * NOTE: On linux with glibc (x86_64, aarch64), the stack is captured by
+ * HLOOP_WATCHDOG_SIGNAL sent to the loop thread: the handler only saves its
+ * registers, the watchdog thread walks the frame pointers, so frames of code
+ * built without -fno-omit-frame-pointer are missing after the stuck one.
+ * The signal is installed with SA_RESTART, but still interrupts the syscalls
+ * never restarted, e.g. sleep, nanosleep, poll, epoll_wait, select and socket
+ * reads or writes with a timeout, which return EINTR in the stuck callback.
+ * The handler is installed at the first hloop_enable_watchdog, a handler
+ * installed before is kept and still called for the signals not sent by
+ * the watchdog. Define HLOOP_WATCHDOG_SIGNAL to another signal ignored by
+ * default if the application uses SIGURG, or to 0 to send no signal and only
+ * log the event type and the callback, sampled by the watchdog thread.
+ *
+ * hloop_enable_watchdog(loop, 1000);
+ *
+ */
+#ifndef HLOOP_WATCHDOG_SIGNAL
+#define HLOOP_WATCHDOG_SIGNAL   SIGURG
+#endif
+// @param stall_ms: 0 means disable, can be called in any thread.
+HV_EXPORT int  hloop_enable_watchdog(hloop_t* loop, uint32_t stall_ms);
+HV_EXPORT void hloop_disable_watchdog(hloop_t* loop);
+
 // custom_event
 /*
  * hevent_t ev;
@@ -376,6 +457,13 @@ HV_EXPORT int hio_read_remain(hio_t* io);
 // NOTE: hio_write is thread-safe, locked by recursive_mutex, allow to be called by other threads.
 // hio_try_write => hio_add(io, HV_WRITE) => write => hwrite_cb
 HV_EXPORT int hio_write  (hio_t* io, const void* buf, size_t len);
+typedef struct hio_iovec_s {
+    const void* base;
+    size_t      len;
+} hio_iovec_t;
+// hio_writev writes bufs in order as one hio_write would, with one writev/sendmsg if possible.
+// NOTE: bufs are concatenated for datagram and ssl, to keep one message in one datagram or record.
+HV_EXPORT int hio_writev (hio_t* io, const hio_iovec_t* iov, int iovcnt);
 
 // NOTE: hio_close is thread-safe, hio_close_async will be called actually in other thread.
 // hio_del(io, HV_RDWR) => close => hclose_cb
@@ -461,6 +549,7 @@ HV_EXPORT void   hio_close_upstream(hio_t* io);
 
 // io1->upstream_io = io2;
 // io2->upstream_io = io1;
+// hio_setup_upstream(io, NULL) detaches io and its upstream_io from each other.
 // @see examples/socks5_proxy_server.c
 HV_EXPORT void   hio_setup_upstream(hio_t* io1, hio_t* io2);
 
@@ -478,6 +567,56 @@ HV_EXPORT hio_t* hio_setup_tcp_upstream(hio_t* io, const char* host, int port, i
 // @see examples/udp_proxy_server.c
 HV_EXPORT hio_t* hio_setup_udp_upstream(hio_t* io, const char* host, int port);
 
+//-----------------relay---------------------------------------------
+/*
+ * hio_setup_relay relays bytes between two connected ios in both directions, like upstream,
+ * with backpressure, half-close and byte accounting.
+ *
+ * splice mode: linux, plain tcp on both sides,
+ *              socket => pipe => socket by splice(2) in the loop, without copy to user space.
+ *              The pipes come from a per-loop pool, up to HRELAY_PIPE_SIZE buffered per direction.
+ *              EOF of one side shutdown(SHUT_WR) the other side after the pipe drained.
+ * copy mode:   otherwise, e.g. ssl,
+ *              hio_read => hio_write, reading stops while the peer write buffer exceeds the watermark.
+ *
+ * Both ios are closed together, then the close cb of the relay is called.
+ * The close cbs of the ios set before hio_setup_relay are still called.
+ * NOTE: relayed ios belong to the relay, do not hio_read/hio_write them in other threads.
+ * @see examples/tcp_proxy_server.c protocol/proxy_server.h
+ */
+#define HRELAY_DEFAULT_WATERMARK    (1U << 18)  // 256K
+
+typedef struct hrelay_s hrelay_t;
+typedef void (*hrelay_cb)(hrelay_t* relay);
+
+typedef struct hrelay_stats_s {
+    uint64_t    bytes[2];       // [0]: io1 => io2, [1]: io2 => io1
+    uint64_t    start_hrtime;   // us
+    uint64_t    end_hrtime;     // us, 0 while relaying
+    int         spliced;        // 1 if splice mode
+    int         error;          // the first error of both ios
+} hrelay_stats_t;
+
+// @param splice: 0 forces copy mode
+// @return NULL if io1 or io2 is closed
+HV_EXPORT hrelay_t* hio_setup_relay(hio_t* io1, hio_t* io2, int splice DEFAULT(1));
+// @tcp_relay: hio_create_socket -> hio_connect -> on_connect -> hio_setup_relay(io, upstream_io)
+// @return upstream_io
+HV_EXPORT hio_t*    hio_setup_tcp_relay(hio_t* io, const char* host, int port, int ssl DEFAULT(0));
+// @return io->relay, NULL if not relayed
+HV_EXPORT hrelay_t* hio_get_relay(hio_t* io);
+
+HV_EXPORT hio_t*    hrelay_io(hrelay_t* relay, int index);
+HV_EXPORT void      hrelay_setcb_close(hrelay_t* relay, hrelay_cb close_cb);
+HV_EXPORT void      hrelay_set_userdata(hrelay_t* relay, void* userdata);
+HV_EXPORT void*     hrelay_userdata(hrelay_t* relay);
+// copy mode: stop reading while the peer write buffer exceeds watermark,
+// resume when it drains to watermark / 2. HRELAY_DEFAULT_WATERMARK by default.
+HV_EXPORT void      hrelay_set_watermark(hrelay_t* relay, uint32_t watermark);
+HV_EXPORT void      hrelay_get_stats(hrelay_t* relay, hrelay_stats_t* stats);
+// hio_close both ios
+HV_EXPORT void      hrelay_close(hrelay_t* relay);
+
 //-----------------unpack---------------------------------------------
 typedef enum {
     UNPACK_MODE_NONE        = 0,
@@ -558,6 +697,60 @@ typedef struct unpack_setting_s {
 HV_EXPORT void hio_set_unpack(hio_t* io, unpack_setting_t* setting);
 HV_EXPORT void hio_unset_unpack(hio_t* io);
 
+//-----------------codec---------------------------------------------
+/*
+ * codec: for framing which unpack_setting_t can not describe,
+ *        e.g. RESP, HTTP chunked, length + checksum.
+ *
+ * hio_read => codec->decode(readbuf) => hio_codec_emit(frame)
+ *          => codec->next->decode(frame) => hio_codec_emit(frame) => ... => hread_cb(frame)
+ * hio_write_codec(msg) => ... => codec->next->encode(iov) => codec->encode(iov) => hio_writev(iov)
+ *
+ * The first codec decodes io->readbuf in place, frames are pointers into it, not copies.
+ * codec->next is stacked upon codec, it gets complete frames and must consume them whole.
+ * TLS is below all codecs, readbuf is already decrypted.
+ *
+ * NOTE: Like unpack_setting_t, only the pointer of hio_codec_t is stored in hio_t,
+ *       the life time of hio_codec_t shoud be guaranteed by caller.
+ *       A codec which keeps state of a connection in userdata must not be shared by IOs.
+ */
+#define HIO_CODEC_MAX_DEPTH     8
+#define HIO_CODEC_MAX_IOVCNT    16
+#define HIO_CODEC_SCRATCH_BYTES 64
+
+typedef struct hio_codec_s hio_codec_t;
+struct hio_codec_s {
+    /*
+     * decode buf, call hio_codec_emit for each frame.
+     * @return bytes consumed, the rest will be passed again with more data appended,
+     *         < 0 on error, io will be closed.
+     * NULL means pass through.
+     */
+    int (*decode)(hio_codec_t* codec, hio_t* io, void* buf, int len);
+    /*
+     * encode iov[0, iovcnt) in place, at most HIO_CODEC_MAX_IOVCNT bufs.
+     * scratch has HIO_CODEC_SCRATCH_BYTES for small heads and tails,
+     * bufs must be valid until hio_write_codec returns.
+     * @return iovcnt, < 0 on error.
+     * NULL means pass through.
+     * NOTE: encode is called in the thread calling hio_write_codec.
+     */
+    int (*encode)(hio_codec_t* codec, hio_t* io, hio_iovec_t* iov, int iovcnt, char* scratch);
+    unsigned int    max_frame_length; // 0 means DEFAULT_PACKAGE_MAX_LENGTH
+    void*           userdata;
+    hio_codec_t*    next;
+};
+
+// NOTE: codec and unpack are exclusive, the later one replaces the former.
+HV_EXPORT void hio_set_codec(hio_t* io, hio_codec_t* codec);
+HV_EXPORT void hio_unset_codec(hio_t* io);
+// pass frame to codec->next, or to hread_cb if codec is the top.
+// @return len, < 0 on error
+HV_EXPORT int  hio_codec_emit(hio_codec_t* codec, hio_t* io, void* frame, int len);
+// hio_write_codec => encode from top to bottom => hio_writev
+// NOTE: thread-safe like hio_write.
+HV_EXPORT int  hio_write_codec(hio_t* io, const void* buf, size_t len);
+
 // unpack examples
 /*
 unpack_setting_t ftp_unpack_setting;
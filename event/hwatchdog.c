@@ -0,0 +1,275 @@
+#include "hloop.h"
+#include "hevent.h"
+
+#include "hdef.h"
+#include "hbase.h"
+#include "hlog.h"
+#include "htime.h"
+#include "hmutex.h"
+#include "hthread.h"
+
+/*
+ * stack of the stuck loop thread:
+ * the signal handler only saves pc, sp and fp of the loop thread, and waits,
+ * while the watchdog thread walks the frame pointers by process_vm_readv,
+ * which fails instead of crashing on a bad address, and symbolizes them.
+ * So nothing but async-signal-safe code runs in the handler.
+ */
+#if defined(OS_LINUX) && defined(__GLIBC__) && HLOOP_WATCHDOG_SIGNAL && \
+    (defined(__x86_64__) || defined(__aarch64__))
+#define HLOOP_WATCHDOG_BACKTRACE    1
+#include <execinfo.h>
+#include <ucontext.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <signal.h>
+#endif
+
+#define WATCHDOG_MAX_INTERVAL_MS    100
+#define WATCHDOG_CAPTURE_TIMEOUT_MS 100
+#define WATCHDOG_MAX_FRAMES         64
+#define WATCHDOG_MAX_STACK_SIZE     (8 << 20)   // frame pointers further than it from sp are garbage
+
+typedef struct watched_loop_s {
+    hloop_t*    loop;
+    uint32_t    cb_seq;
+    uint64_t    since_ms;   // when cb_seq was first seen
+    int         reported;
+} watched_loop_t;
+
+static honce_t          s_watchdog_once = HONCE_INIT;
+static hmutex_t         s_watchdog_mutex;
+static watched_loop_t*  s_watched_loops = NULL;
+static int              s_watched_nloops = 0;
+static int              s_watched_maxloops = 0;
+static int              s_watchdog_running = 0;
+
+#ifdef HLOOP_WATCHDOG_BACKTRACE
+static struct {
+    volatile long   tid;
+    volatile int    done;       // registers saved by the handler
+    volatile int    walked;     // frames walked by the watchdog thread, the handler returns
+    uintptr_t       pc;
+    uintptr_t       sp;
+    uintptr_t       fp;
+} s_capture;
+// installed before watchdog, called for signals not sent by watchdog
+static struct sigaction s_old_sigaction;
+
+static void watchdog_signal_handler(int signo, siginfo_t* info, void* context) {
+    int saved_errno = errno;
+    if (info && info->si_code == SI_TKILL && info->si_pid == getpid() &&
+        hv_gettid() == s_capture.tid && !s_capture.done) {
+        ucontext_t* uc = (ucontext_t*)context;
+#if defined(__x86_64__)
+        s_capture.pc = uc->uc_mcontext.gregs[REG_RIP];
+        s_capture.sp = uc->uc_mcontext.gregs[REG_RSP];
+        s_capture.fp = uc->uc_mcontext.gregs[REG_RBP];
+#else
+        s_capture.pc = uc->uc_mcontext.pc;
+        s_capture.sp = uc->uc_mcontext.sp;
+        s_capture.fp = uc->uc_mcontext.regs[29];
+#endif
+        __atomic_store_n(&s_capture.done, 1, __ATOMIC_RELEASE);
+        // NOTE: keep the stack unchanged while it is walked, nanosleep is async-signal-safe.
+        struct timespec ts = { 0, 1000000 };
+        for (int i = 0; i < WATCHDOG_CAPTURE_TIMEOUT_MS && !__atomic_load_n(&s_capture.walked, __ATOMIC_ACQUIRE); ++i) {
+            nanosleep(&ts, NULL);
+        }
+    }
+    else if (s_old_sigaction.sa_flags & SA_SIGINFO) {
+        if (s_old_sigaction.sa_sigaction) {
+            s_old_sigaction.sa_sigaction(signo, info, context);
+        }
+    }
+    // NOTE: SIG_DFL of HLOOP_WATCHDOG_SIGNAL is expected to be ignore, like SIGURG.
+    else if (s_old_sigaction.sa_handler != SIG_DFL && s_old_sigaction.sa_handler != SIG_IGN) {
+        s_old_sigaction.sa_handler(signo);
+    }
+    errno = saved_errno;
+}
+
+// @retval 0 if all len bytes at addr are read
+static int watchdog_read(uintptr_t addr, void* buf, size_t len) {
+    struct iovec local = { buf, len };
+    struct iovec remote = { (void*)addr, len };
+    return process_vm_readv(getpid(), &local, 1, &remote, 1, 0) == (ssize_t)len ? 0 : -1;
+}
+
+// NOTE: the walk ends at the first frame of code built without frame pointers.
+static int watchdog_walk_stack(void** frames, int maxframes) {
+    int nframes = 0;
+    frames[nframes++] = (void*)s_capture.pc;
+    uintptr_t sp = s_capture.sp;
+    uintptr_t fp = s_capture.fp;
+    while (nframes < maxframes && fp >= sp && fp - sp < WATCHDOG_MAX_STACK_SIZE &&
+           (fp & (sizeof(uintptr_t) - 1)) == 0) {
+        // saved fp, return address
+        uintptr_t frame[2];
+        if (watchdog_read(fp, frame, sizeof(frame)) != 0 || frame[1] == 0) break;
+        frames[nframes++] = (void*)frame[1];
+        if (frame[0] <= fp) break;
+        fp = frame[0];
+    }
+    return nframes;
+}
+
+static void watchdog_capture_stack(hloop_t* loop) {
+    s_capture.done = 0;
+    s_capture.walked = 0;
+    s_capture.tid = loop->tid;
+    if (syscall(SYS_tgkill, getpid(), loop->tid, HLOOP_WATCHDOG_SIGNAL) != 0) {
+        hlogw("loop[%ld] watchdog signal failed: %s", loop->tid, strerror(errno));
+        s_capture.tid = 0;
+        return;
+    }
+    unsigned int start_ms = gettick_ms();
+    while (!__atomic_load_n(&s_capture.done, __ATOMIC_ACQUIRE)) {
+        if (gettick_ms() - start_ms > WATCHDOG_CAPTURE_TIMEOUT_MS) {
+            hlogw("loop[%ld] watchdog capture stack timeout", loop->tid);
+            break;
+        }
+        hv_msleep(1);
+    }
+    void* frames[WATCHDOG_MAX_FRAMES];
+    int nframes = s_capture.done ? watchdog_walk_stack(frames, WATCHDOG_MAX_FRAMES) : 0;
+    __atomic_store_n(&s_capture.walked, 1, __ATOMIC_RELEASE);
+    s_capture.tid = 0;
+    if (nframes <= 0) return;
+    char** symbols = backtrace_symbols(frames, nframes);
+    if (symbols == NULL) return;
+    for (int i = 0; i < nframes; ++i) {
+        hlogw("  #%d %s", i, symbols[i]);
+    }
+    free(symbols);
+}
+#endif
+
+static const char* event_type_str(int event_type) {
+    switch (event_type) {
+    case HEVENT_TYPE_IO:        return "io";
+    case HEVENT_TYPE_TIMEOUT:   return "timeout";
+    case HEVENT_TYPE_PERIOD:    return "period";
+    case HEVENT_TYPE_IDLE:      return "idle";
+    case HEVENT_TYPE_SIGNAL:    return "signal";
+    default:                    return event_type >= HEVENT_TYPE_CUSTOM ? "custom" : "unknown";
+    }
+}
+
+static void watchdog_report(hloop_t* loop, uint64_t stalled_ms) {
+    HLOOP_METRICS_ATOMIC_ADD(loop, stalls, 1);
+    void* cb = loop->cur_event_cb;
+#ifdef HLOOP_WATCHDOG_BACKTRACE
+    char** symbols = backtrace_symbols(&cb, 1);
+    hlogw("loop[%ld] stalled %llums in %s callback %s", loop->tid, (unsigned long long)stalled_ms,
+            event_type_str(loop->cur_event_type), symbols ? symbols[0] : "");
+    if (symbols) free(symbols);
+    watchdog_capture_stack(loop);
+#else
+    hlogw("loop[%ld] stalled %llums in %s callback %p", loop->tid, (unsigned long long)stalled_ms,
+            event_type_str(loop->cur_event_type), cb);
+#endif
+}
+
+static HTHREAD_ROUTINE(hloop_watchdog_thread) {
+    while (1) {
+        uint32_t interval_ms = WATCHDOG_MAX_INTERVAL_MS;
+        hmutex_lock(&s_watchdog_mutex);
+        if (s_watched_nloops == 0) {
+            s_watchdog_running = 0;
+            hmutex_unlock(&s_watchdog_mutex);
+            break;
+        }
+        uint64_t now_ms = gethrtime_us() / 1000;
+        for (int i = 0; i < s_watched_nloops; ++i) {
+            watched_loop_t* watched = &s_watched_loops[i];
+            hloop_t* loop = watched->loop;
+            uint32_t cb_seq = loop->cb_seq;
+            uint32_t stall_ms = loop->stall_ms;
+            if (cb_seq != watched->cb_seq) {
+                if (watched->reported) {
+                    hlogw("loop[%ld] resumed after stalled %llums", loop->tid,
+                            (unsigned long long)(now_ms - watched->since_ms));
+                }
+                watched->cb_seq = cb_seq;
+                watched->since_ms = now_ms;
+                watched->reported = 0;
+            }
+            // NOTE: cb_seq is odd when in callback
+            else if ((cb_seq & 1) && !watched->reported && now_ms - watched->since_ms >= stall_ms) {
+                watched->reported = 1;
+                watchdog_report(loop, now_ms - watched->since_ms);
+            }
+            interval_ms = MIN(interval_ms, MAX(stall_ms / 4, 1));
+        }
+        hmutex_unlock(&s_watchdog_mutex);
+        hv_msleep(interval_ms);
+    }
+    return 0;
+}
+
+static void hloop_watchdog_init() {
+    hmutex_init(&s_watchdog_mutex);
+#ifdef HLOOP_WATCHDOG_BACKTRACE
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = watchdog_signal_handler;
+    sa.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    sigaction(HLOOP_WATCHDOG_SIGNAL, &sa, &s_old_sigaction);
+#endif
+}
+
+int hloop_enable_watchdog(hloop_t* loop, uint32_t stall_ms) {
+    if (stall_ms == 0) {
+        hloop_disable_watchdog(loop);
+        return 0;
+    }
+    honce(&s_watchdog_once, hloop_watchdog_init);
+    hmutex_lock(&s_watchdog_mutex);
+    int found = 0;
+    for (int i = 0; i < s_watched_nloops; ++i) {
+        if (s_watched_loops[i].loop == loop) {
+            found = 1;
+            break;
+        }
+    }
+    if (!found) {
+        if (s_watched_nloops == s_watched_maxloops) {
+            int maxloops = s_watched_maxloops ? s_watched_maxloops * 2 : 16;
+            s_watched_loops = (watched_loop_t*)hv_realloc(s_watched_loops,
+                    sizeof(watched_loop_t) * maxloops, sizeof(watched_loop_t) * s_watched_maxloops);
+            s_watched_maxloops = maxloops;
+        }
+        watched_loop_t* watched = &s_watched_loops[s_watched_nloops++];
+        watched->loop = loop;
+        watched->cb_seq = loop->cb_seq;
+        watched->since_ms = gethrtime_us() / 1000;
+        watched->reported = 0;
+    }
+    loop->stall_ms = stall_ms;
+    if (!s_watchdog_running) {
+        hthread_t th = hthread_create(hloop_watchdog_thread, NULL);
+#ifdef OS_WIN
+        CloseHandle(th);
+#else
+        pthread_detach(th);
+#endif
+        s_watchdog_running = 1;
+    }
+    hmutex_unlock(&s_watchdog_mutex);
+    return 0;
+}
+
+void hloop_disable_watchdog(hloop_t* loop) {
+    honce(&s_watchdog_once, hloop_watchdog_init);
+    hmutex_lock(&s_watchdog_mutex);
+    for (int i = 0; i < s_watched_nloops; ++i) {
+        if (s_watched_loops[i].loop == loop) {
+            s_watched_loops[i] = s_watched_loops[--s_watched_nloops];
+            break;
+        }
+    }
+    loop->stall_ms = 0;
+    hmutex_unlock(&s_watchdog_mutex);
+}
@@ -7,6 +7,10 @@
 #include "herr.h"
 #include "hthread.h"
 
+#ifdef OS_UNIX
+#include <sys/uio.h> // for writev
+#endif
+
 static void __connect_timeout_cb(htimer_t* timer) {
     hio_t* io = (hio_t*)timer->privdata;
     if (io) {
@@ -34,10 +38,12 @@ static void __close_timeout_cb(htimer_t* timer) {
 }
 
 static void __accept_cb(hio_t* io) {
+    HLOOP_METRICS_ADD(io->loop, accepts, 1);
     hio_accept_cb(io);
 }
 
 static void __connect_cb(hio_t* io) {
+    HLOOP_METRICS_ADD(io->loop, connects, 1);
     hio_del_connect_timer(io);
     hio_connect_cb(io);
 }
@@ -45,17 +51,22 @@ static void __connect_cb(hio_t* io) {
 static void __read_cb(hio_t* io, void* buf, int readbytes) {
     // printd("> %.*s\n", readbytes, buf);
     io->last_read_hrtime = io->loop->cur_hrtime;
+    HLOOP_METRICS_ADD(io->loop, reads, 1);
+    HLOOP_METRICS_ADD(io->loop, read_bytes, readbytes);
     hio_handle_read(io, buf, readbytes);
 }
 
 static void __write_cb(hio_t* io, const void* buf, int writebytes) {
     // printd("< %.*s\n", writebytes, buf);
     io->last_write_hrtime = io->loop->cur_hrtime;
+    HLOOP_METRICS_ATOMIC_ADD(io->loop, writes, 1);
+    HLOOP_METRICS_ATOMIC_ADD(io->loop, write_bytes, writebytes);
     hio_write_cb(io, buf, writebytes);
 }
 
 static void __close_cb(hio_t* io) {
     // printd("close fd=%d\n", io->fd);
+    HLOOP_METRICS_ADD(io->loop, closes, 1);
     hio_del_connect_timer(io);
     hio_del_close_timer(io);
     hio_del_read_timer(io);
@@ -166,6 +177,10 @@ static void nio_accept(hio_t* io) {
             __accept_cb(connio);
         }
     }
+    // NOTE: edge-triggered: not EAGAIN yet, accept the rest in the next loop iteration.
+    if (io->loop->flags & HLOOP_FLAG_EDGE_TRIGGERED) {
+        hio_read_again(io);
+    }
     return;
 
 accept_error:
@@ -180,6 +195,12 @@ static void nio_connect(hio_t* io) {
     int ret = getpeername(io->fd, io->peeraddr, &addrlen);
     if (ret < 0) {
         io->error = socket_errno();
+        // NOTE: getpeername says ENOTCONN only, SO_ERROR is the reason, e.g. ECONNREFUSED.
+        int err = 0;
+        socklen_t optlen = sizeof(err);
+        if (getsockopt(io->fd, SOL_SOCKET, SO_ERROR, (char*)&err, &optlen) == 0 && err != 0) {
+            io->error = err;
+        }
         goto connect_error;
     }
     else {
@@ -307,7 +328,11 @@ static void nio_read(hio_t* io) {
     // printd("nio_read fd=%d\n", io->fd);
     void* buf;
     int len = 0, nread = 0, err = 0;
+    // NOTE: edge-triggered: read until EAGAIN, but no more than HIO_READ_BUDGET for fairness.
+    unsigned int budget = (io->loop->flags & HLOOP_FLAG_EDGE_TRIGGERED) ? HIO_READ_BUDGET : 0;
 read:
+    // HLOOP_FLAG_RELEASE_IDLE_BUFFERS: read callback may release it, e.g. by hio_read_until_length.
+    hio_acquire_readbuf(io);
     buf = io->readbuf.base + io->readbuf.tail;
     if (io->read_flags & HIO_READ_UNTIL_LENGTH) {
         len = io->read_until_length - (io->readbuf.tail - io->readbuf.head);
@@ -319,9 +344,13 @@ read:
     // printd("read retval=%d\n", nread);
     if (nread < 0) {
         err = socket_errno();
+        if (err == EINTR && budget) {
+            // NOTE: edge-triggered: no edge comes for the unread data.
+            goto read;
+        }
         if (err == EAGAIN || err == EINTR) {
-            // goto read_done;
-            return;
+            HLOOP_METRICS_ADD(io->loop, read_eagains, 1);
+            goto read_done;
         } else if (err == EMSGSIZE) {
             nread = len;
         } else {
@@ -339,12 +368,32 @@ read:
     }
     io->readbuf.tail += nread;
     __read_cb(io, buf, nread);
-    if (nread == len && !io->closed) {
+    if (budget) {
+        if (io->closed || !(io->events & HV_READ)) return;
+        // NOTE: a short read of a stream drained it, a new edge comes with new data,
+        // but ssl may have own cache, and datagrams are read one by one.
+        if (nread == len || io->io_type == HIO_TYPE_SSL || (io->io_type & HIO_TYPE_SOCK_DGRAM)) {
+            if (budget > (unsigned int)nread) {
+                budget -= nread;
+                goto read;
+            }
+            hio_read_again(io);
+            return;
+        }
+    }
+    else if (nread == len) {
+        if (io->closed) return;
         // NOTE: ssl may have own cache
         if (io->io_type == HIO_TYPE_SSL) {
             // read continue
             goto read;
         }
+        return;
+    }
+read_done:
+    // NOTE: drained, the readbuf is acquired again when readable.
+    if ((io->loop->flags & HLOOP_FLAG_RELEASE_IDLE_BUFFERS) && !io->closed) {
+        hio_release_readbuf(io);
     }
     return;
 read_error:
@@ -360,6 +409,10 @@ static void nio_write(hio_t* io) {
     hrecursive_mutex_lock(&io->write_mutex);
 write:
     if (write_queue_empty(&io->write_queue)) {
+        // NOTE: hio_write inits write_queue again when needed.
+        if ((io->loop->flags & HLOOP_FLAG_RELEASE_IDLE_BUFFERS) && io->write_queue.maxsize) {
+            write_queue_cleanup(&io->write_queue);
+        }
         hrecursive_mutex_unlock(&io->write_mutex);
         if (io->close) {
             io->close = 0;
@@ -376,6 +429,7 @@ write:
     if (nwrite < 0) {
         err = socket_errno();
         if (err == EAGAIN || err == EINTR) {
+            HLOOP_METRICS_ATOMIC_ADD(io->loop, write_eagains, 1);
             hrecursive_mutex_unlock(&io->write_mutex);
             return;
         } else {
@@ -389,6 +443,7 @@ write:
     }
     pbuf->offset += nwrite;
     io->write_bufsize -= nwrite;
+    HLOOP_METRICS_ATOMIC_ADD(io->loop, write_queue_bytes, -(int64_t)nwrite);
     __write_cb(io, buf, nwrite);
     if (nwrite == len) {
         // NOTE: after write_cb, pbuf maybe invalid.
@@ -420,8 +475,19 @@ static void hio_handle_events(hio_t* io) {
         }
     }
 
+    if ((io->revents & HV_WRITE) && !(io->events & HV_WRITE) &&
+        (io->loop->flags & HLOOP_FLAG_EDGE_TRIGGERED)) {
+        // NOTE: edge-triggered: the edge maybe come before hio_write in other thread adds HV_WRITE.
+        hrecursive_mutex_lock(&io->write_mutex);
+        if (!write_queue_empty(&io->write_queue) && !io->closed) {
+            hio_add(io, hio_handle_events, HV_WRITE);
+        }
+        hrecursive_mutex_unlock(&io->write_mutex);
+    }
+
     if ((io->events & HV_WRITE) && (io->revents & HV_WRITE)) {
         // NOTE: del HV_WRITE, if write_queue empty
+        // edge-triggered: only clears io->events, no epoll_ctl.
         hrecursive_mutex_lock(&io->write_mutex);
         if (write_queue_empty(&io->write_queue)) {
             hio_del(io, HV_WRITE);
@@ -479,6 +545,7 @@ int hio_read (hio_t* io) {
     hio_add(io, hio_handle_events, HV_READ);
     if (io->readbuf.tail > io->readbuf.head &&
         io->unpack_setting == NULL &&
+        io->codec == NULL &&
         io->read_flags == 0) {
         hio_read_remain(io);
     }
@@ -507,6 +574,7 @@ try_write:
             err = socket_errno();
             if (err == EAGAIN || err == EINTR) {
                 nwrite = 0;
+                HLOOP_METRICS_ATOMIC_ADD(io->loop, write_eagains, 1);
                 hlogw("try_write failed, enqueue!");
                 goto enqueue;
             } else {
@@ -541,6 +609,7 @@ enqueue:
         }
         write_queue_push_back(&io->write_queue, &remain);
         io->write_bufsize += remain.len;
+        HLOOP_METRICS_ATOMIC_ADD(io->loop, write_queue_bytes, (int64_t)remain.len);
         if (io->write_bufsize > WRITE_BUFSIZE_HIGH_WATER) {
             hlogw("write len=%u enqueue %u, bufsize=%u over high water %u",
                 (unsigned int)len,
@@ -569,6 +638,134 @@ disconnect:
     return nwrite < 0 ? nwrite : -1;
 }
 
+static int hio_writev_concat(hio_t* io, const hio_iovec_t* iov, int iovcnt, size_t len) {
+    char* buf = NULL;
+    HV_STACK_ALLOC(buf, len);
+    char* p = buf;
+    for (int i = 0; i < iovcnt; ++i) {
+        memcpy(p, iov[i].base, iov[i].len);
+        p += iov[i].len;
+    }
+    int nwrite = hio_write(io, buf, len);
+    HV_STACK_FREE(buf);
+    return nwrite;
+}
+
+#ifdef OS_UNIX
+#define HIO_WRITEV_MAX_IOVCNT   64
+static int __nio_writev(hio_t* io, const hio_iovec_t* iov, int iovcnt) {
+    struct iovec vec[HIO_WRITEV_MAX_IOVCNT];
+    for (int i = 0; i < iovcnt; ++i) {
+        vec[i].iov_base = (void*)iov[i].base;
+        vec[i].iov_len = iov[i].len;
+    }
+    if (io->io_type == HIO_TYPE_TCP) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = vec;
+        msg.msg_iovlen = iovcnt;
+        int flag = 0;
+#ifdef MSG_NOSIGNAL
+        flag |= MSG_NOSIGNAL;
+#endif
+        return sendmsg(io->fd, &msg, flag);
+    }
+    return writev(io->fd, vec, iovcnt);
+}
+#endif
+
+int hio_writev(hio_t* io, const hio_iovec_t* iov, int iovcnt) {
+    if (iovcnt == 1) {
+        return hio_write(io, iov[0].base, iov[0].len);
+    }
+    if (io->closed) {
+        hloge("hio_writev called but fd[%d] already closed!", io->fd);
+        return -1;
+    }
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        len += iov[i].len;
+    }
+#ifdef OS_UNIX
+    if (iovcnt > HIO_WRITEV_MAX_IOVCNT ||
+        (io->io_type & (HIO_TYPE_SOCK_DGRAM | HIO_TYPE_SOCK_RAW | HIO_TYPE_SSL))) {
+        return hio_writev_concat(io, iov, iovcnt, len);
+    }
+    int nwrite = 0, err = 0;
+    hrecursive_mutex_lock(&io->write_mutex);
+    if (write_queue_empty(&io->write_queue)) {
+        nwrite = __nio_writev(io, iov, iovcnt);
+        if (nwrite < 0) {
+            err = socket_errno();
+            if (err == EAGAIN || err == EINTR) {
+                nwrite = 0;
+                HLOOP_METRICS_ATOMIC_ADD(io->loop, write_eagains, 1);
+            } else {
+                io->error = err;
+                goto write_error;
+            }
+        } else if (nwrite == 0 && len != 0 && (io->io_type & HIO_TYPE_SOCK_STREAM)) {
+            goto disconnect;
+        }
+        if ((size_t)nwrite < len) {
+            hio_add(io, hio_handle_events, HV_WRITE);
+        }
+    }
+    if ((size_t)nwrite < len) {
+        if (io->write_bufsize + len - nwrite > io->max_write_bufsize) {
+            hloge("write bufsize > %u, close it!", io->max_write_bufsize);
+            io->error = ERR_OVER_LIMIT;
+            goto write_error;
+        }
+        // NOTE: the rest is enqueued as one buf, free in nio_write
+        offset_buf_t remain;
+        remain.len = len - nwrite;
+        remain.offset = 0;
+        HV_ALLOC(remain.base, remain.len);
+        char* p = remain.base;
+        size_t skip = nwrite;
+        for (int i = 0; i < iovcnt; ++i) {
+            if (skip >= iov[i].len) {
+                skip -= iov[i].len;
+                continue;
+            }
+            memcpy(p, (const char*)iov[i].base + skip, iov[i].len - skip);
+            p += iov[i].len - skip;
+            skip = 0;
+        }
+        if (io->write_queue.maxsize == 0) {
+            write_queue_init(&io->write_queue, 4);
+        }
+        write_queue_push_back(&io->write_queue, &remain);
+        io->write_bufsize += remain.len;
+        HLOOP_METRICS_ATOMIC_ADD(io->loop, write_queue_bytes, (int64_t)remain.len);
+    }
+    hrecursive_mutex_unlock(&io->write_mutex);
+    if (nwrite > 0) {
+        io->last_write_hrtime = io->loop->cur_hrtime;
+        HLOOP_METRICS_ATOMIC_ADD(io->loop, writes, 1);
+        HLOOP_METRICS_ATOMIC_ADD(io->loop, write_bytes, nwrite);
+        // hwrite_cb for each buf written
+        size_t remain = nwrite;
+        for (int i = 0; i < iovcnt && remain > 0; ++i) {
+            size_t n = MIN(iov[i].len, remain);
+            hio_write_cb(io, iov[i].base, n);
+            remain -= n;
+        }
+    }
+    return nwrite;
+write_error:
+disconnect:
+    hrecursive_mutex_unlock(&io->write_mutex);
+    if (io->io_type & HIO_TYPE_SOCK_STREAM) {
+        hio_close_async(io);
+    }
+    return nwrite < 0 ? nwrite : -1;
+#else
+    return hio_writev_concat(io, iov, iovcnt, len);
+#endif
+}
+
 int hio_close (hio_t* io) {
     if (io->closed) return 0;
     if (io->destroy == 0 && hv_gettid() != io->loop->tid) {
@@ -375,6 +375,24 @@ disconnect:
     return 0;
 }
 
+// NOTE: one WSASend per hio_write, so bufs are concatenated.
+int hio_writev(hio_t* io, const hio_iovec_t* iov, int iovcnt) {
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        len += iov[i].len;
+    }
+    char* buf = NULL;
+    HV_STACK_ALLOC(buf, len);
+    char* p = buf;
+    for (int i = 0; i < iovcnt; ++i) {
+        memcpy(p, iov[i].base, iov[i].len);
+        p += iov[i].len;
+    }
+    int nwrite = hio_write(io, buf, len);
+    HV_STACK_FREE(buf);
+    return nwrite;
+}
+
 int hio_close (hio_t* io) {
     if (io->closed) return 0;
     io->closed = 1;
@@ -0,0 +1,376 @@
+#include "hevent.h"
+#include "hsocket.h"
+#include "hlog.h"
+
+#ifdef OS_LINUX
+#include <fcntl.h>
+#endif
+
+typedef struct hrelay_dir_s {
+    int         pipefd[2];  // splice mode
+    uint32_t    inpipe;     // bytes in pipe
+    unsigned    eof     :1; // read EOF of src
+    unsigned    done    :1; // shutdown(SHUT_WR) dst
+    unsigned    paused  :1; // copy mode: reading src stopped
+} hrelay_dir_t;
+
+struct hrelay_s {
+    hloop_t*        loop;
+    // dirs[i]: io[i] => io[!i]
+    hio_t*          io[2];
+    hrelay_dir_t    dirs[2];
+    hclose_cb       io_close_cb[2];
+    unsigned        closed[2];
+    // free after the outermost hrelay_on_close, the close cbs maybe close the peer.
+    int             calling;
+    uint32_t        watermark;
+    hrelay_stats_t  stats;
+    hrelay_cb       close_cb;
+    void*           userdata;
+};
+
+static inline int hrelay_index(hrelay_t* relay, hio_t* io) {
+    return relay->io[0] == io ? 0 : 1;
+}
+
+//-----------------pipe pool---------------------------------------------
+#ifdef OS_LINUX
+static int hrelay_pipe_get(hloop_t* loop, int pipefd[2]) {
+    if (loop->nrelay_pipes) {
+        --loop->nrelay_pipes;
+        pipefd[0] = loop->relay_pipes[loop->nrelay_pipes][0];
+        pipefd[1] = loop->relay_pipes[loop->nrelay_pipes][1];
+        return 0;
+    }
+    if (pipe2(pipefd, O_NONBLOCK | O_CLOEXEC) != 0) {
+        return -1;
+    }
+    // NOTE: maybe fail over /proc/sys/fs/pipe-max-size, then 64K by default.
+    fcntl(pipefd[1], F_SETPIPE_SZ, HRELAY_PIPE_SIZE);
+    return 0;
+}
+
+// @param empty: a pipe with bytes left cannot be reused
+static void hrelay_pipe_put(hloop_t* loop, int pipefd[2], int empty) {
+    if (pipefd[0] < 0) return;
+    if (empty && loop->nrelay_pipes < HRELAY_PIPE_POOL_SIZE) {
+        loop->relay_pipes[loop->nrelay_pipes][0] = pipefd[0];
+        loop->relay_pipes[loop->nrelay_pipes][1] = pipefd[1];
+        ++loop->nrelay_pipes;
+    } else {
+        close(pipefd[0]);
+        close(pipefd[1]);
+    }
+    pipefd[0] = pipefd[1] = -1;
+}
+#endif
+
+void hloop_cleanup_relay_pipes(hloop_t* loop) {
+#ifdef OS_LINUX
+    while (loop->nrelay_pipes) {
+        --loop->nrelay_pipes;
+        close(loop->relay_pipes[loop->nrelay_pipes][0]);
+        close(loop->relay_pipes[loop->nrelay_pipes][1]);
+    }
+#endif
+}
+
+//-----------------close---------------------------------------------
+static void hrelay_on_close(hio_t* io) {
+    hrelay_t* relay = io->relay;
+    if (relay == NULL) return;
+    int i = hrelay_index(relay, io);
+    ++relay->calling;
+    relay->closed[i] = 1;
+    if (relay->stats.error == 0) {
+        relay->stats.error = io->error;
+    }
+    // NOTE: hio_get_relay is still valid in the close cb of io.
+    if (relay->io_close_cb[i]) {
+        relay->io_close_cb[i](io);
+    }
+    io->relay = NULL;
+    hio_t* peer = relay->io[!i];
+    if (!relay->closed[!i]) {
+        // NOTE: maybe close later in copy mode, until the write queue of peer is flushed.
+        hio_read_stop(peer);
+        hio_close(peer);
+    }
+    if (--relay->calling > 0 || !relay->closed[!i]) return;
+
+    // both closed
+    relay->stats.end_hrtime = hloop_now_us(relay->loop);
+#ifdef OS_LINUX
+    for (int d = 0; d < 2; ++d) {
+        hrelay_pipe_put(relay->loop, relay->dirs[d].pipefd, relay->dirs[d].inpipe == 0);
+    }
+#endif
+    if (relay->close_cb) {
+        relay->close_cb(relay);
+    }
+    HV_FREE(relay);
+}
+
+void hrelay_close(hrelay_t* relay) {
+    hio_close(relay->io[0]);
+}
+
+//-----------------splice mode---------------------------------------------
+#ifdef OS_LINUX
+static void hrelay_on_events(hio_t* io);
+
+// @retval -1 if closed, relay is freed.
+static int hrelay_error(hio_t* io, int err) {
+    io->error = err;
+    hio_close(io);
+    return -1;
+}
+
+/*
+ * dirs[d] owns HV_READ of src and HV_WRITE of dst.
+ * pipe => dst first, then src => pipe only if the pipe is empty,
+ * so EAGAIN of src => pipe means src is empty.
+ * @retval -1 if closed, relay is freed.
+ */
+static int hrelay_pump(hrelay_t* relay, int d) {
+    hrelay_dir_t* dir = &relay->dirs[d];
+    hio_t* src = relay->io[d];
+    hio_t* dst = relay->io[!d];
+    uint32_t budget = HIO_READ_BUDGET;
+    ssize_t nsplice = 0;
+    if (dir->done) return 0;
+    while (1) {
+        // pipe => dst
+        while (dir->inpipe) {
+            nsplice = splice(dir->pipefd[0], NULL, dst->fd, NULL, dir->inpipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (nsplice > 0) {
+                dir->inpipe -= nsplice;
+                relay->stats.bytes[d] += nsplice;
+                dst->last_write_hrtime = relay->loop->cur_hrtime;
+                continue;
+            }
+            if (nsplice < 0 && errno == EINTR) continue;
+            if (nsplice < 0 && errno == EAGAIN) {
+                // backpressure: stop reading src until dst is writable
+                if (src->events & HV_READ) hio_del(src, HV_READ);
+                if (!(dst->events & HV_WRITE)) hio_add(dst, hrelay_on_events, HV_WRITE);
+                return 0;
+            }
+            return hrelay_error(dst, nsplice < 0 ? errno : EPIPE);
+        }
+        if (dst->events & HV_WRITE) hio_del(dst, HV_WRITE);
+
+        if (dir->eof) {
+            // half-close
+            dir->done = 1;
+            shutdown(dst->fd, SHUT_WR);
+            if (relay->dirs[!d].done) {
+                hio_close(src);
+                return -1;
+            }
+            return 0;
+        }
+
+        if (budget == 0) {
+            // NOTE: edge-triggered: not drained, read it in the next loop iteration.
+            if (relay->loop->flags & HLOOP_FLAG_EDGE_TRIGGERED) {
+                hio_read_again(src);
+            }
+            break;
+        }
+
+        // src => pipe
+        nsplice = splice(src->fd, NULL, dir->pipefd[1], NULL, HRELAY_PIPE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (nsplice > 0) {
+            dir->inpipe = nsplice;
+            budget = (uint32_t)nsplice >= budget ? 0 : budget - nsplice;
+            src->last_read_hrtime = relay->loop->cur_hrtime;
+            continue;
+        }
+        if (nsplice == 0) {
+            dir->eof = 1;
+            if (src->events & HV_READ) hio_del(src, HV_READ);
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN) break;
+        return hrelay_error(src, errno);
+    }
+    if (!(src->events & HV_READ)) hio_add(src, hrelay_on_events, HV_READ);
+    return 0;
+}
+
+static void hrelay_on_events(hio_t* io) {
+    hrelay_t* relay = io->relay;
+    int revents = io->revents & io->events;
+    io->revents = 0;
+    if (relay == NULL) return;
+    int i = hrelay_index(relay, io);
+    if (revents & HV_READ) {
+        if (hrelay_pump(relay, i) < 0) return;
+    }
+    if (revents & HV_WRITE) {
+        hrelay_pump(relay, !i);
+    }
+}
+
+static int hrelay_can_splice(hio_t* io) {
+    return io->io_type == HIO_TYPE_TCP && io->ssl == NULL && io->codec == NULL &&
+           write_queue_empty(&io->write_queue);
+}
+
+// @retval -1 if no pipes
+static int hrelay_start_splice(hrelay_t* relay) {
+    for (int d = 0; d < 2; ++d) {
+        if (hrelay_pipe_get(relay->loop, relay->dirs[d].pipefd) != 0) {
+            hlogw("relay: pipe2 error=%d, fallback to copy", errno);
+            if (d == 1) hrelay_pipe_put(relay->loop, relay->dirs[0].pipefd, 1);
+            return -1;
+        }
+    }
+    relay->stats.spliced = 1;
+    for (int i = 0; i < 2; ++i) {
+        hio_t* io = relay->io[i];
+        hio_del(io, HV_RDWR);
+        hio_add(io, hrelay_on_events, HV_READ);
+        // NOTE: edge-triggered: bytes maybe arrived before, so read them once.
+        hio_read_again(io);
+    }
+    return 0;
+}
+#endif
+
+//-----------------copy mode---------------------------------------------
+static void hrelay_on_read(hio_t* io, void* buf, int readbytes) {
+    hrelay_t* relay = io->relay;
+    if (relay == NULL) return;
+    int i = hrelay_index(relay, io);
+    hio_t* peer = relay->io[!i];
+    if (hio_write(peer, buf, readbytes) < 0) return;
+    relay->stats.bytes[i] += readbytes;
+    if (hio_write_bufsize(peer) > relay->watermark) {
+        // backpressure: resumed by hrelay_on_write of peer
+        relay->dirs[i].paused = 1;
+        hio_read_stop(io);
+    }
+}
+
+static void hrelay_on_write(hio_t* io, const void* buf, int writebytes) {
+    (void)buf;
+    (void)writebytes;
+    hrelay_t* relay = io->relay;
+    if (relay == NULL) return;
+    int i = hrelay_index(relay, io);
+    hrelay_dir_t* dir = &relay->dirs[!i];
+    if (dir->paused && hio_write_bufsize(io) <= relay->watermark / 2) {
+        dir->paused = 0;
+        hio_read(relay->io[!i]);
+    }
+}
+
+static void hrelay_start_copy(hrelay_t* relay) {
+    for (int i = 0; i < 2; ++i) {
+        hio_t* io = relay->io[i];
+        hio_unset_unpack(io);
+        io->read_flags = 0;
+        hio_setcb_read(io, hrelay_on_read);
+        hio_setcb_write(io, hrelay_on_write);
+    }
+    hio_read(relay->io[0]);
+    hio_read(relay->io[1]);
+}
+
+//-----------------relay---------------------------------------------
+// bytes read by hio_readbytes etc. but not consumed yet
+static int hrelay_flush_readbuf(hrelay_t* relay, int i) {
+    hio_t* io = relay->io[i];
+    fifo_buf_t* readbuf = &io->readbuf;
+    if (readbuf->tail <= readbuf->head) return 0;
+    int len = readbuf->tail - readbuf->head;
+    int nwrite = hio_write(relay->io[!i], readbuf->base + readbuf->head, len);
+    readbuf->head = readbuf->tail = 0;
+    if (nwrite < 0) return nwrite;
+    relay->stats.bytes[i] += len;
+    return 0;
+}
+
+hrelay_t* hio_setup_relay(hio_t* io1, hio_t* io2, int splice) {
+    if (io1->closed || io2->closed) return NULL;
+    hrelay_t* relay = NULL;
+    HV_ALLOC_SIZEOF(relay);
+    relay->loop = io1->loop;
+    relay->io[0] = io1;
+    relay->io[1] = io2;
+    relay->watermark = HRELAY_DEFAULT_WATERMARK;
+    relay->stats.start_hrtime = hloop_now_us(relay->loop);
+    for (int i = 0; i < 2; ++i) {
+        hio_t* io = relay->io[i];
+        relay->dirs[i].pipefd[0] = relay->dirs[i].pipefd[1] = -1;
+        relay->io_close_cb[i] = io->close_cb;
+        io->relay = relay;
+        hio_setcb_close(io, hrelay_on_close);
+    }
+    hio_setup_upstream(io1, io2);
+    if (hrelay_flush_readbuf(relay, 0) < 0 || hrelay_flush_readbuf(relay, 1) < 0) {
+        hio_close(io1);
+        return NULL;
+    }
+#ifdef OS_LINUX
+    if (splice && hrelay_can_splice(io1) && hrelay_can_splice(io2) &&
+        hrelay_start_splice(relay) == 0) {
+        return relay;
+    }
+#endif
+    hrelay_start_copy(relay);
+    return relay;
+}
+
+static void hrelay_on_upstream_connect(hio_t* upstream_io) {
+    hio_t* io = upstream_io->upstream_io;
+    if (io == NULL) return;
+    hio_setcb_close(io, NULL);
+    hio_setcb_close(upstream_io, NULL);
+    hio_setup_relay(io, upstream_io, 1);
+}
+
+hio_t* hio_setup_tcp_relay(hio_t* io, const char* host, int port, int ssl) {
+    hio_t* upstream_io = hio_create_socket(io->loop, host, port, HIO_TYPE_TCP, HIO_CLIENT_SIDE);
+    if (upstream_io == NULL) return NULL;
+    if (ssl) hio_enable_ssl(upstream_io);
+    // NOTE: closed together while connecting
+    hio_setup_upstream(io, upstream_io);
+    hio_read_stop(io);
+    hio_setcb_close(io, hio_close_upstream);
+    hio_setcb_close(upstream_io, hio_close_upstream);
+    hio_setcb_connect(upstream_io, hrelay_on_upstream_connect);
+    hio_connect(upstream_io);
+    return upstream_io;
+}
+
+hrelay_t* hio_get_relay(hio_t* io) {
+    return io->relay;
+}
+
+hio_t* hrelay_io(hrelay_t* relay, int index) {
+    return relay->io[index ? 1 : 0];
+}
+
+void hrelay_setcb_close(hrelay_t* relay, hrelay_cb close_cb) {
+    relay->close_cb = close_cb;
+}
+
+void hrelay_set_userdata(hrelay_t* relay, void* userdata) {
+    relay->userdata = userdata;
+}
+
+void* hrelay_userdata(hrelay_t* relay) {
+    return relay->userdata;
+}
+
+void hrelay_set_watermark(hrelay_t* relay, uint32_t watermark) {
+    relay->watermark = watermark;
+}
+
+void hrelay_get_stats(hrelay_t* relay, hrelay_stats_t* stats) {
+    *stats = relay->stats;
+}
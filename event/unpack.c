@@ -19,6 +19,37 @@ int hio_unpack(hio_t* io, void* buf, int readbytes) {
     }
 }
 
+/*
+ * NOTE: An incomplete package that is not small stays where it is, and the
+ * next read appends to it, instead of being moved to readbuf.base after
+ * every read. It is moved only when the space behind it runs low.
+ * A small one is moved right away, that is cheaper than a shorter next read.
+ */
+static void hio_unpack_consume(hio_t* io, const unsigned char* p) {
+    fifo_buf_t* readbuf = &io->readbuf;
+    readbuf->head = (char*)p - readbuf->base;
+    if (readbuf->head == readbuf->tail) {
+        readbuf->head = readbuf->tail = 0;
+    }
+    else if (readbuf->head &&
+             (readbuf->tail - readbuf->head <= readbuf->len / 16 ||
+              readbuf->len - readbuf->tail < readbuf->len / 4)) {
+        hio_memmove_readbuf(io);
+    }
+}
+
+// memchr is vectorized by libc
+static const unsigned char* find_delimiter(const unsigned char* p, const unsigned char* ep,
+        const unsigned char* delimiter, int delimiter_bytes) {
+    while (ep - p >= delimiter_bytes) {
+        p = (const unsigned char*)memchr(p, delimiter[0], ep - p - delimiter_bytes + 1);
+        if (p == NULL) return NULL;
+        if (memcmp(p + 1, delimiter + 1, delimiter_bytes - 1) == 0) return p;
+        ++p;
+    }
+    return NULL;
+}
+
 int hio_unpack_by_fixed_length(hio_t* io, void* buf, int readbytes) {
     const unsigned char* sp = (const unsigned char*)io->readbuf.base + io->readbuf.head;
     const unsigned char* ep = (const unsigned char*)buf + readbytes;
@@ -37,13 +68,10 @@ int hio_unpack_by_fixed_length(hio_t* io, void* buf, int readbytes) {
         remain -= fixed_length;
     }
 
-    io->readbuf.head = 0;
-    io->readbuf.tail = remain;
-    if (remain) {
-        // [p, p+remain] => [base, base+remain]
-        if (p != (unsigned char*)io->readbuf.base) {
-            memmove(io->readbuf.base, p, remain);
-        }
+    hio_unpack_consume(io, p);
+    // make room for the whole package
+    if (io->readbuf.len - io->readbuf.head < fixed_length) {
+        hio_memmove_readbuf(io);
     }
 
     return handled;
@@ -57,37 +85,20 @@ int hio_unpack_by_delimiter(hio_t* io, void* buf, int readbytes) {
     unsigned char* delimiter = setting->delimiter;
     int delimiter_bytes = setting->delimiter_bytes;
 
+    // resume from the bytes scanned last time
     const unsigned char* p = (const unsigned char*)buf - delimiter_bytes + 1;
     if (p < sp) p = sp;
-    int remain = ep - p;
     int handled = 0;
-    int i = 0;
-    while (remain >= delimiter_bytes) {
-        for (i = 0; i < delimiter_bytes; ++i) {
-            if (p[i] != delimiter[i]) {
-                goto not_match;
-            }
-        }
-match:
+    while ((p = find_delimiter(p, ep, delimiter, delimiter_bytes)) != NULL) {
         p += delimiter_bytes;
-        remain -= delimiter_bytes;
         hio_read_cb(io, (void*)sp, p - sp);
         handled += p - sp;
         sp = p;
-        continue;
-not_match:
-        ++p;
-        --remain;
     }
 
-    remain = ep - sp;
-    io->readbuf.head = 0;
-    io->readbuf.tail = remain;
-    if (remain) {
-        // [sp, sp+remain] => [base, base+remain]
-        if (sp != (unsigned char*)io->readbuf.base) {
-            memmove(io->readbuf.base, sp, remain);
-        }
+    hio_unpack_consume(io, sp);
+    if (io->readbuf.tail == io->readbuf.len) {
+        hio_memmove_readbuf(io);
         if (io->readbuf.tail == io->readbuf.len) {
             if (io->readbuf.len >= setting->package_max_length) {
                 hloge("recv package over %d bytes!", (int)setting->package_max_length);
@@ -117,6 +128,7 @@ int hio_unpack_by_length_field(hio_t* io, void* buf, int readbytes) {
     const unsigned char* lp = NULL;
     while (remain >= setting->body_offset) {
         body_len = 0;
+        package_len = setting->body_offset;
         lp = p + setting->length_field_offset;
         if (setting->length_field_coding == BIG_ENDIAN) {
             for (int i = 0; i < setting->length_field_bytes; ++i) {
@@ -156,12 +168,14 @@ int hio_unpack_by_length_field(hio_t* io, void* buf, int readbytes) {
         }
     }
 
-    io->readbuf.head = 0;
-    io->readbuf.tail = remain;
+    if (remain < setting->body_offset) {
+        package_len = setting->body_offset;
+    }
+    hio_unpack_consume(io, p);
     if (remain) {
-        // [p, p+remain] => [base, base+remain]
-        if (p != (unsigned char*)io->readbuf.base) {
-            memmove(io->readbuf.base, p, remain);
+        // make room for the whole package
+        if (io->readbuf.len - io->readbuf.head < package_len) {
+            hio_memmove_readbuf(io);
         }
         if (package_len > io->readbuf.len) {
             if (package_len > setting->package_max_length) {
@@ -177,3 +191,59 @@ int hio_unpack_by_length_field(hio_t* io, void* buf, int readbytes) {
 
     return handled;
 }
+
+int hio_codec_emit(hio_codec_t* codec, hio_t* io, void* frame, int len) {
+    hio_codec_t* next = codec->next;
+    if (next == NULL) {
+        hio_read_cb(io, frame, len);
+        return len;
+    }
+    if (next->decode == NULL) {
+        return hio_codec_emit(next, io, frame, len);
+    }
+    int nread = next->decode(next, io, frame, len);
+    if (nread >= 0 && nread != len) {
+        hloge("codec must consume the whole frame, %d of %d bytes consumed!", nread, len);
+        return -ERR_INVALID_PROTOCOL;
+    }
+    return nread;
+}
+
+int hio_unpack_by_codec(hio_t* io, void* buf, int readbytes) {
+    unsigned char* sp = (unsigned char*)io->readbuf.base + io->readbuf.head;
+    unsigned char* ep = (unsigned char*)buf + readbytes;
+    hio_codec_t* codec = io->codec;
+
+    int handled = 0;
+    if (codec->decode) {
+        handled = codec->decode(codec, io, sp, ep - sp);
+    } else {
+        handled = hio_codec_emit(codec, io, sp, ep - sp);
+    }
+    if (handled < 0) {
+        hloge("codec decode error: %d", handled);
+        if (io->error == 0) io->error = ERR_INVALID_PROTOCOL;
+        hio_close(io);
+        return -1;
+    }
+    // codec maybe unset or replaced in hread_cb
+    if (io->codec != codec) return handled;
+    assert(handled <= ep - sp);
+
+    hio_unpack_consume(io, sp + handled);
+    if (io->readbuf.tail == io->readbuf.len) {
+        hio_memmove_readbuf(io);
+        if (io->readbuf.tail == io->readbuf.len) {
+            if (io->readbuf.len >= codec->max_frame_length) {
+                hloge("recv frame over %d bytes!", (int)codec->max_frame_length);
+                io->error = ERR_OVER_LIMIT;
+                hio_close(io);
+                return -1;
+            }
+            int newsize = MIN(io->readbuf.len * 2, codec->max_frame_length);
+            hio_alloc_readbuf(io, newsize);
+        }
+    }
+
+    return handled;
+}
@@ -7,5 +7,6 @@ int hio_unpack(hio_t* io, void* buf, int readbytes);
 int hio_unpack_by_fixed_length(hio_t* io, void* buf, int readbytes);
 int hio_unpack_by_delimiter(hio_t* io, void* buf, int readbytes);
 int hio_unpack_by_length_field(hio_t* io, void* buf, int readbytes);
+int hio_unpack_by_codec(hio_t* io, void* buf, int readbytes);
 
 #endif // HV_UNPACK_H_
@@ -312,6 +312,28 @@ public:
         hio_set_unpack(io_, setting);
     }
 
+    /*
+     * codec
+     *
+     * NOTE: Only the pointer of hio_codec_t is stored in hio_t,
+     *       the life time of hio_codec_t shoud be guaranteed by caller.
+     * @see hio_set_codec
+     */
+    void setCodec(hio_codec_t* codec) {
+        if (io_ == NULL) return;
+        hio_set_codec(io_, codec);
+    }
+
+    // encode by codec then write, thread-safe
+    int writeCodec(const void* data, int size) {
+        if (!isOpened()) return -1;
+        return hio_write_codec(io_, data, size);
+    }
+
+    int writeCodec(const std::string& str) {
+        return writeCodec(str.data(), str.size());
+    }
+
     int startConnect(int port, const char* host = "127.0.0.1") {
         sockaddr_u peeraddr;
         memset(&peeraddr, 0, sizeof(peeraddr));
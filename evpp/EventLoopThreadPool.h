@@ -28,10 +28,14 @@ public:
         thread_num_ = num;
     }
 
-    EventLoopPtr nextLoop(load_balance_e lb = LB_RoundRobin) {
+    // @param key: client ip for LB_IpHash, url for LB_UrlHash
+    EventLoopPtr nextLoop(load_balance_e lb = LB_RoundRobin, const char* key = NULL) {
         size_t numLoops = loop_threads_.size();
         if (numLoops == 0) return NULL;
         size_t idx = 0;
+        if ((lb == LB_IpHash || lb == LB_UrlHash) && (key == NULL || *key == '\0')) {
+            lb = LB_RoundRobin;
+        }
         if (lb == LB_RoundRobin) {
             if (++next_loop_idx_ >= numLoops) next_loop_idx_ = 0;
             idx = next_loop_idx_ % numLoops;
@@ -43,8 +47,8 @@ public:
                     idx = i;
                 }
             }
-        } else {
-            // Not Implemented
+        } else if (lb == LB_IpHash || lb == LB_UrlHash) {
+            idx = hv_hash(key, strlen(key)) % numLoops;
         }
         return loop_threads_[idx]->loop();
     }
@@ -24,6 +24,7 @@ public:
         unpack_setting = NULL;
         max_connections = 0xFFFFFFFF;
         load_balance = LB_RoundRobin;
+        stall_ms = 0;
     }
 
     virtual ~TcpServerEventLoopTmpl() {
@@ -68,6 +69,11 @@ public:
         load_balance = lb;
     }
 
+    // log the stack of loop threads blocked by a callback longer than stall_ms
+    void enableWatchdog(uint32_t stall_ms = 1000) {
+        this->stall_ms = stall_ms;
+    }
+
     // NOTE: totalThreadNum = 1 acceptor_thread + N worker_threads (N can be 0)
     void setThreadNum(int num) {
         worker_threads.setThreadNum(num);
@@ -111,8 +117,13 @@ public:
 
     // start thread-safe
     void start(bool wait_threads_started = true) {
+        if (stall_ms) {
+            hloop_enable_watchdog(acceptor_loop->loop(), stall_ms);
+        }
         if (worker_threads.threadNum() > 0) {
-            worker_threads.start(wait_threads_started);
+            worker_threads.start(wait_threads_started, [this](const EventLoopPtr& loop) {
+                if (stall_ms) hloop_enable_watchdog(loop->loop(), stall_ms);
+            });
         }
         acceptor_loop->runInLoop(std::bind(&TcpServerEventLoopTmpl::startAccept, this));
     }
@@ -246,7 +257,14 @@ private:
         TcpServerEventLoopTmpl* server = (TcpServerEventLoopTmpl*)hevent_userdata(connio);
         // NOTE: detach from acceptor loop
         hio_detach(connio);
-        EventLoopPtr worker_loop = server->worker_threads.nextLoop(server->load_balance);
+        EventLoopPtr worker_loop;
+        if (server->load_balance == LB_IpHash) {
+            char ip[SOCKADDR_STRLEN] = {0};
+            sockaddr_ip((sockaddr_u*)hio_peeraddr(connio), ip, sizeof(ip));
+            worker_loop = server->worker_threads.nextLoop(LB_IpHash, ip);
+        } else {
+            worker_loop = server->worker_threads.nextLoop(server->load_balance);
+        }
         if (worker_loop == NULL) {
             worker_loop = server->acceptor_loop;
         }
@@ -269,6 +287,7 @@ public:
 
     uint32_t                max_connections;
     load_balance_e          load_balance;
+    uint32_t                stall_ms;
 
 private:
     // id => TSocketChannelPtr
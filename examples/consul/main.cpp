@@ -4,10 +4,12 @@
 
 #include "consul.h"
 
+#include "ServiceDiscovery.h"
+
 int main(int argc, char* argv[]) {
     if (argc < 3) {
         printf("Usage: consul_cli subcmd ServiceName [ServiceAddress ServicePort] [NodeIP NodePort]\n");
-        printf("subcmd=[register,deregister,discover]\n");
+        printf("subcmd=[register,deregister,discover,watch]\n");
         return -10;
     }
     const char* subcmd = argv[1];
@@ -58,6 +60,20 @@ discover:
             printf("name=%s ip=%s port=%d\n", service.name, service.ip, service.port);
         }
     }
+    else if (strcmp(subcmd, "watch") == 0) {
+        // blocking queries, printed on changes
+        char url[128];
+        snprintf(url, sizeof(url), "http://%s:%d", NodeIP, NodePort);
+        hv::ServiceDiscovery discovery(std::make_shared<hv::ConsulDiscoveryBackend>(url));
+        discovery.Watch(ServiceName, [](const std::string& name, const hv::ServiceInstancesPtr& instances) {
+            printf("%s: %u instances\n", name.c_str(), (unsigned)instances->size());
+            for (auto& instance : *instances) {
+                printf("id=%s ip=%s port=%d weight=%d\n", instance.id.c_str(), instance.address.c_str(), instance.port, instance.weight);
+            }
+        });
+        discovery.Start();
+        while (1) hv_sleep(1);
+    }
     else {
         printf("subcmd error!\n");
         return -20;
@@ -0,0 +1,227 @@
+/*
+ * callback vs coroutine benchmark
+ *
+ * @build   make coroutine_bench (needs a C++20 compiler)
+ *
+ * @echo    bin/coroutine_bench echo  [connections] [seconds] [payload_size]
+ * @proxy   bin/coroutine_bench proxy [concurrency] [seconds]
+ *
+ * echo:  pingpong over a TcpServer echoing in onMessage
+ *        and one echoing in a CoChannel read/write loop.
+ * proxy: GET /ping through a HttpServer proxying to a backend HttpServer
+ *        with AsyncHttpClient callbacks and with co_await co_send.
+ *
+ * The same coroutine driver runs in its own loop against both,
+ * and reports round trips per second of each.
+ *
+ */
+
+#include "TcpServer.h"
+#include "HttpServer.h"
+#include "AsyncHttpClient.h"
+#include "EventLoopThread.h"
+#include "Coroutine.h"
+#include "htime.h"
+
+using namespace hv;
+
+#define ECHO_CALLBACK_PORT  18001
+#define ECHO_COROUTINE_PORT 18002
+#define HTTP_BACKEND_PORT   18003
+#define PROXY_CALLBACK_PORT 18004
+#define PROXY_COROUTINE_PORT 18005
+
+static std::atomic<bool>        running(false);
+static std::atomic<uint64_t>    roundtrips(0);
+static std::atomic<int>         finished(0);
+
+static Task<void> echo_session(SocketChannelPtr channel) {
+    CoChannel conn(channel);
+    while (true) {
+        std::string_view data = co_await conn.read();
+        if (data.empty()) break;
+        if (co_await conn.write(data) < 0) break;
+    }
+}
+
+static Task<void> echo_driver(int port, int payload_size) {
+    SocketChannelPtr channel = co_await CoChannel::connect("127.0.0.1", port);
+    if (channel) {
+        tcp_nodelay(channel->fd(), 1);
+        CoChannel conn(channel);
+        std::string msg(payload_size, 'x');
+        while (running) {
+            if (co_await conn.write(msg) < 0) break;
+            size_t nread = 0;
+            while (nread < msg.size()) {
+                std::string_view data = co_await conn.read();
+                if (data.empty()) break;
+                nread += data.size();
+            }
+            if (nread < msg.size()) break;
+            ++roundtrips;
+        }
+    }
+    ++finished;
+}
+
+static Task<void> http_driver(AsyncHttpClient* client, int port) {
+    auto req = std::make_shared<HttpRequest>();
+    req->url = "http://127.0.0.1:" + std::to_string(port) + "/ping";
+    while (running) {
+        HttpResponsePtr resp = co_await co_send(client, req);
+        if (resp == NULL || resp->status_code != HTTP_STATUS_OK) break;
+        ++roundtrips;
+    }
+    ++finished;
+}
+
+static Task<void> proxy_ping(AsyncHttpClient* client, HttpContextPtr ctx) {
+    auto req = std::make_shared<HttpRequest>();
+    req->url = "http://127.0.0.1:" + std::to_string(HTTP_BACKEND_PORT) + "/ping";
+    HttpResponsePtr resp = co_await co_send(client, req);
+    if (resp == NULL) {
+        ctx->response->status_code = HTTP_STATUS_BAD_GATEWAY;
+        ctx->send();
+        co_return;
+    }
+    ctx->send(resp->body, TEXT_PLAIN);
+}
+
+static void run_drivers(EventLoopThread& driver_thread, const char* name, int num, int seconds,
+                        std::function<Task<void>()> driver) {
+    roundtrips = 0;
+    finished = 0;
+    running = true;
+    uint64_t start_ms = gettick_ms();
+    for (int i = 0; i < num; ++i) {
+        co_spawn(driver_thread.loop(), driver);
+    }
+    hv_sleep(seconds);
+    running = false;
+    uint64_t elapsed_ms = gettick_ms() - start_ms;
+    uint64_t count = roundtrips;
+    while (finished < num) hv_msleep(1);
+    printf("%-10s %8llu roundtrips %10.0f/s\n", name,
+            (unsigned long long)count, (double)count * 1000 / elapsed_ms);
+}
+
+static void bench_echo(int connections, int seconds, int payload_size) {
+    TcpServer callback_server;
+    callback_server.createsocket(ECHO_CALLBACK_PORT);
+    callback_server.onConnection = [](const SocketChannelPtr& channel) {
+        if (channel->isConnected()) tcp_nodelay(channel->fd(), 1);
+    };
+    callback_server.onMessage = [](const SocketChannelPtr& channel, Buffer* buf) {
+        channel->write(buf);
+    };
+    callback_server.setThreadNum(1);
+    callback_server.start();
+
+    TcpServer coroutine_server;
+    coroutine_server.createsocket(ECHO_COROUTINE_PORT);
+    coroutine_server.onConnection = [](const SocketChannelPtr& channel) {
+        if (channel->isConnected()) {
+            tcp_nodelay(channel->fd(), 1);
+            co_spawn(echo_session(channel));
+        }
+    };
+    coroutine_server.setThreadNum(1);
+    coroutine_server.start();
+
+    EventLoopThread driver_thread;
+    driver_thread.start();
+    printf("echo: %d connections, %d bytes payload, %ds\n", connections, payload_size, seconds);
+    run_drivers(driver_thread, "callback", connections, seconds, [payload_size]() {
+        return echo_driver(ECHO_CALLBACK_PORT, payload_size);
+    });
+    run_drivers(driver_thread, "coroutine", connections, seconds, [payload_size]() {
+        return echo_driver(ECHO_COROUTINE_PORT, payload_size);
+    });
+    driver_thread.stop(true);
+}
+
+static void bench_proxy(int concurrency, int seconds) {
+    HttpService backend_service;
+    backend_service.GET("/ping", [](HttpRequest* req, HttpResponse* resp) {
+        return resp->String("pong");
+    });
+    HttpServer backend;
+    backend.registerHttpService(&backend_service);
+    backend.setPort(HTTP_BACKEND_PORT);
+    backend.setThreadNum(1);
+    backend.start();
+
+    // one client per proxy, running in the proxy's loop
+    HttpService callback_service;
+    AsyncHttpClient* callback_client = NULL;
+    callback_service.GET("/ping", [&callback_client](const HttpContextPtr& ctx) {
+        auto req = std::make_shared<HttpRequest>();
+        req->url = "http://127.0.0.1:" + std::to_string(HTTP_BACKEND_PORT) + "/ping";
+        callback_client->send(req, [ctx](const HttpResponsePtr& resp) {
+            if (resp == NULL) {
+                ctx->response->status_code = HTTP_STATUS_BAD_GATEWAY;
+                ctx->send();
+                return;
+            }
+            ctx->send(resp->body, TEXT_PLAIN);
+        });
+        return HTTP_STATUS_UNFINISHED;
+    });
+    HttpServer callback_proxy;
+    callback_proxy.registerHttpService(&callback_service);
+    callback_proxy.setPort(PROXY_CALLBACK_PORT);
+    callback_proxy.setThreadNum(1);
+    callback_proxy.start();
+
+    HttpService coroutine_service;
+    AsyncHttpClient* coroutine_client = NULL;
+    coroutine_service.GET("/ping", [&coroutine_client](const HttpContextPtr& ctx) {
+        co_spawn(proxy_ping(coroutine_client, ctx));
+        return HTTP_STATUS_UNFINISHED;
+    });
+    HttpServer coroutine_proxy;
+    coroutine_proxy.registerHttpService(&coroutine_service);
+    coroutine_proxy.setPort(PROXY_COROUTINE_PORT);
+    coroutine_proxy.setThreadNum(1);
+    coroutine_proxy.start();
+
+    // proxies' clients run in their own loop threads in both cases
+    AsyncHttpClient callback_proxy_client;
+    AsyncHttpClient coroutine_proxy_client;
+    callback_client = &callback_proxy_client;
+    coroutine_client = &coroutine_proxy_client;
+
+    EventLoopThread driver_thread;
+    driver_thread.start();
+    AsyncHttpClient driver_client(driver_thread.loop());
+    printf("proxy: %d concurrency, %ds\n", concurrency, seconds);
+    run_drivers(driver_thread, "callback", concurrency, seconds, [&driver_client]() {
+        return http_driver(&driver_client, PROXY_CALLBACK_PORT);
+    });
+    run_drivers(driver_thread, "coroutine", concurrency, seconds, [&driver_client]() {
+        return http_driver(&driver_client, PROXY_COROUTINE_PORT);
+    });
+    driver_thread.stop(true);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: %s echo  [connections] [seconds] [payload_size]\n", argv[0]);
+        printf("       %s proxy [concurrency] [seconds]\n", argv[0]);
+        return -10;
+    }
+    std::string mode(argv[1]);
+    int num = argc > 2 ? atoi(argv[2]) : 100;
+    int seconds = argc > 3 ? atoi(argv[3]) : 5;
+    if (mode == "echo") {
+        int payload_size = argc > 4 ? atoi(argv[4]) : 64;
+        bench_echo(num, seconds, payload_size);
+    } else if (mode == "proxy") {
+        bench_proxy(num, seconds);
+    } else {
+        printf("unknown mode %s\n", mode.c_str());
+        return -20;
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * tcp echo server and client written with C++20 coroutines
+ *
+ * @build   make coroutine_echo (needs a C++20 compiler)
+ *
+ * @server  bin/coroutine_echo 1234
+ * @client  bin/coroutine_echo 1234 localhost
+ *          bin/nc 127.0.0.1 1234
+ *
+ */
+
+#include "TcpServer.h"
+#include "Coroutine.h"
+#include "htime.h"
+
+using namespace hv;
+
+static Task<void> echo_session(SocketChannelPtr channel) {
+    CoChannel conn(channel);
+    while (true) {
+        std::string_view data = co_await conn.read();
+        if (data.empty()) break;
+        if (co_await conn.write(data) < 0) break;
+    }
+    printf("%s disconnected\n", channel->peeraddr().c_str());
+}
+
+static Task<int> echo_once(CoChannel& conn, const std::string& msg) {
+    if (co_await conn.write(msg) < 0) co_return -1;
+    size_t nread = 0;
+    while (nread < msg.size()) {
+        std::string_view data = co_await conn.read();
+        if (data.empty()) co_return -1;
+        printf("< %.*s\n", (int)data.size(), data.data());
+        nread += data.size();
+    }
+    co_return (int)nread;
+}
+
+static Task<void> echo_client(std::string host, int port) {
+    std::string ip = co_await co_resolve(host);
+    if (ip.empty()) {
+        printf("resolve %s failed!\n", host.c_str());
+        co_return;
+    }
+    SocketChannelPtr channel = co_await CoChannel::connect(ip, port, 3000);
+    if (channel == NULL) {
+        printf("connect %s:%d failed!\n", ip.c_str(), port);
+        co_return;
+    }
+    printf("connected to %s\n", channel->peeraddr().c_str());
+    CoChannel conn(channel);
+    for (int i = 0; i < 3; ++i) {
+        std::string msg = "hello " + std::to_string(i);
+        printf("> %s\n", msg.c_str());
+        if (co_await echo_once(conn, msg) < 0) break;
+        co_await co_sleep(1000);
+    }
+    conn.close();
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: %s port [host]\n", argv[0]);
+        return -10;
+    }
+    int port = atoi(argv[1]);
+
+    if (argc > 2) {
+        EventLoopPtr loop(new EventLoop);
+        std::string host(argv[2]);
+        co_spawn(loop, [host, port, loop]() -> Task<void> {
+            co_await echo_client(host, port);
+            loop->stop();
+        });
+        loop->run();
+        return 0;
+    }
+
+    TcpServer srv;
+    int listenfd = srv.createsocket(port);
+    if (listenfd < 0) {
+        return -20;
+    }
+    printf("coroutine echo server listening on port %d\n", port);
+    srv.onConnection = [](const SocketChannelPtr& channel) {
+        if (channel->isConnected()) {
+            printf("%s connected\n", channel->peeraddr().c_str());
+            co_spawn(echo_session(channel));
+        }
+    };
+    srv.setThreadNum(4);
+    srv.start();
+
+    while (1) hv_sleep(1);
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * hrpc pingpong/throughput benchmark
+ *
+ * @build   ./configure --with-hrpc && make examples
+ *
+ * @server  bin/hrpc_server 1234 4
+ *
+ * @bench   bin/hrpc_bench 127.0.0.1 1234 1 1      # pingpong latency
+ *          bin/hrpc_bench 127.0.0.1 1234 4 1000   # throughput
+ *
+ * Keeps concurrency calls of echo in flight over connections for duration seconds,
+ * each completed call issues the next one. Reports calls/s and latency percentiles.
+ *
+ */
+
+#include <algorithm>
+
+#include "RpcClient.h"
+#include "htime.h"
+
+using namespace hv;
+
+static RpcClient*   cli = NULL;
+static std::string  payload;
+static std::atomic<bool>        running(true);
+static std::atomic<uint64_t>    completed(0);
+static std::atomic<uint64_t>    failed(0);
+
+// latency samples per client loop thread
+static std::mutex                           samples_mutex;
+static std::vector<std::vector<uint32_t>*>  all_samples;
+
+static std::vector<uint32_t>* thread_samples() {
+    static thread_local std::vector<uint32_t>* samples = NULL;
+    if (samples == NULL) {
+        samples = new std::vector<uint32_t>;
+        samples->reserve(1 << 20);
+        std::lock_guard<std::mutex> locker(samples_mutex);
+        all_samples.push_back(samples);
+    }
+    return samples;
+}
+
+static void next_call() {
+    if (!running) return;
+    uint64_t start_us = gethrtime_us();
+    cli->call("echo", payload, [start_us](RpcResponse* res) {
+        if (res->ok()) {
+            thread_samples()->push_back(gethrtime_us() - start_us);
+            ++completed;
+        } else {
+            ++failed;
+        }
+        next_call();
+    });
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("Usage: %s host port [connections] [concurrency] [seconds] [payload_size] [threads]\n", argv[0]);
+        return -10;
+    }
+    const char* host = argv[1];
+    int port = atoi(argv[2]);
+    int connections = argc > 3 ? atoi(argv[3]) : 1;
+    int concurrency = argc > 4 ? atoi(argv[4]) : 1;
+    int seconds = argc > 5 ? atoi(argv[5]) : 5;
+    int payload_size = argc > 6 ? atoi(argv[6]) : 64;
+    int threads = argc > 7 ? atoi(argv[7]) : 1;
+    payload.assign(payload_size, 'x');
+
+    RpcClient client;
+    cli = &client;
+    client.addServer(host, port);
+    client.setPoolSize(connections);
+    client.setThreadNum(threads);
+    client.setTimeout(10000);
+    if (client.start() != 0) {
+        return -20;
+    }
+    // warm up connections
+    RpcResponse res;
+    for (int i = 0; i < connections; ++i) {
+        if (client.callSync("echo", payload, &res) != HRPC_STATUS_OK) {
+            printf("echo failed: %s\n", res.payload.c_str());
+            return -30;
+        }
+    }
+
+    uint64_t start_ms = gettick_ms();
+    for (int i = 0; i < concurrency; ++i) {
+        next_call();
+    }
+    hv_sleep(seconds);
+    running = false;
+    uint64_t elapsed_ms = gettick_ms() - start_ms;
+    uint64_t calls = completed;
+    hv_msleep(100);
+
+    std::vector<uint32_t> samples;
+    {
+        std::lock_guard<std::mutex> locker(samples_mutex);
+        for (auto s : all_samples) {
+            samples.insert(samples.end(), s->begin(), s->end());
+        }
+    }
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) -> double {
+        if (samples.empty()) return 0;
+        size_t idx = (size_t)(p * (samples.size() - 1));
+        return samples[idx] / 1000.0;
+    };
+    printf("%d connections, %d concurrent calls, %d bytes payload, %ds\n",
+            connections, concurrency, payload_size, seconds);
+    printf("completed %llu calls, failed %llu: %.0f calls/s\n",
+            (unsigned long long)calls, (unsigned long long)(uint64_t)failed,
+            (double)calls * 1000 / elapsed_ms);
+    printf("latency(ms): p50=%.3f p90=%.3f p99=%.3f max=%.3f\n",
+            percentile(0.5), percentile(0.9), percentile(0.99), percentile(1.0));
+    client.stop();
+    return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * hrpc client
+ *
+ * @build   ./configure --with-hrpc && make examples
+ *
+ * @server  bin/hrpc_server 1234
+ *
+ * @client  bin/hrpc_client 127.0.0.1 1234 add 1 2
+ *          bin/hrpc_client 127.0.0.1 1234 div 1 0
+ *
+ */
+
+#include "RpcClient.h"
+#include "htime.h"
+
+using namespace hv;
+
+int main(int argc, char** argv) {
+    if (argc < 6) {
+        printf("Usage: %s host port method param1 param2\n", argv[0]);
+        printf("method = [add, sub, mul, div]\n");
+        return -10;
+    }
+    const char* host = argv[1];
+    int port = atoi(argv[2]);
+    const char* method = argv[3];
+
+    RpcClient cli;
+    cli.addServer(host, port);
+    cli.setTimeout(3000);
+    if (cli.start() != 0) {
+        return -20;
+    }
+
+    // typed sync call
+    nlohmann::json req, res;
+    req["num1"] = atoll(argv[4]);
+    req["num2"] = atoll(argv[5]);
+    int status = cli.invoke(method, req, &res);
+    if (status == HRPC_STATUS_OK) {
+        printf("%s %s %s = %s\n", argv[4], method, argv[5], res["result"].dump().c_str());
+    } else {
+        printf("%s failed: %s\n", method, hrpc_status_str(status));
+    }
+
+    // async calls multiplexed on one connection
+    std::atomic<int> done(0);
+    for (int i = 0; i < 3; ++i) {
+        std::string msg = "hello" + std::to_string(i);
+        cli.call("echo", msg, [&done](RpcResponse* res) {
+            printf("echo => %d %s\n", res->status, res->payload.c_str());
+            ++done;
+        });
+    }
+    // deadline
+    cli.call("sleep", "1000", [&done](RpcResponse* res) {
+        printf("sleep 1000 with timeout 100 => %s\n", hrpc_status_str(res->status));
+        ++done;
+    }, 100);
+    // cancel
+    RpcCallPtr call = cli.call("sleep", "1000", [&done](RpcResponse* res) {
+        printf("sleep 1000 canceled => %s\n", hrpc_status_str(res->status));
+        ++done;
+    });
+    call->cancel();
+    // future
+    std::future<RpcResponse> future = cli.callFuture("echo", "future");
+    printf("future => %s\n", future.get().payload.c_str());
+
+    while (done < 5) hv_msleep(10);
+    return status;
+}
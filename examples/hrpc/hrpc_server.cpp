@@ -0,0 +1,82 @@
+/*
+ * hrpc server
+ *
+ * @build   ./configure --with-hrpc && make examples
+ *
+ * @server  bin/hrpc_server 1234 [io_threads] [worker_threads]
+ *
+ * @client  bin/hrpc_client 127.0.0.1 1234 add 1 2
+ *          bin/hrpc_bench  127.0.0.1 1234
+ *
+ */
+
+#include "RpcServer.h"
+#include "htime.h"
+
+using namespace hv;
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: %s port [io_threads] [worker_threads]\n", argv[0]);
+        return -10;
+    }
+    int port = atoi(argv[1]);
+    int io_threads = argc > 2 ? atoi(argv[2]) : 4;
+    int worker_threads = argc > 3 ? atoi(argv[3]) : 0;
+
+    RpcServer server;
+    // raw
+    server.registerMethod("echo", [](const RpcContextPtr& ctx) {
+        ctx->reply(ctx->payload);
+    });
+    // reply later
+    server.registerMethod("sleep", [](const RpcContextPtr& ctx) {
+        int ms = atoi(ctx->payload.c_str());
+        std::thread([ctx, ms]() {
+            hv_msleep(ms);
+            ctx->reply(ctx->isCanceled() ? "canceled" : "wakeup");
+        }).detach();
+    });
+    // json
+    auto calc = [](const char* op) {
+        return std::function<int(const nlohmann::json&, nlohmann::json*)>(
+            [op](const nlohmann::json& req, nlohmann::json* res) {
+                if (!req.contains("num1") || !req.contains("num2")) return (int)HRPC_STATUS_BAD_REQUEST;
+                long long num1 = req["num1"].get<long long>();
+                long long num2 = req["num2"].get<long long>();
+                long long result = 0;
+                switch (*op) {
+                case '+': result = num1 + num2; break;
+                case '-': result = num1 - num2; break;
+                case '*': result = num1 * num2; break;
+                case '/':
+                    if (num2 == 0) return (int)HRPC_STATUS_ERROR;
+                    result = num1 / num2;
+                    break;
+                }
+                (*res)["result"] = result;
+                return (int)HRPC_STATUS_OK;
+            });
+    };
+    server.addMethod<nlohmann::json, nlohmann::json>("add", calc("+"));
+    server.addMethod<nlohmann::json, nlohmann::json>("sub", calc("-"));
+    server.addMethod<nlohmann::json, nlohmann::json>("mul", calc("*"));
+    server.addMethod<nlohmann::json, nlohmann::json>("div", calc("/"));
+
+    server.setThreadNum(io_threads);
+    server.setWorkerThreadNum(worker_threads);
+    if (server.listen(port) < 0) {
+        return -20;
+    }
+    server.start();
+    printf("hrpc server listening on port %d, io threads %d, worker threads %d\n", port, io_threads, worker_threads);
+
+    while (1) {
+        hv_sleep(10);
+        printf("requests=%llu canceled=%llu expired=%llu\n",
+            (unsigned long long)server.stats.requests,
+            (unsigned long long)server.stats.canceled,
+            (unsigned long long)server.stats.expired);
+    }
+    return 0;
+}
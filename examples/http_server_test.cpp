@@ -7,6 +7,7 @@
 #include "HttpServer.h"
 #include "hthread.h"    // import hv_gettid
 #include "hasync.h"     // import hv::async
+#include "htime.h"      // import gettick_ms
 
 using namespace hv;
 
@@ -97,6 +98,28 @@ int main(int argc, char** argv) {
         writer->End();
     });
 
+    // curl -v http://ip:port/metrics
+    router.EnableMetrics("/metrics");
+
+    // curl -v http://ip:port/block?t=2000
+    // NOTE: block the loop thread to see the watchdog report,
+    // busy wait here, as the signal capturing stack would interrupt sleep.
+    router.GET("/block", [](HttpRequest* req, HttpResponse* resp) {
+        unsigned int ms = atoi(req->GetParam("t", "2000").c_str());
+        unsigned int start_ms = gettick_ms();
+        while (gettick_ms() - start_ms < ms);
+        return resp->String("unblocked");
+    });
+
+    // curl -v http://ip:port/offload?t=2000
+    // NOTE: the same handler run on worker pool, IO thread is not blocked.
+    router.GET("/offload", [](HttpRequest* req, HttpResponse* resp) {
+        unsigned int ms = atoi(req->GetParam("t", "2000").c_str());
+        unsigned int start_ms = gettick_ms();
+        while (gettick_ms() - start_ms < ms);
+        return resp->String("offloaded");
+    }, http_exec_policy::POOL);
+
     // middleware
     router.AllowCORS();
     router.Use([](HttpRequest* req, HttpResponse* resp) {
@@ -125,6 +148,9 @@ int main(int argc, char** argv) {
     // uncomment to test multi-threads
     // server.setThreadNum(4);
 
+    // log the stack of loop threads blocked longer than 1s, try /block
+    server.enableWatchdog(1000);
+
     server.start();
 
     // press Enter to stop
@@ -169,6 +169,16 @@ int parse_confile(const char* confile) {
     if (str.size() != 0) {
         g_http_service.limit_rate = atoi(str.c_str());
     }
+    // upload_dir
+    str = ini.GetValue("upload_dir");
+    if (str.size() != 0) {
+        g_http_service.upload_dir = str;
+    }
+    // compression
+    str = ini.GetValue("compression");
+    if (str.size() != 0) {
+        g_http_service.enable_compression = hv_getboolean(str.c_str());
+    }
     // access_log
     str = ini.GetValue("access_log");
     if (str.size() != 0) {
@@ -0,0 +1,118 @@
+/*
+ * mqtt publish throughput benchmark
+ *
+ * @build   ./configure --with-mqtt && make examples
+ * @broker  mosquitto -p 1883
+ * @bench   bin/mqtt_bench 127.0.0.1 1883 bench 1000000 1 64
+ *
+ */
+
+#include "hv.h"
+#include "htime.h"
+#include "mqtt_client.h"
+
+typedef struct bench_ctx_s {
+    const char* topic;
+    int         count;
+    int         qos;
+    char*       payload;
+    int         payload_len;
+    int         published;
+    int         acked;
+    uint64_t    start_us;
+} bench_ctx_t;
+
+static void bench_report(mqtt_client_t* cli) {
+    bench_ctx_t* ctx = (bench_ctx_t*)mqtt_client_get_userdata(cli);
+    uint64_t elapsed_us = gethrtime_us() - ctx->start_us;
+    if (elapsed_us == 0) elapsed_us = 1;
+    double msgs = (double)ctx->count * 1000000 / elapsed_us;
+    printf("published %d messages of %d bytes with QoS %d in %.3fs: %.0f msg/s, %.2f MB/s\n",
+            ctx->count, ctx->payload_len, ctx->qos, elapsed_us / 1000000.0,
+            msgs, msgs * ctx->payload_len / 1024 / 1024);
+    mqtt_client_disconnect(cli);
+}
+
+// publish until queue is full, continue on ack
+static void bench_publish(mqtt_client_t* cli) {
+    bench_ctx_t* ctx = (bench_ctx_t*)mqtt_client_get_userdata(cli);
+    mqtt_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.topic = ctx->topic;
+    msg.topic_len = strlen(ctx->topic);
+    msg.payload = ctx->payload;
+    msg.payload_len = ctx->payload_len;
+    msg.qos = ctx->qos;
+    while (ctx->published < ctx->count) {
+        // NOTE: QoS 0 has no flow control, limit write queue
+        if (ctx->qos == 0 && hio_write_bufsize(cli->io) > (1 << 20)) break;
+        if (mqtt_client_publish(cli, &msg) < 0) break;
+        ++ctx->published;
+    }
+}
+
+// QoS 0 has no ack, publish more and wait write queue drained
+static void bench_check_drained(htimer_t* timer) {
+    mqtt_client_t* cli = (mqtt_client_t*)hevent_userdata(timer);
+    bench_ctx_t* ctx = (bench_ctx_t*)mqtt_client_get_userdata(cli);
+    bench_publish(cli);
+    if (ctx->published == ctx->count && cli->queued_bytes == 0 && hio_write_is_complete(cli->io)) {
+        htimer_del(timer);
+        bench_report(cli);
+    }
+}
+
+static void on_mqtt(mqtt_client_t* cli, int type) {
+    bench_ctx_t* ctx = (bench_ctx_t*)mqtt_client_get_userdata(cli);
+    switch(type) {
+    case MQTT_TYPE_DISCONNECT:
+        mqtt_client_stop(cli);
+        break;
+    case MQTT_TYPE_CONNACK:
+        ctx->start_us = gethrtime_us();
+        bench_publish(cli);
+        if (ctx->qos == 0) {
+            htimer_t* timer = htimer_add(cli->loop, bench_check_drained, 1, INFINITE);
+            hevent_set_userdata(timer, cli);
+        }
+        break;
+    case MQTT_TYPE_PUBACK:  /* qos = 1 */
+    case MQTT_TYPE_PUBCOMP: /* qos = 2 */
+        if (++ctx->acked == ctx->count) {
+            bench_report(cli);
+        } else {
+            bench_publish(cli);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        printf("Usage: %s host port topic [count=100000] [qos=1] [payload_size=64] [max_inflight=128]\n", argv[0]);
+        return -10;
+    }
+    const char* host = argv[1];
+    int port = atoi(argv[2]);
+    bench_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.topic = argv[3];
+    ctx.count = argc > 4 ? atoi(argv[4]) : 100000;
+    ctx.qos = argc > 5 ? atoi(argv[5]) : 1;
+    ctx.payload_len = argc > 6 ? atoi(argv[6]) : 64;
+    HV_ALLOC(ctx.payload, ctx.payload_len);
+    memset(ctx.payload, 'x', ctx.payload_len);
+
+    mqtt_client_t* cli = mqtt_client_new(NULL);
+    if (cli == NULL) return -1;
+    if (argc > 7) cli->max_inflight = atoi(argv[7]);
+    mqtt_client_set_userdata(cli, &ctx);
+    mqtt_client_set_callback(cli, on_mqtt);
+    mqtt_client_connect(cli, host, port, 0);
+    mqtt_client_run(cli);
+    mqtt_client_free(cli);
+    HV_FREE(ctx.payload);
+    return 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * mqtt broker
+ *
+ * @build   ./configure --with-mqtt && make examples
+ *
+ * @server  bin/mqtt_broker 1883 4
+ *
+ * @client  bin/mqtt_sub 127.0.0.1 1883 test/#
+ *          bin/mqtt_pub 127.0.0.1 1883 test/topic hello
+ *
+ */
+
+#include "MqttBroker.h"
+#include "htime.h"
+
+using namespace hv;
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: %s port [threads]\n", argv[0]);
+        return -10;
+    }
+    int port = atoi(argv[1]);
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+
+    MqttBroker broker;
+    broker.setThreadNum(threads);
+    if (broker.listen(port) < 0) {
+        return -20;
+    }
+    broker.start();
+    printf("mqtt broker listening on port %d, worker threads %d\n", port, threads);
+
+    while (1) {
+        hv_sleep(10);
+        printf("connections=%llu received=%llu delivered=%llu dropped=%llu\n",
+            (unsigned long long)broker.stats.connections,
+            (unsigned long long)broker.stats.received,
+            (unsigned long long)broker.stats.delivered,
+            (unsigned long long)broker.stats.dropped);
+    }
+    return 0;
+}
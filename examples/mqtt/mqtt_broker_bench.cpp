@@ -0,0 +1,202 @@
+/*
+ * mqtt broker fan-out benchmark
+ *
+ * @build   ./configure --with-mqtt && make examples
+ *
+ * @bench   ulimit -n 65536
+ *          bin/mqtt_broker_bench 1883 10000 1000 100 0 64 4
+ *
+ * Starts MqttBroker in process, connects N subscribers of the same topic over loopback,
+ * then one publisher publishes messages at a fixed rate with send time in payload.
+ * Reports delivered msg/s and delivery latency percentiles.
+ *
+ */
+
+#include <algorithm>
+
+#include "MqttBroker.h"
+#include "mqtt_client.h"
+#include "htime.h"
+
+using namespace hv;
+
+#define BENCH_TOPIC "bench/fanout"
+
+static int  port = DEFAULT_MQTT_PORT;
+static int  subscribers = 10000;
+static int  messages = 1000;
+static int  rate = 100;
+static int  qos = 0;
+static int  payload_size = 64;
+static int  threads = 4;
+
+static std::atomic<int>         connected(0);
+static std::atomic<int>         subscribed(0);
+static std::atomic<uint64_t>    received(0);
+static std::atomic<uint64_t>    last_recv_us(0);
+
+// latency samples per client loop thread
+static std::mutex                           samples_mutex;
+static std::vector<std::vector<uint32_t>*>  all_samples;
+
+static std::vector<uint32_t>* thread_samples() {
+    static thread_local std::vector<uint32_t>* samples = NULL;
+    if (samples == NULL) {
+        samples = new std::vector<uint32_t>;
+        samples->reserve((size_t)subscribers * messages / threads + 1024);
+        std::lock_guard<std::mutex> locker(samples_mutex);
+        all_samples.push_back(samples);
+    }
+    return samples;
+}
+
+static void on_subscriber(mqtt_client_t* cli, int type) {
+    switch (type) {
+    case MQTT_TYPE_CONNACK:
+        ++connected;
+        mqtt_client_subscribe(cli, BENCH_TOPIC, qos);
+        break;
+    case MQTT_TYPE_SUBACK:
+        ++subscribed;
+        break;
+    case MQTT_TYPE_PUBLISH:
+    {
+        uint64_t now_us = gethrtime_us();
+        uint64_t send_us = 0;
+        if (cli->message.payload_len >= sizeof(send_us)) {
+            memcpy(&send_us, cli->message.payload, sizeof(send_us));
+            thread_samples()->push_back(now_us - send_us);
+        }
+        ++received;
+        last_recv_us = now_us;
+    }
+        break;
+    default:
+        break;
+    }
+}
+
+static void on_publisher(mqtt_client_t* cli, int type) {
+    if (type == MQTT_TYPE_CONNACK) {
+        ++connected;
+    }
+}
+
+static bool wait_until(std::function<bool()> cond, int timeout_ms) {
+    uint64_t end_ms = gettick_ms() + timeout_ms;
+    while (!cond()) {
+        if (gettick_ms() > end_ms) return false;
+        hv_msleep(10);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: %s port [subscribers] [messages] [rate] [qos] [payload_size] [threads]\n", argv[0]);
+        return -10;
+    }
+    port = atoi(argv[1]);
+    if (argc > 2) subscribers = atoi(argv[2]);
+    if (argc > 3) messages = atoi(argv[3]);
+    if (argc > 4) rate = atoi(argv[4]);
+    if (argc > 5) qos = atoi(argv[5]);
+    if (argc > 6) payload_size = atoi(argv[6]);
+    if (argc > 7) threads = atoi(argv[7]);
+    if (payload_size < (int)sizeof(uint64_t)) payload_size = sizeof(uint64_t);
+    if (rate <= 0) rate = 1;
+
+    MqttBroker broker;
+    broker.setThreadNum(threads);
+    if (broker.listen(port, "127.0.0.1") < 0) {
+        return -20;
+    }
+    broker.start();
+
+    EventLoopThreadPool client_loops(threads);
+    client_loops.start(true);
+
+    // connect subscribers in batches to avoid overflowing the listen backlog
+    std::vector<mqtt_client_t*> clients(subscribers + 1, NULL);
+    const int batch = 100;
+    for (int i = 0; i < subscribers; i += batch) {
+        for (int j = i; j < i + batch && j < subscribers; ++j) {
+            EventLoopPtr loop = client_loops.nextLoop();
+            mqtt_client_t* cli = mqtt_client_new(loop->loop());
+            mqtt_client_set_callback(cli, on_subscriber);
+            clients[j] = cli;
+            loop->runInLoop([cli]() {
+                mqtt_client_connect(cli, "127.0.0.1", port, 0);
+            });
+        }
+        wait_until([i]() { return connected >= i; }, 10000);
+    }
+    if (!wait_until([]() { return subscribed == subscribers; }, 60000)) {
+        printf("subscribed %d/%d, check ulimit -n\n", (int)subscribed, subscribers);
+        return -30;
+    }
+    printf("%d subscribers ready, broker connections=%llu\n",
+            subscribers, (unsigned long long)broker.stats.connections);
+
+    // publisher
+    EventLoopPtr pub_loop = client_loops.nextLoop();
+    mqtt_client_t* publisher = mqtt_client_new(pub_loop->loop());
+    mqtt_client_set_callback(publisher, on_publisher);
+    clients[subscribers] = publisher;
+    pub_loop->runInLoop([publisher]() {
+        mqtt_client_connect(publisher, "127.0.0.1", port, 0);
+    });
+    if (!wait_until([]() { return connected == subscribers + 1; }, 10000)) {
+        return -40;
+    }
+
+    std::string payload(payload_size, 'x');
+    uint64_t start_us = gethrtime_us();
+    for (int i = 0; i < messages; ++i) {
+        // pace by absolute schedule
+        uint64_t due_us = start_us + (uint64_t)i * 1000000 / rate;
+        while (gethrtime_us() < due_us) {
+            hv_msleep(1);
+        }
+        uint64_t now_us = gethrtime_us();
+        memcpy(&payload[0], &now_us, sizeof(now_us));
+        mqtt_message_t msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.topic = BENCH_TOPIC;
+        msg.topic_len = strlen(BENCH_TOPIC);
+        msg.payload = payload.data();
+        msg.payload_len = payload.size();
+        msg.qos = qos;
+        mqtt_client_publish(publisher, &msg);
+    }
+    uint64_t expected = (uint64_t)subscribers * messages;
+    wait_until([expected]() { return received >= expected; }, 10000);
+
+    uint64_t elapsed_us = last_recv_us - start_us;
+    if (elapsed_us == 0) elapsed_us = 1;
+    std::vector<uint32_t> samples;
+    {
+        std::lock_guard<std::mutex> locker(samples_mutex);
+        for (auto s : all_samples) {
+            samples.insert(samples.end(), s->begin(), s->end());
+        }
+    }
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) -> double {
+        if (samples.empty()) return 0;
+        size_t idx = (size_t)(p * (samples.size() - 1));
+        return samples[idx] / 1000.0;
+    };
+    printf("published %d messages of %d bytes with QoS %d at %d msg/s to %d subscribers\n",
+            messages, payload_size, qos, rate, subscribers);
+    printf("delivered %llu/%llu in %.3fs: %.0f msg/s, dropped %llu\n",
+            (unsigned long long)(uint64_t)received, (unsigned long long)expected,
+            elapsed_us / 1000000.0, (double)received * 1000000 / elapsed_us,
+            (unsigned long long)broker.stats.dropped);
+    printf("latency(ms): p50=%.3f p90=%.3f p99=%.3f max=%.3f\n",
+            percentile(0.5), percentile(0.9), percentile(0.99), percentile(1.0));
+
+    client_loops.stop(true);
+    broker.stop();
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * RedisClient test
+ *
+ * @build   ./configure --with-redis && make examples
+ *
+ * @server  bin/redis_stub 6379
+ *          bin/redis_stub 7000 7001 7002
+ *
+ * @client  bin/redis_client_test 127.0.0.1 6379 [resp3]
+ *          bin/redis_client_test 127.0.0.1 7000 cluster
+ *
+ */
+
+#include "RedisClient.h"
+#include "EventLoopThreadPool.h"
+#include "htime.h"
+
+#include "unittest/unittest.h"
+
+using namespace hv;
+
+#define PIPELINE_COMMANDS   10000
+#define CLUSTER_KEYS        100
+
+static bool wait_until(std::function<bool()> cond, int timeout_ms) {
+    uint64_t end_ms = gettick_ms() + timeout_ms;
+    while (!cond()) {
+        if (gettick_ms() > end_ms) return false;
+        hv_msleep(10);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("Usage: %s host port [resp3|cluster]\n", argv[0]);
+        return -10;
+    }
+    const char* mode = argc > 3 ? argv[3] : "";
+
+    RedisClient redis;
+    redis.host = argv[1];
+    redis.port = atoi(argv[2]);
+    redis.protocol = strcmp(mode, "resp3") == 0 ? 3 : 2;
+    redis.cluster = strcmp(mode, "cluster") == 0;
+
+    // set/get
+    std::atomic<int> done(0);
+    std::string value;
+    redis.command({"SET", "hello", "world"});
+    redis.command({"GET", "hello"}, [&](RedisReply* reply) {
+        printf("GET hello => %s\n", reply->Dump().c_str());
+        value = reply->str();
+        ++done;
+    });
+    redis.command({"GET", "nonexistent"}, [&](RedisReply* reply) {
+        printf("GET nonexistent => %s\n", reply->Dump().c_str());
+        ++done;
+    });
+    CHECK(wait_until([&]() { return done == 2; }, 3000) && value == "world");
+
+    // pipelining: commands issued in one loop iteration are written at once
+    EventLoopThreadPool loops(2);
+    loops.start(true);
+    std::atomic<int> replies(0);
+    std::atomic<int> disorders(0);
+    redis.command({"DEL", "counter"});
+    hv_msleep(100);
+    uint64_t start_ms = gettick_ms();
+    EventLoopPtr loop = loops.nextLoop();
+    loop->runInLoop([&]() {
+        for (int i = 1; i <= PIPELINE_COMMANDS; ++i) {
+            redis.command({"INCR", "counter"}, [&, i](RedisReply* reply) {
+                if (reply->integer != i) ++disorders;
+                ++replies;
+            });
+        }
+    });
+    CHECK(wait_until([&]() { return replies == PIPELINE_COMMANDS; }, 10000) && disorders == 0);
+    printf("%d commands in %llums\n", PIPELINE_COMMANDS, (unsigned long long)(gettick_ms() - start_ms));
+
+    // pub/sub
+    std::atomic<int> messages(0);
+    std::atomic<int> pmessages(0);
+    redis.subscribe("news", [&](const std::string& channel, const std::string& message) {
+        printf("message %s: %s\n", channel.c_str(), message.c_str());
+        ++messages;
+    });
+    redis.psubscribe("news.*", [&](const std::string& channel, const std::string& message) {
+        printf("pmessage %s: %s\n", channel.c_str(), message.c_str());
+        ++pmessages;
+    });
+    hv_msleep(200);
+    redis.command({"PUBLISH", "news", "hello"});
+    redis.command({"PUBLISH", "news.sport", "goal"});
+    CHECK(wait_until([&]() { return messages == 1 && pmessages == 1; }, 3000));
+    redis.unsubscribe("news");
+    hv_msleep(200);
+    redis.command({"PUBLISH", "news", "again"});
+    hv_msleep(200);
+    CHECK(messages == 1);
+
+    if (redis.cluster) {
+        // keys are spread over nodes, routed by MOVED and CLUSTER SLOTS
+        std::atomic<int> ok(0);
+        std::atomic<int> sets(0);
+        for (int i = 0; i < CLUSTER_KEYS; ++i) {
+            std::string key = "key" + std::to_string(i);
+            redis.command({"SET", key, std::to_string(i)}, [&](RedisReply* reply) {
+                if (!reply->IsError()) ++sets;
+            });
+        }
+        // no order between connections of different loops
+        wait_until([&]() { return sets == CLUSTER_KEYS; }, 5000);
+        for (int i = 0; i < CLUSTER_KEYS; ++i) {
+            std::string key = "key" + std::to_string(i);
+            loops.nextLoop()->runInLoop([&, key, i]() {
+                redis.command({"GET", key}, [&, i](RedisReply* reply) {
+                    if (reply->str() == std::to_string(i)) ++ok;
+                    else printf("GET key%d => %s\n", i, reply->Dump().c_str());
+                });
+            });
+        }
+        CHECK(wait_until([&]() { return ok == CLUSTER_KEYS; }, 5000));
+
+        // ASK to the importing node
+        done = 0;
+        value.clear();
+        redis.command({"SET", "ask:key", "migrating"});
+        redis.command({"GET", "ask:key"}, [&](RedisReply* reply) {
+            printf("GET ask:key => %s\n", reply->Dump().c_str());
+            value = reply->str();
+            ++done;
+        });
+        CHECK(wait_until([&]() { return done == 1; }, 3000) && value == "migrating");
+    }
+
+    loops.stop(true);
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed;
+}
@@ -0,0 +1,286 @@
+/*
+ * redis stub server for testing RedisClient
+ *
+ * @build   ./configure --with-redis && make examples
+ *
+ * @server  bin/redis_stub 6379
+ *          bin/redis_stub 7000 7001 7002   # cluster of 3 nodes
+ *
+ * @client  bin/redis_client_test 127.0.0.1 6379
+ *          bin/redis_client_test 127.0.0.1 7000 cluster
+ *
+ * Commands: PING ECHO HELLO AUTH SELECT ASKING GET SET DEL INCR
+ *           PUBLISH SUBSCRIBE UNSUBSCRIBE PSUBSCRIBE PUNSUBSCRIBE CLUSTER SLOTS
+ *
+ * In cluster mode slots are split evenly between the ports,
+ * keys of other nodes get -MOVED, keys prefixed with "ask:" get -ASK
+ * to the next node which only serves them after ASKING.
+ *
+ */
+
+#include <set>
+
+#include "TcpServer.h"
+#include "RedisParser.h"
+#include "RedisClient.h"
+#include "hbase.h"
+#include "hstring.h"
+
+using namespace hv;
+
+struct StubNode {
+    int         index;
+    int         port;
+    TcpServer   server;
+};
+
+struct StubConn {
+    RedisParser parser;
+    StubNode*   node;
+    // set while feeding parser
+    SocketChannelPtr channel;
+    bool        resp3;
+    bool        asking;
+    std::set<std::string> channels;
+    std::set<std::string> patterns;
+
+    StubConn() : node(NULL), resp3(false), asking(false) {}
+};
+
+static std::vector<StubNode*> nodes;
+// shared by all nodes
+static std::mutex                                   data_mutex;
+static std::map<std::string, std::string>           data;
+static std::map<std::string, std::set<SocketChannelPtr>> channel_subs;
+static std::map<std::string, std::set<SocketChannelPtr>> pattern_subs;
+
+static int slot_owner(int slot) {
+    return slot * (int)nodes.size() / REDIS_CLUSTER_SLOTS;
+}
+
+static void append_bulk(std::string& out, const std::string& str) {
+    out += "$" + std::to_string(str.size()) + "\r\n" + str + "\r\n";
+}
+
+static void append_nil(std::string& out, bool resp3) {
+    out += resp3 ? "_\r\n" : "$-1\r\n";
+}
+
+static void append_push(std::string& out, bool resp3, int n) {
+    out += (resp3 ? ">" : "*") + std::to_string(n) + "\r\n";
+}
+
+static bool glob_match(const char* pattern, const char* str) {
+    if (*pattern == '\0') return *str == '\0';
+    if (*pattern == '*') {
+        return glob_match(pattern + 1, str) || (*str && glob_match(pattern, str + 1));
+    }
+    return *str && (*pattern == '?' || *pattern == *str) && glob_match(pattern + 1, str + 1);
+}
+
+static void on_subscribe(const SocketChannelPtr& channel, StubConn* conn, const std::vector<std::string>& argv, std::string& out) {
+    std::string cmd = argv[0];
+    tolower(cmd);
+    bool pattern = cmd[0] == 'p';
+    bool sub = cmd.find("unsubscribe") == std::string::npos;
+    auto& subs = pattern ? pattern_subs : channel_subs;
+    auto& mine = pattern ? conn->patterns : conn->channels;
+    std::lock_guard<std::mutex> locker(data_mutex);
+    for (size_t i = 1; i < argv.size(); ++i) {
+        if (sub) {
+            mine.insert(argv[i]);
+            subs[argv[i]].insert(channel);
+        } else {
+            mine.erase(argv[i]);
+            subs[argv[i]].erase(channel);
+        }
+        append_push(out, conn->resp3, 3);
+        append_bulk(out, cmd);
+        append_bulk(out, argv[i]);
+        out += ":" + std::to_string(conn->channels.size() + conn->patterns.size()) + "\r\n";
+    }
+}
+
+static int on_publish(const std::string& ch, const std::string& message) {
+    std::lock_guard<std::mutex> locker(data_mutex);
+    int receivers = 0;
+    auto iter = channel_subs.find(ch);
+    if (iter != channel_subs.end()) {
+        for (auto& sub : iter->second) {
+            StubConn* conn = sub->getContext<StubConn>();
+            std::string out;
+            append_push(out, conn->resp3, 3);
+            append_bulk(out, "message");
+            append_bulk(out, ch);
+            append_bulk(out, message);
+            sub->write(out);
+            ++receivers;
+        }
+    }
+    for (auto& pair : pattern_subs) {
+        if (!glob_match(pair.first.c_str(), ch.c_str())) continue;
+        for (auto& sub : pair.second) {
+            StubConn* conn = sub->getContext<StubConn>();
+            std::string out;
+            append_push(out, conn->resp3, 4);
+            append_bulk(out, "pmessage");
+            append_bulk(out, pair.first);
+            append_bulk(out, ch);
+            append_bulk(out, message);
+            sub->write(out);
+            ++receivers;
+        }
+    }
+    return receivers;
+}
+
+// @retval true if redirected
+static bool check_slot(StubConn* conn, const std::vector<std::string>& argv, std::string& out) {
+    if (nodes.size() < 2 || argv.size() < 2) return false;
+    bool asking = conn->asking;
+    conn->asking = false;
+    int slot = RedisClient::KeySlot(argv);
+    int owner = slot_owner(slot);
+    bool ask = strncmp(argv[1].c_str(), "ask:", 4) == 0;
+    int target = owner;
+    if (ask) {
+        // migrating to the next node
+        target = (owner + 1) % nodes.size();
+        if (conn->node->index == target && asking) return false;
+        if (conn->node->index == owner) {
+            out += "-ASK " + std::to_string(slot) + " 127.0.0.1:" + std::to_string(nodes[target]->port) + "\r\n";
+            return true;
+        }
+    }
+    if (conn->node->index == owner) return false;
+    out += "-MOVED " + std::to_string(slot) + " 127.0.0.1:" + std::to_string(nodes[owner]->port) + "\r\n";
+    return true;
+}
+
+static void on_command(const SocketChannelPtr& channel, StubConn* conn, RedisReply* request) {
+    std::vector<std::string> argv;
+    for (auto& arg : request->elements) {
+        argv.push_back(arg.str());
+    }
+    if (argv.empty()) return;
+    std::string cmd = argv[0];
+    tolower(cmd);
+    std::string out;
+    if (cmd == "ping") {
+        out = "+PONG\r\n";
+    } else if (cmd == "echo" && argv.size() == 2) {
+        append_bulk(out, argv[1]);
+    } else if (cmd == "hello") {
+        conn->resp3 = argv.size() > 1 && argv[1] == "3";
+        out = conn->resp3 ? "%1\r\n" : "*2\r\n";
+        append_bulk(out, "proto");
+        out += conn->resp3 ? ":3\r\n" : ":2\r\n";
+    } else if (cmd == "auth" || cmd == "select") {
+        out = "+OK\r\n";
+    } else if (cmd == "asking") {
+        conn->asking = true;
+        out = "+OK\r\n";
+    } else if (cmd == "cluster" && argv.size() == 2 && stricmp(argv[1].c_str(), "slots") == 0) {
+        if (nodes.size() < 2) {
+            out = "-ERR This instance has cluster support disabled\r\n";
+        } else {
+            out = "*" + std::to_string(nodes.size()) + "\r\n";
+            int start = 0;
+            for (int i = 0; i < (int)nodes.size(); ++i) {
+                int end = start;
+                while (end + 1 < REDIS_CLUSTER_SLOTS && slot_owner(end + 1) == i) ++end;
+                out += "*3\r\n:" + std::to_string(start) + "\r\n:" + std::to_string(end) + "\r\n";
+                out += "*3\r\n";
+                append_bulk(out, "127.0.0.1");
+                out += ":" + std::to_string(nodes[i]->port) + "\r\n";
+                append_bulk(out, "node" + std::to_string(i));
+                start = end + 1;
+            }
+        }
+    } else if (cmd == "publish" && argv.size() == 3) {
+        out = ":" + std::to_string(on_publish(argv[1], argv[2])) + "\r\n";
+    } else if (cmd == "subscribe" || cmd == "unsubscribe" ||
+               cmd == "psubscribe" || cmd == "punsubscribe") {
+        on_subscribe(channel, conn, argv, out);
+    } else if (check_slot(conn, argv, out)) {
+    } else if (cmd == "get" && argv.size() == 2) {
+        std::lock_guard<std::mutex> locker(data_mutex);
+        auto iter = data.find(argv[1]);
+        if (iter == data.end()) {
+            append_nil(out, conn->resp3);
+        } else {
+            append_bulk(out, iter->second);
+        }
+    } else if (cmd == "set" && argv.size() == 3) {
+        std::lock_guard<std::mutex> locker(data_mutex);
+        data[argv[1]] = argv[2];
+        out = "+OK\r\n";
+    } else if (cmd == "del" && argv.size() >= 2) {
+        std::lock_guard<std::mutex> locker(data_mutex);
+        int n = 0;
+        for (size_t i = 1; i < argv.size(); ++i) {
+            n += data.erase(argv[i]);
+        }
+        out = ":" + std::to_string(n) + "\r\n";
+    } else if (cmd == "incr" && argv.size() == 2) {
+        std::lock_guard<std::mutex> locker(data_mutex);
+        std::string& value = data[argv[1]];
+        value = std::to_string(atoll(value.c_str()) + 1);
+        out = ":" + value + "\r\n";
+    } else {
+        out = "-ERR unknown command '" + argv[0] + "'\r\n";
+    }
+    channel->write(out);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: %s port [port2 port3 ...]\n", argv[0]);
+        return -10;
+    }
+    for (int i = 1; i < argc; ++i) {
+        StubNode* node = new StubNode;
+        node->index = i - 1;
+        node->port = atoi(argv[i]);
+        nodes.push_back(node);
+    }
+    for (auto node : nodes) {
+        TcpServer& server = node->server;
+        if (server.createsocket(node->port) < 0) {
+            return -20;
+        }
+        server.onConnection = [node](const SocketChannelPtr& channel) {
+            if (channel->isConnected()) {
+                StubConn* conn = channel->newContext<StubConn>();
+                conn->node = node;
+                conn->parser.onReply = [conn](RedisReply* request) {
+                    on_command(conn->channel, conn, request);
+                };
+            } else {
+                StubConn* conn = channel->getContext<StubConn>();
+                {
+                    std::lock_guard<std::mutex> locker(data_mutex);
+                    for (auto& ch : conn->channels) channel_subs[ch].erase(channel);
+                    for (auto& pattern : conn->patterns) pattern_subs[pattern].erase(channel);
+                }
+                channel->deleteContext<StubConn>();
+            }
+        };
+        server.onMessage = [](const SocketChannelPtr& channel, Buffer* buf) {
+            StubConn* conn = channel->getContext<StubConn>();
+            conn->channel = channel;
+            if (conn->parser.Feed((const char*)buf->data(), buf->size()) != 0) {
+                channel->close();
+            }
+            conn->channel = NULL;
+        };
+        server.start();
+        printf("redis stub node%d listening on port %d\n", node->index, node->port);
+    }
+    if (nodes.size() > 1) {
+        printf("cluster mode: %d nodes\n", (int)nodes.size());
+    }
+
+    while (1) hv_sleep(1);
+    return 0;
+}
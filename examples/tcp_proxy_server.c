@@ -34,7 +34,8 @@ static char backend_host[64] = "127.0.0.1";
 static int  backend_port = 80;
 static int  backend_ssl = 0;
 
-// hloop_create_tcp_server -> on_accept -> hio_setup_tcp_upstream
+// hloop_create_tcp_server -> on_accept -> hio_setup_tcp_relay
+// NOTE: relayed by splice(2) on linux unless ssl, see hio_setup_relay.
 
 static void on_accept(hio_t* io) {
     /*
@@ -47,7 +48,7 @@ static void on_accept(hio_t* io) {
     */
 
     if (backend_port % 1000 == 443) backend_ssl = 1;
-    hio_setup_tcp_upstream(io, backend_host, backend_port, backend_ssl);
+    hio_setup_tcp_relay(io, backend_host, backend_port, backend_ssl);
 }
 
 int main(int argc, char** argv) {
@@ -37,6 +37,9 @@ public:
         // ping
         setPingInterval(10000);
 
+        // permessage-deflate, require ./configure --with-zlib
+        // setCompression();
+
         // reconnect: 1,2,4,8,10,10,10...
         reconn_setting_t reconn;
         reconn_setting_init(&reconn);
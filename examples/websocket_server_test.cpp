@@ -63,6 +63,8 @@ int main(int argc, char** argv) {
 
     WebSocketService ws;
     // ws.setPingInterval(10000);
+    // permessage-deflate, require ./configure --with-zlib
+    // ws.setCompression();
     ws.onopen = [](const WebSocketChannelPtr& channel, const HttpRequestPtr& req) {
         printf("onopen: GET %s\n", req->Path().c_str());
         auto ctx = channel->newContextPtr<MyContext>();
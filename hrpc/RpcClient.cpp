@@ -0,0 +1,326 @@
+#include "RpcClient.h"
+
+#include <unordered_map>
+
+#include "TcpClient.h"
+#include "hlog.h"
+
+namespace hv {
+
+// NOTE: calls, outbuf and next_id are only accessed in loop thread
+class RpcConnection : public TcpClientEventLoopTmpl<SocketChannel>,
+                      public std::enable_shared_from_this<RpcConnection> {
+public:
+    std::unordered_map<uint32_t, RpcCallPtr> calls;
+    uint32_t            next_id;
+    // for LB_LeastConnections
+    std::atomic<int>    pending;
+    // calls issued in the same loop iteration
+    std::string         outbuf;
+    bool                flush_queued;
+
+    RpcConnection(EventLoopPtr loop) : TcpClientEventLoopTmpl<SocketChannel>(loop)
+        , next_id(0), pending(0), flush_queued(false)
+    {
+        unpack_setting_t unpack_setting;
+        unpack_setting.mode = UNPACK_BY_LENGTH_FIELD;
+        unpack_setting.package_max_length = DEFAULT_PACKAGE_MAX_LENGTH;
+        unpack_setting.body_offset = HRPC_HEAD_LENGTH;
+        unpack_setting.length_field_offset = HRPC_HEAD_LENGTH_FIELD_OFFSET;
+        unpack_setting.length_field_bytes = HRPC_HEAD_LENGTH_FIELD_BYTES;
+        unpack_setting.length_field_coding = ENCODE_BY_BIG_ENDIAN;
+        setUnpack(&unpack_setting);
+
+        reconn_setting_t reconn;
+        reconn_setting_init(&reconn);
+        reconn.min_delay = 1000;
+        reconn.max_delay = 10000;
+        reconn.delay_policy = 2;
+        setReconnect(&reconn);
+
+        onConnection = [this](const SocketChannelPtr& channel) {
+            if (channel->isConnected()) {
+                tcp_nodelay(channel->fd(), 1);
+                flush();
+            } else {
+                failAll(HRPC_STATUS_UNAVAILABLE, "connection closed");
+            }
+        };
+        onMessage = [this](const SocketChannelPtr&, Buffer* buf) {
+            handleMessage(buf);
+        };
+    }
+
+    ~RpcConnection() {
+        // callbacks capture this
+        if (channel) {
+            channel->onconnect = NULL;
+            channel->onread = NULL;
+            channel->onwrite = NULL;
+            channel->onclose = NULL;
+        }
+    }
+
+    void send(const RpcCallPtr& call) {
+        // NOTE: counted by RpcClient::call, never taken from calls
+        if (call->done) {
+            --pending;
+            return;
+        }
+        if (++next_id == 0) ++next_id;
+        call->id = next_id;
+        calls[call->id] = call;
+        if (call->timeout > 0) {
+            call->timer = htimer_add(loop()->loop(), on_timeout, call->timeout, 1);
+            hevent_set_userdata(call->timer, call.get());
+        }
+        hrpc_head head;
+        hrpc_head_init(&head);
+        head.type = HRPC_TYPE_REQUEST;
+        head.codec = call->codec;
+        head.id = call->id;
+        head.timeout = call->timeout > 0 ? call->timeout : 0;
+        head.method_length = call->method.size();
+        head.length = call->method.size() + call->payload.size();
+        appendHead(head);
+        outbuf += call->method;
+        outbuf += call->payload;
+        // payload is not needed any more
+        std::string().swap(call->payload);
+        scheduleFlush();
+    }
+
+    void sendCancel(uint32_t id) {
+        hrpc_head head;
+        hrpc_head_init(&head);
+        head.type = HRPC_TYPE_CANCEL;
+        head.id = id;
+        appendHead(head);
+        scheduleFlush();
+    }
+
+    void appendHead(const hrpc_head& head) {
+        size_t offset = outbuf.size();
+        outbuf.resize(offset + HRPC_HEAD_LENGTH);
+        hrpc_head_pack(&head, &outbuf[offset]);
+    }
+
+    // pipelining: one write for all calls issued in this loop iteration
+    void scheduleFlush() {
+        if (flush_queued || !isConnected()) return;
+        flush_queued = true;
+        RpcConnectionPtr self = shared_from_this();
+        loop()->queueInLoop([self]() {
+            self->flush_queued = false;
+            self->flush();
+        });
+    }
+
+    void flush() {
+        if (outbuf.empty() || !isConnected()) return;
+        channel->write(outbuf);
+        outbuf.clear();
+    }
+
+    RpcCallPtr takeCall(uint32_t id) {
+        auto iter = calls.find(id);
+        if (iter == calls.end()) return NULL;
+        RpcCallPtr call = iter->second;
+        calls.erase(iter);
+        --pending;
+        return call;
+    }
+
+    void cancelCall(const RpcCallPtr& call) {
+        if (call->done) return;
+        if (takeCall(call->id) == NULL) return;
+        sendCancel(call->id);
+        call->complete(HRPC_STATUS_CANCELED);
+    }
+
+    void failAll(int status, const char* errmsg) {
+        std::unordered_map<uint32_t, RpcCallPtr> failed;
+        failed.swap(calls);
+        outbuf.clear();
+        pending -= failed.size();
+        for (auto& pair : failed) {
+            pair.second->complete(status, errmsg);
+        }
+    }
+
+    void handleMessage(Buffer* buf) {
+        hrpc_message msg;
+        int packlen = hrpc_unpack(&msg, buf->data(), buf->size());
+        if (packlen < 0 || hrpc_head_check(&msg.head) != 0) {
+            hloge("hrpc unpack failed!");
+            channel->close();
+            return;
+        }
+        if (msg.head.type != HRPC_TYPE_RESPONSE) return;
+        // late response of timeout or canceled call
+        RpcCallPtr call = takeCall(msg.head.id);
+        if (call == NULL) return;
+        RpcResponse res;
+        res.status = msg.head.status;
+        res.codec = msg.head.codec;
+        res.payload.assign(msg.payload, msg.payload_length);
+        call->complete(&res);
+    }
+
+    static void on_timeout(htimer_t* timer) {
+        RpcCall* call = (RpcCall*)hevent_userdata(timer);
+        call->timer = NULL;
+        RpcConnectionPtr conn = call->conn;
+        RpcCallPtr self = conn->takeCall(call->id);
+        if (self == NULL) return;
+        conn->sendCancel(call->id);
+        self->complete(HRPC_STATUS_TIMEOUT);
+    }
+};
+
+void RpcCall::complete(RpcResponse* res) {
+    if (done.exchange(true)) return;
+    if (timer) {
+        htimer_del(timer);
+        timer = NULL;
+    }
+    RpcCallback callback;
+    callback.swap(cb);
+    if (callback) {
+        callback(res);
+    }
+}
+
+void RpcCall::complete(int status, const char* errmsg) {
+    RpcResponse res;
+    res.status = status;
+    res.payload = errmsg ? errmsg : hrpc_status_str(status);
+    complete(&res);
+}
+
+void RpcCall::cancel() {
+    if (done || conn == NULL) return;
+    RpcCallPtr self = shared_from_this();
+    conn->loop()->runInLoop([self]() {
+        self->conn->cancelCall(self);
+    });
+}
+
+RpcClient::RpcClient(EventLoopPtr loop) : loop_(loop), loop_threads_(1) {
+    pool_size_ = DEFAULT_RPC_POOL_SIZE;
+    load_balance_ = LB_RoundRobin;
+    connect_timeout_ = DEFAULT_RPC_CONNECT_TIMEOUT;
+    timeout_ = 0;
+    next_ = 0;
+}
+
+RpcClient::~RpcClient() {
+    stop();
+    conns_.clear();
+}
+
+int RpcClient::addServer(const char* host, int port) {
+    ServerAddr addr;
+    addr.host = host;
+    addr.port = port;
+    servers_.push_back(addr);
+    return 0;
+}
+
+int RpcClient::start() {
+    if (servers_.empty() || !conns_.empty()) return -1;
+    if (loop_ == NULL) {
+        loop_threads_.start(true);
+    }
+    for (const auto& server : servers_) {
+        for (int i = 0; i < pool_size_; ++i) {
+            EventLoopPtr loop = loop_ ? loop_ : loop_threads_.nextLoop();
+            RpcConnectionPtr conn = std::make_shared<RpcConnection>(loop);
+            conn->setConnectTimeout(connect_timeout_);
+            if (conn->createsocket(server.port, server.host.c_str()) < 0) {
+                hloge("hrpc createsocket %s:%d failed!", server.host.c_str(), server.port);
+                return -1;
+            }
+            conn->start();
+            conns_.push_back(conn);
+        }
+    }
+    return 0;
+}
+
+void RpcClient::stop() {
+    for (auto& conn : conns_) {
+        conn->closesocket();
+    }
+    if (loop_ == NULL) {
+        loop_threads_.stop(true);
+    }
+}
+
+RpcConnectionPtr RpcClient::selectConnection() {
+    size_t num = conns_.size();
+    if (num == 0) return NULL;
+    if (load_balance_ == LB_LeastConnections) {
+        size_t idx = next_++ % num;
+        for (size_t i = 0; i < num; ++i) {
+            const RpcConnectionPtr& conn = conns_[i];
+            if (!conn->isConnected()) continue;
+            if (!conns_[idx]->isConnected() || conn->pending < conns_[idx]->pending) {
+                idx = i;
+            }
+        }
+        return conns_[idx];
+    }
+    size_t start = load_balance_ == LB_Random ? hv_rand(0, num - 1) : next_++;
+    // prefer connected, otherwise queued until connected
+    for (size_t i = 0; i < num; ++i) {
+        const RpcConnectionPtr& conn = conns_[(start + i) % num];
+        if (conn->isConnected()) return conn;
+    }
+    return conns_[start % num];
+}
+
+int RpcClient::call(const RpcCallPtr& call) {
+    RpcConnectionPtr conn = selectConnection();
+    if (conn == NULL) {
+        call->complete(HRPC_STATUS_UNAVAILABLE);
+        return HRPC_STATUS_UNAVAILABLE;
+    }
+    if (call->timeout <= 0) call->timeout = timeout_;
+    call->conn = conn;
+    ++conn->pending;
+    conn->loop()->runInLoop([conn, call]() {
+        conn->send(call);
+    });
+    return 0;
+}
+
+RpcCallPtr RpcClient::call(const std::string& method, const std::string& payload,
+                           RpcCallback cb, int timeout_ms, int codec) {
+    RpcCallPtr rpc = std::make_shared<RpcCall>();
+    rpc->method = method;
+    rpc->payload = payload;
+    rpc->codec = codec;
+    rpc->timeout = timeout_ms;
+    rpc->cb = std::move(cb);
+    call(rpc);
+    return rpc;
+}
+
+std::future<RpcResponse> RpcClient::callFuture(const std::string& method, const std::string& payload,
+                                               int timeout_ms, int codec) {
+    auto promise = std::make_shared<std::promise<RpcResponse>>();
+    std::future<RpcResponse> future = promise->get_future();
+    call(method, payload, [promise](RpcResponse* res) {
+        promise->set_value(std::move(*res));
+    }, timeout_ms, codec);
+    return future;
+}
+
+int RpcClient::callSync(const std::string& method, const std::string& payload,
+                        RpcResponse* res, int timeout_ms, int codec) {
+    *res = callFuture(method, payload, timeout_ms, codec).get();
+    return res->status;
+}
+
+}
@@ -0,0 +1,172 @@
+#ifndef HV_RPC_CLIENT_H_
+#define HV_RPC_CLIENT_H_
+
+/*
+ * hrpc client: many concurrent calls multiplexed per connection
+ *
+ * hv::RpcClient cli;
+ * cli.addServer("127.0.0.1", 1234);
+ * cli.setPoolSize(2);
+ * cli.start();
+ *
+ * // async, called back in loop thread
+ * cli.call("echo", "hello", [](hv::RpcResponse* res) {
+ *     printf("%d %s\n", res->status, res->payload.c_str());
+ * }, 3000);
+ *
+ * // typed with RpcCodec
+ * hv::Json req, res;
+ * req["num1"] = 1; req["num2"] = 2;
+ * int status = cli.invoke("add", req, &res, 3000);
+ *
+ * Pending calls of a connection are only touched in its loop thread,
+ * replies complete callbacks, futures and deadline timers there without locks.
+ *
+ */
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "EventLoopThreadPool.h"
+#include "RpcCodec.h"
+
+#define DEFAULT_RPC_CONNECT_TIMEOUT 5000    // ms
+#define DEFAULT_RPC_POOL_SIZE       1       // connections per server
+
+namespace hv {
+
+struct RpcResponse {
+    int         status;
+    int         codec;
+    // error message if status != HRPC_STATUS_OK
+    std::string payload;
+
+    RpcResponse() : status(HRPC_STATUS_OK), codec(HRPC_CODEC_RAW) {}
+    bool ok() const { return status == HRPC_STATUS_OK; }
+};
+
+typedef std::function<void(RpcResponse* res)> RpcCallback;
+
+class RpcConnection;
+typedef std::shared_ptr<RpcConnection> RpcConnectionPtr;
+
+class HV_EXPORT RpcCall : public std::enable_shared_from_this<RpcCall> {
+public:
+    std::string     method;
+    std::string     payload;
+    int             codec;
+    int             timeout; // ms
+    RpcCallback     cb;
+
+    RpcCall() : codec(HRPC_CODEC_RAW), timeout(0), id(0), timer(NULL), done(false) {}
+
+    // thread-safe, callback with HRPC_STATUS_CANCELED if still pending
+    void cancel();
+    bool isDone() { return done; }
+
+private:
+    friend class RpcConnection;
+    friend class RpcClient;
+    void complete(RpcResponse* res);
+    void complete(int status, const char* errmsg = NULL);
+
+    RpcConnectionPtr    conn;
+    uint32_t            id;
+    htimer_t*           timer;
+    std::atomic<bool>   done;
+};
+typedef std::shared_ptr<RpcCall> RpcCallPtr;
+
+class HV_EXPORT RpcClient {
+public:
+    // loop == NULL: run connections in own loop threads
+    RpcClient(EventLoopPtr loop = NULL);
+    ~RpcClient();
+
+    // configure before start
+    int  addServer(const char* host, int port);
+    void setThreadNum(int num)          { loop_threads_.setThreadNum(num); }
+    void setPoolSize(int num)           { pool_size_ = num; }
+    // LB_RoundRobin, LB_Random, LB_LeastConnections(least pending calls)
+    void setLoadBalance(load_balance_e lb) { load_balance_ = lb; }
+    void setConnectTimeout(int ms)      { connect_timeout_ = ms; }
+    // default deadline of calls, 0 means no deadline
+    void setTimeout(int ms)             { timeout_ = ms; }
+    int  start();
+    void stop();
+
+    // @param timeout_ms: <= 0 means default timeout
+    // NOTE: cb may be called in current thread if no server available.
+    RpcCallPtr call(const std::string& method, const std::string& payload,
+                    RpcCallback cb, int timeout_ms = 0, int codec = HRPC_CODEC_RAW);
+    int call(const RpcCallPtr& call);
+    std::future<RpcResponse> callFuture(const std::string& method, const std::string& payload,
+                                        int timeout_ms = 0, int codec = HRPC_CODEC_RAW);
+    // NOTE: do not block loop threads of RpcClient
+    // @retval hrpc_status_e
+    int callSync(const std::string& method, const std::string& payload,
+                 RpcResponse* res, int timeout_ms = 0, int codec = HRPC_CODEC_RAW);
+
+    // typed sync call, see RpcCodec.h
+    // @retval hrpc_status_e
+    template<typename Req, typename Res>
+    int invoke(const std::string& method, const Req& req, Res* res, int timeout_ms = 0) {
+        std::string payload;
+        if (!RpcCodec<Req>::encode(req, &payload)) return HRPC_STATUS_CODEC_ERROR;
+        RpcResponse resp;
+        int status = callSync(method, payload, &resp, timeout_ms, RpcCodec<Req>::type);
+        if (status != HRPC_STATUS_OK) return status;
+        if (!RpcCodec<Res>::decode(resp.payload.data(), resp.payload.size(), res)) {
+            return HRPC_STATUS_CODEC_ERROR;
+        }
+        return HRPC_STATUS_OK;
+    }
+
+    // typed async call, res is NULL if status != HRPC_STATUS_OK
+    template<typename Res, typename Req>
+    RpcCallPtr invokeAsync(const std::string& method, const Req& req,
+                           std::function<void(int status, Res* res)> cb, int timeout_ms = 0) {
+        std::string payload;
+        if (!RpcCodec<Req>::encode(req, &payload)) {
+            if (cb) cb(HRPC_STATUS_CODEC_ERROR, NULL);
+            return NULL;
+        }
+        return call(method, payload, [cb](RpcResponse* resp) {
+            if (!cb) return;
+            if (!resp->ok()) {
+                cb(resp->status, NULL);
+                return;
+            }
+            Res res;
+            if (!RpcCodec<Res>::decode(resp->payload.data(), resp->payload.size(), &res)) {
+                cb(HRPC_STATUS_CODEC_ERROR, NULL);
+                return;
+            }
+            cb(HRPC_STATUS_OK, &res);
+        }, timeout_ms, RpcCodec<Req>::type);
+    }
+
+private:
+    RpcConnectionPtr selectConnection();
+
+    struct ServerAddr {
+        std::string host;
+        int         port;
+    };
+    std::vector<ServerAddr>         servers_;
+    EventLoopPtr                    loop_;
+    EventLoopThreadPool             loop_threads_;
+    int                             pool_size_;
+    load_balance_e                  load_balance_;
+    int                             connect_timeout_;
+    int                             timeout_;
+    // immutable after start, so selectConnection is lock-free
+    std::vector<RpcConnectionPtr>   conns_;
+    std::atomic<size_t>             next_;
+};
+
+}
+
+#endif // HV_RPC_CLIENT_H_
@@ -0,0 +1,58 @@
+#ifndef HV_RPC_CODEC_H_
+#define HV_RPC_CODEC_H_
+
+/*
+ * RpcCodec<T>: payload <=> T, selected by type of request and response
+ *
+ * std::string      HRPC_CODEC_RAW
+ * hv::Json         HRPC_CODEC_JSON
+ * protobuf message HRPC_CODEC_PROTOBUF, include RpcProtobuf.h
+ *
+ * Specialize RpcCodec for your own types:
+ * template<> struct RpcCodec<MyType> {
+ *     static const int type = HRPC_CODEC_RAW;
+ *     static bool encode(const MyType& obj, std::string* payload);
+ *     static bool decode(const char* data, size_t size, MyType* obj);
+ * };
+ *
+ */
+
+#include <string>
+
+#include "hrpc.h"
+#include "json.hpp"
+
+namespace hv {
+
+template<typename T, typename Enable = void>
+struct RpcCodec;
+
+template<>
+struct RpcCodec<std::string> {
+    static const int type = HRPC_CODEC_RAW;
+    static bool encode(const std::string& obj, std::string* payload) {
+        *payload = obj;
+        return true;
+    }
+    static bool decode(const char* data, size_t size, std::string* obj) {
+        obj->assign(data, size);
+        return true;
+    }
+};
+
+template<>
+struct RpcCodec<nlohmann::json> {
+    static const int type = HRPC_CODEC_JSON;
+    static bool encode(const nlohmann::json& obj, std::string* payload) {
+        *payload = obj.dump();
+        return true;
+    }
+    static bool decode(const char* data, size_t size, nlohmann::json* obj) {
+        *obj = nlohmann::json::parse(data, data + size, nullptr, false);
+        return !obj->is_discarded();
+    }
+};
+
+}
+
+#endif // HV_RPC_CODEC_H_
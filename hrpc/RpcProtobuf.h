@@ -0,0 +1,32 @@
+#ifndef HV_RPC_PROTOBUF_H_
+#define HV_RPC_PROTOBUF_H_
+
+/*
+ * RpcCodec for protobuf messages
+ *
+ * NOTE: header only, link your program with libprotobuf.
+ *
+ */
+
+#include <type_traits>
+
+#include <google/protobuf/message_lite.h>
+
+#include "RpcCodec.h"
+
+namespace hv {
+
+template<typename T>
+struct RpcCodec<T, typename std::enable_if<std::is_base_of<google::protobuf::MessageLite, T>::value>::type> {
+    static const int type = HRPC_CODEC_PROTOBUF;
+    static bool encode(const T& obj, std::string* payload) {
+        return obj.SerializeToString(payload);
+    }
+    static bool decode(const char* data, size_t size, T* obj) {
+        return obj->ParseFromArray(data, (int)size);
+    }
+};
+
+}
+
+#endif // HV_RPC_PROTOBUF_H_
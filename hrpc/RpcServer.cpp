@@ -0,0 +1,183 @@
+#include "RpcServer.h"
+
+#include "hlog.h"
+#include "htime.h"
+
+namespace hv {
+
+// one per connection
+struct RpcSession {
+    EventLoop*          loop;
+    // replies in io loop are written at once
+    std::string         outbuf;
+    bool                flush_queued;
+    // for cancel
+    std::mutex          mutex;
+    std::unordered_map<uint32_t, std::weak_ptr<RpcContext>> inflight;
+
+    RpcSession() : loop(currentThreadEventLoop), flush_queued(false) {}
+
+    void write(const SocketChannelPtr& channel, const std::string& reply) {
+        if (loop != currentThreadEventLoop) {
+            channel->write(reply);
+            return;
+        }
+        outbuf += reply;
+        if (flush_queued) return;
+        flush_queued = true;
+        SocketChannelPtr conn = channel;
+        loop->queueInLoop([this, conn]() {
+            flush_queued = false;
+            if (!outbuf.empty()) {
+                conn->write(outbuf);
+                outbuf.clear();
+            }
+        });
+    }
+
+    void remove(uint32_t id) {
+        std::lock_guard<std::mutex> locker(mutex);
+        inflight.erase(id);
+    }
+};
+typedef std::shared_ptr<RpcSession> RpcSessionPtr;
+
+bool RpcContext::isExpired() {
+    return deadline && gettick_ms() >= deadline;
+}
+
+void RpcContext::reply(const std::string& payload, int status) {
+    if (replied.exchange(true)) return;
+    session->remove(id);
+    if (canceled) return;
+    hrpc_head head;
+    hrpc_head_init(&head);
+    head.type = HRPC_TYPE_RESPONSE;
+    head.codec = codec;
+    head.status = status;
+    head.id = id;
+    head.length = payload.size();
+    std::string buf;
+    buf.reserve(HRPC_HEAD_LENGTH + payload.size());
+    buf.resize(HRPC_HEAD_LENGTH);
+    hrpc_head_pack(&head, &buf[0]);
+    buf += payload;
+    session->write(channel, buf);
+}
+
+RpcServer::RpcServer() {
+    worker_thread_num_ = 0;
+
+    unpack_setting_t unpack_setting;
+    unpack_setting.mode = UNPACK_BY_LENGTH_FIELD;
+    unpack_setting.package_max_length = DEFAULT_PACKAGE_MAX_LENGTH;
+    unpack_setting.body_offset = HRPC_HEAD_LENGTH;
+    unpack_setting.length_field_offset = HRPC_HEAD_LENGTH_FIELD_OFFSET;
+    unpack_setting.length_field_bytes = HRPC_HEAD_LENGTH_FIELD_BYTES;
+    unpack_setting.length_field_coding = ENCODE_BY_BIG_ENDIAN;
+    server_.setUnpack(&unpack_setting);
+
+    server_.onConnection = [](const SocketChannelPtr& channel) {
+        if (channel->isConnected()) {
+            tcp_nodelay(channel->fd(), 1);
+            channel->newContextPtr<RpcSession>();
+        }
+    };
+    server_.onMessage = [this](const SocketChannelPtr& channel, Buffer* buf) {
+        onMessage(channel, buf);
+    };
+}
+
+RpcServer::~RpcServer() {
+    stop();
+}
+
+int RpcServer::listen(int port, const char* host) {
+    return server_.createsocket(port, host);
+}
+
+int RpcServer::start() {
+    if (worker_thread_num_ > 0) {
+        workers_ = std::make_shared<HThreadPool>(worker_thread_num_, worker_thread_num_);
+        workers_->start();
+    }
+    server_.start();
+    return 0;
+}
+
+void RpcServer::stop() {
+    server_.stop(true);
+    if (workers_) {
+        workers_->stop();
+        workers_ = NULL;
+    }
+}
+
+void RpcServer::onMessage(const SocketChannelPtr& channel, Buffer* buf) {
+    hrpc_message msg;
+    int packlen = hrpc_unpack(&msg, buf->data(), buf->size());
+    if (packlen < 0 || hrpc_head_check(&msg.head) != 0) {
+        hloge("hrpc unpack failed!");
+        channel->close();
+        return;
+    }
+    RpcSessionPtr session = channel->getContextPtr<RpcSession>();
+    if (session == NULL) return;
+    if (msg.head.type == HRPC_TYPE_CANCEL) {
+        RpcContextPtr ctx;
+        {
+            std::lock_guard<std::mutex> locker(session->mutex);
+            auto iter = session->inflight.find(msg.head.id);
+            if (iter != session->inflight.end()) {
+                ctx = iter->second.lock();
+                session->inflight.erase(iter);
+            }
+        }
+        if (ctx) {
+            ctx->canceled = true;
+            ++stats.canceled;
+        }
+        return;
+    }
+    if (msg.head.type != HRPC_TYPE_REQUEST) return;
+    ++stats.requests;
+    RpcContextPtr ctx = std::make_shared<RpcContext>();
+    ctx->method.assign(msg.method, msg.head.method_length);
+    ctx->codec = msg.head.codec;
+    ctx->payload.assign(msg.payload, msg.payload_length);
+    ctx->id = msg.head.id;
+    if (msg.head.timeout) {
+        ctx->deadline = gettick_ms() + msg.head.timeout;
+    }
+    ctx->channel = channel;
+    ctx->session = session;
+    auto iter = methods_.find(ctx->method);
+    if (iter == methods_.end()) {
+        ctx->error(HRPC_STATUS_NOT_FOUND);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> locker(session->mutex);
+        session->inflight[ctx->id] = ctx;
+    }
+    dispatch(ctx, iter->second);
+}
+
+void RpcServer::dispatch(const RpcContextPtr& ctx, const RpcHandler& handler) {
+    if (workers_ == NULL) {
+        handler(ctx);
+        return;
+    }
+    workers_->post([this, ctx, &handler]() {
+        // client has given up
+        if (ctx->isCanceled() || ctx->isExpired()) {
+            if (ctx->isExpired()) ++stats.expired;
+            ctx->replied = true;
+            ctx->session->remove(ctx->id);
+            return;
+        }
+        handler(ctx);
+    });
+}
+
+}
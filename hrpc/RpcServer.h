@@ -0,0 +1,128 @@
+#ifndef HV_RPC_SERVER_H_
+#define HV_RPC_SERVER_H_
+
+/*
+ * hrpc server
+ *
+ * hv::RpcServer server;
+ * server.registerMethod("echo", [](const hv::RpcContextPtr& ctx) {
+ *     ctx->reply(ctx->payload);
+ * });
+ * server.addMethod<hv::Json, hv::Json>("add", [](const hv::Json& req, hv::Json* res) {
+ *     (*res)["result"] = req["num1"].get<int>() + req["num2"].get<int>();
+ *     return HRPC_STATUS_OK;
+ * });
+ * server.setWorkerThreadNum(4);
+ * server.listen(1234);
+ * server.start();
+ *
+ * Handlers run in io loop by default, or in HThreadPool after setWorkerThreadNum.
+ * ctx may be kept and replied later in any thread.
+ * Calls canceled or expired before dispatched to handler are dropped.
+ *
+ */
+
+#include <atomic>
+#include <unordered_map>
+
+#include "TcpServer.h"
+#include "hthreadpool.h"
+#include "RpcCodec.h"
+
+namespace hv {
+
+struct RpcSession;
+
+class HV_EXPORT RpcContext : public std::enable_shared_from_this<RpcContext> {
+public:
+    std::string     method;
+    int             codec;
+    std::string     payload;
+    uint32_t        id;
+    // ms of gettick_ms, 0 means no deadline
+    uint64_t        deadline;
+
+    RpcContext() : codec(HRPC_CODEC_RAW), id(0), deadline(0), replied(false), canceled(false) {}
+
+    // thread-safe, only the first reply is sent
+    void reply(const std::string& payload, int status = HRPC_STATUS_OK);
+    void error(int status, const std::string& errmsg = "") {
+        reply(errmsg.empty() ? hrpc_status_str(status) : errmsg, status);
+    }
+    bool isCanceled() { return canceled; }
+    bool isExpired();
+
+private:
+    friend class RpcServer;
+    SocketChannelPtr            channel;
+    std::shared_ptr<RpcSession> session;
+    std::atomic<bool>           replied;
+    std::atomic<bool>           canceled;
+};
+typedef std::shared_ptr<RpcContext> RpcContextPtr;
+
+typedef std::function<void(const RpcContextPtr& ctx)> RpcHandler;
+
+class HV_EXPORT RpcServer {
+public:
+    struct Stats {
+        std::atomic<uint64_t> requests;
+        std::atomic<uint64_t> canceled;
+        std::atomic<uint64_t> expired;
+        Stats() : requests(0), canceled(0), expired(0) {}
+    } stats;
+
+    RpcServer();
+    ~RpcServer();
+
+    int  listen(int port, const char* host = "0.0.0.0");
+    // NOTE: totalThreadNum = 1 acceptor_thread + N io threads (N can be 0)
+    void setThreadNum(int num) { server_.setThreadNum(num); }
+    // 0: handlers run in io loop
+    void setWorkerThreadNum(int num) { worker_thread_num_ = num; }
+    int  start();
+    void stop();
+
+    // register before start
+    void registerMethod(const std::string& method, RpcHandler handler) {
+        methods_[method] = std::move(handler);
+    }
+
+    // typed handler, see RpcCodec.h
+    // @retval hrpc_status_e
+    template<typename Req, typename Res>
+    void addMethod(const std::string& method, std::function<int(const Req& req, Res* res)> handler) {
+        registerMethod(method, [handler](const RpcContextPtr& ctx) {
+            Req req;
+            if (!RpcCodec<Req>::decode(ctx->payload.data(), ctx->payload.size(), &req)) {
+                ctx->error(HRPC_STATUS_BAD_REQUEST);
+                return;
+            }
+            Res res;
+            int status = handler(req, &res);
+            if (status != HRPC_STATUS_OK) {
+                ctx->error(status);
+                return;
+            }
+            std::string payload;
+            if (!RpcCodec<Res>::encode(res, &payload)) {
+                ctx->error(HRPC_STATUS_CODEC_ERROR);
+                return;
+            }
+            ctx->reply(payload);
+        });
+    }
+
+private:
+    void onMessage(const SocketChannelPtr& channel, Buffer* buf);
+    void dispatch(const RpcContextPtr& ctx, const RpcHandler& handler);
+
+    TcpServer                                   server_;
+    std::unordered_map<std::string, RpcHandler> methods_;
+    int                                         worker_thread_num_;
+    std::shared_ptr<HThreadPool>                workers_;
+};
+
+}
+
+#endif // HV_RPC_SERVER_H_
@@ -0,0 +1,83 @@
+#include "hrpc.h"
+
+#include "hendian.h"
+
+void hrpc_head_pack(const hrpc_head* head, void* buf) {
+    unsigned char* p = (unsigned char*)buf;
+    PUSH_N(p, head->protocol, 4);
+    PUSH8(p, head->version);
+    PUSH8(p, head->type);
+    PUSH8(p, head->codec);
+    PUSH8(p, head->status);
+    PUSH32(p, head->id);
+    PUSH32(p, head->timeout);
+    PUSH16(p, head->method_length);
+    PUSH16(p, head->reserved);
+    PUSH32(p, head->length);
+}
+
+int hrpc_pack(const hrpc_message* msg, void* buf, int len) {
+    if (!msg || !buf || !len) return -1;
+    const hrpc_head* head = &(msg->head);
+    unsigned int packlen = hrpc_package_length(head);
+    // Check is buffer enough
+    if ((unsigned int)len < packlen) {
+        return -2;
+    }
+    if (head->method_length + msg->payload_length != head->length) {
+        return -3;
+    }
+    hrpc_head_pack(head, buf);
+    unsigned char* p = (unsigned char*)buf + HRPC_HEAD_LENGTH;
+    if (msg->method && head->method_length) {
+        PUSH_N(p, msg->method, head->method_length);
+    }
+    if (msg->payload && msg->payload_length) {
+        PUSH_N(p, msg->payload, msg->payload_length);
+    }
+    return packlen;
+}
+
+int hrpc_unpack(hrpc_message* msg, const void* buf, int len) {
+    if (!msg || !buf || !len) return -1;
+    if (len < HRPC_HEAD_LENGTH) return -2;
+    hrpc_head* head = &(msg->head);
+    const unsigned char* p = (const unsigned char*)buf;
+    POP_N(p, head->protocol, 4);
+    POP8(p, head->version);
+    POP8(p, head->type);
+    POP8(p, head->codec);
+    POP8(p, head->status);
+    POP32(p, head->id);
+    POP32(p, head->timeout);
+    POP16(p, head->method_length);
+    POP16(p, head->reserved);
+    POP32(p, head->length);
+    // Check is buffer enough
+    unsigned int packlen = hrpc_package_length(head);
+    if ((unsigned int)len < packlen) {
+        return -3;
+    }
+    if (head->method_length > head->length) {
+        return -4;
+    }
+    // NOTE: just shadow copy
+    msg->method = (const char*)p;
+    msg->payload = (const char*)p + head->method_length;
+    msg->payload_length = head->length - head->method_length;
+    return packlen;
+}
+
+const char* hrpc_status_str(int status) {
+    switch (status) {
+    case HRPC_STATUS_OK:            return "OK";
+    case HRPC_STATUS_ERROR:         return "Error";
+    case HRPC_STATUS_NOT_FOUND:     return "Method Not Found";
+    case HRPC_STATUS_BAD_REQUEST:   return "Bad Request";
+    case HRPC_STATUS_TIMEOUT:       return "Timeout";
+    case HRPC_STATUS_CANCELED:      return "Canceled";
+    case HRPC_STATUS_UNAVAILABLE:   return "Unavailable";
+    case HRPC_STATUS_CODEC_ERROR:   return "Codec Error";
+    default:                        return "Unknown";
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef HV_HRPC_H_
+#define HV_HRPC_H_
+
+/*
+ * hrpc framing, multiplexed calls on one connection
+ *
+ * protocol:4bytes + version:1byte + type:1byte + codec:1byte + status:1byte +
+ * id:4bytes + timeout:4bytes + method_length:2bytes + reserved:2bytes + length:4bytes = 24bytes
+ *
+ * body = method + payload, length = method_length + payload_length
+ * multi-byte fields are big endian.
+ *
+ */
+
+#include <string.h>
+
+#include "hexport.h"
+
+#define HRPC_NAME       "HRPC"
+// version 1 is examples/protorpc
+#define HRPC_VERSION    2
+
+#define HRPC_HEAD_LENGTH                24
+#define HRPC_HEAD_LENGTH_FIELD_OFFSET   20
+#define HRPC_HEAD_LENGTH_FIELD_BYTES    4
+
+typedef enum {
+    HRPC_TYPE_REQUEST   = 0,
+    HRPC_TYPE_RESPONSE  = 1,
+    // client gives up the call, server may skip it
+    HRPC_TYPE_CANCEL    = 2,
+} hrpc_type_e;
+
+typedef enum {
+    HRPC_CODEC_RAW      = 0,
+    HRPC_CODEC_JSON     = 1,
+    HRPC_CODEC_PROTOBUF = 2,
+} hrpc_codec_e;
+
+typedef enum {
+    HRPC_STATUS_OK          = 0,
+    // payload is error message
+    HRPC_STATUS_ERROR       = 1,
+    HRPC_STATUS_NOT_FOUND   = 2,
+    HRPC_STATUS_BAD_REQUEST = 3,
+    // client side
+    HRPC_STATUS_TIMEOUT     = 4,
+    HRPC_STATUS_CANCELED    = 5,
+    HRPC_STATUS_UNAVAILABLE = 6,
+    HRPC_STATUS_CODEC_ERROR = 7,
+} hrpc_status_e;
+
+typedef struct {
+    unsigned char   protocol[4];
+    unsigned char   version;
+    unsigned char   type;
+    unsigned char   codec;
+    unsigned char   status;
+    unsigned int    id;
+    // ms, 0 means no deadline
+    unsigned int    timeout;
+    unsigned short  method_length;
+    unsigned short  reserved;
+    unsigned int    length;
+} hrpc_head;
+
+typedef struct {
+    hrpc_head       head;
+    const char*     method;
+    const char*     payload;
+    unsigned int    payload_length;
+} hrpc_message;
+
+BEGIN_EXTERN_C
+
+static inline unsigned int hrpc_package_length(const hrpc_head* head) {
+    return HRPC_HEAD_LENGTH + head->length;
+}
+
+static inline void hrpc_head_init(hrpc_head* head) {
+    memset(head, 0, sizeof(hrpc_head));
+    memcpy(head->protocol, HRPC_NAME, 4);
+    head->version = HRPC_VERSION;
+}
+
+static inline int hrpc_head_check(const hrpc_head* head) {
+    if (memcmp(head->protocol, HRPC_NAME, 4) != 0) {
+        return -1;
+    }
+    if (head->version != HRPC_VERSION) {
+        return -2;
+    }
+    if (head->method_length > head->length) {
+        return -3;
+    }
+    return 0;
+}
+
+// pack head only, body follows
+HV_EXPORT void hrpc_head_pack(const hrpc_head* head, void* buf);
+// @retval >0 package_length, <0 error
+HV_EXPORT int  hrpc_pack(const hrpc_message* msg, void* buf, int len);
+// NOTE: method and payload point into buf
+// @retval >0 package_length, <0 error
+HV_EXPORT int  hrpc_unpack(hrpc_message* msg, const void* buf, int len);
+
+HV_EXPORT const char* hrpc_status_str(int status);
+
+END_EXTERN_C
+
+#endif // HV_HRPC_H_
@@ -53,7 +53,7 @@ public:
     }
 
     virtual int FeedRecvData(const char* data, size_t len) {
-        return http_parser_execute(&parser, &cbs, data, len);
+        return http_parser_execute_fast(&parser, &cbs, data, len);
     }
 
     virtual int  GetState() {
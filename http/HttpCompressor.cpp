@@ -0,0 +1,307 @@
+#include "HttpCompressor.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hdef.h"
+#include "hbase.h"
+
+#ifdef WITH_ZLIB
+#include "zlib.h"
+#endif
+
+#ifdef WITH_BROTLI
+#include "brotli/encode.h"
+#endif
+
+#define HTTP_COMPRESS_CHUNK_SIZE    16384
+
+#define ZLIB_DEFAULT_WINDOW_BITS    15
+#define ZLIB_GZIP_WINDOW_BITS       (15 + 16)
+#define BROTLI_DEFAULT_LEVEL        5
+
+HttpCompressionOptions::HttpCompressionOptions() {
+    level = -1;
+    min_length = DEFAULT_COMPRESSION_MIN_LENGTH;
+    types.push_back("text/");
+    types.push_back("application/json");
+    types.push_back("application/javascript");
+    types.push_back("application/xml");
+    types.push_back("image/svg+xml");
+    precompressed = true;
+}
+
+bool HttpCompressionOptions::IsCompressibleType(const char* content_type) const {
+    if (content_type == NULL || *content_type == '\0') return false;
+    // NOTE: text/event-stream must not be buffered by compressor
+    if (strnicmp(content_type, "text/event-stream", 17) == 0) return false;
+    for (const auto& type : types) {
+        if (strnicmp(content_type, type.c_str(), type.size()) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+HttpCompressor::HttpCompressor()
+    : encoding_(HTTP_CONTENT_ENCODING_IDENTITY)
+    , stream_(NULL)
+{}
+
+HttpCompressor::~HttpCompressor() {
+    Close();
+}
+
+bool HttpCompressor::IsSupported(http_content_encoding encoding) {
+    switch (encoding) {
+#ifdef WITH_ZLIB
+    case HTTP_CONTENT_ENCODING_GZIP:
+    case HTTP_CONTENT_ENCODING_DEFLATE:
+        return true;
+#endif
+#ifdef WITH_BROTLI
+    case HTTP_CONTENT_ENCODING_BROTLI:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+const char* HttpCompressor::EncodingName(http_content_encoding encoding) {
+    switch (encoding) {
+    case HTTP_CONTENT_ENCODING_GZIP:    return "gzip";
+    case HTTP_CONTENT_ENCODING_DEFLATE: return "deflate";
+    case HTTP_CONTENT_ENCODING_BROTLI:  return "br";
+    default:                            return "identity";
+    }
+}
+
+const char* HttpCompressor::EncodingSuffix(http_content_encoding encoding) {
+    switch (encoding) {
+    case HTTP_CONTENT_ENCODING_GZIP:    return ".gz";
+    case HTTP_CONTENT_ENCODING_BROTLI:  return ".br";
+    default:                            return NULL;
+    }
+}
+
+http_content_encoding HttpCompressor::Negotiate(const char* accept_encoding) {
+    if (accept_encoding == NULL || *accept_encoding == '\0') {
+        return HTTP_CONTENT_ENCODING_IDENTITY;
+    }
+    // -1: not listed
+    double qvalues[HTTP_CONTENT_ENCODING_NUM] = { -1, -1, -1, -1 };
+    double qvalue_any = -1;
+    for (const auto& item : hv::split(accept_encoding, ',')) {
+        std::string coding = item;
+        double qvalue = 1.0;
+        std::string::size_type pos = item.find(';');
+        if (pos != std::string::npos) {
+            coding = item.substr(0, pos);
+            std::string param = hv::trim(item.substr(pos + 1));
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                qvalue = atof(param.c_str() + 2);
+            }
+        }
+        coding = hv::trim(coding);
+        if (coding == "*") {
+            qvalue_any = qvalue;
+        } else if (stricmp(coding.c_str(), "gzip") == 0 || stricmp(coding.c_str(), "x-gzip") == 0) {
+            qvalues[HTTP_CONTENT_ENCODING_GZIP] = qvalue;
+        } else if (stricmp(coding.c_str(), "deflate") == 0) {
+            qvalues[HTTP_CONTENT_ENCODING_DEFLATE] = qvalue;
+        } else if (stricmp(coding.c_str(), "br") == 0) {
+            qvalues[HTTP_CONTENT_ENCODING_BROTLI] = qvalue;
+        }
+    }
+    // NOTE: prefer br > gzip > deflate if qvalues are equal
+    static const http_content_encoding preferred[] = {
+        HTTP_CONTENT_ENCODING_BROTLI,
+        HTTP_CONTENT_ENCODING_GZIP,
+        HTTP_CONTENT_ENCODING_DEFLATE,
+    };
+    http_content_encoding encoding = HTTP_CONTENT_ENCODING_IDENTITY;
+    double max_qvalue = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(preferred); ++i) {
+        if (!IsSupported(preferred[i])) continue;
+        double qvalue = qvalues[preferred[i]];
+        if (qvalue < 0) qvalue = qvalue_any;
+        if (qvalue > max_qvalue) {
+            max_qvalue = qvalue;
+            encoding = preferred[i];
+        }
+    }
+    return encoding;
+}
+
+bool HttpCompressor::Compress(http_content_encoding encoding, const char* data, size_t len, std::string& out, int level) {
+    HttpCompressor compressor;
+    if (!compressor.Init(encoding, level)) return false;
+    out.reserve(out.size() + len / 4 + 64);
+    return compressor.Compress(data, len, out, true);
+}
+
+void HttpCompressor::AddVary(HttpMessage* msg) {
+    auto iter = msg->headers.find("Vary");
+    if (iter == msg->headers.end()) {
+        msg->headers["Vary"] = "Accept-Encoding";
+        return;
+    }
+    for (const auto& field : hv::split(iter->second, ',')) {
+        std::string name = hv::trim(field);
+        if (name == "*" || stricmp(name.c_str(), "Accept-Encoding") == 0) return;
+    }
+    iter->second += ", Accept-Encoding";
+}
+
+bool HttpCompressor::CompressResponse(HttpResponse* resp, http_content_encoding encoding, const HttpCompressionOptions& options) {
+    if (resp->status_code / 100 == 1 ||
+        resp->status_code == HTTP_STATUS_NO_CONTENT ||
+        resp->status_code == HTTP_STATUS_PARTIAL_CONTENT ||
+        resp->status_code == HTTP_STATUS_NOT_MODIFIED) {
+        return false;
+    }
+    if (resp->headers.find("Content-Encoding") != resp->headers.end() || resp->IsChunked()) {
+        return false;
+    }
+    // structured content -> body
+    resp->DumpBody();
+    resp->FillContentType();
+    const char* content = (const char*)resp->Content();
+    size_t content_length = resp->ContentLength();
+    auto iter = resp->headers.find("Content-Type");
+    if (content == NULL || iter == resp->headers.end() ||
+        !options.IsCompressible(iter->second.c_str(), content_length)) {
+        return false;
+    }
+    AddVary(resp);
+    if (!IsSupported(encoding)) return false;
+
+    std::string compressed;
+    if (!Compress(encoding, content, content_length, compressed, options.level) ||
+        compressed.size() >= content_length) {
+        return false;
+    }
+    resp->body.swap(compressed);
+    resp->content = NULL;
+    resp->content_length = 0;
+    resp->headers.erase("Content-Length");
+    resp->headers["Content-Encoding"] = EncodingName(encoding);
+    return true;
+}
+
+#ifdef WITH_ZLIB
+static bool zlib_compress(z_stream* strm, const char* data, size_t len, std::string& out, bool finish) {
+    strm->next_in = (Bytef*)data;
+    strm->avail_in = len;
+    int flush = finish ? Z_FINISH : Z_SYNC_FLUSH;
+    int ret = Z_OK;
+    do {
+        size_t offset = out.size();
+        out.resize(offset + HTTP_COMPRESS_CHUNK_SIZE);
+        strm->next_out = (Bytef*)&out[offset];
+        strm->avail_out = HTTP_COMPRESS_CHUNK_SIZE;
+        ret = deflate(strm, flush);
+        out.resize(offset + HTTP_COMPRESS_CHUNK_SIZE - strm->avail_out);
+        if (ret == Z_STREAM_ERROR) return false;
+    } while (strm->avail_out == 0 || (finish && ret != Z_STREAM_END));
+    return true;
+}
+#endif
+
+#ifdef WITH_BROTLI
+static bool brotli_compress(BrotliEncoderState* state, const char* data, size_t len, std::string& out, bool finish) {
+    BrotliEncoderOperation op = finish ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_FLUSH;
+    size_t available_in = len;
+    const uint8_t* next_in = (const uint8_t*)data;
+    do {
+        size_t offset = out.size();
+        out.resize(offset + HTTP_COMPRESS_CHUNK_SIZE);
+        size_t available_out = HTTP_COMPRESS_CHUNK_SIZE;
+        uint8_t* next_out = (uint8_t*)&out[offset];
+        if (!BrotliEncoderCompressStream(state, op, &available_in, &next_in, &available_out, &next_out, NULL)) {
+            out.resize(offset);
+            return false;
+        }
+        out.resize(offset + HTTP_COMPRESS_CHUNK_SIZE - available_out);
+    } while (available_in != 0 || BrotliEncoderHasMoreOutput(state) ||
+             (finish && !BrotliEncoderIsFinished(state)));
+    return true;
+}
+#endif
+
+bool HttpCompressor::Init(http_content_encoding encoding, int level) {
+    Close();
+    switch (encoding) {
+#ifdef WITH_ZLIB
+    case HTTP_CONTENT_ENCODING_GZIP:
+    case HTTP_CONTENT_ENCODING_DEFLATE:
+    {
+        if (level < 0 || level > 9) level = Z_DEFAULT_COMPRESSION;
+        z_stream* strm = (z_stream*)calloc(1, sizeof(z_stream));
+        if (strm == NULL) return false;
+        int window_bits = encoding == HTTP_CONTENT_ENCODING_GZIP ? ZLIB_GZIP_WINDOW_BITS : ZLIB_DEFAULT_WINDOW_BITS;
+        if (deflateInit2(strm, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            free(strm);
+            return false;
+        }
+        stream_ = strm;
+        break;
+    }
+#endif
+#ifdef WITH_BROTLI
+    case HTTP_CONTENT_ENCODING_BROTLI:
+    {
+        if (level < BROTLI_MIN_QUALITY || level > BROTLI_MAX_QUALITY) level = BROTLI_DEFAULT_LEVEL;
+        BrotliEncoderState* state = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+        if (state == NULL) return false;
+        BrotliEncoderSetParameter(state, BROTLI_PARAM_QUALITY, level);
+        stream_ = state;
+        break;
+    }
+#endif
+    default:
+        return false;
+    }
+    encoding_ = encoding;
+    return true;
+}
+
+bool HttpCompressor::Compress(const char* data, size_t len, std::string& out, bool finish) {
+    if (stream_ == NULL) return false;
+    switch (encoding_) {
+#ifdef WITH_ZLIB
+    case HTTP_CONTENT_ENCODING_GZIP:
+    case HTTP_CONTENT_ENCODING_DEFLATE:
+        return zlib_compress((z_stream*)stream_, data, len, out, finish);
+#endif
+#ifdef WITH_BROTLI
+    case HTTP_CONTENT_ENCODING_BROTLI:
+        return brotli_compress((BrotliEncoderState*)stream_, data, len, out, finish);
+#endif
+    default:
+        return false;
+    }
+}
+
+void HttpCompressor::Close() {
+    if (stream_ == NULL) return;
+    switch (encoding_) {
+#ifdef WITH_ZLIB
+    case HTTP_CONTENT_ENCODING_GZIP:
+    case HTTP_CONTENT_ENCODING_DEFLATE:
+        deflateEnd((z_stream*)stream_);
+        free(stream_);
+        break;
+#endif
+#ifdef WITH_BROTLI
+    case HTTP_CONTENT_ENCODING_BROTLI:
+        BrotliEncoderDestroyInstance((BrotliEncoderState*)stream_);
+        break;
+#endif
+    default:
+        break;
+    }
+    stream_ = NULL;
+    encoding_ = HTTP_CONTENT_ENCODING_IDENTITY;
+}
@@ -0,0 +1,81 @@
+#ifndef HV_HTTP_COMPRESSOR_H_
+#define HV_HTTP_COMPRESSOR_H_
+
+/*
+ * Content-Encoding: gzip, deflate, br
+ *
+ * @build ./configure --with-zlib --with-brotli && make clean && make
+ *
+ */
+
+#include "hexport.h"
+#include "hstring.h"
+#include "HttpMessage.h"
+
+#include <memory>
+
+enum http_content_encoding {
+    HTTP_CONTENT_ENCODING_IDENTITY = 0,
+    HTTP_CONTENT_ENCODING_GZIP,
+    HTTP_CONTENT_ENCODING_DEFLATE,
+    HTTP_CONTENT_ENCODING_BROTLI,
+    HTTP_CONTENT_ENCODING_NUM,
+};
+
+#define DEFAULT_COMPRESSION_MIN_LENGTH  1024 // 1K
+
+struct HV_EXPORT HttpCompressionOptions {
+    // compression level: -1 means default (zlib: 6, brotli: 5)
+    int     level;
+    // bodies smaller than min_length are sent uncompressed
+    int     min_length;
+    // compressible Content-Type prefixes, e.g. text/ application/json
+    hv::StringList  types;
+    // static file: serve precompressed sibling file.gz, file.br if newer than file
+    bool    precompressed;
+
+    HttpCompressionOptions();
+
+    bool IsCompressibleType(const char* content_type) const;
+    bool IsCompressible(const char* content_type, size_t content_length) const {
+        return content_length >= (size_t)min_length && IsCompressibleType(content_type);
+    }
+};
+
+class HV_EXPORT HttpCompressor {
+public:
+    HttpCompressor();
+    ~HttpCompressor();
+
+    static bool IsSupported(http_content_encoding encoding);
+    // gzip, deflate, br
+    static const char* EncodingName(http_content_encoding encoding);
+    // .gz, .br
+    static const char* EncodingSuffix(http_content_encoding encoding);
+    // Accept-Encoding: gzip, deflate, br;q=0.9 => supported encoding with the highest qvalue
+    static http_content_encoding Negotiate(const char* accept_encoding);
+
+    // one-shot
+    static bool Compress(http_content_encoding encoding, const char* data, size_t len, std::string& out, int level = -1);
+
+    // compress response body if eligible, then set Content-Encoding and Vary
+    // NOTE: Vary: Accept-Encoding is added even if encoding is identity
+    static bool CompressResponse(HttpResponse* resp, http_content_encoding encoding, const HttpCompressionOptions& options);
+    static void AddVary(HttpMessage* msg);
+
+    // streaming: Init -> Compress -> Compress -> ... -> Compress(finish = true)
+    bool Init(http_content_encoding encoding, int level = -1);
+    // NOTE: flush every call if !finish, so that compressed data can be sent immediately.
+    bool Compress(const char* data, size_t len, std::string& out, bool finish = false);
+    void Close();
+
+    http_content_encoding Encoding() { return encoding_; }
+
+private:
+    http_content_encoding   encoding_;
+    void*                   stream_; // z_stream* or BrotliEncoderState*
+};
+
+typedef std::shared_ptr<HttpCompressor> HttpCompressorPtr;
+
+#endif // HV_HTTP_COMPRESSOR_H_
@@ -208,13 +208,44 @@ public:
             return HTTP_STATUS_BAD_REQUEST;
         }
         const auto& formdata = iter->second;
-        if (formdata.content.empty()) {
+        if (formdata.content.empty() && formdata.filepath.empty()) {
             return HTTP_STATUS_BAD_REQUEST;
         }
         std::string filepath(path);
         if (HPath::isdir(path)) {
             filepath = HPath::join(filepath, formdata.filename);
         }
+        if (!formdata.filepath.empty()) {
+            // streaming upload: move temp file, copy and remove it if cross device
+            if (::rename(formdata.filepath.c_str(), filepath.c_str()) == 0) {
+                return 200;
+            }
+            HFile src, dst;
+            if (src.open(formdata.filepath.c_str(), "rb") != 0 ||
+                dst.open(filepath.c_str(), "wb") != 0) {
+                return HTTP_STATUS_INTERNAL_SERVER_ERROR;
+            }
+            char buf[40960];
+            size_t nread = 0;
+            bool ok = true;
+            while ((nread = src.read(buf, sizeof(buf))) > 0) {
+                if (dst.write(buf, nread) != nread) {
+                    ok = false;
+                    break;
+                }
+            }
+            // NOTE: fread returns 0 on both EOF and error, fclose flushes.
+            if (ferror(src.fp)) ok = false;
+            if (fclose(dst.fp) != 0) ok = false;
+            dst.fp = NULL;
+            if (!ok) {
+                ::remove(filepath.c_str());
+                return HTTP_STATUS_INTERNAL_SERVER_ERROR;
+            }
+            src.close();
+            ::remove(formdata.filepath.c_str());
+            return 200;
+        }
         HFile file;
         if (file.open(filepath.c_str(), "wb") != 0) {
             return HTTP_STATUS_INTERNAL_SERVER_ERROR;
@@ -8,6 +8,10 @@ int WebSocketChannel::send(const char* buf, int len, enum ws_opcode opcode /* =
         return send(buf, len, fragment, opcode);
     }
     std::lock_guard<std::mutex> locker(mutex_);
+    // NOTE: only compress a whole message
+    if (fin && needCompress(opcode, len)) {
+        return sendCompressed(buf, len, fragment, opcode);
+    }
     return sendFrame(buf, len, opcode, fin);
 }
 
@@ -23,12 +27,19 @@ int WebSocketChannel::send(const char* buf, int len, enum ws_opcode opcode /* =
  */
 int WebSocketChannel::send(const char* buf, int len, int fragment, enum ws_opcode opcode /* = WS_OPCODE_BINARY */) {
     std::lock_guard<std::mutex> locker(mutex_);
+    if (needCompress(opcode, len)) {
+        return sendCompressed(buf, len, fragment, opcode);
+    }
+    return sendFragments(buf, len, fragment, opcode);
+}
+
+int WebSocketChannel::sendFragments(const char* buf, int len, int fragment, enum ws_opcode opcode, bool rsv1) {
     if (len <= fragment) {
-        return sendFrame(buf, len, opcode, true);
+        return sendFrame(buf, len, opcode, true, rsv1);
     }
 
     // first fragment
-    int nsend = sendFrame(buf, fragment, opcode, false);
+    int nsend = sendFrame(buf, fragment, opcode, false, rsv1);
     if (nsend < 0) return nsend;
 
     const char* p = buf + fragment;
@@ -47,6 +58,22 @@ int WebSocketChannel::send(const char* buf, int len, int fragment, enum ws_opcod
     return len;
 }
 
+/*
+ * permessage-deflate
+ * Compress(buf) -> sendFragments(compressed, rsv1 = true)
+ * NOTE: RSV1 is only set on the first fragment.
+ *
+ */
+int WebSocketChannel::sendCompressed(const char* buf, int len, int fragment, enum ws_opcode opcode) {
+    std::string compressed;
+    if (!deflate->Compress(buf, len, compressed)) {
+        return sendFragments(buf, len, fragment, opcode);
+    }
+    int nsend = sendFragments(compressed.data(), compressed.size(), fragment, opcode, true);
+    if (nsend < 0) return nsend;
+    return len;
+}
+
 int WebSocketChannel::sendPing() {
     std::lock_guard<std::mutex> locker(mutex_);
     if (type == WS_CLIENT) {
@@ -63,7 +90,7 @@ int WebSocketChannel::sendPong() {
     return write(WS_SERVER_PONG_FRAME, WS_SERVER_MIN_FRAME_SIZE);
 }
 
-int WebSocketChannel::sendFrame(const char* buf, int len, enum ws_opcode opcode /* = WS_OPCODE_BINARY */, bool fin /* = true */) {
+int WebSocketChannel::sendFrame(const char* buf, int len, enum ws_opcode opcode /* = WS_OPCODE_BINARY */, bool fin /* = true */, bool rsv1 /* = false */) {
     bool has_mask = false;
     char mask[4] = {0};
     if (type == WS_CLIENT) {
@@ -75,6 +102,9 @@ int WebSocketChannel::sendFrame(const char* buf, int len, enum ws_opcode opcode
         sendbuf_.resize(ceil2e(frame_size));
     }
     ws_build_frame(sendbuf_.base, buf, len, mask, has_mask, opcode, fin);
+    if (rsv1) {
+        sendbuf_.base[0] |= WS_RSV1_BIT;
+    }
     return write(sendbuf_.base, frame_size);
 }
 
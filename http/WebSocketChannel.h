@@ -7,6 +7,7 @@
 
 #include "wsdef.h"
 #include "hmath.h"
+#include "WebSocketDeflate.h"
 
 namespace hv {
 
@@ -39,10 +40,18 @@ public:
     }
 
 protected:
-    int sendFrame(const char* buf, int len, enum ws_opcode opcode = WS_OPCODE_BINARY, bool fin = true);
+    int sendFrame(const char* buf, int len, enum ws_opcode opcode = WS_OPCODE_BINARY, bool fin = true, bool rsv1 = false);
+    int sendFragments(const char* buf, int len, int fragment, enum ws_opcode opcode, bool rsv1 = false);
+    // permessage-deflate
+    bool needCompress(enum ws_opcode opcode, int len) {
+        return deflate && (opcode == WS_OPCODE_TEXT || opcode == WS_OPCODE_BINARY) && deflate->NeedCompress(len);
+    }
+    int sendCompressed(const char* buf, int len, int fragment, enum ws_opcode opcode);
 
 public:
     enum ws_opcode  opcode;
+    // NOTE: set when permessage-deflate negotiated
+    WebSocketDeflatePtr deflate;
 private:
     Buffer      sendbuf_;
     std::mutex  mutex_;
@@ -0,0 +1,369 @@
+#include "WebSocketDeflate.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+
+#include "hdef.h"
+#include "hbase.h"
+#include "hstring.h"
+
+#ifdef WITH_ZLIB
+#include "zlib.h"
+#endif
+
+#define WS_DEFLATE_TAIL         "\x00\x00\xff\xff"
+#define WS_DEFLATE_TAIL_LEN     4
+#define WS_DEFLATE_CHUNK_SIZE   4096
+
+static int clamp_window_bits(int bits) {
+    if (bits < WS_MIN_WINDOW_BITS) return WS_MIN_WINDOW_BITS;
+    if (bits > WS_DEFAULT_WINDOW_BITS) return WS_DEFAULT_WINDOW_BITS;
+    return bits;
+}
+
+// permessage-deflate; client_max_window_bits, permessage-deflate
+// => [ { "permessage-deflate": "", "client_max_window_bits": "" }, { "permessage-deflate": "" } ]
+typedef std::vector<std::pair<std::string, std::string>> ws_extension_params;
+static std::vector<ws_extension_params> parse_extensions(const std::string& str) {
+    std::vector<ws_extension_params> extensions;
+    for (const auto& ext : hv::split(str, ',')) {
+        ws_extension_params params;
+        for (const auto& param : hv::split(ext, ';')) {
+            std::string key, value;
+            std::string::size_type pos = param.find('=');
+            if (pos == std::string::npos) {
+                key = hv::trim(param);
+            } else {
+                key = hv::trim(param.substr(0, pos));
+                value = hv::trim_pairs(hv::trim(param.substr(pos + 1)), "\"\"");
+            }
+            if (key.empty()) continue;
+            params.emplace_back(key, value);
+        }
+        if (params.size() > 0) {
+            extensions.push_back(std::move(params));
+        }
+    }
+    return extensions;
+}
+
+// @retval -1: invalid
+static int parse_window_bits(const std::string& value) {
+    if (value.empty()) return -1;
+    for (char c : value) {
+        if (!IS_DIGIT(c)) return -1;
+    }
+    int bits = atoi(value.c_str());
+    if (bits < 8 || bits > 15) return -1;
+    return bits;
+}
+
+std::string WebSocketDeflateOptions::ToOffer() const {
+    std::string offer = WS_PERMESSAGE_DEFLATE;
+    if (client_max_window_bits < WS_DEFAULT_WINDOW_BITS) {
+        offer += "; client_max_window_bits=";
+        offer += hv::to_string(clamp_window_bits(client_max_window_bits));
+    } else {
+        offer += "; client_max_window_bits";
+    }
+    if (server_max_window_bits < WS_DEFAULT_WINDOW_BITS) {
+        offer += "; server_max_window_bits=";
+        offer += hv::to_string(clamp_window_bits(server_max_window_bits));
+    }
+    if (server_no_context_takeover) {
+        offer += "; server_no_context_takeover";
+    }
+    if (client_no_context_takeover) {
+        offer += "; client_no_context_takeover";
+    }
+    return offer;
+}
+
+bool WebSocketDeflateOptions::AcceptOffer(const std::string& extensions, WebSocketDeflateOptions* negotiated) const {
+    for (const auto& params : parse_extensions(extensions)) {
+        if (params[0].first != WS_PERMESSAGE_DEFLATE) continue;
+        WebSocketDeflateOptions result = *this;
+        bool valid = true;
+        bool client_max_window_bits_offered = false;
+        for (size_t i = 1; i < params.size() && valid; ++i) {
+            const std::string& key = params[i].first;
+            const std::string& value = params[i].second;
+            if (key == "server_no_context_takeover") {
+                result.server_no_context_takeover = true;
+            } else if (key == "client_no_context_takeover") {
+                result.client_no_context_takeover = true;
+            } else if (key == "server_max_window_bits") {
+                // NOTE: zlib deflate does not support 8, and the response must not exceed the offer,
+                // so decline the offer instead of clamping it up to 9 (RFC 7692 7.1.2.1).
+                int bits = parse_window_bits(value);
+                if (bits < WS_MIN_WINDOW_BITS) valid = false;
+                else result.server_max_window_bits = MIN(result.server_max_window_bits, bits);
+            } else if (key == "client_max_window_bits") {
+                client_max_window_bits_offered = true;
+                if (value.empty()) continue;
+                int bits = parse_window_bits(value);
+                if (bits < WS_MIN_WINDOW_BITS) valid = false;
+                else result.client_max_window_bits = MIN(result.client_max_window_bits, bits);
+            } else {
+                valid = false;
+            }
+        }
+        if (!valid) continue;
+        // NOTE: client_max_window_bits must not be responded if the client does not offer it.
+        if (!client_max_window_bits_offered) {
+            result.client_max_window_bits = WS_DEFAULT_WINDOW_BITS;
+        }
+        result.server_max_window_bits = clamp_window_bits(result.server_max_window_bits);
+        result.client_max_window_bits = clamp_window_bits(result.client_max_window_bits);
+        if (negotiated) *negotiated = result;
+        return true;
+    }
+    return false;
+}
+
+std::string WebSocketDeflateOptions::ToResponse() const {
+    std::string response = WS_PERMESSAGE_DEFLATE;
+    if (server_no_context_takeover) {
+        response += "; server_no_context_takeover";
+    }
+    if (client_no_context_takeover) {
+        response += "; client_no_context_takeover";
+    }
+    if (server_max_window_bits < WS_DEFAULT_WINDOW_BITS) {
+        response += "; server_max_window_bits=";
+        response += hv::to_string(server_max_window_bits);
+    }
+    if (client_max_window_bits < WS_DEFAULT_WINDOW_BITS) {
+        response += "; client_max_window_bits=";
+        response += hv::to_string(client_max_window_bits);
+    }
+    return response;
+}
+
+bool WebSocketDeflateOptions::AcceptResponse(const std::string& extensions, WebSocketDeflateOptions* negotiated) const {
+    for (const auto& params : parse_extensions(extensions)) {
+        if (params[0].first != WS_PERMESSAGE_DEFLATE) continue;
+        WebSocketDeflateOptions result = *this;
+        result.server_no_context_takeover = false;
+        result.server_max_window_bits = WS_DEFAULT_WINDOW_BITS;
+        for (size_t i = 1; i < params.size(); ++i) {
+            const std::string& key = params[i].first;
+            const std::string& value = params[i].second;
+            if (key == "server_no_context_takeover") {
+                result.server_no_context_takeover = true;
+            } else if (key == "client_no_context_takeover") {
+                result.client_no_context_takeover = true;
+            } else if (key == "server_max_window_bits") {
+                int bits = parse_window_bits(value);
+                if (bits < 0) return false;
+                result.server_max_window_bits = bits;
+            } else if (key == "client_max_window_bits") {
+                // NOTE: fail the connection, zlib deflate can not use a window of 8
+                int bits = parse_window_bits(value);
+                if (bits < WS_MIN_WINDOW_BITS) return false;
+                result.client_max_window_bits = MIN(result.client_max_window_bits, bits);
+            } else {
+                return false;
+            }
+        }
+        result.server_max_window_bits = clamp_window_bits(result.server_max_window_bits);
+        result.client_max_window_bits = clamp_window_bits(result.client_max_window_bits);
+        if (negotiated) *negotiated = result;
+        return true;
+    }
+    return false;
+}
+
+#ifdef WITH_ZLIB
+static z_stream* deflate_stream_new(int level, int window_bits, int mem_level) {
+    z_stream* strm = (z_stream*)calloc(1, sizeof(z_stream));
+    // NOTE: negative windowBits means raw deflate without zlib header
+    if (deflateInit2(strm, level, Z_DEFLATED, -window_bits, mem_level, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(strm);
+        return NULL;
+    }
+    return strm;
+}
+
+static void deflate_stream_free(z_stream* strm) {
+    if (strm == NULL) return;
+    deflateEnd(strm);
+    free(strm);
+}
+
+static z_stream* inflate_stream_new(int window_bits) {
+    z_stream* strm = (z_stream*)calloc(1, sizeof(z_stream));
+    if (inflateInit2(strm, -window_bits) != Z_OK) {
+        free(strm);
+        return NULL;
+    }
+    return strm;
+}
+
+static void inflate_stream_free(z_stream* strm) {
+    if (strm == NULL) return;
+    inflateEnd(strm);
+    free(strm);
+}
+
+// NOTE: one zlib stream per (thread, params), shared by all no_context_takeover connections on the loop.
+class ZStreamPool {
+public:
+    ~ZStreamPool() {
+        for (auto& pair : deflaters) deflate_stream_free(pair.second);
+        for (auto& pair : inflaters) inflate_stream_free(pair.second);
+    }
+
+    z_stream* getDeflater(int level, int window_bits, int mem_level) {
+        int key = ((level + 1) << 8) | (mem_level << 4) | window_bits;
+        z_stream*& strm = deflaters[key];
+        if (strm == NULL) {
+            strm = deflate_stream_new(level, window_bits, mem_level);
+        }
+        return strm;
+    }
+
+    z_stream* getInflater(int window_bits) {
+        z_stream*& strm = inflaters[window_bits];
+        if (strm == NULL) {
+            strm = inflate_stream_new(window_bits);
+        }
+        return strm;
+    }
+
+private:
+    std::map<int, z_stream*> deflaters;
+    std::map<int, z_stream*> inflaters;
+};
+
+static thread_local ZStreamPool s_zstream_pool;
+#endif
+
+WebSocketDeflate::WebSocketDeflate(const WebSocketDeflateOptions& negotiated, ws_session_type type)
+    : options(negotiated)
+    , deflater_(NULL)
+    , inflater_(NULL)
+{
+    if (type == WS_SERVER) {
+        deflate_window_bits_ = options.server_max_window_bits;
+        deflate_no_context_takeover_ = options.server_no_context_takeover;
+        inflate_window_bits_ = options.client_max_window_bits;
+        inflate_no_context_takeover_ = options.client_no_context_takeover;
+    } else {
+        deflate_window_bits_ = options.client_max_window_bits;
+        deflate_no_context_takeover_ = options.client_no_context_takeover;
+        inflate_window_bits_ = options.server_max_window_bits;
+        inflate_no_context_takeover_ = options.server_no_context_takeover;
+    }
+    deflate_window_bits_ = clamp_window_bits(deflate_window_bits_);
+    inflate_window_bits_ = clamp_window_bits(inflate_window_bits_);
+}
+
+WebSocketDeflate::~WebSocketDeflate() {
+#ifdef WITH_ZLIB
+    deflate_stream_free((z_stream*)deflater_);
+    inflate_stream_free((z_stream*)inflater_);
+#endif
+}
+
+bool WebSocketDeflate::IsSupported() {
+#ifdef WITH_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool WebSocketDeflate::Compress(const char* data, size_t len, std::string& out) {
+#ifdef WITH_ZLIB
+    z_stream* strm = NULL;
+    if (deflate_no_context_takeover_) {
+        strm = s_zstream_pool.getDeflater(options.compression_level, deflate_window_bits_, options.mem_level);
+    } else {
+        if (deflater_ == NULL) {
+            deflater_ = deflate_stream_new(options.compression_level, deflate_window_bits_, options.mem_level);
+        }
+        strm = (z_stream*)deflater_;
+    }
+    if (strm == NULL) return false;
+
+    out.resize(deflateBound(strm, len) + WS_DEFLATE_TAIL_LEN);
+    strm->next_in = (Bytef*)data;
+    strm->avail_in = (uInt)len;
+    size_t total = 0;
+    int ret = Z_OK;
+    do {
+        if (total == out.size()) {
+            out.resize(out.size() + WS_DEFLATE_CHUNK_SIZE);
+        }
+        strm->next_out = (Bytef*)&out[total];
+        strm->avail_out = (uInt)(out.size() - total);
+        ret = deflate(strm, Z_SYNC_FLUSH);
+        total = out.size() - strm->avail_out;
+    } while (ret == Z_OK && (strm->avail_in != 0 || strm->avail_out == 0));
+    if (deflate_no_context_takeover_) {
+        deflateReset(strm);
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        return false;
+    }
+    // strip tail 00 00 ff ff
+    if (total >= WS_DEFLATE_TAIL_LEN &&
+        memcmp(&out[total - WS_DEFLATE_TAIL_LEN], WS_DEFLATE_TAIL, WS_DEFLATE_TAIL_LEN) == 0) {
+        total -= WS_DEFLATE_TAIL_LEN;
+    }
+    out.resize(total);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool WebSocketDeflate::Decompress(const char* data, size_t len, std::string& out, size_t max_len) {
+#ifdef WITH_ZLIB
+    z_stream* strm = NULL;
+    if (inflate_no_context_takeover_) {
+        strm = s_zstream_pool.getInflater(inflate_window_bits_);
+    } else {
+        if (inflater_ == NULL) {
+            inflater_ = inflate_stream_new(inflate_window_bits_);
+        }
+        strm = (z_stream*)inflater_;
+    }
+    if (strm == NULL) return false;
+
+    out.clear();
+    bool ok = true;
+    char buf[WS_DEFLATE_CHUNK_SIZE];
+    // append tail 00 00 ff ff
+    const char* inputs[2] = { data, WS_DEFLATE_TAIL };
+    size_t input_lens[2] = { len, WS_DEFLATE_TAIL_LEN };
+    for (int i = 0; i < 2 && ok; ++i) {
+        strm->next_in = (Bytef*)inputs[i];
+        strm->avail_in = (uInt)input_lens[i];
+        do {
+            strm->next_out = (Bytef*)buf;
+            strm->avail_out = sizeof(buf);
+            int ret = inflate(strm, Z_SYNC_FLUSH);
+            if (ret != Z_OK && ret != Z_BUF_ERROR && ret != Z_STREAM_END) {
+                ok = false;
+                break;
+            }
+            size_t nout = sizeof(buf) - strm->avail_out;
+            if (out.size() + nout > max_len) {
+                ok = false;
+                break;
+            }
+            out.append(buf, nout);
+            if (ret == Z_STREAM_END) break;
+        } while (strm->avail_out == 0);
+    }
+    if (inflate_no_context_takeover_ || !ok) {
+        inflateReset(strm);
+    }
+    return ok;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,89 @@
+#ifndef HV_WEBSOCKET_DEFLATE_H_
+#define HV_WEBSOCKET_DEFLATE_H_
+
+/*
+ * @rfc https://www.rfc-editor.org/rfc/rfc7692
+ *
+ * Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits
+ *
+ * @build ./configure --with-zlib && make clean && make
+ *
+ */
+
+#include "hexport.h"
+#include "wsdef.h"
+
+#include <string>
+#include <memory>
+
+#define WS_PERMESSAGE_DEFLATE       "permessage-deflate"
+#define WS_DEFAULT_WINDOW_BITS      15
+#define WS_MIN_WINDOW_BITS          9
+#define WS_DEFAULT_COMPRESS_THRESHOLD   128
+
+struct HV_EXPORT WebSocketDeflateOptions {
+    // zlib compression level: -1 ~ 9, -1 means Z_DEFAULT_COMPRESSION
+    int     compression_level;
+    // zlib memLevel: 1 ~ 9
+    int     mem_level;
+    // LZ77 sliding window 2^N: 9 ~ 15
+    int     server_max_window_bits;
+    int     client_max_window_bits;
+    // NOTE: no_context_takeover resets the compressor after each message,
+    // so one zlib stream per loop thread is shared by all connections,
+    // which keeps memory per connection bounded.
+    bool    server_no_context_takeover;
+    bool    client_no_context_takeover;
+    // messages smaller than compress_threshold are sent uncompressed
+    int     compress_threshold;
+
+    WebSocketDeflateOptions() {
+        compression_level = -1;
+        mem_level = 8;
+        server_max_window_bits = WS_DEFAULT_WINDOW_BITS;
+        client_max_window_bits = WS_DEFAULT_WINDOW_BITS;
+        server_no_context_takeover = true;
+        client_no_context_takeover = true;
+        compress_threshold = WS_DEFAULT_COMPRESS_THRESHOLD;
+    }
+
+    // client: options => offer
+    std::string ToOffer() const;
+    // server: offer => negotiated options, return false if not accepted
+    bool AcceptOffer(const std::string& extensions, WebSocketDeflateOptions* negotiated) const;
+    // server: negotiated options => response
+    std::string ToResponse() const;
+    // client: response => negotiated options, return false if not accepted
+    bool AcceptResponse(const std::string& extensions, WebSocketDeflateOptions* negotiated) const;
+};
+
+class HV_EXPORT WebSocketDeflate {
+public:
+    WebSocketDeflate(const WebSocketDeflateOptions& negotiated, ws_session_type type);
+    ~WebSocketDeflate();
+
+    static bool IsSupported();
+
+    bool NeedCompress(int len) {
+        return len >= options.compress_threshold;
+    }
+
+    // deflate message, strip tail 00 00 ff ff
+    bool Compress(const char* data, size_t len, std::string& out);
+    // append tail 00 00 ff ff, inflate message
+    bool Decompress(const char* data, size_t len, std::string& out, size_t max_len = (1 << 24));
+
+    WebSocketDeflateOptions options;
+
+private:
+    void*   deflater_;  // z_stream* for context takeover
+    void*   inflater_;  // z_stream* for context takeover
+    int     deflate_window_bits_;
+    int     inflate_window_bits_;
+    bool    deflate_no_context_takeover_;
+    bool    inflate_no_context_takeover_;
+};
+
+typedef std::shared_ptr<WebSocketDeflate> WebSocketDeflatePtr;
+
+#endif // HV_WEBSOCKET_DEFLATE_H_
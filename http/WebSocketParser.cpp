@@ -12,6 +12,14 @@ static int on_frame_header(websocket_parser* parser) {
     if (opcode != WS_OP_CONTINUE) {
         wp->opcode = opcode;
     }
+    // NOTE: RSV1 is only set on the first frame of a compressed data message
+    if (opcode == WS_OP_TEXT || opcode == WS_OP_BINARY) {
+        wp->compressed = (parser->flags & WS_RSV1) != 0;
+        if (wp->compressed && wp->deflate == NULL) {
+            // RSV1 without negotiated permessage-deflate
+            return -1;
+        }
+    }
     int length = parser->length;
     int reserve_length = MIN(length + 1, MAX_PAYLOAD_LENGTH);
     if (reserve_length > wp->message.capacity()) {
@@ -42,6 +50,15 @@ static int on_frame_end(websocket_parser* parser) {
     wp->state = WS_FRAME_END;
     if (wp->parser->flags & WS_FIN) {
         wp->state = WS_FRAME_FIN;
+        // NOTE: control frames are never compressed
+        if (wp->compressed && (parser->flags & WS_OP_MASK) < WS_OP_CLOSE) {
+            std::string decompressed;
+            if (!wp->deflate->Decompress(wp->message.data(), wp->message.size(), decompressed, MAX_PAYLOAD_LENGTH)) {
+                return -1;
+            }
+            wp->message.swap(decompressed);
+            wp->compressed = false;
+        }
         if (wp->onMessage) {
             wp->onMessage(wp->opcode, wp->message);
         }
@@ -61,6 +78,7 @@ WebSocketParser::WebSocketParser() {
     parser->data = this;
     state = WS_FRAME_BEGIN;
     opcode = WS_OP_CLOSE;
+    compressed = false;
 }
 
 WebSocketParser::~WebSocketParser() {
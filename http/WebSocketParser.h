@@ -2,6 +2,7 @@
 #define HV_WEBSOCKET_PARSER_H_
 
 #include "hexport.h"
+#include "WebSocketDeflate.h"
 
 #include <string>
 #include <memory>
@@ -23,6 +24,9 @@ public:
     int                                 opcode;
     std::string                         message;
     std::function<void(int opcode, const std::string& msg)> onMessage;
+    // permessage-deflate
+    WebSocketDeflatePtr                 deflate;
+    bool                                compressed;
 
     WebSocketParser();
     ~WebSocketParser();
@@ -6,6 +6,7 @@
 
 #include "EventLoopThread.h"
 #include "Channel.h"
+#include "Coroutine.h"
 
 #include "HttpMessage.h"
 #include "HttpParser.h"
@@ -159,6 +160,41 @@ private:
     std::map<std::string, ConnPool<int>>    conn_pools;
 };
 
+#ifdef HV_WITH_COROUTINE
+// co_await co_send(client, req) => resp, NULL if failed.
+// The coroutine is resumed in its own loop, not in the client's loop.
+class HttpSendAwaiter {
+public:
+    HttpSendAwaiter(AsyncHttpClient* client, const HttpRequestPtr& req)
+        : client_(client), req_(req) {}
+
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        EventLoop* loop = currentThreadEventLoop;
+        client_->send(req_, [this, h, loop](const HttpResponsePtr& resp) {
+            resp_ = resp;
+            if (loop && !loop->isInLoopThread()) {
+                loop->queueInLoop([h]() {
+                    h.resume();
+                });
+            } else {
+                h.resume();
+            }
+        });
+    }
+    HttpResponsePtr await_resume() { return std::move(resp_); }
+
+private:
+    AsyncHttpClient*    client_;
+    HttpRequestPtr      req_;
+    HttpResponsePtr     resp_;
+};
+
+inline HttpSendAwaiter co_send(AsyncHttpClient* client, const HttpRequestPtr& req) {
+    return HttpSendAwaiter(client, req);
+}
+#endif
+
 }
 
 #endif // HV_ASYNC_HTTP_CLIENT_H_
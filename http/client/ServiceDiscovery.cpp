@@ -0,0 +1,304 @@
+#include "ServiceDiscovery.h"
+
+#include <algorithm>
+
+#include "hdef.h"
+#include "herr.h"
+#include "hbase.h"
+#include "hlog.h"
+#include "hfile.h"
+#include "hstring.h"
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+namespace hv {
+
+std::string ServiceInstance::Key() const {
+    return address + ":" + hv::to_string(port);
+}
+
+std::string ServiceInstance::Url(const char* scheme) const {
+    std::string url = scheme;
+    url += "://";
+    // IPv6
+    if (address.find(':') != std::string::npos) {
+        url += "[" + address + "]";
+    } else {
+        url += address;
+    }
+    url += ":" + hv::to_string(port);
+    return url;
+}
+
+static void sort_instances(ServiceInstances& instances) {
+    std::sort(instances.begin(), instances.end(), [](const ServiceInstance& lhs, const ServiceInstance& rhs) {
+        return lhs.Key() < rhs.Key();
+    });
+}
+
+static int parse_tags(const json& jtags, std::vector<std::string>& tags) {
+    if (!jtags.is_array()) return 0;
+    for (const auto& jtag : jtags) {
+        if (jtag.is_string()) tags.push_back(jtag.get<std::string>());
+    }
+    return 0;
+}
+
+//------------------ConsulDiscoveryBackend--------------------------------
+/*
+ * /v1/health/service/<name>
+ * [
+ *   {
+ *     "Node": { "Node": "node1", "Address": "10.1.10.12" },
+ *     "Service": {
+ *       "ID": "web1", "Service": "web", "Tags": ["v1"],
+ *       "Address": "10.1.10.12", "Port": 8000,
+ *       "Weights": { "Passing": 10, "Warning": 1 }
+ *     },
+ *     "Checks": [...]
+ *   }
+ * ]
+ * /v1/catalog/service/<name> is accepted too:
+ * [ { "Address": "10.1.10.12", "ServiceID": "web1", "ServiceAddress": "", "ServicePort": 8000, ... } ]
+ */
+int ConsulDiscoveryBackend::ParseInstances(const std::string& body, ServiceInstances& instances) {
+    json jroot = json::parse(body, nullptr, false);
+    if (!jroot.is_array()) return ERR_INVALID_JSON;
+    for (const auto& jentry : jroot) {
+        if (!jentry.is_object()) continue;
+        ServiceInstance instance;
+        std::string node_address;
+        if (jentry.contains("Service") && jentry["Service"].is_object()) {
+            const json& jservice = jentry["Service"];
+            if (jentry.contains("Node") && jentry["Node"].is_object()) {
+                node_address = jentry["Node"].value("Address", "");
+            }
+            instance.id = jservice.value("ID", "");
+            instance.address = jservice.value("Address", "");
+            instance.port = jservice.value("Port", 0);
+            if (jservice.contains("Tags")) parse_tags(jservice["Tags"], instance.tags);
+            if (jservice.contains("Weights") && jservice["Weights"].is_object()) {
+                instance.weight = jservice["Weights"].value("Passing", 1);
+            }
+        } else {
+            node_address = jentry.value("Address", "");
+            instance.id = jentry.value("ServiceID", "");
+            instance.address = jentry.value("ServiceAddress", "");
+            instance.port = jentry.value("ServicePort", 0);
+            if (jentry.contains("ServiceTags")) parse_tags(jentry["ServiceTags"], instance.tags);
+            if (jentry.contains("ServiceWeights") && jentry["ServiceWeights"].is_object()) {
+                instance.weight = jentry["ServiceWeights"].value("Passing", 1);
+            }
+        }
+        // NOTE: empty service address means the node address
+        if (instance.address.empty()) instance.address = node_address;
+        if (instance.address.empty() || instance.port <= 0) continue;
+        if (instance.weight <= 0) instance.weight = 1;
+        instances.push_back(instance);
+    }
+    sort_instances(instances);
+    return 0;
+}
+
+void ConsulDiscoveryBackend::Query(const EventLoopPtr& loop, const std::string& service,
+                                   uint64_t index, int wait_ms, DiscoveryQueryCallback cb) {
+    if (client_ == NULL) {
+        client_ = std::make_shared<AsyncHttpClient>(loop);
+    }
+    auto req = std::make_shared<HttpRequest>();
+    req->method = HTTP_GET;
+    req->url = url_ + "/v1/health/service/" + service;
+    if (passing) {
+        req->query_params["passing"] = "1";
+    }
+    if (!tag.empty()) {
+        req->query_params["tag"] = tag;
+    }
+    if (index != 0) {
+        req->query_params["index"] = hv::to_string(index);
+        req->query_params["wait"] = hv::to_string(wait_ms) + "ms";
+        // NOTE: consul adds a random jitter up to wait / 16
+        req->timeout = (wait_ms + wait_ms / 16) / 1000 + 5;
+    }
+    if (!token.empty()) {
+        req->headers["X-Consul-Token"] = token;
+    }
+    client_->send(req, [cb](const HttpResponsePtr& resp) {
+        if (resp == NULL) {
+            cb(ERR_RESPONSE, NULL, 0);
+            return;
+        }
+        if (resp->status_code != HTTP_STATUS_OK) {
+            cb(resp->status_code, NULL, 0);
+            return;
+        }
+        auto instances = std::make_shared<ServiceInstances>();
+        int ret = ParseInstances(resp->body, *instances);
+        if (ret != 0) {
+            cb(ret, NULL, 0);
+            return;
+        }
+        uint64_t new_index = 0;
+        std::string strIndex = resp->GetHeader("X-Consul-Index");
+        if (!strIndex.empty()) {
+            new_index = strtoull(strIndex.c_str(), NULL, 10);
+        }
+        cb(0, instances, new_index);
+    });
+}
+
+//------------------FileDiscoveryBackend--------------------------------
+// @retval index, 0 if read failed
+static uint64_t read_file_instances(const std::string& filepath, const std::string& service,
+                                    ServiceInstances& instances) {
+    HFile file;
+    if (file.open(filepath.c_str(), "rb") != 0) return 0;
+    std::string content;
+    file.readall(content);
+    json jroot = json::parse(content, nullptr, false);
+    if (!jroot.is_object()) return 0;
+    if (jroot.contains(service) && jroot[service].is_array()) {
+        for (const auto& jinstance : jroot[service]) {
+            if (!jinstance.is_object()) continue;
+            ServiceInstance instance;
+            instance.id = jinstance.value("id", "");
+            instance.address = jinstance.value("address", "");
+            instance.port = jinstance.value("port", 0);
+            instance.weight = jinstance.value("weight", 1);
+            if (jinstance.contains("tags")) parse_tags(jinstance["tags"], instance.tags);
+            if (instance.address.empty() || instance.port <= 0) continue;
+            if (instance.weight <= 0) instance.weight = 1;
+            instances.push_back(instance);
+        }
+    }
+    sort_instances(instances);
+    // NOTE: content hash as index, never 0
+    return (uint64_t)hv_hash(content.data(), content.size()) + 1;
+}
+
+void FileDiscoveryBackend::Query(const EventLoopPtr& loop, const std::string& service,
+                                 uint64_t index, int wait_ms, DiscoveryQueryCallback cb) {
+    poll(loop, service, index, wait_ms, cb);
+}
+
+void FileDiscoveryBackend::poll(const EventLoopPtr& loop, const std::string& service,
+                                uint64_t index, int wait_ms, DiscoveryQueryCallback cb) {
+    auto instances = std::make_shared<ServiceInstances>();
+    uint64_t new_index = read_file_instances(filepath_, service, *instances);
+    if (new_index == 0) {
+        cb(ERR_READ_FILE, NULL, 0);
+        return;
+    }
+    if (index == 0 || new_index != index || wait_ms <= 0) {
+        cb(0, instances, new_index);
+        return;
+    }
+    int interval = MIN(poll_interval_, wait_ms);
+    loop->setTimeout(interval, [this, loop, service, index, wait_ms, interval, cb](TimerID) {
+        poll(loop, service, index, wait_ms - interval, cb);
+    });
+}
+
+//------------------ServiceDiscovery--------------------------------
+ServiceDiscovery::ServiceDiscovery(const DiscoveryBackendPtr& backend, EventLoopPtr loop)
+    : EventLoopThread(loop)
+    , backend_(backend)
+    , own_loop_(loop == NULL)
+    , snapshot_(std::make_shared<Snapshot>())
+{}
+
+ServiceDiscovery::~ServiceDiscovery() {
+    Stop();
+}
+
+int ServiceDiscovery::Start() {
+    if (own_loop_) {
+        EventLoopThread::start(true);
+    }
+    return 0;
+}
+
+void ServiceDiscovery::Stop() {
+    if (own_loop_) {
+        EventLoopThread::stop(true);
+    }
+}
+
+void ServiceDiscovery::Watch(const std::string& service, WatchCallback cb) {
+    // NOTE: run after Start if the loop is not running
+    loop()->runInLoop(std::bind(&ServiceDiscovery::watchInLoop, this, service, cb));
+}
+
+ServiceInstancesPtr ServiceDiscovery::Get(const std::string& service) {
+    SnapshotPtr snapshot = snapshot_.Load();
+    auto iter = snapshot->find(service);
+    return iter != snapshot->end() ? iter->second : NULL;
+}
+
+void ServiceDiscovery::watchInLoop(const std::string& service, WatchCallback cb) {
+    WatchEntryPtr& entry = entries_[service];
+    if (entry == NULL) {
+        entry = std::make_shared<WatchEntry>();
+        entry->service = service;
+    }
+    if (cb) {
+        entry->callbacks.push_back(cb);
+        if (entry->instances) {
+            cb(service, entry->instances);
+        }
+    }
+    if (!entry->querying) {
+        query(entry);
+    }
+}
+
+void ServiceDiscovery::query(const WatchEntryPtr& entry) {
+    entry->querying = true;
+    backend_->Query(loop(), entry->service, entry->index, wait_ms,
+        std::bind(&ServiceDiscovery::onQuery, this, entry,
+                  std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void ServiceDiscovery::onQuery(const WatchEntryPtr& entry, int error, const ServiceInstancesPtr& instances, uint64_t index) {
+    if (error != 0 || instances == NULL) {
+        // keep the last instances, retry with backoff
+        entry->index = 0;
+        entry->retry_delay = entry->retry_delay == 0 ? retry_interval : MIN(entry->retry_delay * 2, max_retry_delay);
+        hlogw("discovery %s: query failed %d, retry after %dms", entry->service.c_str(), error, entry->retry_delay);
+        loop()->setTimeout(entry->retry_delay, [this, entry](TimerID) {
+            query(entry);
+        });
+        return;
+    }
+    entry->retry_delay = 0;
+    bool changed = entry->instances == NULL || !(*entry->instances == *instances);
+    // NOTE: reset if the index goes backwards, see consul blocking queries
+    entry->index = index < entry->index ? 0 : index;
+    if (changed) {
+        entry->instances = instances;
+        publish(entry);
+    }
+    if (index == 0) {
+        // no blocking query, poll it
+        loop()->setTimeout(retry_interval, [this, entry](TimerID) {
+            query(entry);
+        });
+        return;
+    }
+    query(entry);
+}
+
+void ServiceDiscovery::publish(const WatchEntryPtr& entry) {
+    hlogi("discovery %s: %u instances", entry->service.c_str(), (unsigned)entry->instances->size());
+    // NOTE: callbacks first, so the upstreams are updated once Get returns the new instances.
+    for (const auto& cb : entry->callbacks) {
+        cb(entry->service, entry->instances);
+    }
+    // copy, update, swap
+    auto snapshot = std::make_shared<Snapshot>(*snapshot_.Latest());
+    (*snapshot)[entry->service] = entry->instances;
+    snapshot_.Store(snapshot);
+}
+
+}
@@ -13,6 +13,7 @@ WebSocketClient::WebSocketClient(EventLoopPtr loop)
     state = WS_CLOSED;
     ping_interval = DEFAULT_WS_PING_INTERVAL;
     ping_cnt = 0;
+    enable_compression = false;
 }
 
 WebSocketClient::~WebSocketClient() {
@@ -81,6 +82,9 @@ int WebSocketClient::open(const char* _url, const http_headers& headers) {
             if (http_req_->GetHeader(SEC_WEBSOCKET_VERSION).empty()) {
                 http_req_->headers[SEC_WEBSOCKET_VERSION] = "13";
             }
+            if (enable_compression) {
+                http_req_->headers[SEC_WEBSOCKET_EXTENSIONS] = compression.ToOffer();
+            }
             std::string http_msg = http_req_->Dump(true, true);
             // printf("%s", http_msg.c_str());
             // NOTE: not use WebSocketChannel::send
@@ -138,6 +142,19 @@ int WebSocketClient::open(const char* _url, const http_headers& headers) {
                     return;
                 }
                 ws_parser_ = std::make_shared<WebSocketParser>();
+                // Sec-WebSocket-Extensions: permessage-deflate
+                channel->deflate = NULL;
+                std::string ws_extensions = http_resp_->GetHeader(SEC_WEBSOCKET_EXTENSIONS);
+                if (!ws_extensions.empty()) {
+                    WebSocketDeflateOptions deflate_options;
+                    if (!enable_compression || !compression.AcceptResponse(ws_extensions, &deflate_options)) {
+                        hloge("unsupported %s: %s", SEC_WEBSOCKET_EXTENSIONS, ws_extensions.c_str());
+                        channel->close();
+                        return;
+                    }
+                    channel->deflate = std::make_shared<WebSocketDeflate>(deflate_options, WS_CLIENT);
+                    ws_parser_->deflate = channel->deflate;
+                }
                 // websocket_onmessage
                 ws_parser_->onMessage = [this, &channel](int opcode, const std::string& msg) {
                     channel->opcode = (enum ws_opcode)opcode;
@@ -39,6 +39,13 @@ public:
         ping_interval = ms;
     }
 
+    // permessage-deflate
+    // NOTE: call before open, require WITH_ZLIB
+    void setCompression(const WebSocketDeflateOptions& options = WebSocketDeflateOptions()) {
+        enable_compression = WebSocketDeflate::IsSupported();
+        compression = options;
+    }
+
     // NOTE: call before open
     void setHttpRequest(const HttpRequestPtr& req) {
         http_req_ = req;
@@ -64,6 +71,9 @@ private:
     // ping/pong
     int                 ping_interval;
     int                 ping_cnt;
+    // permessage-deflate
+    bool                    enable_compression;
+    WebSocketDeflateOptions compression;
 };
 
 }
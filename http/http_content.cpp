@@ -1,8 +1,14 @@
 #include "http_content.h"
 
+#include "hplatform.h"
 #include "hurl.h"
+#include "hpath.h"
+#include "hthread.h"
+#include "httpdef.h"
 
 #include <string.h>
+#include <atomic>
+#include <mutex>
 
 BEGIN_NAMESPACE_HV
 
@@ -109,6 +115,29 @@ std::string dump_multipart(MultiPart& mp, const char* boundary) {
 }
 
 #include "multipart_parser.h"
+// Content-Disposition: form-data; name="avatar"; filename="user.jpg"
+// @retval true if has filename
+static bool parse_content_disposition(const std::string& header_value, std::string& name, std::string& filename) {
+    bool has_filename = false;
+    StringList strlist = split(header_value, ';');
+    for (auto& str : strlist) {
+        StringList kv = split(trim(str, " "), '=');
+        if (kv.size() == 2) {
+            const char* key = kv.begin()->c_str();
+            std::string value = *(kv.begin() + 1);
+            value = trim_pairs(value, "\"\"\'\'");
+            if (strcmp(key, "name") == 0) {
+                name = value;
+            }
+            else if (strcmp(key, "filename") == 0) {
+                filename = value;
+                has_filename = true;
+            }
+        }
+    }
+    return has_filename;
+}
+
 enum multipart_parser_state_e {
     MP_START,
     MP_PART_DATA_BEGIN,
@@ -132,21 +161,7 @@ struct multipart_parser_userdata {
     void handle_header() {
         if (header_field.size() == 0 || header_value.size() == 0) return;
         if (stricmp(header_field.c_str(), "Content-Disposition") == 0) {
-            StringList strlist = split(header_value, ';');
-            for (auto& str : strlist) {
-                StringList kv = split(trim(str, " "), '=');
-                if (kv.size() == 2) {
-                    const char* key = kv.begin()->c_str();
-                    std::string value = *(kv.begin() + 1);
-                    value = trim_pairs(value, "\"\"\'\'");
-                    if (strcmp(key, "name") == 0) {
-                        name = value;
-                    }
-                    else if (strcmp(key, "filename") == 0) {
-                        filename = value;
-                    }
-                }
-            }
+            parse_content_disposition(header_value, name, filename);
         }
         header_field.clear();
         header_value.clear();
@@ -234,6 +249,207 @@ int parse_multipart(const std::string& str, MultiPart& mp, const char* boundary)
     return nparse == str.size() ? 0 : -1;
 }
 
+struct multipart_stream_callbacks {
+    static MultipartParser* get(multipart_parser* parser) {
+        return (MultipartParser*)multipart_parser_get_data(parser);
+    }
+    static int on_header_field(multipart_parser* parser, const char *at, size_t length) {
+        return get(parser)->onHeaderField(at, length);
+    }
+    static int on_header_value(multipart_parser* parser, const char *at, size_t length) {
+        return get(parser)->onHeaderValue(at, length);
+    }
+    static int on_headers_complete(multipart_parser* parser) {
+        return get(parser)->onHeadersComplete();
+    }
+    static int on_part_data(multipart_parser* parser, const char *at, size_t length) {
+        return get(parser)->onPartData(at, length);
+    }
+    static int on_part_data_end(multipart_parser* parser) {
+        return get(parser)->onPartDataEnd();
+    }
+    static int on_body_end(multipart_parser* parser) {
+        get(parser)->complete_ = true;
+        return 0;
+    }
+};
+
+MultipartParser::MultipartParser(MultiPart* mp, const char* boundary) {
+    max_memory_size = DEFAULT_MULTIPART_MAX_MEMORY_SIZE;
+    max_file_size = 0;
+    content_length = 0;
+#ifdef OS_WIN
+    upload_dir = ".";
+#else
+    upload_dir = "/tmp";
+#endif
+    mp_ = mp;
+    error_ = 0;
+    complete_ = false;
+    nfeed_ = 0;
+    memory_size_ = 0;
+    has_filename_ = false;
+    fp_ = NULL;
+    file_size_ = 0;
+    file_reserved_ = 0;
+
+    static multipart_parser_settings settings;
+    static std::once_flag settings_once;
+    std::call_once(settings_once, []() {
+        memset(&settings, 0, sizeof(settings));
+        settings.on_header_field     = multipart_stream_callbacks::on_header_field;
+        settings.on_header_value     = multipart_stream_callbacks::on_header_value;
+        settings.on_headers_complete = multipart_stream_callbacks::on_headers_complete;
+        settings.on_part_data        = multipart_stream_callbacks::on_part_data;
+        settings.on_part_data_end    = multipart_stream_callbacks::on_part_data_end;
+        settings.on_body_end         = multipart_stream_callbacks::on_body_end;
+    });
+    std::string __boundary("--");
+    __boundary += boundary;
+    multipart_parser* parser = multipart_parser_init(__boundary.c_str(), &settings);
+    multipart_parser_set_data(parser, this);
+    parser_ = parser;
+}
+
+MultipartParser::~MultipartParser() {
+    closeFile();
+    for (const auto& filepath : filepaths_) {
+        // NOTE: renamed files are kept
+        remove(filepath.c_str());
+    }
+    multipart_parser_free((multipart_parser*)parser_);
+}
+
+int MultipartParser::Feed(const char* data, size_t len) {
+    if (error_ != 0) return error_;
+    size_t nparse = multipart_parser_execute((multipart_parser*)parser_, data, len);
+    nfeed_ += len;
+    if (nparse != len && error_ == 0) {
+        error_ = HTTP_STATUS_BAD_REQUEST;
+    }
+    return error_;
+}
+
+int MultipartParser::onHeaderField(const char* at, size_t length) {
+    if (header_value_.size() != 0) handleHeader();
+    header_field_.append(at, length);
+    memory_size_ += length;
+    if (memory_size_ > max_memory_size) {
+        error_ = HTTP_STATUS_PAYLOAD_TOO_LARGE;
+        return -1;
+    }
+    return 0;
+}
+
+int MultipartParser::onHeaderValue(const char* at, size_t length) {
+    header_value_.append(at, length);
+    memory_size_ += length;
+    if (memory_size_ > max_memory_size) {
+        error_ = HTTP_STATUS_PAYLOAD_TOO_LARGE;
+        return -1;
+    }
+    return 0;
+}
+
+void MultipartParser::handleHeader() {
+    if (stricmp(header_field_.c_str(), "Content-Disposition") == 0) {
+        has_filename_ = parse_content_disposition(header_value_, name_, filename_);
+    }
+    header_field_.clear();
+    header_value_.clear();
+}
+
+int MultipartParser::onHeadersComplete() {
+    handleHeader();
+    if (has_filename_ && name_.size() != 0) {
+        return openFile();
+    }
+    return 0;
+}
+
+int MultipartParser::onPartData(const char* at, size_t length) {
+    if (name_.size() == 0) return 0;
+    if (fp_) {
+        file_size_ += length;
+        if (max_file_size != 0 && file_size_ > max_file_size) {
+            error_ = HTTP_STATUS_PAYLOAD_TOO_LARGE;
+            return -1;
+        }
+        if (fwrite(at, 1, length, fp_) != length) {
+            error_ = HTTP_STATUS_INTERNAL_SERVER_ERROR;
+            return -1;
+        }
+        return 0;
+    }
+    content_.append(at, length);
+    memory_size_ += length;
+    if (memory_size_ > max_memory_size) {
+        error_ = HTTP_STATUS_PAYLOAD_TOO_LARGE;
+        return -1;
+    }
+    return 0;
+}
+
+int MultipartParser::onPartDataEnd() {
+    if (name_.size() != 0) {
+        FormData& formdata = (*mp_)[name_];
+        formdata.filename = filename_;
+        formdata.content.swap(content_);
+        formdata.filepath.clear();
+        if (fp_) {
+            closeFile();
+            formdata.filepath = filepath_;
+        }
+    }
+    name_.clear();
+    filename_.clear();
+    has_filename_ = false;
+    content_.clear();
+    return error_ == 0 ? 0 : -1;
+}
+
+int MultipartParser::openFile() {
+    static std::atomic<unsigned int> s_seq(0);
+    char filename[64] = {0};
+    snprintf(filename, sizeof(filename), "libhv-upload-%ld-%u.tmp", (long)hv_getpid(), ++s_seq);
+    filepath_ = HPath::join(upload_dir, filename);
+    fp_ = fopen(filepath_.c_str(), "wb");
+    if (fp_ == NULL) {
+        error_ = HTTP_STATUS_INTERNAL_SERVER_ERROR;
+        return -1;
+    }
+    filepaths_.push_back(filepath_);
+    file_size_ = 0;
+    file_reserved_ = 0;
+#ifdef OS_LINUX
+    // NOTE: reserve remaining bytes of body to reduce fragmentation, truncate when part end
+    if (content_length > nfeed_) {
+        size_t remain = content_length - nfeed_;
+        if (max_file_size != 0 && remain > max_file_size) remain = max_file_size;
+        if (posix_fallocate(fileno(fp_), 0, remain) == 0) {
+            file_reserved_ = remain;
+        }
+    }
+#endif
+    return 0;
+}
+
+void MultipartParser::closeFile() {
+    if (fp_ == NULL) return;
+    if (fflush(fp_) != 0) {
+        error_ = HTTP_STATUS_INTERNAL_SERVER_ERROR;
+    }
+#ifdef OS_UNIX
+    if (file_reserved_ > file_size_) {
+        if (ftruncate(fileno(fp_), file_size_) != 0) {
+            error_ = HTTP_STATUS_INTERNAL_SERVER_ERROR;
+        }
+    }
+#endif
+    fclose(fp_);
+    fp_ = NULL;
+}
+
 std::string dump_json(const hv::Json& json, int indent) {
     if (json.empty()) return "";
     return json.dump(indent);
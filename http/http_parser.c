@@ -635,10 +635,346 @@ parse_url_char(enum state s, const char ch)
   return s_dead;
 }
 
-size_t http_parser_execute (http_parser *parser,
-                            const http_parser_settings *settings,
-                            const char *data,
-                            size_t len)
+/* Fast path of the start line and headers, see http_parser_execute_fast().
+ *
+ * When the whole header block of a message is in the buffer, it is validated
+ * in one pass and the callbacks are invoked just like the state machine would
+ * invoke them, then the state machine goes on from s_headers_almost_done.
+ * Runs of URL, token and header value characters are skipped 16 bytes at a
+ * time with SSE4.2 range compares, like picohttpparser does.
+ *
+ * Anything uncommon (fragmented header block, bare LF, obs-fold, absolute or
+ * authority URL, duplicate Content-Length, too many headers ...) is left to
+ * the state machine, which also reports the errors.
+ */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+# define HTTP_PARSER_SSE42 1
+# include <nmmintrin.h>
+# ifdef __SSE4_2__
+#  define SSE42_TARGET
+#  define HAS_SSE42() 1
+# else
+#  define SSE42_TARGET __attribute__((target("sse4.2")))
+#  define HAS_SSE42() __builtin_cpu_supports("sse4.2")
+# endif
+#else
+# define HAS_SSE42() 0
+#endif
+
+#define FAST_MAX_HEADERS 64
+
+struct fast_header {
+  const char *name;
+  const char *value;
+  size_t name_len;
+  size_t value_len;
+};
+
+#ifdef HTTP_PARSER_SSE42
+/* Returns the first char in ranges, or where less than 16 bytes are left. */
+SSE42_TARGET
+static const char *
+findchar_sse42(const char *p, const char *end, const char ranges[16], int ranges_size)
+{
+  __m128i ranges16 = _mm_loadu_si128((const __m128i *)ranges);
+  while (end - p >= 16) {
+    __m128i b16 = _mm_loadu_si128((const __m128i *)p);
+    int r = _mm_cmpestri(ranges16, ranges_size, b16, 16,
+        _SIDD_LEAST_SIGNIFICANT | _SIDD_CMP_RANGES | _SIDD_UBYTE_OPS);
+    if (r != 16) {
+      return p + r;
+    }
+    p += 16;
+  }
+  return p;
+}
+#endif
+
+/* %x21-7E, all of them are valid in origin-form URL */
+static const char *
+skip_url_chars(const char *p, const char *end, int sse42)
+{
+#ifdef HTTP_PARSER_SSE42
+  static const char ranges[16] = "\000\040\177\377";
+  if (sse42) p = findchar_sse42(p, end, ranges, 4);
+#endif
+  while (p != end && (unsigned char)(*p - 0x21) < 0x5e) ++p;
+  return p;
+}
+
+static const char *
+skip_token_chars(const char *p, const char *end, int sse42)
+{
+#ifdef HTTP_PARSER_SSE42
+  /* separators and CTLs, and '|' '~' which need the table */
+  static const char ranges[] = "\000\040\"\"(),,//:@[]{\377";
+  if (sse42) p = findchar_sse42(p, end, ranges, 16);
+#endif
+  while (p != end && STRICT_TOKEN(*p)) ++p;
+  return p;
+}
+
+static const char *
+skip_header_value_chars(const char *p, const char *end, int sse42)
+{
+#ifdef HTTP_PARSER_SSE42
+  /* CTLs but HT */
+  static const char ranges[16] = "\000\010\012\037\177\177";
+  if (sse42) p = findchar_sse42(p, end, ranges, 6);
+#endif
+  while (p != end && (*p == '\t' || ((unsigned char)*p > 31 && *p != 127))) ++p;
+  return p;
+}
+
+static int
+fast_header_is(const struct fast_header *h, const char *lower, size_t len)
+{
+  size_t i;
+  if (h->name_len != len) return 0;
+  for (i = 0; i < len; ++i) {
+    if (LOWER(h->name[i]) != lower[i]) return 0;
+  }
+  return 1;
+}
+
+/* value is lower followed by spaces only */
+static int
+fast_value_is(const char *p, const char *end, const char *lower, size_t len)
+{
+  size_t i;
+  if ((size_t)(end - p) < len) return 0;
+  for (i = 0; i < len; ++i) {
+    if (LOWER(p[i]) != lower[i]) return 0;
+  }
+  for (p += len; p != end; ++p) {
+    if (*p != ' ') return 0;
+  }
+  return 1;
+}
+
+/* Mirrors the header_state machine, returns -1 to leave it to the state machine. */
+static int
+fast_header_flags(const struct fast_header *h, unsigned int *flags, uint64_t *content_length)
+{
+  const char *p = h->value;
+  const char *end = h->value + h->value_len;
+
+  if (fast_header_is(h, CONNECTION, sizeof(CONNECTION)-1) ||
+      fast_header_is(h, PROXY_CONNECTION, sizeof(PROXY_CONNECTION)-1)) {
+    /* comma separated tokens */
+    for (;;) {
+      const char *token;
+      const char *comma = p;
+      while (comma != end && *comma != ',') {
+        if (!STRICT_TOKEN(*comma) && *comma != ' ' && *comma != '\t') return -1;
+        ++comma;
+      }
+      while (p != comma && (*p == ' ' || *p == '\t')) ++p;
+      if (p == comma) return -1;
+      token = p;
+      if (fast_value_is(token, comma, KEEP_ALIVE, sizeof(KEEP_ALIVE)-1)) {
+        *flags |= F_CONNECTION_KEEP_ALIVE;
+      } else if (fast_value_is(token, comma, CLOSE, sizeof(CLOSE)-1)) {
+        *flags |= F_CONNECTION_CLOSE;
+      } else if (fast_value_is(token, comma, UPGRADE, sizeof(UPGRADE)-1)) {
+        *flags |= F_CONNECTION_UPGRADE;
+      }
+      if (comma == end) break;
+      p = comma + 1;
+    }
+  } else if (fast_header_is(h, CONTENT_LENGTH, sizeof(CONTENT_LENGTH)-1)) {
+    uint64_t n = 0;
+    const char *start = p;
+    if (*flags & F_CONTENTLENGTH) return -1;
+    /* 18 digits can not overflow */
+    while (p != end && IS_NUM(*p) && p - start < 18) {
+      n = n * 10 + (*p - '0');
+      ++p;
+    }
+    if (p == start) return -1;
+    for (; p != end; ++p) {
+      if (*p != ' ') return -1;
+    }
+    *flags |= F_CONTENTLENGTH;
+    *content_length = n;
+  } else if (fast_header_is(h, TRANSFER_ENCODING, sizeof(TRANSFER_ENCODING)-1)) {
+    *flags &= ~F_CHUNKED;
+    if (fast_value_is(p, end, CHUNKED, sizeof(CHUNKED)-1)) {
+      *flags |= F_CHUNKED;
+    }
+  } else if (fast_header_is(h, UPGRADE, sizeof(UPGRADE)-1)) {
+    if (p != end) {
+      *flags |= F_UPGRADE;
+    }
+  }
+  return 0;
+}
+
+static int
+fast_method(const char *p, size_t len)
+{
+  unsigned int i;
+  for (i = 0; i < ARRAY_SIZE(method_strings); ++i) {
+    const char *method = method_strings[i];
+    if (method[0] == p[0] && strlen(method) == len && memcmp(method, p, len) == 0) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+/* Returns 0 to leave the message to the state machine, otherwise the
+ * callbacks up to the last header value have been invoked and *last points
+ * to the LF ending the header block, or http_errno is set if a callback failed.
+ *
+ * NOTE: p is the first char of the message, and p + max_size is the
+ * farthest LF allowed by max_header_size.
+ */
+static int
+parse_headers_fast(http_parser *parser,
+                   const http_parser_settings *settings,
+                   const char *p,
+                   const char *end,
+                   size_t max_size,
+                   const char **last)
+{
+  struct fast_header headers[FAST_MAX_HEADERS];
+  int nheaders = 0;
+  int i;
+  int sse42 = HAS_SSE42();
+  int method = 0;
+  unsigned short http_major, http_minor;
+  unsigned int status_code = 0;
+  unsigned int flags = 0;
+  uint64_t content_length = ULLONG_MAX;
+  const char *url = NULL;
+  const char *status = NULL;
+  size_t url_len = 0, status_len = 0;
+
+  if ((size_t)(end - p) > max_size + 1) {
+    end = p + max_size + 1;
+  }
+
+  /* start line */
+  if (parser->type == HTTP_REQUEST) {
+    const char *start = p;
+    while (p != end && ((*p >= 'A' && *p <= 'Z') || *p == '-')) ++p;
+    if (p == end || *p != ' ') return 0;
+    method = fast_method(start, p - start);
+    if (method < 0 || method == HTTP_CONNECT) return 0;
+    url = ++p;
+    if (p == end || (*p != '/' && *p != '*')) return 0;
+    p = skip_url_chars(p, end, sse42);
+    if (p == end || *p != ' ') return 0;
+    url_len = p - url;
+    ++p;
+    if (end - p < 10 || memcmp(p, "HTTP/", 5) != 0 ||
+        !IS_NUM(p[5]) || p[6] != '.' || !IS_NUM(p[7]) ||
+        p[8] != CR || p[9] != LF) {
+      return 0;
+    }
+    http_major = p[5] - '0';
+    http_minor = p[7] - '0';
+    p += 10;
+  } else {
+    if (end - p < 13 || memcmp(p, "HTTP/", 5) != 0 ||
+        !IS_NUM(p[5]) || p[6] != '.' || !IS_NUM(p[7]) || p[8] != ' ' ||
+        !IS_NUM(p[9]) || !IS_NUM(p[10]) || !IS_NUM(p[11])) {
+      return 0;
+    }
+    http_major = p[5] - '0';
+    http_minor = p[7] - '0';
+    status_code = (p[9] - '0') * 100 + (p[10] - '0') * 10 + (p[11] - '0');
+    p += 12;
+    if (*p == ' ') {
+      ++p;
+    } else if (*p != CR) {
+      return 0;
+    }
+    /* reason-phrase is not validated */
+    status = p;
+    for (;;) {
+      p = skip_header_value_chars(p, end, sse42);
+      if (p == end) return 0;
+      if (*p == CR || *p == LF) break;
+      ++p;
+    }
+    if (*p != CR || p + 1 == end || p[1] != LF) return 0;
+    status_len = p - status;
+    p += 2;
+  }
+
+  /* headers */
+  for (;;) {
+    struct fast_header *h;
+    if (p == end) return 0;
+    if (*p == CR) {
+      if (p + 1 == end || p[1] != LF) return 0;
+      *last = p + 1;
+      break;
+    }
+    if (nheaders == FAST_MAX_HEADERS) return 0;
+    h = &headers[nheaders++];
+    h->name = p;
+    p = skip_token_chars(p, end, sse42);
+    if (p == h->name || p == end || *p != ':') return 0;
+    h->name_len = p - h->name;
+    ++p;
+    while (p != end && (*p == ' ' || *p == '\t')) ++p;
+    h->value = p;
+    p = skip_header_value_chars(p, end, sse42);
+    if (p == end || *p != CR || p + 1 == end || p[1] != LF) return 0;
+    h->value_len = p - h->value;
+    p += 2;
+    /* obs-fold */
+    if (p != end && (*p == ' ' || *p == '\t')) return 0;
+    if (fast_header_flags(h, &flags, &content_length) != 0) return 0;
+  }
+
+  /* valid, commit and invoke the callbacks */
+  parser->flags = flags;
+  parser->content_length = content_length;
+  parser->http_major = http_major;
+  parser->http_minor = http_minor;
+  if (parser->type == HTTP_REQUEST) {
+    parser->method = method;
+  } else {
+    parser->status_code = status_code;
+  }
+
+#define FAST_CALLBACK_NOTIFY(FOR)                                    \
+  if (settings->on_##FOR && settings->on_##FOR(parser) != 0) {       \
+    parser->http_errno = HPE_CB_##FOR;                               \
+  }                                                                  \
+  if (HTTP_PARSER_ERRNO(parser) != HPE_OK) return 1;
+
+#define FAST_CALLBACK_DATA(FOR, AT, LEN)                             \
+  if (settings->on_##FOR && settings->on_##FOR(parser, AT, LEN) != 0) { \
+    parser->http_errno = HPE_CB_##FOR;                               \
+  }                                                                  \
+  if (HTTP_PARSER_ERRNO(parser) != HPE_OK) return 1;
+
+  FAST_CALLBACK_NOTIFY(message_begin);
+  if (parser->type == HTTP_REQUEST) {
+    FAST_CALLBACK_DATA(url, url, url_len);
+  } else {
+    FAST_CALLBACK_DATA(status, status, status_len);
+  }
+  for (i = 0; i < nheaders; ++i) {
+    FAST_CALLBACK_DATA(header_field, headers[i].name, headers[i].name_len);
+    FAST_CALLBACK_DATA(header_value, headers[i].value, headers[i].value_len);
+  }
+#undef FAST_CALLBACK_NOTIFY
+#undef FAST_CALLBACK_DATA
+  return 1;
+}
+
+static size_t
+execute (http_parser *parser,
+         const http_parser_settings *settings,
+         const char *data,
+         size_t len,
+         int fast)
 {
   char c, ch;
   int8_t unhex_val;
@@ -767,6 +1103,21 @@ reexecute:
         parser->flags = 0;
         parser->content_length = ULLONG_MAX;
 
+        if (fast) {
+          const char *last = NULL;
+          if (parse_headers_fast(parser, settings, p, data + len,
+                                 max_header_size - nread, &last)) {
+            if (UNLIKELY(HTTP_PARSER_ERRNO(parser) != HPE_OK)) {
+              RETURN(p - data);
+            }
+            COUNT_HEADER_SIZE(last - p);
+            p = last;
+            ch = *p;
+            UPDATE_STATE(s_headers_almost_done);
+            REEXECUTE();
+          }
+        }
+
         if (ch == 'H') {
           UPDATE_STATE(s_res_H);
         } else {
@@ -924,6 +1275,21 @@ reexecute:
         parser->flags = 0;
         parser->content_length = ULLONG_MAX;
 
+        if (fast) {
+          const char *last = NULL;
+          if (parse_headers_fast(parser, settings, p, data + len,
+                                 max_header_size - nread, &last)) {
+            if (UNLIKELY(HTTP_PARSER_ERRNO(parser) != HPE_OK)) {
+              RETURN(p - data);
+            }
+            COUNT_HEADER_SIZE(last - p);
+            p = last;
+            ch = *p;
+            UPDATE_STATE(s_headers_almost_done);
+            REEXECUTE();
+          }
+        }
+
         if (UNLIKELY(!IS_ALPHA(ch))) {
           SET_ERRNO(HPE_INVALID_METHOD);
           goto error;
@@ -2088,6 +2454,22 @@ error:
   RETURN(p - data);
 }
 
+size_t http_parser_execute (http_parser *parser,
+                            const http_parser_settings *settings,
+                            const char *data,
+                            size_t len)
+{
+  return execute(parser, settings, data, len, 0);
+}
+
+size_t http_parser_execute_fast (http_parser *parser,
+                                 const http_parser_settings *settings,
+                                 const char *data,
+                                 size_t len)
+{
+  return execute(parser, settings, data, len, 1);
+}
+
 
 /* Does the parser need to see an EOF to find the end of the message? */
 int
@@ -271,6 +271,17 @@ size_t http_parser_execute(http_parser *parser,
                            const char *data,
                            size_t len);
 
+/* Same as http_parser_execute(), but the start line and headers of a
+ * message whose header block is all in data are parsed in one pass,
+ * which is much faster. Fragmented header blocks and anything uncommon
+ * fall back to http_parser_execute().
+ * NOTE: callbacks before on_headers_complete must not pause the parser.
+ */
+size_t http_parser_execute_fast(http_parser *parser,
+                                const http_parser_settings *settings,
+                                const char *data,
+                                size_t len);
+
 
 /* If http_should_keep_alive() in the on_headers_complete or
  * on_message_complete callback returns 0, then this should be
@@ -4,6 +4,7 @@
 #include "hscope.h"
 #include "htime.h"
 #include "hlog.h"
+#include "hfile.h"
 
 #include "httpdef.h"    // import http_content_type_str_by_suffix
 #include "http_page.h"  // import make_index_of_page
@@ -13,6 +14,8 @@
 #endif
 
 #define ETAG_FMT    "\"%zx-%zx\""
+// NOTE: each representation has its own strong ETag, e.g. "5f3e-1a2b-gzip"
+#define ENCODED_ETAG_FMT    "\"%zx-%zx-%s\""
 
 FileCache::FileCache() {
     stat_interval = 10; // s
@@ -20,7 +23,7 @@ FileCache::FileCache() {
 }
 
 file_cache_ptr FileCache::Open(const char* filepath, OpenParam* param) {
-    std::lock_guard<std::mutex> locker(mutex_);
+    std::unique_lock<std::mutex> locker(mutex_);
     file_cache_ptr fc = Get(filepath);
 #ifdef OS_WIN
     std::wstring wfilepath;
@@ -133,9 +136,94 @@ file_cache_ptr FileCache::Open(const char* filepath, OpenParam* param) {
         gmtime_fmt(fc->st.st_mtime, fc->last_modified);
         snprintf(fc->etag, sizeof(fc->etag), ETAG_FMT, (size_t)fc->st.st_mtime, (size_t)fc->st.st_size);
     }
+    bool compressible = param->content_encoding != HTTP_CONTENT_ENCODING_IDENTITY &&
+        param->compression && fc->is_complete() &&
+        param->compression->IsCompressible(fc->content_type.c_str(), fc->filebuf.len);
+    locker.unlock();
+    if (compressible) {
+        file_cache_ptr efc = GetEncoded(fc, param);
+        if (efc) return efc;
+    }
+    param->content_encoding = HTTP_CONTENT_ENCODING_IDENTITY;
     return fc;
 }
 
+file_cache_ptr FileCache::GetEncoded(const file_cache_ptr& fc, OpenParam* param) {
+    http_content_encoding encoding = param->content_encoding;
+    std::string key = HttpCompressor::EncodingName(encoding);
+    key += ':';
+    key += fc->filepath;
+    // snapshot of fc, which may be reread by another thread while compressing
+    file_cache_ptr efc = std::make_shared<file_cache_t>();
+    std::string content;
+    {
+        std::lock_guard<std::mutex> locker(mutex_);
+        auto iter = encoded_files.find(key);
+        if (iter != encoded_files.end()) {
+            file_cache_ptr cached = iter->second;
+            if (cached->st.st_mtime == fc->st.st_mtime && cached->st.st_size == fc->st.st_size) {
+                cached->stat_time = fc->stat_time;
+                // NOTE: empty means not worth compressing
+                return cached->filebuf.len ? cached : NULL;
+            }
+        }
+        efc->filepath = fc->filepath;
+        efc->st = fc->st;
+        efc->open_time = fc->open_time;
+        efc->stat_time = fc->stat_time;
+        efc->stat_cnt = 1;
+        memcpy(efc->last_modified, fc->last_modified, sizeof(efc->last_modified));
+        efc->content_type = fc->content_type;
+        content.assign(fc->filebuf.base, fc->filebuf.len);
+    }
+
+    // NOTE: read or compress without mutex_, other loops keep serving files meanwhile.
+    std::string compressed;
+    bool precompressed = false;
+    const char* suffix = HttpCompressor::EncodingSuffix(encoding);
+    if (param->compression->precompressed && suffix && S_ISREG(efc->st.st_mode)) {
+        std::string filepath = efc->filepath + suffix;
+        struct stat st;
+        HFile file;
+        if (stat(filepath.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+            st.st_mtime >= efc->st.st_mtime && st.st_size <= param->max_read &&
+            file.open(filepath.c_str(), "rb") == 0 &&
+            file.readall(compressed) == (size_t)st.st_size) {
+            precompressed = true;
+        } else {
+            compressed.clear();
+        }
+    }
+    if (!precompressed) {
+        if (!HttpCompressor::Compress(encoding, content.data(), content.size(), compressed, param->compression->level) ||
+            compressed.size() >= content.size()) {
+            compressed.clear();
+        }
+    }
+
+    snprintf(efc->etag, sizeof(efc->etag), ENCODED_ETAG_FMT, (size_t)efc->st.st_mtime, (size_t)efc->st.st_size, HttpCompressor::EncodingName(encoding));
+    efc->content_encoding = HttpCompressor::EncodingName(encoding);
+    if (compressed.size()) {
+        efc->resize_buf(compressed.size());
+        memcpy(efc->filebuf.base, compressed.data(), compressed.size());
+    }
+
+    std::lock_guard<std::mutex> locker(mutex_);
+    auto iter = encoded_files.find(key);
+    if (iter != encoded_files.end()) {
+        file_cache_ptr cached = iter->second;
+        // published by another thread meanwhile, or newer
+        if (cached->st.st_mtime >= efc->st.st_mtime) {
+            if (cached->st.st_mtime == efc->st.st_mtime && cached->st.st_size == efc->st.st_size) {
+                efc = cached;
+            }
+            return efc->filebuf.len ? efc : NULL;
+        }
+    }
+    encoded_files[key] = efc;
+    return efc->filebuf.len ? efc : NULL;
+}
+
 bool FileCache::Close(const char* filepath) {
     std::lock_guard<std::mutex> locker(mutex_);
     auto iter = cached_files.find(filepath);
@@ -148,10 +236,11 @@ bool FileCache::Close(const char* filepath) {
 
 bool FileCache::Close(const file_cache_ptr& fc) {
     std::lock_guard<std::mutex> locker(mutex_);
-    auto iter = cached_files.begin();
-    while (iter != cached_files.end()) {
+    FileCacheMap& files = fc->content_encoding.empty() ? cached_files : encoded_files;
+    auto iter = files.begin();
+    while (iter != files.end()) {
         if (iter->second == fc) {
-            iter = cached_files.erase(iter);
+            iter = files.erase(iter);
             return true;
         } else {
             ++iter;
@@ -179,4 +268,12 @@ void FileCache::RemoveExpiredFileCache() {
             ++iter;
         }
     }
+    iter = encoded_files.begin();
+    while (iter != encoded_files.end()) {
+        if (now - iter->second->stat_time > expired_time) {
+            iter = encoded_files.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
 }
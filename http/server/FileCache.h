@@ -9,6 +9,8 @@
 #include "hbuf.h"
 #include "hstring.h"
 
+#include "HttpCompressor.h"
+
 #define HTTP_HEADER_MAX_LENGTH      1024        // 1K
 #define FILE_CACHE_MAX_SIZE         (1 << 22)   // 4M
 
@@ -24,6 +26,7 @@ typedef struct file_cache_s {
     char        last_modified[64];
     char        etag[64];
     std::string content_type;
+    std::string content_encoding; // compressed variant: gzip, deflate, br
 
     file_cache_s() {
         stat_cnt = 0;
@@ -61,6 +64,8 @@ typedef std::map<std::string, file_cache_ptr>   FileCacheMap;
 class FileCache {
 public:
     FileCacheMap    cached_files;
+    // Content-Encoding:filepath => compressed file_cache_ptr
+    FileCacheMap    encoded_files;
     std::mutex      mutex_;
     int             stat_interval;
     int             expired_time;
@@ -73,6 +78,10 @@ public:
         const char* path;
         size_t  filesize;
         int  error;
+        // in:  negotiated by Accept-Encoding
+        // out: Content-Encoding of returned file cache
+        http_content_encoding content_encoding;
+        const HttpCompressionOptions* compression;
 
         OpenParam() {
             need_read = true;
@@ -80,6 +89,8 @@ public:
             path = "/";
             filesize = 0;
             error = 0;
+            content_encoding = HTTP_CONTENT_ENCODING_IDENTITY;
+            compression = NULL;
         }
     };
     file_cache_ptr Open(const char* filepath, OpenParam* param);
@@ -89,6 +100,9 @@ public:
 
 protected:
     file_cache_ptr Get(const char* filepath);
+    // NOTE: compress once, or load precompressed file.gz, file.br,
+    // mutex_ is only held to look up and publish, not while compressing.
+    file_cache_ptr GetEncoded(const file_cache_ptr& fc, OpenParam* param);
 };
 
 #endif // HV_FILE_CACHE_H_
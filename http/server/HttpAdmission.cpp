@@ -0,0 +1,217 @@
+#include "HttpAdmission.h"
+
+#include <mutex>
+#include <vector>
+
+#include "hplatform.h"
+#include "hdef.h"
+#include "htime.h"
+
+#include "HttpService.h"
+#include "HttpSharedStats.h"
+
+#define HTTP_429_RESPONSE   "HTTP/1.1 429 Too Many Requests\r\n" \
+                            "Content-Length: 0\r\n" \
+                            "Retry-After: 1\r\n" \
+                            "Connection: close\r\n\r\n"
+#define HTTP_503_RESPONSE   "HTTP/1.1 503 Service Unavailable\r\n" \
+                            "Content-Length: 0\r\n" \
+                            "Retry-After: 1\r\n" \
+                            "Connection: close\r\n\r\n"
+
+namespace hv {
+
+static std::mutex                                   s_admissions_mutex;
+static std::vector<std::shared_ptr<HttpAdmission>>  s_admissions;
+
+HttpAdmission::HttpAdmission()
+    : inflight(0)
+    , limit(0)
+    , admitted(0)
+    , rejected_ip(0)
+    , rejected_route(0)
+    , rejected_inflight(0)
+    , rejected_concurrency(0)
+    , rejected_accept_queue(0)
+    , latency_sum(0)
+    , latency_count(0)
+    , window_start_ms(0)
+    , window_peak(0)
+    , accept_queue_fd(-1)
+    , accept_queue_len(0)
+    , accept_queue_ms(0)
+{}
+
+HttpAdmission* HttpAdmission::Current() {
+    static thread_local HttpAdmission* admission = NULL;
+    if (admission == NULL) {
+        std::shared_ptr<HttpAdmission> ptr(new HttpAdmission);
+        std::lock_guard<std::mutex> locker(s_admissions_mutex);
+        s_admissions.push_back(ptr);
+        admission = ptr.get();
+    }
+    return admission;
+}
+
+void HttpAdmission::adaptLimit(const http_adaptive_concurrency& options, uint64_t now_ms) {
+    window_start_ms = now_ms;
+    uint64_t count = latency_count.exchange(0, std::memory_order_relaxed);
+    uint64_t sum = latency_sum.exchange(0, std::memory_order_relaxed);
+    uint32_t cur = limit.load(std::memory_order_relaxed);
+    if (cur == 0) cur = options.max_limit;
+    if (count) {
+        if (sum / count > (uint64_t)options.target_latency_ms * 1000) {
+            // NOTE: back off from the concurrency reached, the limit may be far above it.
+            cur = (uint32_t)(MIN(cur, window_peak) * options.backoff);
+        } else if (window_peak >= cur) {
+            ++cur;
+        }
+    }
+    window_peak = 0;
+    cur = LIMIT(options.min_limit, cur, options.max_limit);
+    limit.store(cur, std::memory_order_relaxed);
+}
+
+http_status HttpAdmission::Admit(HttpService* service, const char* ip, const std::string* route) {
+    // cheap local checks first
+    uint32_t n = inflight.load(std::memory_order_relaxed);
+    if (service->max_inflight_requests && n >= service->max_inflight_requests) {
+        rejected_inflight.fetch_add(1, std::memory_order_relaxed);
+        return HTTP_STATUS_SERVICE_UNAVAILABLE;
+    }
+    const http_adaptive_concurrency& adaptive = service->adaptive_concurrency;
+    if (adaptive.target_latency_ms) {
+        uint64_t now_ms = gethrtime_us() / 1000;
+        if (now_ms >= window_start_ms + adaptive.window_ms) {
+            adaptLimit(adaptive, now_ms);
+        }
+        if (n >= limit.load(std::memory_order_relaxed)) {
+            rejected_concurrency.fetch_add(1, std::memory_order_relaxed);
+            return HTTP_STATUS_SERVICE_UNAVAILABLE;
+        }
+    }
+
+    // token buckets
+    const http_rate_limit& ip_limit = service->ip_rate_limit;
+    if (ip_limit.rate > 0 && ip) {
+        std::string key("ip:");
+        key += ip;
+        if (!HttpSharedStats::RateLimit(key, ip_limit.rate, ip_limit.burst)) {
+            rejected_ip.fetch_add(1, std::memory_order_relaxed);
+            return HTTP_STATUS_TOO_MANY_REQUESTS;
+        }
+    }
+    if (route && !service->route_rate_limits.empty()) {
+        auto iter = service->route_rate_limits.find(*route);
+        if (iter != service->route_rate_limits.end() && iter->second.rate > 0) {
+            std::string key("route:");
+            key += *route;
+            if (!HttpSharedStats::RateLimit(key, iter->second.rate, iter->second.burst)) {
+                rejected_route.fetch_add(1, std::memory_order_relaxed);
+                return HTTP_STATUS_TOO_MANY_REQUESTS;
+            }
+        }
+    }
+
+    if (++n > window_peak) window_peak = n;
+    inflight.fetch_add(1, std::memory_order_relaxed);
+    admitted.fetch_add(1, std::memory_order_relaxed);
+    return HTTP_STATUS_OK;
+}
+
+void HttpAdmission::Release(uint64_t latency_us) {
+    inflight.fetch_sub(1, std::memory_order_relaxed);
+    if (latency_us) {
+        latency_sum.fetch_add(latency_us, std::memory_order_relaxed);
+        latency_count.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool HttpAdmission::CheckAcceptQueue(HttpService* service, int listenfd, uint64_t now_ms) {
+    if (service->max_accept_queue == 0) return true;
+#ifdef OS_LINUX
+    if (listenfd != accept_queue_fd || now_ms != accept_queue_ms) {
+        // NOTE: tcpi_unacked of a listening socket is the length of its accept queue.
+        struct tcp_info info;
+        socklen_t len = sizeof(info);
+        memset(&info, 0, sizeof(info));
+        if (getsockopt(listenfd, IPPROTO_TCP, TCP_INFO, &info, &len) != 0) {
+            info.tcpi_unacked = 0;
+        }
+        accept_queue_fd = listenfd;
+        accept_queue_len = info.tcpi_unacked;
+        accept_queue_ms = now_ms;
+    } else if (accept_queue_len) {
+        // one less since the last query
+        --accept_queue_len;
+    }
+    if (accept_queue_len > service->max_accept_queue) {
+        rejected_accept_queue.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+#endif
+    return true;
+}
+
+const char* HttpAdmission::StatusResponse(http_status status_code, int* len) {
+    if (status_code == HTTP_STATUS_TOO_MANY_REQUESTS) {
+        *len = sizeof(HTTP_429_RESPONSE) - 1;
+        return HTTP_429_RESPONSE;
+    }
+    *len = sizeof(HTTP_503_RESPONSE) - 1;
+    return HTTP_503_RESPONSE;
+}
+
+static void dump_header(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP "; out += name; out += " "; out += help; out += "\n";
+    out += "# TYPE "; out += name; out += " "; out += type; out += "\n";
+}
+
+void HttpAdmission::Dump(std::string& out) {
+    unsigned long long inflight = 0, limit = 0, admitted = 0;
+    unsigned long long rejected[5] = { 0 };
+    {
+        std::lock_guard<std::mutex> locker(s_admissions_mutex);
+        if (s_admissions.empty()) return;
+        for (auto& admission : s_admissions) {
+            inflight += admission->inflight.load(std::memory_order_relaxed);
+            limit += admission->limit.load(std::memory_order_relaxed);
+            admitted += admission->admitted.load(std::memory_order_relaxed);
+            rejected[0] += admission->rejected_ip.load(std::memory_order_relaxed);
+            rejected[1] += admission->rejected_route.load(std::memory_order_relaxed);
+            rejected[2] += admission->rejected_inflight.load(std::memory_order_relaxed);
+            rejected[3] += admission->rejected_concurrency.load(std::memory_order_relaxed);
+            rejected[4] += admission->rejected_accept_queue.load(std::memory_order_relaxed);
+        }
+    }
+    char buf[256];
+    dump_header(out, "hv_admission_inflight_requests", "gauge", "HTTP requests in flight of all loops.");
+    snprintf(buf, sizeof(buf), "hv_admission_inflight_requests %llu\n", inflight);
+    out += buf;
+    dump_header(out, "hv_admission_concurrency_limit", "gauge", "Adaptive concurrency limits of all loops.");
+    snprintf(buf, sizeof(buf), "hv_admission_concurrency_limit %llu\n", limit);
+    out += buf;
+    dump_header(out, "hv_admission_admitted_total", "counter", "HTTP requests admitted.");
+    snprintf(buf, sizeof(buf), "hv_admission_admitted_total %llu\n", admitted);
+    out += buf;
+    const char* name = "hv_admission_rejected_total";
+    dump_header(out, name, "counter", "HTTP requests and connections rejected by reason.");
+    static const char* reasons[5] = { "ip_rate", "route_rate", "inflight", "concurrency", "accept_queue" };
+    for (int i = 0; i < 5; ++i) {
+        snprintf(buf, sizeof(buf), "%s{reason=\"%s\"} %llu\n", name, reasons[i], rejected[i]);
+        out += buf;
+    }
+}
+
+void HttpAdmissionTicket::Release(bool observe) {
+    if (released) return;
+    released = true;
+    uint64_t latency_us = 0;
+    if (observe && begin_us) {
+        latency_us = gethrtime_us() - begin_us;
+        if (latency_us == 0) latency_us = 1;
+    }
+    admission->Release(latency_us);
+}
+
+}
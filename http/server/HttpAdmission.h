@@ -0,0 +1,142 @@
+#ifndef HV_HTTP_ADMISSION_H_
+#define HV_HTTP_ADMISSION_H_
+
+/*
+ * Admission control of HttpService: shed load before bodies are parsed
+ *
+ * HttpService service;
+ * // 100 requests per second per client ip, bursts up to 200 => 429
+ * service.RateLimit(100, 200);
+ * // 1000 requests per second of all clients on /login => 429
+ * service.RateLimit("/login", 1000, 1000);
+ * // 256 requests in flight per loop => 503
+ * service.SetMaxInflightRequests(256);
+ * // keep handler latency under 50ms by limiting concurrency per loop => 503
+ * service.EnableAdaptiveConcurrency(50);
+ * // close new connections when 1024 are waiting in the accept queue (linux)
+ * service.SetMaxAcceptQueue(1024);
+ * service.EnableMetrics("/metrics"); // dumps admission counters too
+ *
+ * Requests are checked when headers are complete, right after routing,
+ * rejected ones get a pre-built response and the connection is closed,
+ * without reading the body.
+ *
+ * Token buckets are HttpSharedStats::RateLimit, so they are shared by worker
+ * processes and threads, http_server_run inits HttpSharedStats for them.
+ *
+ * In-flight requests and the adaptive limit are counted per loop.
+ * A request is in flight from its headers until its response is ended.
+ * Adaptive concurrency is AIMD: every window, if the mean handler latency is
+ * over target, the limit is set to the peak concurrency multiplied by backoff,
+ * else it grows by 1 if the limit was reached.
+ *
+ */
+
+#include <string>
+#include <atomic>
+#include <memory>
+
+#include "hexport.h"
+#include "httpdef.h"
+
+#define HTTP_ADAPTIVE_CONCURRENCY_WINDOW_MS     100
+#define HTTP_ADAPTIVE_CONCURRENCY_BACKOFF       0.9
+
+// token bucket, rate <= 0 means unlimited
+struct http_rate_limit {
+    double  rate;   // requests per second
+    double  burst;  // bucket size
+
+    http_rate_limit(double rate = 0, double burst = 0) : rate(rate), burst(burst) {}
+};
+
+struct http_adaptive_concurrency {
+    uint32_t    target_latency_ms;  // 0 means disabled
+    uint32_t    min_limit;
+    uint32_t    max_limit;          // the initial limit
+    uint32_t    window_ms;
+    double      backoff;            // multiplicative decrease
+
+    http_adaptive_concurrency() {
+        target_latency_ms = 0;
+        min_limit = 1;
+        max_limit = 1000;
+        window_ms = HTTP_ADAPTIVE_CONCURRENCY_WINDOW_MS;
+        backoff = HTTP_ADAPTIVE_CONCURRENCY_BACKOFF;
+    }
+};
+
+namespace hv {
+
+struct HttpService;
+
+// admission state of one loop thread
+class HV_EXPORT HttpAdmission {
+public:
+    // of the calling thread, lives until the process exits.
+    static HttpAdmission* Current();
+
+    // called by HttpHandler when headers are complete, in loop thread.
+    // @param route: path pattern of HttpService::pathHandlers, NULL means not routed to an API.
+    // @retval HTTP_STATUS_OK: one in-flight request is taken, call Release when it is done.
+    //         HTTP_STATUS_TOO_MANY_REQUESTS, HTTP_STATUS_SERVICE_UNAVAILABLE
+    http_status Admit(HttpService* service, const char* ip, const std::string* route);
+    // any thread
+    // @param latency_us: handler latency for adaptive concurrency, 0 means not observed.
+    void Release(uint64_t latency_us);
+
+    // called by HttpServer on_accept, in loop thread.
+    // @retval false if the accept queue of listenfd is longer than service->max_accept_queue
+    bool CheckAcceptQueue(HttpService* service, int listenfd, uint64_t now_ms);
+
+    // pre-built response with Connection: close
+    static const char* StatusResponse(http_status status_code, int* len);
+
+    // Prometheus text format, summed up of all loops
+    static void Dump(std::string& out);
+
+public:
+    std::atomic<uint32_t>   inflight;
+    std::atomic<uint32_t>   limit;      // adaptive concurrency limit
+    // counters
+    std::atomic<uint64_t>   admitted;
+    std::atomic<uint64_t>   rejected_ip;
+    std::atomic<uint64_t>   rejected_route;
+    std::atomic<uint64_t>   rejected_inflight;
+    std::atomic<uint64_t>   rejected_concurrency;
+    std::atomic<uint64_t>   rejected_accept_queue;
+
+private:
+    HttpAdmission();
+    void adaptLimit(const http_adaptive_concurrency& options, uint64_t now_ms);
+
+    // adaptive concurrency window
+    std::atomic<uint64_t>   latency_sum;
+    std::atomic<uint64_t>   latency_count;
+    uint64_t                window_start_ms;
+    uint32_t                window_peak;    // max inflight admitted in the window
+    // accept queue length, queried once per ms at most
+    int                     accept_queue_fd;
+    uint32_t                accept_queue_len;
+    uint64_t                accept_queue_ms;
+};
+
+// one admitted request, released when ended or destroyed.
+struct HV_EXPORT HttpAdmissionTicket {
+    HttpAdmission*  admission;
+    uint64_t        begin_us;   // 0 means latency is not observed
+    bool            released;
+
+    HttpAdmissionTicket(HttpAdmission* admission, uint64_t begin_us)
+        : admission(admission), begin_us(begin_us), released(false) {}
+    ~HttpAdmissionTicket() { Release(false); }
+
+    // @param observe: the response is ended, observe the latency.
+    void Release(bool observe = true);
+};
+
+typedef std::shared_ptr<HttpAdmissionTicket> HttpAdmissionTicketPtr;
+
+}
+
+#endif // HV_HTTP_ADMISSION_H_
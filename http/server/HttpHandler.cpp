@@ -12,6 +12,9 @@
 #include "wsdef.h"
 
 #include "http_page.h"
+#include "HttpMetrics.h"
+#include "HttpSharedStats.h"
+#include "HttpAdmission.h"
 
 #include "EventLoop.h" // import hv::setInterval
 using namespace hv;
@@ -24,6 +27,22 @@ using namespace hv;
 #define HTTP_200_CONNECT_RESPONSE       "HTTP/1.1 200 Connection established\r\n\r\n"
 #define HTTP_200_CONNECT_RESPONSE_LEN   39
 
+// idle_release: keep small buffers for the next request, free large ones.
+#define IDLE_BUFFER_MAX_CAPACITY        4096
+
+static void observe_request(HttpService* service, http_method method, const std::string* route, int status_code, uint64_t begin_hrtime) {
+    if (service && service->enable_metrics) {
+        hv::HttpMetrics::ObserveRequest(method, route, status_code, gethrtime_us() - begin_hrtime);
+    }
+    hv::HttpSharedStats::ObserveRequest(method, route, status_code);
+}
+
+static inline void shrink_buffer(std::string& str) {
+    if (str.capacity() > IDLE_BUFFER_MAX_CAPACITY) {
+        std::string().swap(str);
+    }
+}
+
 HttpHandler::HttpHandler(hio_t* io) :
     protocol(HttpHandler::UNKNOWN),
     state(WANT_RECV),
@@ -36,6 +55,10 @@ HttpHandler::HttpHandler(hio_t* io) :
     proxy_connected(0),
     forward_proxy(0),
     reverse_proxy(0),
+    proxy_request_complete(0),
+    proxy_cache(0),
+    proxy_cache_leader(0),
+    idle_release(0),
     ip{'\0'},
     port(0),
     pid(0),
@@ -44,6 +67,10 @@ HttpHandler::HttpHandler(hio_t* io) :
     io(io),
     service(NULL),
     api_handler(NULL),
+    api_route(NULL),
+    pool_handler(NULL),
+    begin_hrtime(0),
+    content_encoding(HTTP_CONTENT_ENCODING_IDENTITY),
     // for websocket
     ws_service(NULL),
     last_send_ping_time(0),
@@ -52,7 +79,8 @@ HttpHandler::HttpHandler(hio_t* io) :
     files(NULL),
     file(NULL),
     // for proxy
-    proxy_port(0)
+    proxy_port(0),
+    proxy_requests(0)
 {
     // Init();
 }
@@ -115,16 +143,34 @@ void HttpHandler::Reset() {
     resp->Reset();
     ctx = NULL;
     api_handler = NULL;
+    api_route = NULL;
+    pool_handler = NULL;
+    content_encoding = HTTP_CONTENT_ENCODING_IDENTITY;
+    proxy_cache_entry = NULL;
+    admission_ticket = NULL;
+#ifndef WITHOUT_HTTP_CONTENT
+    // NOTE: remove temp files not renamed by handler
+    upload_parser = NULL;
+#endif
     closeFile();
     if (writer) {
         writer->Begin();
+        writer->content_encoding = HTTP_CONTENT_ENCODING_IDENTITY;
+        writer->compression = NULL;
         writer->onwrite = NULL;
         writer->onclose = NULL;
+        writer->onend = NULL;
     }
     parser->InitRequest(req.get());
+    if (idle_release) {
+        shrink_buffer(req->body);
+        shrink_buffer(resp->body);
+        shrink_buffer(header);
+    }
 }
 
 void HttpHandler::Close() {
+    admission_ticket = NULL;
     if (writer) {
         writer->status = hv::SocketChannel::DISCONNECTED;
     }
@@ -137,6 +183,10 @@ void HttpHandler::Close() {
     }
 
     // close proxy
+    if (proxy_cache_leader) {
+        proxy_cache_leader = 0;
+        service->proxy_cache->Complete(proxy_cache_key, NULL);
+    }
     closeProxy();
 
     // close file
@@ -233,12 +283,22 @@ int HttpHandler::customHttpHandler(const http_handler& handler) {
 
 int HttpHandler::invokeHttpHandler(const http_handler* handler) {
     int status_code = HTTP_STATUS_NOT_IMPLEMENTED;
+    // NOTE: streams of HTTP/2 share one connection, run them inline.
+    if (handler->worker_pool && writer && protocol == HTTP_V1) {
+        if (!handler->worker_pool->Acquire()) {
+            hlogw("[%s:%d] worker pool '%s' overloaded", ip, port, handler->worker_pool->name.c_str());
+            return HTTP_STATUS_SERVICE_UNAVAILABLE;
+        }
+        // NOTE: post it after HandleHttpRequest, avoid racing with postprocessor on resp.
+        pool_handler = handler;
+        return HTTP_STATUS_NEXT;
+    }
     if (handler->sync_handler) {
         // NOTE: sync_handler run on IO thread
         status_code = handler->sync_handler(req.get(), resp.get());
     } else if (handler->async_handler) {
         // NOTE: async_handler run on hv::async threadpool
-        hv::async(std::bind(handler->async_handler, req, writer));
+        hv::async::post(std::bind(handler->async_handler, req, writer));
         status_code = HTTP_STATUS_NEXT;
     } else if (handler->ctx_handler) {
         // NOTE: ctx_handler run on IO thread, you can easily post HttpContextPtr to your consumer thread for processing.
@@ -249,6 +309,79 @@ int HttpHandler::invokeHttpHandler(const http_handler* handler) {
     return status_code;
 }
 
+void HttpHandler::offloadHttpHandler() {
+    const http_handler* handler = pool_handler;
+    pool_handler = NULL;
+    hv::HttpWorkerPool* worker_pool = handler->worker_pool;
+    hv::EventLoop* loop = currentThreadEventLoop;
+    HttpRequestPtr request = req;
+    HttpResponsePtr response = resp;
+    HttpResponseWriterPtr writer = this->writer;
+    HttpContextPtr ctx = handler->ctx_handler ? context() : NULL;
+    // NOTE: stop reading until handler done, the next request may reset req and resp.
+    hio_read_stop(writer->io());
+    worker_pool->Post([this, handler, worker_pool, loop, request, response, writer, ctx]() {
+        int status_code = HTTP_STATUS_NEXT;
+        if (handler->sync_handler) {
+            status_code = handler->sync_handler(request.get(), response.get());
+        } else if (handler->ctx_handler) {
+            status_code = handler->ctx_handler(ctx);
+        } else if (handler->async_handler) {
+            handler->async_handler(request, writer);
+        }
+        worker_pool->Release();
+        // write response back on IO thread
+        auto complete = [this, writer, status_code]() {
+            // NOTE: this is deleted on close, which runs on the same loop.
+            if (!writer->isConnected()) return;
+            completeHttpHandler(status_code);
+        };
+        if (loop) {
+            loop->runInLoop(complete);
+        } else {
+            complete();
+        }
+    });
+}
+
+void HttpHandler::completeHttpHandler(int status_code) {
+    hio_read_start(io);
+    // HTTP_STATUS_NEXT means the handler will end response by itself
+    status_code = postprocessHttpRequest(status_code);
+    if (status_code != HTTP_STATUS_NEXT) {
+        sendHandledResponse(true);
+    }
+    logAccess();
+    if (status_code == HTTP_STATUS_NEXT) return;
+    // keepalive ? Reset : Close
+    if (keepalive) {
+        Reset();
+    } else {
+        state = WANT_CLOSE;
+        hio_close(io);
+    }
+}
+
+void HttpHandler::sendHandledResponse(bool hook) {
+    SendHttpResponse();
+    if (hook && writer && writer->onend) {
+        std::function<void()> onend(std::move(writer->onend));
+        writer->onend = NULL;
+        onend();
+    } else if (!writer && ((service && service->enable_metrics) || hv::HttpSharedStats::IsEnabled())) {
+        observe_request(service, req->method, api_route, resp->status_code, begin_hrtime);
+    }
+}
+
+void HttpHandler::logAccess() {
+    if (service && service->enable_access_log) {
+        hlogi("[%ld-%ld][%s:%d][%s %s]=>[%d %s]",
+            pid, tid, ip, port,
+            http_method_str(req->method), req->path.c_str(),
+            resp->status_code, resp->status_message());
+    }
+}
+
 void HttpHandler::onHeadersComplete() {
     // printf("onHeadersComplete\n");
     int status_code = handleRequestHeaders();
@@ -258,8 +391,15 @@ void HttpHandler::onHeadersComplete() {
     }
 
     HttpRequest* pReq = req.get();
+    if ((service && service->enable_metrics) || hv::HttpSharedStats::IsEnabled()) {
+        begin_hrtime = gethrtime_us();
+    }
     if (service && service->pathHandlers.size() != 0) {
-        service->GetRoute(pReq, &api_handler);
+        service->GetRoute(pReq, &api_handler, &api_route);
+    }
+
+    if (service && service->enable_admission) {
+        if (!admitRequest()) return;
     }
 
     if (api_handler && api_handler->state_handler) {
@@ -272,6 +412,11 @@ void HttpHandler::onHeadersComplete() {
         return;
     }
 
+    // streaming multipart/form-data upload
+    if (service && !service->upload_dir.empty()) {
+        startUpload();
+    }
+
     // Expect: 100-continue
     handleExpect100();
 }
@@ -287,6 +432,20 @@ void HttpHandler::onBody(const char* data, size_t size) {
         return;
     }
 
+#ifndef WITHOUT_HTTP_CONTENT
+    if (upload_parser) {
+        int status_code = upload_parser->Feed(data, size);
+        if (status_code != 0) {
+            hlogw("[%s:%d] upload %s failed: %d", ip, port, req->path.c_str(), status_code);
+            upload_parser = NULL;
+            keepalive = false;
+            SendHttpStatusResponse((http_status)status_code);
+            error = ERR_REQUEST;
+        }
+        return;
+    }
+#endif
+
     req->body.append(data, size);
     return;
 }
@@ -301,10 +460,20 @@ void HttpHandler::onMessageComplete() {
     }
 
     if (proxy) {
-        if (proxy_connected) Reset();
+        if (proxy_connected) {
+            proxy_request_complete = 1;
+            Reset();
+        }
         return;
     }
 
+#ifndef WITHOUT_HTTP_CONTENT
+    if (upload_parser && !upload_parser->IsComplete()) {
+        // multipart/form-data without close-delimiter
+        resp->status_code = HTTP_STATUS_BAD_REQUEST;
+    }
+#endif
+
     addResponseHeaders();
 
     // upgrade ? handleUpgrade : HandleHttpRequest
@@ -314,20 +483,28 @@ void HttpHandler::onMessageComplete() {
             handleUpgrade(iter_upgrade->second.c_str());
             status_code = resp->status_code;
         }
+        // NOTE: an upgraded connection is not a request in flight
+        admission_ticket = NULL;
     } else {
+        bool metrics = (service && service->enable_metrics) || hv::HttpSharedStats::IsEnabled();
+        bool hook = metrics || admission_ticket;
+        if (hook) {
+            // response may be ended later in any thread
+            setMetricsHook();
+        }
         status_code = HandleHttpRequest();
+        if (pool_handler) {
+            // NOTE: access log, send and keepalive by completeHttpHandler
+            offloadHttpHandler();
+            return;
+        }
         if (status_code != HTTP_STATUS_NEXT) {
-            SendHttpResponse();
+            sendHandledResponse(hook);
         }
     }
 
     // access log
-    if (service && service->enable_access_log) {
-        hlogi("[%ld-%ld][%s:%d][%s %s]=>[%d %s]",
-            pid, tid, ip, port,
-            http_method_str(req->method), req->path.c_str(),
-            resp->status_code, resp->status_message());
-    }
+    logAccess();
 
     if (status_code != HTTP_STATUS_NEXT) {
         // keepalive ? Reset : Close
@@ -339,6 +516,49 @@ void HttpHandler::onMessageComplete() {
     }
 }
 
+void HttpHandler::setMetricsHook() {
+    if (!writer) return;
+    http_method method = req->method;
+    const std::string* route = api_route;
+    uint64_t begin = begin_hrtime;
+    HttpResponsePtr response = resp;
+    HttpService* service = this->service;
+    bool metrics = (service && service->enable_metrics) || hv::HttpSharedStats::IsEnabled();
+    hv::HttpAdmissionTicketPtr ticket(std::move(admission_ticket));
+    writer->onend = [service, method, route, begin, response, metrics, ticket]() {
+        if (metrics) {
+            observe_request(service, method, route, response->status_code, begin);
+        }
+        if (ticket) {
+            ticket->Release();
+        }
+    };
+}
+
+bool HttpHandler::admitRequest() {
+    hv::HttpAdmission* admission = hv::HttpAdmission::Current();
+    http_status status_code = admission->Admit(service, ip, api_route);
+    if (status_code == HTTP_STATUS_OK) {
+        uint64_t begin = service->adaptive_concurrency.target_latency_ms ? gethrtime_us() : 0;
+        admission_ticket = std::make_shared<hv::HttpAdmissionTicket>(admission, begin);
+        return true;
+    }
+    // shed it before reading the body
+    error = ERR_OVER_LIMIT;
+    keepalive = 0;
+    resp->status_code = status_code;
+    hv::HttpSharedStats::ObserveRequest(req->method, api_route, status_code);
+    if (protocol == HTTP_V1 && io) {
+        int len = 0;
+        const char* data = hv::HttpAdmission::StatusResponse(status_code, &len);
+        hio_write(io, data, len);
+        hv::HttpSharedStats::AddSendBytes(len);
+        state = WANT_CLOSE;
+    }
+    // else onMessageComplete sends the status response
+    return false;
+}
+
 int HttpHandler::handleRequestHeaders() {
     HttpRequest* pReq = req.get();
     pReq->scheme = ssl ? "https" : "http";
@@ -352,7 +572,7 @@ int HttpHandler::handleRequestHeaders() {
     upgrade = pReq->IsUpgrade();
 
     // proxy
-    proxy = forward_proxy = reverse_proxy = 0;
+    proxy = forward_proxy = reverse_proxy = proxy_cache = 0;
     if (hv::startswith(pReq->url, "http")) {
         // forward proxy
         proxy = forward_proxy = 1;
@@ -399,7 +619,14 @@ int HttpHandler::handleRequestHeaders() {
         std::string proxy_url = service->GetProxyUrl(pReq->path.c_str());
         if (!proxy_url.empty()) {
             pReq->url = proxy_url;
-            proxy = reverse_proxy = 1;
+            reverse_proxy = 1;
+            // NOTE: cacheable request is handled by proxyCacheHandler after message complete
+            if (service->proxy_cache && HttpProxyCache::IsCacheableRequest(pReq)) {
+                proxy_cache = 1;
+            } else {
+                proxy = 1;
+                if (service->proxy_cache) ++service->proxy_cache->stats.bypasses;
+            }
         }
     }
 
@@ -416,6 +643,29 @@ void HttpHandler::handleExpect100() {
     }
 }
 
+bool HttpHandler::startUpload() {
+#ifndef WITHOUT_HTTP_CONTENT
+    HttpRequest* pReq = req.get();
+    if (pReq->ContentType() != MULTIPART_FORM_DATA) return false;
+    auto iter = pReq->headers.find("Content-Type");
+    const char* boundary = strstr(iter->second.c_str(), "boundary=");
+    if (boundary == NULL) return false;
+    boundary += strlen("boundary=");
+    std::string strBoundary(boundary);
+    strBoundary = hv::trim_pairs(strBoundary, "\"\"\'\'");
+    upload_parser = std::make_shared<MultipartParser>(&pReq->form, strBoundary.c_str());
+    upload_parser->upload_dir = service->upload_dir;
+    upload_parser->max_memory_size = service->upload_max_memory_size;
+    upload_parser->max_file_size = service->upload_max_file_size;
+    if (service->enable_upload_preallocate) {
+        upload_parser->content_length = atoll(pReq->GetHeader("Content-Length").c_str());
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
 void HttpHandler::addResponseHeaders() {
     HttpResponse* pResp = resp.get();
     // Server:
@@ -433,6 +683,18 @@ int HttpHandler::HandleHttpRequest() {
     // NOTE: Not all users want to parse body, we comment it out.
     // pReq->ParseBody();
 
+    // Accept-Encoding
+    if (service->enable_compression && pReq->method != HTTP_HEAD) {
+        auto iter = pReq->headers.find("Accept-Encoding");
+        if (iter != pReq->headers.end()) {
+            content_encoding = HttpCompressor::Negotiate(iter->second.c_str());
+        }
+        if (writer) {
+            writer->content_encoding = content_encoding;
+            writer->compression = &service->compression;
+        }
+    }
+
     int status_code = pResp->status_code;
     if (status_code != HTTP_STATUS_OK) {
         goto postprocessor;
@@ -461,8 +723,21 @@ processor:
     } else {
         status_code = defaultRequestHandler();
     }
+    if (pool_handler) {
+        // NOTE: postprocessed by completeHttpHandler when the pooled handler returned
+        state = HANDLE_CONTINUE;
+        return HTTP_STATUS_NEXT;
+    }
 
 postprocessor:
+    return postprocessHttpRequest(status_code);
+}
+
+int HttpHandler::postprocessHttpRequest(int status_code) {
+    // status -> errorHandler -> postprocessor -> compression
+    HttpRequest* pReq = req.get();
+    HttpResponse* pResp = resp.get();
+
     if (status_code >= 100 && status_code < 600) {
         pResp->status_code = (http_status)status_code;
         if (pResp->status_code >= 400 && pResp->body.size() == 0 && pReq->method != HTTP_HEAD) {
@@ -479,6 +754,12 @@ postprocessor:
         pResp->headers["Content-Type"] = fc->content_type;
         pResp->headers["Last-Modified"] = fc->last_modified;
         pResp->headers["Etag"] = fc->etag;
+        if (!fc->content_encoding.empty()) {
+            pResp->headers["Content-Encoding"] = fc->content_encoding;
+            HttpCompressor::AddVary(pResp);
+        } else if (service->enable_compression && service->compression.IsCompressible(fc->content_type.c_str(), fc->filebuf.len)) {
+            HttpCompressor::AddVary(pResp);
+        }
     }
     if (service->postprocessor) {
         customHttpHandler(service->postprocessor);
@@ -491,6 +772,10 @@ postprocessor:
         state = HANDLE_CONTINUE;
     } else {
         state = HANDLE_END;
+        // compression
+        if (service->enable_compression && !fc && pReq->method != HTTP_HEAD) {
+            HttpCompressor::CompressResponse(pResp, content_encoding, service->compression);
+        }
     }
     return status_code;
 }
@@ -498,7 +783,10 @@ postprocessor:
 int HttpHandler::defaultRequestHandler() {
     int status_code = HTTP_STATUS_OK;
 
-    if (api_handler) {
+    if (proxy_cache) {
+        status_code = proxyCacheHandler();
+    }
+    else if (api_handler) {
         status_code = invokeHttpHandler(api_handler);
     }
     else if (req->method == HTTP_GET || req->method == HTTP_HEAD) {
@@ -585,6 +873,10 @@ int HttpHandler::defaultStaticHandler() {
     param.max_read = service->max_file_cache_size;
     param.need_read = !(req->method == HTTP_HEAD || has_range);
     param.path = req_path;
+    if (service->enable_compression) {
+        param.content_encoding = content_encoding;
+        param.compression = &service->compression;
+    }
     if (files) {
         fc = files->Open(filepath.c_str(), &param);
     }
@@ -762,7 +1054,7 @@ int HttpHandler::GetSendData(char** data, size_t* len) {
                 if (fc) {
                     pResp->headers["Accept-Ranges"] = "bytes";
                     pResp->headers["Content-Length"] = hv::to_string(fc->st.st_size);
-                } else {
+                } else if (proxy_cache_entry == NULL) {
                     pResp->headers["Content-Type"] = "text/html";
                     pResp->headers["Content-Length"] = "0";
                 }
@@ -846,6 +1138,7 @@ int HttpHandler::SendHttpResponse(bool submit) {
             total_len += len;
         }
     }
+    hv::HttpSharedStats::AddSendBytes(total_len);
     return total_len;
 }
 
@@ -892,6 +1185,7 @@ int HttpHandler::sendFile() {
         writer->close(true);
         return nwrite;
     }
+    hv::HttpSharedStats::AddSendBytes(nread);
     resp->content_length -= nread;
     if (resp->content_length == 0) {
         writer->End();
@@ -958,6 +1252,18 @@ int HttpHandler::upgradeWebSocket() {
         }
     }
 
+    // Sec-WebSocket-Extensions: permessage-deflate
+    WebSocketDeflateOptions deflate_options;
+    bool enable_deflate = false;
+    if (ws_service && ws_service->enable_compression) {
+        auto iter_extensions = req->headers.find(SEC_WEBSOCKET_EXTENSIONS);
+        if (iter_extensions != req->headers.end() &&
+            ws_service->compression.AcceptOffer(iter_extensions->second, &deflate_options)) {
+            enable_deflate = true;
+            resp->headers[SEC_WEBSOCKET_EXTENSIONS] = deflate_options.ToResponse();
+        }
+    }
+
     SendHttpResponse();
 
     if (!SwitchWebSocket()) {
@@ -965,6 +1271,11 @@ int HttpHandler::upgradeWebSocket() {
         return SetError(ERR_INVALID_PROTOCOL);
     }
 
+    if (enable_deflate) {
+        ws_channel->deflate = std::make_shared<WebSocketDeflate>(deflate_options, WS_SERVER);
+        ws_parser->deflate = ws_channel->deflate;
+    }
+
     // onopen
     WebSocketOnOpen();
     return 0;
@@ -1027,18 +1338,18 @@ int HttpHandler::connectProxy(const std::string& strUrl) {
     url.parse(strUrl);
     hlogi("[%s:%d] proxy_pass %s", ip, port, strUrl.c_str());
 
+    // proxy_pass http://upstream_name/
+    UpstreamGroupPtr upstream = reverse_proxy ? service->GetUpstream(url.host.c_str()) : NULL;
+
     if (proxy_connected) {
-        if (url.host == proxy_host && url.port == proxy_port) {
+        if (upstream ? upstream == proxy_upstream :
+            (url.host == proxy_host && url.port == proxy_port)) {
             // reuse keepalive connection
             sendProxyRequest();
             return 0;
         } else {
             // detach and close previous connection
-            hio_t* upstream_io = hio_get_upstream(io);
-            if (upstream_io) {
-                hio_setcb_close(upstream_io, NULL);
-                closeProxy();
-            }
+            closeProxy();
         }
     }
 
@@ -1048,10 +1359,19 @@ int HttpHandler::connectProxy(const std::string& strUrl) {
         return 0;
     }
 
-    hloop_t* loop = hevent_loop(io);
     proxy = 1;
+    proxy_upstream = upstream;
+    if (proxy_upstream) {
+        proxy_tried.clear();
+        return connectUpstream();
+    }
+
+    hloop_t* loop = hevent_loop(io);
     proxy_host = url.host;
     proxy_port = url.port;
+    if (proxy_cache) {
+        initProxyParser();
+    }
     hio_t* upstream_io = hio_create_socket(loop, proxy_host.c_str(), proxy_port, HIO_TYPE_TCP, HIO_CLIENT_SIDE);
     if (upstream_io == NULL) {
         return SetError(ERR_SOCKET, HTTP_STATUS_BAD_GATEWAY);
@@ -1078,25 +1398,173 @@ int HttpHandler::connectProxy(const std::string& strUrl) {
     return 0;
 }
 
-int HttpHandler::closeProxy() {
-    if (proxy && proxy_connected) {
-        proxy_connected = 0;
-        if (io) hio_close_upstream(io);
+int HttpHandler::connectUpstream() {
+    const char* key = NULL;
+    if (proxy_upstream->lb == LB_IpHash) {
+        key = ip;
+    } else if (proxy_upstream->lb == LB_UrlHash) {
+        key = req->path.c_str();
+    }
+    proxy_server = proxy_upstream->Select(key, &proxy_tried);
+    if (proxy_server == NULL) {
+        hlogw("upstream %s: no server available", proxy_upstream->name.c_str());
+        return SetError(ERR_SOCKET, HTTP_STATUS_BAD_GATEWAY);
+    }
+    ++proxy_server->conns;
+    proxy_host = proxy_server->host;
+    proxy_port = proxy_server->port;
+
+    // NOTE: tunnel can not be reused
+    bool reusable = proxy_upstream->keepalive_connections > 0 && !upgrade && req->method != HTTP_CONNECT;
+    if (reusable || proxy_cache) {
+        initProxyParser();
+    } else {
+        proxy_parser = NULL;
     }
+
+    hloop_t* loop = hevent_loop(io);
+    hio_t* upstream_io = reusable ? UpstreamConnPool::Get(loop, proxy_server->Key()) : NULL;
+    if (upstream_io) {
+        hevent_set_userdata(upstream_io, this);
+        hio_setup_upstream(io, upstream_io);
+        hio_setcb_close(upstream_io, HttpHandler::onProxyClose);
+        onProxyConnect(upstream_io);
+        return 0;
+    }
+
+    upstream_io = proxy_server->CreateSocket(loop);
+    if (upstream_io == NULL) {
+        releaseUpstreamServer();
+        return SetError(ERR_SOCKET, HTTP_STATUS_BAD_GATEWAY);
+    }
+    if (proxy_server->https) {
+        hio_enable_ssl(upstream_io);
+        hio_set_hostname(upstream_io, proxy_host.c_str());
+    }
+    hevent_set_userdata(upstream_io, this);
+    hio_setup_upstream(io, upstream_io);
+    hio_setcb_connect(upstream_io, HttpHandler::onProxyConnect);
+    hio_setcb_close(upstream_io, HttpHandler::onProxyClose);
+    if (service->proxy_connect_timeout > 0) {
+        hio_set_connect_timeout(upstream_io, service->proxy_connect_timeout);
+    }
+    if (service->proxy_read_timeout > 0) {
+        hio_set_read_timeout(io, service->proxy_read_timeout);
+    }
+    if (service->proxy_write_timeout > 0) {
+        hio_set_write_timeout(io, service->proxy_write_timeout);
+    }
+    // NOTE: wait upstream_io connected then start read
+    hio_read_stop(io);
+    hio_connect(upstream_io);
     return 0;
 }
 
+int HttpHandler::closeProxy() {
+    hio_t* upstream_io = io ? hio_get_upstream(io) : NULL;
+    proxy_connected = 0;
+    proxy_requests = 0;
+    if (upstream_io) {
+        // NOTE: detach, so that onProxyClose will not be called back
+        hevent_set_userdata(upstream_io, NULL);
+        hio_setup_upstream(io, NULL);
+        hio_close(upstream_io);
+    }
+    releaseUpstreamServer();
+    return 0;
+}
+
+void HttpHandler::releaseProxy(bool reuse) {
+    hio_t* upstream_io = io ? hio_get_upstream(io) : NULL;
+    proxy_connected = 0;
+    proxy_requests = 0;
+    if (upstream_io) {
+        hevent_set_userdata(upstream_io, NULL);
+        hio_setup_upstream(io, NULL);
+        hio_setcb_close(upstream_io, NULL);
+        hio_setcb_write(upstream_io, NULL);
+        if (!reuse || proxy_server == NULL ||
+            !UpstreamConnPool::Put(upstream_io, proxy_server->Key(),
+                proxy_upstream->keepalive_connections, proxy_upstream->keepalive_timeout)) {
+            hio_close(upstream_io);
+        }
+    }
+    releaseUpstreamServer();
+}
+
+void HttpHandler::initProxyParser() {
+    if (proxy_parser == NULL) {
+        proxy_parser.reset(HttpParser::New(HTTP_CLIENT, ::HTTP_V1));
+        proxy_resp = std::make_shared<HttpResponse>();
+    }
+}
+
+void HttpHandler::releaseUpstreamServer() {
+    if (proxy_server) {
+        --proxy_server->conns;
+        proxy_server = NULL;
+    }
+}
+
 int HttpHandler::sendProxyRequest() {
     if (!io || !proxy_connected) return -1;
 
+    http_method method = req->method;
+    http_headers headers;
+    if (proxy_cache) {
+        // NOTE: fetch the full entity for cache, client validators are checked by sendProxyCache
+        headers = req->headers;
+        if (method == HTTP_HEAD) req->method = HTTP_GET;
+        req->headers.erase("If-None-Match");
+        req->headers.erase("If-Modified-Since");
+        req->headers.erase("If-Range");
+        if (proxy_cache_entry) {
+            // revalidate stale entry
+            if (!proxy_cache_entry->etag.empty()) {
+                req->headers["If-None-Match"] = proxy_cache_entry->etag;
+            }
+            if (!proxy_cache_entry->last_modified.empty()) {
+                req->headers["If-Modified-Since"] = proxy_cache_entry->last_modified;
+            }
+        }
+    }
+
+    if (proxy_parser) {
+        if (proxy_requests > 0) {
+            // NOTE: pipelined requests, can not know which response belongs to which request,
+            // so relay the responses and never reuse this upstream connection.
+            proxy_parser = NULL;
+        } else {
+            if (proxy_cache) {
+                // NOTE: buffer the response body to store
+                proxy_resp->http_cb = NULL;
+            } else {
+                // NOTE: hook http_cb to not buffer the response body
+                proxy_resp->http_cb = [](HttpMessage*, http_parser_state, const char*, size_t) {};
+            }
+            proxy_parser->InitResponse(proxy_resp.get());
+            // NOTE: response to HEAD has no body
+            proxy_parser->SubmitRequest(req.get());
+        }
+    }
+    ++proxy_requests;
+    proxy_request_complete = parser->IsComplete();
+
     req->headers.erase("Host");
     req->FillHost(proxy_host.c_str(), proxy_port);
     req->headers.erase("Proxy-Connection");
-    req->headers["Connection"] = keepalive ? "keep-alive" : "close";
+    req->headers["Connection"] = (keepalive || proxy_parser) ? "keep-alive" : "close";
     req->headers["X-Real-IP"] = ip;
     // NOTE: send head + received body
     std::string msg = req->Dump(true, false) + req->body;
     // printf("%s\n", msg.c_str());
+    if (proxy_cache) {
+        // NOTE: keep request for Vary and conditional response
+        req->method = method;
+        req->headers.swap(headers);
+        hio_write_upstream(io, (void*)msg.c_str(), msg.size());
+        return msg.size();
+    }
     req->Reset();
 
     hio_write_upstream(io, (void*)msg.c_str(), msg.size());
@@ -1110,6 +1578,9 @@ void HttpHandler::onProxyConnect(hio_t* upstream_io) {
     hio_t* io = hio_get_upstream(upstream_io);
     assert(handler != NULL && io != NULL);
     handler->proxy_connected = 1;
+    if (handler->proxy_server) {
+        handler->proxy_server->OnSuccess();
+    }
 
     if (handler->req->method == HTTP_CONNECT) {
         // handler->resp->status_code = HTTP_STATUS_OK;
@@ -1124,21 +1595,111 @@ void HttpHandler::onProxyConnect(hio_t* upstream_io) {
 
     // NOTE: start recv request continue then upstream
     if (handler->upgrade) hio_setcb_read(io, hio_write_upstream);
-    hio_read_start(io);
+    // NOTE: proxy cache recv next request after response sent
+    if (!handler->proxy_cache) hio_read_start(io);
     // NOTE: start recv response then upstream
-    hio_setcb_read(upstream_io, hio_write_upstream);
+    hio_setcb_read(upstream_io, handler->proxy_upstream || handler->proxy_cache ?
+        HttpHandler::onProxyRecv : hio_write_upstream);
     hio_read_start(upstream_io);
 }
 
+void HttpHandler::onProxyRecv(hio_t* upstream_io, void* buf, int readbytes) {
+    HttpHandler* handler = (HttpHandler*)hevent_userdata(upstream_io);
+    if (handler && handler->proxy_cache) {
+        HttpParserPtr& proxy_parser = handler->proxy_parser;
+        int nfeed = proxy_parser->FeedRecvData((const char*)buf, readbytes);
+        if (nfeed != readbytes) {
+            hlogw("[%s:%d] upstream response parse error: %s", handler->ip, handler->port,
+                proxy_parser->StrError(proxy_parser->GetError()));
+            handler->releaseProxy(false);
+            handler->onProxyCacheError(HTTP_STATUS_BAD_GATEWAY);
+            return;
+        }
+        if (!proxy_parser->IsComplete()) return;
+        handler->releaseProxy(handler->proxy_resp->IsKeepAlive() && hio_write_is_complete(upstream_io));
+        handler->onProxyCacheComplete();
+        return;
+    }
+    if (handler == NULL || handler->proxy_parser == NULL) {
+        hio_write_upstream(upstream_io, buf, readbytes);
+        return;
+    }
+
+    HttpParserPtr& proxy_parser = handler->proxy_parser;
+    int nfeed = proxy_parser->FeedRecvData((const char*)buf, readbytes);
+    if (nfeed != readbytes || !proxy_parser->IsComplete()) {
+        if (nfeed != readbytes) proxy_parser = NULL;
+        hio_write_upstream(upstream_io, buf, readbytes);
+        return;
+    }
+
+    // response complete
+    if (--handler->proxy_requests > 0 || !handler->proxy_request_complete) {
+        // NOTE: request body is still sending, never reuse this upstream connection.
+        proxy_parser = NULL;
+        hio_write_upstream(upstream_io, buf, readbytes);
+        return;
+    }
+    hio_t* io = handler->io;
+    bool reuse = handler->proxy_resp->IsKeepAlive() && hio_write_is_complete(upstream_io);
+    bool keepalive = handler->keepalive;
+    hio_write(io, buf, readbytes);
+    handler->releaseProxy(reuse);
+    if (keepalive) {
+        hio_read_start(io);
+    } else {
+        hio_close(io);
+    }
+}
+
 void HttpHandler::onProxyClose(hio_t* upstream_io) {
     // printf("onProxyClose\n");
     HttpHandler* handler = (HttpHandler*)hevent_userdata(upstream_io);
     if (handler == NULL) return;
+    bool connected = handler->proxy_connected;
     handler->proxy_connected = 0;
+    handler->proxy_requests = 0;
 
     hevent_set_userdata(upstream_io, NULL);
 
     int error = hio_error(upstream_io);
+    UpstreamServerPtr server = handler->proxy_server;
+    if (server && !connected) {
+        // passive health check, then try next server
+        handler->releaseUpstreamServer();
+        server->OnFailure(gethrtime_us() / 1000);
+        hlogw("[%s:%d] upstream %s:%d connect failed: %d", handler->ip, handler->port,
+            server->host.c_str(), server->port, error);
+        hio_t* io = handler->io;
+        hio_setup_upstream(upstream_io, NULL);
+        handler->proxy_tried.push_back(server.get());
+        if ((int)handler->proxy_tried.size() <= handler->proxy_upstream->retries &&
+            handler->connectUpstream() == 0) {
+            return;
+        }
+        http_status status_code = error == ETIMEDOUT ? HTTP_STATUS_GATEWAY_TIMEOUT : HTTP_STATUS_BAD_GATEWAY;
+        if (handler->proxy_cache) {
+            handler->error = 0;
+            handler->onProxyCacheError(status_code);
+            return;
+        }
+        handler->SendHttpStatusResponse(status_code);
+        hio_close(io);
+        return;
+    }
+    handler->releaseUpstreamServer();
+
+    if (handler->proxy_cache) {
+        hio_setup_upstream(upstream_io, NULL);
+        // NOTE: response without Content-Length ends by EOF
+        if (connected && handler->proxy_parser && handler->proxy_parser->IsEof()) {
+            handler->onProxyCacheComplete();
+        } else {
+            handler->onProxyCacheError(error == ETIMEDOUT ? HTTP_STATUS_GATEWAY_TIMEOUT : HTTP_STATUS_BAD_GATEWAY);
+        }
+        return;
+    }
+
     if (error == ETIMEDOUT) {
         handler->SendHttpStatusResponse(HTTP_STATUS_GATEWAY_TIMEOUT);
     }
@@ -1146,3 +1707,165 @@ void HttpHandler::onProxyClose(hio_t* upstream_io) {
     handler->error = error;
     hio_close_upstream(upstream_io);
 }
+
+//------------------proxy cache--------------------------------------
+int HttpHandler::proxyCacheHandler() {
+    if (!io) return HTTP_STATUS_BAD_GATEWAY;
+    HttpProxyCache* cache = service->proxy_cache.get();
+    proxy_cache_key = req->url;
+    HttpCacheEntryPtr entry = cache->Get(proxy_cache_key, req.get());
+    if (entry == NULL) {
+        ++cache->stats.misses;
+    } else if (entry->IsFresh(time(NULL)) && !HttpProxyCache::NeedRevalidate(req.get())) {
+        ++cache->stats.hits;
+        return sendProxyCache(entry, HTTP_CACHE_HIT);
+    } else {
+        ++cache->stats.expired;
+        // NOTE: revalidate if has validator, serve stale if upstream failed
+        proxy_cache_entry = entry;
+    }
+
+    // proxy_cache_lock: concurrent misses of the same key wait for one upstream fetch
+    EventLoop* loop = currentThreadEventLoop;
+    if (loop) {
+        HttpResponseWriterPtr writer = this->writer;
+        HttpHandler* handler = this;
+        bool waiting = cache->Wait(proxy_cache_key, [loop, writer, handler](const HttpCacheEntryPtr& entry) {
+            loop->runInLoop([writer, handler, entry]() {
+                // NOTE: handler has been deleted if disconnected
+                if (!writer->isConnected()) return;
+                if (entry) {
+                    ++handler->service->proxy_cache->stats.coalesced;
+                    handler->endProxyCache(entry, HTTP_CACHE_HIT);
+                } else if (handler->fetchProxyCache() != 0) {
+                    handler->onProxyCacheError(HTTP_STATUS_BAD_GATEWAY);
+                }
+            });
+        });
+        if (waiting) {
+            // NOTE: recv next request after response sent
+            hio_read_stop(io);
+            return HTTP_STATUS_NEXT;
+        }
+        proxy_cache_leader = 1;
+    }
+
+    if (fetchProxyCache() != 0) {
+        if (proxy_cache_leader) {
+            proxy_cache_leader = 0;
+            cache->Complete(proxy_cache_key, NULL);
+        }
+        if (proxy_cache_entry) {
+            return sendProxyCache(proxy_cache_entry, HTTP_CACHE_STALE);
+        }
+        return HTTP_STATUS_BAD_GATEWAY;
+    }
+    return HTTP_STATUS_NEXT;
+}
+
+int HttpHandler::fetchProxyCache() {
+    int ret = connectProxy(req->url);
+    if (ret != 0) {
+        // NOTE: respond 502 instead of closing the connection
+        error = 0;
+    }
+    return ret;
+}
+
+int HttpHandler::sendProxyCache(const HttpCacheEntryPtr& entry, http_cache_status status) {
+    HttpResponse* pResp = resp.get();
+    proxy_cache_entry = entry;
+    pResp->status_code = (http_status)entry->status_code;
+    for (const auto& header : entry->headers) {
+        pResp->headers[header.first] = header.second;
+    }
+    time_t age = time(NULL) - entry->date;
+    if (age > 0) {
+        pResp->headers["Age"] = hv::to_string(age);
+    }
+    pResp->headers["X-Cache-Status"] = http_cache_status_str(status);
+
+    if (entry->NotModified(req.get())) {
+        pResp->status_code = HTTP_STATUS_NOT_MODIFIED;
+    } else if (req->method == HTTP_HEAD) {
+        pResp->headers["Content-Length"] = hv::to_string(entry->size());
+    } else if (pResp->status_code >= 400) {
+        // NOTE: copy body, so that error handler will not replace it
+        pResp->body.assign(entry->data(), entry->size());
+    } else {
+        // NOTE: no copy entry body, more efficient
+        pResp->content = (void*)entry->data();
+        pResp->content_length = entry->size();
+    }
+    return pResp->status_code;
+}
+
+void HttpHandler::endProxyCache(const HttpCacheEntryPtr& entry, http_cache_status status) {
+    sendProxyCache(entry, status);
+    writer->End();
+    // NOTE: recv next request
+    if (writer->isConnected()) hio_read_start(io);
+}
+
+void HttpHandler::onProxyCacheComplete() {
+    HttpProxyCache* cache = service->proxy_cache.get();
+    HttpResponse* upstream_resp = proxy_resp.get();
+    HttpCacheEntryPtr entry;
+    http_cache_status status = HTTP_CACHE_MISS;
+    if (proxy_cache_entry && upstream_resp->status_code == HTTP_STATUS_NOT_MODIFIED) {
+        cache->Refresh(proxy_cache_key, proxy_cache_entry, upstream_resp);
+        entry = proxy_cache_entry;
+        status = HTTP_CACHE_REVALIDATED;
+        ++cache->stats.revalidated;
+    } else {
+        if (proxy_cache_entry) status = HTTP_CACHE_EXPIRED;
+        entry = cache->Store(proxy_cache_key, req.get(), upstream_resp);
+    }
+    if (proxy_cache_leader) {
+        proxy_cache_leader = 0;
+        cache->Complete(proxy_cache_key, entry);
+    }
+    if (entry) {
+        endProxyCache(entry, status);
+        return;
+    }
+
+    // not cacheable: relay upstream response
+    HttpResponse* pResp = resp.get();
+    pResp->status_code = upstream_resp->status_code;
+    for (const auto& header : upstream_resp->headers) {
+        if (!HttpProxyCache::IsHopByHopHeader(header.first)) {
+            pResp->headers[header.first] = header.second;
+        }
+    }
+    pResp->cookies = upstream_resp->cookies;
+    pResp->headers["X-Cache-Status"] = http_cache_status_str(status);
+    if (req->method == HTTP_HEAD) {
+        pResp->headers["Content-Length"] = hv::to_string(upstream_resp->body.size());
+    } else {
+        pResp->body.swap(upstream_resp->body);
+    }
+    writer->End();
+    if (writer->isConnected()) hio_read_start(io);
+}
+
+void HttpHandler::onProxyCacheError(http_status status_code) {
+    if (proxy_cache_leader) {
+        proxy_cache_leader = 0;
+        service->proxy_cache->Complete(proxy_cache_key, NULL);
+    }
+    // proxy_cache_use_stale error
+    if (proxy_cache_entry) {
+        endProxyCache(proxy_cache_entry, HTTP_CACHE_STALE);
+        return;
+    }
+    resp->status_code = status_code;
+    if (service->errorHandler) {
+        customHttpHandler(service->errorHandler);
+    } else {
+        resp->content_type = TEXT_HTML;
+        make_http_status_page(resp->status_code, resp->body);
+    }
+    writer->End();
+    if (writer->isConnected()) hio_read_start(io);
+}
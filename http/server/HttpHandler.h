@@ -40,6 +40,10 @@ public:
     unsigned proxy_connected    :1;
     unsigned forward_proxy      :1;
     unsigned reverse_proxy      :1;
+    unsigned proxy_request_complete :1;
+    unsigned proxy_cache        :1;
+    unsigned proxy_cache_leader :1;
+    unsigned idle_release       :1; // shrink buffers in Reset
 
     // peeraddr
     char                    ip[64];
@@ -58,6 +62,15 @@ public:
     HttpParserPtr           parser;
     HttpContextPtr          ctx;
     http_handler*           api_handler;
+    const std::string*      api_route;
+    // run on worker pool after HandleHttpRequest
+    const http_handler*     pool_handler;
+    // for metrics
+    uint64_t                begin_hrtime;
+    // admitted request in flight, moved to writer->onend by setMetricsHook
+    hv::HttpAdmissionTicketPtr admission_ticket;
+    // Accept-Encoding => Content-Encoding
+    http_content_encoding   content_encoding;
 
     // for GetSendData
     std::string             header;
@@ -81,6 +94,21 @@ public:
     // for proxy
     std::string             proxy_host;
     int                     proxy_port;
+    // for upstream group
+    hv::UpstreamGroupPtr    proxy_upstream;
+    hv::UpstreamServerPtr   proxy_server;
+    std::vector<hv::UpstreamServer*> proxy_tried;
+    // parse upstream response to know when upstream connection can be reused
+    HttpParserPtr           proxy_parser;
+    HttpResponsePtr         proxy_resp;
+    int                     proxy_requests; // requests waiting for response
+#ifndef WITHOUT_HTTP_CONTENT
+    // for streaming multipart/form-data upload
+    std::shared_ptr<hv::MultipartParser> upload_parser;
+#endif
+    // for proxy cache
+    std::string             proxy_cache_key;
+    hv::HttpCacheEntryPtr   proxy_cache_entry; // stale entry to revalidate, or entry being sent
 
     HttpHandler(hio_t* io = NULL);
     ~HttpHandler();
@@ -147,6 +175,12 @@ private:
     // Expect: 100-continue
     void  handleExpect100();
     void  addResponseHeaders();
+    // multipart/form-data => MultipartParser
+    bool  startUpload();
+    // metrics and admission: observe latency when response is ended
+    void  setMetricsHook();
+    // HttpAdmission: false if rejected
+    bool  admitRequest();
 
     // http_cb
     void onHeadersComplete();
@@ -160,6 +194,15 @@ private:
     int defaultErrorHandler();
     int customHttpHandler(const http_handler& handler);
     int invokeHttpHandler(const http_handler* handler);
+    // status -> errorHandler -> postprocessor -> compression
+    int  postprocessHttpRequest(int status_code);
+    // SendHttpResponse, then call writer->onend if hook
+    void sendHandledResponse(bool hook);
+    void logAccess();
+    // http_exec_policy::POOL
+    void offloadHttpHandler();
+    // on IO thread when the pooled handler returned
+    void completeHttpHandler(int status_code);
 
     // sendfile
     int  openFile(const char* filepath);
@@ -177,9 +220,22 @@ private:
     int handleForwardProxy();
     int handleReverseProxy();
     int connectProxy(const std::string& url);
+    int connectUpstream();
     int closeProxy();
+    // detach upstream_io, then put it back to UpstreamConnPool or close it
+    void releaseProxy(bool reuse);
+    void releaseUpstreamServer();
     int sendProxyRequest();
+    void initProxyParser();
+    // proxy cache
+    int proxyCacheHandler();
+    int fetchProxyCache();
+    int sendProxyCache(const hv::HttpCacheEntryPtr& entry, hv::http_cache_status status);
+    void onProxyCacheComplete();
+    void onProxyCacheError(http_status status_code);
+    void endProxyCache(const hv::HttpCacheEntryPtr& entry, hv::http_cache_status status);
     static void onProxyConnect(hio_t* upstream_io);
+    static void onProxyRecv(hio_t* upstream_io, void* buf, int readbytes);
     static void onProxyClose(hio_t* upstream_io);
 };
 
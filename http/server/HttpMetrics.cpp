@@ -0,0 +1,215 @@
+#include "HttpMetrics.h"
+
+#include <stddef.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "hdef.h"
+#include "hstring.h"
+
+namespace hv {
+
+struct RouteMetrics {
+    std::string         method;
+    std::string         route;
+    // 1xx ~ 5xx
+    uint64_t            codes[6];
+    hloop_histogram_t   latency;
+};
+
+// one per thread
+struct MetricsShard {
+    // locked by owner thread only when adding a route, and by Dump.
+    std::mutex  mutex;
+    std::map<std::pair<int, const std::string*>, RouteMetrics> routes;
+};
+
+static std::mutex                                   s_shards_mutex;
+static std::vector<std::shared_ptr<MetricsShard>>   s_shards;
+static const std::string                            s_unrouted("*");
+
+static MetricsShard* thread_shard() {
+    static thread_local MetricsShard* shard = NULL;
+    if (shard == NULL) {
+        std::shared_ptr<MetricsShard> ptr = std::make_shared<MetricsShard>();
+        std::lock_guard<std::mutex> locker(s_shards_mutex);
+        s_shards.push_back(ptr);
+        shard = ptr.get();
+    }
+    return shard;
+}
+
+void HttpMetrics::ObserveRequest(http_method method, const std::string* route, int status_code, uint64_t us) {
+    if (route == NULL) route = &s_unrouted;
+    MetricsShard* shard = thread_shard();
+    std::pair<int, const std::string*> key((int)method, route);
+    auto iter = shard->routes.find(key);
+    if (iter == shard->routes.end()) {
+        std::lock_guard<std::mutex> locker(shard->mutex);
+        RouteMetrics& metrics = shard->routes[key];
+        memset(metrics.codes, 0, sizeof(metrics.codes));
+        memset(&metrics.latency, 0, sizeof(metrics.latency));
+        metrics.method = http_method_str(method);
+        metrics.route = *route;
+        iter = shard->routes.find(key);
+    }
+    RouteMetrics& metrics = iter->second;
+    int code_class = status_code / 100;
+    if (code_class < 1 || code_class > 5) code_class = 0;
+    ++metrics.codes[code_class];
+    hloop_histogram_observe(&metrics.latency, us);
+}
+
+static void dump_histogram(std::string& out, const char* name, const std::string& labels, const hloop_histogram_t& histogram) {
+    char buf[256];
+    uint64_t count = 0;
+    for (int i = 0; i < HLOOP_HISTOGRAM_BUCKETS; ++i) {
+        count += histogram.buckets[i];
+        snprintf(buf, sizeof(buf), "%s_bucket{%s%sle=\"%g\"} %llu\n", name,
+                labels.c_str(), labels.empty() ? "" : ",",
+                (double)(1ULL << i) / 1000000, (unsigned long long)count);
+        out += buf;
+    }
+    // NOTE: buckets are read without lock, use their sum as count to keep them consistent.
+    count += histogram.buckets[HLOOP_HISTOGRAM_BUCKETS];
+    snprintf(buf, sizeof(buf), "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name,
+            labels.c_str(), labels.empty() ? "" : ",", (unsigned long long)count);
+    out += buf;
+    snprintf(buf, sizeof(buf), "%s_sum{%s} %.6f\n", name, labels.c_str(), (double)histogram.sum / 1000000);
+    out += buf;
+    snprintf(buf, sizeof(buf), "%s_count{%s} %llu\n", name, labels.c_str(), (unsigned long long)count);
+    out += buf;
+}
+
+static void dump_header(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP "; out += name; out += " "; out += help; out += "\n";
+    out += "# TYPE "; out += name; out += " "; out += type; out += "\n";
+}
+
+struct LoopSnapshot {
+    long                tid;
+    uint32_t            nios;
+    uint32_t            ntimers;
+    hloop_metrics_t     metrics;
+};
+
+static void snapshot_loop(hloop_t* loop, hloop_metrics_t* metrics, void* userdata) {
+    std::vector<LoopSnapshot>* loops = (std::vector<LoopSnapshot>*)userdata;
+    LoopSnapshot snapshot;
+    snapshot.tid = hloop_tid(loop);
+    snapshot.nios = hloop_nios(loop);
+    snapshot.ntimers = hloop_ntimers(loop);
+    memcpy(&snapshot.metrics, metrics, sizeof(hloop_metrics_t));
+    loops->push_back(snapshot);
+}
+
+void HttpMetrics::DumpLoops(std::string& out) {
+    std::vector<LoopSnapshot> loops;
+    hloop_metrics_foreach(snapshot_loop, &loops);
+    if (loops.empty()) return;
+
+    struct Histogram {
+        const char* name;
+        const char* help;
+        size_t      offset;
+    } histograms[] = {
+        { "hv_loop_poll_wait_seconds", "Time blocked in poll.", offsetof(hloop_metrics_t, poll_wait) },
+        { "hv_loop_callback_seconds", "Time spent in each event callback.", offsetof(hloop_metrics_t, callback) },
+        { "hv_loop_lag_seconds", "Time from event ready or timer due to its callback.", offsetof(hloop_metrics_t, lag) },
+    };
+    for (auto& h : histograms) {
+        dump_header(out, h.name, "histogram", h.help);
+        for (auto& loop : loops) {
+            std::string labels = "loop=\"" + hv::to_string(loop.tid) + "\"";
+            dump_histogram(out, h.name, labels, *(hloop_histogram_t*)((char*)&loop.metrics + h.offset));
+        }
+    }
+
+#define LOOP_VALUES(XX) \
+    XX("hv_loop_iterations_total",      "counter", "Loop iterations.",                      m.loops)                \
+    XX("hv_loop_accepts_total",         "counter", "Accepted connections.",                 m.accepts)              \
+    XX("hv_loop_connects_total",        "counter", "Connected outgoing connections.",       m.connects)             \
+    XX("hv_loop_closes_total",          "counter", "Closed ios.",                           m.closes)               \
+    XX("hv_loop_reads_total",           "counter", "Successful reads.",                     m.reads)                \
+    XX("hv_loop_read_bytes_total",      "counter", "Bytes read.",                           m.read_bytes)           \
+    XX("hv_loop_read_eagains_total",    "counter", "Reads returned EAGAIN.",                m.read_eagains)         \
+    XX("hv_loop_writes_total",          "counter", "Successful writes.",                    m.writes)               \
+    XX("hv_loop_write_bytes_total",     "counter", "Bytes written.",                        m.write_bytes)          \
+    XX("hv_loop_write_eagains_total",   "counter", "Writes returned EAGAIN.",               m.write_eagains)        \
+    XX("hv_loop_custom_events_total",   "counter", "Handled custom events.",                m.custom_events)        \
+    XX("hv_loop_stalls_total",          "counter", "Callbacks reported by watchdog.",       m.stalls)               \
+    XX("hv_loop_poll_ctls_total",       "counter", "epoll_ctl calls.",                      m.poll_ctls)            \
+    XX("hv_loop_pending_custom_events", "gauge",   "Custom events posted but not handled.", (int64_t)(m.custom_events_posted - m.custom_events)) \
+    XX("hv_loop_write_queue_bytes",     "gauge",   "Bytes waiting in write queues.",        MAX(m.write_queue_bytes, 0)) \
+    XX("hv_loop_ios",                   "gauge",   "Number of ios.",                        loop.nios)              \
+    XX("hv_loop_timers",                "gauge",   "Number of timers.",                     loop.ntimers)           \
+
+    char buf[256];
+#define XX(name, type, help, value) \
+    dump_header(out, name, type, help); \
+    for (auto& loop : loops) { \
+        const hloop_metrics_t& m = loop.metrics; \
+        snprintf(buf, sizeof(buf), "%s{loop=\"%ld\"} %lld\n", name, loop.tid, (long long)(value)); \
+        out += buf; \
+        (void)m; \
+    }
+    LOOP_VALUES(XX)
+#undef XX
+#undef LOOP_VALUES
+}
+
+void HttpMetrics::DumpRoutes(std::string& out) {
+    // merge shards
+    std::map<std::pair<std::string, std::string>, RouteMetrics> routes;
+    {
+        std::lock_guard<std::mutex> locker(s_shards_mutex);
+        for (auto& shard : s_shards) {
+            std::lock_guard<std::mutex> shard_locker(shard->mutex);
+            for (auto& pair : shard->routes) {
+                const RouteMetrics& from = pair.second;
+                auto iter = routes.find(std::make_pair(from.route, from.method));
+                if (iter == routes.end()) {
+                    routes[std::make_pair(from.route, from.method)] = from;
+                    continue;
+                }
+                RouteMetrics& to = iter->second;
+                for (int i = 0; i < 6; ++i) {
+                    to.codes[i] += from.codes[i];
+                }
+                for (int i = 0; i <= HLOOP_HISTOGRAM_BUCKETS; ++i) {
+                    to.latency.buckets[i] += from.latency.buckets[i];
+                }
+                to.latency.count += from.latency.count;
+                to.latency.sum += from.latency.sum;
+            }
+        }
+    }
+    if (routes.empty()) return;
+
+    const char* name = "hv_http_request_duration_seconds";
+    dump_header(out, name, "histogram", "HTTP request latency by route, until the response is sent.");
+    for (auto& pair : routes) {
+        const RouteMetrics& metrics = pair.second;
+        std::string labels = "method=\"" + metrics.method + "\",route=\"" + metrics.route + "\"";
+        dump_histogram(out, name, labels, metrics.latency);
+    }
+
+    name = "hv_http_requests_total";
+    dump_header(out, name, "counter", "HTTP requests by route and status class.");
+    static const char* code_classes[6] = { "other", "1xx", "2xx", "3xx", "4xx", "5xx" };
+    char buf[512];
+    for (auto& pair : routes) {
+        const RouteMetrics& metrics = pair.second;
+        for (int i = 0; i < 6; ++i) {
+            if (metrics.codes[i] == 0) continue;
+            snprintf(buf, sizeof(buf), "%s{method=\"%s\",route=\"%s\",code=\"%s\"} %llu\n", name,
+                    metrics.method.c_str(), metrics.route.c_str(), code_classes[i],
+                    (unsigned long long)metrics.codes[i]);
+            out += buf;
+        }
+    }
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef HV_HTTP_METRICS_H_
+#define HV_HTTP_METRICS_H_
+
+/*
+ * Prometheus text format of loop and route metrics
+ *
+ * HttpService service;
+ * service.EnableMetrics("/metrics");
+ *
+ * @see hloop_enable_metrics
+ *
+ * Route latency is observed into a shard owned by the calling thread,
+ * shards and loops are only summed up when /metrics is scraped.
+ *
+ */
+
+#include <string>
+
+#include "hexport.h"
+#include "hloop.h"
+#include "httpdef.h"
+
+namespace hv {
+
+class HV_EXPORT HttpMetrics {
+public:
+    // @param route: path pattern of HttpService::pathHandlers, NULL means not routed to an API.
+    // NOTE: route is used as key, it must outlive the process.
+    static void ObserveRequest(http_method method, const std::string* route, int status_code, uint64_t us);
+
+    static void DumpLoops(std::string& out);
+    static void DumpRoutes(std::string& out);
+    static std::string Dump() {
+        std::string out;
+        DumpLoops(out);
+        DumpRoutes(out);
+        return out;
+    }
+};
+
+}
+
+#endif // HV_HTTP_METRICS_H_
@@ -0,0 +1,502 @@
+#include "HttpProxyCache.h"
+
+#include "hplatform.h"
+#include "hbase.h"
+#include "htime.h"
+#include "hlog.h"
+#include "hthread.h"
+#include "hstring.h"
+#include "hthreadpool.h"
+
+#ifdef OS_UNIX
+#include <sys/mman.h>
+// NOTE: disk tier needs mmap
+#define PROXY_CACHE_DISK_TIER
+#endif
+
+namespace hv {
+
+// Cache-Control: max-age=60, no-cache => true, *seconds = 60
+static bool cache_control_find(const std::string& cache_control, const char* directive, int* seconds = NULL) {
+    size_t len = strlen(directive);
+    for (const auto& item : hv::split(cache_control, ',')) {
+        std::string token = hv::trim(item);
+        if (strnicmp(token.c_str(), directive, len) != 0) continue;
+        if (token.size() == len) return true;
+        if (token[len] == '=') {
+            if (seconds) {
+                const char* value = token.c_str() + len + 1;
+                if (*value == '"') ++value;
+                *seconds = atoi(value);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Sun, 06 Nov 1994 08:49:37 GMT => time_t
+static time_t parse_http_date(const char* str) {
+    char weekday[16] = {0};
+    char month[16] = {0};
+    int day = 0, year = 0, hour = 0, min = 0, sec = 0;
+    if (sscanf(str, "%15[^,], %d %15s %d %d:%d:%d", weekday, &day, month, &year, &hour, &min, &sec) != 7) {
+        return 0;
+    }
+    int mon = month_atoi(month);
+    if (mon <= 0) return 0;
+    // days from civil, UTC
+    int y = year - (mon <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (mon + (mon > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long long days = (long long)era * 146097 + doe - 719468;
+    return (time_t)(days * 86400 + hour * 3600 + min * 60 + sec);
+}
+
+bool HttpProxyCache::IsHopByHopHeader(const std::string& name) {
+    static const char* hop_by_hop_headers[] = {
+        "Connection",
+        "Keep-Alive",
+        "Proxy-Connection",
+        "Proxy-Authenticate",
+        "Transfer-Encoding",
+        "Trailer",
+        "Upgrade",
+        "Content-Length",
+        "Age",
+    };
+    for (size_t i = 0; i < ARRAY_SIZE(hop_by_hop_headers); ++i) {
+        if (stricmp(name.c_str(), hop_by_hop_headers[i]) == 0) return true;
+    }
+    return false;
+}
+
+// @return freshness lifetime in seconds, -1 if not specified
+static int freshness_lifetime(HttpResponse* resp, time_t date) {
+    std::string cache_control = resp->GetHeader("Cache-Control");
+    int seconds = 0;
+    if (cache_control_find(cache_control, "no-cache")) return 0;
+    if (cache_control_find(cache_control, "s-maxage", &seconds)) return seconds;
+    if (cache_control_find(cache_control, "max-age", &seconds)) return seconds;
+    auto iter = resp->headers.find("Expires");
+    if (iter != resp->headers.end()) {
+        time_t expires = parse_http_date(iter->second.c_str());
+        return expires > date ? (int)(expires - date) : 0;
+    }
+    return -1;
+}
+
+const char* http_cache_status_str(enum http_cache_status status) {
+    switch (status) {
+    case HTTP_CACHE_BYPASS:      return "BYPASS";
+    case HTTP_CACHE_MISS:        return "MISS";
+    case HTTP_CACHE_HIT:         return "HIT";
+    case HTTP_CACHE_EXPIRED:     return "EXPIRED";
+    case HTTP_CACHE_REVALIDATED: return "REVALIDATED";
+    case HTTP_CACHE_STALE:       return "STALE";
+    default:                     return "UNKNOWN";
+    }
+}
+
+//------------------HttpCacheEntry--------------------------------------
+HttpCacheEntry::HttpCacheEntry()
+    : status_code(HTTP_STATUS_OK)
+    , date(0)
+    , expires(0)
+    , mapped(NULL)
+    , mapped_size(0)
+{}
+
+HttpCacheEntry::~HttpCacheEntry() {
+#ifdef OS_UNIX
+    if (mapped) {
+        munmap(mapped, mapped_size);
+        mapped = NULL;
+    }
+#endif
+}
+
+bool HttpCacheEntry::MatchVary(HttpRequest* req) const {
+    for (size_t i = 0; i < vary_names.size(); ++i) {
+        if (req->GetHeader(vary_names[i].c_str()) != vary_values[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool HttpCacheEntry::NotModified(HttpRequest* req) const {
+    if (status_code != HTTP_STATUS_OK) return false;
+    auto iter = req->headers.find("If-None-Match");
+    if (iter != req->headers.end()) {
+        if (etag.empty()) return false;
+        // W/"xxx" matches "xxx" in weak comparison
+        const char* strong_etag = strncmp(etag.c_str(), "W/", 2) == 0 ? etag.c_str() + 2 : etag.c_str();
+        for (const auto& item : hv::split(iter->second, ',')) {
+            std::string tag = hv::trim(item);
+            if (tag == "*") return true;
+            const char* strong_tag = strncmp(tag.c_str(), "W/", 2) == 0 ? tag.c_str() + 2 : tag.c_str();
+            if (strcmp(strong_tag, strong_etag) == 0) return true;
+        }
+        return false;
+    }
+    iter = req->headers.find("If-Modified-Since");
+    if (iter != req->headers.end()) {
+        return !last_modified.empty() && iter->second == last_modified;
+    }
+    return false;
+}
+
+//------------------HttpProxyCacheStats--------------------------------------
+HttpProxyCacheStats::HttpProxyCacheStats()
+    : hits(0)
+    , misses(0)
+    , expired(0)
+    , revalidated(0)
+    , bypasses(0)
+    , coalesced(0)
+    , stores(0)
+    , evictions(0)
+    , memory_size(0)
+    , disk_size(0)
+{}
+
+double HttpProxyCacheStats::HitRatio() const {
+    uint64_t lookups = hits + misses + expired;
+    if (lookups == 0) return 0;
+    return (double)(hits + revalidated + coalesced) / lookups;
+}
+
+std::string HttpProxyCacheStats::Dump() const {
+    return hv::asprintf("{\"hits\":%llu,\"misses\":%llu,\"expired\":%llu,\"revalidated\":%llu,"
+        "\"bypasses\":%llu,\"coalesced\":%llu,\"stores\":%llu,\"evictions\":%llu,"
+        "\"memory_size\":%llu,\"disk_size\":%llu,\"hit_ratio\":%.4f}",
+        (unsigned long long)hits, (unsigned long long)misses,
+        (unsigned long long)expired, (unsigned long long)revalidated,
+        (unsigned long long)bypasses, (unsigned long long)coalesced,
+        (unsigned long long)stores, (unsigned long long)evictions,
+        (unsigned long long)memory_size, (unsigned long long)disk_size,
+        HitRatio());
+}
+
+//------------------HttpProxyCache--------------------------------------
+HttpProxyCache::HttpProxyCache(size_t max_memory_size, int shards)
+    : max_memory_size(max_memory_size)
+    , max_disk_size(DEFAULT_PROXY_CACHE_MAX_DISK_SIZE)
+    , max_memory_object_size(DEFAULT_PROXY_CACHE_MEMORY_OBJECT_SIZE)
+    , max_disk_pending_size(DEFAULT_PROXY_CACHE_MAX_DISK_PENDING_SIZE)
+    , max_object_size(DEFAULT_PROXY_CACHE_MAX_OBJECT_SIZE)
+    , default_ttl(0)
+    , file_seq_(0)
+    , disk_pending_size_(0)
+    , disk_writer_(new HThreadPool(1, 1))
+{
+    if (shards <= 0) shards = 1;
+    for (int i = 0; i < shards; ++i) {
+        Shard* s = new Shard;
+        s->memory_size = 0;
+        s->disk_size = 0;
+        shards_.emplace_back(s);
+    }
+}
+
+HttpProxyCache::~HttpProxyCache() {
+    // NOTE: pending writes are dropped
+    disk_writer_->stop();
+    Clear();
+}
+
+bool HttpProxyCache::IsCacheableRequest(HttpRequest* req) {
+    if (req->method != HTTP_GET && req->method != HTTP_HEAD) return false;
+    if (req->headers.find("Authorization") != req->headers.end()) return false;
+    if (req->headers.find("Range") != req->headers.end()) return false;
+    auto iter = req->headers.find("Cache-Control");
+    if (iter != req->headers.end() && cache_control_find(iter->second, "no-store")) return false;
+    return true;
+}
+
+bool HttpProxyCache::NeedRevalidate(HttpRequest* req) {
+    auto iter = req->headers.find("Cache-Control");
+    if (iter != req->headers.end()) {
+        int max_age = -1;
+        if (cache_control_find(iter->second, "no-cache")) return true;
+        if (cache_control_find(iter->second, "max-age", &max_age) && max_age == 0) return true;
+    }
+    iter = req->headers.find("Pragma");
+    return iter != req->headers.end() && cache_control_find(iter->second, "no-cache");
+}
+
+HttpProxyCache::Shard& HttpProxyCache::shard(const std::string& key) {
+    return *shards_[hv_hash(key.data(), key.size()) % shards_.size()];
+}
+
+HttpCacheEntryPtr HttpProxyCache::Get(const std::string& key, HttpRequest* req) {
+    Shard& s = shard(key);
+    std::lock_guard<std::mutex> locker(s.mutex_);
+    auto iter = s.entries.find(key);
+    if (iter == s.entries.end()) return NULL;
+    // LRU: move to front
+    s.lru.splice(s.lru.begin(), s.lru, iter->second);
+    const HttpCacheEntryPtr& entry = iter->second->second;
+    return entry->MatchVary(req) ? entry : NULL;
+}
+
+HttpCacheEntryPtr HttpProxyCache::Store(const std::string& key, HttpRequest* req, HttpResponse* resp) {
+    switch (resp->status_code) {
+    case HTTP_STATUS_OK:
+    case HTTP_STATUS_NON_AUTHORITATIVE_INFORMATION:
+    case HTTP_STATUS_MOVED_PERMANENTLY:
+    case HTTP_STATUS_NOT_FOUND:
+    case HTTP_STATUS_GONE:
+        break;
+    default:
+        return NULL;
+    }
+    std::string cache_control = resp->GetHeader("Cache-Control");
+    if (cache_control_find(cache_control, "no-store") ||
+        cache_control_find(cache_control, "private")) {
+        return NULL;
+    }
+    if (!resp->cookies.empty()) return NULL;
+    std::string vary = resp->GetHeader("Vary");
+    if (vary.find('*') != std::string::npos) return NULL;
+
+    size_t body_size = resp->body.size();
+#ifdef PROXY_CACHE_DISK_TIER
+    bool to_disk = body_size > max_memory_object_size && !disk_path.empty() && max_disk_size > 0;
+#else
+    bool to_disk = false;
+#endif
+    size_t budget = to_disk ? max_disk_size : max_memory_size;
+    if (body_size > max_object_size || body_size > budget / shards_.size()) return NULL;
+    if (to_disk && disk_pending_size_ + body_size > max_disk_pending_size) {
+        hlogw("proxy cache: disk writer is busy, %s not cached", key.c_str());
+        return NULL;
+    }
+
+    time_t now = time(NULL);
+    time_t date = 0;
+    auto iter = resp->headers.find("Date");
+    if (iter != resp->headers.end()) date = parse_http_date(iter->second.c_str());
+    if (date <= 0 || date > now) date = now;
+    int lifetime = freshness_lifetime(resp, date);
+    if (lifetime < 0) lifetime = default_ttl;
+    int age = atoi(resp->GetHeader("Age").c_str());
+    if (age > 0) lifetime -= age;
+
+    HttpCacheEntryPtr entry = std::make_shared<HttpCacheEntry>();
+    entry->etag = resp->GetHeader("Etag");
+    entry->last_modified = resp->GetHeader("Last-Modified");
+    if (lifetime <= 0 && !entry->HasValidator()) return NULL;
+
+    entry->status_code = resp->status_code;
+    for (const auto& header : resp->headers) {
+        if (!IsHopByHopHeader(header.first)) {
+            entry->headers.emplace(header.first, header.second);
+        }
+    }
+    for (const auto& name : hv::split(vary, ',')) {
+        std::string field = hv::trim(name);
+        if (field.empty()) continue;
+        entry->vary_values.push_back(req->GetHeader(field.c_str()));
+        entry->vary_names.push_back(field);
+    }
+    entry->date = now;
+    entry->expires = now + MAX(lifetime, 0);
+    // NOTE: move body into cache
+    entry->body.swap(resp->body);
+    resp->content = NULL;
+    resp->content_length = 0;
+    if (to_disk) {
+        char filepath[MAX_PATH] = {0};
+        snprintf(filepath, sizeof(filepath), "%s/%d-%llu.cache", disk_path.c_str(),
+            (int)hv_getpid(), (unsigned long long)++file_seq_);
+        entry->filepath = filepath;
+    }
+
+    {
+        Shard& s = shard(key);
+        std::lock_guard<std::mutex> locker(s.mutex_);
+        auto old = s.entries.find(key);
+        if (old != s.entries.end()) {
+            removeEntry(s, old->second);
+        }
+        s.lru.emplace_front(key, entry);
+        s.entries[key] = s.lru.begin();
+        if (entry->on_disk()) {
+            s.disk_size += entry->size();
+            stats.disk_size += entry->size();
+        } else {
+            s.memory_size += entry->size();
+            stats.memory_size += entry->size();
+        }
+        ++stats.stores;
+        evict(s);
+    }
+
+    // NOTE: write and mmap large bodies out of the loop thread
+    if (to_disk) {
+        disk_pending_size_ += entry->size();
+        disk_writer_->post([this, key, entry]() {
+            writeToDisk(key, entry);
+        });
+    }
+    return entry;
+}
+
+void HttpProxyCache::Refresh(const std::string& key, const HttpCacheEntryPtr& entry, HttpResponse* resp) {
+    time_t now = time(NULL);
+    int lifetime = freshness_lifetime(resp, now);
+    if (lifetime < 0) lifetime = default_ttl;
+    time_t expires = now + MAX(lifetime, 0);
+    Shard& s = shard(key);
+    std::lock_guard<std::mutex> locker(s.mutex_);
+    entry->date = now;
+    entry->expires = expires;
+    // NOTE: filepath is unique per Store, the same one means the mapped copy of entry
+    auto iter = s.entries.find(key);
+    if (iter != s.entries.end() && entry->on_disk()) {
+        const HttpCacheEntryPtr& current = iter->second->second;
+        if (current != entry && current->filepath == entry->filepath) {
+            current->date = now;
+            current->expires = expires;
+        }
+    }
+}
+
+bool HttpProxyCache::Remove(const std::string& key) {
+    Shard& s = shard(key);
+    std::lock_guard<std::mutex> locker(s.mutex_);
+    auto iter = s.entries.find(key);
+    if (iter == s.entries.end()) return false;
+    removeEntry(s, iter->second);
+    return true;
+}
+
+void HttpProxyCache::Clear() {
+    for (auto& s : shards_) {
+        std::lock_guard<std::mutex> locker(s->mutex_);
+        while (!s->lru.empty()) {
+            removeEntry(*s, std::prev(s->lru.end()));
+        }
+    }
+}
+
+void HttpProxyCache::removeEntry(Shard& s, decltype(Shard::lru)::iterator iter) {
+    const HttpCacheEntryPtr& entry = iter->second;
+    if (entry->on_disk()) {
+        s.disk_size -= entry->size();
+        stats.disk_size -= entry->size();
+        // NOTE: mapped pages stay valid until entry released
+        remove(entry->filepath.c_str());
+    } else {
+        s.memory_size -= entry->size();
+        stats.memory_size -= entry->size();
+    }
+    s.entries.erase(iter->first);
+    s.lru.erase(iter);
+}
+
+void HttpProxyCache::evict(Shard& s) {
+    size_t max_shard_memory_size = max_memory_size / shards_.size();
+    size_t max_shard_disk_size = max_disk_size / shards_.size();
+    // evict the least recently used entries of the tier over budget
+    auto iter = s.lru.end();
+    while ((s.memory_size > max_shard_memory_size || s.disk_size > max_shard_disk_size) &&
+           iter != s.lru.begin()) {
+        --iter;
+        bool on_disk = iter->second->on_disk();
+        if ((on_disk && s.disk_size > max_shard_disk_size) ||
+            (!on_disk && s.memory_size > max_shard_memory_size)) {
+            auto victim = iter++;
+            removeEntry(s, victim);
+            ++stats.evictions;
+        }
+    }
+}
+
+void HttpProxyCache::writeToDisk(const std::string& key, const HttpCacheEntryPtr& entry) {
+    const char* filepath = entry->filepath.c_str();
+    size_t size = entry->body.size();
+    HttpCacheEntryPtr mapped_entry;
+#ifdef PROXY_CACHE_DISK_TIER
+    FILE* fp = fopen(filepath, "wb+");
+    if (fp == NULL) {
+        hv_mkdir_p(disk_path.c_str());
+        fp = fopen(filepath, "wb+");
+    }
+    if (fp) {
+        bool ok = fwrite(entry->body.data(), 1, size, fp) == size && fflush(fp) == 0;
+        void* mapped = ok ? mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(fp), 0) : MAP_FAILED;
+        fclose(fp);
+        if (mapped != MAP_FAILED) {
+            mapped_entry = std::make_shared<HttpCacheEntry>();
+            mapped_entry->status_code = entry->status_code;
+            mapped_entry->headers = entry->headers;
+            mapped_entry->etag = entry->etag;
+            mapped_entry->last_modified = entry->last_modified;
+            mapped_entry->vary_names = entry->vary_names;
+            mapped_entry->vary_values = entry->vary_values;
+            mapped_entry->filepath = entry->filepath;
+            mapped_entry->mapped = mapped;
+            mapped_entry->mapped_size = size;
+        }
+    }
+    if (mapped_entry == NULL) {
+        hloge("proxy cache: write %s failed", filepath);
+    }
+#endif
+
+    {
+        Shard& s = shard(key);
+        std::lock_guard<std::mutex> locker(s.mutex_);
+        // compare-and-swap: replace entry only if it is still the one stored under key,
+        // freshness is copied under the lock Refresh takes too.
+        auto iter = s.entries.find(key);
+        if (iter != s.entries.end() && iter->second->second == entry) {
+            if (mapped_entry) {
+                // NOTE: requests holding entry go on with its body in memory
+                mapped_entry->date = entry->date.load();
+                mapped_entry->expires = entry->expires.load();
+                iter->second->second = mapped_entry;
+            } else {
+                removeEntry(s, iter->second);
+            }
+        } else {
+            // evicted or replaced while writing
+            remove(filepath);
+        }
+    }
+    disk_pending_size_ -= size;
+}
+
+bool HttpProxyCache::Wait(const std::string& key, const Waiter& waiter) {
+    Shard& s = shard(key);
+    std::lock_guard<std::mutex> locker(s.mutex_);
+    auto iter = s.fetching.find(key);
+    if (iter == s.fetching.end()) {
+        s.fetching[key];
+        return false;
+    }
+    iter->second.push_back(waiter);
+    return true;
+}
+
+void HttpProxyCache::Complete(const std::string& key, const HttpCacheEntryPtr& entry) {
+    std::vector<Waiter> waiters;
+    {
+        Shard& s = shard(key);
+        std::lock_guard<std::mutex> locker(s.mutex_);
+        auto iter = s.fetching.find(key);
+        if (iter == s.fetching.end()) return;
+        waiters.swap(iter->second);
+        s.fetching.erase(iter);
+    }
+    for (const auto& waiter : waiters) {
+        waiter(entry);
+    }
+}
+
+}
@@ -0,0 +1,190 @@
+#ifndef HV_HTTP_PROXY_CACHE_H_
+#define HV_HTTP_PROXY_CACHE_H_
+
+/*
+ * nginx:
+ * proxy_cache_path /var/cache/nginx max_size=1g;
+ * proxy_cache_lock on;
+ * add_header X-Cache-Status $upstream_cache_status;
+ *
+ * libhv:
+ * service.proxy_cache = std::make_shared<hv::HttpProxyCache>(64 << 20);
+ * service.proxy_cache->disk_path = "/var/cache/libhv";
+ * service.Proxy("/api/", "http://backend/");
+ *
+ * Only GET/HEAD are cached, HEAD is fetched as GET.
+ * Freshness: Cache-Control s-maxage, max-age, Expires, or default_ttl.
+ * Stale entries with ETag/Last-Modified are revalidated by If-None-Match/If-Modified-Since.
+ * Concurrent misses of the same key wait for one upstream fetch.
+ * Bodies larger than max_memory_object_size are written to disk_path and mmap by a writer thread,
+ * they are served from memory until written.
+ * NOTE: the disk tier needs mmap, disk_path is ignored on windows.
+ *
+ */
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <functional>
+
+#include "hexport.h"
+#include "HttpMessage.h"
+
+class HThreadPool;
+
+#define DEFAULT_PROXY_CACHE_MAX_MEMORY_SIZE     (64 << 20)  // 64M
+#define DEFAULT_PROXY_CACHE_MAX_DISK_SIZE       (1 << 30)   // 1G
+#define DEFAULT_PROXY_CACHE_MAX_OBJECT_SIZE     (64 << 20)  // 64M
+#define DEFAULT_PROXY_CACHE_MEMORY_OBJECT_SIZE  (1 << 20)   // 1M
+#define DEFAULT_PROXY_CACHE_MAX_DISK_PENDING_SIZE (128 << 20) // 128M
+#define DEFAULT_PROXY_CACHE_SHARDS              16
+
+namespace hv {
+
+// $upstream_cache_status
+enum http_cache_status {
+    HTTP_CACHE_BYPASS,
+    HTTP_CACHE_MISS,
+    HTTP_CACHE_HIT,
+    HTTP_CACHE_EXPIRED,
+    HTTP_CACHE_REVALIDATED,
+    HTTP_CACHE_STALE, // upstream failed, serve stale
+};
+
+HV_EXPORT const char* http_cache_status_str(enum http_cache_status status);
+
+struct HV_EXPORT HttpCacheEntry {
+    int             status_code;
+    http_headers    headers; // exclude hop-by-hop headers and Content-Length
+    std::string     etag;
+    std::string     last_modified;
+    // Vary: Accept-Encoding => request Accept-Encoding when stored
+    StringList      vary_names;
+    StringList      vary_values;
+    // stored time and fresh until, updated by revalidation
+    std::atomic<time_t> date;
+    std::atomic<time_t> expires;
+
+    // memory tier
+    std::string     body;
+    // disk tier: body is written to filepath and mmap by the writer thread,
+    // then this entry is replaced by a mapped copy, so an entry never changes once stored.
+    std::string     filepath;
+    void*           mapped;
+    size_t          mapped_size;
+
+    HttpCacheEntry();
+    ~HttpCacheEntry();
+
+    const char* data() const { return mapped ? (const char*)mapped : body.data(); }
+    size_t      size() const { return mapped ? mapped_size : body.size(); }
+    bool        on_disk() const { return !filepath.empty(); }
+
+    bool IsFresh(time_t now) const { return now < expires; }
+    bool HasValidator() const { return !etag.empty() || !last_modified.empty(); }
+    bool MatchVary(HttpRequest* req) const;
+    // If-None-Match, If-Modified-Since => 304 Not Modified
+    bool NotModified(HttpRequest* req) const;
+};
+
+typedef std::shared_ptr<HttpCacheEntry> HttpCacheEntryPtr;
+
+struct HV_EXPORT HttpProxyCacheStats {
+    std::atomic<uint64_t>   hits;
+    std::atomic<uint64_t>   misses;
+    std::atomic<uint64_t>   expired;
+    std::atomic<uint64_t>   revalidated;
+    std::atomic<uint64_t>   bypasses;
+    std::atomic<uint64_t>   coalesced; // misses served by another request's upstream fetch
+    std::atomic<uint64_t>   stores;
+    std::atomic<uint64_t>   evictions;
+    std::atomic<uint64_t>   memory_size;
+    std::atomic<uint64_t>   disk_size;
+
+    HttpProxyCacheStats();
+
+    // (hits + revalidated + coalesced) / lookups
+    double HitRatio() const;
+    // json
+    std::string Dump() const;
+};
+
+class HV_EXPORT HttpProxyCache {
+public:
+    // bytes of memory tier, split over shards
+    size_t      max_memory_size;
+    // bytes of disk tier, 0 or empty disk_path means disabled
+    size_t      max_disk_size;
+    std::string disk_path;
+    // objects larger than max_memory_object_size go to disk tier if enabled
+    size_t      max_memory_object_size;
+    // bodies waiting for the disk writer, objects are not cached to disk beyond it
+    size_t      max_disk_pending_size;
+    // objects larger than max_object_size are never cached
+    size_t      max_object_size;
+    // freshness lifetime of responses without Cache-Control/Expires, 0 means store only if revalidatable
+    int         default_ttl; // s
+    HttpProxyCacheStats stats;
+
+    // NOTE: waiter is called back in the thread which completes the upstream fetch.
+    // entry is NULL if the response is not cacheable or the fetch failed.
+    typedef std::function<void(const HttpCacheEntryPtr& entry)> Waiter;
+
+    HttpProxyCache(size_t max_memory_size = DEFAULT_PROXY_CACHE_MAX_MEMORY_SIZE,
+                   int shards = DEFAULT_PROXY_CACHE_SHARDS);
+    ~HttpProxyCache();
+
+    // GET/HEAD without Authorization and Cache-Control: no-store
+    static bool IsCacheableRequest(HttpRequest* req);
+    // Cache-Control: no-cache, max-age=0, Pragma: no-cache
+    static bool NeedRevalidate(HttpRequest* req);
+    // hop-by-hop headers and Content-Length, Age are not stored
+    static bool IsHopByHopHeader(const std::string& name);
+
+    // @retval entry matched Vary, fresh or stale; NULL if miss
+    HttpCacheEntryPtr Get(const std::string& key, HttpRequest* req);
+    // @retval NULL if resp is not cacheable
+    HttpCacheEntryPtr Store(const std::string& key, HttpRequest* req, HttpResponse* resp);
+    // 304 Not Modified: refresh entry by resp freshness,
+    // and the mapped copy which has replaced it under key, if any.
+    void Refresh(const std::string& key, const HttpCacheEntryPtr& entry, HttpResponse* resp);
+    bool Remove(const std::string& key);
+    void Clear();
+
+    // proxy_cache_lock
+    // @retval false: caller is the first one and must fetch upstream, then call Complete.
+    // @retval true:  waiter added, will be called back by Complete.
+    bool Wait(const std::string& key, const Waiter& waiter);
+    void Complete(const std::string& key, const HttpCacheEntryPtr& entry);
+
+private:
+    struct Shard {
+        std::mutex  mutex_;
+        std::list<std::pair<std::string, HttpCacheEntryPtr>> lru; // front is the most recently used
+        std::unordered_map<std::string, decltype(lru)::iterator> entries;
+        // key => waiters, present means fetching
+        std::unordered_map<std::string, std::vector<Waiter>> fetching;
+        size_t      memory_size;
+        size_t      disk_size;
+    };
+    Shard& shard(const std::string& key);
+    void   evict(Shard& s);
+    void   removeEntry(Shard& s, decltype(Shard::lru)::iterator iter);
+    // run in disk_writer_
+    void   writeToDisk(const std::string& key, const HttpCacheEntryPtr& entry);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<uint64_t>               file_seq_;
+    std::atomic<size_t>                 disk_pending_size_;
+    std::unique_ptr<HThreadPool>        disk_writer_;
+};
+
+typedef std::shared_ptr<HttpProxyCache> HttpProxyCachePtr;
+
+}
+
+#endif // HV_HTTP_PROXY_CACHE_H_
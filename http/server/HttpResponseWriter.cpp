@@ -7,6 +7,9 @@ int HttpResponseWriter::EndHeaders(const char* key /* = NULL */, const char* val
     if (key && value) {
         response->SetHeader(key, value);
     }
+    if (response->IsChunked()) {
+        beginCompress();
+    }
     std::string headers = response->Dump(true, false);
     // erase Content-Length: 0\r\n
     std::string content_length_0("Content-Length: 0\r\n");
@@ -18,12 +21,52 @@ int HttpResponseWriter::EndHeaders(const char* key /* = NULL */, const char* val
     return write(headers);
 }
 
+void HttpResponseWriter::beginCompress() {
+    if (compression == NULL) return;
+    if (response->headers.find("Content-Encoding") != response->headers.end()) return;
+    response->FillContentType();
+    auto iter = response->headers.find("Content-Type");
+    if (iter == response->headers.end() ||
+        !compression->IsCompressibleType(iter->second.c_str())) {
+        return;
+    }
+    HttpCompressor::AddVary(response.get());
+    if (content_encoding == HTTP_CONTENT_ENCODING_IDENTITY) return;
+    compressor = std::make_shared<HttpCompressor>();
+    if (!compressor->Init(content_encoding, compression->level)) {
+        compressor.reset();
+        return;
+    }
+    response->headers["Content-Encoding"] = HttpCompressor::EncodingName(content_encoding);
+}
+
 int HttpResponseWriter::WriteChunked(const char* buf, int len /* = -1 */) {
-    int ret = 0;
     if (len == -1) len = strlen(buf);
     if (state == SEND_BEGIN) {
         EndHeaders("Transfer-Encoding", "chunked");
     }
+    if (compressor) {
+        bool finish = !(buf && len);
+        std::string compressed;
+        if (!compressor->Compress(buf, finish ? 0 : len, compressed, finish)) {
+            return -1;
+        }
+        if (compressed.size()) {
+            int ret = writeChunk(compressed.data(), compressed.size());
+            if (ret < 0) return ret;
+        }
+        if (finish) {
+            compressor.reset();
+            writeChunk(NULL, 0);
+            return 0;
+        }
+        return len;
+    }
+    return writeChunk(buf, len);
+}
+
+int HttpResponseWriter::writeChunk(const char* buf, int len) {
+    int ret = 0;
     char chunked_header[64];
     int chunked_header_len = snprintf(chunked_header, sizeof(chunked_header), "%x\r\n", len);
     write(chunked_header, chunked_header_len);
@@ -79,6 +122,11 @@ int HttpResponseWriter::SSEvent(const std::string& data, const char* event /* =
 int HttpResponseWriter::End(const char* buf /* = NULL */, int len /* = -1 */) {
     if (end == SEND_END) return 0;
     end = SEND_END;
+    if (onend) {
+        std::function<void()> cb(std::move(onend));
+        onend = NULL;
+        cb();
+    }
 
     if (!isConnected()) {
         return -1;
@@ -106,6 +154,9 @@ int HttpResponseWriter::End(const char* buf /* = NULL */, int len /* = -1 */) {
             is_dump_body = false;
         }
         if (is_dump_body) {
+            if (is_dump_headers && compression) {
+                HttpCompressor::CompressResponse(response.get(), content_encoding, *compression);
+            }
             std::string msg = response->Dump(is_dump_headers, is_dump_body);
             state = SEND_BODY;
             ret = write(msg);
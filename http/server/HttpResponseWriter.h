@@ -3,6 +3,7 @@
 
 #include "Channel.h"
 #include "HttpMessage.h"
+#include "HttpCompressor.h"
 
 namespace hv {
 
@@ -17,11 +18,19 @@ public:
         SEND_CHUNKED_END,
         SEND_END,
     } state: 8, end: 8;
+    // Content-Encoding negotiated by Accept-Encoding, set by HttpHandler
+    http_content_encoding           content_encoding;
+    const HttpCompressionOptions*   compression; // NULL means disabled
+    HttpCompressorPtr               compressor;  // for chunked
+    // called once by End, set by HttpHandler for metrics
+    std::function<void()>           onend;
     HttpResponseWriter(hio_t* io, const HttpResponsePtr& resp)
         : SocketChannel(io)
         , response(resp)
         , state(SEND_BEGIN)
         , end(SEND_BEGIN)
+        , content_encoding(HTTP_CONTENT_ENCODING_IDENTITY)
+        , compression(NULL)
     {}
     ~HttpResponseWriter() {}
 
@@ -31,9 +40,11 @@ public:
     // Begin -> EndHeaders("Content-Type", "text/event-stream") -> write -> write -> ... -> close
     // Begin -> EndHeaders("Content-Length", content_length) -> WriteBody -> WriteBody -> ... -> End
     // Begin -> EndHeaders("Transfer-Encoding", "chunked") -> WriteChunked -> WriteChunked -> ... -> End
+    // NOTE: chunked body and End(body) are compressed if compression enabled.
 
     int Begin() {
         state = end = SEND_BEGIN;
+        compressor.reset();
         return 0;
     }
 
@@ -91,6 +102,10 @@ public:
     int End(const std::string& str) {
         return End(str.c_str(), str.size());
     }
+
+private:
+    void beginCompress();
+    int  writeChunk(const char* buf, int len);
 };
 
 }
@@ -9,6 +9,8 @@
 using namespace hv;
 
 #include "HttpHandler.h"
+#include "HttpSharedStats.h"
+#include "HttpAdmission.h"
 
 static void on_accept(hio_t* io);
 static void on_recv(hio_t* io, void* _buf, int readbytes);
@@ -26,6 +28,7 @@ static void on_recv(hio_t* io, void* buf, int readbytes) {
     // printf("on_recv fd=%d readbytes=%d\n", hio_fd(io), readbytes);
     HttpHandler* handler = (HttpHandler*)hevent_userdata(io);
     assert(handler != NULL);
+    HttpSharedStats::AddRecvBytes(readbytes);
 
     int nfeed = handler->FeedRecvData((const char*)buf, readbytes);
     if (nfeed != readbytes) {
@@ -40,6 +43,7 @@ static void on_close(hio_t* io) {
 
     hevent_set_userdata(io, NULL);
     delete handler;
+    HttpSharedStats::OnClose();
 
     EventLoop* loop = currentThreadEventLoop;
     if (loop) {
@@ -65,7 +69,24 @@ static void on_accept(hio_t* io) {
         hio_close(io);
         return;
     }
+    if (server->max_connections && HttpSharedStats::Connections() >= server->max_connections) {
+        hlogw("over max_connections");
+        hio_close(io);
+        return;
+    }
+    if (service->max_accept_queue) {
+        int listenfd = server->listenfd[hio_is_ssl(io) ? 1 : 0];
+        if (!HttpAdmission::Current()->CheckAcceptQueue(service, listenfd, hloop_now_ms(hevent_loop(io)))) {
+            // NOTE: shed it without reading, hio_close flushes the response first.
+            int len = 0;
+            const char* data = HttpAdmission::StatusResponse(HTTP_STATUS_SERVICE_UNAVAILABLE, &len);
+            hio_write(io, data, len);
+            hio_close(io);
+            return;
+        }
+    }
     ++loop->connectionNum;
+    HttpSharedStats::OnAccept();
 
     hio_setcb_close(io, on_close);
     hio_setcb_read(io, on_recv);
@@ -78,6 +99,7 @@ static void on_accept(hio_t* io) {
     HttpHandler* handler = new HttpHandler(io);
     // ssl
     handler->ssl = hio_is_ssl(io);
+    handler->idle_release = server->idle_release ? 1 : 0;
     // ip:port
     sockaddr_u* peeraddr = (sockaddr_u*)hio_peeraddr(io);
     sockaddr_ip(peeraddr, handler->ip, sizeof(handler->ip));
@@ -98,6 +120,15 @@ static void loop_thread(void* userdata) {
 
     auto loop = std::make_shared<EventLoop>();
     hloop_t* hloop = loop->loop();
+    if (service->enable_metrics) {
+        hloop_enable_metrics(hloop);
+    }
+    if (server->stall_ms) {
+        hloop_enable_watchdog(hloop, server->stall_ms);
+    }
+    if (server->idle_release) {
+        hloop_enable_idle_release(hloop);
+    }
     // http
     if (server->listenfd[0] >= 0) {
         hio_t* listenio = haccept(hloop, server->listenfd[0], on_accept);
@@ -144,6 +175,11 @@ static void loop_thread(void* userdata) {
             },  filecache->expired_time * 1000);
             hevent_set_userdata(timer, filecache);
         }
+
+        // upstream active health check, on the first loop only
+        for (auto& pair : service->upstreams) {
+            pair.second->StartHealthCheck(hloop);
+        }
     }
     privdata->loops.push_back(loop);
     privdata->mutex_.unlock();
@@ -207,6 +243,14 @@ int http_server_run(http_server_t* server, int wait) {
         server->service = privdata->service.get();
     }
 
+    HttpService* service = server->service;
+    bool rate_limit = service->ip_rate_limit.rate > 0 || !service->route_rate_limits.empty();
+    if (server->enable_shared_stats || server->max_connections || rate_limit) {
+        // NOTE: before fork, workers inherit the shared memory
+        int ret = HttpSharedStats::Init();
+        if (ret != 0) return ret;
+    }
+
     if (server->worker_processes) {
         // multi-processes
         return master_workers_run(loop_thread, server, server->worker_processes, server->worker_threads, wait);
@@ -268,6 +312,11 @@ int http_server_stop(http_server_t* server) {
         hthread_join(thrd);
     }
 
+    // NOTE: health check timers are freed with the loops
+    for (auto& pair : server->service->upstreams) {
+        pair.second->StopHealthCheck();
+    }
+
     if (server->alloced_ssl_ctx && server->ssl_ctx) {
         hssl_ctx_free(server->ssl_ctx);
         server->alloced_ssl_ctx = 0;
@@ -297,6 +346,10 @@ std::shared_ptr<hv::EventLoop> HttpServer::loop(int idx) {
 }
 
 size_t HttpServer::connectionNum() {
+    if (HttpSharedStats::IsEnabled()) {
+        // all worker processes
+        return HttpSharedStats::Connections();
+    }
     HttpServerPrivdata* privdata = (HttpServerPrivdata*)this->privdata;
     if (privdata == NULL) return 0;
     std::lock_guard<std::mutex> locker(privdata->mutex_);
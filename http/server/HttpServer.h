@@ -5,6 +5,7 @@
 #include "hssl.h"
 // #include "EventLoop.h"
 #include "HttpService.h"
+#include "HttpSharedStats.h"
 // #include "WebSocketServer.h"
 namespace hv {
 class EventLoop;
@@ -21,6 +22,10 @@ typedef struct http_server_s {
     int worker_processes;
     int worker_threads;
     uint32_t worker_connections; // max_connections = workers * worker_connections
+    uint32_t max_connections; // of all worker processes, 0 means unlimited, @see HttpSharedStats
+    int enable_shared_stats; // counters and rate limiters shared by worker processes, @see HttpSharedStats
+    uint32_t stall_ms; // watchdog: 0 means disabled, @see hloop_enable_watchdog
+    int idle_release; // release buffers of idle connections, @see hloop_enable_idle_release
     HttpService* service; // http service
     WebSocketService* ws; // websocket service
     void* userdata;
@@ -45,6 +50,10 @@ typedef struct http_server_s {
         worker_processes = 0;
         worker_threads = 0;
         worker_connections = 1024;
+        max_connections = 0;
+        enable_shared_stats = 0;
+        stall_ms = 0;
+        idle_release = 0;
         service = NULL;
         ws = NULL;
         listenfd[0] = listenfd[1] = -1;
@@ -122,8 +131,26 @@ public:
     void setMaxWorkerConnectionNum(uint32_t num) {
         this->worker_connections = num;
     }
+    // limit connections of all worker processes, enables shared stats
+    void setMaxConnectionNum(uint32_t num) {
+        this->max_connections = num;
+    }
+    // counters and rate limiters shared by worker processes, @see HttpSharedStats
+    void enableSharedStats() {
+        this->enable_shared_stats = 1;
+    }
     size_t connectionNum();
 
+    // log the stack of loop threads blocked by a callback longer than stall_ms
+    void enableWatchdog(uint32_t stall_ms = 1000) {
+        this->stall_ms = stall_ms;
+    }
+
+    // idle keepalive connections hold no read/write buffers, for many mostly idle connections
+    void enableIdleRelease(bool on = true) {
+        this->idle_release = on;
+    }
+
     // SSL/TLS
     int setSslCtx(hssl_ctx_t ssl_ctx) {
         this->ssl_ctx = ssl_ctx;
@@ -1,11 +1,30 @@
 #include "HttpService.h"
 #include "HttpMiddleware.h"
+#include "HttpMetrics.h"
+#include "HttpSharedStats.h"
+#include "HttpAdmission.h"
 
 #include "hbase.h" // import hv_strendswith
+#include "hasync.h" // import hv::async
 
 namespace hv {
 
-void HttpService::AddRoute(const char* path, http_method method, const http_handler& handler) {
+void HttpWorkerPool::Post(std::function<void()> task) {
+    if (pool) {
+        pool->post(std::move(task));
+    } else {
+        hv::async::post(std::move(task));
+    }
+}
+
+void HttpService::AddRoute(const char* path, http_method method, const http_handler& handler, const http_exec_policy& exec) {
+    HttpWorkerPool* worker_pool = NULL;
+    if (exec.type == http_exec_policy::POOL && handler.state_handler == NULL) {
+        worker_pool = GetWorkerPool(exec.pool_name.c_str());
+        if (worker_pool == NULL) {
+            worker_pool = AddWorkerPool(exec.pool_name.c_str());
+        }
+    }
     std::shared_ptr<http_method_handlers> method_handlers = NULL;
     auto iter = pathHandlers.find(path);
     if (iter == pathHandlers.end()) {
@@ -20,11 +39,36 @@ void HttpService::AddRoute(const char* path, http_method method, const http_hand
         if (iter->method == method) {
             // update
             iter->handler = handler;
+            iter->handler.worker_pool = worker_pool;
             return;
         }
     }
     // add
     method_handlers->push_back(http_method_handler(method, handler));
+    method_handlers->back().handler.worker_pool = worker_pool;
+}
+
+HttpWorkerPool* HttpService::AddWorkerPool(const char* name, int threads, size_t max_queue_size) {
+    std::shared_ptr<HttpWorkerPool>& worker_pool = workerPools[name];
+    if (worker_pool == NULL) {
+        worker_pool = std::make_shared<HttpWorkerPool>(name, max_queue_size);
+    }
+    // NOTE: update in place, as routes added before refer to it.
+    worker_pool->max_queue_size = max_queue_size;
+    if (threads > 0) {
+        worker_pool->pool = std::make_shared<HThreadPool>(threads, threads);
+        worker_pool->pool->start();
+    } else if (*name != '\0') {
+        // dedicated pool
+        worker_pool->pool = std::make_shared<HThreadPool>();
+        worker_pool->pool->start();
+    }
+    return worker_pool.get();
+}
+
+HttpWorkerPool* HttpService::GetWorkerPool(const char* name) {
+    auto iter = workerPools.find(name);
+    return iter == workerPools.end() ? NULL : iter->second.get();
 }
 
 int HttpService::GetRoute(const char* url, http_method method, http_handler** handler) {
@@ -55,7 +99,7 @@ int HttpService::GetRoute(const char* url, http_method method, http_handler** ha
     return HTTP_STATUS_METHOD_NOT_ALLOWED;
 }
 
-int HttpService::GetRoute(HttpRequest* req, http_handler** handler) {
+int HttpService::GetRoute(HttpRequest* req, http_handler** handler, const std::string** route) {
     // {base_url}/path?query
     const char* s = req->path.c_str();
     const char* b = base_url.c_str();
@@ -107,6 +151,7 @@ int HttpService::GetRoute(HttpRequest* req, http_handler** handler) {
         match = match ? match : (*kp == '\0' && *vp == '\0');
 
         if (match) {
+            const std::string* pattern = &iter->first;
             auto method_handlers = iter->second;
             for (auto iter = method_handlers->begin(); iter != method_handlers->end(); ++iter) {
                 if (iter->method == req->method) {
@@ -115,6 +160,7 @@ int HttpService::GetRoute(HttpRequest* req, http_handler** handler) {
                         req->query_params[param.first] = param.second;
                     }
                     if (handler) *handler = &iter->handler;
+                    if (route) *route = pattern;
                     return 0;
                 }
             }
@@ -171,6 +217,22 @@ std::string HttpService::GetProxyUrl(const char* path) {
     return url;
 }
 
+hv::UpstreamGroupPtr HttpService::Upstream(const char* name, load_balance_e lb) {
+    hv::UpstreamGroupPtr& upstream = upstreams[name];
+    if (upstream == NULL) {
+        upstream = std::make_shared<hv::UpstreamGroup>(name, lb);
+    } else {
+        upstream->lb = lb;
+    }
+    return upstream;
+}
+
+hv::UpstreamGroupPtr HttpService::GetUpstream(const char* name) {
+    if (upstreams.empty()) return NULL;
+    auto iter = upstreams.find(name);
+    return iter != upstreams.end() ? iter->second : NULL;
+}
+
 void HttpService::AddTrustProxy(const char* host) {
     trustProxies.emplace_back(host);
 }
@@ -206,4 +268,15 @@ void HttpService::AllowCORS() {
     Use(HttpMiddleware::CORS);
 }
 
+void HttpService::EnableMetrics(const char* path) {
+    enable_metrics = 1;
+    GET(path, [](HttpRequest* req, HttpResponse* resp) {
+        resp->headers["Content-Type"] = "text/plain; version=0.0.4";
+        resp->body = HttpMetrics::Dump();
+        HttpSharedStats::Dump(resp->body);
+        HttpAdmission::Dump(resp->body);
+        return 200;
+    });
+}
+
 }
@@ -8,11 +8,15 @@
 #include <list>
 #include <memory>
 #include <functional>
+#include <atomic>
 
 #include "hexport.h"
 #include "HttpMessage.h"
 #include "HttpResponseWriter.h"
 #include "HttpContext.h"
+#include "HttpUpstream.h"
+#include "HttpProxyCache.h"
+#include "HttpAdmission.h"
 
 #define DEFAULT_BASE_URL        "/api/v1"
 #define DEFAULT_DOCUMENT_ROOT   "/var/www/html"
@@ -20,12 +24,16 @@
 #define DEFAULT_ERROR_PAGE      "error.html"
 #define DEFAULT_INDEXOF_DIR     "/downloads/"
 #define DEFAULT_KEEPALIVE_TIMEOUT   75000   // ms
+#define DEFAULT_UPLOAD_MAX_MEMORY_SIZE  (1 << 20) // 1M
 
 // for FileCache
 #define MAX_FILE_CACHE_SIZE                 (1 << 22)   // 4M
 #define DEFAULT_FILE_CACHE_STAT_INTERVAL    10          // s
 #define DEFAULT_FILE_CACHE_EXPIRED_TIME     60          // s
 
+// for HttpWorkerPool
+#define DEFAULT_WORKER_POOL_MAX_QUEUE_SIZE  1024
+
 /*
  * @param[in]  req:  parsed structured http request
  * @param[out] resp: structured http response
@@ -43,22 +51,52 @@ typedef std::function<int(const HttpContextPtr& ctx)>
 // NOTE: http_state_handler run on IO thread
 typedef std::function<int(const HttpContextPtr& ctx, http_parser_state state, const char* data, size_t size)> http_state_handler;
 
+class HThreadPool;
+namespace hv {
+struct HttpWorkerPool;
+}
+
+/*
+ * execution policy of API handlers
+ * INLINE: run on IO thread
+ * POOL:   sync_handler and ctx_handler run on a worker pool, then the response
+ *         goes through errorHandler and postprocessor and is written back on IO thread,
+ *         async_handler runs on the same pool.
+ *
+ * router.GET("/heavy", handler, http_exec_policy::POOL);  // default pool
+ * router.GET("/report", handler, "report");               // dedicated pool
+ * @see HttpService::AddWorkerPool
+ */
+struct http_exec_policy {
+    enum type_e {
+        INLINE,
+        POOL,
+    } type;
+    std::string pool_name; // empty means default pool
+
+    http_exec_policy(type_e type = INLINE) : type(type) {}
+    http_exec_policy(const char* pool_name) : type(POOL), pool_name(pool_name ? pool_name : "") {}
+};
+
 struct http_handler {
     http_sync_handler   sync_handler;
     http_async_handler  async_handler;
     http_ctx_handler    ctx_handler;
     http_state_handler  state_handler;
-
-    http_handler()  {}
-    http_handler(http_sync_handler fn)  : sync_handler(std::move(fn))   {}
-    http_handler(http_async_handler fn) : async_handler(std::move(fn))  {}
-    http_handler(http_ctx_handler fn)   : ctx_handler(std::move(fn))    {}
-    http_handler(http_state_handler fn) : state_handler(std::move(fn))  {}
+    // NULL means run inline, set by HttpService::AddRoute
+    hv::HttpWorkerPool* worker_pool;
+
+    http_handler() : worker_pool(NULL) {}
+    http_handler(http_sync_handler fn)  : sync_handler(std::move(fn)),  worker_pool(NULL) {}
+    http_handler(http_async_handler fn) : async_handler(std::move(fn)), worker_pool(NULL) {}
+    http_handler(http_ctx_handler fn)   : ctx_handler(std::move(fn)),   worker_pool(NULL) {}
+    http_handler(http_state_handler fn) : state_handler(std::move(fn)), worker_pool(NULL) {}
     http_handler(const http_handler& rhs)
         : sync_handler(std::move(const_cast<http_handler&>(rhs).sync_handler))
         , async_handler(std::move(const_cast<http_handler&>(rhs).async_handler))
         , ctx_handler(std::move(const_cast<http_handler&>(rhs).ctx_handler))
         , state_handler(std::move(const_cast<http_handler&>(rhs).state_handler))
+        , worker_pool(rhs.worker_pool)
     {}
 
     const http_handler& operator=(http_sync_handler fn) {
@@ -106,6 +144,31 @@ typedef std::unordered_map<std::string, std::shared_ptr<http_method_handlers>>
 
 namespace hv {
 
+// worker pool of API handlers with http_exec_policy::POOL
+struct HV_EXPORT HttpWorkerPool {
+    std::string                     name;
+    std::shared_ptr<HThreadPool>    pool;           // NULL means hv::GlobalThreadPool
+    size_t                          max_queue_size; // 0 means unlimited
+    std::atomic<size_t>             queue_size;     // queued and running handlers
+
+    HttpWorkerPool(const std::string& name, size_t max_queue_size = DEFAULT_WORKER_POOL_MAX_QUEUE_SIZE)
+        : name(name), max_queue_size(max_queue_size), queue_size(0) {}
+
+    // @retval false if overloaded, should respond 503
+    bool Acquire() {
+        size_t size = ++queue_size;
+        if (max_queue_size && size > max_queue_size) {
+            --queue_size;
+            return false;
+        }
+        return true;
+    }
+    void Release() {
+        --queue_size;
+    }
+    void Post(std::function<void()> task);
+};
+
 struct HV_EXPORT HttpService {
     /* handler chain */
     // preprocessor -> middleware -> processor -> postprocessor
@@ -118,6 +181,8 @@ struct HV_EXPORT HttpService {
     /* API handlers */
     std::string         base_url;
     http_path_handlers  pathHandlers;
+    // name => HttpWorkerPool, "" is the default pool
+    std::map<std::string, std::shared_ptr<HttpWorkerPool>> workerPools;
 
     /* Static file service */
     http_handler    staticHandler;
@@ -135,6 +200,10 @@ struct HV_EXPORT HttpService {
     /* Reverse proxy service */
     // nginx: location => proxy_pass
     std::map<std::string, std::string, std::greater<std::string>> proxies;
+    // nginx: upstream name => servers
+    std::map<std::string, hv::UpstreamGroupPtr> upstreams;
+    // nginx: proxy_cache, NULL means disabled
+    hv::HttpProxyCachePtr proxy_cache;
     /* Forward proxy service */
     StringList  trustProxies;
     StringList  noProxies;
@@ -154,9 +223,39 @@ struct HV_EXPORT HttpService {
      * @client  bin/wget http://127.0.0.1:8080/downloads/test.zip
      */
     int limit_rate; // limit send rate, unit: KB/s
+    /*
+     * @build   ./configure --with-zlib --with-brotli
+     * @client  curl -v --compressed http://127.0.0.1:8080/
+     */
+    HttpCompressionOptions compression; // Content-Encoding: gzip, deflate, br
+    /*
+     * @server  bin/httpd -c etc/httpd.conf => upload_dir = html/uploads
+     * @client  curl -v http://127.0.0.1:8080/upload -F 'file=@LICENSE'
+     * multipart/form-data file parts are written to upload_dir while receiving,
+     * instead of buffering the whole body in req->body.
+     * NOTE: written by the loop thread with blocking write(2), which mostly just
+     *       copies to the page cache, but stalls the loop when the disk is slow,
+     *       so keep upload_dir on a local disk, stall_ms of the watchdog reports it.
+     * @see MultipartParser, req->form[name].filepath, req->SaveFormFile
+     */
+    std::string upload_dir;             // empty means disabled
+    size_t      upload_max_memory_size; // bytes of in-memory parts per request
+    size_t      upload_max_file_size;   // bytes per file part, 0 means unlimited
+
+    /* Admission control, @see HttpAdmission.h */
+    http_rate_limit ip_rate_limit;  // per client ip
+    // path pattern => token bucket of all clients
+    std::map<std::string, http_rate_limit> route_rate_limits;
+    uint32_t    max_inflight_requests;  // per loop, 0 means unlimited
+    uint32_t    max_accept_queue;       // close new connections over it, 0 means unlimited, linux only
+    http_adaptive_concurrency adaptive_concurrency;
 
     unsigned enable_access_log      :1;
     unsigned enable_forward_proxy   :1;
+    unsigned enable_compression     :1;
+    unsigned enable_upload_preallocate :1; // fallocate upload file by Content-Length
+    unsigned enable_metrics         :1;
+    unsigned enable_admission       :1; // check requests by HttpAdmission
 
     HttpService() {
         // base_url = DEFAULT_BASE_URL;
@@ -175,16 +274,34 @@ struct HV_EXPORT HttpService {
         file_cache_stat_interval = DEFAULT_FILE_CACHE_STAT_INTERVAL;
         file_cache_expired_time = DEFAULT_FILE_CACHE_EXPIRED_TIME;
         limit_rate = -1; // unlimited
+        upload_max_memory_size = DEFAULT_UPLOAD_MAX_MEMORY_SIZE;
+        upload_max_file_size = 0;
+        max_inflight_requests = 0;
+        max_accept_queue = 0;
 
         enable_access_log = 1;
         enable_forward_proxy = 0;
+        enable_compression = 0;
+        enable_upload_preallocate = 0;
+        enable_metrics = 0;
+        enable_admission = 0;
     }
 
-    void AddRoute(const char* path, http_method method, const http_handler& handler);
+    void AddRoute(const char* path, http_method method, const http_handler& handler,
+                  const http_exec_policy& exec = http_exec_policy());
     // @retval 0 OK, else HTTP_STATUS_NOT_FOUND, HTTP_STATUS_METHOD_NOT_ALLOWED
     int  GetRoute(const char* url,  http_method method, http_handler** handler);
     // RESTful API /:field/ => req->query_params["field"]
-    int  GetRoute(HttpRequest* req, http_handler** handler);
+    // @param route: set to the matched path pattern
+    int  GetRoute(HttpRequest* req, http_handler** handler, const std::string** route = NULL);
+
+    // worker pool for handlers with http_exec_policy(name), "" is the default pool
+    // which runs on hv::GlobalThreadPool unless threads > 0.
+    // Requests are rejected with 503 when max_queue_size handlers are queued or running.
+    // AddWorkerPool("report", 4, 100);
+    HttpWorkerPool* AddWorkerPool(const char* name, int threads = 0,
+                                  size_t max_queue_size = DEFAULT_WORKER_POOL_MAX_QUEUE_SIZE);
+    HttpWorkerPool* GetWorkerPool(const char* name);
 
     // Static("/", "/var/www/html")
     void Static(const char* path, const char* dir);
@@ -194,6 +311,41 @@ struct HV_EXPORT HttpService {
     // https://developer.mozilla.org/en-US/docs/Web/HTTP/CORS
     void AllowCORS();
 
+    // compression
+    void EnableCompression() { enable_compression = 1; }
+
+    // metrics
+    // Enable loop metrics of HttpServer and per-route latency,
+    // GET path => Prometheus text format, @see HttpMetrics.h
+    void EnableMetrics(const char* path = "/metrics");
+
+    // admission control, rejected requests are not read further, @see HttpAdmission.h
+    // token bucket per client ip => 429
+    void RateLimit(double rate, double burst) {
+        ip_rate_limit = http_rate_limit(rate, burst);
+        enable_admission = 1;
+    }
+    // token bucket per route of all clients => 429
+    // @param path: the pattern passed to GET, POST, ...
+    void RateLimit(const char* path, double rate, double burst) {
+        route_rate_limits[path] = http_rate_limit(rate, burst);
+        enable_admission = 1;
+    }
+    // requests in flight per loop => 503
+    void SetMaxInflightRequests(uint32_t num) {
+        max_inflight_requests = num;
+        enable_admission = 1;
+    }
+    // AIMD concurrency limit per loop by handler latency => 503
+    void EnableAdaptiveConcurrency(uint32_t target_latency_ms, uint32_t min_limit = 1, uint32_t max_limit = 1000) {
+        adaptive_concurrency.target_latency_ms = target_latency_ms;
+        adaptive_concurrency.min_limit = min_limit;
+        adaptive_concurrency.max_limit = max_limit;
+        enable_admission = 1;
+    }
+    // close new connections when the accept queue is longer than num
+    void SetMaxAcceptQueue(uint32_t num) { max_accept_queue = num; }
+
     // proxy
     // forward proxy
     void EnableForwardProxy() { enable_forward_proxy = 1; }
@@ -205,6 +357,12 @@ struct HV_EXPORT HttpService {
     void Proxy(const char* path, const char* url);
     // @retval /api/v1/test => http://www.httpbin.org/test
     std::string GetProxyUrl(const char* path);
+    // Upstream("backend")->AddServer("http://127.0.0.1:8001");
+    // Proxy("/api/", "http://backend/");
+    // @see HttpUpstream.h
+    hv::UpstreamGroupPtr Upstream(const char* name, load_balance_e lb = LB_RoundRobin);
+    // @retval NULL if not found
+    hv::UpstreamGroupPtr GetUpstream(const char* name);
 
     hv::StringList Paths() {
         hv::StringList paths;
@@ -223,56 +381,64 @@ struct HV_EXPORT HttpService {
     // Inspired by github.com/gin-gonic/gin
     // Handler = [ http_sync_handler, http_async_handler, http_ctx_handler, http_state_handler ]
     template<typename Handler>
-    void Handle(const char* httpMethod, const char* relativePath, Handler handlerFunc) {
-        AddRoute(relativePath, http_method_enum(httpMethod), http_handler(handlerFunc));
+    void Handle(const char* httpMethod, const char* relativePath, Handler handlerFunc,
+                const http_exec_policy& exec = http_exec_policy()) {
+        AddRoute(relativePath, http_method_enum(httpMethod), http_handler(handlerFunc), exec);
     }
 
     // HEAD
     template<typename Handler>
-    void HEAD(const char* relativePath, Handler handlerFunc) {
-        Handle("HEAD", relativePath, handlerFunc);
+    void HEAD(const char* relativePath, Handler handlerFunc,
+              const http_exec_policy& exec = http_exec_policy()) {
+        Handle("HEAD", relativePath, handlerFunc, exec);
     }
 
     // GET
     template<typename Handler>
-    void GET(const char* relativePath, Handler handlerFunc) {
-        Handle("GET", relativePath, handlerFunc);
+    void GET(const char* relativePath, Handler handlerFunc,
+             const http_exec_policy& exec = http_exec_policy()) {
+        Handle("GET", relativePath, handlerFunc, exec);
     }
 
     // POST
     template<typename Handler>
-    void POST(const char* relativePath, Handler handlerFunc) {
-        Handle("POST", relativePath, handlerFunc);
+    void POST(const char* relativePath, Handler handlerFunc,
+              const http_exec_policy& exec = http_exec_policy()) {
+        Handle("POST", relativePath, handlerFunc, exec);
     }
 
     // PUT
     template<typename Handler>
-    void PUT(const char* relativePath, Handler handlerFunc) {
-        Handle("PUT", relativePath, handlerFunc);
+    void PUT(const char* relativePath, Handler handlerFunc,
+             const http_exec_policy& exec = http_exec_policy()) {
+        Handle("PUT", relativePath, handlerFunc, exec);
     }
 
     // DELETE
     // NOTE: Windows <winnt.h> #define DELETE as a macro, we have to replace DELETE with Delete.
     template<typename Handler>
-    void Delete(const char* relativePath, Handler handlerFunc) {
-        Handle("DELETE", relativePath, handlerFunc);
+    void Delete(const char* relativePath, Handler handlerFunc,
+                const http_exec_policy& exec = http_exec_policy()) {
+        Handle("DELETE", relativePath, handlerFunc, exec);
     }
 
     // PATCH
     template<typename Handler>
-    void PATCH(const char* relativePath, Handler handlerFunc) {
-        Handle("PATCH", relativePath, handlerFunc);
+    void PATCH(const char* relativePath, Handler handlerFunc,
+               const http_exec_policy& exec = http_exec_policy()) {
+        Handle("PATCH", relativePath, handlerFunc, exec);
     }
 
     // Any
     template<typename Handler>
-    void Any(const char* relativePath, Handler handlerFunc) {
-        Handle("HEAD", relativePath, handlerFunc);
-        Handle("GET", relativePath, handlerFunc);
-        Handle("POST", relativePath, handlerFunc);
-        Handle("PUT", relativePath, handlerFunc);
-        Handle("DELETE", relativePath, handlerFunc);
-        Handle("PATCH", relativePath, handlerFunc);
+    void Any(const char* relativePath, Handler handlerFunc,
+             const http_exec_policy& exec = http_exec_policy()) {
+        Handle("HEAD", relativePath, handlerFunc, exec);
+        Handle("GET", relativePath, handlerFunc, exec);
+        Handle("POST", relativePath, handlerFunc, exec);
+        Handle("PUT", relativePath, handlerFunc, exec);
+        Handle("DELETE", relativePath, handlerFunc, exec);
+        Handle("PATCH", relativePath, handlerFunc, exec);
     }
 };
 
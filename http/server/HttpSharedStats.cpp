@@ -0,0 +1,279 @@
+#include "HttpSharedStats.h"
+
+#include <atomic>
+
+#include "hplatform.h"
+#include "hdef.h"
+#include "herr.h"
+#include "hlog.h"
+#include "htime.h"
+
+#ifdef OS_UNIX
+#include <sys/mman.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+#define TOKEN_BITS          24
+#define TOKEN_MASK          ((1ULL << TOKEN_BITS) - 1)
+#define TOKEN_SCALE         256
+// a slot not refilled for so long can be taken by another key
+#define LIMITER_IDLE_MS     60000
+#define LIMITER_PROBES      16
+
+namespace hv {
+
+// NOTE: the segment is zero-filled, that is a valid state for the atomics.
+struct SharedRoute {
+    std::atomic<uint64_t>   key;    // 0: empty
+    std::atomic<int>        ready;  // method and route are written
+    int                     method;
+    char                    route[HTTP_SHARED_STATS_ROUTE_MAXLEN];
+    // 1xx ~ 5xx
+    std::atomic<uint64_t>   codes[6];
+};
+
+struct SharedLimiter {
+    std::atomic<uint64_t>   key;    // 0: empty
+    std::atomic<uint64_t>   state;  // last_ms << TOKEN_BITS | tokens, 0: full bucket
+};
+
+struct SharedSegment {
+    size_t                  size;
+    uint64_t                start_ms;
+    uint32_t                max_limiters;
+    std::atomic<int64_t>    connections;
+    std::atomic<uint64_t>   accepts;
+    std::atomic<uint64_t>   requests;
+    std::atomic<uint64_t>   recv_bytes;
+    std::atomic<uint64_t>   send_bytes;
+    std::atomic<uint64_t>   rate_limited;
+    std::atomic<uint64_t>   rate_limit_overflows;
+    SharedRoute             routes[HTTP_SHARED_STATS_MAX_ROUTES];
+    SharedLimiter           limiters[1]; // max_limiters
+};
+
+static SharedSegment* s_segment = NULL;
+static const std::string s_unrouted("*");
+
+// FNV-1a, never 0
+static uint64_t hash_bytes(const void* data, size_t len, uint64_t hash = 14695981039346656037ULL) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash ? hash : 1;
+}
+
+// ms since Init, never 0, the same clock in all processes.
+static uint64_t segment_now_ms(SharedSegment* segment) {
+    return gethrtime_us() / 1000 - segment->start_ms + 1;
+}
+
+int HttpSharedStats::Init(uint32_t max_limiters) {
+    if (s_segment) return 0;
+    uint32_t n = 1;
+    while (n < max_limiters) n <<= 1;
+    size_t size = sizeof(SharedSegment) + (n - 1) * sizeof(SharedLimiter);
+#ifdef OS_UNIX
+    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        hloge("mmap shared stats %u bytes failed!", (unsigned int)size);
+        return ERR_MALLOC;
+    }
+#else
+    // NOTE: no worker processes, a process-local segment is enough.
+    void* addr = calloc(1, size);
+    if (addr == NULL) return ERR_MALLOC;
+#endif
+    SharedSegment* segment = (SharedSegment*)addr;
+    segment->size = size;
+    segment->start_ms = gethrtime_us() / 1000;
+    segment->max_limiters = n;
+    s_segment = segment;
+    return 0;
+}
+
+void HttpSharedStats::Cleanup() {
+    if (s_segment == NULL) return;
+#ifdef OS_UNIX
+    munmap(s_segment, s_segment->size);
+#else
+    free(s_segment);
+#endif
+    s_segment = NULL;
+}
+
+bool HttpSharedStats::IsEnabled() {
+    return s_segment != NULL;
+}
+
+void HttpSharedStats::OnAccept() {
+    if (s_segment == NULL) return;
+    s_segment->connections.fetch_add(1, std::memory_order_relaxed);
+    s_segment->accepts.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HttpSharedStats::OnClose() {
+    if (s_segment == NULL) return;
+    s_segment->connections.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void HttpSharedStats::AddRecvBytes(uint64_t bytes) {
+    if (s_segment == NULL) return;
+    s_segment->recv_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void HttpSharedStats::AddSendBytes(uint64_t bytes) {
+    if (s_segment == NULL) return;
+    s_segment->send_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+int64_t HttpSharedStats::Connections() {
+    if (s_segment == NULL) return 0;
+    return s_segment->connections.load(std::memory_order_relaxed);
+}
+
+static SharedRoute* find_route(SharedSegment* segment, http_method method, const std::string& route) {
+    uint64_t hash = hash_bytes(route.data(), route.size(), hash_bytes(&method, sizeof(method)));
+    for (uint32_t i = 0; i < HTTP_SHARED_STATS_MAX_ROUTES; ++i) {
+        SharedRoute* slot = &segment->routes[(hash + i) % HTTP_SHARED_STATS_MAX_ROUTES];
+        uint64_t key = slot->key.load(std::memory_order_acquire);
+        if (key == 0) {
+            if (!slot->key.compare_exchange_strong(key, hash)) {
+                if (key == hash) return slot;
+                continue;
+            }
+            slot->method = method;
+            strncpy(slot->route, route.c_str(), sizeof(slot->route) - 1);
+            slot->ready.store(1, std::memory_order_release);
+            return slot;
+        }
+        if (key == hash) return slot;
+    }
+    return NULL;
+}
+
+void HttpSharedStats::ObserveRequest(http_method method, const std::string* route, int status_code) {
+    SharedSegment* segment = s_segment;
+    if (segment == NULL) return;
+    segment->requests.fetch_add(1, std::memory_order_relaxed);
+    SharedRoute* slot = find_route(segment, method, route ? *route : s_unrouted);
+    if (slot == NULL) return;
+    int code_class = status_code / 100;
+    if (code_class < 1 || code_class > 5) code_class = 0;
+    slot->codes[code_class].fetch_add(1, std::memory_order_relaxed);
+}
+
+static SharedLimiter* find_limiter(SharedSegment* segment, uint64_t hash, uint64_t now) {
+    uint32_t mask = segment->max_limiters - 1;
+    SharedLimiter* stale = NULL;
+    for (uint32_t i = 0; i < LIMITER_PROBES; ++i) {
+        SharedLimiter* slot = &segment->limiters[(hash + i) & mask];
+        uint64_t key = slot->key.load(std::memory_order_acquire);
+        if (key == 0) {
+            if (slot->key.compare_exchange_strong(key, hash)) return slot;
+        }
+        if (key == hash) return slot;
+        uint64_t state = slot->state.load(std::memory_order_relaxed);
+        if (stale == NULL && state != 0 && now > (state >> TOKEN_BITS) + LIMITER_IDLE_MS) {
+            stale = slot;
+        }
+    }
+    if (stale) {
+        // NOTE: a request of the old key racing with us just starts with a full bucket.
+        uint64_t key = stale->key.load(std::memory_order_acquire);
+        if (stale->key.compare_exchange_strong(key, hash)) {
+            stale->state.store(0, std::memory_order_relaxed);
+            return stale;
+        }
+    }
+    return NULL;
+}
+
+bool HttpSharedStats::RateLimit(const std::string& key, double rate, double burst, double cost) {
+    SharedSegment* segment = s_segment;
+    if (segment == NULL) return true;
+    uint64_t now = segment_now_ms(segment);
+    SharedLimiter* slot = find_limiter(segment, hash_bytes(key.data(), key.size()), now);
+    if (slot == NULL) {
+        segment->rate_limit_overflows.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    uint64_t max_tokens = (uint64_t)(MIN(burst, (double)HTTP_SHARED_RATE_LIMIT_MAX_BURST) * TOKEN_SCALE);
+    uint64_t need = (uint64_t)(cost * TOKEN_SCALE);
+    double tokens_per_ms = rate * TOKEN_SCALE / 1000;
+    uint64_t state = slot->state.load(std::memory_order_relaxed);
+    while (1) {
+        uint64_t last = state >> TOKEN_BITS;
+        uint64_t tokens = state & TOKEN_MASK;
+        if (state == 0) {
+            last = now;
+            tokens = max_tokens;
+        } else if (now > last && tokens_per_ms > 0) {
+            uint64_t add = (uint64_t)((now - last) * tokens_per_ms);
+            if (tokens + add >= max_tokens) {
+                tokens = max_tokens;
+                last = now;
+            } else if (add) {
+                tokens += add;
+                // NOTE: keep the time of the fraction not refilled
+                last = MIN(now, last + (uint64_t)(add / tokens_per_ms));
+            }
+        }
+        if (tokens > max_tokens) tokens = max_tokens;
+        bool allowed = tokens >= need;
+        if (allowed) tokens -= need;
+        if (slot->state.compare_exchange_weak(state, last << TOKEN_BITS | tokens, std::memory_order_relaxed)) {
+            if (!allowed) {
+                segment->rate_limited.fetch_add(1, std::memory_order_relaxed);
+            }
+            return allowed;
+        }
+    }
+}
+
+static void dump_value(std::string& out, const char* name, const char* type, const char* help, long long value) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "# HELP %s %s\n# TYPE %s %s\n%s %lld\n", name, help, name, type, name, value);
+    out += buf;
+}
+
+void HttpSharedStats::Dump(std::string& out) {
+    SharedSegment* segment = s_segment;
+    if (segment == NULL) return;
+    long long keys = 0;
+    for (uint32_t i = 0; i < segment->max_limiters; ++i) {
+        if (segment->limiters[i].key.load(std::memory_order_relaxed)) ++keys;
+    }
+    dump_value(out, "hv_shared_connections", "gauge", "Connections of all worker processes.", (long long)segment->connections.load());
+    dump_value(out, "hv_shared_accepts_total", "counter", "Accepted connections of all worker processes.", (long long)segment->accepts.load());
+    dump_value(out, "hv_shared_requests_total", "counter", "HTTP requests of all worker processes.", (long long)segment->requests.load());
+    dump_value(out, "hv_shared_recv_bytes_total", "counter", "Bytes received by all worker processes.", (long long)segment->recv_bytes.load());
+    dump_value(out, "hv_shared_send_bytes_total", "counter", "Response bytes sent by all worker processes.", (long long)segment->send_bytes.load());
+    dump_value(out, "hv_shared_rate_limited_total", "counter", "Requests rejected by shared rate limiters.", (long long)segment->rate_limited.load());
+    dump_value(out, "hv_shared_rate_limit_overflows_total", "counter", "Keys not limited for the rate limiter table is full.", (long long)segment->rate_limit_overflows.load());
+    dump_value(out, "hv_shared_rate_limit_keys", "gauge", "Slots taken in the rate limiter table.", keys);
+
+    const char* name = "hv_shared_http_requests_total";
+    out += "# HELP "; out += name; out += " HTTP requests of all worker processes by route and status class.\n";
+    out += "# TYPE "; out += name; out += " counter\n";
+    static const char* code_classes[6] = { "other", "1xx", "2xx", "3xx", "4xx", "5xx" };
+    char buf[512];
+    for (int i = 0; i < HTTP_SHARED_STATS_MAX_ROUTES; ++i) {
+        SharedRoute* slot = &segment->routes[i];
+        if (!slot->ready.load(std::memory_order_acquire)) continue;
+        for (int j = 0; j < 6; ++j) {
+            uint64_t count = slot->codes[j].load(std::memory_order_relaxed);
+            if (count == 0) continue;
+            snprintf(buf, sizeof(buf), "%s{method=\"%s\",route=\"%s\",code=\"%s\"} %llu\n", name,
+                    http_method_str((http_method)slot->method), slot->route, code_classes[j],
+                    (unsigned long long)count);
+            out += buf;
+        }
+    }
+}
+
+}
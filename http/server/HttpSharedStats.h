@@ -0,0 +1,79 @@
+#ifndef HV_HTTP_SHARED_STATS_H_
+#define HV_HTTP_SHARED_STATS_H_
+
+/*
+ * Counters and token-bucket rate limiters shared by all worker processes
+ *
+ * HttpService service;
+ * // 100 requests per second per client ip, bursts up to 200
+ * service.Use([](HttpRequest* req, HttpResponse* resp) {
+ *     if (!HttpSharedStats::RateLimit(req->client_addr.ip, 100, 200)) {
+ *         return HTTP_STATUS_TOO_MANY_REQUESTS;
+ *     }
+ *     return HTTP_STATUS_NEXT;
+ * });
+ * service.EnableMetrics("/metrics"); // dumps shared stats too
+ *
+ * HttpServer server(&service);
+ * server.setProcessNum(4);
+ * server.enableSharedStats();
+ * server.run();
+ *
+ * The segment is mapped shared and anonymous by http_server_run in the master
+ * before fork, so workers inherit it, any worker can read the totals.
+ * Nothing is locked: counters are atomics, routes and rate limiters live in
+ * fixed-size open-addressing tables whose slots are claimed by CAS.
+ * A token bucket is one 64-bit word updated by CAS:
+ * last refill time in ms (40 bits) and tokens in 1/256 (24 bits),
+ * so burst is limited to HTTP_SHARED_RATE_LIMIT_MAX_BURST.
+ *
+ */
+
+#include <string>
+
+#include "hexport.h"
+#include "httpdef.h"
+
+#define HTTP_SHARED_STATS_MAX_ROUTES        256
+#define HTTP_SHARED_STATS_ROUTE_MAXLEN      120
+#define HTTP_SHARED_STATS_DEFAULT_LIMITERS  65536
+#define HTTP_SHARED_RATE_LIMIT_MAX_BURST    65535
+
+namespace hv {
+
+class HV_EXPORT HttpSharedStats {
+public:
+    // NOTE: call it in master before fork, it does nothing if already inited.
+    // @param max_limiters: rate limiter slots, rounded up to power of 2.
+    static int  Init(uint32_t max_limiters = HTTP_SHARED_STATS_DEFAULT_LIMITERS);
+    static void Cleanup();
+    static bool IsEnabled();
+
+    // called by HttpServer
+    static void OnAccept();
+    static void OnClose();
+    static void AddRecvBytes(uint64_t bytes);
+    static void AddSendBytes(uint64_t bytes);
+    // @param route: path pattern of HttpService::pathHandlers, NULL means not routed to an API.
+    static void ObserveRequest(http_method method, const std::string* route, int status_code);
+
+    // connections of all worker processes
+    static int64_t Connections();
+
+    // token bucket keyed by key, e.g. client ip or api key.
+    // @param rate: tokens per second
+    // @param burst: bucket size
+    // @return true if cost tokens are taken, always true if not enabled,
+    //         or the key can not get a slot in a full table.
+    static bool RateLimit(const std::string& key, double rate, double burst, double cost = 1);
+    static bool RateLimit(const char* key, double rate, double burst, double cost = 1) {
+        return RateLimit(std::string(key), rate, burst, cost);
+    }
+
+    // Prometheus text format
+    static void Dump(std::string& out);
+};
+
+}
+
+#endif // HV_HTTP_SHARED_STATS_H_
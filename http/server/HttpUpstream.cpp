@@ -0,0 +1,427 @@
+#include "HttpUpstream.h"
+
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+
+#include "hasync.h"
+#include "hbase.h"
+#include "hlog.h"
+#include "htime.h"
+#include "hurl.h"
+#include "hversion.h"
+#include "hstring.h"
+
+namespace hv {
+
+static inline uint64_t upstream_now_ms() {
+    return gethrtime_us() / 1000;
+}
+
+UpstreamServer::UpstreamServer()
+    : port(0)
+    , https(false)
+    , weight(1)
+    , max_fails(DEFAULT_UPSTREAM_MAX_FAILS)
+    , fail_timeout(DEFAULT_UPSTREAM_FAIL_TIMEOUT)
+    , resolved(false)
+    , resolving(false)
+    , conns(0)
+    , fails(0)
+    , down_until(0)
+    , healthy(true)
+    , checking(false)
+{
+    memset(&addr, 0, sizeof(addr));
+}
+
+std::string UpstreamServer::Key() const {
+    return host + ":" + hv::to_string(port);
+}
+
+void UpstreamServer::OnFailure(uint64_t now_ms) {
+    if (max_fails <= 0) return;
+    if (++fails >= max_fails) {
+        fails = 0;
+        down_until = now_ms + fail_timeout;
+        hlogw("upstream %s:%d down for %dms", host.c_str(), port, fail_timeout);
+    }
+}
+
+void UpstreamServer::resolveAsync() {
+    bool resolving = false;
+    if (!this->resolving.compare_exchange_strong(resolving, true)) return;
+    UpstreamServerPtr self = shared_from_this();
+    hv::async::post([self]() {
+        sockaddr_u addr;
+        memset(&addr, 0, sizeof(addr));
+        if (sockaddr_set_ipport(&addr, self->host.c_str(), self->port) != 0) {
+            hlogw("upstream resolve %s failed", self->host.c_str());
+            self->resolving = false;
+            return;
+        }
+        // NOTE: resolving is left set, so addr is written once.
+        self->addr = addr;
+        self->resolved.store(true, std::memory_order_release);
+    });
+}
+
+hio_t* UpstreamServer::CreateSocket(hloop_t* loop) {
+    if (!resolved.load(std::memory_order_acquire)) {
+        resolveAsync();
+        return NULL;
+    }
+    int sockfd = socket(addr.sa.sa_family, SOCK_STREAM, 0);
+    if (sockfd < 0) {
+        perror("socket");
+        return NULL;
+    }
+    hio_t* io = hio_get(loop, sockfd);
+    assert(io != NULL);
+    hio_set_peeraddr(io, &addr.sa, sockaddr_len(&addr));
+    return io;
+}
+
+UpstreamGroup::UpstreamGroup(const char* name, load_balance_e lb)
+    : name(name)
+    , lb(lb)
+    , retries(1)
+    , keepalive_connections(DEFAULT_UPSTREAM_KEEPALIVE_CONNECTIONS)
+    , keepalive_timeout(DEFAULT_UPSTREAM_KEEPALIVE_TIMEOUT)
+    , health_check_interval(0)
+    , health_check_timeout(DEFAULT_UPSTREAM_HEALTH_CHECK_TIMEOUT)
+    , servers_(std::make_shared<UpstreamServers>())
+    , rr_index_(0)
+    , health_check_loop_(NULL)
+{}
+
+UpstreamServerPtr UpstreamGroup::newServer(const char* url, int weight, int max_fails, int fail_timeout) {
+    HUrl hurl;
+    if (!hurl.parse(url) || hurl.host.empty()) {
+        hloge("upstream %s: invalid server url %s", name.c_str(), url);
+        return NULL;
+    }
+    UpstreamServerPtr server = std::make_shared<UpstreamServer>();
+    server->host = hurl.host;
+    server->port = hurl.port;
+    server->https = hurl.scheme == "https";
+    server->weight = MAX(weight, 1);
+    server->max_fails = max_fails;
+    server->fail_timeout = fail_timeout;
+    if (sockaddr_set_ipport(&server->addr, server->host.c_str(), server->port) == 0) {
+        server->resolved = true;
+    } else {
+        hlogw("upstream %s: resolve %s failed", name.c_str(), server->host.c_str());
+    }
+    return server;
+}
+
+UpstreamServerPtr UpstreamGroup::AddServer(const char* url, int weight, int max_fails, int fail_timeout) {
+    UpstreamServerPtr server = newServer(url, weight, max_fails, fail_timeout);
+    if (server == NULL) return NULL;
+    std::lock_guard<std::mutex> locker(mutex_);
+    auto snapshot = std::make_shared<UpstreamServers>();
+    snapshot->servers = servers_.Latest()->servers;
+    snapshot->servers.push_back(server);
+    snapshot->rebuild();
+    servers_.Store(snapshot);
+    return server;
+}
+
+void UpstreamGroup::SetServers(const std::vector<std::pair<std::string, int>>& urls, int max_fails, int fail_timeout) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    UpstreamServersPtr old_snapshot = servers_.Latest();
+    const auto& old_servers = old_snapshot->servers;
+    auto snapshot = std::make_shared<UpstreamServers>();
+    for (const auto& url : urls) {
+        UpstreamServerPtr server = newServer(url.first.c_str(), url.second, max_fails, fail_timeout);
+        if (server == NULL) continue;
+        for (const auto& old_server : old_servers) {
+            if (old_server->Key() == server->Key() && old_server->https == server->https &&
+                old_server->weight == server->weight) {
+                server = old_server;
+                break;
+            }
+        }
+        snapshot->servers.push_back(server);
+    }
+    snapshot->rebuild();
+    hlogi("upstream %s: %u => %u servers", name.c_str(), (unsigned)old_servers.size(), (unsigned)snapshot->servers.size());
+    servers_.Store(snapshot);
+}
+
+UpstreamServersPtr UpstreamGroup::Servers() const {
+    return servers_.Load();
+}
+
+void UpstreamServers::rebuild() {
+    // smooth weighted round robin: a:5 b:1 c:1 => a a b a c a a
+    int total = 0;
+    for (const auto& server : servers) {
+        total += server->weight;
+    }
+    std::vector<int> current(servers.size(), 0);
+    rr_schedule.clear();
+    for (int n = 0; n < total; ++n) {
+        int best = 0;
+        for (size_t i = 0; i < servers.size(); ++i) {
+            current[i] += servers[i]->weight;
+            if (current[i] > current[best]) best = i;
+        }
+        current[best] -= total;
+        rr_schedule.push_back(best);
+    }
+
+    // consistent hash ring
+    ring.clear();
+    for (size_t i = 0; i < servers.size(); ++i) {
+        std::string key = servers[i]->Key();
+        int vnodes = UPSTREAM_VIRTUAL_NODES * servers[i]->weight;
+        for (int v = 0; v < vnodes; ++v) {
+            std::string vnode = key + "#" + hv::to_string(v);
+            ring.emplace_back(hv_hash(vnode.c_str(), vnode.size()), (int)i);
+        }
+    }
+    std::sort(ring.begin(), ring.end());
+}
+
+bool UpstreamGroup::selectable(UpstreamServer* server, uint64_t now_ms, bool ignore_down,
+                               const std::vector<UpstreamServer*>* tried) {
+    if (tried && std::find(tried->begin(), tried->end(), server) != tried->end()) {
+        return false;
+    }
+    return ignore_down || server->IsAvailable(now_ms);
+}
+
+UpstreamServerPtr UpstreamGroup::Select(const char* key, const std::vector<UpstreamServer*>* tried) {
+    UpstreamServersPtr snapshot = Servers();
+    const auto& servers = snapshot->servers;
+    const auto& ring = snapshot->ring;
+    if (servers.empty()) return NULL;
+    uint64_t now_ms = upstream_now_ms();
+    load_balance_e method = lb;
+    if ((method == LB_IpHash || method == LB_UrlHash) && (key == NULL || *key == '\0')) {
+        method = LB_RoundRobin;
+    }
+    unsigned int rr_start = method == LB_RoundRobin ? rr_index_++ : 0;
+    // first pass: available servers, second pass: ignore down servers
+    for (int pass = 0; pass < 2; ++pass) {
+        bool ignore_down = pass == 1;
+        int idx = -1;
+        switch (method) {
+        case LB_Random:
+        {
+            int total = 0;
+            for (const auto& server : servers) {
+                if (selectable(server.get(), now_ms, ignore_down, tried)) total += server->weight;
+            }
+            if (total == 0) break;
+            int r = hv_rand(0, total - 1);
+            for (size_t i = 0; i < servers.size(); ++i) {
+                if (!selectable(servers[i].get(), now_ms, ignore_down, tried)) continue;
+                r -= servers[i]->weight;
+                if (r < 0) {
+                    idx = i;
+                    break;
+                }
+            }
+            break;
+        }
+        case LB_LeastConnections:
+        {
+            for (size_t i = 0; i < servers.size(); ++i) {
+                UpstreamServer* server = servers[i].get();
+                if (!selectable(server, now_ms, ignore_down, tried)) continue;
+                // conns / weight < best_conns / best_weight
+                if (idx < 0 || (int64_t)server->conns * servers[idx]->weight <
+                               (int64_t)servers[idx]->conns * server->weight) {
+                    idx = i;
+                }
+            }
+            break;
+        }
+        case LB_IpHash:
+        case LB_UrlHash:
+        {
+            uint32_t hash = hv_hash(key, strlen(key));
+            auto iter = std::lower_bound(ring.begin(), ring.end(), std::make_pair(hash, 0));
+            for (size_t n = 0; n < ring.size(); ++n, ++iter) {
+                if (iter == ring.end()) iter = ring.begin();
+                if (selectable(servers[iter->second].get(), now_ms, ignore_down, tried)) {
+                    idx = iter->second;
+                    break;
+                }
+            }
+            break;
+        }
+        default:
+        {
+            size_t n = snapshot->rr_schedule.size();
+            for (size_t i = 0; i < n; ++i) {
+                int j = snapshot->rr_schedule[(rr_start + i) % n];
+                if (selectable(servers[j].get(), now_ms, ignore_down, tried)) {
+                    idx = j;
+                    break;
+                }
+            }
+            break;
+        }
+        }
+        if (idx >= 0) return servers[idx];
+    }
+    return NULL;
+}
+
+//------------------health check--------------------------------------
+struct UpstreamHealthCheck {
+    UpstreamGroup*      group;
+    UpstreamServerPtr   server;
+    bool                ok;
+};
+
+static void on_health_check_close(hio_t* io) {
+    UpstreamHealthCheck* check = (UpstreamHealthCheck*)hevent_userdata(io);
+    if (check == NULL) return;
+    hevent_set_userdata(io, NULL);
+    UpstreamServer* server = check->server.get();
+    server->checking = false;
+    if (server->healthy != check->ok) {
+        if (check->ok) {
+            hlogi("upstream %s: %s:%d is healthy", check->group->name.c_str(), server->host.c_str(), server->port);
+        } else {
+            hlogw("upstream %s: %s:%d is unhealthy", check->group->name.c_str(), server->host.c_str(), server->port);
+        }
+        server->healthy = check->ok;
+    }
+    delete check;
+}
+
+static void on_health_check_recv(hio_t* io, void* buf, int readbytes) {
+    UpstreamHealthCheck* check = (UpstreamHealthCheck*)hevent_userdata(io);
+    // HTTP/1.1 200 OK
+    const char* status_line = (const char*)buf;
+    if (check && readbytes > 12 && strncmp(status_line, "HTTP/1.", 7) == 0) {
+        int status_code = atoi(status_line + 9);
+        check->ok = status_code >= 200 && status_code < 400;
+    }
+    hio_close(io);
+}
+
+static void on_health_check_connect(hio_t* io) {
+    UpstreamHealthCheck* check = (UpstreamHealthCheck*)hevent_userdata(io);
+    UpstreamGroup* group = check->group;
+    if (group->health_check_path.empty()) {
+        check->ok = true;
+        hio_close(io);
+        return;
+    }
+    std::string request = "GET " + group->health_check_path + " HTTP/1.1\r\n";
+    request += "Host: " + check->server->Key() + "\r\n";
+    request += "User-Agent: libhv/" HV_VERSION_STRING "\r\n";
+    request += "Connection: close\r\n\r\n";
+    hio_setcb_read(io, on_health_check_recv);
+    hio_set_read_timeout(io, group->health_check_timeout);
+    hio_write(io, request.c_str(), request.size());
+    hio_read_start(io);
+}
+
+static void health_check(hloop_t* loop, UpstreamGroup* group, const UpstreamServerPtr& server) {
+    // NOTE: skip if the last check is still in flight, i.e. health_check_timeout > health_check_interval
+    bool checking = false;
+    if (!server->checking.compare_exchange_strong(checking, true)) return;
+    hio_t* io = server->CreateSocket(loop);
+    if (io == NULL) {
+        server->checking = false;
+        server->healthy = false;
+        return;
+    }
+    if (server->https) {
+        hio_enable_ssl(io);
+        hio_set_hostname(io, server->host.c_str());
+    }
+    UpstreamHealthCheck* check = new UpstreamHealthCheck;
+    check->group = group;
+    check->server = server;
+    check->ok = false;
+    hevent_set_userdata(io, check);
+    hio_setcb_connect(io, on_health_check_connect);
+    hio_setcb_close(io, on_health_check_close);
+    hio_set_connect_timeout(io, group->health_check_timeout);
+    hio_connect(io);
+}
+
+static void on_health_check_timer(htimer_t* timer) {
+    UpstreamGroup* group = (UpstreamGroup*)hevent_userdata(timer);
+    hloop_t* loop = hevent_loop(timer);
+    UpstreamServersPtr snapshot = group->Servers();
+    for (const auto& server : snapshot->servers) {
+        health_check(loop, group, server);
+    }
+}
+
+void UpstreamGroup::StartHealthCheck(hloop_t* loop) {
+    // NOTE: servers may be set later by SetServers
+    if (health_check_interval <= 0) return;
+    hloop_t* started = NULL;
+    if (!health_check_loop_.compare_exchange_strong(started, loop)) return;
+    htimer_t* timer = htimer_add(loop, on_health_check_timer, health_check_interval);
+    hevent_set_userdata(timer, this);
+}
+
+//------------------UpstreamConnPool--------------------------------------
+// NOTE: one pool per loop thread, so no lock needed.
+// host:port => idle connections
+static thread_local std::unordered_map<std::string, std::list<hio_t*>> s_idle_conns;
+
+static void on_idle_close(hio_t* io) {
+    for (auto& pair : s_idle_conns) {
+        auto& conns = pair.second;
+        auto iter = std::find(conns.begin(), conns.end(), io);
+        if (iter != conns.end()) {
+            conns.erase(iter);
+            return;
+        }
+    }
+}
+
+static void on_idle_recv(hio_t* io, void* buf, int readbytes) {
+    (void)buf;
+    (void)readbytes;
+    // NOTE: idle connection should not receive anything
+    hio_close(io);
+}
+
+hio_t* UpstreamConnPool::Get(hloop_t* loop, const std::string& key) {
+    auto iter = s_idle_conns.find(key);
+    if (iter == s_idle_conns.end()) return NULL;
+    auto& conns = iter->second;
+    // LIFO: the most recently used connection is least likely closed by server
+    for (auto it = conns.rbegin(); it != conns.rend(); ++it) {
+        hio_t* io = *it;
+        if (hevent_loop(io) != loop) continue;
+        conns.erase(std::next(it).base());
+        hio_setcb_close(io, NULL);
+        hio_setcb_read(io, NULL);
+        hio_set_keepalive_timeout(io, 0);
+        return io;
+    }
+    return NULL;
+}
+
+bool UpstreamConnPool::Put(hio_t* io, const std::string& key, int max_idle, int idle_timeout) {
+    if (max_idle <= 0 || hio_is_closed(io)) return false;
+    auto& conns = s_idle_conns[key];
+    if ((int)conns.size() >= max_idle) return false;
+    hevent_set_userdata(io, NULL);
+    hio_setcb_read(io, on_idle_recv);
+    hio_setcb_write(io, NULL);
+    hio_setcb_close(io, on_idle_close);
+    if (idle_timeout > 0) {
+        hio_set_keepalive_timeout(io, idle_timeout);
+    }
+    hio_read_start(io);
+    conns.push_back(io);
+    return true;
+}
+
+}
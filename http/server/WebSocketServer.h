@@ -19,12 +19,21 @@ struct WebSocketService {
     std::function<void(const WebSocketChannelPtr&, const std::string&)>     onmessage;
     std::function<void(const WebSocketChannelPtr&)>                         onclose;
     int ping_interval;
+    // permessage-deflate
+    bool enable_compression;
+    WebSocketDeflateOptions compression;
 
-    WebSocketService() : ping_interval(0) {}
+    WebSocketService() : ping_interval(0), enable_compression(false) {}
 
     void setPingInterval(int ms) {
         ping_interval = ms;
     }
+
+    // NOTE: require WITH_ZLIB
+    void setCompression(const WebSocketDeflateOptions& options = WebSocketDeflateOptions()) {
+        enable_compression = WebSocketDeflate::IsSupported();
+        compression = options;
+    }
 };
 
 class WebSocketServer : public HttpServer {
@@ -39,6 +39,8 @@ typedef enum websocket_flags {
     // marks
     WS_FINAL_FRAME = 0x10,
     WS_HAS_MASK    = 0x20,
+    // permessage-deflate
+    WS_RSV1        = 0x40,
 } websocket_flags;
 
 #define WS_OP_MASK 0xF
@@ -92,6 +94,7 @@ size_t websocket_build_frame(char * frame, websocket_flags flags, const char mas
 #define websocket_parser_get_opcode(p) (p->flags & WS_OP_MASK)
 #define websocket_parser_has_mask(p) (p->flags & WS_HAS_MASK)
 #define websocket_parser_has_final(p) (p->flags & WS_FIN)
+#define websocket_parser_has_rsv1(p) (p->flags & WS_RSV1)
 
 #ifdef __cplusplus
 }
@@ -24,6 +24,9 @@
 // 1000 1010 1000 0000
 #define WS_CLIENT_PONG_FRAME        "\212\200WSWS"
 
+// 0100 0000: permessage-deflate compressed message
+#define WS_RSV1_BIT                 0x40
+
 enum ws_session_type {
     WS_CLIENT,
     WS_SERVER,
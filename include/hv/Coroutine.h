@@ -0,0 +1,576 @@
+#ifndef HV_COROUTINE_HPP_
+#define HV_COROUTINE_HPP_
+
+/*
+ * C++20 coroutines over EventLoop
+ *
+ * hv::Task<void> session(hv::SocketChannelPtr channel) {
+ *     hv::CoChannel conn(channel);
+ *     while (true) {
+ *         std::string_view data = co_await conn.read();
+ *         if (data.empty()) break;
+ *         if (co_await conn.write(data) < 0) break;
+ *     }
+ * }
+ * server.onConnection = [](const hv::SocketChannelPtr& channel) {
+ *     if (channel->isConnected()) hv::co_spawn(session(channel));
+ * };
+ *
+ * Coroutines run in the loop thread which spawns them and are resumed by
+ * the loop's own io, timer and custom events, no thread is added.
+ * Frames are allocated from a per-thread pool, see CoFramePool.
+ *
+ * The library itself is built with C++11, everything here is header-only
+ * and enabled when the including translation unit is compiled with C++20.
+ *
+ */
+
+#if defined(__cplusplus) && (__cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L))
+#if defined(__has_include)
+#if __has_include(<coroutine>)
+#define HV_WITH_COROUTINE   1
+#endif
+#endif
+#endif
+
+#ifdef HV_WITH_COROUTINE
+
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "EventLoop.h"
+#include "Channel.h"
+#include "hasync.h"
+#include "hlog.h"
+
+namespace hv {
+
+// Coroutine frames of one size class are recycled in the thread which frees them,
+// frames larger than MAX_FRAME_SIZE go to the global allocator.
+class CoFramePool {
+public:
+    enum {
+        FRAME_ALIGN         = 64,
+        MAX_FRAME_SIZE      = 2048,
+        CLASS_NUM           = MAX_FRAME_SIZE / FRAME_ALIGN,
+        MAX_FREE_PER_CLASS  = 1024,
+    };
+
+    static void* alloc(size_t size) {
+        if (size > MAX_FRAME_SIZE) return ::operator new(size);
+        size_t idx = (size - 1) / FRAME_ALIGN;
+        FreeList& list = instance().lists_[idx];
+        if (list.head) {
+            Node* node = list.head;
+            list.head = node->next;
+            --list.count;
+            return node;
+        }
+        return ::operator new((idx + 1) * FRAME_ALIGN);
+    }
+
+    static void free(void* ptr, size_t size) {
+        if (size > MAX_FRAME_SIZE) {
+            ::operator delete(ptr);
+            return;
+        }
+        FreeList& list = instance().lists_[(size - 1) / FRAME_ALIGN];
+        if (list.count >= MAX_FREE_PER_CLASS) {
+            ::operator delete(ptr);
+            return;
+        }
+        Node* node = (Node*)ptr;
+        node->next = list.head;
+        list.head = node;
+        ++list.count;
+    }
+
+    // frames cached by current thread
+    static size_t cached() {
+        size_t num = 0;
+        for (int i = 0; i < CLASS_NUM; ++i) {
+            num += instance().lists_[i].count;
+        }
+        return num;
+    }
+
+    ~CoFramePool() {
+        for (int i = 0; i < CLASS_NUM; ++i) {
+            Node* node = lists_[i].head;
+            while (node) {
+                Node* next = node->next;
+                ::operator delete(node);
+                node = next;
+            }
+            lists_[i].head = NULL;
+            lists_[i].count = 0;
+        }
+    }
+
+private:
+    struct Node { Node* next; };
+    struct FreeList {
+        Node*   head;
+        size_t  count;
+    };
+
+    CoFramePool() {
+        for (int i = 0; i < CLASS_NUM; ++i) {
+            lists_[i].head = NULL;
+            lists_[i].count = 0;
+        }
+    }
+
+    static CoFramePool& instance() {
+        static thread_local CoFramePool pool;
+        return pool;
+    }
+
+    FreeList lists_[CLASS_NUM];
+};
+
+template<typename T = void>
+class Task;
+
+namespace detail {
+
+struct CoPromiseBase {
+    std::coroutine_handle<>     continuation;
+    std::exception_ptr          exception;
+    // started by co_spawn, nobody awaits it
+    bool                        detached = false;
+
+    static void* operator new(size_t size) {
+        return CoFramePool::alloc(size);
+    }
+    static void operator delete(void* ptr, size_t size) {
+        CoFramePool::free(ptr, size);
+    }
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+            CoPromiseBase& promise = h.promise();
+            if (promise.continuation) {
+                return promise.continuation;
+            }
+            if (promise.detached) {
+                if (promise.exception) {
+                    hloge("coroutine exited with an uncaught exception");
+                }
+                h.destroy();
+            }
+            return std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    // lazy start, run at co_await or co_spawn
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template<typename T>
+struct CoPromise : public CoPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+
+    template<typename U>
+    void return_value(U&& v) {
+        value.emplace(std::forward<U>(v));
+    }
+
+    T result() {
+        if (exception) std::rethrow_exception(exception);
+        return std::move(*value);
+    }
+};
+
+template<>
+struct CoPromise<void> : public CoPromiseBase {
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void result() {
+        if (exception) std::rethrow_exception(exception);
+    }
+};
+
+}
+
+template<typename T>
+class Task {
+public:
+    typedef detail::CoPromise<T>                promise_type;
+    typedef std::coroutine_handle<promise_type> handle_type;
+
+    explicit Task(handle_type h = nullptr) : handle_(h) {}
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        if (handle_) handle_.destroy();
+    }
+
+    bool valid() const { return handle_ != nullptr; }
+
+    // co_await task: run it and resume the awaiting coroutine when it returns
+    bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+    T await_resume() {
+        return handle_.promise().result();
+    }
+
+    // run in current thread until the first suspension, the frame is freed when it returns
+    void detach() {
+        if (!handle_) return;
+        handle_type h = std::exchange(handle_, nullptr);
+        h.promise().detached = true;
+        h.resume();
+    }
+
+private:
+    handle_type handle_;
+};
+
+namespace detail {
+
+template<typename T>
+inline Task<T> CoPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<CoPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> CoPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<CoPromise<void>>::from_promise(*this));
+}
+
+// fn is kept in the frame as long as the coroutine it returns
+template<typename Fn>
+Task<void> co_invoke(Fn fn) {
+    co_await fn();
+}
+
+}
+
+// start a coroutine in current thread
+inline void co_spawn(Task<void>&& task) {
+    task.detach();
+}
+
+// start fn() in loop, fn may be a lambda with captures returning Task<void>
+template<typename Fn>
+void co_spawn(EventLoop* loop, Fn fn) {
+    loop->runInLoop([fn]() {
+        detail::co_invoke(fn).detach();
+    });
+}
+
+template<typename Fn>
+void co_spawn(const EventLoopPtr& loop, Fn fn) {
+    co_spawn(loop.get(), std::move(fn));
+}
+
+// co_await co_sleep(ms) in a loop thread
+// NOTE: the timer is deleted if the sleeping coroutine is destroyed.
+class SleepAwaiter {
+public:
+    explicit SleepAwaiter(int ms) : ms_(ms), timer_(NULL) {}
+    SleepAwaiter(const SleepAwaiter&) = delete;
+    SleepAwaiter& operator=(const SleepAwaiter&) = delete;
+
+    ~SleepAwaiter() {
+        if (timer_) htimer_del(timer_);
+    }
+
+    bool await_ready() const noexcept { return ms_ <= 0; }
+    void await_suspend(std::coroutine_handle<> h) {
+        EventLoop* loop = currentThreadEventLoop;
+        assert(loop != NULL);
+        handle_ = h;
+        timer_ = htimer_add(loop->loop(), on_timer, ms_, 1);
+        hevent_set_userdata(timer_, this);
+    }
+    void await_resume() noexcept {}
+
+private:
+    static void on_timer(htimer_t* timer) {
+        SleepAwaiter* self = (SleepAwaiter*)hevent_userdata(timer);
+        // freed by loop after this callback
+        self->timer_ = NULL;
+        self->handle_.resume();
+    }
+
+    int                     ms_;
+    htimer_t*               timer_;
+    std::coroutine_handle<> handle_;
+};
+
+inline SleepAwaiter co_sleep(int ms) {
+    return SleepAwaiter(ms);
+}
+
+// co_await co_resolve(host) => ip, empty if failed
+// NOTE: getaddrinfo blocks, it runs in GlobalThreadPool and the coroutine is resumed in its loop.
+class ResolveAwaiter {
+public:
+    explicit ResolveAwaiter(const std::string& host) : host_(host) {}
+
+    bool await_ready() {
+        if (is_ipaddr(host_.c_str())) {
+            ip_ = host_;
+            return true;
+        }
+        return false;
+    }
+    void await_suspend(std::coroutine_handle<> h) {
+        EventLoop* loop = currentThreadEventLoop;
+        assert(loop != NULL);
+        hv::async::post([this, h, loop]() {
+            sockaddr_u addr;
+            memset(&addr, 0, sizeof(addr));
+            if (ResolveAddr(host_.c_str(), &addr) == 0) {
+                char ip[SOCKADDR_STRLEN] = {0};
+                sockaddr_ip(&addr, ip, sizeof(ip));
+                ip_ = ip;
+            }
+            loop->queueInLoop([h]() {
+                h.resume();
+            });
+        });
+    }
+    std::string await_resume() { return std::move(ip_); }
+
+private:
+    std::string host_;
+    std::string ip_;
+};
+
+inline ResolveAwaiter co_resolve(const std::string& host) {
+    return ResolveAwaiter(host);
+}
+
+/*
+ * Awaitable read/write over a connected SocketChannel.
+ * CoChannel takes over channel->onread and channel->onwrite,
+ * channel->onclose set before (e.g. by TcpServer) is still called.
+ * Data arriving without a pending read is buffered and reading is paused.
+ * Use it in the channel's loop thread only.
+ */
+class CoChannel {
+public:
+    explicit CoChannel(const SocketChannelPtr& channel)
+        : channel_(channel)
+        , closed_(!channel->isOpened())
+        , paused_(false)
+        , from_pending_(false)
+    {
+        prev_onclose_ = std::move(channel_->onclose);
+        channel_->onread = [this](Buffer* buf) {
+            onRead(buf);
+        };
+        channel_->onwrite = [this](Buffer*) {
+            if (writer_ && channel_->isWriteComplete()) {
+                std::exchange(writer_, nullptr).resume();
+            }
+        };
+        channel_->onclose = [this]() {
+            onClose();
+        };
+        if (!closed_) channel_->startRead();
+    }
+
+    ~CoChannel() {
+        channel_->onread = NULL;
+        channel_->onwrite = NULL;
+        // onclose may be running if closed_
+        if (!closed_) {
+            channel_->onclose = std::move(prev_onclose_);
+            channel_->close();
+        }
+    }
+
+    const SocketChannelPtr& channel() { return channel_; }
+    bool isClosed() { return closed_; }
+    void close() { if (!closed_) channel_->close(); }
+
+    // co_await read() => data, empty if closed.
+    // NOTE: data is valid until the next co_await on this CoChannel.
+    class ReadAwaiter {
+    public:
+        explicit ReadAwaiter(CoChannel* conn) : conn_(conn) {}
+
+        bool await_ready() {
+            if (conn_->from_pending_) {
+                conn_->pending_.clear();
+                conn_->from_pending_ = false;
+            }
+            return !conn_->pending_.empty() || conn_->closed_;
+        }
+        void await_suspend(std::coroutine_handle<> h) {
+            conn_->reader_ = h;
+            if (conn_->paused_) {
+                conn_->paused_ = false;
+                conn_->channel_->startRead();
+            }
+        }
+        std::string_view await_resume() {
+            if (conn_->direct_.data()) {
+                return std::exchange(conn_->direct_, std::string_view());
+            }
+            if (!conn_->pending_.empty()) {
+                conn_->from_pending_ = true;
+                return conn_->pending_;
+            }
+            return std::string_view();
+        }
+
+    private:
+        CoChannel* conn_;
+    };
+    ReadAwaiter read() { return ReadAwaiter(this); }
+
+    // co_await write(data) => bytes, -1 if closed before all written.
+    // It is resumed when the write queue is empty.
+    class WriteAwaiter {
+    public:
+        WriteAwaiter(CoChannel* conn, const void* data, int size)
+            : conn_(conn), data_(data), size_(size), nwrite_(-1), suspended_(false) {}
+
+        bool await_ready() {
+            if (conn_->closed_) return true;
+            nwrite_ = conn_->channel_->write(data_, size_);
+            return nwrite_ < 0 || conn_->channel_->isWriteComplete();
+        }
+        void await_suspend(std::coroutine_handle<> h) {
+            suspended_ = true;
+            conn_->writer_ = h;
+        }
+        int await_resume() {
+            if (suspended_ && conn_->closed_) return -1;
+            return nwrite_;
+        }
+
+    private:
+        CoChannel*  conn_;
+        const void* data_;
+        int         size_;
+        int         nwrite_;
+        bool        suspended_;
+    };
+    WriteAwaiter write(const void* data, int size) { return WriteAwaiter(this, data, size); }
+    WriteAwaiter write(std::string_view data) { return WriteAwaiter(this, data.data(), (int)data.size()); }
+
+    // co_await CoChannel::connect(ip, port) => SocketChannelPtr, NULL if failed.
+    // NOTE: host is resolved synchronously, use co_resolve before for domain names.
+    class ConnectAwaiter {
+    public:
+        ConnectAwaiter(const std::string& host, int port, int timeout_ms)
+            : host_(host), port_(port), timeout_ms_(timeout_ms), connected_(false) {}
+
+        bool await_suspend(std::coroutine_handle<> h) {
+            EventLoop* loop = currentThreadEventLoop;
+            assert(loop != NULL);
+            hio_t* io = hio_create_socket(loop->loop(), host_.c_str(), port_, HIO_TYPE_TCP, HIO_CLIENT_SIDE);
+            if (io == NULL) return false;
+            channel_ = std::make_shared<SocketChannel>(io);
+            channel_->onconnect = [this, h]() {
+                connected_ = true;
+                h.resume();
+            };
+            // connect failed or timeout
+            // NOTE: resume later, the frame owning channel_ may be destroyed by the coroutine,
+            // which must not happen while channel_->onclose is running.
+            channel_->onclose = [this, h, loop]() {
+                if (!connected_) {
+                    loop->queueInLoop([h]() {
+                        h.resume();
+                    });
+                }
+            };
+            if (timeout_ms_ > 0) {
+                channel_->setConnectTimeout(timeout_ms_);
+            }
+            channel_->startConnect();
+            return true;
+        }
+        bool await_ready() { return false; }
+        SocketChannelPtr await_resume() {
+            if (!connected_) return NULL;
+            channel_->onclose = NULL;
+            return std::move(channel_);
+        }
+
+    private:
+        std::string         host_;
+        int                 port_;
+        int                 timeout_ms_;
+        bool                connected_;
+        SocketChannelPtr    channel_;
+    };
+    static ConnectAwaiter connect(const std::string& host, int port, int timeout_ms = HIO_DEFAULT_CONNECT_TIMEOUT) {
+        return ConnectAwaiter(host, port, timeout_ms);
+    }
+
+private:
+    void onRead(Buffer* buf) {
+        if (reader_) {
+            direct_ = std::string_view((const char*)buf->data(), buf->size());
+            std::exchange(reader_, nullptr).resume();
+            // NOTE: this may be destroyed by the resumed coroutine.
+            return;
+        }
+        pending_.append((const char*)buf->data(), buf->size());
+        if (!paused_) {
+            paused_ = true;
+            channel_->stopRead();
+        }
+    }
+
+    void onClose() {
+        closed_ = true;
+        std::function<void()> prev_onclose = std::move(prev_onclose_);
+        std::coroutine_handle<> h = std::exchange(reader_, nullptr);
+        if (!h) h = std::exchange(writer_, nullptr);
+        if (prev_onclose) prev_onclose();
+        if (h) h.resume();
+        // NOTE: this and this lambda may be destroyed here, no code should be added below.
+    }
+
+    SocketChannelPtr            channel_;
+    std::function<void()>       prev_onclose_;
+    bool                        closed_;
+    bool                        paused_;
+    std::coroutine_handle<>     reader_;
+    std::coroutine_handle<>     writer_;
+    // zero-copy view of readbuf when resumed in onread
+    std::string_view            direct_;
+    // received while nobody is reading
+    std::string                 pending_;
+    bool                        from_pending_;
+};
+
+}
+
+#endif // HV_WITH_COROUTINE
+
+#endif // HV_COROUTINE_HPP_
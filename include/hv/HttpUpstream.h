@@ -0,0 +1,178 @@
+#ifndef HV_HTTP_UPSTREAM_H_
+#define HV_HTTP_UPSTREAM_H_
+
+/*
+ * nginx:
+ * upstream backend {
+ *     least_conn;
+ *     server 127.0.0.1:8001 weight=2 max_fails=3 fail_timeout=10s;
+ *     server 127.0.0.1:8002;
+ *     keepalive 32;
+ * }
+ * location /api/ {
+ *     proxy_pass http://backend/;
+ * }
+ *
+ * libhv:
+ * auto backend = service.Upstream("backend", LB_LeastConnections);
+ * backend->AddServer("http://127.0.0.1:8001", 2, 3, 10000);
+ * backend->AddServer("http://127.0.0.1:8002");
+ * backend->keepalive_connections = 32;
+ * service.Proxy("/api/", "http://backend/");
+ *
+ * Servers can be replaced at runtime by SetServers, e.g. from ServiceDiscovery.
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "hexport.h"
+#include "hsocket.h"
+#include "hloop.h"
+#include "hsnapshot.h"
+
+#define DEFAULT_UPSTREAM_MAX_FAILS              1
+#define DEFAULT_UPSTREAM_FAIL_TIMEOUT           10000   // ms
+#define DEFAULT_UPSTREAM_KEEPALIVE_CONNECTIONS  32
+#define DEFAULT_UPSTREAM_KEEPALIVE_TIMEOUT      60000   // ms
+#define DEFAULT_UPSTREAM_HEALTH_CHECK_TIMEOUT   3000    // ms
+#define UPSTREAM_VIRTUAL_NODES                  160     // per weight, for consistent hash
+
+namespace hv {
+
+struct HV_EXPORT UpstreamServer : public std::enable_shared_from_this<UpstreamServer> {
+    std::string     host;
+    int             port;
+    bool            https;
+    int             weight;
+    // passive health check: max_fails failures => down for fail_timeout ms
+    int             max_fails;
+    int             fail_timeout;
+    // NOTE: resolved once by AddServer, so connecting never blocks on DNS,
+    //       else by CreateSocket on hv::async threadpool, never written once resolved.
+    sockaddr_u              addr;
+    std::atomic<bool>       resolved;
+    std::atomic<bool>       resolving;
+
+    std::atomic<int>        conns;      // active requests
+    std::atomic<int>        fails;
+    std::atomic<uint64_t>   down_until; // ms
+    std::atomic<bool>       healthy;    // active health check
+    std::atomic<bool>       checking;   // an active health check is in flight
+
+    UpstreamServer();
+
+    // host:port
+    std::string Key() const;
+    bool IsAvailable(uint64_t now_ms) const {
+        return healthy && now_ms >= down_until;
+    }
+    void OnSuccess() { fails = 0; }
+    void OnFailure(uint64_t now_ms);
+
+    // hio_create_socket without DNS lookup
+    // NOTE: NULL at once if not resolved yet, the host is then resolved asynchronously.
+    hio_t* CreateSocket(hloop_t* loop);
+
+private:
+    void resolveAsync();
+};
+
+typedef std::shared_ptr<UpstreamServer> UpstreamServerPtr;
+
+// NOTE: immutable once published, replaced as a whole by UpstreamGroup.
+struct HV_EXPORT UpstreamServers {
+    std::vector<UpstreamServerPtr>          servers;
+    // smooth weighted round robin schedule
+    std::vector<int>                        rr_schedule;
+    // consistent hash ring: hash => server index
+    std::vector<std::pair<uint32_t, int>>   ring;
+
+    void rebuild();
+};
+
+typedef std::shared_ptr<const UpstreamServers> UpstreamServersPtr;
+
+/*
+ * @lb
+ * LB_RoundRobin:       weighted round robin
+ * LB_Random:           weighted random
+ * LB_LeastConnections: least conns / weight
+ * LB_IpHash:           consistent hash by client ip
+ * LB_UrlHash:          consistent hash by request path
+ *
+ * NOTE: servers are published as a snapshot, see HSnapshot:
+ *       AddServer and SetServers copy, modify and store it under a mutex,
+ *       Select reuses the snapshot cached by its loop until the next update,
+ *       so it takes no lock between updates.
+ */
+struct HV_EXPORT UpstreamGroup {
+    std::string     name;
+    load_balance_e  lb;
+    // try next server if connect failed
+    int             retries;
+    // idle keepalive connections per loop per server, 0 means disabled
+    int             keepalive_connections;
+    int             keepalive_timeout; // ms
+    // active health check: connect, then GET health_check_path if not empty
+    int             health_check_interval; // ms, 0 means disabled
+    int             health_check_timeout;  // ms
+    std::string     health_check_path;
+
+    UpstreamGroup(const char* name = "", load_balance_e lb = LB_RoundRobin);
+
+    // @param url: http://host:port, https://host:port
+    UpstreamServerPtr AddServer(const char* url, int weight = 1,
+            int max_fails = DEFAULT_UPSTREAM_MAX_FAILS,
+            int fail_timeout = DEFAULT_UPSTREAM_FAIL_TIMEOUT);
+
+    // replace all servers, url => weight
+    // NOTE: servers with the same url and weight keep their state (conns, fails, healthy).
+    void SetServers(const std::vector<std::pair<std::string, int>>& urls,
+            int max_fails = DEFAULT_UPSTREAM_MAX_FAILS,
+            int fail_timeout = DEFAULT_UPSTREAM_FAIL_TIMEOUT);
+
+    // current snapshot, thread-safe
+    UpstreamServersPtr Servers() const;
+
+    // @param key: client ip for LB_IpHash, path for LB_UrlHash
+    // @param tried: servers already failed for this request
+    // NOTE: if all servers are unavailable, select one of them anyway.
+    UpstreamServerPtr Select(const char* key = NULL, const std::vector<UpstreamServer*>* tried = NULL);
+
+    // active health check by loop timer
+    // NOTE: started once per group, by the first loop that calls it, until StopHealthCheck.
+    void StartHealthCheck(hloop_t* loop);
+    // NOTE: call it after that loop stopped, the timer is freed with the loop.
+    void StopHealthCheck() { health_check_loop_ = NULL; }
+
+private:
+    UpstreamServerPtr newServer(const char* url, int weight, int max_fails, int fail_timeout);
+    bool selectable(UpstreamServer* server, uint64_t now_ms, bool ignore_down,
+                    const std::vector<UpstreamServer*>* tried);
+
+    HSnapshot<UpstreamServers>              servers_;
+    // writers: AddServer, SetServers
+    std::mutex                              mutex_;
+    std::atomic<unsigned int>               rr_index_;
+    std::atomic<hloop_t*>                   health_check_loop_;
+};
+
+typedef std::shared_ptr<UpstreamGroup> UpstreamGroupPtr;
+
+// per-loop idle keepalive connections to upstream servers
+class HV_EXPORT UpstreamConnPool {
+public:
+    // @return idle connected io on loop, NULL if none
+    static hio_t* Get(hloop_t* loop, const std::string& key);
+    // @return false if pool is full, caller should close io
+    static bool   Put(hio_t* io, const std::string& key, int max_idle, int idle_timeout);
+};
+
+}
+
+#endif // HV_HTTP_UPSTREAM_H_
@@ -0,0 +1,897 @@
+#ifndef HV_MQTT_BROKER_HPP_
+#define HV_MQTT_BROKER_HPP_
+
+/*
+ * Embedded MQTT v3.1.1 broker based on TcpServer
+ *
+ * hv::MqttBroker broker;
+ * broker.setThreadNum(4);
+ * broker.listen(1883);
+ * broker.start();
+ *
+ * Supported: + and # wildcards, $share/group/filter shared subscriptions (round robin),
+ * retained messages, will messages, QoS 0/1 delivery with per-session inflight window.
+ * QoS 2 publishes are acknowledged by PUBREC/PUBCOMP and delivered as QoS 1.
+ * Sessions are always clean: subscriptions and pending messages are dropped on disconnect.
+ *
+ * Fan-out:
+ * Each worker loop owns a topic tree of its own sessions, so subscribing and matching
+ * take no lock. A PUBLISH is framed once, the same buffer is posted to the inbox of
+ * every loop and written to each subscriber; the QoS 1 packet identifier is patched
+ * in a per-loop copy, because hio_write copies the unsent bytes before returning.
+ * When a loop falls behind and drains several messages at once, packets to the same
+ * subscriber are coalesced into one write.
+ *
+ * @example examples/mqtt/mqtt_broker.cpp
+ * @bench   examples/mqtt/mqtt_broker_bench.cpp
+ */
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <functional>
+
+#include "TcpServer.h"
+#include "mqtt_protocol.h"
+#include "hendian.h"
+
+#define DEFAULT_MQTT_BROKER_MAX_PACKET_SIZE         (1 << 20)   // 1M
+#define DEFAULT_MQTT_BROKER_MAX_INFLIGHT            64
+#define DEFAULT_MQTT_BROKER_MAX_QUEUED_MESSAGES     1024
+#define DEFAULT_MQTT_BROKER_MAX_WRITE_BUFSIZE       (1 << 22)   // 4M
+
+namespace hv {
+
+// framed PUBLISH shared by all subscribers, immutable after created
+struct MqttPublish {
+    std::string     topic;
+    std::string     payload;
+    unsigned char   qos;
+    bool            retain;
+    uint64_t        seq;
+    // QoS 0 packet, and QoS 1 packet with mid = 0 at mid_offset
+    std::string     packet0;
+    std::string     packet1;
+    size_t          mid_offset;
+
+    MqttPublish(const std::string& topic, const std::string& payload,
+                unsigned char qos, bool retain, uint64_t seq)
+        : topic(topic), payload(payload), qos(qos > 1 ? 1 : qos), retain(retain), seq(seq), mid_offset(0)
+    {
+        frame(packet0, 0);
+        if (this->qos) frame(packet1, 1);
+    }
+
+private:
+    void frame(std::string& packet, unsigned char pub_qos) {
+        mqtt_head_t head;
+        memset(&head, 0, sizeof(head));
+        head.type = MQTT_TYPE_PUBLISH;
+        head.qos = pub_qos;
+        head.retain = retain;
+        head.length = 2 + topic.size() + (pub_qos ? 2 : 0) + payload.size();
+        packet.resize(mqtt_estimate_length(&head));
+        unsigned char* buf = (unsigned char*)&packet[0];
+        unsigned char* p = buf;
+        p += mqtt_head_pack(&head, p);
+        PUSH16(p, topic.size());
+        PUSH_N(p, topic.data(), topic.size());
+        if (pub_qos) {
+            mid_offset = p - buf;
+            PUSH16(p, 0);
+        }
+        if (payload.size()) {
+            PUSH_N(p, payload.data(), payload.size());
+        }
+        packet.resize(p - buf);
+    }
+};
+
+typedef std::shared_ptr<MqttPublish> MqttPublishPtr;
+
+struct MqttBrokerStats {
+    std::atomic<uint64_t>   connections;
+    std::atomic<uint64_t>   received;   // PUBLISH from clients
+    std::atomic<uint64_t>   delivered;  // PUBLISH to subscribers
+    std::atomic<uint64_t>   dropped;    // slow subscribers
+
+    MqttBrokerStats() : connections(0), received(0), delivered(0), dropped(0) {}
+};
+
+class MqttBroker {
+public:
+    // @retval mqtt_connack_e
+    typedef std::function<int(const std::string& client_id,
+                              const std::string& username,
+                              const std::string& password)> AuthCallback;
+    AuthCallback        onAuth;
+
+    // unacknowledged QoS 1 deliveries per session
+    int                 max_inflight;
+    // QoS 1 deliveries waiting for the inflight window, the newest are dropped if exceeded
+    int                 max_queued_messages;
+    // QoS 0 deliveries are dropped if the write queue of subscriber exceeds it
+    size_t              max_write_bufsize;
+    uint32_t            max_packet_size;
+    MqttBrokerStats     stats;
+
+    MqttBroker()
+        : max_inflight(DEFAULT_MQTT_BROKER_MAX_INFLIGHT)
+        , max_queued_messages(DEFAULT_MQTT_BROKER_MAX_QUEUED_MESSAGES)
+        , max_write_bufsize(DEFAULT_MQTT_BROKER_MAX_WRITE_BUFSIZE)
+        , max_packet_size(DEFAULT_MQTT_BROKER_MAX_PACKET_SIZE)
+        , num_contexts_(0)
+        , shared_num_(0)
+        , seq_(0)
+    {}
+
+    ~MqttBroker() {
+        stop();
+        for (auto ctx : contexts_) {
+            delete ctx;
+        }
+    }
+
+    //@retval >=0 listenfd, <0 error
+    int listen(int port = DEFAULT_MQTT_PORT, const char* host = "0.0.0.0") {
+        return server_.createsocket(port, host);
+    }
+
+    // NOTE: totalThreadNum = 1 acceptor_thread + N worker_threads (N can be 0)
+    void setThreadNum(int num) {
+        server_.setThreadNum(num);
+    }
+
+    void setMaxConnectionNum(uint32_t num) {
+        server_.setMaxConnectionNum(num);
+    }
+
+    int withTLS(hssl_ctx_opt_t* opt = NULL) {
+        return server_.withTLS(opt);
+    }
+
+    size_t connectionNum() {
+        return server_.connectionNum();
+    }
+
+    // start thread-safe
+    void start(bool wait_threads_started = true) {
+        // one context per loop, never reallocated while running
+        if (contexts_.empty()) {
+            contexts_.resize(MAX_LOOPS, NULL);
+        }
+        unpack_setting_t unpack_setting;
+        unpack_setting.mode = UNPACK_BY_LENGTH_FIELD;
+        unpack_setting.package_max_length = max_packet_size;
+        unpack_setting.body_offset = 2;
+        unpack_setting.length_field_offset = 1;
+        unpack_setting.length_field_bytes = 1;
+        unpack_setting.length_field_coding = ENCODE_BY_VARINT;
+        server_.setUnpack(&unpack_setting);
+        server_.onConnection = [this](const SocketChannelPtr& channel) {
+            if (channel->isConnected()) {
+                onConnect(channel);
+            } else {
+                onClose(channel);
+            }
+        };
+        server_.onMessage = [this](const SocketChannelPtr& channel, Buffer* buf) {
+            onPacket(channel, (const unsigned char*)buf->data(), buf->size());
+        };
+        server_.start(wait_threads_started);
+    }
+
+    // stop thread-safe
+    void stop(bool wait_threads_stopped = true) {
+        server_.stop(wait_threads_stopped);
+    }
+
+    // publish thread-safe
+    void publish(const std::string& topic, const std::string& payload, int qos = 0, bool retain = false) {
+        route(std::make_shared<MqttPublish>(topic, payload, qos, false, ++seq_), retain);
+    }
+
+    // filter: a/+/c, a/#
+    // NOTE: wildcards at the first level do not match topics beginning with $
+    static bool TopicMatch(const char* filter, const char* topic) {
+        if (*topic == '$' && (*filter == '+' || *filter == '#')) return false;
+        while (true) {
+            // at the beginning of a level
+            if (*filter == '#') return true;
+            if (*filter == '+') {
+                ++filter;
+                while (*topic && *topic != '/') ++topic;
+            } else {
+                while (*filter && *filter != '/') {
+                    if (*filter++ != *topic++) return false;
+                }
+                if (*topic && *topic != '/') return false;
+            }
+            if (*filter == '\0') return *topic == '\0';
+            // a/# matches a
+            if (*topic == '\0') return strcmp(filter, "/#") == 0;
+            ++filter;
+            ++topic;
+        }
+    }
+
+    static bool IsValidTopic(const std::string& topic) {
+        return !topic.empty() && topic.find_first_of("+#") == std::string::npos;
+    }
+
+    static bool IsValidFilter(const std::string& filter) {
+        if (filter.empty()) return false;
+        for (size_t i = 0; i < filter.size(); ++i) {
+            char c = filter[i];
+            if (c != '+' && c != '#') continue;
+            if (i > 0 && filter[i-1] != '/') return false;
+            if (c == '#' && i != filter.size() - 1) return false;
+            if (c == '+' && i != filter.size() - 1 && filter[i+1] != '/') return false;
+        }
+        return true;
+    }
+
+private:
+    enum { MAX_LOOPS = 256 };
+    struct LoopContext;
+
+    struct Session {
+        uint32_t        id;
+        hio_t*          io;
+        LoopContext*    ctx;
+        bool            connected;
+        bool            disconnected; // DISCONNECT received, do not publish will
+        std::string     client_id;
+        MqttPublishPtr  will;
+        bool            will_retain;
+        // filter => granted qos
+        std::map<std::string, unsigned char> subscriptions;
+        // outgoing QoS 1
+        unsigned short  next_mid;
+        std::unordered_set<unsigned short>  inflight;
+        std::deque<MqttPublishPtr>          pending;
+        // coalesced PUBLISH packets of one dispatch
+        std::string     outbuf;
+
+        Session() : id(0), io(NULL), ctx(NULL), connected(false), disconnected(false),
+                    will_retain(false), next_mid(0) {}
+
+        unsigned short nextMid() {
+            if (++next_mid == 0) next_mid = 1;
+            return next_mid;
+        }
+    };
+
+    // not thread-safe, owned by one loop
+    struct TopicTree {
+        struct Node {
+            std::unordered_map<std::string, std::unique_ptr<Node>> children;
+            std::unordered_map<Session*, unsigned char>             subscribers;
+        };
+        Node root;
+
+        void subscribe(const std::string& filter, Session* session, unsigned char qos) {
+            Node* node = &root;
+            for (const auto& level : splitLevels(filter)) {
+                std::unique_ptr<Node>& child = node->children[level];
+                if (!child) child.reset(new Node);
+                node = child.get();
+            }
+            node->subscribers[session] = qos;
+        }
+
+        void unsubscribe(const std::string& filter, Session* session) {
+            unsubscribe(&root, splitLevels(filter), 0, session);
+        }
+
+        // matched nodes => subscribers
+        void match(const std::string& topic, std::vector<Node*>& nodes) {
+            match(&root, splitLevels(topic), 0, topic[0] == '$', nodes);
+        }
+
+    private:
+        // NOTE: empty levels are kept, a//b => a, "", b
+        static std::vector<std::string> splitLevels(const std::string& str) {
+            std::vector<std::string> levels;
+            size_t begin = 0;
+            while (true) {
+                size_t end = str.find('/', begin);
+                if (end == std::string::npos) {
+                    levels.push_back(str.substr(begin));
+                    break;
+                }
+                levels.push_back(str.substr(begin, end - begin));
+                begin = end + 1;
+            }
+            return levels;
+        }
+
+        // @retval true if node is empty
+        bool unsubscribe(Node* node, const std::vector<std::string>& levels, size_t i, Session* session) {
+            if (i == levels.size()) {
+                node->subscribers.erase(session);
+            } else {
+                auto iter = node->children.find(levels[i]);
+                if (iter == node->children.end()) return false;
+                if (unsubscribe(iter->second.get(), levels, i + 1, session)) {
+                    node->children.erase(iter);
+                }
+            }
+            return node->subscribers.empty() && node->children.empty();
+        }
+
+        void match(Node* node, const std::vector<std::string>& levels, size_t i, bool dollar, std::vector<Node*>& nodes) {
+            bool wildcard = !(i == 0 && dollar);
+            if (wildcard) {
+                auto iter = node->children.find("#");
+                if (iter != node->children.end()) nodes.push_back(iter->second.get());
+            }
+            if (i == levels.size()) {
+                if (!node->subscribers.empty()) nodes.push_back(node);
+                return;
+            }
+            if (wildcard) {
+                auto iter = node->children.find("+");
+                if (iter != node->children.end()) match(iter->second.get(), levels, i + 1, dollar, nodes);
+            }
+            auto iter = node->children.find(levels[i]);
+            if (iter != node->children.end()) match(iter->second.get(), levels, i + 1, dollar, nodes);
+        }
+    };
+
+    // session_id == 0 means fan-out by topic tree
+    struct Delivery {
+        MqttPublishPtr  msg;
+        uint32_t        session_id;
+        unsigned char   qos;
+    };
+
+    struct LoopContext {
+        EventLoop*      loop;
+        TopicTree       tree;
+        std::unordered_map<uint32_t, Session*> sessions;
+        // per-loop copy of QoS 1 packet to patch mid
+        std::string     packet1;
+        uint64_t        packet1_seq;
+        // sessions with outbuf to flush after dispatch
+        bool                    coalescing;
+        std::vector<Session*>   flushing;
+        // posted by other loops
+        std::mutex              inbox_mutex;
+        std::vector<Delivery>   inbox;
+
+        LoopContext(EventLoop* loop) : loop(loop), packet1_seq(0), coalescing(false) {}
+    };
+
+    struct SharedMember {
+        LoopContext*    ctx;
+        uint32_t        session_id;
+        unsigned char   qos;
+    };
+
+    struct SharedGroup {
+        std::string                 filter;
+        std::vector<SharedMember>   members;
+        size_t                      next;
+        SharedGroup() : next(0) {}
+    };
+
+    LoopContext* currentContext() {
+        EventLoop* loop = currentThreadEventLoop;
+        int num = num_contexts_.load(std::memory_order_acquire);
+        for (int i = 0; i < num; ++i) {
+            if (contexts_[i]->loop == loop) return contexts_[i];
+        }
+        std::lock_guard<std::mutex> locker(contexts_mutex_);
+        num = num_contexts_.load(std::memory_order_relaxed);
+        assert(num < MAX_LOOPS);
+        contexts_[num] = new LoopContext(loop);
+        num_contexts_.store(num + 1, std::memory_order_release);
+        return contexts_[num];
+    }
+
+    void onConnect(const SocketChannelPtr& channel) {
+        Session* session = channel->newContext<Session>();
+        session->id = channel->id();
+        session->io = channel->io();
+        session->ctx = currentContext();
+        session->ctx->sessions[session->id] = session;
+        ++stats.connections;
+        // CONNECT must arrive in time
+        hio_set_keepalive_timeout(session->io, 10000);
+    }
+
+    void onClose(const SocketChannelPtr& channel) {
+        Session* session = channel->getContext<Session>();
+        if (session == NULL) return;
+        LoopContext* ctx = session->ctx;
+        for (auto& sub : session->subscriptions) {
+            unsubscribe(session, sub.first);
+        }
+        ctx->sessions.erase(session->id);
+        if (session->connected) {
+            std::lock_guard<std::mutex> locker(clients_mutex_);
+            auto iter = clients_.find(session->client_id);
+            if (iter != clients_.end() && iter->second.second == session->id) {
+                clients_.erase(iter);
+            }
+        }
+        if (session->will && !session->disconnected) {
+            route(session->will, session->will_retain);
+        }
+        --stats.connections;
+        channel->deleteContext<Session>();
+    }
+
+    static void sendAck(hio_t* io, int type, unsigned short mid) {
+        mqtt_head_t head;
+        memset(&head, 0, sizeof(head));
+        head.type = type;
+        head.length = 2;
+        unsigned char buf[8] = { 0 };
+        unsigned char* p = buf;
+        p += mqtt_head_pack(&head, p);
+        PUSH16(p, mid);
+        hio_write(io, buf, p - buf);
+    }
+
+    static void sendConnack(hio_t* io, int rc) {
+        unsigned char buf[4] = { MQTT_TYPE_CONNACK << 4, 2, 0, (unsigned char)rc };
+        hio_write(io, buf, sizeof(buf));
+    }
+
+    #define MQTT_BROKER_CHECK(cond) \
+        if (!(cond)) { \
+            hlogw("MQTT broker received malformed packet type=%d", (int)head.type); \
+            hio_close(io); \
+            return; \
+        }
+
+    #define MQTT_BROKER_POP_STRING(str) \
+        MQTT_BROKER_CHECK(end - p >= 2); \
+        POP16(p, len); \
+        MQTT_BROKER_CHECK(end - p >= len); \
+        str.assign((const char*)p, len); \
+        p += len;
+
+    void onPacket(const SocketChannelPtr& channel, const unsigned char* buf, int size) {
+        Session* session = channel->getContext<Session>();
+        hio_t* io = session->io;
+        mqtt_head_t head;
+        memset(&head, 0, sizeof(head));
+        int headlen = mqtt_head_unpack(&head, buf, size);
+        if (headlen <= 0) {
+            hio_close(io);
+            return;
+        }
+        const unsigned char* p = buf + headlen;
+        const unsigned char* end = p + head.length;
+        unsigned short len = 0, mid = 0;
+        if (!session->connected && head.type != MQTT_TYPE_CONNECT) {
+            hio_close(io);
+            return;
+        }
+        switch (head.type) {
+        case MQTT_TYPE_CONNECT:
+        {
+            MQTT_BROKER_CHECK(!session->connected);
+            std::string protocol_name, client_id, username, password;
+            unsigned char protocol_version = 0, conn_flags = 0;
+            unsigned short keepalive = 0;
+            MQTT_BROKER_POP_STRING(protocol_name);
+            MQTT_BROKER_CHECK(end - p >= 4);
+            POP8(p, protocol_version);
+            POP8(p, conn_flags);
+            POP16(p, keepalive);
+            if (protocol_version != MQTT_PROTOCOL_V31 && protocol_version != MQTT_PROTOCOL_V311) {
+                sendConnack(io, MQTT_CONNACK_REFUSED_PROTOCOL_VERSION);
+                hio_close(io);
+                return;
+            }
+            MQTT_BROKER_POP_STRING(client_id);
+            if (conn_flags & MQTT_CONN_HAS_WILL) {
+                std::string will_topic, will_payload;
+                MQTT_BROKER_POP_STRING(will_topic);
+                MQTT_BROKER_POP_STRING(will_payload);
+                MQTT_BROKER_CHECK(IsValidTopic(will_topic));
+                session->will = std::make_shared<MqttPublish>(will_topic, will_payload,
+                        (conn_flags >> 3) & 0x03, false, ++seq_);
+                session->will_retain = (conn_flags & MQTT_CONN_WILL_RETAIN) != 0;
+            }
+            if (conn_flags & MQTT_CONN_HAS_USERNAME) {
+                MQTT_BROKER_POP_STRING(username);
+            }
+            if (conn_flags & MQTT_CONN_HAS_PASSWORD) {
+                MQTT_BROKER_POP_STRING(password);
+            }
+            if (client_id.empty()) {
+                if (!(conn_flags & MQTT_CONN_CLEAN_SESSION)) {
+                    sendConnack(io, MQTT_CONNACK_REFUSED_IDENTIFIER_REJECTED);
+                    hio_close(io);
+                    return;
+                }
+                client_id = "auto-" + std::to_string(session->id);
+            }
+            if (onAuth) {
+                int rc = onAuth(client_id, username, password);
+                if (rc != MQTT_CONNACK_ACCEPTED) {
+                    sendConnack(io, rc);
+                    hio_close(io);
+                    return;
+                }
+            }
+            session->client_id = client_id;
+            session->connected = true;
+            // take over the session with the same client_id
+            std::pair<LoopContext*, uint32_t> old(NULL, 0);
+            {
+                std::lock_guard<std::mutex> locker(clients_mutex_);
+                auto& client = clients_[client_id];
+                old = client;
+                client = std::make_pair(session->ctx, session->id);
+            }
+            if (old.first) {
+                uint32_t old_id = old.second;
+                LoopContext* old_ctx = old.first;
+                old_ctx->loop->runInLoop([old_ctx, old_id]() {
+                    auto iter = old_ctx->sessions.find(old_id);
+                    if (iter != old_ctx->sessions.end()) {
+                        hio_close(iter->second->io);
+                    }
+                });
+            }
+            // 1.5 times keepalive
+            hio_set_keepalive_timeout(io, keepalive ? keepalive * 1500 : 0);
+            sendConnack(io, MQTT_CONNACK_ACCEPTED);
+        }
+            break;
+        case MQTT_TYPE_PUBLISH:
+        {
+            std::string topic;
+            MQTT_BROKER_POP_STRING(topic);
+            MQTT_BROKER_CHECK(IsValidTopic(topic) && head.qos < 3);
+            if (head.qos > 0) {
+                MQTT_BROKER_CHECK(end - p >= 2);
+                POP16(p, mid);
+            }
+            ++stats.received;
+            std::string payload((const char*)p, end - p);
+            route(std::make_shared<MqttPublish>(topic, payload, (unsigned char)head.qos, false, ++seq_), head.retain);
+            if (head.qos == 1) {
+                sendAck(io, MQTT_TYPE_PUBACK, mid);
+            } else if (head.qos == 2) {
+                // NOTE: delivered on PUBLISH, PUBREL only completes the handshake
+                sendAck(io, MQTT_TYPE_PUBREC, mid);
+            }
+        }
+            break;
+        case MQTT_TYPE_PUBREL:
+        {
+            MQTT_BROKER_CHECK(end - p >= 2);
+            POP16(p, mid);
+            sendAck(io, MQTT_TYPE_PUBCOMP, mid);
+        }
+            break;
+        case MQTT_TYPE_PUBACK:
+        {
+            MQTT_BROKER_CHECK(end - p >= 2);
+            POP16(p, mid);
+            session->inflight.erase(mid);
+            while (!session->pending.empty() && (int)session->inflight.size() < max_inflight) {
+                MqttPublishPtr msg = session->pending.front();
+                session->pending.pop_front();
+                sendPublish(session, msg, 1);
+            }
+        }
+            break;
+        case MQTT_TYPE_PUBREC:
+        case MQTT_TYPE_PUBCOMP:
+            // never deliver QoS 2
+            break;
+        case MQTT_TYPE_SUBSCRIBE:
+        {
+            MQTT_BROKER_CHECK(end - p >= 2);
+            POP16(p, mid);
+            std::vector<std::pair<std::string, unsigned char>> filters;
+            std::string ack;
+            while (p < end) {
+                std::string filter;
+                unsigned char qos = 0;
+                MQTT_BROKER_POP_STRING(filter);
+                MQTT_BROKER_CHECK(end - p >= 1);
+                POP8(p, qos);
+                if (!subscribe(session, filter, qos > 1 ? 1 : qos)) {
+                    ack.push_back((char)0x80);
+                    continue;
+                }
+                ack.push_back(qos > 1 ? 1 : qos);
+                filters.emplace_back(filter, qos > 1 ? 1 : qos);
+            }
+            MQTT_BROKER_CHECK(!ack.empty());
+            mqtt_head_t suback;
+            memset(&suback, 0, sizeof(suback));
+            suback.type = MQTT_TYPE_SUBACK;
+            suback.length = 2 + ack.size();
+            std::string packet(mqtt_estimate_length(&suback), '\0');
+            unsigned char* q = (unsigned char*)&packet[0];
+            q += mqtt_head_pack(&suback, q);
+            PUSH16(q, mid);
+            PUSH_N(q, ack.data(), ack.size());
+            hio_write(io, packet.data(), q - (unsigned char*)packet.data());
+            // retained messages after SUBACK
+            for (auto& filter : filters) {
+                if (strncmp(filter.first.c_str(), "$share/", 7) == 0) continue;
+                std::vector<MqttPublishPtr> msgs;
+                {
+                    std::lock_guard<std::mutex> locker(retained_mutex_);
+                    for (auto& retained : retained_) {
+                        if (TopicMatch(filter.first.c_str(), retained.first.c_str())) {
+                            msgs.push_back(retained.second);
+                        }
+                    }
+                }
+                for (auto& msg : msgs) {
+                    deliver(session, msg, filter.second);
+                }
+            }
+        }
+            break;
+        case MQTT_TYPE_UNSUBSCRIBE:
+        {
+            MQTT_BROKER_CHECK(end - p >= 2);
+            POP16(p, mid);
+            while (p < end) {
+                std::string filter;
+                MQTT_BROKER_POP_STRING(filter);
+                if (session->subscriptions.erase(filter)) {
+                    unsubscribe(session, filter);
+                }
+            }
+            sendAck(io, MQTT_TYPE_UNSUBACK, mid);
+        }
+            break;
+        case MQTT_TYPE_PINGREQ:
+        {
+            unsigned char pong[2] = { MQTT_TYPE_PINGRESP << 4, 0 };
+            hio_write(io, pong, sizeof(pong));
+        }
+            break;
+        case MQTT_TYPE_DISCONNECT:
+            session->disconnected = true;
+            hio_close(io);
+            break;
+        default:
+            hlogw("MQTT broker received wrong type=%d", (int)head.type);
+            hio_close(io);
+            break;
+        }
+    }
+
+    #undef MQTT_BROKER_POP_STRING
+    #undef MQTT_BROKER_CHECK
+
+    // $share/group/filter
+    static bool parseSharedFilter(const std::string& filter, std::string& group, std::string& real_filter) {
+        if (strncmp(filter.c_str(), "$share/", 7) != 0) return false;
+        size_t pos = filter.find('/', 7);
+        if (pos == std::string::npos || pos == 7) return false;
+        group = filter.substr(7, pos - 7);
+        real_filter = filter.substr(pos + 1);
+        return true;
+    }
+
+    bool subscribe(Session* session, const std::string& filter, unsigned char qos) {
+        std::string group, real_filter;
+        bool shared = parseSharedFilter(filter, group, real_filter);
+        if (!IsValidFilter(shared ? real_filter : filter)) return false;
+        if (shared && group.find_first_of("+#") != std::string::npos) return false;
+        auto iter = session->subscriptions.find(filter);
+        if (iter != session->subscriptions.end()) {
+            unsubscribe(session, filter);
+        }
+        session->subscriptions[filter] = qos;
+        if (!shared) {
+            session->ctx->tree.subscribe(filter, session, qos);
+            return true;
+        }
+        std::lock_guard<std::mutex> locker(shared_mutex_);
+        SharedGroup& shared_group = shared_[filter];
+        shared_group.filter = real_filter;
+        SharedMember member = { session->ctx, session->id, qos };
+        shared_group.members.push_back(member);
+        ++shared_num_;
+        return true;
+    }
+
+    void unsubscribe(Session* session, const std::string& filter) {
+        if (strncmp(filter.c_str(), "$share/", 7) != 0) {
+            session->ctx->tree.unsubscribe(filter, session);
+            return;
+        }
+        std::lock_guard<std::mutex> locker(shared_mutex_);
+        auto iter = shared_.find(filter);
+        if (iter == shared_.end()) return;
+        auto& members = iter->second.members;
+        for (auto it = members.begin(); it != members.end(); ++it) {
+            if (it->session_id == session->id) {
+                members.erase(it);
+                --shared_num_;
+                break;
+            }
+        }
+        if (members.empty()) shared_.erase(iter);
+    }
+
+    // thread-safe
+    void route(const MqttPublishPtr& msg, bool retain) {
+        if (retain) {
+            std::lock_guard<std::mutex> locker(retained_mutex_);
+            if (msg->payload.empty()) {
+                retained_.erase(msg->topic);
+            } else {
+                // NOTE: retain flag is set only for deliveries on subscribe
+                retained_[msg->topic] = std::make_shared<MqttPublish>(msg->topic, msg->payload, msg->qos, true, ++seq_);
+            }
+        }
+        int num = num_contexts_.load(std::memory_order_acquire);
+        for (int i = 0; i < num; ++i) {
+            post(contexts_[i], msg, 0, 0);
+        }
+        if (shared_num_ == 0) return;
+        std::lock_guard<std::mutex> locker(shared_mutex_);
+        for (auto& pair : shared_) {
+            SharedGroup& group = pair.second;
+            if (group.members.empty() || !TopicMatch(group.filter.c_str(), msg->topic.c_str())) continue;
+            SharedMember& member = group.members[group.next++ % group.members.size()];
+            post(member.ctx, msg, member.session_id, member.qos);
+        }
+    }
+
+    void post(LoopContext* ctx, const MqttPublishPtr& msg, uint32_t session_id, unsigned char qos) {
+        Delivery delivery = { msg, session_id, qos };
+        bool notify = false;
+        {
+            std::lock_guard<std::mutex> locker(ctx->inbox_mutex);
+            notify = ctx->inbox.empty();
+            ctx->inbox.push_back(std::move(delivery));
+        }
+        // one event for a batch of deliveries
+        if (notify) {
+            ctx->loop->queueInLoop([this, ctx]() {
+                dispatch(ctx);
+            });
+        }
+    }
+
+    void dispatch(LoopContext* ctx) {
+        std::vector<Delivery> deliveries;
+        {
+            std::lock_guard<std::mutex> locker(ctx->inbox_mutex);
+            deliveries.swap(ctx->inbox);
+        }
+        uint64_t delivered = 0;
+        // NOTE: more than one message in inbox means loop is busy,
+        // coalesce all packets to the same session into one write.
+        ctx->coalescing = deliveries.size() > 1;
+        std::vector<TopicTree::Node*> nodes;
+        std::unordered_map<Session*, unsigned char> merged;
+        for (auto& delivery : deliveries) {
+            const MqttPublishPtr& msg = delivery.msg;
+            if (delivery.session_id) {
+                auto iter = ctx->sessions.find(delivery.session_id);
+                if (iter != ctx->sessions.end()) {
+                    delivered += deliver(iter->second, msg, delivery.qos);
+                }
+                continue;
+            }
+            nodes.clear();
+            ctx->tree.match(msg->topic, nodes);
+            if (nodes.size() == 1) {
+                for (auto& sub : nodes[0]->subscribers) {
+                    delivered += deliver(sub.first, msg, sub.second);
+                }
+                continue;
+            }
+            // overlapping subscriptions: deliver once with the maximum qos
+            merged.clear();
+            for (auto node : nodes) {
+                for (auto& sub : node->subscribers) {
+                    unsigned char& qos = merged[sub.first];
+                    if (sub.second > qos) qos = sub.second;
+                }
+            }
+            for (auto& sub : merged) {
+                delivered += deliver(sub.first, msg, sub.second);
+            }
+        }
+        if (ctx->coalescing) {
+            for (auto session : ctx->flushing) {
+                hio_write(session->io, session->outbuf.data(), session->outbuf.size());
+                session->outbuf.clear();
+            }
+            ctx->flushing.clear();
+            ctx->coalescing = false;
+        }
+        if (delivered) stats.delivered += delivered;
+    }
+
+    void sendPacket(Session* session, const char* data, size_t size) {
+        LoopContext* ctx = session->ctx;
+        if (!ctx->coalescing) {
+            hio_write(session->io, data, size);
+            return;
+        }
+        if (session->outbuf.empty()) {
+            ctx->flushing.push_back(session);
+        }
+        session->outbuf.append(data, size);
+    }
+
+    // @retval 1 if sent or queued, 0 if dropped
+    int deliver(Session* session, const MqttPublishPtr& msg, unsigned char qos) {
+        if (msg->qos < qos) qos = msg->qos;
+        if (qos == 0) {
+            if (hio_write_bufsize(session->io) + session->outbuf.size() > max_write_bufsize) {
+                ++stats.dropped;
+                return 0;
+            }
+            sendPacket(session, msg->packet0.data(), msg->packet0.size());
+            return 1;
+        }
+        if ((int)session->inflight.size() >= max_inflight) {
+            if ((int)session->pending.size() >= max_queued_messages) {
+                ++stats.dropped;
+                return 0;
+            }
+            session->pending.push_back(msg);
+            return 1;
+        }
+        sendPublish(session, msg, qos);
+        return 1;
+    }
+
+    void sendPublish(Session* session, const MqttPublishPtr& msg, unsigned char qos) {
+        if (qos == 0) {
+            sendPacket(session, msg->packet0.data(), msg->packet0.size());
+            return;
+        }
+        LoopContext* ctx = session->ctx;
+        if (ctx->packet1_seq != msg->seq) {
+            ctx->packet1 = msg->packet1;
+            ctx->packet1_seq = msg->seq;
+        }
+        unsigned short mid = session->nextMid();
+        session->inflight.insert(mid);
+        unsigned char* p = (unsigned char*)&ctx->packet1[msg->mid_offset];
+        PUSH16(p, mid);
+        sendPacket(session, ctx->packet1.data(), ctx->packet1.size());
+    }
+
+private:
+    TcpServer                   server_;
+    // LoopContext per loop, appended when the first connection comes
+    std::vector<LoopContext*>   contexts_;
+    std::atomic<int>            num_contexts_;
+    std::mutex                  contexts_mutex_;
+    // client_id => (ctx, session_id)
+    std::unordered_map<std::string, std::pair<LoopContext*, uint32_t>> clients_;
+    std::mutex                  clients_mutex_;
+    // $share/group/filter => members
+    std::map<std::string, SharedGroup>  shared_;
+    std::atomic<int>            shared_num_;
+    std::mutex                  shared_mutex_;
+    // topic => retained message
+    std::unordered_map<std::string, MqttPublishPtr> retained_;
+    std::mutex                  retained_mutex_;
+    std::atomic<uint64_t>       seq_;
+};
+
+}
+
+#endif // HV_MQTT_BROKER_HPP_
@@ -0,0 +1,213 @@
+#ifndef HV_SERVICE_DISCOVERY_H_
+#define HV_SERVICE_DISCOVERY_H_
+
+/*
+ * Service discovery with watches and a local cache
+ *
+ * @code
+
+#include "ServiceDiscovery.h"
+
+hv::ServiceDiscovery discovery(std::make_shared<hv::ConsulDiscoveryBackend>("http://127.0.0.1:8500"));
+// HttpService upstream group follows the passing instances of service "web"
+discovery.BindUpstream("web", service.Upstream("web"));
+discovery.Watch("cache", [](const std::string& name, const hv::ServiceInstancesPtr& instances) {
+    printf("%s: %u instances\n", name.c_str(), (unsigned)instances->size());
+});
+discovery.Start();
+...
+// any thread
+hv::ServiceInstancesPtr instances = discovery.Get("cache");
+
+ * @endcode
+ *
+ * Each watched service is queried by a blocking query (long-poll) in the discovery loop:
+ * the backend returns at once for index 0, else when the service changes from index,
+ * or after wait_ms. The instances are published as an immutable snapshot, copied and
+ * swapped by the discovery loop, so Get from any loop returns a snapshot valid while held.
+ * NOTE: Get reuses the snapshot cached by the calling thread until the next update,
+ *       see HSnapshot, so it takes no lock between updates.
+ * On errors, the last snapshot is kept and the query is retried with backoff.
+ *
+ * Backends:
+ * ConsulDiscoveryBackend:  GET /v1/health/service/<name>?passing=1&index=<index>&wait=<wait>
+ * FileDiscoveryBackend:    JSON file polled for changes
+ * {
+ *   "web": [
+ *     { "address": "127.0.0.1", "port": 8001, "weight": 2, "tags": ["v1"] }
+ *   ]
+ * }
+ *
+ */
+
+#include <map>
+
+#include "AsyncHttpClient.h"
+#include "hsnapshot.h"
+
+#define DEFAULT_DISCOVERY_WAIT              60000   // ms
+#define DEFAULT_DISCOVERY_RETRY_INTERVAL    1000    // ms
+#define DEFAULT_DISCOVERY_MAX_RETRY_DELAY   30000   // ms
+#define DEFAULT_DISCOVERY_POLL_INTERVAL     1000    // ms
+
+namespace hv {
+
+struct HV_EXPORT ServiceInstance {
+    std::string id;
+    std::string address;
+    int         port;
+    int         weight;
+    std::vector<std::string> tags;
+
+    ServiceInstance() : port(0), weight(1) {}
+
+    // address:port
+    std::string Key() const;
+    // http://address:port
+    std::string Url(const char* scheme = "http") const;
+    bool operator==(const ServiceInstance& rhs) const {
+        return id == rhs.id && address == rhs.address && port == rhs.port &&
+               weight == rhs.weight && tags == rhs.tags;
+    }
+};
+
+typedef std::vector<ServiceInstance>            ServiceInstances;
+typedef std::shared_ptr<const ServiceInstances> ServiceInstancesPtr;
+
+/*
+ * @param error:     0 if ok, else ERR_* of herr.h or http status code
+ * @param instances: sorted by Key, NULL if error
+ * @param index:     pass it to the next Query to wait for changes
+ */
+typedef std::function<void(int error, const ServiceInstancesPtr& instances, uint64_t index)> DiscoveryQueryCallback;
+
+class HV_EXPORT DiscoveryBackend {
+public:
+    virtual ~DiscoveryBackend() {}
+    // Called in the loop thread of ServiceDiscovery, cb must be called in it too.
+    // @param index: 0 returns at once, else returns when the service changes from index, or after wait_ms.
+    virtual void Query(const EventLoopPtr& loop, const std::string& service,
+                       uint64_t index, int wait_ms, DiscoveryQueryCallback cb) = 0;
+};
+
+typedef std::shared_ptr<DiscoveryBackend> DiscoveryBackendPtr;
+
+// Consul compatible HTTP API
+class HV_EXPORT ConsulDiscoveryBackend : public DiscoveryBackend {
+public:
+    // @param url: http://127.0.0.1:8500
+    ConsulDiscoveryBackend(const char* url = "http://127.0.0.1:8500") : url_(url) {}
+
+    // only passing instances by default
+    bool        passing = true;
+    // filter by tag if not empty
+    std::string tag;
+    // X-Consul-Token
+    std::string token;
+
+    virtual void Query(const EventLoopPtr& loop, const std::string& service,
+                       uint64_t index, int wait_ms, DiscoveryQueryCallback cb);
+
+    // parse the response body of /v1/health/service/<name>
+    static int ParseInstances(const std::string& body, ServiceInstances& instances);
+
+private:
+    std::string                         url_;
+    // created in the loop of ServiceDiscovery
+    std::shared_ptr<AsyncHttpClient>    client_;
+};
+
+// static JSON file, see above
+class HV_EXPORT FileDiscoveryBackend : public DiscoveryBackend {
+public:
+    FileDiscoveryBackend(const char* filepath, int poll_interval_ms = DEFAULT_DISCOVERY_POLL_INTERVAL)
+        : filepath_(filepath), poll_interval_(poll_interval_ms) {}
+
+    virtual void Query(const EventLoopPtr& loop, const std::string& service,
+                       uint64_t index, int wait_ms, DiscoveryQueryCallback cb);
+
+private:
+    void poll(const EventLoopPtr& loop, const std::string& service,
+              uint64_t index, int wait_ms, DiscoveryQueryCallback cb);
+
+    std::string filepath_;
+    int         poll_interval_;
+};
+
+class HV_EXPORT ServiceDiscovery : private EventLoopThread {
+public:
+    typedef std::function<void(const std::string& service, const ServiceInstancesPtr& instances)> WatchCallback;
+
+    // @param loop: run the watches in loop if not NULL, else in an own thread by Start
+    // NOTE: destroy it after the loop stopped if loop is not NULL.
+    ServiceDiscovery(const DiscoveryBackendPtr& backend, EventLoopPtr loop = NULL);
+    ~ServiceDiscovery();
+
+    // blocking query wait time
+    int wait_ms = DEFAULT_DISCOVERY_WAIT;
+    // retry after retry_interval ms on errors, doubled every time up to max_retry_delay
+    int retry_interval = DEFAULT_DISCOVERY_RETRY_INTERVAL;
+    int max_retry_delay = DEFAULT_DISCOVERY_MAX_RETRY_DELAY;
+
+    // thread-safe
+    // cb is called in the loop thread when instances of service change,
+    // and at once if they are known already.
+    void Watch(const std::string& service, WatchCallback cb = NULL);
+
+    // UpstreamGroupPtr of HttpService, SetServers by the passing instances.
+    // NOTE: a template, so that http/client does not depend on http/server.
+    template<class UpstreamGroupPtr>
+    void BindUpstream(const std::string& service, UpstreamGroupPtr upstream, const char* scheme = "http") {
+        std::string prefix = scheme;
+        Watch(service, [upstream, prefix](const std::string&, const ServiceInstancesPtr& instances) {
+            std::vector<std::pair<std::string, int>> urls;
+            for (const auto& instance : *instances) {
+                urls.emplace_back(instance.Url(prefix.c_str()), instance.weight);
+            }
+            upstream->SetServers(urls);
+        });
+    }
+
+    int  Start();
+    void Stop();
+
+    // any thread, NULL if the service is unknown yet
+    ServiceInstancesPtr Get(const std::string& service);
+
+    const EventLoopPtr& loop() {
+        return EventLoopThread::loop();
+    }
+
+private:
+    struct WatchEntry {
+        std::string                 service;
+        std::vector<WatchCallback>  callbacks;
+        ServiceInstancesPtr         instances;
+        uint64_t                    index;
+        int                         retry_delay;
+        bool                        querying;
+
+        WatchEntry() : index(0), retry_delay(0), querying(false) {}
+    };
+    typedef std::shared_ptr<WatchEntry> WatchEntryPtr;
+    // service => instances
+    typedef std::map<std::string, ServiceInstancesPtr> Snapshot;
+    typedef HSnapshot<Snapshot>::Ptr SnapshotPtr;
+
+    void watchInLoop(const std::string& service, WatchCallback cb);
+    void query(const WatchEntryPtr& entry);
+    void onQuery(const WatchEntryPtr& entry, int error, const ServiceInstancesPtr& instances, uint64_t index);
+    void publish(const WatchEntryPtr& entry);
+
+    DiscoveryBackendPtr                     backend_;
+    bool                                    own_loop_;
+    bool                                    started_;
+    // NOTE: accessed in the loop thread only
+    std::map<std::string, WatchEntryPtr>    entries_;
+    // copied and stored by the loop thread, read by any thread
+    HSnapshot<Snapshot>                     snapshot_;
+};
+
+}
+
+#endif // HV_SERVICE_DISCOVERY_H_
@@ -0,0 +1,75 @@
+#ifndef HV_FTP_CLIENT_H_
+#define HV_FTP_CLIENT_H_
+
+/*
+ * Non-blocking FTP client on a hloop
+ *
+ * ftp_client_t* cli = ftp_client_new(loop);
+ * ftp_client_connect(cli, "127.0.0.1", FTP_COMMAND_PORT, "user", "pass", on_login, NULL);
+ * ftp_client_download(cli, "remote.log", "local.log", on_download, NULL);
+ * ftp_client_upload(cli, "local.csv", "remote.csv", on_upload, NULL);
+ * ftp_client_quit(cli, on_quit, NULL);
+ *
+ * Operations are queued and run one by one on the control connection,
+ * so they can be queued right after ftp_client_connect.
+ * Replies of the control connection are split into lines by hio_set_unpack,
+ * multi-line replies are completed by their last line.
+ * Files are transferred by passive mode data connections, without blocking the loop:
+ * - download: socket => pipe => file by splice (linux), read/fwrite otherwise.
+ * - upload:   file => socket by sendfile (linux), fread/send otherwise.
+ *
+ * NOTE: not thread-safe, call them in the loop thread.
+ *
+ */
+
+#include "hexport.h"
+#include "hloop.h"
+#include "ftp.h"
+
+#define FTP_CLIENT_DEFAULT_TIMEOUT      10000   // ms
+#define FTP_CLIENT_DEFAULT_MAX_PENDING  1024
+
+typedef struct ftp_client_s ftp_client_t;
+
+// @param ret: 0 if succeed, else the unexpected reply code or ERR_* of herr.h;
+//             the reply code for ftp_client_exec.
+typedef void (*ftp_client_cb)(ftp_client_t* cli, int ret, void* userdata);
+
+BEGIN_EXTERN_C
+
+HV_EXPORT ftp_client_t* ftp_client_new(hloop_t* loop);
+// NOTE: pending operations are cancelled without callbacks.
+HV_EXPORT void ftp_client_free(ftp_client_t* cli);
+
+// connect timeout, and the max time waiting for a reply or data
+HV_EXPORT void ftp_client_set_timeout(ftp_client_t* cli, int ms);
+// max queued operations, more are refused with ERR_TASK_QUEUE_FULL
+HV_EXPORT void ftp_client_set_max_pending(ftp_client_t* cli, uint32_t max_pending);
+
+// last reply line
+HV_EXPORT const char* ftp_client_reply(ftp_client_t* cli);
+// bytes of the last transfer
+HV_EXPORT uint64_t ftp_client_transfer_bytes(ftp_client_t* cli);
+
+// NOTE: If the control connection is closed, pending operations fail,
+// later ones are refused with ERR_INVALID_HANDLE.
+// @retval 0 queued, callback will be called, else ERR_* of herr.h
+// connect => 220 => USER => 331 => PASS => 230
+HV_EXPORT int ftp_client_connect(ftp_client_t* cli, const char* host, int port,
+                                 const char* username, const char* password,
+                                 ftp_client_cb cb, void* userdata DEFAULT(NULL));
+// cmd param => reply code
+HV_EXPORT int ftp_client_exec(ftp_client_t* cli, const char* cmd, const char* param,
+                              ftp_client_cb cb, void* userdata DEFAULT(NULL));
+// PASV => RETR => remote => local => 226
+HV_EXPORT int ftp_client_download(ftp_client_t* cli, const char* remote_filepath, const char* local_filepath,
+                                  ftp_client_cb cb, void* userdata DEFAULT(NULL));
+// PASV => STOR => local => remote => 226
+HV_EXPORT int ftp_client_upload(ftp_client_t* cli, const char* local_filepath, const char* remote_filepath,
+                                ftp_client_cb cb, void* userdata DEFAULT(NULL));
+// QUIT => close
+HV_EXPORT int ftp_client_quit(ftp_client_t* cli, ftp_client_cb cb DEFAULT(NULL), void* userdata DEFAULT(NULL));
+
+END_EXTERN_C
+
+#endif // HV_FTP_CLIENT_H_
@@ -0,0 +1,525 @@
+#ifndef HV_THREAD_POOL_H_
+#define HV_THREAD_POOL_H_
+
+/*
+ * @usage unittest/threadpool_test.cpp
+ * @bench unittest/threadpool_bench.cpp
+ *
+ * Work-stealing thread pool:
+ * - each worker owns a Chase-Lev deque, tasks posted by a worker are pushed to its own deque,
+ *   the owner pops from bottom, other workers steal from top when they run out of tasks.
+ * - tasks posted by other threads (e.g. io loops) go to the injection queue,
+ *   a worker takes them in batches to its own deque so that others can steal them.
+ * - idle workers park on a condition variable, producers only notify when someone parked.
+ * - post(fn) is fire-and-forget, commit(fn, args...) returns a future.
+ *
+ */
+
+#include <time.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <chrono>
+
+#define DEFAULT_THREAD_POOL_MIN_THREAD_NUM  1
+#define DEFAULT_THREAD_POOL_MAX_THREAD_NUM  std::thread::hardware_concurrency()
+#define DEFAULT_THREAD_POOL_MAX_IDLE_TIME   60000 // ms
+#define THREAD_POOL_SPIN_COUNT              16
+
+class HThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    HThreadPool(int min_threads = DEFAULT_THREAD_POOL_MIN_THREAD_NUM,
+                int max_threads = DEFAULT_THREAD_POOL_MAX_THREAD_NUM,
+                int max_idle_ms = DEFAULT_THREAD_POOL_MAX_IDLE_TIME)
+        : min_thread_num(min_threads)
+        , max_thread_num(max_threads)
+        , max_idle_time(max_idle_ms)
+        , status(STOP)
+        , cur_thread_num(0)
+        , idle_thread_num(0)
+        , injected_num(0)
+        , park_epoch(0)
+        , waiter_num(0)
+    {}
+
+    virtual ~HThreadPool() {
+        stop();
+    }
+
+    void setMinThreadNum(int min_threads) {
+        min_thread_num = min_threads;
+    }
+    // NOTE: workers are allocated by start, when started max_threads is capped to them.
+    // @retval 0 ok, -1 capped, restart to take more threads.
+    int setMaxThreadNum(int max_threads) {
+        std::lock_guard<std::mutex> locker(thread_mutex);
+        if (status != STOP && max_threads > (int)workers.size()) {
+            max_thread_num = (int)workers.size();
+            return -1;
+        }
+        max_thread_num = max_threads;
+        return 0;
+    }
+    void setMaxIdleTime(int ms) {
+        max_idle_time = ms;
+    }
+    int currentThreadNum() {
+        return cur_thread_num;
+    }
+    int idleThreadNum() {
+        return idle_thread_num;
+    }
+    size_t taskNum() {
+        size_t num = injected_num.load(std::memory_order_relaxed);
+        for (auto& worker : workers) {
+            num += worker->tasks.size();
+        }
+        return num;
+    }
+    bool isStarted() {
+        return status != STOP;
+    }
+    bool isStopped() {
+        return status == STOP;
+    }
+
+    int start(int start_threads = 0) {
+        {
+            std::lock_guard<std::mutex> locker(thread_mutex);
+            if (status != STOP) return -1;
+            int worker_num = max_thread_num > 0 ? max_thread_num : 1;
+            workers.clear();
+            for (int i = 0; i < worker_num; ++i) {
+                workers.emplace_back(new Worker(this, i));
+            }
+            status = RUNNING;
+        }
+        if (start_threads < min_thread_num) start_threads = min_thread_num;
+        if (start_threads > max_thread_num) start_threads = max_thread_num;
+        for (int i = 0; i < start_threads; ++i) {
+            createThread();
+        }
+        return 0;
+    }
+
+    int stop() {
+        {
+            std::lock_guard<std::mutex> locker(thread_mutex);
+            if (status == STOP) return -1;
+            status = STOP;
+        }
+        wakeup(true);
+        // NOTE: join out of thread_mutex, as createThread may be called in workers.
+        for (auto& worker : workers) {
+            if (worker->thread.joinable()) {
+                worker->thread.join();
+            }
+        }
+        // drop tasks not run, their futures get broken_promise.
+        for (auto& worker : workers) {
+            while (TaskBase* task = worker->tasks.pop()) {
+                delete task;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> locker(inject_mutex);
+            for (auto task : injected) {
+                delete task;
+            }
+            injected.clear();
+            injected_num = 0;
+        }
+        workers.clear();
+        cur_thread_num = 0;
+        idle_thread_num = 0;
+        return 0;
+    }
+
+    int pause() {
+        std::lock_guard<std::mutex> locker(park_mutex);
+        if (status == RUNNING) {
+            status = PAUSE;
+        }
+        return 0;
+    }
+
+    int resume() {
+        {
+            std::lock_guard<std::mutex> locker(park_mutex);
+            if (status != PAUSE) return 0;
+            status = RUNNING;
+        }
+        wakeup(true);
+        return 0;
+    }
+
+    // wait all tasks done
+    int wait() {
+        std::unique_lock<std::mutex> locker(park_mutex);
+        ++waiter_num;
+        while (status != STOP) {
+            if (idle_thread_num == cur_thread_num && taskNum() == 0) {
+                break;
+            }
+            idle_cond.wait_for(locker, std::chrono::milliseconds(10));
+        }
+        --waiter_num;
+        return 0;
+    }
+
+    /*
+     * fire-and-forget, no future.
+     * post(fn)
+     * post(std::bind(&Class::mem_fn, &obj))
+     *
+     */
+    template<class Fn>
+    void post(Fn&& fn) {
+        if (status == STOP) start();
+        pushTask(new TaskImpl<typename std::decay<Fn>::type>(std::forward<Fn>(fn)));
+    }
+
+    /*
+     * return a future, calling future.get() will wait task done and return RetType.
+     * commit(fn, args...)
+     * commit(std::bind(&Class::mem_fn, &obj))
+     * commit(std::mem_fn(&Class::mem_fn, &obj))
+     *
+     */
+    template<class Fn, class... Args>
+    auto commit(Fn&& fn, Args&&... args) -> std::future<decltype(fn(args...))> {
+        using RetType = decltype(fn(args...));
+        std::packaged_task<RetType()> task(
+            std::bind(std::forward<Fn>(fn), std::forward<Args>(args)...));
+        std::future<RetType> future = task.get_future();
+        post(std::move(task));
+        return future;
+    }
+
+protected:
+    struct TaskBase {
+        virtual ~TaskBase() {}
+        virtual void run() = 0;
+    };
+
+    template<class Fn>
+    struct TaskImpl : public TaskBase {
+        Fn fn;
+        template<class F>
+        explicit TaskImpl(F&& f) : fn(std::forward<F>(f)) {}
+        void run() override { fn(); }
+    };
+
+    // Chase-Lev deque, see "Correct and Efficient Work-Stealing for Weak Memory Models".
+    // push and pop by owner only, steal by any thread.
+    class TaskDeque {
+    public:
+        TaskDeque(int64_t capacity = 256) : top(0), bottom(0) {
+            array.store(new Array(capacity), std::memory_order_relaxed);
+        }
+        ~TaskDeque() {
+            delete array.load(std::memory_order_relaxed);
+            for (auto old : garbage) {
+                delete old;
+            }
+        }
+
+        void push(TaskBase* task) {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_acquire);
+            Array* a = array.load(std::memory_order_relaxed);
+            if (b - t > a->capacity - 1) {
+                a = grow(a, b, t);
+            }
+            a->put(b, task);
+            // publish the task to thieves loading bottom with acquire
+            bottom.store(b + 1, std::memory_order_release);
+        }
+
+        TaskBase* pop() {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            Array* a = array.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            TaskBase* task = NULL;
+            if (t <= b) {
+                task = a->get(b);
+                if (t == b) {
+                    // last one, race with thieves
+                    if (!top.compare_exchange_strong(t, t + 1,
+                            std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                        task = NULL;
+                    }
+                    bottom.store(b + 1, std::memory_order_relaxed);
+                }
+            } else {
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return task;
+        }
+
+        TaskBase* steal() {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b) return NULL;
+            Array* a = array.load(std::memory_order_acquire);
+            TaskBase* task = a->get(t);
+            if (!top.compare_exchange_strong(t, t + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return NULL;
+            }
+            return task;
+        }
+
+        size_t size() {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_relaxed);
+            return b > t ? (size_t)(b - t) : 0;
+        }
+
+    private:
+        struct Array {
+            int64_t                 capacity;
+            std::atomic<TaskBase*>* buffer;
+
+            explicit Array(int64_t cap) : capacity(cap), buffer(new std::atomic<TaskBase*>[cap]) {}
+            ~Array() { delete[] buffer; }
+            TaskBase* get(int64_t i) {
+                return buffer[i & (capacity - 1)].load(std::memory_order_relaxed);
+            }
+            void put(int64_t i, TaskBase* task) {
+                buffer[i & (capacity - 1)].store(task, std::memory_order_relaxed);
+            }
+        };
+
+        Array* grow(Array* a, int64_t b, int64_t t) {
+            Array* bigger = new Array(a->capacity * 2);
+            for (int64_t i = t; i != b; ++i) {
+                bigger->put(i, a->get(i));
+            }
+            // NOTE: thieves may still read the old one
+            garbage.push_back(a);
+            array.store(bigger, std::memory_order_release);
+            return bigger;
+        }
+
+        // padding to avoid false sharing between owner and thieves
+        std::atomic<int64_t>    top;
+        char                    pad1[64];
+        std::atomic<int64_t>    bottom;
+        char                    pad2[64];
+        std::atomic<Array*>     array;
+        std::vector<Array*>     garbage;
+    };
+
+    struct Worker {
+        HThreadPool*        pool;
+        int                 index;
+        uint32_t            seed;
+        TaskDeque           tasks;
+        std::thread         thread;
+        std::atomic<bool>   running;
+
+        Worker(HThreadPool* pool, int index)
+            : pool(pool), index(index), seed(index * 2654435761U + 1), running(false) {}
+    };
+
+    static Worker*& currentWorker() {
+        static thread_local Worker* worker = NULL;
+        return worker;
+    }
+
+    void pushTask(TaskBase* task) {
+        Worker* worker = currentWorker();
+        if (worker && worker->pool == this) {
+            worker->tasks.push(task);
+        } else {
+            std::lock_guard<std::mutex> locker(inject_mutex);
+            injected.push_back(task);
+            injected_num.store(injected.size(), std::memory_order_relaxed);
+        }
+        // NOTE: pairs with the fence in park, either we see the parked worker,
+        // or the worker sees the task before sleeping.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (idle_thread_num.load(std::memory_order_relaxed) > 0) {
+            wakeup(false);
+        } else if (cur_thread_num < max_thread_num) {
+            createThread();
+        }
+    }
+
+    void wakeup(bool all) {
+        {
+            std::lock_guard<std::mutex> locker(park_mutex);
+            ++park_epoch;
+        }
+        if (all) {
+            park_cond.notify_all();
+        } else {
+            park_cond.notify_one();
+        }
+    }
+
+    bool hasTask() {
+        if (injected_num.load(std::memory_order_relaxed) != 0) return true;
+        for (auto& worker : workers) {
+            if (worker->tasks.size() != 0) return true;
+        }
+        return false;
+    }
+
+    TaskBase* popInjected(Worker* worker) {
+        if (injected_num.load(std::memory_order_relaxed) == 0) return NULL;
+        std::lock_guard<std::mutex> locker(inject_mutex);
+        if (injected.empty()) return NULL;
+        TaskBase* task = injected.front();
+        injected.pop_front();
+        // take a batch to own deque, let others steal from it
+        int thread_num = cur_thread_num;
+        size_t batch = injected.size() / (thread_num > 0 ? thread_num : 1);
+        if (batch > 32) batch = 32;
+        while (batch--) {
+            worker->tasks.push(injected.front());
+            injected.pop_front();
+        }
+        injected_num.store(injected.size(), std::memory_order_relaxed);
+        return task;
+    }
+
+    TaskBase* stealTask(Worker* worker) {
+        size_t num = workers.size();
+        // xorshift
+        worker->seed ^= worker->seed << 13;
+        worker->seed ^= worker->seed >> 17;
+        worker->seed ^= worker->seed << 5;
+        size_t start = worker->seed % num;
+        for (size_t i = 0; i < num; ++i) {
+            Worker* victim = workers[(start + i) % num].get();
+            if (victim == worker) continue;
+            TaskBase* task = victim->tasks.steal();
+            if (task) return task;
+        }
+        return NULL;
+    }
+
+    TaskBase* getTask(Worker* worker) {
+        TaskBase* task = worker->tasks.pop();
+        if (task) return task;
+        task = popInjected(worker);
+        if (task) return task;
+        return stealTask(worker);
+    }
+
+    // @return false if idle timeout and thread should exit
+    bool park() {
+        std::unique_lock<std::mutex> locker(park_mutex);
+        if (status == PAUSE) {
+            park_cond.wait(locker, [this]() {
+                return status != PAUSE;
+            });
+            return true;
+        }
+        uint64_t epoch = park_epoch;
+        ++idle_thread_num;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (status == STOP || hasTask()) {
+            --idle_thread_num;
+            return true;
+        }
+        if (waiter_num) idle_cond.notify_all();
+        bool woken = park_cond.wait_for(locker, std::chrono::milliseconds(max_idle_time), [this, epoch]() {
+            return park_epoch != epoch || status == STOP;
+        });
+        --idle_thread_num;
+        if (woken || status != RUNNING) return true;
+        int thread_num = cur_thread_num;
+        while (thread_num > min_thread_num &&
+               !cur_thread_num.compare_exchange_weak(thread_num, thread_num - 1));
+        if (thread_num <= min_thread_num) return true;
+        if (waiter_num) idle_cond.notify_all();
+        return false;
+    }
+
+    void workerRoutine(Worker* worker) {
+        currentWorker() = worker;
+        int spins = 0;
+        while (status != STOP) {
+            TaskBase* task = status == RUNNING ? getTask(worker) : NULL;
+            if (task) {
+                task->run();
+                delete task;
+                spins = 0;
+                continue;
+            }
+            // spin a little before parking, as tasks usually come in bursts
+            if (status == RUNNING && ++spins < THREAD_POOL_SPIN_COUNT) {
+                std::this_thread::yield();
+                continue;
+            }
+            spins = 0;
+            if (!park()) break;
+        }
+        currentWorker() = NULL;
+        worker->running = false;
+    }
+
+    bool createThread() {
+        std::lock_guard<std::mutex> locker(thread_mutex);
+        if (status == STOP || cur_thread_num >= max_thread_num) return false;
+        for (auto& worker : workers) {
+            if (worker->running) continue;
+            // exited for idle timeout
+            if (worker->thread.joinable()) {
+                worker->thread.join();
+            }
+            worker->running = true;
+            ++cur_thread_num;
+            worker->thread = std::thread(&HThreadPool::workerRoutine, this, worker.get());
+            return true;
+        }
+        return false;
+    }
+
+public:
+    int min_thread_num;
+    int max_thread_num;
+    int max_idle_time;
+
+protected:
+    enum Status {
+        STOP,
+        RUNNING,
+        PAUSE,
+    };
+    std::atomic<Status>     status;
+    std::atomic<int>        cur_thread_num;
+    std::atomic<int>        idle_thread_num;
+    // fixed between start and stop
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex              thread_mutex;
+    // injection queue for tasks posted by non-worker threads
+    std::deque<TaskBase*>   injected;
+    std::atomic<size_t>     injected_num;
+    std::mutex              inject_mutex;
+    // parking
+    std::mutex              park_mutex;
+    std::condition_variable park_cond;
+    uint64_t                park_epoch;
+    std::condition_variable idle_cond;
+    int                     waiter_num;
+};
+
+#endif // HV_THREAD_POOL_H_
@@ -0,0 +1,138 @@
+#ifndef HV_HTTP_CONTENT_H_
+#define HV_HTTP_CONTENT_H_
+
+#include "hexport.h"
+#include "hstring.h"
+
+// NOTE: WITHOUT_HTTP_CONTENT
+// ndk-r10e no std::to_string and can't compile modern json.hpp
+#ifndef WITHOUT_HTTP_CONTENT
+#include "json.hpp" // https://github.com/nlohmann/json
+#endif
+
+BEGIN_NAMESPACE_HV
+
+// QueryParams
+using QueryParams = hv::KeyValue;
+HV_EXPORT std::string dump_query_params(const QueryParams& query_params);
+HV_EXPORT int         parse_query_params(const char* query_string, QueryParams& query_params);
+
+#ifndef WITHOUT_HTTP_CONTENT
+
+/**************multipart/form-data*************************************
+--boundary
+Content-Disposition: form-data; name="user"
+
+content
+--boundary
+Content-Disposition: form-data; name="avatar"; filename="user.jpg"
+Content-Type: image/jpeg
+
+content
+--boundary--
+***********************************************************************/
+// FormData
+struct FormData {
+    std::string     filename;
+    std::string     content;
+    // saved temp file of file part parsed by MultipartParser, content is empty
+    std::string     filepath;
+
+    FormData(const char* content = NULL, const char* filename = NULL) {
+        if (content) {
+            this->content = content;
+        }
+        if (filename) {
+            this->filename = filename;
+        }
+    }
+    template<typename T>
+    FormData(T num) {
+        content = hv::to_string(num);
+    }
+};
+// FormFile
+struct FormFile : public FormData {
+    FormFile(const char* filename = NULL) {
+        if (filename) {
+            this->filename = filename;
+        }
+    }
+};
+
+// MultiPart
+// name => FormData
+typedef HV_MAP<std::string, FormData>          MultiPart;
+#define DEFAULT_MULTIPART_BOUNDARY  "----WebKitFormBoundary7MA4YWxkTrZu0gW"
+HV_EXPORT std::string dump_multipart(MultiPart& mp, const char* boundary = DEFAULT_MULTIPART_BOUNDARY);
+HV_EXPORT int         parse_multipart(const std::string& str, MultiPart& mp, const char* boundary);
+
+#define DEFAULT_MULTIPART_MAX_MEMORY_SIZE   (1 << 20) // 1M
+/*
+ * MultipartParser: streaming multipart/form-data parser, fed chunk by chunk.
+ * Parts with filename are written to temp files in upload_dir => FormData::filepath,
+ * other parts are kept in memory => FormData::content.
+ *
+ * NOTE: temp files are removed by destructor, rename them to keep.
+ */
+class HV_EXPORT MultipartParser {
+public:
+    std::string upload_dir;
+    // bytes of part headers and in-memory parts
+    size_t      max_memory_size;
+    // bytes per file part, 0 means unlimited
+    size_t      max_file_size;
+    // fallocate file part by remaining content_length, 0 means disabled
+    size_t      content_length;
+
+    MultipartParser(MultiPart* mp, const char* boundary);
+    ~MultipartParser();
+
+    // @retval 0 OK, else HTTP_STATUS_BAD_REQUEST, HTTP_STATUS_PAYLOAD_TOO_LARGE, HTTP_STATUS_INTERNAL_SERVER_ERROR
+    int  Feed(const char* data, size_t len);
+    // close-delimiter parsed
+    bool IsComplete() { return complete_; }
+
+private:
+    friend struct multipart_stream_callbacks;
+    int  onHeaderField(const char* at, size_t length);
+    int  onHeaderValue(const char* at, size_t length);
+    int  onHeadersComplete();
+    int  onPartData(const char* at, size_t length);
+    int  onPartDataEnd();
+    void handleHeader();
+    int  openFile();
+    void closeFile();
+
+    MultiPart*  mp_;
+    void*       parser_;
+    int         error_;
+    bool        complete_;
+    size_t      nfeed_;
+    size_t      memory_size_;
+    // current part
+    std::string header_field_;
+    std::string header_value_;
+    std::string name_;
+    std::string filename_;
+    bool        has_filename_;
+    std::string content_;
+    FILE*       fp_;
+    std::string filepath_;
+    size_t      file_size_;
+    size_t      file_reserved_;
+    // temp files to remove
+    StringList  filepaths_;
+};
+
+// Json
+using Json = nlohmann::json;
+// using Json = nlohmann::ordered_json;
+
+HV_EXPORT std::string dump_json(const hv::Json& json, int indent = -1);
+HV_EXPORT int         parse_json(const char* str, hv::Json& json, std::string& errmsg);
+#endif
+
+END_NAMESPACE_HV
+
+#endif // HV_HTTP_CONTENT_H_
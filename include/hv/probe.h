@@ -0,0 +1,128 @@
+#ifndef HV_PROBE_H_
+#define HV_PROBE_H_
+
+/*
+ * Health prober running on a hloop: ICMP echo, TCP connect, HTTP GET
+ *
+ * hprober_t* prober = hprober_new(loop, 1024);
+ * hprobe_setting_t setting;
+ * hprobe_setting_init(&setting);
+ * setting.type = HPROBE_HTTP;
+ * setting.host = "127.0.0.1";
+ * setting.port = 8080;
+ * setting.path = "/health";
+ * hprober_add(prober, &setting, on_probe, NULL);
+ * hloop_run(loop);
+ *
+ * Each target is probed every interval_ms by its own timer, the first probe
+ * is delayed randomly within one interval to spread the load.
+ * At most max_concurrency probes run at a time, the others wait in FIFO order.
+ * ICMP probes of a prober share one socket per address family,
+ * replies are matched by sequence number, the id too on raw sockets.
+ * Unprivileged ping sockets (SOCK_DGRAM) are tried before SOCK_RAW,
+ * @see /proc/sys/net/ipv4/ping_group_range
+ *
+ * NOTE: not thread-safe, call them in the loop thread.
+ *
+ */
+
+#include "hexport.h"
+#include "hloop.h"
+
+#define HPROBE_DEFAULT_INTERVAL         1000    // ms
+#define HPROBE_DEFAULT_TIMEOUT          1000    // ms
+#define HPROBE_DEFAULT_MAX_CONCURRENCY  1024
+// ICMP probes in flight per address family
+#define HPROBE_MAX_ICMP_INFLIGHT        4096
+
+typedef enum {
+    HPROBE_ICMP,    // echo request => echo reply
+    HPROBE_TCP,     // connect
+    HPROBE_HTTP,    // connect => GET path => status code < 400
+} hprobe_type_e;
+
+typedef struct hprober_s        hprober_t;
+typedef struct hprobe_target_s  hprobe_target_t;
+
+typedef struct hprobe_setting_s {
+    hprobe_type_e   type;
+    const char*     host;   // resolved once by hprober_add
+    int             port;   // TCP, HTTP
+    const char*     path;   // HTTP, NULL means "/"
+    uint32_t        interval_ms;
+    uint32_t        timeout_ms;
+    // up after rise successes in a row, down after fall failures in a row
+    uint32_t        rise;
+    uint32_t        fall;
+
+#ifdef __cplusplus
+    hprobe_setting_s() {
+        type = HPROBE_TCP;
+        host = NULL;
+        port = 0;
+        path = NULL;
+        interval_ms = HPROBE_DEFAULT_INTERVAL;
+        timeout_ms = HPROBE_DEFAULT_TIMEOUT;
+        rise = 1;
+        fall = 1;
+    }
+#endif
+} hprobe_setting_t;
+
+typedef struct hprobe_result_s {
+    int         ok;
+    int         error;          // errno or ERR_* of herr.h, 0 if ok
+    int         status_code;    // HTTP
+    uint32_t    rtt_us;
+    int         up;             // health after this probe
+    int         changed;        // up is changed by this probe
+} hprobe_result_t;
+
+typedef struct hprobe_stats_s {
+    uint64_t            probes;
+    uint64_t            successes;
+    uint64_t            failures;
+    uint64_t            timeouts;   // of failures
+    uint64_t            skipped;    // interval elapsed while the last probe is running or waiting
+    uint32_t            consecutive_successes;
+    uint32_t            consecutive_failures;
+    hloop_histogram_t   rtt;        // us of successes
+} hprobe_stats_t;
+
+typedef void (*hprobe_cb)(hprobe_target_t* target, const hprobe_result_t* result);
+
+BEGIN_EXTERN_C
+
+HV_INLINE void hprobe_setting_init(hprobe_setting_t* setting) {
+    setting->type = HPROBE_TCP;
+    setting->host = NULL;
+    setting->port = 0;
+    setting->path = NULL;
+    setting->interval_ms = HPROBE_DEFAULT_INTERVAL;
+    setting->timeout_ms = HPROBE_DEFAULT_TIMEOUT;
+    setting->rise = 1;
+    setting->fall = 1;
+}
+
+HV_EXPORT hprober_t* hprober_new(hloop_t* loop, uint32_t max_concurrency DEFAULT(HPROBE_DEFAULT_MAX_CONCURRENCY));
+// NOTE: probes in flight are cancelled without callbacks.
+HV_EXPORT void hprober_free(hprober_t* prober);
+// probes running, at most max_concurrency
+HV_EXPORT uint32_t hprober_inflight(hprober_t* prober);
+// summed up of all targets, rtt included
+HV_EXPORT void hprober_stats(hprober_t* prober, hprobe_stats_t* stats);
+
+// @retval NULL if host can not be resolved
+HV_EXPORT hprobe_target_t* hprober_add(hprober_t* prober, const hprobe_setting_t* setting,
+                                       hprobe_cb cb, void* userdata DEFAULT(NULL));
+// NOTE: a probe in flight is cancelled without callback.
+HV_EXPORT void hprober_del(hprobe_target_t* target);
+
+HV_EXPORT void* hprobe_target_userdata(hprobe_target_t* target);
+HV_EXPORT const char* hprobe_target_host(hprobe_target_t* target);
+HV_EXPORT int  hprobe_target_up(hprobe_target_t* target);
+HV_EXPORT const hprobe_stats_t* hprobe_target_stats(hprobe_target_t* target);
+
+END_EXTERN_C
+
+#endif // HV_PROBE_H_
@@ -0,0 +1,129 @@
+#ifndef HV_PROXY_SERVER_H_
+#define HV_PROXY_SERVER_H_
+
+/*
+ * SOCKS5 and HTTP CONNECT tunnel proxy on a hloop
+ *
+ * proxy_server_setting_t setting;
+ * proxy_server_setting_init(&setting);
+ * setting.port = 1080;
+ * proxy_server_t* server = proxy_server_new(loop, &setting);
+ * proxy_server_setcb_tunnel(server, on_tunnel_close);
+ * hloop_run(loop);
+ *
+ * Both protocols are served on one port, told apart by the first byte (0x05 for SOCKS5).
+ * SOCKS5 (RFC 1928): CONNECT only, NO AUTHENTICATION or USERNAME/PASSWORD (RFC 1929).
+ * HTTP:              CONNECT host:port only, Proxy-Authorization: Basic.
+ *                    see examples/tinyproxyd.c for a forward proxy of plain HTTP.
+ * After the target is connected, the tunnel is relayed by hio_setup_relay,
+ * by splice(2) on linux, and the tunnel cb is called with its bytes when it is closed.
+ *
+ * To serve on multiple loops, listen once and pass the listenfd to a proxy_server per loop.
+ *
+ * NOTE: not thread-safe, call them in the loop thread.
+ * NOTE: target domain names are resolved by getaddrinfo in resolver threads,
+ *       not to block the loop, and connecting resumes in the loop.
+ *
+ */
+
+#include "hexport.h"
+#include "hloop.h"
+
+#define PROXY_SERVER_DEFAULT_PORT               1080
+#define PROXY_SERVER_DEFAULT_HANDSHAKE_TIMEOUT  10000   // ms
+#define PROXY_SERVER_DEFAULT_CONNECT_TIMEOUT    10000   // ms
+
+typedef enum {
+    PROXY_PROTOCOL_SOCKS5       = 0x1,
+    PROXY_PROTOCOL_HTTP_CONNECT = 0x2,
+    PROXY_PROTOCOL_ALL          = 0x3,
+} proxy_protocol_e;
+
+typedef struct proxy_server_s proxy_server_t;
+
+typedef struct proxy_server_setting_s {
+    const char* host;
+    int         port;
+    int         listenfd;       // accept on listenfd instead of host:port if >= 0
+    int         protocols;      // proxy_protocol_e
+    // SOCKS5 USERNAME/PASSWORD and HTTP Proxy-Authorization if username is set
+    const char* username;
+    const char* password;
+    int         handshake_timeout;  // ms, read timeout before the target is connected
+    int         connect_timeout;    // ms
+    int         idle_timeout;       // ms, keepalive timeout of tunnels, 0 means no timeout
+    uint32_t    watermark;          // hrelay_set_watermark, 0 means HRELAY_DEFAULT_WATERMARK
+
+#ifdef __cplusplus
+    proxy_server_setting_s() {
+        host = "0.0.0.0";
+        port = PROXY_SERVER_DEFAULT_PORT;
+        listenfd = -1;
+        protocols = PROXY_PROTOCOL_ALL;
+        username = NULL;
+        password = NULL;
+        handshake_timeout = PROXY_SERVER_DEFAULT_HANDSHAKE_TIMEOUT;
+        connect_timeout = PROXY_SERVER_DEFAULT_CONNECT_TIMEOUT;
+        idle_timeout = 0;
+        watermark = 0;
+    }
+#endif
+} proxy_server_setting_t;
+
+typedef struct proxy_tunnel_s {
+    proxy_protocol_e    protocol;
+    char                client_addr[64];    // ip:port
+    char                host[256];          // target
+    int                 port;
+    uint64_t            bytes_up;           // client => target
+    uint64_t            bytes_down;         // target => client
+    uint64_t            start_hrtime;       // us, the target is connected
+    uint64_t            end_hrtime;         // us
+    int                 spliced;
+    int                 error;
+} proxy_tunnel_t;
+
+typedef struct proxy_server_stats_s {
+    uint64_t    accepted;
+    uint64_t    failed;     // handshake or connect failed
+    uint64_t    tunnels;    // established
+    uint64_t    spliced;    // tunnels relayed by splice
+    uint64_t    active;     // connections
+    uint64_t    bytes_up;   // of closed tunnels
+    uint64_t    bytes_down;
+} proxy_server_stats_t;
+
+// called when an established tunnel is closed
+typedef void (*proxy_tunnel_cb)(proxy_server_t* server, const proxy_tunnel_t* tunnel);
+
+BEGIN_EXTERN_C
+
+HV_INLINE void proxy_server_setting_init(proxy_server_setting_t* setting) {
+    setting->host = "0.0.0.0";
+    setting->port = PROXY_SERVER_DEFAULT_PORT;
+    setting->listenfd = -1;
+    setting->protocols = PROXY_PROTOCOL_ALL;
+    setting->username = NULL;
+    setting->password = NULL;
+    setting->handshake_timeout = PROXY_SERVER_DEFAULT_HANDSHAKE_TIMEOUT;
+    setting->connect_timeout = PROXY_SERVER_DEFAULT_CONNECT_TIMEOUT;
+    setting->idle_timeout = 0;
+    setting->watermark = 0;
+}
+
+// @return NULL if listen failed
+HV_EXPORT proxy_server_t* proxy_server_new(hloop_t* loop, const proxy_server_setting_t* setting);
+// NOTE: closes the listener and all connections, the tunnel cb is not called any more.
+HV_EXPORT void proxy_server_free(proxy_server_t* server);
+
+HV_EXPORT void  proxy_server_setcb_tunnel(proxy_server_t* server, proxy_tunnel_cb cb);
+HV_EXPORT void  proxy_server_set_userdata(proxy_server_t* server, void* userdata);
+HV_EXPORT void* proxy_server_userdata(proxy_server_t* server);
+
+// the listen port, useful for port 0
+HV_EXPORT int   proxy_server_port(proxy_server_t* server);
+HV_EXPORT void  proxy_server_get_stats(proxy_server_t* server, proxy_server_stats_t* stats);
+
+END_EXTERN_C
+
+#endif // HV_PROXY_SERVER_H_
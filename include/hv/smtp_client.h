@@ -0,0 +1,91 @@
+#ifndef HV_SMTP_CLIENT_H_
+#define HV_SMTP_CLIENT_H_
+
+/*
+ * Non-blocking SMTP client on a hloop, for batch delivery
+ *
+ * smtp_client_setting_t setting;
+ * smtp_client_setting_init(&setting);
+ * setting.host = "127.0.0.1";
+ * setting.max_connections = 4;
+ * smtp_client_t* cli = smtp_client_new(loop, &setting);
+ * for (...) smtp_client_send(cli, &mail, on_sent, NULL);
+ *
+ * Mails are queued, and delivered by at most max_connections connections,
+ * each one sends the queued mails one by one, then QUIT when the queue is empty.
+ * If the server supports PIPELINING (RFC 2920), MAIL, RCPT and DATA are sent at once,
+ * and the next ones follow the body of the last mail,
+ * so a mail takes one round trip only.
+ * Replies are split into lines by hio_set_unpack.
+ *
+ * NOTE: not thread-safe, call them in the loop thread.
+ *
+ */
+
+#include "hexport.h"
+#include "hloop.h"
+#include "smtp.h"
+
+#define SMTP_CLIENT_DEFAULT_TIMEOUT         10000   // ms
+#define SMTP_CLIENT_DEFAULT_MAX_CONNECTIONS 4
+#define SMTP_CLIENT_DEFAULT_MAX_PENDING     10000
+
+typedef struct smtp_client_s smtp_client_t;
+
+typedef struct smtp_client_setting_s {
+    const char* host;
+    int         port;
+    const char* domain;     // EHLO domain, NULL means "localhost"
+    // AUTH PLAIN if username is set
+    const char* username;
+    const char* password;
+    uint32_t    max_connections;
+    uint32_t    max_pending;    // queued mails
+    int         timeout_ms;     // connect, and waiting for a reply
+
+#ifdef __cplusplus
+    smtp_client_setting_s() {
+        host = NULL;
+        port = SMTP_PORT;
+        domain = NULL;
+        username = NULL;
+        password = NULL;
+        max_connections = SMTP_CLIENT_DEFAULT_MAX_CONNECTIONS;
+        max_pending = SMTP_CLIENT_DEFAULT_MAX_PENDING;
+        timeout_ms = SMTP_CLIENT_DEFAULT_TIMEOUT;
+    }
+#endif
+} smtp_client_setting_t;
+
+// @param ret: 0 if the mail is accepted, else the unexpected reply code or ERR_* of herr.h
+typedef void (*smtp_client_cb)(smtp_client_t* cli, int ret, void* userdata);
+
+BEGIN_EXTERN_C
+
+HV_INLINE void smtp_client_setting_init(smtp_client_setting_t* setting) {
+    setting->host = NULL;
+    setting->port = SMTP_PORT;
+    setting->domain = NULL;
+    setting->username = NULL;
+    setting->password = NULL;
+    setting->max_connections = SMTP_CLIENT_DEFAULT_MAX_CONNECTIONS;
+    setting->max_pending = SMTP_CLIENT_DEFAULT_MAX_PENDING;
+    setting->timeout_ms = SMTP_CLIENT_DEFAULT_TIMEOUT;
+}
+
+HV_EXPORT smtp_client_t* smtp_client_new(hloop_t* loop, const smtp_client_setting_t* setting);
+// NOTE: pending mails are cancelled without callbacks.
+HV_EXPORT void smtp_client_free(smtp_client_t* cli);
+
+// mail is copied
+// @retval 0 queued, callback will be called, ERR_TASK_QUEUE_FULL
+HV_EXPORT int smtp_client_send(smtp_client_t* cli, const mail_t* mail,
+                               smtp_client_cb cb, void* userdata DEFAULT(NULL));
+
+// mails queued and in flight
+HV_EXPORT uint32_t smtp_client_pending(smtp_client_t* cli);
+HV_EXPORT uint32_t smtp_client_connections(smtp_client_t* cli);
+
+END_EXTERN_C
+
+#endif // HV_SMTP_CLIENT_H_
@@ -5,9 +5,86 @@
 #include "hendian.h"
 #include "hsocket.h"
 
-static unsigned short mqtt_next_mid() {
-    static unsigned short s_mid = 0;
-    return ++s_mid;
+// NOTE: coalesce packets into one write up to this size
+#define MQTT_MAX_BATCH_SIZE     (1 << 16) // 64K
+
+// NOTE: with cli->mutex_ locked
+static unsigned short mqtt_next_mid(mqtt_client_t* cli) {
+    // NOTE: packet identifier must be non-zero
+    if (++cli->next_mid == 0) ++cli->next_mid;
+    return cli->next_mid;
+}
+
+/*
+ * mqtt_packet_t: serialized QoS 1/2 PUBLISH waiting for ack,
+ * or any PUBLISH queued to send.
+ */
+struct mqtt_packet_s {
+    mqtt_packet_t*  next;
+    unsigned short  mid;
+    unsigned char   qos;
+    unsigned char   pubrel; // QoS 2: PUBREC received, resend PUBREL
+    unsigned int    len;
+    unsigned char*  buf;
+};
+
+static mqtt_packet_t* mqtt_packet_new(unsigned int len) {
+    mqtt_packet_t* pkt = NULL;
+    HV_ALLOC(pkt, sizeof(mqtt_packet_t) + len);
+    if (pkt == NULL) return NULL;
+    pkt->buf = (unsigned char*)(pkt + 1);
+    pkt->len = len;
+    return pkt;
+}
+
+static void mqtt_packet_push(mqtt_packet_t** head, mqtt_packet_t** tail, mqtt_packet_t* pkt) {
+    pkt->next = NULL;
+    if (*tail) {
+        (*tail)->next = pkt;
+    } else {
+        *head = pkt;
+    }
+    *tail = pkt;
+}
+
+static mqtt_packet_t* mqtt_packet_pop(mqtt_packet_t** head, mqtt_packet_t** tail) {
+    mqtt_packet_t* pkt = *head;
+    if (pkt == NULL) return NULL;
+    *head = pkt->next;
+    if (*head == NULL) *tail = NULL;
+    pkt->next = NULL;
+    return pkt;
+}
+
+// NOTE: acks mostly come in order, so the packet is usually the head.
+static mqtt_packet_t* mqtt_packet_find(mqtt_packet_t* head, unsigned short mid) {
+    for (mqtt_packet_t* pkt = head; pkt; pkt = pkt->next) {
+        if (pkt->mid == mid) return pkt;
+    }
+    return NULL;
+}
+
+static mqtt_packet_t* mqtt_packet_remove(mqtt_packet_t** head, mqtt_packet_t** tail, unsigned short mid) {
+    mqtt_packet_t* prev = NULL;
+    for (mqtt_packet_t* pkt = *head; pkt; prev = pkt, pkt = pkt->next) {
+        if (pkt->mid != mid) continue;
+        if (prev) {
+            prev->next = pkt->next;
+        } else {
+            *head = pkt->next;
+        }
+        if (*tail == pkt) *tail = prev;
+        pkt->next = NULL;
+        return pkt;
+    }
+    return NULL;
+}
+
+static void mqtt_packet_free_all(mqtt_packet_t** head, mqtt_packet_t** tail) {
+    mqtt_packet_t* pkt = NULL;
+    while ((pkt = mqtt_packet_pop(head, tail)) != NULL) {
+        HV_FREE(pkt);
+    }
 }
 
 static int mqtt_client_send(mqtt_client_t* cli, const void* buf, int len) {
@@ -64,6 +141,130 @@ static void mqtt_send_disconnect(hio_t* io) {
     mqtt_send_head(io, MQTT_TYPE_DISCONNECT, 0);
 }
 
+static bool mqtt_client_inflight_full(mqtt_client_t* cli) {
+    return cli->max_inflight > 0 && cli->inflight_cnt >= cli->max_inflight;
+}
+
+// NOTE: must be called with cli->mutex_ locked
+// @return batch buffer of MQTT_MAX_BATCH_SIZE, allocated once per client
+static unsigned char* mqtt_client_batch_buf(mqtt_client_t* cli) {
+    if (cli->batch_buf == NULL) {
+        HV_ALLOC(cli->batch_buf, MQTT_MAX_BATCH_SIZE);
+    }
+    return cli->batch_buf;
+}
+
+// NOTE: must be called with cli->mutex_ locked
+static int mqtt_client_send_batch(mqtt_client_t* cli, unsigned char* buf, int len) {
+    if (len == 0) return 0;
+    return hio_write(cli->io, buf, len);
+}
+
+// resend unacknowledged packets on reconnect
+static int mqtt_client_resend_inflight(mqtt_client_t* cli) {
+    int nwrite = 0;
+    hmutex_lock(&cli->mutex_);
+    unsigned char* buf = mqtt_client_batch_buf(cli);
+    int len = 0;
+    mqtt_packet_t* pkt = cli->inflight_head;
+    while (pkt && nwrite >= 0) {
+        // PUBLISH with DUP flag
+        if (!pkt->pubrel) pkt->buf[0] |= 0x08;
+        if (len + pkt->len > MQTT_MAX_BATCH_SIZE) {
+            if (len == 0) {
+                // large packet, send alone
+                nwrite = hio_write(cli->io, pkt->buf, pkt->len);
+                pkt = pkt->next;
+                continue;
+            }
+            nwrite = mqtt_client_send_batch(cli, buf, len);
+            len = 0;
+            continue;
+        }
+        memcpy(buf + len, pkt->buf, pkt->len);
+        len += pkt->len;
+        pkt = pkt->next;
+    }
+    if (nwrite >= 0) {
+        nwrite = mqtt_client_send_batch(cli, buf, len);
+    }
+    hmutex_unlock(&cli->mutex_);
+    return nwrite;
+}
+
+// send queued packets while in-flight window is not full
+static int mqtt_client_flush_queue(mqtt_client_t* cli) {
+    int nwrite = 0;
+    hmutex_lock(&cli->mutex_);
+    if (cli->queue_head == NULL || !cli->connected || !cli->io) {
+        hmutex_unlock(&cli->mutex_);
+        return 0;
+    }
+    unsigned char* buf = mqtt_client_batch_buf(cli);
+    int len = 0;
+    mqtt_packet_t* pkt = NULL;
+    while (cli->queue_head && nwrite >= 0) {
+        pkt = cli->queue_head;
+        if (pkt->qos > 0 && mqtt_client_inflight_full(cli)) break;
+        if (len + pkt->len > MQTT_MAX_BATCH_SIZE && len != 0) {
+            nwrite = mqtt_client_send_batch(cli, buf, len);
+            len = 0;
+            continue;
+        }
+        mqtt_packet_pop(&cli->queue_head, &cli->queue_tail);
+        cli->queued_bytes -= pkt->len;
+        if (pkt->len > MQTT_MAX_BATCH_SIZE) {
+            // large packet, send alone
+            nwrite = hio_write(cli->io, pkt->buf, pkt->len);
+        } else {
+            memcpy(buf + len, pkt->buf, pkt->len);
+            len += pkt->len;
+        }
+        if (pkt->qos > 0) {
+            mqtt_packet_push(&cli->inflight_head, &cli->inflight_tail, pkt);
+            ++cli->inflight_cnt;
+        } else {
+            HV_FREE(pkt);
+        }
+    }
+    if (nwrite >= 0) {
+        nwrite = mqtt_client_send_batch(cli, buf, len);
+    }
+    hmutex_unlock(&cli->mutex_);
+    return nwrite;
+}
+
+// PUBACK, PUBREC, PUBCOMP
+static void mqtt_client_on_ack(mqtt_client_t* cli, int type, unsigned short mid) {
+    mqtt_packet_t* pkt = NULL;
+    hmutex_lock(&cli->mutex_);
+    if (type == MQTT_TYPE_PUBREC) {
+        pkt = mqtt_packet_find(cli->inflight_head, mid);
+        if (pkt && pkt->qos == 2) {
+            // NOTE: replace PUBLISH with PUBREL to resend on reconnect
+            unsigned char* p = pkt->buf;
+            mqtt_head_t head;
+            memset(&head, 0, sizeof(head));
+            head.type = MQTT_TYPE_PUBREL;
+            head.qos = 1;
+            head.length = 2;
+            p += mqtt_head_pack(&head, p);
+            PUSH16(p, mid);
+            pkt->len = p - pkt->buf;
+            pkt->pubrel = 1;
+        }
+        pkt = NULL;
+    } else {
+        pkt = mqtt_packet_remove(&cli->inflight_head, &cli->inflight_tail, mid);
+        if (pkt) --cli->inflight_cnt;
+    }
+    hmutex_unlock(&cli->mutex_);
+    if (pkt) {
+        HV_FREE(pkt);
+        mqtt_client_flush_queue(cli);
+    }
+}
+
 /*
  * MQTT_TYPE_CONNECT
  * 2 + protocol_name + 1 protocol_version + 1 conn_flags + 2 keepalive + 2 + [client_id] +
@@ -238,6 +439,9 @@ static void on_packet(hio_t* io, void* buf, int len) {
             cli->ping_cnt = 0;
             hio_set_heartbeat(io, cli->keepalive * 1000, mqtt_send_ping);
         }
+        // resend unacknowledged, then queued packets
+        mqtt_client_resend_inflight(cli);
+        mqtt_client_flush_queue(cli);
     }
         break;
     case MQTT_TYPE_PUBLISH:
@@ -296,6 +500,9 @@ static void on_packet(hio_t* io, void* buf, int len) {
         } else if (cli->head.type == MQTT_TYPE_PUBREL) {
             mqtt_send_head_with_mid(io, MQTT_TYPE_PUBCOMP, cli->mid);
         }
+        if (cli->head.type != MQTT_TYPE_PUBREL) {
+            mqtt_client_on_ack(cli, cli->head.type, cli->mid);
+        }
     }
         break;
     // case MQTT_TYPE_SUBSCRIBE:
@@ -382,12 +589,17 @@ mqtt_client_t* mqtt_client_new(hloop_t* loop) {
     cli->loop = loop;
     cli->protocol_version = MQTT_PROTOCOL_V311;
     cli->keepalive = DEFAULT_MQTT_KEEPALIVE;
+    cli->max_inflight = DEFAULT_MQTT_MAX_INFLIGHT;
+    cli->max_queued_bytes = DEFAULT_MQTT_MAX_QUEUED_BYTES;
     hmutex_init(&cli->mutex_);
     return cli;
 }
 
 void mqtt_client_free(mqtt_client_t* cli) {
     if (!cli) return;
+    mqtt_packet_free_all(&cli->inflight_head, &cli->inflight_tail);
+    mqtt_packet_free_all(&cli->queue_head, &cli->queue_tail);
+    HV_FREE(cli->batch_buf);
     hmutex_destroy(&cli->mutex_);
     if (cli->ssl_ctx && cli->alloced_ssl_ctx) {
         hssl_ctx_free(cli->ssl_ctx);
@@ -528,8 +740,7 @@ int mqtt_client_disconnect(mqtt_client_t* cli) {
 }
 
 int mqtt_client_publish(mqtt_client_t* cli, mqtt_message_t* msg) {
-    if (!cli || !cli->io || !msg) return -1;
-    if (!cli->connected) return -2;
+    if (!cli || !msg) return -1;
     int topic_len = msg->topic_len ? msg->topic_len : strlen(msg->topic);
     int payload_len = msg->payload_len ? msg->payload_len : strlen(msg->payload);
     int len = 2 + topic_len + payload_len;
@@ -543,32 +754,52 @@ int mqtt_client_publish(mqtt_client_t* cli, mqtt_message_t* msg) {
     head.retain = msg->retain;
     head.length = len;
     int buflen = mqtt_estimate_length(&head);
-    // NOTE: send payload alone
-    buflen -= payload_len;
-    unsigned char* buf = NULL;
-    HV_STACK_ALLOC(buf, buflen);
-    unsigned char* p = buf;
+    // NOTE: pack head + topic + mid + payload into one packet, send by one write
+    mqtt_packet_t* pkt = mqtt_packet_new(buflen);
+    if (pkt == NULL) return -1;
+    pkt->qos = head.qos;
+    unsigned char* p = pkt->buf;
     int headlen = mqtt_head_pack(&head, p);
     p += headlen;
     PUSH16(p, topic_len);
     PUSH_N(p, msg->topic, topic_len);
-    if (msg->qos) {
-        mid = mqtt_next_mid();
-        PUSH16(p, mid);
-    }
 
+    int nwrite = 0;
     hmutex_lock(&cli->mutex_);
-    // send head + topic + mid
-    int nwrite = hio_write(cli->io, buf, p - buf);
-    HV_STACK_FREE(buf);
-    if (nwrite < 0) {
-        goto unlock;
+    if (pkt->qos) {
+        do {
+            mid = mqtt_next_mid(cli);
+        } while (mqtt_packet_find(cli->inflight_head, mid));
+        pkt->mid = mid;
+        PUSH16(p, mid);
+    }
+    PUSH_N(p, msg->payload, payload_len);
+    pkt->len = p - pkt->buf;
+
+    if (cli->io && cli->connected && cli->queue_head == NULL &&
+        (pkt->qos == 0 || !mqtt_client_inflight_full(cli))) {
+        nwrite = hio_write(cli->io, pkt->buf, pkt->len);
+        if (pkt->qos > 0) {
+            // NOTE: keep it even if write failed, resend on reconnect
+            mqtt_packet_push(&cli->inflight_head, &cli->inflight_tail, pkt);
+            ++cli->inflight_cnt;
+            nwrite = 0;
+            pkt = NULL;
+        } else if (nwrite >= 0) {
+            HV_FREE(pkt);
+        }
+        // QoS 0 write failed: the connection is lost, queue it like a disconnected publish
+    }
+    if (pkt) {
+        if (cli->queued_bytes + pkt->len <= cli->max_queued_bytes) {
+            mqtt_packet_push(&cli->queue_head, &cli->queue_tail, pkt);
+            cli->queued_bytes += pkt->len;
+            nwrite = 0;
+        } else {
+            nwrite = cli->connected && nwrite >= 0 ? -3 : -2;
+            HV_FREE(pkt);
+        }
     }
-
-    // send payload
-    nwrite = hio_write(cli->io, msg->payload, payload_len);
-
-unlock:
     hmutex_unlock(&cli->mutex_);
     return nwrite < 0 ? nwrite : mid;
 }
@@ -590,7 +821,9 @@ int mqtt_client_subscribe(mqtt_client_t* cli, const char* topic, int qos) {
     unsigned char* p = buf;
     int headlen = mqtt_head_pack(&head, p);
     p += headlen;
-    unsigned short mid = mqtt_next_mid();
+    hmutex_lock(&cli->mutex_);
+    unsigned short mid = mqtt_next_mid(cli);
+    hmutex_unlock(&cli->mutex_);
     PUSH16(p, mid);
     PUSH16(p, topic_len);
     PUSH_N(p, topic, topic_len);
@@ -618,7 +851,9 @@ int mqtt_client_unsubscribe(mqtt_client_t* cli, const char* topic) {
     unsigned char* p = buf;
     int headlen = mqtt_head_pack(&head, p);
     p += headlen;
-    unsigned short mid = mqtt_next_mid();
+    hmutex_lock(&cli->mutex_);
+    unsigned short mid = mqtt_next_mid(cli);
+    hmutex_unlock(&cli->mutex_);
     PUSH16(p, mid);
     PUSH16(p, topic_len);
     PUSH_N(p, topic, topic_len);
@@ -7,8 +7,11 @@
 #include "hmutex.h"
 
 #define DEFAULT_MQTT_KEEPALIVE  60 // s
+#define DEFAULT_MQTT_MAX_INFLIGHT       128
+#define DEFAULT_MQTT_MAX_QUEUED_BYTES   (1 << 22) // 4M
 
 typedef struct mqtt_client_s mqtt_client_t;
+typedef struct mqtt_packet_s mqtt_packet_t;
 
 // @type    mqtt_type_e
 // @example examples/mqtt
@@ -41,6 +44,19 @@ struct mqtt_client_s {
     int error;              // for MQTT_TYPE_CONNACK
     int mid;                // for MQTT_TYPE_SUBACK, MQTT_TYPE_PUBACK
     mqtt_message_t message; // for MQTT_TYPE_PUBLISH
+    // flow control
+    // QoS 1/2 publishes wait for PUBACK/PUBCOMP, resent with DUP on reconnect
+    int             max_inflight;       // Default DEFAULT_MQTT_MAX_INFLIGHT, 0 means unlimited
+    // publishes queued while disconnected or in-flight window is full, 0 means disabled
+    unsigned int    max_queued_bytes;   // Default DEFAULT_MQTT_MAX_QUEUED_BYTES
+    int             inflight_cnt;       // Read Only
+    unsigned int    queued_bytes;       // Read Only
+    mqtt_packet_t*  inflight_head;      // intern
+    mqtt_packet_t*  inflight_tail;
+    mqtt_packet_t*  queue_head;
+    mqtt_packet_t*  queue_tail;
+    unsigned char*  batch_buf;          // intern, coalesce packets into one write
+    unsigned short  next_mid;           // intern, last packet identifier
     // callback
     mqtt_client_cb cb;
     // userdata
@@ -114,6 +130,13 @@ HV_EXPORT bool mqtt_client_is_connected(mqtt_client_t* cli);
 HV_EXPORT int mqtt_client_disconnect(mqtt_client_t* cli);
 
 // publish
+// @retval >=0 accepted, sent or queued: mid of QoS 1/2, 0 for QoS 0;
+// -1 invalid,
+// -2 not connected, or the write failed, and the queue is disabled or full,
+// -3 connected, but the in-flight window and the queue are full.
+// NOTE: messages published while disconnected, or when the in-flight window is full,
+// or QoS 0 messages whose write failed, are queued, then sent by coalesced writes
+// after (re)connected. Set max_queued_bytes = 0 to get -2 when not connected.
 HV_EXPORT int mqtt_client_publish(mqtt_client_t* cli,
         mqtt_message_t* msg);
 
@@ -184,6 +207,15 @@ public:
         client->keepalive = sec;
     }
 
+    // flow control
+    void setMaxInflight(int cnt) {
+        client->max_inflight = cnt;
+    }
+
+    void setMaxQueuedBytes(unsigned int bytes) {
+        client->max_queued_bytes = bytes;
+    }
+
     int lastError() {
         return mqtt_client_get_last_error(client);
     }
@@ -0,0 +1,657 @@
+#include "ftp_client.h"
+
+#include "hdef.h"
+#include "hbase.h"
+#include "herr.h"
+#include "hlog.h"
+#include "hsocket.h"
+#include "list.h"
+
+#ifdef OS_LINUX
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#endif
+
+#define FTP_DATA_CHUNK_SIZE     (64 * 1024)
+
+enum ftp_op_type {
+    FTP_OP_LOGIN,
+    FTP_OP_EXEC,
+    FTP_OP_DOWNLOAD,
+    FTP_OP_UPLOAD,
+    FTP_OP_QUIT,
+};
+
+enum ftp_op_step {
+    FTP_STEP_START,
+    FTP_STEP_USER,      // LOGIN
+    FTP_STEP_PASS,      // LOGIN
+    FTP_STEP_PASV,      // DOWNLOAD, UPLOAD
+    FTP_STEP_PRELIM,    // RETR, STOR => 1xx
+    FTP_STEP_FINAL,     // data => 226
+};
+
+typedef struct ftp_op_s {
+    struct list_node    node;
+    int                 type;
+    int                 step;
+    char*               cmd;
+    char*               param;      // remote_filepath of DOWNLOAD, UPLOAD
+    char*               local_filepath;
+    ftp_client_cb       cb;
+    void*               userdata;
+} ftp_op_t;
+
+struct ftp_client_s {
+    hloop_t*            loop;
+    hio_t*              io;
+    unpack_setting_t    unpack_setting; // CRLF
+    int                 connected;
+    int                 closed;
+    int                 timeout_ms;
+    uint32_t            max_pending;
+    uint32_t            npending;
+    struct list_head    pending;
+    ftp_op_t*           current;
+    htimer_t*           timer;      // waiting for a reply or data
+    int                 timedout;
+    // multi-line reply
+    int                 multiline_code;
+    char                reply[256];
+    // data connection
+    hio_t*              data_io;
+    FILE*               fp;
+    int                 data_connected;
+    int                 data_started;   // upload starts after 1xx
+    int                 data_done;
+    int                 data_error;
+    int                 reply_done;
+    int                 final_code;
+    uint64_t            transfer_bytes;
+#ifdef OS_LINUX
+    int                 pipefd[2];      // splice socket => file
+#endif
+    char*               buf;            // FTP_DATA_CHUNK_SIZE
+    int                 buf_len;
+    int                 buf_off;
+    // free in callback
+    int                 calling;
+    int                 destroyed;
+};
+
+static void process_queue(ftp_client_t* cli);
+
+static void free_op(ftp_op_t* op) {
+    HV_FREE(op->cmd);
+    HV_FREE(op->param);
+    HV_FREE(op->local_filepath);
+    HV_FREE(op);
+}
+
+static void free_client(ftp_client_t* cli) {
+    while (!list_empty(&cli->pending)) {
+        ftp_op_t* op = list_entry(cli->pending.next, ftp_op_t, node);
+        list_del(&op->node);
+        free_op(op);
+    }
+#ifdef OS_LINUX
+    if (cli->pipefd[0] >= 0) {
+        close(cli->pipefd[0]);
+        close(cli->pipefd[1]);
+    }
+#endif
+    HV_FREE(cli->buf);
+    HV_FREE(cli);
+}
+
+// @retval 0 if cli is freed in callback
+static int call_cb(ftp_client_t* cli, ftp_op_t* op, int ret) {
+    if (op->cb) {
+        ++cli->calling;
+        op->cb(cli, ret, op->userdata);
+        --cli->calling;
+        if (cli->destroyed) {
+            if (cli->calling == 0) free_client(cli);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void reset_timer(ftp_client_t* cli) {
+    if (cli->timer) htimer_reset(cli->timer, 0);
+}
+
+//-----------------data connection---------------------------------------------
+static void data_close(ftp_client_t* cli) {
+    if (cli->data_io) {
+        hevent_set_userdata(cli->data_io, NULL);
+        hio_close(cli->data_io);
+        cli->data_io = NULL;
+    }
+    if (cli->fp) {
+        fclose(cli->fp);
+        cli->fp = NULL;
+    }
+    cli->data_connected = 0;
+    cli->data_started = 0;
+    cli->buf_len = cli->buf_off = 0;
+}
+
+static void op_done(ftp_client_t* cli, int ret);
+
+static void transfer_try_done(ftp_client_t* cli) {
+    if (!cli->data_done || !cli->reply_done) return;
+    int ret = cli->data_error;
+    if (ret == 0 && cli->final_code != FTP_STATUS_TRANSFER_COMPLETE && cli->final_code != FTP_STATUS_OK) {
+        ret = cli->final_code;
+    }
+    op_done(cli, ret);
+}
+
+static void data_finish(ftp_client_t* cli, int error) {
+    data_close(cli);
+    cli->data_done = 1;
+    cli->data_error = error;
+    transfer_try_done(cli);
+}
+
+// socket => file
+static void data_recv(ftp_client_t* cli) {
+    int fd = hio_fd(cli->data_io);
+    int ntotal = 0;
+#ifdef OS_LINUX
+    if (cli->pipefd[0] >= 0 || pipe2(cli->pipefd, O_NONBLOCK | O_CLOEXEC) == 0) {
+        int filefd = fileno(cli->fp);
+        while (1) {
+            ssize_t nrecv = splice(fd, NULL, cli->pipefd[1], NULL, FTP_DATA_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (nrecv == 0) {
+                data_finish(cli, 0);
+                return;
+            }
+            if (nrecv < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN) data_finish(cli, errno);
+                break;
+            }
+            // NOTE: the pipe is drained every time, so EAGAIN above means the socket is drained.
+            while (nrecv > 0) {
+                ssize_t nwrite = splice(cli->pipefd[0], NULL, filefd, NULL, nrecv, SPLICE_F_MOVE);
+                if (nwrite <= 0) {
+                    if (nwrite < 0 && errno == EINTR) continue;
+                    data_finish(cli, ERR_WRITE_FILE);
+                    return;
+                }
+                nrecv -= nwrite;
+                ntotal += nwrite;
+                cli->transfer_bytes += nwrite;
+            }
+        }
+        if (ntotal) reset_timer(cli);
+        return;
+    }
+    cli->pipefd[0] = cli->pipefd[1] = -1;
+#endif
+    while (1) {
+        int nrecv = recv(fd, cli->buf, FTP_DATA_CHUNK_SIZE, 0);
+        if (nrecv == 0) {
+            data_finish(cli, 0);
+            return;
+        }
+        if (nrecv < 0) {
+            int err = socket_errno();
+            if (err == EINTR) continue;
+            if (err != EAGAIN && err != EWOULDBLOCK) data_finish(cli, err);
+            break;
+        }
+        if (fwrite(cli->buf, 1, nrecv, cli->fp) != (size_t)nrecv) {
+            data_finish(cli, ERR_WRITE_FILE);
+            return;
+        }
+        ntotal += nrecv;
+        cli->transfer_bytes += nrecv;
+    }
+    if (ntotal) reset_timer(cli);
+}
+
+static void on_data_events(hio_t* io);
+
+// file => socket
+static void data_send(ftp_client_t* cli) {
+    hio_t* io = cli->data_io;
+    int fd = hio_fd(io);
+    int ntotal = 0;
+    int err = 0;
+#ifdef OS_LINUX
+    int filefd = fileno(cli->fp);
+    while (1) {
+        ssize_t nsend = sendfile(fd, filefd, NULL, FTP_DATA_CHUNK_SIZE);
+        if (nsend == 0) {
+            // EOF => close => 226
+            data_finish(cli, 0);
+            return;
+        }
+        if (nsend < 0) {
+            if (errno == EINTR) continue;
+            err = errno;
+            break;
+        }
+        ntotal += nsend;
+        cli->transfer_bytes += nsend;
+    }
+#else
+    while (1) {
+        if (cli->buf_off == cli->buf_len) {
+            cli->buf_off = 0;
+            cli->buf_len = fread(cli->buf, 1, FTP_DATA_CHUNK_SIZE, cli->fp);
+            if (cli->buf_len == 0) {
+                data_finish(cli, ferror(cli->fp) ? ERR_READ_FILE : 0);
+                return;
+            }
+        }
+        int nsend = send(fd, cli->buf + cli->buf_off, cli->buf_len - cli->buf_off, 0);
+        if (nsend < 0) {
+            err = socket_errno();
+            if (err == EINTR) continue;
+            break;
+        }
+        cli->buf_off += nsend;
+        ntotal += nsend;
+        cli->transfer_bytes += nsend;
+    }
+#endif
+    if (err != EAGAIN && err != EWOULDBLOCK) {
+        data_finish(cli, err);
+        return;
+    }
+    if (ntotal) reset_timer(cli);
+    // wait for writable
+    hio_add(io, on_data_events, HV_WRITE);
+}
+
+static void on_data_events(hio_t* io) {
+    ftp_client_t* cli = (ftp_client_t*)hevent_userdata(io);
+    if (cli == NULL) return;
+    ftp_op_t* op = cli->current;
+    if (!cli->data_connected) {
+        int err = 0;
+        socklen_t optlen = sizeof(err);
+        getsockopt(hio_fd(io), SOL_SOCKET, SO_ERROR, (char*)&err, &optlen);
+        if (err) {
+            data_finish(cli, err);
+            return;
+        }
+        cli->data_connected = 1;
+        hio_del(io, HV_WRITE);
+        if (op->type == FTP_OP_DOWNLOAD) {
+            hio_add(io, on_data_events, HV_READ);
+        }
+    }
+    if (op->type == FTP_OP_DOWNLOAD) {
+        data_recv(cli);
+    } else if (cli->data_started) {
+        hio_del(io, HV_WRITE);
+        data_send(cli);
+    }
+}
+
+static int data_connect(ftp_client_t* cli, const char* host, int port) {
+    int fd = ConnectNonblock(host, port);
+    if (fd < 0) return fd;
+    hio_t* io = hio_get(cli->loop, fd);
+    hevent_set_userdata(io, cli);
+    cli->data_io = io;
+    cli->data_connected = 0;
+    // writable => connected
+    hio_add(io, on_data_events, HV_WRITE);
+    return 0;
+}
+
+static int ftp_parse_pasv(const char* resp, char* host, int* port) {
+    // 227 Entering Passive Mode (127,0,0,1,4,51)
+    const char* str = strchr(resp, '(');
+    if (str == NULL) {
+        return ERR_RESPONSE;
+    }
+    int arr[6];
+    if (sscanf(str, "(%d,%d,%d,%d,%d,%d)",
+            &arr[0], &arr[1], &arr[2], &arr[3], &arr[4], &arr[5]) != 6) {
+        return ERR_RESPONSE;
+    }
+    sprintf(host, "%d.%d.%d.%d", arr[0], arr[1], arr[2], arr[3]);
+    *port = arr[4] << 8 | arr[5];
+    return 0;
+}
+
+//-----------------control connection---------------------------------------------
+static void send_command(ftp_client_t* cli, const char* cmd, const char* param) {
+    char buf[1024];
+    int len = 0;
+    if (param && *param) {
+        len = snprintf(buf, sizeof(buf), "%s %s\r\n", cmd, param);
+    }
+    else {
+        len = snprintf(buf, sizeof(buf), "%s\r\n", cmd);
+    }
+    if (len >= (int)sizeof(buf)) len = sizeof(buf) - 1;
+    hio_write(cli->io, buf, len);
+}
+
+static void on_timeout(htimer_t* timer) {
+    ftp_client_t* cli = (ftp_client_t*)hevent_userdata(timer);
+    cli->timer = NULL;
+    hlogw("ftp %s timeout", cli->current && cli->current->cmd ? cli->current->cmd : "LOGIN");
+    // the state of the control connection is unknown
+    cli->timedout = 1;
+    hio_close(cli->io);
+}
+
+static void op_done(ftp_client_t* cli, int ret) {
+    ftp_op_t* op = cli->current;
+    if (op == NULL) return;
+    cli->current = NULL;
+    if (cli->timer) {
+        htimer_del(cli->timer);
+        cli->timer = NULL;
+    }
+    data_close(cli);
+    int quit = op->type == FTP_OP_QUIT;
+    if (quit && cli->io) {
+        hevent_set_userdata(cli->io, NULL);
+        hio_close(cli->io);
+        cli->io = NULL;
+        cli->closed = 1;
+    }
+    int alive = call_cb(cli, op, ret);
+    free_op(op);
+    if (alive) process_queue(cli);
+}
+
+static void start_transfer(ftp_client_t* cli, ftp_op_t* op) {
+    char host[64];
+    int port = 0;
+    int ret = ftp_parse_pasv(cli->reply, host, &port);
+    if (ret != 0) {
+        op_done(cli, ret);
+        return;
+    }
+    cli->fp = fopen(op->local_filepath, op->type == FTP_OP_DOWNLOAD ? "wb" : "rb");
+    if (cli->fp == NULL) {
+        op_done(cli, ERR_OPEN_FILE);
+        return;
+    }
+    cli->transfer_bytes = 0;
+    cli->data_done = cli->data_error = 0;
+    cli->reply_done = cli->final_code = 0;
+    ret = data_connect(cli, host, port);
+    if (ret != 0) {
+        op_done(cli, ret);
+        return;
+    }
+    op->step = FTP_STEP_PRELIM;
+    send_command(cli, op->cmd, op->param);
+}
+
+static void on_reply(ftp_client_t* cli, int code) {
+    ftp_op_t* op = cli->current;
+    if (op == NULL) {
+        // e.g. 421 Service not available, closing control connection
+        hlogw("ftp unexpected reply: %s", cli->reply);
+        return;
+    }
+    reset_timer(cli);
+    switch (op->type) {
+    case FTP_OP_LOGIN:
+        if (op->step == FTP_STEP_START) {
+            if (code != FTP_STATUS_READY) {
+                op_done(cli, code);
+                return;
+            }
+            op->step = FTP_STEP_USER;
+            send_command(cli, "USER", op->cmd);
+        } else if (op->step == FTP_STEP_USER && code == FTP_STATUS_PASS) {
+            op->step = FTP_STEP_PASS;
+            send_command(cli, "PASS", op->param);
+        } else {
+            op_done(cli, code == FTP_STATUS_LOGIN_OK ? 0 : code);
+        }
+        break;
+    case FTP_OP_EXEC:
+        op_done(cli, code);
+        break;
+    case FTP_OP_QUIT:
+        op_done(cli, code == FTP_STATUS_BYE ? 0 : code);
+        break;
+    case FTP_OP_DOWNLOAD:
+    case FTP_OP_UPLOAD:
+        if (op->step == FTP_STEP_PASV) {
+            if (code != FTP_STATUS_PASV) {
+                op_done(cli, code);
+                return;
+            }
+            start_transfer(cli, op);
+        } else if (op->step == FTP_STEP_PRELIM) {
+            // 125 Data connection already open; 150 File status okay
+            if (code < 100 || code >= 200) {
+                op_done(cli, code);
+                return;
+            }
+            op->step = FTP_STEP_FINAL;
+            if (op->type == FTP_OP_UPLOAD && !cli->data_done) {
+                cli->data_started = 1;
+                if (cli->data_connected) data_send(cli);
+            }
+        } else {
+            cli->reply_done = 1;
+            cli->final_code = code;
+            transfer_try_done(cli);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void on_line(hio_t* io, void* buf, int len) {
+    ftp_client_t* cli = (ftp_client_t*)hevent_userdata(io);
+    if (cli == NULL) return;
+    char* line = (char*)buf;
+    // trim CRLF
+    while (len > 0 && (line[len-1] == '\r' || line[len-1] == '\n')) --len;
+    if (len >= (int)sizeof(cli->reply)) len = sizeof(cli->reply) - 1;
+    memcpy(cli->reply, line, len);
+    cli->reply[len] = '\0';
+    int code = len >= 3 && IS_DIGIT(line[0]) ? atoi(cli->reply) : 0;
+    if (cli->multiline_code) {
+        // 211-Features:
+        //  SIZE
+        // 211 End
+        if (code != cli->multiline_code || len < 4 || line[3] != ' ') return;
+        cli->multiline_code = 0;
+    } else if (code && len >= 4 && line[3] == '-') {
+        cli->multiline_code = code;
+        return;
+    }
+    if (code == 0) return;
+    on_reply(cli, code);
+}
+
+static void on_close(hio_t* io) {
+    ftp_client_t* cli = (ftp_client_t*)hevent_userdata(io);
+    if (cli == NULL) return;
+    cli->io = NULL;
+    cli->connected = 0;
+    cli->closed = 1;
+    int err = cli->timedout ? ETIMEDOUT : hio_error(io);
+    if (err == 0) err = ERR_RECV;
+    if (cli->timer) {
+        htimer_del(cli->timer);
+        cli->timer = NULL;
+    }
+    data_close(cli);
+    // fail all operations
+    while (cli->current || !list_empty(&cli->pending)) {
+        ftp_op_t* op = cli->current;
+        if (op) {
+            cli->current = NULL;
+        } else {
+            op = list_entry(cli->pending.next, ftp_op_t, node);
+            list_del(&op->node);
+            --cli->npending;
+        }
+        int alive = call_cb(cli, op, err);
+        free_op(op);
+        if (!alive) return;
+    }
+}
+
+static void on_connect(hio_t* io) {
+    ftp_client_t* cli = (ftp_client_t*)hevent_userdata(io);
+    if (cli == NULL) return;
+    cli->connected = 1;
+    hio_set_unpack(io, &cli->unpack_setting);
+    hio_setcb_read(io, on_line);
+    hio_read_start(io);
+    process_queue(cli);
+}
+
+static void process_queue(ftp_client_t* cli) {
+    while (cli->connected && cli->current == NULL && !list_empty(&cli->pending)) {
+        ftp_op_t* op = list_entry(cli->pending.next, ftp_op_t, node);
+        list_del(&op->node);
+        --cli->npending;
+        cli->current = op;
+        cli->multiline_code = 0;
+        cli->timer = htimer_add(cli->loop, on_timeout, cli->timeout_ms, 1);
+        hevent_set_userdata(cli->timer, cli);
+        switch (op->type) {
+        case FTP_OP_LOGIN:
+            // wait for 220
+            break;
+        case FTP_OP_DOWNLOAD:
+        case FTP_OP_UPLOAD:
+            op->step = FTP_STEP_PASV;
+            send_command(cli, "PASV", NULL);
+            break;
+        default:
+            send_command(cli, op->cmd, op->param);
+            break;
+        }
+    }
+}
+
+static int add_op(ftp_client_t* cli, int type, const char* cmd, const char* param, const char* local_filepath,
+                  ftp_client_cb cb, void* userdata) {
+    if (cli->closed || (cli->io == NULL && type != FTP_OP_LOGIN)) return ERR_INVALID_HANDLE;
+    if (cli->npending >= cli->max_pending) return ERR_TASK_QUEUE_FULL;
+    ftp_op_t* op = NULL;
+    HV_ALLOC_SIZEOF(op);
+    op->type = type;
+    op->step = FTP_STEP_START;
+    op->cmd = cmd ? strdup(cmd) : NULL;
+    op->param = param ? strdup(param) : NULL;
+    op->local_filepath = local_filepath ? strdup(local_filepath) : NULL;
+    op->cb = cb;
+    op->userdata = userdata;
+    if (type == FTP_OP_LOGIN) {
+        list_add(&op->node, &cli->pending);
+    } else {
+        list_add_tail(&op->node, &cli->pending);
+    }
+    ++cli->npending;
+    process_queue(cli);
+    return 0;
+}
+
+ftp_client_t* ftp_client_new(hloop_t* loop) {
+    ftp_client_t* cli = NULL;
+    HV_ALLOC_SIZEOF(cli);
+    cli->loop = loop;
+    cli->timeout_ms = FTP_CLIENT_DEFAULT_TIMEOUT;
+    cli->max_pending = FTP_CLIENT_DEFAULT_MAX_PENDING;
+    list_init(&cli->pending);
+    cli->unpack_setting.mode = UNPACK_BY_DELIMITER;
+    cli->unpack_setting.package_max_length = FTP_RECV_BUFSIZE;
+    cli->unpack_setting.delimiter[0] = '\r';
+    cli->unpack_setting.delimiter[1] = '\n';
+    cli->unpack_setting.delimiter_bytes = 2;
+#ifdef OS_LINUX
+    cli->pipefd[0] = cli->pipefd[1] = -1;
+#endif
+    HV_ALLOC(cli->buf, FTP_DATA_CHUNK_SIZE);
+    return cli;
+}
+
+void ftp_client_free(ftp_client_t* cli) {
+    if (cli == NULL || cli->destroyed) return;
+    cli->destroyed = 1;
+    if (cli->timer) {
+        htimer_del(cli->timer);
+        cli->timer = NULL;
+    }
+    data_close(cli);
+    if (cli->io) {
+        hevent_set_userdata(cli->io, NULL);
+        hio_close(cli->io);
+        cli->io = NULL;
+    }
+    if (cli->current) {
+        free_op(cli->current);
+        cli->current = NULL;
+    }
+    // NOTE: freed after the callback returns
+    if (cli->calling) return;
+    free_client(cli);
+}
+
+void ftp_client_set_timeout(ftp_client_t* cli, int ms) {
+    cli->timeout_ms = ms;
+}
+
+void ftp_client_set_max_pending(ftp_client_t* cli, uint32_t max_pending) {
+    cli->max_pending = max_pending;
+}
+
+const char* ftp_client_reply(ftp_client_t* cli) {
+    return cli->reply;
+}
+
+uint64_t ftp_client_transfer_bytes(ftp_client_t* cli) {
+    return cli->transfer_bytes;
+}
+
+int ftp_client_connect(ftp_client_t* cli, const char* host, int port,
+                       const char* username, const char* password,
+                       ftp_client_cb cb, void* userdata) {
+    if (cli->io || cli->closed) return ERR_INVALID_HANDLE;
+    hio_t* io = hio_create_socket(cli->loop, host, port, HIO_TYPE_TCP, HIO_CLIENT_SIDE);
+    if (io == NULL) return ERR_SOCKET;
+    cli->io = io;
+    hevent_set_userdata(io, cli);
+    hio_setcb_connect(io, on_connect);
+    hio_setcb_close(io, on_close);
+    hio_set_connect_timeout(io, cli->timeout_ms);
+    // LOGIN: cmd = username, param = password
+    add_op(cli, FTP_OP_LOGIN, username, password, NULL, cb, userdata);
+    hio_connect(io);
+    return 0;
+}
+
+int ftp_client_exec(ftp_client_t* cli, const char* cmd, const char* param,
+                    ftp_client_cb cb, void* userdata) {
+    return add_op(cli, FTP_OP_EXEC, cmd, param, NULL, cb, userdata);
+}
+
+int ftp_client_download(ftp_client_t* cli, const char* remote_filepath, const char* local_filepath,
+                        ftp_client_cb cb, void* userdata) {
+    return add_op(cli, FTP_OP_DOWNLOAD, "RETR", remote_filepath, local_filepath, cb, userdata);
+}
+
+int ftp_client_upload(ftp_client_t* cli, const char* local_filepath, const char* remote_filepath,
+                      ftp_client_cb cb, void* userdata) {
+    return add_op(cli, FTP_OP_UPLOAD, "STOR", remote_filepath, local_filepath, cb, userdata);
+}
+
+int ftp_client_quit(ftp_client_t* cli, ftp_client_cb cb, void* userdata) {
+    return add_op(cli, FTP_OP_QUIT, "QUIT", NULL, NULL, cb, userdata);
+}
@@ -0,0 +1,471 @@
+#include "probe.h"
+
+#include "hdef.h"
+#include "hbase.h"
+#include "herr.h"
+#include "hlog.h"
+#include "hsocket.h"
+#include "htime.h"
+#include "hversion.h"
+#include "list.h"
+#include "netinet.h"
+
+#define ICMP_PACKET_SIZE    64
+#define HTTP_STATUS_LINE_LEN 12 // HTTP/1.1 200
+
+enum {
+    PROBE_IDLE,
+    PROBE_WAITING,
+    PROBE_RUNNING,
+};
+
+struct hprober_s {
+    hloop_t*            loop;
+    uint32_t            max_concurrency;
+    uint32_t            running;
+    struct list_head    targets;
+    struct list_head    waiting;
+    // ICMP, 0: IPv4, 1: IPv6
+    hio_t*              icmp_io[2];
+    int                 icmp_dgram[2];
+    int                 icmp_error[2];
+    uint16_t            echo_seq[2];
+    uint16_t            echo_id;
+    // seq % HPROBE_MAX_ICMP_INFLIGHT => target
+    hprobe_target_t**   icmp_pending[2];
+};
+
+struct hprobe_target_s {
+    hprober_t*          prober;
+    struct list_node    node;       // prober->targets
+    struct list_node    wait_node;  // prober->waiting
+    hprobe_type_e       type;
+    char                host[64];
+    char                path[256];
+    sockaddr_u          addr;
+    uint32_t            interval_ms;
+    uint32_t            timeout_ms;
+    uint32_t            rise;
+    uint32_t            fall;
+    hprobe_cb           cb;
+    void*               userdata;
+
+    htimer_t*           interval_timer;
+    htimer_t*           timeout_timer;
+    hio_t*              io;         // TCP, HTTP
+    uint16_t            echo_seq;
+    int                 state;
+    int                 up;
+    int                 scheduled;  // interval_timer is reset from the random first delay
+    uint64_t            start_hrtime;
+    char                status_line[HTTP_STATUS_LINE_LEN + 1];
+    int                 status_len;
+    hprobe_stats_t      stats;
+};
+
+static void start_probe(hprobe_target_t* target);
+
+static int addr_equal(const sockaddr_u* a, const sockaddr_u* b) {
+    if (a->sa.sa_family != b->sa.sa_family) return 0;
+    if (a->sa.sa_family == AF_INET) {
+        return a->sin.sin_addr.s_addr == b->sin.sin_addr.s_addr;
+    }
+    if (a->sa.sa_family == AF_INET6) {
+        return memcmp(&a->sin6.sin6_addr, &b->sin6.sin6_addr, sizeof(a->sin6.sin6_addr)) == 0;
+    }
+    return 0;
+}
+
+static void start_waiting(hprober_t* prober) {
+    while (prober->running < prober->max_concurrency && !list_empty(&prober->waiting)) {
+        hprobe_target_t* target = list_entry(prober->waiting.next, hprobe_target_t, wait_node);
+        list_del(&target->wait_node);
+        start_probe(target);
+    }
+}
+
+// stop the running probe, no callback
+static void cancel_probe(hprobe_target_t* target) {
+    hprober_t* prober = target->prober;
+    if (target->state == PROBE_WAITING) {
+        list_del(&target->wait_node);
+    }
+    if (target->state != PROBE_RUNNING) {
+        target->state = PROBE_IDLE;
+        return;
+    }
+    target->state = PROBE_IDLE;
+    --prober->running;
+    if (target->timeout_timer) {
+        htimer_del(target->timeout_timer);
+        target->timeout_timer = NULL;
+    }
+    if (target->io) {
+        hevent_set_userdata(target->io, NULL);
+        hio_close(target->io);
+        target->io = NULL;
+    }
+    if (target->type == HPROBE_ICMP) {
+        int v6 = target->addr.sa.sa_family == AF_INET6;
+        hprobe_target_t** slot = &prober->icmp_pending[v6][target->echo_seq % HPROBE_MAX_ICMP_INFLIGHT];
+        if (*slot == target) *slot = NULL;
+    }
+}
+
+static void probe_done(hprobe_target_t* target, int ok, int error, int status_code) {
+    if (target->state != PROBE_RUNNING) return;
+    hprober_t* prober = target->prober;
+    hprobe_stats_t* stats = &target->stats;
+    hprobe_result_t result;
+    memset(&result, 0, sizeof(result));
+    result.ok = ok;
+    result.error = ok ? 0 : error;
+    result.status_code = status_code;
+    result.rtt_us = (uint32_t)(gethrtime_us() - target->start_hrtime);
+    cancel_probe(target);
+
+    if (ok) {
+        ++stats->successes;
+        ++stats->consecutive_successes;
+        stats->consecutive_failures = 0;
+        hloop_histogram_observe(&stats->rtt, result.rtt_us);
+        if (!target->up && stats->consecutive_successes >= target->rise) {
+            target->up = 1;
+            result.changed = 1;
+        }
+    } else {
+        ++stats->failures;
+        if (error == ETIMEDOUT) ++stats->timeouts;
+        ++stats->consecutive_failures;
+        stats->consecutive_successes = 0;
+        if (target->up && stats->consecutive_failures >= target->fall) {
+            target->up = 0;
+            result.changed = 1;
+        }
+    }
+    result.up = target->up;
+    // NOTE: cb may delete target
+    if (target->cb) {
+        target->cb(target, &result);
+    }
+    start_waiting(prober);
+}
+
+static void on_probe_timeout(htimer_t* timer) {
+    hprobe_target_t* target = (hprobe_target_t*)hevent_userdata(timer);
+    // NOTE: the timer is deleted after callback
+    target->timeout_timer = NULL;
+    probe_done(target, 0, ETIMEDOUT, 0);
+}
+
+//-----------------ICMP---------------------------------------------
+static void on_icmp_recv(hio_t* io, void* buf, int readbytes) {
+    hprober_t* prober = (hprober_t*)hevent_userdata(io);
+    if (prober == NULL) return;
+    int v6 = io == prober->icmp_io[1];
+    uint8_t* data = (uint8_t*)buf;
+    int len = readbytes;
+    // NOTE: IPv4 raw sockets receive the IP header.
+    if (!v6 && !prober->icmp_dgram[v6]) {
+        if (len < (int)sizeof(iphdr_t)) return;
+        int iphdr_len = ((iphdr_t*)data)->ihl * 4;
+        data += iphdr_len;
+        len -= iphdr_len;
+    }
+    if (len < (int)sizeof(icmphdr_t)) return;
+    icmp_t* icmp = (icmp_t*)data;
+    if (icmp->icmp_type != (v6 ? ICMPV6_ECHOREPLY : ICMP_ECHOREPLY)) return;
+    // NOTE: ping sockets rewrite id, and only receive their own replies.
+    if (!prober->icmp_dgram[v6] && icmp->icmp_id != prober->echo_id) return;
+    uint16_t seq = icmp->icmp_seq;
+    hprobe_target_t* target = prober->icmp_pending[v6][seq % HPROBE_MAX_ICMP_INFLIGHT];
+    if (target == NULL || target->echo_seq != seq) return;
+    if (!addr_equal(&target->addr, (sockaddr_u*)hio_peeraddr(io))) return;
+    probe_done(target, 1, 0, 0);
+}
+
+static hio_t* icmp_open(hprober_t* prober, int v6) {
+    if (prober->icmp_io[v6]) return prober->icmp_io[v6];
+    if (prober->icmp_error[v6]) return NULL;
+    int family = v6 ? AF_INET6 : AF_INET;
+    int protocol = v6 ? IPPROTO_ICMPV6 : IPPROTO_ICMP;
+    int dgram = 1;
+    int sockfd = socket(family, SOCK_DGRAM, protocol);
+    if (sockfd < 0) {
+        dgram = 0;
+        sockfd = socket(family, SOCK_RAW, protocol);
+    }
+    if (sockfd < 0) {
+        prober->icmp_error[v6] = socket_errno();
+        hloge("create icmp socket failed: %d, please use root or allow ping sockets", prober->icmp_error[v6]);
+        return NULL;
+    }
+    nonblocking(sockfd);
+    hio_t* io = hio_get(prober->loop, sockfd);
+    hevent_set_userdata(io, prober);
+    hio_setcb_read(io, on_icmp_recv);
+    hio_read_start(io);
+    HV_ALLOC(prober->icmp_pending[v6], sizeof(hprobe_target_t*) * HPROBE_MAX_ICMP_INFLIGHT);
+    prober->icmp_dgram[v6] = dgram;
+    prober->icmp_io[v6] = io;
+    return io;
+}
+
+static void icmp_probe(hprobe_target_t* target) {
+    hprober_t* prober = target->prober;
+    int v6 = target->addr.sa.sa_family == AF_INET6;
+    hio_t* io = icmp_open(prober, v6);
+    if (io == NULL) {
+        probe_done(target, 0, prober->icmp_error[v6], 0);
+        return;
+    }
+    // a free slot, seq is unique in flight
+    hprobe_target_t** slot = NULL;
+    for (int i = 0; i < HPROBE_MAX_ICMP_INFLIGHT; ++i) {
+        uint16_t seq = ++prober->echo_seq[v6];
+        slot = &prober->icmp_pending[v6][seq % HPROBE_MAX_ICMP_INFLIGHT];
+        if (*slot == NULL) {
+            target->echo_seq = seq;
+            break;
+        }
+        slot = NULL;
+    }
+    if (slot == NULL) {
+        probe_done(target, 0, ERR_OVER_LIMIT, 0);
+        return;
+    }
+    *slot = target;
+
+    char sendbuf[ICMP_PACKET_SIZE];
+    memset(sendbuf, 0, sizeof(sendbuf));
+    icmp_t* icmp = (icmp_t*)sendbuf;
+    icmp->icmp_type = v6 ? ICMPV6_ECHO : ICMP_ECHO;
+    icmp->icmp_code = 0;
+    icmp->icmp_id = prober->echo_id;
+    icmp->icmp_seq = target->echo_seq;
+    for (int i = sizeof(icmphdr_t); i < ICMP_PACKET_SIZE; ++i) {
+        sendbuf[i] = (char)i;
+    }
+    // NOTE: the kernel computes checksum of ICMPv6
+    if (!v6) {
+        icmp->icmp_cksum = checksum((uint8_t*)sendbuf, ICMP_PACKET_SIZE);
+    }
+    // NOTE: sendto directly, a queued write would go to the peeraddr of the next probe.
+    int nsend = sendto(hio_fd(io), sendbuf, ICMP_PACKET_SIZE, 0, &target->addr.sa, sockaddr_len(&target->addr));
+    if (nsend < 0) {
+        probe_done(target, 0, socket_errno(), 0);
+    }
+}
+
+//-----------------TCP/HTTP---------------------------------------------
+static void on_tcp_close(hio_t* io) {
+    hprobe_target_t* target = (hprobe_target_t*)hevent_userdata(io);
+    if (target == NULL) return;
+    target->io = NULL;
+    int error = hio_error(io);
+    probe_done(target, 0, error ? error : ERR_RESPONSE, 0);
+}
+
+static void on_http_recv(hio_t* io, void* buf, int readbytes) {
+    hprobe_target_t* target = (hprobe_target_t*)hevent_userdata(io);
+    if (target == NULL) return;
+    int len = MIN(readbytes, HTTP_STATUS_LINE_LEN - target->status_len);
+    memcpy(target->status_line + target->status_len, buf, len);
+    target->status_len += len;
+    if (target->status_len < HTTP_STATUS_LINE_LEN) return;
+    target->status_line[HTTP_STATUS_LINE_LEN] = '\0';
+    // HTTP/1.1 200
+    int status_code = 0;
+    if (strncmp(target->status_line, "HTTP/1.", 7) == 0) {
+        status_code = atoi(target->status_line + 9);
+    }
+    int ok = status_code >= 200 && status_code < 400;
+    probe_done(target, ok, ERR_RESPONSE, status_code);
+}
+
+static void on_tcp_connect(hio_t* io) {
+    hprobe_target_t* target = (hprobe_target_t*)hevent_userdata(io);
+    if (target == NULL) return;
+    if (target->type == HPROBE_TCP) {
+        probe_done(target, 1, 0, 0);
+        return;
+    }
+    char request[512];
+    int len = snprintf(request, sizeof(request),
+            "GET %s HTTP/1.1\r\n"
+            "Host: %s\r\n"
+            "User-Agent: libhv/" HV_VERSION_STRING "\r\n"
+            "Connection: close\r\n\r\n",
+            target->path, target->host);
+    target->status_len = 0;
+    hio_setcb_read(io, on_http_recv);
+    hio_write(io, request, len);
+    hio_read_start(io);
+}
+
+static void tcp_probe(hprobe_target_t* target) {
+    int sockfd = socket(target->addr.sa.sa_family, SOCK_STREAM, 0);
+    if (sockfd < 0) {
+        probe_done(target, 0, socket_errno(), 0);
+        return;
+    }
+    hio_t* io = hio_get(target->prober->loop, sockfd);
+    hio_set_peeraddr(io, &target->addr.sa, sockaddr_len(&target->addr));
+    hevent_set_userdata(io, target);
+    target->io = io;
+    hio_setcb_connect(io, on_tcp_connect);
+    hio_setcb_close(io, on_tcp_close);
+    hio_set_connect_timeout(io, target->timeout_ms);
+    hio_connect(io);
+}
+
+//-----------------scheduler---------------------------------------------
+static void start_probe(hprobe_target_t* target) {
+    hprober_t* prober = target->prober;
+    target->state = PROBE_RUNNING;
+    ++prober->running;
+    ++target->stats.probes;
+    target->start_hrtime = gethrtime_us();
+    target->timeout_timer = htimer_add(prober->loop, on_probe_timeout, target->timeout_ms, 1);
+    hevent_set_userdata(target->timeout_timer, target);
+    if (target->type == HPROBE_ICMP) {
+        icmp_probe(target);
+    } else {
+        tcp_probe(target);
+    }
+}
+
+static void on_interval(htimer_t* timer) {
+    hprobe_target_t* target = (hprobe_target_t*)hevent_userdata(timer);
+    hprober_t* prober = target->prober;
+    if (!target->scheduled) {
+        // the first delay is random
+        target->scheduled = 1;
+        htimer_reset(timer, target->interval_ms);
+    }
+    if (target->state != PROBE_IDLE) {
+        ++target->stats.skipped;
+        return;
+    }
+    if (prober->running >= prober->max_concurrency) {
+        target->state = PROBE_WAITING;
+        list_add_tail(&target->wait_node, &prober->waiting);
+        return;
+    }
+    start_probe(target);
+}
+
+hprober_t* hprober_new(hloop_t* loop, uint32_t max_concurrency) {
+    hprober_t* prober = NULL;
+    HV_ALLOC_SIZEOF(prober);
+    prober->loop = loop;
+    prober->max_concurrency = max_concurrency ? max_concurrency : HPROBE_DEFAULT_MAX_CONCURRENCY;
+    prober->echo_id = (uint16_t)hv_rand(1, 65535);
+    list_init(&prober->targets);
+    list_init(&prober->waiting);
+    return prober;
+}
+
+static void free_target(hprobe_target_t* target) {
+    cancel_probe(target);
+    if (target->interval_timer) {
+        htimer_del(target->interval_timer);
+        target->interval_timer = NULL;
+    }
+    list_del(&target->node);
+    HV_FREE(target);
+}
+
+void hprober_free(hprober_t* prober) {
+    if (prober == NULL) return;
+    while (!list_empty(&prober->targets)) {
+        free_target(list_entry(prober->targets.next, hprobe_target_t, node));
+    }
+    for (int v6 = 0; v6 < 2; ++v6) {
+        if (prober->icmp_io[v6]) {
+            hevent_set_userdata(prober->icmp_io[v6], NULL);
+            hio_close(prober->icmp_io[v6]);
+        }
+        HV_FREE(prober->icmp_pending[v6]);
+    }
+    HV_FREE(prober);
+}
+
+uint32_t hprober_inflight(hprober_t* prober) {
+    return prober->running;
+}
+
+void hprober_stats(hprober_t* prober, hprobe_stats_t* stats) {
+    memset(stats, 0, sizeof(hprobe_stats_t));
+    struct list_node* node;
+    list_for_each(node, &prober->targets) {
+        hprobe_target_t* target = list_entry(node, hprobe_target_t, node);
+        const hprobe_stats_t* s = &target->stats;
+        stats->probes += s->probes;
+        stats->successes += s->successes;
+        stats->failures += s->failures;
+        stats->timeouts += s->timeouts;
+        stats->skipped += s->skipped;
+        stats->consecutive_successes += s->consecutive_successes;
+        stats->consecutive_failures += s->consecutive_failures;
+        for (int i = 0; i <= HLOOP_HISTOGRAM_BUCKETS; ++i) {
+            stats->rtt.buckets[i] += s->rtt.buckets[i];
+        }
+        stats->rtt.count += s->rtt.count;
+        stats->rtt.sum += s->rtt.sum;
+    }
+}
+
+hprobe_target_t* hprober_add(hprober_t* prober, const hprobe_setting_t* setting, hprobe_cb cb, void* userdata) {
+    if (setting->host == NULL) return NULL;
+    sockaddr_u addr;
+    memset(&addr, 0, sizeof(addr));
+    if (ResolveAddr(setting->host, &addr) != 0) {
+        hloge("probe: unknown host %s", setting->host);
+        return NULL;
+    }
+    if (setting->type != HPROBE_ICMP) {
+        sockaddr_set_port(&addr, setting->port);
+    }
+    hprobe_target_t* target = NULL;
+    HV_ALLOC_SIZEOF(target);
+    target->prober = prober;
+    target->type = setting->type;
+    hv_strncpy(target->host, setting->host, sizeof(target->host));
+    hv_strncpy(target->path, setting->path ? setting->path : "/", sizeof(target->path));
+    target->addr = addr;
+    target->interval_ms = setting->interval_ms ? setting->interval_ms : HPROBE_DEFAULT_INTERVAL;
+    target->timeout_ms = setting->timeout_ms ? setting->timeout_ms : HPROBE_DEFAULT_TIMEOUT;
+    target->rise = setting->rise ? setting->rise : 1;
+    target->fall = setting->fall ? setting->fall : 1;
+    target->cb = cb;
+    target->userdata = userdata;
+    target->state = PROBE_IDLE;
+    list_add_tail(&target->node, &prober->targets);
+
+    target->interval_timer = htimer_add(prober->loop, on_interval, hv_rand(1, target->interval_ms), INFINITE);
+    hevent_set_userdata(target->interval_timer, target);
+    return target;
+}
+
+void hprober_del(hprobe_target_t* target) {
+    hprober_t* prober = target->prober;
+    free_target(target);
+    start_waiting(prober);
+}
+
+void* hprobe_target_userdata(hprobe_target_t* target) {
+    return target->userdata;
+}
+
+const char* hprobe_target_host(hprobe_target_t* target) {
+    return target->host;
+}
+
+int hprobe_target_up(hprobe_target_t* target) {
+    return target->up;
+}
+
+const hprobe_stats_t* hprobe_target_stats(hprobe_target_t* target) {
+    return &target->stats;
+}
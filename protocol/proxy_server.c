@@ -0,0 +1,678 @@
+#include "proxy_server.h"
+
+#include "hdef.h"
+#include "hbase.h"
+#include "hsocket.h"
+#include "herr.h"
+#include "hlog.h"
+#include "hmutex.h"
+#include "hthread.h"
+#include "list.h"
+#include "base64.h"
+
+#define PROXY_HANDSHAKE_BUFSIZE     4096    // HTTP CONNECT header
+#define PROXY_RESOLVER_THREADS      4
+
+#define SOCKS5_VERSION              0x05
+#define SOCKS5_AUTH_VERSION         0x01
+#define SOCKS5_AUTH_NONE            0x00
+#define SOCKS5_AUTH_USERNAME        0x02
+#define SOCKS5_AUTH_NO_ACCEPTABLE   0xFF
+#define SOCKS5_CMD_CONNECT          0x01
+#define SOCKS5_ATYP_IPV4            0x01
+#define SOCKS5_ATYP_DOMAIN          0x03
+#define SOCKS5_ATYP_IPV6            0x04
+// replies
+#define SOCKS5_SUCCEEDED            0x00
+#define SOCKS5_GENERAL_FAILURE      0x01
+#define SOCKS5_NETWORK_UNREACHABLE  0x03
+#define SOCKS5_HOST_UNREACHABLE     0x04
+#define SOCKS5_CONNECTION_REFUSED   0x05
+#define SOCKS5_CMD_NOT_SUPPORTED    0x07
+#define SOCKS5_ATYP_NOT_SUPPORTED   0x08
+
+enum proxy_stage {
+    PROXY_STAGE_DETECT,
+    PROXY_STAGE_SOCKS5_METHODS,
+    PROXY_STAGE_SOCKS5_AUTH,
+    PROXY_STAGE_SOCKS5_REQUEST,
+    PROXY_STAGE_HTTP_HEADER,
+    PROXY_STAGE_CONNECTING,
+    PROXY_STAGE_RELAYING,
+};
+
+typedef struct proxy_resolve_s proxy_resolve_t;
+
+typedef struct proxy_conn_s {
+    struct list_node    node;
+    proxy_server_t*     server;     // NULL after proxy_server_free
+    hio_t*              io;
+    hio_t*              upstream_io;
+    proxy_resolve_t*    resolve;    // resolving the target host
+    hrelay_t*           relay;
+    int                 stage;
+    proxy_tunnel_t      tunnel;
+    // handshake bytes not consumed yet
+    int                 len;
+    char                buf[PROXY_HANDSHAKE_BUFSIZE];
+} proxy_conn_t;
+
+struct proxy_server_s {
+    hloop_t*                loop;
+    proxy_server_setting_t  setting;
+    char*                   username;
+    char*                   password;
+    char*                   basic_auth;     // base64(username:password)
+    hio_t*                  listenio;
+    struct list_head        conns;
+    proxy_server_stats_t    stats;
+    proxy_tunnel_cb         tunnel_cb;
+    void*                   userdata;
+};
+
+static char* copy_str(const char* str) {
+    if (str == NULL) return NULL;
+    size_t len = strlen(str);
+    char* copy = NULL;
+    HV_ALLOC(copy, len + 1);
+    memcpy(copy, str, len);
+    return copy;
+}
+
+// a domain name resolved by a resolver thread
+struct proxy_resolve_s {
+    struct list_node    node;
+    hloop_t*            loop;
+    // NULL if the conn is closed while resolving, guarded by s_resolver.mutex
+    proxy_conn_t*       conn;
+    char                host[256];
+    int                 ret;
+    sockaddr_u          addr;
+};
+
+static void resolve_detach(proxy_conn_t* conn);
+
+//-----------------close---------------------------------------------
+static void free_conn(proxy_conn_t* conn) {
+    if (conn->server) {
+        list_del(&conn->node);
+        --conn->server->stats.active;
+    }
+    HV_FREE(conn);
+}
+
+static void on_close(hio_t* io) {
+    proxy_conn_t* conn = (proxy_conn_t*)hevent_userdata(io);
+    if (conn == NULL) return;
+    hevent_set_userdata(io, NULL);
+    // NOTE: freed by on_tunnel_close after both closed.
+    if (conn->relay) return;
+    if (conn->resolve) {
+        resolve_detach(conn);
+    }
+    if (conn->server && conn->stage != PROXY_STAGE_RELAYING) {
+        ++conn->server->stats.failed;
+    }
+    if (conn->upstream_io) {
+        hevent_set_userdata(conn->upstream_io, NULL);
+        hio_close(conn->upstream_io);
+    }
+    free_conn(conn);
+}
+
+static void on_tunnel_close(hrelay_t* relay) {
+    proxy_conn_t* conn = (proxy_conn_t*)hrelay_userdata(relay);
+    proxy_tunnel_t* tunnel = &conn->tunnel;
+    hrelay_stats_t stats;
+    hrelay_get_stats(relay, &stats);
+    tunnel->bytes_up += stats.bytes[0];
+    tunnel->bytes_down += stats.bytes[1];
+    tunnel->end_hrtime = stats.end_hrtime;
+    tunnel->spliced = stats.spliced;
+    tunnel->error = stats.error;
+    proxy_server_t* server = conn->server;
+    if (server) {
+        server->stats.bytes_up += tunnel->bytes_up;
+        server->stats.bytes_down += tunnel->bytes_down;
+        if (server->tunnel_cb) {
+            server->tunnel_cb(server, tunnel);
+        }
+    }
+    free_conn(conn);
+}
+
+// write the reply, and close after it is written
+static int reply_close(proxy_conn_t* conn, const void* buf, int len) {
+    if (len > 0) {
+        hio_write(conn->io, buf, len);
+    }
+    hio_close(conn->io);
+    return -1;
+}
+
+// @param status: "502 Bad Gateway"
+static int http_reply_close(proxy_conn_t* conn, const char* status, const char* headers) {
+    char reply[256];
+    int len = snprintf(reply, sizeof(reply), "HTTP/1.1 %s\r\n%sContent-Length: 0\r\nConnection: close\r\n\r\n",
+                       status, headers ? headers : "");
+    return reply_close(conn, reply, len);
+}
+
+static int socks5_reply_close(proxy_conn_t* conn, int rep) {
+    unsigned char reply[10] = { SOCKS5_VERSION, (unsigned char)rep, 0x00, SOCKS5_ATYP_IPV4, 0 };
+    return reply_close(conn, reply, sizeof(reply));
+}
+
+//-----------------connect---------------------------------------------
+static void on_upstream_connect(hio_t* upstream_io) {
+    proxy_conn_t* conn = (proxy_conn_t*)hevent_userdata(upstream_io);
+    if (conn == NULL) return;
+    proxy_server_t* server = conn->server;
+    hio_t* io = conn->io;
+    if (conn->tunnel.protocol == PROXY_PROTOCOL_SOCKS5) {
+        // BND.ADDR BND.PORT
+        unsigned char reply[22] = { SOCKS5_VERSION, SOCKS5_SUCCEEDED, 0x00 };
+        int len = 4;
+        sockaddr_u* addr = (sockaddr_u*)hio_localaddr(upstream_io);
+        if (addr->sa.sa_family == AF_INET6) {
+            reply[3] = SOCKS5_ATYP_IPV6;
+            memcpy(reply + len, &addr->sin6.sin6_addr, 16);
+            len += 16;
+            memcpy(reply + len, &addr->sin6.sin6_port, 2);
+        } else {
+            reply[3] = SOCKS5_ATYP_IPV4;
+            memcpy(reply + len, &addr->sin.sin_addr, 4);
+            len += 4;
+            memcpy(reply + len, &addr->sin.sin_port, 2);
+        }
+        len += 2;
+        hio_write(io, reply, len);
+    } else {
+        static const char reply[] = "HTTP/1.1 200 Connection Established\r\n\r\n";
+        hio_write(io, reply, sizeof(reply) - 1);
+    }
+    // early data after the request
+    if (conn->len > 0) {
+        hio_write(upstream_io, conn->buf, conn->len);
+        conn->tunnel.bytes_up += conn->len;
+        conn->len = 0;
+    }
+    conn->stage = PROXY_STAGE_RELAYING;
+    conn->tunnel.start_hrtime = hloop_now_us(hevent_loop(io));
+    hio_set_read_timeout(io, 0);
+    if (server && server->setting.idle_timeout > 0) {
+        hio_set_keepalive_timeout(io, server->setting.idle_timeout);
+    }
+    hrelay_t* relay = hio_setup_relay(io, upstream_io, 1);
+    // NOTE: conn is freed by on_close if relay failed.
+    if (relay == NULL) return;
+    conn->relay = relay;
+    hrelay_set_userdata(relay, conn);
+    hrelay_setcb_close(relay, on_tunnel_close);
+    if (server) {
+        if (server->setting.watermark) {
+            hrelay_set_watermark(relay, server->setting.watermark);
+        }
+        ++server->stats.tunnels;
+        hrelay_stats_t stats;
+        hrelay_get_stats(relay, &stats);
+        if (stats.spliced) ++server->stats.spliced;
+    }
+}
+
+static void on_upstream_close(hio_t* upstream_io) {
+    proxy_conn_t* conn = (proxy_conn_t*)hevent_userdata(upstream_io);
+    if (conn == NULL || conn->relay) return;
+    // connect failed
+    conn->upstream_io = NULL;
+    int err = hio_error(upstream_io);
+    hlogi("proxy connect %s:%d failed: %d", conn->tunnel.host, conn->tunnel.port, err);
+    if (conn->tunnel.protocol == PROXY_PROTOCOL_SOCKS5) {
+        int rep = err == ECONNREFUSED ? SOCKS5_CONNECTION_REFUSED :
+                  err == ENETUNREACH  ? SOCKS5_NETWORK_UNREACHABLE :
+                  err == EHOSTUNREACH || err == ETIMEDOUT ? SOCKS5_HOST_UNREACHABLE :
+                  SOCKS5_GENERAL_FAILURE;
+        socks5_reply_close(conn, rep);
+    } else {
+        http_reply_close(conn, err == ETIMEDOUT ? "504 Gateway Timeout" : "502 Bad Gateway", NULL);
+    }
+}
+
+static int connect_failed(proxy_conn_t* conn, int rep) {
+    if (conn->tunnel.protocol == PROXY_PROTOCOL_SOCKS5) {
+        return socks5_reply_close(conn, rep);
+    }
+    return http_reply_close(conn, "502 Bad Gateway", NULL);
+}
+
+static int connect_addr(proxy_conn_t* conn, sockaddr_u* addr) {
+    proxy_server_t* server = conn->server;
+    hio_t* io = conn->io;
+    sockaddr_set_port(addr, conn->tunnel.port);
+    int sockfd = socket(addr->sa.sa_family, SOCK_STREAM, 0);
+    if (sockfd < 0) {
+        hloge("proxy socket failed: %d", socket_errno());
+        return connect_failed(conn, SOCKS5_GENERAL_FAILURE);
+    }
+    hio_t* upstream_io = hio_get(hevent_loop(io), sockfd);
+    hio_set_peeraddr(upstream_io, &addr->sa, sockaddr_len(addr));
+    conn->upstream_io = upstream_io;
+    hevent_set_userdata(upstream_io, conn);
+    hio_set_connect_timeout(upstream_io, server->setting.connect_timeout);
+    hio_setcb_connect(upstream_io, on_upstream_connect);
+    hio_setcb_close(upstream_io, on_upstream_close);
+    hio_connect(upstream_io);
+    return -1;
+}
+
+//-----------------resolve---------------------------------------------
+/*
+ * getaddrinfo blocks, so domain names are resolved by resolver threads shared by all proxy_servers,
+ * and connecting is resumed in the loop by hloop_post_event, as co_resolve does.
+ * The client may close while resolving, then the job is detached from its conn and dropped.
+ */
+static struct {
+    honce_t             once;
+    hmutex_t            mutex;
+    hcondvar_t          cond;
+    struct list_head    jobs;
+} s_resolver = { HONCE_INIT };
+
+static void on_resolved(hevent_t* ev) {
+    proxy_resolve_t* job = (proxy_resolve_t*)hevent_userdata(ev);
+    // NOTE: posted, so only the loop thread writes job->conn from now on.
+    proxy_conn_t* conn = job->conn;
+    if (conn) {
+        conn->resolve = NULL;
+        if (job->ret != 0) {
+            hlogi("proxy resolve %s failed: %d", job->host, job->ret);
+            connect_failed(conn, SOCKS5_HOST_UNREACHABLE);
+        } else {
+            connect_addr(conn, &job->addr);
+        }
+    }
+    HV_FREE(job);
+}
+
+static HTHREAD_ROUTINE(resolver_thread) {
+    (void)userdata;
+    while (1) {
+        hmutex_lock(&s_resolver.mutex);
+        while (list_empty(&s_resolver.jobs)) {
+            hcondvar_wait(&s_resolver.cond, &s_resolver.mutex);
+        }
+        proxy_resolve_t* job = list_entry(s_resolver.jobs.next, proxy_resolve_t, node);
+        list_del(&job->node);
+        int detached = job->conn == NULL;
+        hmutex_unlock(&s_resolver.mutex);
+        if (!detached) {
+            job->ret = ResolveAddr(job->host, &job->addr);
+        }
+        // NOTE: posted under the mutex, so the loop is alive until the conn is detached.
+        hmutex_lock(&s_resolver.mutex);
+        if (job->conn) {
+            hevent_t ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.cb = on_resolved;
+            ev.userdata = job;
+            hloop_post_event(job->loop, &ev);
+        } else {
+            HV_FREE(job);
+        }
+        hmutex_unlock(&s_resolver.mutex);
+    }
+    return 0;
+}
+
+static void resolver_init() {
+    hmutex_init(&s_resolver.mutex);
+    hcondvar_init(&s_resolver.cond);
+    list_init(&s_resolver.jobs);
+    for (int i = 0; i < PROXY_RESOLVER_THREADS; ++i) {
+        hthread_create(resolver_thread, NULL);
+    }
+}
+
+static void resolve_detach(proxy_conn_t* conn) {
+    hmutex_lock(&s_resolver.mutex);
+    conn->resolve->conn = NULL;
+    hmutex_unlock(&s_resolver.mutex);
+    conn->resolve = NULL;
+}
+
+// @retval -1 if connecting or closing
+static int connect_target(proxy_conn_t* conn) {
+    conn->stage = PROXY_STAGE_CONNECTING;
+    hio_read_stop(conn->io);
+    sockaddr_u addr;
+    memset(&addr, 0, sizeof(addr));
+    if (is_ipaddr(conn->tunnel.host)) {
+        if (sockaddr_set_ipport(&addr, conn->tunnel.host, conn->tunnel.port) != 0) {
+            return connect_failed(conn, SOCKS5_HOST_UNREACHABLE);
+        }
+        return connect_addr(conn, &addr);
+    }
+    honce(&s_resolver.once, resolver_init);
+    proxy_resolve_t* job = NULL;
+    HV_ALLOC_SIZEOF(job);
+    job->loop = hevent_loop(conn->io);
+    job->conn = conn;
+    hv_strncpy(job->host, conn->tunnel.host, sizeof(job->host));
+    conn->resolve = job;
+    hmutex_lock(&s_resolver.mutex);
+    list_add_tail(&job->node, &s_resolver.jobs);
+    hcondvar_signal(&s_resolver.cond);
+    hmutex_unlock(&s_resolver.mutex);
+    return -1;
+}
+
+//-----------------SOCKS5---------------------------------------------
+/*
+ * @retval >0 bytes consumed, 0 if more bytes needed, -1 if closing.
+ */
+static int socks5_methods(proxy_conn_t* conn) {
+    unsigned char* buf = (unsigned char*)conn->buf;
+    if (conn->len < 2) return 0;
+    int nmethods = buf[1];
+    if (conn->len < 2 + nmethods) return 0;
+    unsigned char want = conn->server->basic_auth ? SOCKS5_AUTH_USERNAME : SOCKS5_AUTH_NONE;
+    unsigned char reply[2] = { SOCKS5_VERSION, SOCKS5_AUTH_NO_ACCEPTABLE };
+    for (int i = 0; i < nmethods; ++i) {
+        if (buf[2 + i] == want) {
+            reply[1] = want;
+            break;
+        }
+    }
+    if (reply[1] == SOCKS5_AUTH_NO_ACCEPTABLE) {
+        return reply_close(conn, reply, 2);
+    }
+    hio_write(conn->io, reply, 2);
+    conn->stage = want == SOCKS5_AUTH_USERNAME ? PROXY_STAGE_SOCKS5_AUTH : PROXY_STAGE_SOCKS5_REQUEST;
+    return 2 + nmethods;
+}
+
+// RFC 1929
+static int socks5_auth(proxy_conn_t* conn) {
+    proxy_server_t* server = conn->server;
+    unsigned char* buf = (unsigned char*)conn->buf;
+    if (conn->len < 2) return 0;
+    int ulen = buf[1];
+    if (conn->len < 3 + ulen) return 0;
+    int plen = buf[2 + ulen];
+    if (conn->len < 3 + ulen + plen) return 0;
+    const char* username = server->username;
+    const char* password = server->password ? server->password : "";
+    unsigned char reply[2] = { SOCKS5_AUTH_VERSION, 0x00 };
+    if (buf[0] != SOCKS5_AUTH_VERSION ||
+        ulen != (int)strlen(username) || memcmp(buf + 2, username, ulen) != 0 ||
+        plen != (int)strlen(password) || memcmp(buf + 3 + ulen, password, plen) != 0) {
+        reply[1] = 0x01;
+        return reply_close(conn, reply, 2);
+    }
+    hio_write(conn->io, reply, 2);
+    conn->stage = PROXY_STAGE_SOCKS5_REQUEST;
+    return 3 + ulen + plen;
+}
+
+static int socks5_request(proxy_conn_t* conn) {
+    unsigned char* buf = (unsigned char*)conn->buf;
+    if (conn->len < 5) return 0;
+    if (buf[0] != SOCKS5_VERSION) {
+        return socks5_reply_close(conn, SOCKS5_GENERAL_FAILURE);
+    }
+    int addrlen = 0;
+    switch (buf[3]) {
+    case SOCKS5_ATYP_IPV4:      addrlen = 4;            break;
+    case SOCKS5_ATYP_DOMAIN:    addrlen = 1 + buf[4];   break;
+    case SOCKS5_ATYP_IPV6:      addrlen = 16;           break;
+    default:
+        return socks5_reply_close(conn, SOCKS5_ATYP_NOT_SUPPORTED);
+    }
+    int len = 4 + addrlen + 2;
+    if (conn->len < len) return 0;
+    if (buf[1] != SOCKS5_CMD_CONNECT) {
+        return socks5_reply_close(conn, SOCKS5_CMD_NOT_SUPPORTED);
+    }
+    proxy_tunnel_t* tunnel = &conn->tunnel;
+    if (buf[3] == SOCKS5_ATYP_IPV4) {
+        inet_ntop(AF_INET, buf + 4, tunnel->host, sizeof(tunnel->host));
+    } else if (buf[3] == SOCKS5_ATYP_IPV6) {
+        inet_ntop(AF_INET6, buf + 4, tunnel->host, sizeof(tunnel->host));
+    } else {
+        memcpy(tunnel->host, buf + 5, buf[4]);
+        tunnel->host[buf[4]] = '\0';
+    }
+    tunnel->port = ((int)buf[4 + addrlen] << 8) | buf[5 + addrlen];
+    // NOTE: early data after the request is kept in conn->buf
+    memmove(conn->buf, conn->buf + len, conn->len - len);
+    conn->len -= len;
+    return connect_target(conn);
+}
+
+//-----------------HTTP CONNECT---------------------------------------------
+static const char* find_header(const char* header, const char* end, const char* name) {
+    size_t namelen = strlen(name);
+    const char* line = strstr(header, "\r\n");
+    while (line && line + 2 < end) {
+        line += 2;
+        if (strncasecmp(line, name, namelen) == 0 && line[namelen] == ':') {
+            const char* value = line + namelen + 1;
+            while (*value == ' ') ++value;
+            return value;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return NULL;
+}
+
+static int http_connect(proxy_conn_t* conn) {
+    proxy_server_t* server = conn->server;
+    conn->buf[conn->len] = '\0';
+    char* end = strstr(conn->buf, "\r\n\r\n");
+    if (end == NULL) {
+        if (conn->len >= PROXY_HANDSHAKE_BUFSIZE - 1) {
+            return http_reply_close(conn, "431 Request Header Fields Too Large", NULL);
+        }
+        return 0;
+    }
+    end += 4;
+    // CONNECT host:port HTTP/1.1
+    char method[16] = {0};
+    char authority[280] = {0};
+    if (sscanf(conn->buf, "%15s %279s", method, authority) != 2) {
+        return http_reply_close(conn, "400 Bad Request", NULL);
+    }
+    if (strcmp(method, "CONNECT") != 0) {
+        return http_reply_close(conn, "405 Method Not Allowed", "Allow: CONNECT\r\n");
+    }
+    if (server->basic_auth) {
+        const char* value = find_header(conn->buf, end, "Proxy-Authorization");
+        size_t authlen = strlen(server->basic_auth);
+        if (value == NULL || strncasecmp(value, "Basic ", 6) != 0 ||
+            strncmp(value + 6, server->basic_auth, authlen) != 0 || value[6 + authlen] != '\r') {
+            return http_reply_close(conn, "407 Proxy Authentication Required",
+                                    "Proxy-Authenticate: Basic realm=\"proxy\"\r\n");
+        }
+    }
+    // [ipv6]:port or host:port
+    proxy_tunnel_t* tunnel = &conn->tunnel;
+    char* host = authority;
+    char* colon = NULL;
+    if (*host == '[') {
+        ++host;
+        char* bracket = strchr(host, ']');
+        if (bracket == NULL) {
+            return http_reply_close(conn, "400 Bad Request", NULL);
+        }
+        *bracket = '\0';
+        colon = bracket[1] == ':' ? bracket + 1 : NULL;
+    } else {
+        colon = strrchr(host, ':');
+        if (colon) *colon = '\0';
+    }
+    tunnel->port = colon ? atoi(colon + 1) : 443;
+    if (*host == '\0' || tunnel->port <= 0 || tunnel->port > 65535) {
+        return http_reply_close(conn, "400 Bad Request", NULL);
+    }
+    hv_strncpy(tunnel->host, host, sizeof(tunnel->host));
+    int len = end - conn->buf;
+    memmove(conn->buf, conn->buf + len, conn->len - len);
+    conn->len -= len;
+    return connect_target(conn);
+}
+
+//-----------------handshake---------------------------------------------
+static void handshake(proxy_conn_t* conn) {
+    proxy_server_t* server = conn->server;
+    int nconsumed = 0;
+    while (conn->len > 0) {
+        switch (conn->stage) {
+        case PROXY_STAGE_DETECT:
+            if ((unsigned char)conn->buf[0] == SOCKS5_VERSION && (server->setting.protocols & PROXY_PROTOCOL_SOCKS5)) {
+                conn->tunnel.protocol = PROXY_PROTOCOL_SOCKS5;
+                conn->stage = PROXY_STAGE_SOCKS5_METHODS;
+            } else if (server->setting.protocols & PROXY_PROTOCOL_HTTP_CONNECT) {
+                conn->tunnel.protocol = PROXY_PROTOCOL_HTTP_CONNECT;
+                conn->stage = PROXY_STAGE_HTTP_HEADER;
+            } else {
+                hio_close(conn->io);
+                return;
+            }
+            continue;
+        case PROXY_STAGE_SOCKS5_METHODS:    nconsumed = socks5_methods(conn);   break;
+        case PROXY_STAGE_SOCKS5_AUTH:       nconsumed = socks5_auth(conn);      break;
+        case PROXY_STAGE_SOCKS5_REQUEST:    nconsumed = socks5_request(conn);   break;
+        case PROXY_STAGE_HTTP_HEADER:       nconsumed = http_connect(conn);     break;
+        default: return;
+        }
+        if (nconsumed <= 0) return;
+        memmove(conn->buf, conn->buf + nconsumed, conn->len - nconsumed);
+        conn->len -= nconsumed;
+    }
+}
+
+static void on_recv(hio_t* io, void* buf, int readbytes) {
+    proxy_conn_t* conn = (proxy_conn_t*)hevent_userdata(io);
+    if (conn == NULL || conn->server == NULL) return;
+    // NOTE: one byte left for '\0' of HTTP header
+    if (conn->len + readbytes >= PROXY_HANDSHAKE_BUFSIZE) {
+        hlogw("proxy handshake too large from %s", conn->tunnel.client_addr);
+        hio_close(io);
+        return;
+    }
+    memcpy(conn->buf + conn->len, buf, readbytes);
+    conn->len += readbytes;
+    handshake(conn);
+}
+
+// NOTE: userdata of io is inherited from listenio
+static void on_accept(hio_t* io) {
+    proxy_server_t* server = (proxy_server_t*)hevent_userdata(io);
+    proxy_conn_t* conn = NULL;
+    HV_ALLOC_SIZEOF(conn);
+    conn->server = server;
+    conn->io = io;
+    conn->stage = PROXY_STAGE_DETECT;
+    SOCKADDR_STR(hio_peeraddr(io), conn->tunnel.client_addr);
+    list_add(&conn->node, &server->conns);
+    ++server->stats.accepted;
+    ++server->stats.active;
+    hevent_set_userdata(io, conn);
+    hio_setcb_read(io, on_recv);
+    hio_setcb_close(io, on_close);
+    hio_set_read_timeout(io, server->setting.handshake_timeout);
+    hio_read(io);
+}
+
+//-----------------proxy_server---------------------------------------------
+proxy_server_t* proxy_server_new(hloop_t* loop, const proxy_server_setting_t* setting) {
+    proxy_server_t* server = NULL;
+    HV_ALLOC_SIZEOF(server);
+    server->loop = loop;
+    server->setting = *setting;
+    server->setting.host = NULL;
+    server->setting.username = server->setting.password = NULL;
+    list_init(&server->conns);
+    if (setting->username) {
+        server->username = copy_str(setting->username);
+        server->password = copy_str(setting->password ? setting->password : "");
+        // username:password
+        int ulen = strlen(server->username);
+        int plen = strlen(server->password);
+        char* userpass = NULL;
+        HV_ALLOC(userpass, ulen + plen + 2);
+        memcpy(userpass, server->username, ulen);
+        userpass[ulen] = ':';
+        memcpy(userpass + ulen + 1, server->password, plen);
+        HV_ALLOC(server->basic_auth, BASE64_ENCODE_OUT_SIZE(ulen + plen + 1) + 1);
+        hv_base64_encode((unsigned char*)userpass, ulen + plen + 1, server->basic_auth);
+        HV_FREE(userpass);
+    }
+    if (setting->listenfd >= 0) {
+        server->listenio = hio_get(loop, setting->listenfd);
+        hio_setcb_accept(server->listenio, on_accept);
+        hevent_set_userdata(server->listenio, server);
+        if (hio_accept(server->listenio) != 0) {
+            server->listenio = NULL;
+        }
+    } else {
+        server->listenio = hio_create_socket(loop, setting->host, setting->port, HIO_TYPE_TCP, HIO_SERVER_SIDE);
+        if (server->listenio) {
+            hio_setcb_accept(server->listenio, on_accept);
+            hevent_set_userdata(server->listenio, server);
+            hio_accept(server->listenio);
+        }
+    }
+    if (server->listenio == NULL) {
+        hloge("proxy_server listen failed");
+        proxy_server_free(server);
+        return NULL;
+    }
+    return server;
+}
+
+void proxy_server_free(proxy_server_t* server) {
+    if (server == NULL) return;
+    if (server->listenio) {
+        hevent_set_userdata(server->listenio, NULL);
+        // NOTE: the shared listenfd is closed by its owner.
+        if (server->setting.listenfd >= 0) {
+            hio_del(server->listenio, HV_READ);
+        } else {
+            hio_close(server->listenio);
+        }
+    }
+    // detach and close all connections
+    struct list_node* node = server->conns.next;
+    while (node != &server->conns) {
+        proxy_conn_t* conn = list_entry(node, proxy_conn_t, node);
+        node = node->next;
+        list_del(&conn->node);
+        conn->server = NULL;
+        hio_close(conn->io);
+    }
+    HV_FREE(server->username);
+    HV_FREE(server->password);
+    HV_FREE(server->basic_auth);
+    HV_FREE(server);
+}
+
+void proxy_server_setcb_tunnel(proxy_server_t* server, proxy_tunnel_cb cb) {
+    server->tunnel_cb = cb;
+}
+
+void proxy_server_set_userdata(proxy_server_t* server, void* userdata) {
+    server->userdata = userdata;
+}
+
+void* proxy_server_userdata(proxy_server_t* server) {
+    return server->userdata;
+}
+
+int proxy_server_port(proxy_server_t* server) {
+    return sockaddr_port((sockaddr_u*)hio_localaddr(server->listenio));
+}
+
+void proxy_server_get_stats(proxy_server_t* server, proxy_server_stats_t* stats) {
+    *stats = server->stats;
+}
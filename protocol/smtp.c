@@ -26,6 +26,7 @@ int smtp_build_command(enum smtp_command cmd, const char* param, char* buf, int
     switch (cmd) {
     // unary
     case SMTP_DATA:
+    case SMTP_RSET:
     case SMTP_QUIT:
         return snprintf(buf, buflen, "%s\r\n", smtp_command_str(cmd));
     // <address>
@@ -17,6 +17,7 @@
     XX(MAIL,    MAIL FROM:) \
     XX(RCPT,    RCPT TO:)   \
     XX(DATA,    DATA)       \
+    XX(RSET,    RSET)       \
     XX(QUIT,    QUIT)       \
 
 enum smtp_command {
@@ -0,0 +1,481 @@
+#include "smtp_client.h"
+
+#include "hdef.h"
+#include "hbase.h"
+#include "hsocket.h"
+#include "herr.h"
+#include "hlog.h"
+#include "list.h"
+#include "base64.h"
+
+// expected replies
+enum smtp_stage {
+    SMTP_STAGE_GREETING,
+    SMTP_STAGE_EHLO,
+    SMTP_STAGE_HELO,
+    SMTP_STAGE_AUTH,
+    SMTP_STAGE_MAIL,
+    SMTP_STAGE_RCPT,
+    SMTP_STAGE_DATA,
+    SMTP_STAGE_BODY,
+    SMTP_STAGE_RSET,
+    SMTP_STAGE_QUIT,
+};
+
+typedef struct smtp_mail_s {
+    struct list_node    node;
+    char*               from;
+    char*               to;
+    char*               subject;
+    char*               body;
+    int                 error;  // the first unexpected reply
+    smtp_client_cb      cb;
+    void*               userdata;
+} smtp_mail_t;
+
+typedef struct smtp_cmd_s {
+    struct list_node    node;
+    int                 stage;
+    smtp_mail_t*        mail;
+} smtp_cmd_t;
+
+typedef struct smtp_conn_s {
+    struct list_node    node;
+    smtp_client_t*      cli;
+    hio_t*              io;
+    int                 established;    // greeting, EHLO and AUTH are done
+    int                 ready;          // established and not closing
+    int                 quit;
+    int                 pipelining;
+    int                 error;      // the reply closing the connection
+    struct list_head    cmds;       // smtp_cmd_t, waiting for replies in order
+    smtp_mail_t*        tx;         // MAIL, RCPT, DATA sent
+} smtp_conn_t;
+
+struct smtp_client_s {
+    hloop_t*                loop;
+    smtp_client_setting_t   setting;
+    char*                   host;
+    char*                   domain;
+    char*                   auth;       // AUTH PLAIN base64
+    unpack_setting_t        unpack_setting; // CRLF
+    struct list_head        mails;      // queued
+    uint32_t                nqueued;
+    uint32_t                ninflight;
+    struct list_head        conns;
+    uint32_t                nconns;
+    uint32_t                nconnecting;
+    // free in callback
+    int                     calling;
+    int                     destroyed;
+};
+
+static void dispatch(smtp_client_t* cli);
+
+static void free_mail(smtp_mail_t* mail) {
+    HV_FREE(mail->from);
+    HV_FREE(mail->to);
+    HV_FREE(mail->subject);
+    HV_FREE(mail->body);
+    HV_FREE(mail);
+}
+
+static void free_conn(smtp_conn_t* conn) {
+    while (!list_empty(&conn->cmds)) {
+        smtp_cmd_t* cmd = list_entry(conn->cmds.next, smtp_cmd_t, node);
+        list_del(&cmd->node);
+        HV_FREE(cmd);
+    }
+    HV_FREE(conn);
+}
+
+static void free_client(smtp_client_t* cli) {
+    while (!list_empty(&cli->mails)) {
+        smtp_mail_t* mail = list_entry(cli->mails.next, smtp_mail_t, node);
+        list_del(&mail->node);
+        free_mail(mail);
+    }
+    HV_FREE(cli->host);
+    HV_FREE(cli->domain);
+    HV_FREE(cli->auth);
+    HV_FREE(cli);
+}
+
+// @retval 0 if cli is freed in callback
+static int mail_done(smtp_client_t* cli, smtp_mail_t* mail, int ret) {
+    --cli->ninflight;
+    smtp_client_cb cb = mail->cb;
+    void* userdata = mail->userdata;
+    free_mail(mail);
+    if (cb) {
+        ++cli->calling;
+        cb(cli, ret, userdata);
+        --cli->calling;
+        if (cli->destroyed) {
+            if (cli->calling == 0) free_client(cli);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void send_cmd(smtp_conn_t* conn, int stage, smtp_mail_t* mail, const char* buf, int len) {
+    smtp_cmd_t* cmd = NULL;
+    HV_ALLOC_SIZEOF(cmd);
+    cmd->stage = stage;
+    cmd->mail = mail;
+    list_add_tail(&cmd->node, &conn->cmds);
+    hio_write(conn->io, buf, len);
+}
+
+static void send_command(smtp_conn_t* conn, int stage, smtp_mail_t* mail, enum smtp_command command, const char* param) {
+    char buf[1024];
+    int len = smtp_build_command(command, param, buf, sizeof(buf));
+    if (len >= (int)sizeof(buf)) len = sizeof(buf) - 1;
+    send_cmd(conn, stage, mail, buf, len);
+}
+
+// From: To: Subject: body . with dot-stuffing
+static void send_message(smtp_conn_t* conn, smtp_mail_t* mail) {
+    int bodylen = strlen(mail->body);
+    int maxlen = strlen(mail->from) + strlen(mail->to) + strlen(mail->subject) + 32 + bodylen * 2 + SMTP_EOB_LEN;
+    char* buf = NULL;
+    HV_ALLOC(buf, maxlen);
+    int len = snprintf(buf, maxlen, "From:%s\r\nTo:%s\r\nSubject:%s\r\n\r\n", mail->from, mail->to, mail->subject);
+    const char* p = mail->body;
+    int bol = 1;
+    for (; *p; ++p) {
+        // NOTE: a line starting with '.' is doubled, RFC 5321 4.5.2
+        if (bol && *p == '.') buf[len++] = '.';
+        buf[len++] = *p;
+        bol = *p == '\n';
+    }
+    if (!bol) {
+        buf[len++] = '\r';
+        buf[len++] = '\n';
+    }
+    // .\r\n
+    memcpy(buf + len, SMTP_EOB + 2, SMTP_EOB_LEN - 2);
+    len += SMTP_EOB_LEN - 2;
+    send_cmd(conn, SMTP_STAGE_BODY, mail, buf, len);
+    HV_FREE(buf);
+}
+
+// start the next mail, or QUIT
+static void conn_kick(smtp_conn_t* conn) {
+    smtp_client_t* cli = conn->cli;
+    if (!conn->ready || conn->quit || conn->tx) return;
+    // NOTE: one command at a time without PIPELINING
+    if (!conn->pipelining && !list_empty(&conn->cmds)) return;
+    if (list_empty(&cli->mails)) {
+        if (list_empty(&conn->cmds)) {
+            conn->quit = 1;
+            send_command(conn, SMTP_STAGE_QUIT, NULL, SMTP_QUIT, NULL);
+        }
+        return;
+    }
+    smtp_mail_t* mail = list_entry(cli->mails.next, smtp_mail_t, node);
+    list_del(&mail->node);
+    --cli->nqueued;
+    ++cli->ninflight;
+    conn->tx = mail;
+    send_command(conn, SMTP_STAGE_MAIL, mail, SMTP_MAIL, mail->from);
+    if (conn->pipelining) {
+        send_command(conn, SMTP_STAGE_RCPT, mail, SMTP_RCPT, mail->to);
+        send_command(conn, SMTP_STAGE_DATA, mail, SMTP_DATA, NULL);
+    }
+}
+
+static void conn_ready(smtp_conn_t* conn) {
+    conn->established = conn->ready = 1;
+    --conn->cli->nconnecting;
+}
+
+// NOTE: closed later, conn is used after on_reply.
+static void conn_close(smtp_conn_t* conn, int code) {
+    conn->error = code;
+    conn->ready = 0;
+    hio_close_async(conn->io);
+}
+
+// MAIL or RCPT or DATA is rejected
+static int tx_failed(smtp_conn_t* conn, int code) {
+    smtp_mail_t* mail = conn->tx;
+    conn->tx = NULL;
+    send_command(conn, SMTP_STAGE_RSET, NULL, SMTP_RSET, NULL);
+    return mail_done(conn->cli, mail, mail->error ? mail->error : code);
+}
+
+// @retval 0 if cli is freed in callback
+static int on_reply(smtp_conn_t* conn, int code) {
+    smtp_client_t* cli = conn->cli;
+    if (list_empty(&conn->cmds)) {
+        // e.g. 421 Service not available
+        hlogw("smtp unexpected reply: %d", code);
+        return 1;
+    }
+    smtp_cmd_t* cmd = list_entry(conn->cmds.next, smtp_cmd_t, node);
+    list_del(&cmd->node);
+    int stage = cmd->stage;
+    smtp_mail_t* mail = cmd->mail;
+    HV_FREE(cmd);
+    int alive = 1;
+    switch (stage) {
+    case SMTP_STAGE_GREETING:
+        if (code != SMTP_STATUS_READY) {
+            conn_close(conn, code);
+            break;
+        }
+        send_command(conn, SMTP_STAGE_EHLO, NULL, SMTP_EHLO, cli->domain);
+        break;
+    case SMTP_STAGE_EHLO:
+    case SMTP_STAGE_HELO:
+        if (code != SMTP_STATUS_OK) {
+            if (stage == SMTP_STAGE_EHLO) {
+                conn->pipelining = 0;
+                send_command(conn, SMTP_STAGE_HELO, NULL, SMTP_HELO, cli->domain);
+            } else {
+                conn_close(conn, code);
+            }
+            break;
+        }
+        if (cli->auth) {
+            char buf[512];
+            int len = snprintf(buf, sizeof(buf), "AUTH PLAIN %s\r\n", cli->auth);
+            send_cmd(conn, SMTP_STAGE_AUTH, NULL, buf, len);
+        } else {
+            conn_ready(conn);
+        }
+        break;
+    case SMTP_STAGE_AUTH:
+        if (code != SMTP_STATUS_AUTH_SUCCESS) {
+            hlogw("smtp auth failed: %d", code);
+            conn_close(conn, code);
+            break;
+        }
+        conn_ready(conn);
+        break;
+    case SMTP_STAGE_MAIL:
+    case SMTP_STAGE_RCPT:
+        if (code != SMTP_STATUS_OK && code != 251) {
+            if (mail->error == 0) mail->error = code;
+        }
+        if (!conn->pipelining) {
+            // MAIL => RCPT => DATA
+            if (mail->error) {
+                alive = tx_failed(conn, code);
+            } else if (stage == SMTP_STAGE_MAIL) {
+                send_command(conn, SMTP_STAGE_RCPT, mail, SMTP_RCPT, mail->to);
+            } else {
+                send_command(conn, SMTP_STAGE_DATA, mail, SMTP_DATA, NULL);
+            }
+        }
+        break;
+    case SMTP_STAGE_DATA:
+        if (code != SMTP_STATUS_DATA) {
+            alive = tx_failed(conn, code);
+            break;
+        }
+        conn->tx = NULL;
+        if (mail->error) {
+            // NOTE: an empty message, then RSET
+            send_cmd(conn, SMTP_STAGE_BODY, mail, SMTP_EOB + 2, SMTP_EOB_LEN - 2);
+            send_command(conn, SMTP_STAGE_RSET, NULL, SMTP_RSET, NULL);
+        } else {
+            send_message(conn, mail);
+        }
+        break;
+    case SMTP_STAGE_BODY:
+        alive = mail_done(cli, mail, mail->error ? mail->error : code == SMTP_STATUS_OK ? 0 : code);
+        break;
+    case SMTP_STAGE_QUIT:
+        conn_close(conn, 0);
+        break;
+    default:
+        break;
+    }
+    return alive;
+}
+
+static void on_line(hio_t* io, void* buf, int len) {
+    smtp_conn_t* conn = (smtp_conn_t*)hevent_userdata(io);
+    if (conn == NULL) return;
+    const char* line = (const char*)buf;
+    int code = len >= 3 && IS_DIGIT(line[0]) ? atoi(line) : 0;
+    if (code == 0) return;
+    int last = len < 4 || line[3] != '-';
+    // 250-PIPELINING
+    if (!list_empty(&conn->cmds) && len >= 14 &&
+        list_entry(conn->cmds.next, smtp_cmd_t, node)->stage == SMTP_STAGE_EHLO &&
+        strncasecmp(line + 4, "PIPELINING", 10) == 0) {
+        conn->pipelining = 1;
+    }
+    if (!last) return;
+    if (!on_reply(conn, code)) return;
+    conn_kick(conn);
+}
+
+static void on_close(hio_t* io) {
+    smtp_conn_t* conn = (smtp_conn_t*)hevent_userdata(io);
+    if (conn == NULL) return;
+    smtp_client_t* cli = conn->cli;
+    int err = conn->error ? conn->error : hio_error(io);
+    if (err == 0) err = ERR_RECV;
+    list_del(&conn->node);
+    --cli->nconns;
+    int established = conn->established;
+    if (!established) --cli->nconnecting;
+    // fail the mails in flight
+    smtp_mail_t* failed[2] = { NULL, NULL };
+    int nfailed = 0;
+    if (conn->tx) failed[nfailed++] = conn->tx;
+    while (!list_empty(&conn->cmds)) {
+        smtp_cmd_t* cmd = list_entry(conn->cmds.next, smtp_cmd_t, node);
+        list_del(&cmd->node);
+        if (cmd->stage == SMTP_STAGE_BODY && nfailed < 2 && cmd->mail != failed[0]) {
+            failed[nfailed++] = cmd->mail;
+        }
+        HV_FREE(cmd);
+    }
+    HV_FREE(conn);
+    for (int i = 0; i < nfailed; ++i) {
+        if (!mail_done(cli, failed[i], err)) return;
+    }
+    // NOTE: fail the queued mails if the server can not be used, instead of reconnecting forever.
+    if (!established && cli->nconns == cli->nconnecting) {
+        while (!list_empty(&cli->mails)) {
+            smtp_mail_t* mail = list_entry(cli->mails.next, smtp_mail_t, node);
+            list_del(&mail->node);
+            --cli->nqueued;
+            ++cli->ninflight;
+            if (!mail_done(cli, mail, err)) return;
+        }
+    }
+    dispatch(cli);
+}
+
+static void on_connect(hio_t* io) {
+    smtp_conn_t* conn = (smtp_conn_t*)hevent_userdata(io);
+    // NOTE: pipelined commands are small writes
+    tcp_nodelay(hio_fd(io), 1);
+    smtp_cmd_t* cmd = NULL;
+    HV_ALLOC_SIZEOF(cmd);
+    cmd->stage = SMTP_STAGE_GREETING;
+    list_add_tail(&cmd->node, &conn->cmds);
+    hio_set_unpack(io, &conn->cli->unpack_setting);
+    hio_setcb_read(io, on_line);
+    hio_set_read_timeout(io, conn->cli->setting.timeout_ms);
+    hio_read_start(io);
+}
+
+static int conn_open(smtp_client_t* cli) {
+    hio_t* io = hio_create_socket(cli->loop, cli->host, cli->setting.port, HIO_TYPE_TCP, HIO_CLIENT_SIDE);
+    if (io == NULL) return ERR_SOCKET;
+    smtp_conn_t* conn = NULL;
+    HV_ALLOC_SIZEOF(conn);
+    conn->cli = cli;
+    conn->io = io;
+    list_init(&conn->cmds);
+    list_add_tail(&conn->node, &cli->conns);
+    ++cli->nconns;
+    ++cli->nconnecting;
+    hevent_set_userdata(io, conn);
+    hio_setcb_connect(io, on_connect);
+    hio_setcb_close(io, on_close);
+    hio_set_connect_timeout(io, cli->setting.timeout_ms);
+    hio_connect(io);
+    return 0;
+}
+
+static void dispatch(smtp_client_t* cli) {
+    struct list_node* node;
+    list_for_each(node, &cli->conns) {
+        conn_kick(list_entry(node, smtp_conn_t, node));
+    }
+    // NOTE: connections being established will take the queued mails.
+    while (cli->nqueued > cli->nconnecting && cli->nconns < cli->setting.max_connections) {
+        if (conn_open(cli) != 0) break;
+    }
+}
+
+smtp_client_t* smtp_client_new(hloop_t* loop, const smtp_client_setting_t* setting) {
+    if (setting->host == NULL) return NULL;
+    smtp_client_t* cli = NULL;
+    HV_ALLOC_SIZEOF(cli);
+    cli->loop = loop;
+    cli->setting = *setting;
+    cli->host = strdup(setting->host);
+    cli->domain = strdup(setting->domain ? setting->domain : "localhost");
+    cli->setting.host = cli->host;
+    cli->setting.domain = cli->domain;
+    cli->setting.username = cli->setting.password = NULL;
+    if (cli->setting.max_connections == 0) cli->setting.max_connections = 1;
+    if (setting->username) {
+        // BASE64 \0username\0password
+        const char* password = setting->password ? setting->password : "";
+        int usernamelen = strlen(setting->username);
+        int passwordlen = strlen(password);
+        int basiclen = 1 + usernamelen + 1 + passwordlen;
+        char* basic = NULL;
+        HV_ALLOC(basic, basiclen);
+        memcpy(basic + 1, setting->username, usernamelen);
+        memcpy(basic + 1 + usernamelen + 1, password, passwordlen);
+        HV_ALLOC(cli->auth, BASE64_ENCODE_OUT_SIZE(basiclen) + 1);
+        hv_base64_encode((unsigned char*)basic, basiclen, cli->auth);
+        HV_FREE(basic);
+    }
+    cli->unpack_setting.mode = UNPACK_BY_DELIMITER;
+    cli->unpack_setting.package_max_length = DEFAULT_PACKAGE_MAX_LENGTH;
+    cli->unpack_setting.delimiter[0] = '\r';
+    cli->unpack_setting.delimiter[1] = '\n';
+    cli->unpack_setting.delimiter_bytes = 2;
+    list_init(&cli->mails);
+    list_init(&cli->conns);
+    return cli;
+}
+
+void smtp_client_free(smtp_client_t* cli) {
+    if (cli == NULL || cli->destroyed) return;
+    cli->destroyed = 1;
+    while (!list_empty(&cli->conns)) {
+        smtp_conn_t* conn = list_entry(cli->conns.next, smtp_conn_t, node);
+        list_del(&conn->node);
+        hevent_set_userdata(conn->io, NULL);
+        hio_close(conn->io);
+        // mails in flight
+        if (conn->tx) free_mail(conn->tx);
+        struct list_node* node;
+        list_for_each(node, &conn->cmds) {
+            smtp_cmd_t* cmd = list_entry(node, smtp_cmd_t, node);
+            if (cmd->stage == SMTP_STAGE_BODY && cmd->mail != conn->tx) free_mail(cmd->mail);
+        }
+        free_conn(conn);
+    }
+    // NOTE: freed after the callback returns
+    if (cli->calling) return;
+    free_client(cli);
+}
+
+int smtp_client_send(smtp_client_t* cli, const mail_t* mail, smtp_client_cb cb, void* userdata) {
+    if (cli->nqueued >= cli->setting.max_pending) return ERR_TASK_QUEUE_FULL;
+    smtp_mail_t* m = NULL;
+    HV_ALLOC_SIZEOF(m);
+    m->from = strdup(mail->from ? mail->from : "");
+    m->to = strdup(mail->to ? mail->to : "");
+    m->subject = strdup(mail->subject ? mail->subject : "");
+    m->body = strdup(mail->body ? mail->body : "");
+    m->cb = cb;
+    m->userdata = userdata;
+    list_add_tail(&m->node, &cli->mails);
+    ++cli->nqueued;
+    dispatch(cli);
+    return 0;
+}
+
+uint32_t smtp_client_pending(smtp_client_t* cli) {
+    return cli->nqueued + cli->ninflight;
+}
+
+uint32_t smtp_client_connections(smtp_client_t* cli) {
+    return cli->nconns;
+}
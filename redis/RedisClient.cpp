@@ -0,0 +1,519 @@
+#include "RedisClient.h"
+
+#include <deque>
+
+#include "hbase.h"
+#include "hlog.h"
+#include "hsocket.h"
+#include "htime.h"
+
+namespace hv {
+
+struct RedisLoopPool {
+    EventLoop*  loop;
+    // host:port => connections
+    std::map<std::string, std::vector<RedisConnectionPtr>> nodes;
+    size_t      next;
+
+    RedisLoopPool(EventLoop* loop) : loop(loop), next(0) {}
+};
+
+// NOTE: only accessed in loop thread
+class RedisConnection : public std::enable_shared_from_this<RedisConnection> {
+public:
+    enum State {
+        DISCONNECTED,
+        CONNECTING,
+        CONNECTED,
+    };
+    State           state;
+    RedisClient*    client;
+    EventLoop*      loop;
+    // NULL for pub/sub connection
+    RedisLoopPool*  pool;
+    std::string     node;
+    hio_t*          io;
+    RedisParser     parser;
+    // commands issued in the same loop iteration
+    std::string     outbuf;
+    bool            flush_queued;
+    // waiting for replies in order
+    std::deque<RedisTaskPtr> tasks;
+
+    RedisConnection(RedisClient* client, EventLoop* loop, RedisLoopPool* pool, const std::string& node)
+        : state(DISCONNECTED), client(client), loop(loop), pool(pool), node(node)
+        , io(NULL), flush_queued(false)
+    {
+        parser.onReply = [this](RedisReply* reply) {
+            onReply(reply);
+        };
+    }
+
+    ~RedisConnection() {
+        // io is freed with loop later
+        if (io) hevent_set_userdata(io, NULL);
+    }
+
+    int connect() {
+        std::string host = node;
+        int port = DEFAULT_REDIS_PORT;
+        std::string::size_type pos = node.rfind(':');
+        if (pos != std::string::npos) {
+            host = node.substr(0, pos);
+            port = atoi(node.c_str() + pos + 1);
+        }
+        io = hio_create_socket(loop->loop(), host.c_str(), port, HIO_TYPE_TCP, HIO_CLIENT_SIDE);
+        if (io == NULL) {
+            hloge("redis connect %s failed!", node.c_str());
+            return -1;
+        }
+        tcp_nodelay(hio_fd(io), 1);
+        hevent_set_userdata(io, this);
+        hio_setcb_connect(io, on_connect);
+        hio_setcb_read(io, on_read);
+        hio_setcb_close(io, on_close);
+        if (client->connect_timeout > 0) {
+            hio_set_connect_timeout(io, client->connect_timeout);
+        }
+        state = CONNECTING;
+        // handshake before any queued commands
+        if (client->protocol == 3) {
+            std::vector<std::string> argv = {"HELLO", "3"};
+            if (!client->password.empty()) {
+                argv.push_back("AUTH");
+                argv.push_back(client->username.empty() ? "default" : client->username);
+                argv.push_back(client->password);
+            }
+            sendInternal(argv);
+        } else if (!client->password.empty()) {
+            if (client->username.empty()) {
+                sendInternal({"AUTH", client->password});
+            } else {
+                sendInternal({"AUTH", client->username, client->password});
+            }
+        }
+        if (client->db > 0 && !client->cluster) {
+            sendInternal({"SELECT", std::to_string(client->db)});
+        }
+        int ret = hio_connect(io);
+        if (ret != 0) {
+            // closed async, caller drops this connection
+            hevent_set_userdata(io, NULL);
+            io = NULL;
+            state = DISCONNECTED;
+        }
+        return ret;
+    }
+
+    void close() {
+        if (io) hio_close(io);
+    }
+
+    void send(const RedisTaskPtr& task) {
+        RedisClient::AppendCommand(outbuf, task->argv);
+        tasks.push_back(task);
+        scheduleFlush();
+    }
+
+    void sendInternal(const std::vector<std::string>& argv) {
+        RedisTaskPtr task = std::make_shared<RedisTask>();
+        task->argv = argv;
+        task->internal = true;
+        send(task);
+    }
+
+    // pub/sub commands have no ordered replies
+    void sendRaw(const std::vector<std::string>& argv) {
+        RedisClient::AppendCommand(outbuf, argv);
+        scheduleFlush();
+    }
+
+    // pipelining: one write for all commands issued in this loop iteration
+    void scheduleFlush() {
+        if (state != CONNECTED || flush_queued || outbuf.empty()) return;
+        flush_queued = true;
+        RedisConnectionPtr self = shared_from_this();
+        loop->queueInLoop([self]() {
+            self->flush_queued = false;
+            self->flush();
+        });
+    }
+
+    void flush() {
+        if (state != CONNECTED || outbuf.empty()) return;
+        hio_write(io, outbuf.data(), outbuf.size());
+        outbuf.clear();
+    }
+
+    void failAll(const char* errmsg) {
+        std::deque<RedisTaskPtr> failed;
+        failed.swap(tasks);
+        outbuf.clear();
+        RedisReply reply;
+        reply.SetString(REDIS_REPLY_ERROR, errmsg, strlen(errmsg));
+        for (auto& task : failed) {
+            if (!task->internal && task->cb) {
+                task->cb(&reply);
+            }
+        }
+    }
+
+    void onReply(RedisReply* reply) {
+        if (tasks.empty() || reply->type == REDIS_REPLY_PUSH) {
+            if (pool == NULL) {
+                client->onPubsubMessage(reply);
+            } else {
+                hlogw("redis %s unexpected reply: %s", node.c_str(), reply->Dump().c_str());
+            }
+            return;
+        }
+        RedisTaskPtr task = tasks.front();
+        tasks.pop_front();
+        if (task->internal) {
+            if (reply->IsError()) {
+                hloge("redis %s %s: %.*s", node.c_str(), task->argv[0].c_str(), (int)reply->size(), reply->data());
+            }
+            return;
+        }
+        if (client->cluster && reply->IsError() && client->redirect(this, task, reply)) {
+            return;
+        }
+        if (task->cb) {
+            task->cb(reply);
+        }
+    }
+
+    static void on_connect(hio_t* io) {
+        RedisConnection* conn = (RedisConnection*)hevent_userdata(io);
+        conn->state = CONNECTED;
+        hio_read(io);
+        conn->flush();
+    }
+
+    static void on_read(hio_t* io, void* buf, int readbytes) {
+        RedisConnection* conn = (RedisConnection*)hevent_userdata(io);
+        if (conn->parser.Feed((const char*)buf, readbytes) != 0) {
+            hloge("redis %s protocol error!", conn->node.c_str());
+            hio_close(io);
+        }
+    }
+
+    static void on_close(hio_t* io) {
+        RedisConnection* conn = (RedisConnection*)hevent_userdata(io);
+        if (conn == NULL) return;
+        hevent_set_userdata(io, NULL);
+        RedisConnectionPtr self = conn->shared_from_this();
+        bool connected = conn->state == CONNECTED;
+        conn->state = DISCONNECTED;
+        conn->io = NULL;
+        if (conn->pool) {
+            auto& conns = conn->pool->nodes[conn->node];
+            for (auto iter = conns.begin(); iter != conns.end(); ++iter) {
+                if (iter->get() == conn) {
+                    conns.erase(iter);
+                    break;
+                }
+            }
+        }
+        conn->failAll(connected ? "ERR connection closed" : "ERR connect failed");
+        if (conn->pool == NULL) {
+            conn->client->onPubsubClose();
+        }
+    }
+};
+
+RedisClient::RedisClient(EventLoopPtr loop) : EventLoopThread(loop) {
+    host = "127.0.0.1";
+    port = DEFAULT_REDIS_PORT;
+    db = 0;
+    connect_timeout = DEFAULT_REDIS_CONNECT_TIMEOUT;
+    pool_size = DEFAULT_REDIS_POOL_SIZE;
+    protocol = 2;
+    cluster = false;
+    max_redirects = DEFAULT_REDIS_MAX_REDIRECTS;
+    slots_refresh_ms_ = 0;
+    if (loop == NULL) {
+        EventLoopThread::start(true);
+    }
+}
+
+RedisClient::~RedisClient() {
+    EventLoopThread::stop(true);
+}
+
+void RedisClient::AppendCommand(std::string& buf, const std::vector<std::string>& argv) {
+    char line[32];
+    int len = snprintf(line, sizeof(line), "*%d\r\n", (int)argv.size());
+    buf.append(line, len);
+    for (const auto& arg : argv) {
+        len = snprintf(line, sizeof(line), "$%d\r\n", (int)arg.size());
+        buf.append(line, len);
+        buf.append(arg);
+        buf.append("\r\n", 2);
+    }
+}
+
+// CRC16-CCITT (XMODEM), see redis cluster spec
+static uint16_t redis_crc16(const char* buf, size_t len) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= (uint16_t)(unsigned char)buf[i] << 8;
+        for (int j = 0; j < 8; ++j) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+int RedisClient::KeySlot(const char* key, size_t len) {
+    // {hashtag}
+    const char* begin = (const char*)memchr(key, '{', len);
+    if (begin) {
+        const char* end = (const char*)memchr(begin + 1, '}', key + len - begin - 1);
+        if (end && end > begin + 1) {
+            key = begin + 1;
+            len = end - key;
+        }
+    }
+    return redis_crc16(key, len) & (REDIS_CLUSTER_SLOTS - 1);
+}
+
+int RedisClient::KeySlot(const std::vector<std::string>& argv) {
+    if (argv.size() < 2) return -1;
+    const std::string& cmd = argv[0];
+    if (stricmp(cmd.c_str(), "EVAL") == 0 || stricmp(cmd.c_str(), "EVALSHA") == 0) {
+        if (argv.size() < 4 || atoi(argv[2].c_str()) <= 0) return -1;
+        return KeySlot(argv[3].data(), argv[3].size());
+    }
+    return KeySlot(argv[1].data(), argv[1].size());
+}
+
+std::string RedisClient::seedNode() const {
+    return host + ":" + std::to_string(port);
+}
+
+int RedisClient::command(const std::vector<std::string>& argv, RedisCallback cb) {
+    if (argv.empty()) return -1;
+    RedisTaskPtr task = std::make_shared<RedisTask>();
+    task->argv = argv;
+    task->cb = std::move(cb);
+    return command(task);
+}
+
+int RedisClient::command(const RedisTaskPtr& task) {
+    EventLoop* loop = currentThreadEventLoop;
+    if (loop && loop->isInLoopThread()) {
+        commandInLoop(loop, task);
+        return 0;
+    }
+    EventLoop* own_loop = EventLoopThread::loop().get();
+    own_loop->queueInLoop([this, own_loop, task]() {
+        commandInLoop(own_loop, task);
+    });
+    return 0;
+}
+
+RedisLoopPoolPtr RedisClient::loopPool(EventLoop* loop) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    RedisLoopPoolPtr& pool = pools_[loop];
+    if (pool == NULL) {
+        pool = std::make_shared<RedisLoopPool>(loop);
+    }
+    return pool;
+}
+
+RedisConnectionPtr RedisClient::getConnection(const RedisLoopPoolPtr& pool, const std::string& node) {
+    auto& conns = pool->nodes[node];
+    if ((int)conns.size() < pool_size || conns.empty()) {
+        RedisConnectionPtr conn = std::make_shared<RedisConnection>(this, pool->loop, pool.get(), node);
+        if (conn->connect() != 0) return NULL;
+        conns.push_back(conn);
+        return conn;
+    }
+    return conns[pool->next++ % conns.size()];
+}
+
+void RedisClient::commandInLoop(EventLoop* loop, const RedisTaskPtr& task) {
+    RedisLoopPoolPtr pool = loopPool(loop);
+    std::string node;
+    if (cluster) {
+        int slot = KeySlot(task->argv);
+        if (slot >= 0) node = slotNode(slot);
+        if (node.empty()) refreshSlots(loop);
+    }
+    if (node.empty()) node = seedNode();
+    RedisConnectionPtr conn = getConnection(pool, node);
+    if (conn == NULL) {
+        if (task->cb) {
+            RedisReply reply;
+            reply.SetString(REDIS_REPLY_ERROR, "ERR connect failed", 18);
+            task->cb(&reply);
+        }
+        return;
+    }
+    conn->send(task);
+}
+
+std::string RedisClient::slotNode(int slot) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return slots_.empty() ? std::string() : slots_[slot];
+}
+
+void RedisClient::updateSlot(int slot, const std::string& node) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (slots_.empty()) slots_.resize(REDIS_CLUSTER_SLOTS);
+    slots_[slot] = node;
+}
+
+void RedisClient::refreshSlots(EventLoop* loop) {
+    uint64_t now_ms = gettimeofday_ms();
+    {
+        std::lock_guard<std::mutex> locker(mutex_);
+        if (slots_refresh_ms_ && now_ms < slots_refresh_ms_ + 1000) return;
+        slots_refresh_ms_ = now_ms;
+    }
+    RedisTaskPtr task = std::make_shared<RedisTask>();
+    task->argv = {"CLUSTER", "SLOTS"};
+    std::string seed_host = host;
+    task->cb = [this, seed_host](RedisReply* reply) {
+        if (!reply->IsArray()) {
+            hlogw("redis CLUSTER SLOTS failed: %s", reply->Dump().c_str());
+            return;
+        }
+        // 1) start 2) end 3) master: host, port, id 4) replicas...
+        std::lock_guard<std::mutex> locker(mutex_);
+        if (slots_.empty()) slots_.resize(REDIS_CLUSTER_SLOTS);
+        for (const auto& range : reply->elements) {
+            if (range.elements.size() < 3 || range.elements[2].elements.size() < 2) continue;
+            long long start = range.elements[0].integer;
+            long long end = range.elements[1].integer;
+            const RedisReply& master = range.elements[2];
+            std::string node_host = master.elements[0].str();
+            if (node_host.empty()) node_host = seed_host;
+            std::string node = node_host + ":" + std::to_string(master.elements[1].integer);
+            for (long long slot = start; slot <= end && slot < REDIS_CLUSTER_SLOTS; ++slot) {
+                if (slot >= 0) slots_[slot] = node;
+            }
+        }
+    };
+    RedisConnectionPtr conn = getConnection(loopPool(loop), seedNode());
+    if (conn) conn->send(task);
+}
+
+// MOVED 3999 127.0.0.1:6381
+// ASK 3999 127.0.0.1:6381
+bool RedisClient::redirect(RedisConnection* conn, const RedisTaskPtr& task, RedisReply* reply) {
+    std::string err = reply->str();
+    bool moved = strncmp(err.c_str(), "MOVED ", 6) == 0;
+    bool ask = strncmp(err.c_str(), "ASK ", 4) == 0;
+    if (!moved && !ask) return false;
+    if (++task->redirects > max_redirects) return false;
+    const char* p = err.c_str() + (moved ? 6 : 4);
+    int slot = atoi(p);
+    p = strchr(p, ' ');
+    if (p == NULL || slot < 0 || slot >= REDIS_CLUSTER_SLOTS) return false;
+    std::string node = p + 1;
+    if (node[0] == ':') {
+        // empty host means the same host
+        node = conn->node.substr(0, conn->node.rfind(':')) + node;
+    }
+    RedisLoopPoolPtr pool = loopPool(conn->loop);
+    if (moved) {
+        updateSlot(slot, node);
+        refreshSlots(conn->loop);
+    }
+    RedisConnectionPtr target = getConnection(pool, node);
+    if (target == NULL) return false;
+    if (ask) {
+        target->sendInternal({"ASKING"});
+    }
+    target->send(task);
+    return true;
+}
+
+int RedisClient::subscribe(const std::string& channel, RedisMessageCallback cb) {
+    EventLoopThread::loop()->runInLoop([this, channel, cb]() {
+        channels_[channel] = cb;
+        subscribeInLoop("SUBSCRIBE", channel);
+    });
+    return 0;
+}
+
+int RedisClient::unsubscribe(const std::string& channel) {
+    EventLoopThread::loop()->runInLoop([this, channel]() {
+        if (channels_.erase(channel)) {
+            subscribeInLoop("UNSUBSCRIBE", channel);
+        }
+    });
+    return 0;
+}
+
+int RedisClient::psubscribe(const std::string& pattern, RedisMessageCallback cb) {
+    EventLoopThread::loop()->runInLoop([this, pattern, cb]() {
+        patterns_[pattern] = cb;
+        subscribeInLoop("PSUBSCRIBE", pattern);
+    });
+    return 0;
+}
+
+int RedisClient::punsubscribe(const std::string& pattern) {
+    EventLoopThread::loop()->runInLoop([this, pattern]() {
+        if (patterns_.erase(pattern)) {
+            subscribeInLoop("PUNSUBSCRIBE", pattern);
+        }
+    });
+    return 0;
+}
+
+void RedisClient::subscribeInLoop(const char* cmd, const std::string& channel) {
+    if (pubsub_conn_ == NULL) {
+        RedisConnectionPtr conn = std::make_shared<RedisConnection>(this, EventLoopThread::loop().get(), (RedisLoopPool*)NULL, seedNode());
+        if (conn->connect() != 0) {
+            onPubsubClose();
+            return;
+        }
+        pubsub_conn_ = conn;
+        // subscribe all after reconnected
+        if (*cmd == 'S' || *cmd == 'P') {
+            for (auto& pair : channels_) {
+                pubsub_conn_->sendRaw({"SUBSCRIBE", pair.first});
+            }
+            for (auto& pair : patterns_) {
+                pubsub_conn_->sendRaw({"PSUBSCRIBE", pair.first});
+            }
+            return;
+        }
+    }
+    pubsub_conn_->sendRaw({cmd, channel});
+}
+
+// 1) message 2) channel 3) payload
+// 1) pmessage 2) pattern 3) channel 4) payload
+void RedisClient::onPubsubMessage(RedisReply* reply) {
+    if (!reply->IsArray() || reply->elements.size() < 3) return;
+    const auto& elements = reply->elements;
+    if (elements[0].Equals("message")) {
+        auto iter = channels_.find(elements[1].str());
+        if (iter != channels_.end() && iter->second) {
+            iter->second(iter->first, elements[2].str());
+        }
+    } else if (elements[0].Equals("pmessage") && elements.size() >= 4) {
+        auto iter = patterns_.find(elements[1].str());
+        if (iter != patterns_.end() && iter->second) {
+            iter->second(elements[2].str(), elements[3].str());
+        }
+    }
+}
+
+void RedisClient::onPubsubClose() {
+    pubsub_conn_ = NULL;
+    if (channels_.empty() && patterns_.empty()) return;
+    EventLoopThread::loop()->setTimeout(1000, [this](TimerID) {
+        if (pubsub_conn_ == NULL && !(channels_.empty() && patterns_.empty())) {
+            hlogi("redis resubscribe");
+            subscribeInLoop("SUBSCRIBE", "");
+        }
+    });
+}
+
+}
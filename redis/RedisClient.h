@@ -0,0 +1,136 @@
+#ifndef HV_REDIS_CLIENT_H_
+#define HV_REDIS_CLIENT_H_
+
+/*
+ * Asynchronous redis client on EventLoop
+ *
+ * hv::RedisClient redis;
+ * redis.host = "127.0.0.1";
+ * redis.port = 6379;
+ * redis.command({"SET", "key", "value"});
+ * redis.command({"GET", "key"}, [](hv::RedisReply* reply) {
+ *     printf("%s\n", reply->Dump().c_str());
+ * });
+ * redis.subscribe("news", [](const std::string& channel, const std::string& message) {
+ *     printf("%s: %s\n", channel.c_str(), message.c_str());
+ * });
+ *
+ * Pipelining: commands issued in the same loop iteration are written at once,
+ *             replies are dispatched in order.
+ * Threading:  commands issued in a loop thread use connections of that loop and
+ *             are called back in that loop; commands from other threads go to the
+ *             loop of RedisClient.
+ * Cluster:    key slot is routed by the slot table learned from CLUSTER SLOTS,
+ *             MOVED updates the table, ASK is retried on the target node after ASKING.
+ *             The first key is argv[1], or argv[3] for EVAL/EVALSHA.
+ *
+ * NOTE: RedisClient must outlive the loops it is used in.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <functional>
+
+#include "EventLoopThread.h"
+#include "RedisParser.h"
+
+#define DEFAULT_REDIS_PORT              6379
+#define DEFAULT_REDIS_CONNECT_TIMEOUT   3000    // ms
+#define DEFAULT_REDIS_POOL_SIZE         1       // connections per loop per node
+#define DEFAULT_REDIS_MAX_REDIRECTS     5
+#define REDIS_CLUSTER_SLOTS             16384
+
+namespace hv {
+
+class RedisConnection;
+struct RedisLoopPool;
+typedef std::shared_ptr<RedisConnection> RedisConnectionPtr;
+typedef std::shared_ptr<RedisLoopPool>   RedisLoopPoolPtr;
+
+// NOTE: reply is never NULL, connection errors are REDIS_REPLY_ERROR.
+typedef std::function<void(RedisReply* reply)> RedisCallback;
+typedef std::function<void(const std::string& channel, const std::string& message)> RedisMessageCallback;
+
+struct RedisTask {
+    std::vector<std::string>    argv;
+    RedisCallback               cb;
+    int                         redirects;
+    // AUTH, SELECT, HELLO, ASKING sent by client
+    bool                        internal;
+
+    RedisTask() : redirects(0), internal(false) {}
+};
+typedef std::shared_ptr<RedisTask> RedisTaskPtr;
+
+class HV_EXPORT RedisClient : private EventLoopThread {
+public:
+    // seed node in cluster mode
+    std::string host;
+    int         port;
+    std::string username;
+    std::string password;
+    int         db;
+    int         connect_timeout; // ms
+    int         pool_size;
+    // 3: HELLO 3 after connected
+    int         protocol;
+    bool        cluster;
+    int         max_redirects;
+
+    RedisClient(EventLoopPtr loop = NULL);
+    ~RedisClient();
+
+    // thread-safe
+    int command(const std::vector<std::string>& argv, RedisCallback cb = NULL);
+    int command(const RedisTaskPtr& task);
+
+    // pub/sub on a dedicated connection, resubscribed after reconnected
+    // thread-safe, called back in the loop of RedisClient
+    int subscribe(const std::string& channel, RedisMessageCallback cb);
+    int unsubscribe(const std::string& channel);
+    // callback with the matched channel
+    int psubscribe(const std::string& pattern, RedisMessageCallback cb);
+    int punsubscribe(const std::string& pattern);
+
+    // *argc\r\n$len\r\narg\r\n...
+    static void AppendCommand(std::string& buf, const std::vector<std::string>& argv);
+    // CRC16 of key or {hashtag} % 16384
+    static int  KeySlot(const char* key, size_t len);
+    static int  KeySlot(const std::vector<std::string>& argv);
+
+private:
+    friend class RedisConnection;
+    void commandInLoop(EventLoop* loop, const RedisTaskPtr& task);
+    RedisLoopPoolPtr loopPool(EventLoop* loop);
+    RedisConnectionPtr getConnection(const RedisLoopPoolPtr& pool, const std::string& node);
+    // cluster
+    std::string slotNode(int slot);
+    void updateSlot(int slot, const std::string& node);
+    void refreshSlots(EventLoop* loop);
+    bool redirect(RedisConnection* conn, const RedisTaskPtr& task, RedisReply* reply);
+    // pub/sub
+    void subscribeInLoop(const char* cmd, const std::string& channel);
+    void onPubsubMessage(RedisReply* reply);
+    void onPubsubClose();
+
+    std::string seedNode() const;
+
+    std::mutex                                  mutex_;
+    // EventLoop => connections of the loop
+    std::map<EventLoop*, RedisLoopPoolPtr>      pools_;
+    // slot => host:port, empty means seed node
+    std::vector<std::string>                    slots_;
+    uint64_t                                    slots_refresh_ms_;
+    // pub/sub, in loop of RedisClient
+    RedisConnectionPtr                                      pubsub_conn_;
+    std::unordered_map<std::string, RedisMessageCallback>   channels_;
+    std::unordered_map<std::string, RedisMessageCallback>   patterns_;
+};
+
+}
+
+#endif // HV_REDIS_CLIENT_H_
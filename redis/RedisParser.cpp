@@ -0,0 +1,314 @@
+#include "RedisParser.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hdef.h"
+
+namespace hv {
+
+bool RedisReply::Equals(const char* s) const {
+    size_t len = strlen(s);
+    return len == size() && memcmp(data(), s, len) == 0;
+}
+
+static void dump_reply(const RedisReply& reply, std::string& out, int indent) {
+    switch (reply.type) {
+    case REDIS_REPLY_NIL:
+        out += "(nil)";
+        break;
+    case REDIS_REPLY_STATUS:
+        out.append(reply.data(), reply.size());
+        break;
+    case REDIS_REPLY_ERROR:
+        out += "(error) ";
+        out.append(reply.data(), reply.size());
+        break;
+    case REDIS_REPLY_INTEGER:
+        out += "(integer) ";
+        out += std::to_string(reply.integer);
+        break;
+    case REDIS_REPLY_STRING:
+        out += '"';
+        out.append(reply.data(), reply.size());
+        out += '"';
+        break;
+    case REDIS_REPLY_DOUBLE:
+        out += "(double) ";
+        out.append(reply.data(), reply.size());
+        break;
+    case REDIS_REPLY_BOOL:
+        out += reply.integer ? "(true)" : "(false)";
+        break;
+    case REDIS_REPLY_BIGNUM:
+        out += "(big number) ";
+        out.append(reply.data(), reply.size());
+        break;
+    default:
+    {
+        if (reply.elements.empty()) {
+            out += "(empty array)";
+            break;
+        }
+        bool map = reply.type == REDIS_REPLY_MAP;
+        size_t step = map ? 2 : 1;
+        for (size_t i = 0; i < reply.elements.size(); i += step) {
+            if (i != 0) {
+                out += '\n';
+                out.append(indent, ' ');
+            }
+            std::string prefix = std::to_string(i / step + 1) + ") ";
+            out += prefix;
+            dump_reply(reply.elements[i], out, indent + prefix.size());
+            if (map && i + 1 < reply.elements.size()) {
+                out += " => ";
+                dump_reply(reply.elements[i + 1], out, indent + prefix.size());
+            }
+        }
+    }
+        break;
+    }
+}
+
+std::string RedisReply::Dump() const {
+    std::string out;
+    dump_reply(*this, out, 0);
+    return out;
+}
+
+RedisParser::RedisParser() {
+    max_bulk_len = DEFAULT_REDIS_MAX_BULK_LEN;
+    max_elements = DEFAULT_REDIS_MAX_ELEMENTS;
+    max_line_len = DEFAULT_REDIS_MAX_LINE_LEN;
+    max_depth = DEFAULT_REDIS_MAX_DEPTH;
+    bulk_ = NULL;
+    bulk_len_ = bulk_need_ = 0;
+    bulk_verbatim_ = false;
+}
+
+void RedisParser::Reset() {
+    root_ = RedisReply();
+    stack_.clear();
+    attributes_.clear();
+    line_.clear();
+    bulk_ = NULL;
+    bulk_len_ = bulk_need_ = 0;
+    bulk_verbatim_ = false;
+    views_.clear();
+}
+
+RedisReply* RedisParser::slot() {
+    if (stack_.empty()) return &root_;
+    Frame& frame = stack_.back();
+    return &frame.reply->elements[frame.index];
+}
+
+void RedisParser::complete() {
+    while (!stack_.empty()) {
+        Frame& frame = stack_.back();
+        if (++frame.index < frame.reply->elements.size()) return;
+        bool attribute = frame.attribute;
+        size_t views = frame.views;
+        stack_.pop_back();
+        // attribute does not fill the slot of parent
+        if (attribute) {
+            // views of the attribute elements go away with it
+            views_.resize(views);
+            attributes_.pop_back();
+            return;
+        }
+    }
+    if (onReply) {
+        onReply(&root_);
+    }
+    root_ = RedisReply();
+    views_.clear();
+}
+
+int RedisParser::parseLine(const char* line, size_t len, bool spanning, const char*& p, const char* end) {
+    if (len < 3 || len > max_line_len || line[len - 2] != '\r') return -1;
+    char type = line[0];
+    const char* s = line + 1;
+    size_t n = len - 3;
+    // NOTE: s is terminated by CRLF, so strtoll/strtod stop there.
+    switch (type) {
+    case '+':
+    case '-':
+    case ',':
+    case '(':
+    {
+        RedisReply* reply = slot();
+        reply->type = type == '+' ? REDIS_REPLY_STATUS :
+                      type == '-' ? REDIS_REPLY_ERROR :
+                      type == ',' ? REDIS_REPLY_DOUBLE : REDIS_REPLY_BIGNUM;
+        if (type == ',') {
+            reply->dval = strtod(s, NULL);
+        }
+        if (spanning) {
+            reply->SetString(reply->type, s, n);
+        } else {
+            reply->setView(s, n);
+            views_.push_back(reply);
+        }
+        complete();
+        return 0;
+    }
+    case ':':
+    {
+        RedisReply* reply = slot();
+        reply->type = REDIS_REPLY_INTEGER;
+        reply->integer = strtoll(s, NULL, 10);
+        complete();
+        return 0;
+    }
+    case '#':
+    {
+        RedisReply* reply = slot();
+        reply->type = REDIS_REPLY_BOOL;
+        reply->integer = *s == 't';
+        complete();
+        return 0;
+    }
+    case '_':
+        slot()->type = REDIS_REPLY_NIL;
+        complete();
+        return 0;
+    case '$':
+    case '!':
+    case '=':
+    {
+        // NOTE: streamed strings $? are not supported
+        if (*s == '?') return -1;
+        long long blen = strtoll(s, NULL, 10);
+        if (blen > 0 && (unsigned long long)blen > max_bulk_len) return -1;
+        RedisReply* reply = slot();
+        if (blen < 0) {
+            reply->type = REDIS_REPLY_NIL;
+            complete();
+            return 0;
+        }
+        reply->type = type == '!' ? REDIS_REPLY_ERROR : REDIS_REPLY_STRING;
+        // =: txt:content
+        bool verbatim = type == '=';
+        if (end - p >= blen + 2) {
+            if (p[blen] != '\r') return -1;
+            if (verbatim && blen >= 4 && p[3] == ':') {
+                reply->setView(p + 4, blen - 4);
+            } else {
+                reply->setView(p, blen);
+            }
+            views_.push_back(reply);
+            p += blen + 2;
+            complete();
+            return 0;
+        }
+        // wait for more data
+        reply->owned_.reserve(blen);
+        bulk_ = reply;
+        bulk_len_ = blen;
+        bulk_need_ = blen + 2;
+        bulk_verbatim_ = verbatim;
+        return 0;
+    }
+    case '*':
+    case '~':
+    case '>':
+    case '%':
+    case '|':
+    {
+        long long count = strtoll(s, NULL, 10);
+        bool pairs = type == '%' || type == '|';
+        if (count > 0 && (unsigned long long)count > (pairs ? max_elements / 2 : max_elements)) return -1;
+        if (pairs) count *= 2;
+        if (count > 0 && stack_.size() >= max_depth) return -1;
+        if (type == '|') {
+            if (count <= 0) return 0;
+            attributes_.emplace_back(new RedisReply);
+            RedisReply* attribute = attributes_.back().get();
+            attribute->type = REDIS_REPLY_MAP;
+            attribute->elements.resize(count);
+            Frame frame = { attribute, 0, true, views_.size() };
+            stack_.push_back(frame);
+            return 0;
+        }
+        RedisReply* reply = slot();
+        if (count < 0) {
+            reply->type = REDIS_REPLY_NIL;
+            complete();
+            return 0;
+        }
+        reply->type = type == '*' ? REDIS_REPLY_ARRAY :
+                      type == '~' ? REDIS_REPLY_SET :
+                      type == '>' ? REDIS_REPLY_PUSH : REDIS_REPLY_MAP;
+        if (count == 0) {
+            complete();
+            return 0;
+        }
+        // NOTE: elements are never reallocated, so views and frames are stable.
+        reply->elements.resize(count);
+        Frame frame = { reply, 0, false, 0 };
+        stack_.push_back(frame);
+        return 0;
+    }
+    default:
+        return -1;
+    }
+}
+
+int RedisParser::Feed(const char* data, size_t len) {
+    const char* p = data;
+    const char* end = data + len;
+    while (p < end) {
+        if (bulk_) {
+            size_t n = MIN(bulk_need_, (size_t)(end - p));
+            size_t have = bulk_->owned_.size();
+            if (have < bulk_len_) {
+                bulk_->owned_.append(p, MIN(n, bulk_len_ - have));
+            }
+            p += n;
+            bulk_need_ -= n;
+            if (bulk_need_) break;
+            std::string& str = bulk_->owned_;
+            if (bulk_verbatim_ && str.size() >= 4 && str[3] == ':') {
+                str.erase(0, 4);
+            }
+            bulk_->str_ = NULL;
+            bulk_->len_ = str.size();
+            bulk_ = NULL;
+            complete();
+            continue;
+        }
+        const char* lf = (const char*)memchr(p, '\n', end - p);
+        if (lf == NULL) {
+            if (line_.size() + (end - p) > max_line_len) {
+                Reset();
+                return -1;
+            }
+            line_.append(p, end - p);
+            break;
+        }
+        int ret = 0;
+        if (line_.empty()) {
+            const char* line = p;
+            p = lf + 1;
+            ret = parseLine(line, p - line, false, p, end);
+        } else {
+            line_.append(p, lf + 1 - p);
+            p = lf + 1;
+            ret = parseLine(line_.data(), line_.size(), true, p, end);
+            line_.clear();
+        }
+        if (ret != 0) {
+            Reset();
+            return -1;
+        }
+    }
+    // incomplete reply: copy views before the read buffer is reused
+    for (auto reply : views_) {
+        reply->own();
+    }
+    views_.clear();
+    return 0;
+}
+
+}
@@ -0,0 +1,147 @@
+#ifndef HV_REDIS_PARSER_H_
+#define HV_REDIS_PARSER_H_
+
+/*
+ * RESP2/RESP3 incremental parser
+ *
+ * RedisParser parser;
+ * parser.onReply = [](RedisReply* reply) {
+ *     printf("%s\n", reply->Dump().c_str());
+ * };
+ * parser.Feed(data, len); // in hio read callback
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "hexport.h"
+
+// same as redis proto-max-bulk-len
+#define DEFAULT_REDIS_MAX_BULK_LEN      (512 << 20) // 512M
+// elements of an aggregate are allocated upfront, map counts key and value
+#define DEFAULT_REDIS_MAX_ELEMENTS      (1 << 20)   // 1M
+// type line, i.e. simple string, error, number or length, including CRLF
+#define DEFAULT_REDIS_MAX_LINE_LEN      (64 << 10)  // 64K
+// nested aggregates and attributes
+#define DEFAULT_REDIS_MAX_DEPTH         64
+
+typedef enum {
+    REDIS_REPLY_NIL,        // _, $-1, *-1
+    REDIS_REPLY_STATUS,     // +
+    REDIS_REPLY_ERROR,      // -, !
+    REDIS_REPLY_INTEGER,    // :
+    REDIS_REPLY_STRING,     // $, =
+    REDIS_REPLY_ARRAY,      // *
+    // RESP3
+    REDIS_REPLY_DOUBLE,     // ,
+    REDIS_REPLY_BOOL,       // #
+    REDIS_REPLY_BIGNUM,     // (
+    REDIS_REPLY_MAP,        // %
+    REDIS_REPLY_SET,        // ~
+    REDIS_REPLY_PUSH,       // >
+} redis_reply_type;
+
+namespace hv {
+
+struct HV_EXPORT RedisReply {
+    redis_reply_type    type;
+    long long           integer;    // INTEGER, BOOL
+    double              dval;       // DOUBLE
+    // ARRAY, SET, PUSH; MAP: key1, value1, key2, value2 ...
+    std::vector<RedisReply> elements;
+
+    RedisReply() : type(REDIS_REPLY_NIL), integer(0), dval(0), str_(NULL), len_(0) {}
+
+    // STATUS, ERROR, STRING, DOUBLE, BIGNUM
+    // NOTE: data may point into the read buffer, so it is only valid in callback,
+    // use str() to copy.
+    const char* data() const { return str_ ? str_ : owned_.data(); }
+    size_t      size() const { return len_; }
+    std::string str()  const { return std::string(data(), size()); }
+
+    bool IsNil()    const { return type == REDIS_REPLY_NIL; }
+    bool IsError()  const { return type == REDIS_REPLY_ERROR; }
+    bool IsString() const { return type == REDIS_REPLY_STRING || type == REDIS_REPLY_STATUS; }
+    bool IsArray()  const {
+        return type == REDIS_REPLY_ARRAY || type == REDIS_REPLY_SET ||
+               type == REDIS_REPLY_MAP   || type == REDIS_REPLY_PUSH;
+    }
+    // case sensitive
+    bool Equals(const char* s) const;
+
+    // redis-cli like format
+    std::string Dump() const;
+
+    void SetString(redis_reply_type type, const char* s, size_t len) {
+        this->type = type;
+        owned_.assign(s, len);
+        str_ = NULL;
+        len_ = len;
+    }
+
+private:
+    friend class RedisParser;
+    void setView(const char* s, size_t len) {
+        str_ = s;
+        len_ = len;
+    }
+    // copy view before the read buffer is reused
+    void own() {
+        if (str_) {
+            owned_.assign(str_, len_);
+            str_ = NULL;
+        }
+    }
+    const char*     str_;
+    size_t          len_;
+    std::string     owned_;
+};
+
+class HV_EXPORT RedisParser {
+public:
+    // NOTE: reply is reset after callback
+    typedef std::function<void(RedisReply* reply)> ReplyCallback;
+    ReplyCallback   onReply;
+    // bulk string length, aggregate elements, type line or nesting over the limit => protocol error
+    size_t          max_bulk_len;   // Default DEFAULT_REDIS_MAX_BULK_LEN
+    size_t          max_elements;   // Default DEFAULT_REDIS_MAX_ELEMENTS
+    size_t          max_line_len;   // Default DEFAULT_REDIS_MAX_LINE_LEN
+    size_t          max_depth;      // Default DEFAULT_REDIS_MAX_DEPTH
+
+    RedisParser();
+
+    // @retval 0 ok, -1 protocol error
+    int  Feed(const char* data, size_t len);
+    void Reset();
+
+private:
+    RedisReply* slot();
+    void        complete();
+    int         parseLine(const char* line, size_t len, bool spanning, const char*& p, const char* end);
+
+    struct Frame {
+        RedisReply* reply;
+        size_t      index;
+        bool        attribute; // |: parsed and discarded
+        size_t      views;     // views_.size() when the attribute is pushed
+    };
+    RedisReply              root_;
+    std::vector<Frame>      stack_;
+    std::vector<std::unique_ptr<RedisReply>> attributes_;
+    // incomplete type line
+    std::string             line_;
+    // incomplete bulk string
+    RedisReply*             bulk_;
+    size_t                  bulk_len_;
+    size_t                  bulk_need_; // including CRLF
+    bool                    bulk_verbatim_;
+    // replies pointing into the current data
+    std::vector<RedisReply*> views_;
+};
+
+}
+
+#endif // HV_REDIS_PARSER_H_
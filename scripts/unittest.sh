@@ -20,11 +20,29 @@ bin/defer_test
 bin/hstring_test
 bin/hpath_test
 bin/hurl_test
+bin/http_parser_test 100000
+bin/redis_parser_test
+bin/shared_stats_test
 # bin/hatomic_test
 # bin/hatomic_cpp_test
 # bin/hthread_test
 # bin/hmutex_test
 bin/socketpair_test
+bin/codec_test
+bin/watchdog_test
+bin/probe_test
+bin/proxy_server_test
+bin/ftp_client_test
+bin/smtp_client_test
+bin/service_discovery_test
+bin/upstream_test
+bin/proxy_cache_test
+bin/multipart_test
+bin/worker_pool_test
+bin/compression_test
+bin/metrics_test
+bin/websocket_deflate_test
 # bin/threadpool_test
 # bin/objectpool_test
+bin/snapshot_test
 bin/sizeof_test
@@ -0,0 +1,167 @@
+/*
+ * HttpAdmission load test
+ *
+ * @build   make unittest
+ * @run     bin/admission_bench [clients] [seconds]
+ *
+ * Blocking clients flood a HttpServer with one request per connection,
+ * each scenario runs on a new server with one admission setting:
+ * - none:        /slow sleeps 10ms on a pool of 4 threads, requests queue up.
+ * - inflight:    SetMaxInflightRequests(8)
+ * - adaptive:    EnableAdaptiveConcurrency(30)
+ * - ip_rate:     RateLimit(1000, 100) on /fast
+ * - route_rate:  RateLimit("/fast", 500, 50)
+ * Prints responses by status, throughput and latency of 200s,
+ * rejected requests must be answered without reaching the handlers.
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "HttpServer.h"
+#include "HttpAdmission.h"
+
+#include "hsocket.h"
+#include "htime.h"
+
+using namespace hv;
+
+#define SLOW_HANDLER_MS     10
+#define SLOW_POOL_THREADS   4
+
+static int s_clients = 32;
+static int s_seconds = 1;
+static std::atomic<uint64_t> s_handled(0);
+
+struct client_result {
+    uint64_t                codes[6];
+    std::vector<uint32_t>   latencies; // us of 200s
+};
+
+// @return status code, 0 if failed
+static int request(int port, const char* path) {
+    int fd = ConnectTimeout("127.0.0.1", port, 3000);
+    if (fd < 0) return 0;
+    char buf[1024];
+    int len = snprintf(buf, sizeof(buf), "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n", path);
+    if (send(fd, buf, len, 0) != len) {
+        closesocket(fd);
+        return 0;
+    }
+    int nread = 0, n = 0;
+    while (nread < sizeof(buf) - 1 && (n = recv(fd, buf + nread, sizeof(buf) - 1 - nread, 0)) > 0) {
+        nread += n;
+    }
+    closesocket(fd);
+    buf[nread] = '\0';
+    int status_code = 0;
+    if (sscanf(buf, "HTTP/1.1 %d", &status_code) != 1) return 0;
+    return status_code;
+}
+
+static void client_thread(int port, const char* path, uint64_t end_us, client_result* result) {
+    while (1) {
+        uint64_t start_us = gethrtime_us();
+        if (start_us >= end_us) break;
+        int status_code = request(port, path);
+        int code_class = status_code / 100;
+        if (code_class < 1 || code_class > 5) code_class = 0;
+        ++result->codes[code_class];
+        if (status_code == 200) {
+            result->latencies.push_back((uint32_t)(gethrtime_us() - start_us));
+        }
+    }
+}
+
+static void run(const char* name, const char* path, std::function<void(HttpService*)> setup) {
+    HttpService service;
+    service.enable_access_log = 0;
+    service.AddWorkerPool("", SLOW_POOL_THREADS);
+    service.GET("/fast", [](HttpRequest* req, HttpResponse* resp) {
+        ++s_handled;
+        return resp->String("OK");
+    });
+    service.GET("/slow", [](HttpRequest* req, HttpResponse* resp) {
+        ++s_handled;
+        hv_msleep(SLOW_HANDLER_MS);
+        return resp->String("OK");
+    }, http_exec_policy::POOL);
+    setup(&service);
+
+    int listenfd = Listen(0, "127.0.0.1");
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(listenfd, &addr.sa, &addrlen);
+    int port = ntohs(addr.sin.sin_port);
+    HttpServer server(&service);
+    server.setListenFD(listenfd);
+    server.setThreadNum(1);
+    server.start();
+    hv_msleep(100);
+
+    s_handled = 0;
+    uint64_t start_us = gethrtime_us();
+    uint64_t end_us = start_us + s_seconds * 1000000ULL;
+    std::vector<client_result> results(s_clients);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < s_clients; ++i) {
+        memset(results[i].codes, 0, sizeof(results[i].codes));
+        threads.emplace_back(client_thread, port, path, end_us, &results[i]);
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    uint64_t us = gethrtime_us() - start_us;
+    server.stop();
+
+    uint64_t codes[6] = { 0 };
+    std::vector<uint32_t> latencies;
+    for (auto& result : results) {
+        for (int i = 0; i < 6; ++i) codes[i] += result.codes[i];
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    uint64_t total = codes[0] + codes[2] + codes[4] + codes[5];
+    uint32_t p50 = latencies.empty() ? 0 : latencies[latencies.size() / 2];
+    uint32_t p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+    printf("%-12s %-6s %8llu %8llu %8llu %8llu %8llu %10.0f %8.2f %8.2f\n", name, path,
+            (unsigned long long)total, (unsigned long long)codes[2],
+            (unsigned long long)codes[4], (unsigned long long)codes[5], (unsigned long long)codes[0],
+            us ? (double)total / us * 1e6 : 0, p50 / 1000.0, p99 / 1000.0);
+    // rejected requests never reach the handlers
+    assert(s_handled == codes[2]);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) s_clients = atoi(argv[1]);
+    if (argc > 2) s_seconds = atoi(argv[2]);
+    // NOTE: rate limiters are HttpSharedStats, inited by http_server_run.
+
+    printf("%d clients, %d seconds per scenario, one request per connection\n", s_clients, s_seconds);
+    printf("%-12s %-6s %8s %8s %8s %8s %8s %10s %8s %8s\n", "scenario", "path",
+            "total", "2xx", "4xx", "5xx", "failed", "req/s", "p50(ms)", "p99(ms)");
+    run("none", "/slow", [](HttpService* service) {});
+    run("inflight", "/slow", [](HttpService* service) {
+        service->SetMaxInflightRequests(8);
+    });
+    run("adaptive", "/slow", [](HttpService* service) {
+        service->EnableAdaptiveConcurrency(3 * SLOW_HANDLER_MS);
+    });
+    run("none", "/fast", [](HttpService* service) {});
+    run("ip_rate", "/fast", [](HttpService* service) {
+        service->RateLimit(1000, 100);
+    });
+    run("route_rate", "/fast", [](HttpService* service) {
+        service->RateLimit("/fast", 500, 50);
+    });
+
+    std::string out;
+    HttpAdmission::Dump(out);
+    printf("%s", out.c_str());
+    return 0;
+}
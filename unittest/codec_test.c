@@ -0,0 +1,144 @@
+/*
+ * hio_set_codec test
+ *
+ * @build   make unittest
+ * @run     bin/codec_test
+ *
+ * Two codecs are stacked:
+ * - bottom: 2 bytes big-endian length + body
+ * - top:    body + 1 byte checksum
+ * Messages of random length are written by hio_write_codec into one end of a socketpair,
+ * and checked when read_cb gets them from the other end.
+ *
+ */
+
+#include "hloop.h"
+#include "hsocket.h"
+
+#define NMESSAGES   1000
+
+static int s_received = 0;
+static int s_errors = 0;
+static unsigned int s_seed = 1;
+
+static int rand_len() {
+    s_seed = s_seed * 1103515245 + 12345;
+    return (s_seed >> 16) % 2000;
+}
+
+//-----------------length codec---------------------------------------------
+static int length_decode(hio_codec_t* codec, hio_t* io, void* buf, int len) {
+    unsigned char* p = (unsigned char*)buf;
+    int remain = len;
+    while (remain >= 2) {
+        int body_len = p[0] << 8 | p[1];
+        if (remain < 2 + body_len) break;
+        int ret = hio_codec_emit(codec, io, p + 2, body_len);
+        if (ret < 0) return ret;
+        p += 2 + body_len;
+        remain -= 2 + body_len;
+    }
+    return len - remain;
+}
+
+static int length_encode(hio_codec_t* codec, hio_t* io, hio_iovec_t* iov, int iovcnt, char* scratch) {
+    size_t body_len = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        body_len += iov[i].len;
+    }
+    if (body_len > 0xFFFF || iovcnt == HIO_CODEC_MAX_IOVCNT) return -1;
+    memmove(iov + 1, iov, iovcnt * sizeof(hio_iovec_t));
+    scratch[0] = (char)(body_len >> 8);
+    scratch[1] = (char)(body_len & 0xFF);
+    iov[0].base = scratch;
+    iov[0].len = 2;
+    return iovcnt + 1;
+}
+
+//-----------------checksum codec---------------------------------------------
+static unsigned char checksum(const unsigned char* p, int len) {
+    unsigned char sum = 0;
+    for (int i = 0; i < len; ++i) {
+        sum += p[i];
+    }
+    return sum;
+}
+
+static int checksum_decode(hio_codec_t* codec, hio_t* io, void* buf, int len) {
+    if (len < 1) return -1;
+    unsigned char* p = (unsigned char*)buf;
+    if (checksum(p, len - 1) != p[len - 1]) return -1;
+    int ret = hio_codec_emit(codec, io, p, len - 1);
+    return ret < 0 ? ret : len;
+}
+
+static int checksum_encode(hio_codec_t* codec, hio_t* io, hio_iovec_t* iov, int iovcnt, char* scratch) {
+    if (iovcnt == HIO_CODEC_MAX_IOVCNT) return -1;
+    unsigned char sum = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        sum += checksum((const unsigned char*)iov[i].base, iov[i].len);
+    }
+    scratch[0] = (char)sum;
+    iov[iovcnt].base = scratch;
+    iov[iovcnt].len = 1;
+    return iovcnt + 1;
+}
+
+static hio_codec_t s_checksum_codec = { checksum_decode, checksum_encode, 0, NULL, NULL };
+static hio_codec_t s_length_codec = { length_decode, length_encode, 0, NULL, &s_checksum_codec };
+
+//-----------------test---------------------------------------------
+static void on_message(hio_t* io, void* buf, int len) {
+    const unsigned char* p = (const unsigned char*)buf;
+    int expected_len = rand_len();
+    if (len != expected_len) {
+        printf("message %d: len=%d expected=%d\n", s_received, len, expected_len);
+        ++s_errors;
+    }
+    for (int i = 0; i < len; ++i) {
+        if (p[i] != (unsigned char)(s_received + i)) {
+            printf("message %d: byte %d mismatch\n", s_received, i);
+            ++s_errors;
+            break;
+        }
+    }
+    if (++s_received == NMESSAGES) {
+        hloop_stop(hevent_loop(io));
+    }
+}
+
+int main(int argc, char** argv) {
+    int fds[2];
+    if (Socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        perror("socketpair");
+        return -1;
+    }
+
+    hloop_t* loop = hloop_new(0);
+    hio_t* wio = hio_get(loop, fds[0]);
+    hio_t* rio = hio_get(loop, fds[1]);
+    hio_set_codec(wio, &s_length_codec);
+    hio_set_codec(rio, &s_length_codec);
+    hio_setcb_read(rio, on_message);
+    hio_read_start(rio);
+
+    // writes are queued by the loop if the socketpair is full
+    char buf[2000];
+    for (int n = 0; n < NMESSAGES; ++n) {
+        int len = rand_len();
+        for (int i = 0; i < len; ++i) {
+            buf[i] = (char)(n + i);
+        }
+        if (hio_write_codec(wio, buf, len) < 0) {
+            printf("hio_write_codec failed!\n");
+            return -1;
+        }
+    }
+
+    s_seed = 1;
+    hloop_run(loop);
+    hloop_free(&loop);
+
+    printf("received %d/%d messages, %d errors\n", s_received, NMESSAGES, s_errors);
+    return s_received == NMESSAGES && s_errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,265 @@
+/*
+ * HttpCompressor test
+ *
+ * @build   ./configure --with-zlib && make unittest
+ * @run     bin/compression_test
+ *
+ * - negotiate: Accept-Encoding qvalues, *, and unsupported encodings.
+ * - response:  CompressResponse only compresses eligible responses, and always adds Vary once.
+ * - server:    chunked and End(body) responses of HttpResponseWriter are compressed,
+ *              a static file is compressed once per encoding with its own ETag,
+ *              also when cold requests race for it on several loops.
+ *
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HttpServer.h"
+#include "HttpCompressor.h"
+#include "requests.h"
+
+#include "hfile.h"
+
+#include "unittest.h"
+
+#ifdef WITH_ZLIB
+#include "zlib.h"
+#endif
+
+using namespace hv;
+
+#define STATIC_FILE_SIZE    (1 << 20)   // 1M
+#define STATIC_FILE_NAME    "compression_test.txt"
+
+static std::string text_body(size_t size) {
+    std::string body;
+    while (body.size() < size) {
+        body += "line " + hv::to_string(body.size()) + ": hello compression\n";
+    }
+    body.resize(size);
+    return body;
+}
+
+// gzip and deflate(zlib) => identity, empty if broken
+static std::string inflate_body(const std::string& data) {
+    std::string out;
+#ifdef WITH_ZLIB
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    // 32: detect gzip or zlib header
+    if (inflateInit2(&strm, MAX_WBITS + 32) != Z_OK) return out;
+    strm.next_in = (Bytef*)data.data();
+    strm.avail_in = data.size();
+    char buf[16384];
+    int ret = Z_OK;
+    do {
+        strm.next_out = (Bytef*)buf;
+        strm.avail_out = sizeof(buf);
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END) break;
+        out.append(buf, sizeof(buf) - strm.avail_out);
+    } while (ret != Z_STREAM_END);
+    inflateEnd(&strm);
+    if (ret != Z_STREAM_END) out.clear();
+#endif
+    return out;
+}
+
+static http_content_encoding supported_or_identity(http_content_encoding encoding) {
+    return HttpCompressor::IsSupported(encoding) ? encoding : HTTP_CONTENT_ENCODING_IDENTITY;
+}
+
+static void test_negotiate() {
+    bool gzip = HttpCompressor::IsSupported(HTTP_CONTENT_ENCODING_GZIP);
+    bool br = HttpCompressor::IsSupported(HTTP_CONTENT_ENCODING_BROTLI);
+    CHECK(HttpCompressor::Negotiate(NULL) == HTTP_CONTENT_ENCODING_IDENTITY);
+    CHECK(HttpCompressor::Negotiate("") == HTTP_CONTENT_ENCODING_IDENTITY);
+    CHECK(HttpCompressor::Negotiate("identity") == HTTP_CONTENT_ENCODING_IDENTITY);
+    CHECK(HttpCompressor::Negotiate("compress, zstd") == HTTP_CONTENT_ENCODING_IDENTITY);
+    CHECK(HttpCompressor::Negotiate("gzip") == supported_or_identity(HTTP_CONTENT_ENCODING_GZIP));
+    CHECK(HttpCompressor::Negotiate("X-GZIP") == supported_or_identity(HTTP_CONTENT_ENCODING_GZIP));
+    CHECK(HttpCompressor::Negotiate("deflate") == supported_or_identity(HTTP_CONTENT_ENCODING_DEFLATE));
+    CHECK(HttpCompressor::Negotiate("gzip;q=0") == HTTP_CONTENT_ENCODING_IDENTITY);
+    CHECK(HttpCompressor::Negotiate("gzip;q=0.5, deflate") == supported_or_identity(HTTP_CONTENT_ENCODING_DEFLATE));
+    CHECK(HttpCompressor::Negotiate("gzip ; q=0.8, deflate;q=0.3") == supported_or_identity(HTTP_CONTENT_ENCODING_GZIP));
+    // br > gzip > deflate if qvalues are equal
+    CHECK(HttpCompressor::Negotiate("deflate, gzip, br") ==
+          (br ? HTTP_CONTENT_ENCODING_BROTLI : supported_or_identity(HTTP_CONTENT_ENCODING_GZIP)));
+    CHECK(HttpCompressor::Negotiate("br;q=0.5, gzip;q=0.9") ==
+          (gzip ? HTTP_CONTENT_ENCODING_GZIP : supported_or_identity(HTTP_CONTENT_ENCODING_BROTLI)));
+    // *: any encoding not listed
+    CHECK(HttpCompressor::Negotiate("*") ==
+          (br ? HTTP_CONTENT_ENCODING_BROTLI : supported_or_identity(HTTP_CONTENT_ENCODING_GZIP)));
+    CHECK(HttpCompressor::Negotiate("*;q=0.5, br;q=0, gzip;q=0") == supported_or_identity(HTTP_CONTENT_ENCODING_DEFLATE));
+    CHECK(HttpCompressor::Negotiate("*;q=0") == HTTP_CONTENT_ENCODING_IDENTITY);
+}
+
+static void test_response() {
+    http_content_encoding gzip = HTTP_CONTENT_ENCODING_GZIP;
+    bool supported = HttpCompressor::IsSupported(gzip);
+    HttpCompressionOptions options;
+    std::string body = text_body(4096);
+
+    HttpResponse resp;
+    resp.content_type = TEXT_PLAIN;
+    resp.body = body;
+    CHECK(HttpCompressor::CompressResponse(&resp, gzip, options) == supported);
+    CHECK(resp.GetHeader("Vary") == "Accept-Encoding");
+    if (supported) {
+        CHECK(resp.GetHeader("Content-Encoding") == "gzip");
+        CHECK(resp.body.size() < body.size());
+        CHECK(inflate_body(resp.body) == body);
+    }
+
+    // identity: not compressed, but varies
+    HttpResponse identity;
+    identity.content_type = TEXT_PLAIN;
+    identity.body = body;
+    identity.headers["Vary"] = "Origin";
+    CHECK(!HttpCompressor::CompressResponse(&identity, HTTP_CONTENT_ENCODING_IDENTITY, options));
+    CHECK(identity.body == body && identity.GetHeader("Content-Encoding").empty());
+    CHECK(identity.GetHeader("Vary") == "Origin, Accept-Encoding");
+    HttpCompressor::AddVary(&identity);
+    CHECK(identity.GetHeader("Vary") == "Origin, Accept-Encoding");
+
+    // not eligible: no Vary either
+    HttpResponse small;
+    small.content_type = TEXT_PLAIN;
+    small.body = body.substr(0, options.min_length - 1);
+    CHECK(!HttpCompressor::CompressResponse(&small, gzip, options));
+    CHECK(small.GetHeader("Content-Encoding").empty() && small.GetHeader("Vary").empty());
+
+    HttpResponse image;
+    image.content_type = IMAGE_PNG;
+    image.body = body;
+    CHECK(!HttpCompressor::CompressResponse(&image, gzip, options));
+    CHECK(image.GetHeader("Vary").empty());
+
+    HttpResponse sse;
+    sse.headers["Content-Type"] = "text/event-stream";
+    sse.body = body;
+    CHECK(!HttpCompressor::CompressResponse(&sse, gzip, options));
+
+    http_status statuses[] = { HTTP_STATUS_NO_CONTENT, HTTP_STATUS_PARTIAL_CONTENT, HTTP_STATUS_NOT_MODIFIED };
+    for (http_status status : statuses) {
+        HttpResponse partial;
+        partial.status_code = status;
+        partial.content_type = TEXT_PLAIN;
+        partial.body = body;
+        CHECK(!HttpCompressor::CompressResponse(&partial, gzip, options));
+        CHECK(partial.body == body);
+    }
+
+    HttpResponse encoded;
+    encoded.content_type = TEXT_PLAIN;
+    encoded.headers["Content-Encoding"] = "br";
+    encoded.body = body;
+    CHECK(!HttpCompressor::CompressResponse(&encoded, gzip, options));
+    CHECK(encoded.body == body && encoded.GetHeader("Content-Encoding") == "br");
+
+    // incompressible
+    std::string random(4096, '\0');
+    for (size_t i = 0; i < random.size(); ++i) random[i] = (char)rand();
+    HttpResponse noise;
+    noise.content_type = TEXT_PLAIN;
+    noise.body = random;
+    CHECK(!HttpCompressor::CompressResponse(&noise, gzip, options));
+    CHECK(noise.body == random && noise.GetHeader("Content-Encoding").empty());
+}
+
+static void test_server() {
+    std::string body = text_body(64 << 10);
+    std::string file_content = text_body(STATIC_FILE_SIZE);
+    HFile file;
+    if (file.open(STATIC_FILE_NAME, "wb") == 0) {
+        file.write(file_content.data(), file_content.size());
+        file.close();
+    }
+
+    HttpService service;
+    service.enable_access_log = 0;
+    service.document_root = ".";
+    service.EnableCompression();
+    service.GET("/chunked", [&body](const HttpRequestPtr&, const HttpResponseWriterPtr& writer) {
+        writer->Begin();
+        writer->WriteHeader("Content-Type", "text/plain");
+        for (size_t offset = 0; offset < body.size(); offset += 10000) {
+            writer->WriteChunked(body.substr(offset, 10000));
+        }
+        writer->EndChunked();
+    });
+    service.GET("/end", [&body](const HttpRequestPtr&, const HttpResponseWriterPtr& writer) {
+        writer->Begin();
+        writer->WriteHeader("Content-Type", "text/plain");
+        writer->End(body);
+    });
+    HttpServer server(&service);
+    int port = 0;
+    server.setListenFD(listen_any(&port));
+    server.setThreadNum(4);
+    server.start();
+    std::string url = "http://127.0.0.1:" + hv::to_string(port);
+    bool supported = HttpCompressor::IsSupported(HTTP_CONTENT_ENCODING_GZIP);
+    http_headers gzip = {{"Accept-Encoding", "gzip"}};
+
+    auto resp = requests::get((url + "/chunked").c_str(), gzip);
+    CHECK(resp && resp->status_code == HTTP_STATUS_OK && resp->IsChunked());
+    CHECK(resp && resp->GetHeader("Vary") == "Accept-Encoding");
+    if (supported) {
+        CHECK(resp && resp->GetHeader("Content-Encoding") == "gzip" && inflate_body(resp->body) == body);
+    }
+    resp = requests::get((url + "/chunked").c_str());
+    CHECK(resp && resp->body == body && resp->GetHeader("Content-Encoding").empty());
+
+    resp = requests::get((url + "/end").c_str(), gzip);
+    CHECK(resp && resp->status_code == HTTP_STATUS_OK);
+    if (supported) {
+        CHECK(resp && resp->GetHeader("Content-Encoding") == "gzip" && inflate_body(resp->body) == body);
+    }
+
+    // cold requests racing on several loops
+    std::string path = url + "/" STATIC_FILE_NAME;
+    std::vector<std::thread> clients;
+    std::atomic<int> ok(0);
+    std::vector<std::string> etags(8);
+    for (int i = 0; i < 8; ++i) {
+        clients.emplace_back([&, i]() {
+            http_headers headers = {{"Accept-Encoding", "gzip"}};
+            auto resp = requests::get(path.c_str(), headers);
+            if (resp == NULL || resp->status_code != HTTP_STATUS_OK) return;
+            std::string content = supported ? inflate_body(resp->body) : resp->body;
+            if (content == file_content) ++ok;
+            etags[i] = resp->GetHeader("Etag");
+        });
+    }
+    for (auto& client : clients) client.join();
+    CHECK(ok == 8);
+    for (int i = 1; i < 8; ++i) {
+        CHECK(etags[i] == etags[0]);
+    }
+    resp = requests::get(path.c_str());
+    CHECK(resp && resp->body == file_content && resp->GetHeader("Content-Encoding").empty());
+    CHECK(resp && resp->GetHeader("Vary") == "Accept-Encoding");
+    if (supported) {
+        // each representation has its own ETag
+        CHECK(resp && resp->GetHeader("Etag") != etags[0]);
+        http_headers revalidate = {{"Accept-Encoding", "gzip"}, {"If-None-Match", etags[0]}};
+        resp = requests::get(path.c_str(), revalidate);
+        CHECK(resp && resp->status_code == HTTP_STATUS_NOT_MODIFIED);
+    }
+
+    server.stop();
+    remove(STATIC_FILE_NAME);
+}
+
+int main() {
+    test_negotiate();
+    test_response();
+    test_server();
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed;
+}
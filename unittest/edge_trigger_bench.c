@@ -0,0 +1,193 @@
+/*
+ * HLOOP_FLAG_EDGE_TRIGGERED microbenchmark
+ *
+ * @build   make unittest
+ * @run     bin/edge_trigger_bench [connections] [MB]
+ *
+ * Compares level-triggered and edge-triggered epoll over loopback tcp connections:
+ * - read:  a thread writes to all connections round-robin, the loop reads them.
+ * - write: the loop writes 64K at a time to all connections, a thread drains them.
+ * and prints throughput with syscall counts from hloop_metrics.
+ *
+ */
+
+#include "hloop.h"
+#include "hsocket.h"
+#include "hthread.h"
+#include "htime.h"
+
+#ifdef OS_UNIX
+#include <poll.h>
+#endif
+
+#define CHUNK_SIZE  (64 * 1024)
+
+typedef struct bench_s {
+    int         conns;
+    int*        fds;        // thread side
+    uint64_t    per_conn;   // bytes
+    uint64_t    total;
+    uint64_t    done;
+    char*       chunk;
+} bench_t;
+
+static bench_t s_bench;
+
+static int connect_pairs(hloop_t* loop, hio_t** ios) {
+    int port = 0;
+    int listenfd = Listen(0, "127.0.0.1");
+    if (listenfd < 0) return -1;
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(listenfd, &addr.sa, &addrlen);
+    port = ntohs(addr.sin.sin_port);
+    for (int i = 0; i < s_bench.conns; ++i) {
+        s_bench.fds[i] = Connect("127.0.0.1", port, 0);
+        int connfd = accept(listenfd, NULL, NULL);
+        if (s_bench.fds[i] < 0 || connfd < 0) return -1;
+        tcp_nodelay(connfd, 1);
+        // small buffers to make the loop wait for writable
+        int bufsize = 32 * 1024;
+        setsockopt(connfd, SOL_SOCKET, SO_SNDBUF, (const char*)&bufsize, sizeof(int));
+        setsockopt(s_bench.fds[i], SOL_SOCKET, SO_RCVBUF, (const char*)&bufsize, sizeof(int));
+        ios[i] = hio_get(loop, connfd);
+    }
+    closesocket(listenfd);
+    return 0;
+}
+
+//-----------------read---------------------------------------------
+static HTHREAD_ROUTINE(writer_thread) {
+    for (uint64_t written = 0; written < s_bench.per_conn; written += CHUNK_SIZE) {
+        for (int i = 0; i < s_bench.conns; ++i) {
+            if (send(s_bench.fds[i], s_bench.chunk, CHUNK_SIZE, 0) != CHUNK_SIZE) return 0;
+        }
+    }
+    return 0;
+}
+
+static void on_read(hio_t* io, void* buf, int readbytes) {
+    s_bench.done += readbytes;
+    if (s_bench.done >= s_bench.total) {
+        hloop_stop(hevent_loop(io));
+    }
+}
+
+//-----------------write---------------------------------------------
+static HTHREAD_ROUTINE(reader_thread) {
+#ifdef OS_UNIX
+    struct pollfd* pfds = (struct pollfd*)malloc(sizeof(struct pollfd) * s_bench.conns);
+    for (int i = 0; i < s_bench.conns; ++i) {
+        pfds[i].fd = s_bench.fds[i];
+        pfds[i].events = POLLIN;
+    }
+    char* buf = (char*)malloc(CHUNK_SIZE);
+    uint64_t nread = 0;
+    while (nread < s_bench.total) {
+        if (poll(pfds, s_bench.conns, 1000) <= 0) break;
+        for (int i = 0; i < s_bench.conns; ++i) {
+            if (pfds[i].revents == 0) continue;
+            int n = recv(pfds[i].fd, buf, CHUNK_SIZE, 0);
+            if (n <= 0) goto end;
+            nread += n;
+        }
+    }
+end:
+    free(buf);
+    free(pfds);
+#endif
+    return 0;
+}
+
+typedef struct writer_s {
+    uint64_t    queued;
+    int         writing;
+} writer_t;
+
+static void on_write(hio_t* io, const void* buf, int writebytes) {
+    writer_t* writer = (writer_t*)hevent_userdata(io);
+    s_bench.done += writebytes;
+    if (s_bench.done >= s_bench.total) {
+        hloop_stop(hevent_loop(io));
+        return;
+    }
+    // NOTE: hio_write calls on_write if written at once
+    if (writer->writing) return;
+    writer->writing = 1;
+    // keep one chunk queued at most, like a proxy does
+    while (hio_write_is_complete(io) && writer->queued < s_bench.per_conn) {
+        writer->queued += CHUNK_SIZE;
+        if (hio_write(io, s_bench.chunk, CHUNK_SIZE) < 0) break;
+    }
+    writer->writing = 0;
+}
+
+//-----------------main---------------------------------------------
+static void run(const char* name, int read_mode, int flags) {
+    hloop_t* loop = hloop_new(flags);
+    hloop_enable_metrics(loop);
+    hio_t** ios = (hio_t**)malloc(sizeof(hio_t*) * s_bench.conns);
+    writer_t* writers = (writer_t*)calloc(s_bench.conns, sizeof(writer_t));
+    if (connect_pairs(loop, ios) != 0) {
+        printf("connect failed!\n");
+        exit(1);
+    }
+    s_bench.done = 0;
+    for (int i = 0; i < s_bench.conns; ++i) {
+        if (read_mode) {
+            hio_setcb_read(ios[i], on_read);
+            hio_read_start(ios[i]);
+        } else {
+            hevent_set_userdata(ios[i], &writers[i]);
+            hio_setcb_write(ios[i], on_write);
+        }
+    }
+    uint64_t start_us = gethrtime_us();
+    hthread_t th = hthread_create(read_mode ? writer_thread : reader_thread, NULL);
+    if (!read_mode) {
+        for (int i = 0; i < s_bench.conns; ++i) {
+            on_write(ios[i], NULL, 0);
+        }
+    }
+    hloop_run(loop);
+    uint64_t us = gethrtime_us() - start_us;
+    hthread_join(th);
+    for (int i = 0; i < s_bench.conns; ++i) {
+        closesocket(s_bench.fds[i]);
+    }
+
+    hloop_metrics_t* m = hloop_metrics(loop);
+    double mb = (double)s_bench.done / (1 << 20);
+    printf("%-10s %10.2f %12.1f %12.1f %12.1f %12.1f\n", name,
+            us ? (double)s_bench.done / us : 0,
+            m->loops / mb,
+            read_mode ? (m->reads + m->read_eagains) / mb : (m->writes + m->write_eagains) / mb,
+            read_mode ? m->read_eagains / mb : m->write_eagains / mb,
+            m->poll_ctls / mb);
+    hloop_free(&loop);
+    free(writers);
+    free(ios);
+}
+
+int main(int argc, char** argv) {
+    s_bench.conns = argc > 1 ? atoi(argv[1]) : 64;
+    uint64_t total_mb = argc > 2 ? atoi(argv[2]) : 1024;
+    s_bench.per_conn = (total_mb << 20) / s_bench.conns / CHUNK_SIZE * CHUNK_SIZE;
+    if (s_bench.per_conn == 0) s_bench.per_conn = CHUNK_SIZE;
+    s_bench.total = s_bench.per_conn * s_bench.conns;
+    s_bench.fds = (int*)malloc(sizeof(int) * s_bench.conns);
+    s_bench.chunk = (char*)malloc(CHUNK_SIZE);
+    memset(s_bench.chunk, 'x', CHUNK_SIZE);
+
+    printf("%d connections, %d MB, per MB: polls=epoll_wait, calls=recv/send, ctls=epoll_ctl\n",
+            s_bench.conns, (int)(s_bench.total >> 20));
+    printf("%-10s %10s %12s %12s %12s %12s\n", "mode", "MB/s", "polls", "calls", "eagains", "ctls");
+    run("read/LT",  1, 0);
+    run("read/ET",  1, HLOOP_FLAG_EDGE_TRIGGERED);
+    run("write/LT", 0, 0);
+    run("write/ET", 0, HLOOP_FLAG_EDGE_TRIGGERED);
+
+    free(s_bench.chunk);
+    free(s_bench.fds);
+    return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * ftp_client test
+ *
+ * @build   make unittest
+ * @run     bin/ftp_client_test
+ *
+ * A stub FTP server is written with two TcpServers on one loop,
+ * the control server, and the data server advertised by PASV.
+ * The client runs on the main loop:
+ * login => FEAT (multi-line) => download 8MB => upload 5MB => download missing file => QUIT
+ *
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "TcpServer.h"
+#include "hfile.h"
+#include "herr.h"
+
+#include "ftp_client.h"
+
+using namespace hv;
+
+#define DOWNLOAD_SIZE   (8 * 1024 * 1024)
+#define UPLOAD_SIZE     (5 * 1024 * 1024 + 123)
+
+static const char* s_download_filepath = "ftp_client_test.download";
+static const char* s_upload_filepath = "ftp_client_test.upload";
+static const char* s_missing_filepath = "ftp_client_test.missing";
+
+//-----------------stub server---------------------------------------------
+class FtpStub {
+public:
+    FtpStub() : data(ctrl.loop()) {
+        ctrl_port = listen(&ctrl);
+        data_port = listen(&data);
+        unpack_setting_t unpack;
+        unpack.mode = UNPACK_BY_DELIMITER;
+        unpack.package_max_length = DEFAULT_PACKAGE_MAX_LENGTH;
+        unpack.delimiter[0] = '\r';
+        unpack.delimiter[1] = '\n';
+        unpack.delimiter_bytes = 2;
+        ctrl.setUnpack(&unpack);
+        ctrl.onConnection = [this](const SocketChannelPtr& channel) {
+            if (channel->isConnected()) {
+                ctrl_channel = channel;
+                channel->write("220 Ready\r\n");
+            }
+        };
+        ctrl.onMessage = [this](const SocketChannelPtr&, Buffer* buf) {
+            onCommand(std::string((char*)buf->data(), buf->size() - 2));
+        };
+        data.onConnection = [this](const SocketChannelPtr& channel) {
+            if (channel->isConnected()) {
+                data_channel = channel;
+                startTransfer();
+            } else {
+                data_channel = NULL;
+                // the client closes after upload
+                if (mode == "STOR") {
+                    mode.clear();
+                    ctrl_channel->write("226 Transfer complete\r\n");
+                }
+            }
+        };
+        data.onMessage = [this](const SocketChannelPtr&, Buffer* buf) {
+            stored.append((char*)buf->data(), buf->size());
+        };
+        for (int i = 0; i < DOWNLOAD_SIZE; ++i) {
+            content.push_back((char)(i * 7 + (i >> 12)));
+        }
+        ctrl.start();
+        data.start();
+    }
+
+    int listen(TcpServer* server) {
+        int listenfd = server->createsocket(0, "127.0.0.1");
+        sockaddr_u addr;
+        socklen_t addrlen = sizeof(addr);
+        getsockname(listenfd, &addr.sa, &addrlen);
+        return ntohs(addr.sin.sin_port);
+    }
+
+    void onCommand(const std::string& line) {
+        std::string cmd = line.substr(0, line.find(' '));
+        std::string param = line.size() > cmd.size() ? line.substr(cmd.size() + 1) : "";
+        commands.push_back(cmd);
+        char reply[256];
+        if (cmd == "USER") {
+            ctrl_channel->write("331 Password required\r\n");
+        } else if (cmd == "PASS") {
+            ctrl_channel->write(param == "secret" ? "230 Login OK\r\n" : "530 Not login\r\n");
+        } else if (cmd == "FEAT") {
+            ctrl_channel->write("211-Features:\r\n SIZE\r\n PASV\r\n211 End\r\n");
+        } else if (cmd == "PASV") {
+            snprintf(reply, sizeof(reply), "227 Entering Passive Mode (127,0,0,1,%d,%d)\r\n", data_port >> 8, data_port & 0xFF);
+            ctrl_channel->write(reply);
+        } else if (cmd == "RETR") {
+            if (param != "big.bin") {
+                // NOTE: the data connection is not used
+                if (data_channel) data_channel->close();
+                ctrl_channel->write("550 No such file\r\n");
+                return;
+            }
+            mode = cmd;
+            ctrl_channel->write("150 Opening data connection\r\n");
+            startTransfer();
+        } else if (cmd == "STOR") {
+            mode = cmd;
+            stored.clear();
+            ctrl_channel->write("150 Ok to send data\r\n");
+        } else if (cmd == "QUIT") {
+            ctrl_channel->write("221 Bye\r\n");
+            ctrl_channel->close();
+        } else {
+            ctrl_channel->write("500 Bad syntax\r\n");
+        }
+    }
+
+    void startTransfer() {
+        if (mode != "RETR" || data_channel == NULL) return;
+        mode.clear();
+        data_channel->write(content);
+        // NOTE: the write queue is flushed before closing.
+        data_channel->close();
+        ctrl_channel->write("226 Transfer complete\r\n");
+    }
+
+    TcpServer           ctrl;
+    TcpServer           data;
+    int                 ctrl_port;
+    int                 data_port;
+    SocketChannelPtr    ctrl_channel;
+    SocketChannelPtr    data_channel;
+    std::string         mode;
+    std::string         content;
+    std::string         stored;
+    std::vector<std::string> commands;
+};
+
+//-----------------test---------------------------------------------
+struct step_t {
+    const char* name;
+    int         expect;
+    int         ret;
+    int         done;
+};
+
+static step_t s_steps[] = {
+    { "login",              0,      -1, 0 },
+    { "FEAT",               211,    -1, 0 },
+    { "download",           0,      -1, 0 },
+    { "upload",             0,      -1, 0 },
+    { "download_missing",   550,    -1, 0 },
+    { "quit",               0,      -1, 0 },
+};
+static int s_nsteps = sizeof(s_steps) / sizeof(s_steps[0]);
+static int s_ndone = 0;
+static hloop_t* s_loop = NULL;
+
+static void on_step(ftp_client_t* cli, int ret, void* userdata) {
+    step_t* step = (step_t*)userdata;
+    step->ret = ret;
+    step->done = ++s_ndone;
+    printf("%-18s ret=%d reply=%s bytes=%llu\n", step->name, ret, ftp_client_reply(cli),
+            (unsigned long long)ftp_client_transfer_bytes(cli));
+    if (step == &s_steps[s_nsteps - 1]) {
+        ftp_client_free(cli);
+        hloop_stop(s_loop);
+    }
+}
+
+int main() {
+    FtpStub stub;
+    hv_msleep(100);
+
+    std::string upload;
+    for (int i = 0; i < UPLOAD_SIZE; ++i) {
+        upload.push_back((char)(i * 13 + (i >> 10)));
+    }
+    HFile file;
+    file.open(s_upload_filepath, "wb");
+    file.write(upload.data(), upload.size());
+    file.close();
+
+    hloop_t* loop = s_loop = hloop_new(0);
+    ftp_client_t* cli = ftp_client_new(loop);
+    ftp_client_set_max_pending(cli, s_nsteps);
+    int failed = 0;
+    int ret = ftp_client_connect(cli, "127.0.0.1", stub.ctrl_port, "user", "secret", on_step, &s_steps[0]);
+    if (ret != 0) {
+        printf("connect: ret=%d\n", ret);
+        ++failed;
+    }
+    ftp_client_exec(cli, "FEAT", NULL, on_step, &s_steps[1]);
+    ftp_client_download(cli, "big.bin", s_download_filepath, on_step, &s_steps[2]);
+    ftp_client_upload(cli, s_upload_filepath, "up.bin", on_step, &s_steps[3]);
+    ftp_client_download(cli, "missing.bin", s_missing_filepath, on_step, &s_steps[4]);
+    ftp_client_quit(cli, on_step, &s_steps[5]);
+    // bounded queue
+    ret = ftp_client_exec(cli, "NOOP", NULL, on_step, NULL);
+    if (ret != ERR_TASK_QUEUE_FULL) {
+        printf("queue full: ret=%d\n", ret);
+        ++failed;
+    }
+    hloop_run(loop);
+    hloop_free(&loop);
+
+    for (int i = 0; i < s_nsteps; ++i) {
+        step_t* step = &s_steps[i];
+        // in order
+        if (step->ret != step->expect || step->done != i + 1) {
+            printf("%s: ret=%d expect=%d done=%d\n", step->name, step->ret, step->expect, step->done);
+            ++failed;
+        }
+    }
+    std::string downloaded;
+    file.open(s_download_filepath, "rb");
+    file.readall(downloaded);
+    file.close();
+    if (downloaded != stub.content) {
+        printf("download mismatch: %zu/%zu bytes\n", downloaded.size(), stub.content.size());
+        ++failed;
+    }
+    if (stub.stored != upload) {
+        printf("upload mismatch: %zu/%zu bytes\n", stub.stored.size(), upload.size());
+        ++failed;
+    }
+    remove(s_download_filepath);
+    remove(s_upload_filepath);
+    remove(s_missing_filepath);
+    printf("%s\n", failed ? "FAILED" : "OK");
+    return failed;
+}
@@ -0,0 +1,262 @@
+/*
+ * http_parser_execute_fast vs http_parser_execute
+ *
+ * @build   make unittest
+ * @run     bin/http_parser_test [iterations]
+ *
+ * Every message of the corpus is fed whole, byte by byte and split at every
+ * offset, the callbacks, errors and parser results of both must be the same.
+ * Then both are benchmarked in requests parsed per second.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <string>
+
+#include "http_parser.h"
+#include "htime.h"
+
+struct Trace {
+    std::string events;
+    char        last;
+};
+
+static void trace_event(http_parser* parser, char event, const char* at = NULL, size_t length = 0) {
+    Trace* trace = (Trace*)parser->data;
+    // fragmented data callbacks are merged
+    if (at == NULL || event != trace->last) {
+        trace->events += '\n';
+        trace->events += event;
+        trace->events += ':';
+    }
+    if (at) trace->events.append(at, length);
+    trace->last = at ? event : 0;
+}
+
+static int on_message_begin(http_parser* parser) { trace_event(parser, 'B'); return 0; }
+static int on_url(http_parser* parser, const char* at, size_t length) { trace_event(parser, 'U', at, length); return 0; }
+static int on_status(http_parser* parser, const char* at, size_t length) { trace_event(parser, 'S', at, length); return 0; }
+static int on_header_field(http_parser* parser, const char* at, size_t length) { trace_event(parser, 'F', at, length); return 0; }
+static int on_header_value(http_parser* parser, const char* at, size_t length) { trace_event(parser, 'V', at, length); return 0; }
+static int on_body(http_parser* parser, const char* at, size_t length) { trace_event(parser, 'D', at, length); return 0; }
+static int on_chunk_header(http_parser* parser) { trace_event(parser, 'C'); return 0; }
+static int on_chunk_complete(http_parser* parser) { trace_event(parser, 'c'); return 0; }
+static int on_message_complete(http_parser* parser) { trace_event(parser, 'E'); return 0; }
+
+static int on_headers_complete(http_parser* parser) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "H:%d %d.%d %d flags=%x len=%llu upgrade=%d keepalive=%d",
+            parser->method, parser->http_major, parser->http_minor, parser->status_code,
+            parser->flags, (unsigned long long)parser->content_length,
+            parser->upgrade, http_should_keep_alive(parser));
+    trace_event(parser, 'H');
+    ((Trace*)parser->data)->events += buf;
+    return 0;
+}
+
+static http_parser_settings settings = {
+    on_message_begin,
+    on_url,
+    on_status,
+    on_header_field,
+    on_header_value,
+    on_headers_complete,
+    on_body,
+    on_message_complete,
+    on_chunk_header,
+    on_chunk_complete
+};
+
+typedef size_t (*execute_fn)(http_parser*, const http_parser_settings*, const char*, size_t);
+
+// feeds data in pieces of step bytes, first is the size of the first piece
+static std::string run(execute_fn execute, http_parser_type type, const std::string& data, size_t first, size_t step) {
+    http_parser parser;
+    Trace trace;
+    trace.last = 0;
+    http_parser_init(&parser, type);
+    parser.data = &trace;
+    size_t offset = 0;
+    while (offset < data.size()) {
+        size_t len = offset == 0 ? first : step;
+        len = len < data.size() - offset ? len : data.size() - offset;
+        size_t nparsed = execute(&parser, &settings, data.data() + offset, len);
+        offset += nparsed;
+        if (nparsed != len || parser.http_errno != HPE_OK || parser.upgrade) break;
+    }
+    if (parser.http_errno == HPE_OK && !parser.upgrade) {
+        execute(&parser, &settings, NULL, 0);
+    }
+    char buf[64];
+    snprintf(buf, sizeof(buf), "\n=%s offset=%u", http_errno_name((http_errno)parser.http_errno), (unsigned)offset);
+    return trace.events + buf;
+}
+
+static const char* s_requests[] = {
+    "GET / HTTP/1.1\r\n\r\n",
+    "GET /index.html HTTP/1.0\r\nHost: example.com\r\n\r\n",
+    "GET /path/to/resource?query=1&x=%20y#frag HTTP/1.1\r\n"
+    "Host: www.example.com:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Cookie: a=1; b=2\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n",
+    "POST /api/v1/users HTTP/1.1\r\nContent-Type: application/json\r\nContent-Length: 13\r\n\r\n{\"name\":\"hv\"}",
+    "POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n",
+    "POST /upload HTTP/1.1\r\nTransfer-Encoding: CHUNKED  \r\n\r\n5\r\nhello\r\n0\r\n\r\n",
+    "POST /upload HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\nContent-Length: 3\r\n\r\nabc",
+    "PUT /a HTTP/1.1\r\nContent-Length: 3  \r\n\r\nabc",
+    "DELETE /a/b HTTP/1.1\r\nConnection: close\r\n\r\n",
+    "PATCH /a HTTP/1.1\r\nConnection: Keep-Alive , Upgrade\r\nUpgrade: websocket\r\n\r\n",
+    "GET /chat HTTP/1.1\r\nHost: server.example.com\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n\x81\x85",
+    "OPTIONS * HTTP/1.1\r\nProxy-Connection: close\r\n\r\n",
+    "M-SEARCH * HTTP/1.1\r\nHOST: 239.255.255.250:1900\r\nMAN: \"ssdp:discover\"\r\n\r\n",
+    "HEAD /x HTTP/1.1\r\nX-Empty:\r\nX-Spaces:   \r\nX-Tab:\tv\t\r\nX-Trailing: v  \r\n\r\n",
+    "GET /x HTTP/1.1\r\nConnection: keep-alive, close\r\nConnection: upgrade\r\n\r\n",
+    "GET /x HTTP/1.1\r\nConnection: closed, keep-alivex, keep-alive\tx\r\n\r\n",
+    "GET /x HTTP/1.1\r\nX-Pipe|Tilde~: 1\r\nx-1234567890123456789: 2\r\n\r\n",
+    "\r\n\r\nGET /leading-crlf HTTP/1.1\r\n\r\n",
+    // pipelined
+    "GET /1 HTTP/1.1\r\nHost: a\r\n\r\nGET /2 HTTP/1.1\r\nHost: b\r\n\r\nPOST /3 HTTP/1.1\r\nContent-Length: 1\r\n\r\nx",
+    // left to the state machine
+    "GET http://example.com/abs HTTP/1.1\r\nHost: example.com\r\n\r\n",
+    "CONNECT example.com:443 HTTP/1.1\r\nHost: example.com:443\r\n\r\n",
+    "GET  /two-spaces HTTP/1.1\r\n\r\n",
+    "GET /lf HTTP/1.1\nHost: a\n\n",
+    "GET /fold HTTP/1.1\r\nX-Fold: a\r\n b\r\n\r\n",
+    "GET /dup HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 1\r\n\r\nx",
+    "GET /cl HTTP/1.1\r\nContent-Length: 1x\r\n\r\n",
+    "GET /cl HTTP/1.1\r\nContent-Length:\r\n\r\n",
+    "GET /cl HTTP/1.1\r\nContent-Length: 99999999999999999999999\r\n\r\n",
+    "GET /both HTTP/1.1\r\nContent-Length: 1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n",
+    "GET /conn HTTP/1.1\r\nConnection: close,\r\n\r\n",
+    "GET /conn HTTP/1.1\r\nConnection: ,close\r\n\r\n",
+    "GET /conn HTTP/1.1\r\nConnection: \"close\", keep-alive\r\n\r\n",
+    "GET /bad name HTTP/1.1\r\n\r\n",
+    "GET /ctl\x01 HTTP/1.1\r\n\r\n",
+    "GET /high\xe4\xb8\xad HTTP/1.1\r\n\r\n",
+    "GET /x HTTP/1.1\r\nBad Name: v\r\n\r\n",
+    "GET /x HTTP/1.1\r\nBad\x01: v\r\n\r\n",
+    "GET /x HTTP/1.1\r\n: v\r\n\r\n",
+    "GET /x HTTP/1.1\r\nX: a\x01 b\r\n\r\n",
+    "GET /x HTTP/1.1\r\nX: a\x7f b\r\n\r\n",
+    "GET /x HTTP/1.1\r\nX: \xe4\xb8\xad\r\n\r\n",
+    "GET /x HTTP/1.1\r\nX: a\rb\r\n\r\n",
+    "GET /x HTTP/1.1\r\r\n\r\n",
+    "GET /x HTTP/1.1\r\nX: a\r\n\r\r\n",
+    "GET /x HTTP/1.12\r\n\r\n",
+    "GET /x HTTP/12.1\r\n\r\n",
+    "GET /x HTTX/1.1\r\n\r\n",
+    "GET /x\r\n\r\n",
+    "get /x HTTP/1.1\r\n\r\n",
+    "FOO /x HTTP/1.1\r\n\r\n",
+    "SOURCE /x ICE/1.0\r\n\r\n",
+    "GET /x HTTP/1.1\r\nHost: a\r\n",
+};
+
+static const char* s_responses[] = {
+    "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello",
+    "HTTP/1.1 200 OK\r\nServer: libhv\r\nDate: Sun, 18 Oct 2026 00:00:00 GMT\r\n"
+    "Content-Type: text/plain\r\nTransfer-Encoding: chunked\r\nConnection: keep-alive\r\n\r\n"
+    "5\r\nhello\r\n0\r\n\r\n",
+    "HTTP/1.0 404 Not Found\r\n\r\nbody until eof",
+    "HTTP/1.1 204\r\n\r\n",
+    "HTTP/1.1 301 Moved Permanently\r\nLocation: /new\r\nContent-Length: 0\r\n\r\n",
+    "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n\r\n\x81\x00",
+    "HTTP/1.1 200 \xe4\xb8\xad\tOK\r\nContent-Length: 0\r\n\r\n",
+    "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\nHTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n",
+    // left to the state machine
+    "HTTP/1.1  200 OK\r\n\r\n",
+    "HTTP/1.1 2000 OK\r\n\r\n",
+    "HTTP/1.1 20 OK\r\n\r\n",
+    "HTTP/1.1 200 OK\nContent-Length: 0\n\n",
+    "HTTP/1.1 200 O\x01K\r\nContent-Length: 0\r\n\r\n",
+    "HTTP/1.1 200 OK\rContent-Length: 0\r\n\r\n",
+    "HTTP/1.1 200OK\r\n\r\n",
+    "HTTX/1.1 200 OK\r\n\r\n",
+};
+
+static int verify(http_parser_type type, const std::string& data) {
+    for (size_t split = 0; split <= data.size(); ++split) {
+        for (size_t step = 1; step <= data.size(); step = step < 4 ? step + 1 : step * 2) {
+            size_t first = split ? split : step;
+            if (split) step = data.size();
+            std::string expected = run(http_parser_execute, type, data, first, step);
+            std::string actual = run(http_parser_execute_fast, type, data, first, step);
+            if (actual != expected) {
+                printf("MISMATCH split=%u step=%u\n%s\n--- expected:%s\n--- actual:%s\n",
+                        (unsigned)split, (unsigned)step, data.c_str(), expected.c_str(), actual.c_str());
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int on_data(http_parser* parser, const char* at, size_t length) {
+    return 0;
+}
+
+static void bench(const char* name, const std::string& data, int iterations) {
+    http_parser_settings noop;
+    http_parser_settings_init(&noop);
+    noop.on_url = on_data;
+    noop.on_header_field = on_data;
+    noop.on_header_value = on_data;
+    execute_fn fns[2] = { http_parser_execute, http_parser_execute_fast };
+    double rates[2];
+    for (int i = 0; i < 2; ++i) {
+        http_parser parser;
+        http_parser_init(&parser, HTTP_REQUEST);
+        uint64_t start_us = gethrtime_us();
+        for (int n = 0; n < iterations; ++n) {
+            size_t nparsed = fns[i](&parser, &noop, data.data(), data.size());
+            assert(nparsed == data.size());
+            (void)nparsed;
+        }
+        uint64_t us = gethrtime_us() - start_us;
+        rates[i] = us ? (double)iterations / us : 0;
+    }
+    printf("%-10s %6u bytes %10.2f %10.2f %6.2fx\n", name, (unsigned)data.size(),
+            rates[0], rates[1], rates[0] ? rates[1] / rates[0] : 0);
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(s_requests) / sizeof(s_requests[0]); ++i) {
+        failed += verify(HTTP_REQUEST, s_requests[i]);
+    }
+    for (size_t i = 0; i < sizeof(s_responses) / sizeof(s_responses[0]); ++i) {
+        failed += verify(HTTP_RESPONSE, s_responses[i]);
+    }
+    // too many headers and too large header block
+    std::string many = "GET /many HTTP/1.1\r\n";
+    for (int i = 0; i < 100; ++i) {
+        many += "X-Header-" + std::to_string(i) + ": value\r\n";
+    }
+    many += "\r\n";
+    failed += verify(HTTP_REQUEST, many);
+    std::string large = "GET /large HTTP/1.1\r\nX-Large: " + std::string(HTTP_MAX_HEADER_SIZE, 'x') + "\r\n\r\n";
+    if (run(http_parser_execute, HTTP_REQUEST, large, large.size(), large.size()) !=
+        run(http_parser_execute_fast, HTTP_REQUEST, large, large.size(), large.size())) {
+        printf("MISMATCH large header\n");
+        ++failed;
+    }
+    printf("corpus: %s\n", failed ? "FAILED" : "OK");
+    if (failed) return 1;
+
+    printf("%-10s %12s %10s %10s (Mreq/s)\n", "request", "", "execute", "fast");
+    bench("curl", "GET /ping HTTP/1.1\r\nHost: 127.0.0.1:8080\r\nUser-Agent: curl/7.81.0\r\nAccept: */*\r\n\r\n", iterations);
+    bench("browser", s_requests[2], iterations);
+    bench("post", s_requests[3], iterations);
+    return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * HLOOP_FLAG_RELEASE_IDLE_BUFFERS benchmark
+ *
+ * @build   make unittest
+ * @run     bin/idle_conn_bench [connections]
+ *
+ * Opens loopback tcp connections (100000 by default, limited by RLIMIT_NOFILE),
+ * the loop side reads them by hio_set_unpack, each connection sends one line
+ * and gets an echo, then all connections stay idle.
+ * Prints the resident memory per idle connection, with and without releasing idle buffers.
+ * Each mode runs in a forked process to measure its own RSS.
+ * The "until_len" mode reads a message then a larger body by hio_read_until_length
+ * with edge-triggered, the read buffer is released in the read callback while
+ * the body is still unread, each connection must get both back.
+ *
+ */
+
+#include "hloop.h"
+#include "hsocket.h"
+#include "htime.h"
+
+#ifdef OS_UNIX
+#include <sys/resource.h>
+#include <sys/wait.h>
+#endif
+
+#define MESSAGE     "ping\r\n"
+#define MESSAGE_LEN 6
+#define BODY_LEN    1024
+
+static int s_conns = 100000;
+static int s_replied = 0;
+static unpack_setting_t s_unpack_setting;
+// hio_read_until_length: MESSAGE, then BODY_LEN
+static int s_until_length = 0;
+
+static long rss_bytes() {
+    long pages = 0, rss = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) return 0;
+    if (fscanf(fp, "%ld %ld", &pages, &rss) != 2) rss = 0;
+    fclose(fp);
+    return rss * sysconf(_SC_PAGESIZE);
+}
+
+// NOTE: use source addresses 127.0.0.x to get more than one ephemeral port range.
+static int connect_from(int i, int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_u addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin.sin_family = AF_INET;
+    addr.sin.sin_addr.s_addr = htonl(0x7F000002 + i / 10000);
+    if (bind(fd, &addr.sa, sizeof(addr.sin)) != 0) {
+        closesocket(fd);
+        return -1;
+    }
+    addr.sin.sin_addr.s_addr = htonl(0x7F000001);
+    addr.sin.sin_port = htons(port);
+    if (connect(fd, &addr.sa, sizeof(addr.sin)) != 0) {
+        closesocket(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void on_read(hio_t* io, void* buf, int readbytes) {
+    hio_write(io, buf, readbytes);
+    if (s_until_length) {
+        // NOTE: readbuf is empty and smaller than the body, it is released here
+        // while the body is readable.
+        hio_read_until_length(io, readbytes == MESSAGE_LEN ? BODY_LEN : MESSAGE_LEN);
+        if (readbytes == MESSAGE_LEN) return;
+    }
+    if (++s_replied == s_conns) {
+        hloop_stop(hevent_loop(io));
+    }
+}
+
+static void on_close(hio_t* io) {
+    if (hio_error(io)) {
+        printf("connection closed by error %d!\n", hio_error(io));
+        exit(1);
+    }
+}
+
+// @retval 0 if recv len bytes of c
+static int recv_bytes(int fd, char c, int len) {
+    char buf[BODY_LEN];
+    int nread = 0, n = 0;
+    while (nread < len && (n = recv(fd, buf + nread, len - nread, 0)) > 0) {
+        nread += n;
+    }
+    if (nread != len) return -1;
+    for (int i = 0; i < len; ++i) {
+        if (buf[i] != c) return -1;
+    }
+    return 0;
+}
+
+static void run(const char* name, int flags) {
+    int* fds = (int*)malloc(sizeof(int) * s_conns);
+    char buf[MESSAGE_LEN];
+    char body[BODY_LEN];
+    memset(body, 'b', BODY_LEN);
+    long rss0 = rss_bytes();
+    hloop_t* loop = hloop_new(flags);
+
+    int listenfd = Listen(0, "127.0.0.1");
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(listenfd, &addr.sa, &addrlen);
+    int port = ntohs(addr.sin.sin_port);
+    for (int i = 0; i < s_conns; ++i) {
+        fds[i] = connect_from(i, port);
+        int connfd = accept(listenfd, NULL, NULL);
+        if (fds[i] < 0 || connfd < 0) {
+            printf("connect %d failed!\n", i);
+            exit(1);
+        }
+        hio_t* io = hio_get(loop, connfd);
+        hio_setcb_read(io, on_read);
+        hio_setcb_close(io, on_close);
+        if (s_until_length) {
+            hio_read_until_length(io, MESSAGE_LEN);
+        } else {
+            hio_set_unpack(io, &s_unpack_setting);
+            hio_read_start(io);
+        }
+        send(fds[i], MESSAGE, MESSAGE_LEN, 0);
+        if (s_until_length) {
+            send(fds[i], body, BODY_LEN, 0);
+        }
+    }
+    closesocket(listenfd);
+
+    uint64_t start_us = gethrtime_us();
+    hloop_run(loop);
+    uint64_t us = gethrtime_us() - start_us;
+    for (int i = 0; i < s_conns; ++i) {
+        if (recv(fds[i], buf, MESSAGE_LEN, 0) != MESSAGE_LEN) {
+            printf("recv %d failed!\n", i);
+            exit(1);
+        }
+        if (s_until_length && recv_bytes(fds[i], 'b', BODY_LEN) != 0) {
+            printf("recv body %d failed!\n", i);
+            exit(1);
+        }
+    }
+    long rss = rss_bytes() - rss0;
+    printf("%-10s %12.2f %12ld %10.2f\n", name,
+            (double)rss / (1 << 20), rss / s_conns, us ? (double)s_conns / us * 1e6 : 0);
+
+    // NOTE: close the loop side first, to leave TIME_WAIT out of the ephemeral ports.
+    hloop_free(&loop);
+    for (int i = 0; i < s_conns; ++i) {
+        closesocket(fds[i]);
+    }
+    free(fds);
+}
+
+// @retval exit status of the mode
+static int run_process(const char* name, int flags) {
+#ifdef OS_UNIX
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        run(name, flags);
+        exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+#else
+    run(name, flags);
+    return 0;
+#endif
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) s_conns = atoi(argv[1]);
+#ifdef OS_UNIX
+    // 2 fds per connection
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    if (rl.rlim_cur != RLIM_INFINITY && (rlim_t)s_conns * 2 + 64 > rl.rlim_cur) {
+        s_conns = (int)(rl.rlim_cur - 64) / 2;
+    }
+#endif
+
+    s_unpack_setting.mode = UNPACK_BY_DELIMITER;
+    strcpy((char*)s_unpack_setting.delimiter, "\r\n");
+    s_unpack_setting.delimiter_bytes = 2;
+    s_unpack_setting.package_max_length = DEFAULT_PACKAGE_MAX_LENGTH;
+
+    printf("%d idle connections\n", s_conns);
+    printf("%-10s %12s %12s %10s\n", "mode", "RSS(MB)", "bytes/conn", "conns/s");
+    int ret = 0;
+    ret |= run_process("default", 0);
+    ret |= run_process("release", HLOOP_FLAG_RELEASE_IDLE_BUFFERS);
+    s_until_length = 1;
+    ret |= run_process("until_len", HLOOP_FLAG_RELEASE_IDLE_BUFFERS | HLOOP_FLAG_EDGE_TRIGGERED);
+    return ret;
+}
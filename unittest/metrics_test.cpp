@@ -0,0 +1,197 @@
+/*
+ * loop metrics and HttpMetrics test
+ *
+ * @build   make unittest
+ * @run     bin/metrics_test
+ *
+ * - histogram: hloop_histogram_observe counts values <= 2^i us in buckets[i], the rest in the last one.
+ * - loop:      timers and custom events of a loop with metrics enabled are counted,
+ *              and the loop is only reported by hloop_metrics_foreach until freed.
+ * - http:      requests observed by two threads are merged by route in the Prometheus text format.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+
+#include "hloop.h"
+#include "hstring.h"
+#include "HttpMetrics.h"
+
+#include "unittest.h"
+
+#define TIMER_REPEAT    5
+#define CUSTOM_EVENTS   3
+
+static void test_histogram() {
+    hloop_histogram_t histogram;
+    memset(&histogram, 0, sizeof(histogram));
+    struct {
+        uint64_t    us;
+        int         bucket;
+    } cases[] = {
+        { 0, 0 },
+        { 1, 0 },
+        { 2, 1 },
+        { 3, 2 },
+        { 4, 2 },
+        { 5, 3 },
+        { 1024, 10 },
+        { 1025, 11 },
+        { 1ULL << 24, 24 },
+        { (1ULL << 24) + 1, HLOOP_HISTOGRAM_BUCKETS },
+        { 1ULL << 40, HLOOP_HISTOGRAM_BUCKETS },
+    };
+    uint64_t sum = 0;
+    for (auto& c : cases) {
+        uint64_t before = histogram.buckets[c.bucket];
+        hloop_histogram_observe(&histogram, c.us);
+        CHECK(histogram.buckets[c.bucket] == before + 1);
+        sum += c.us;
+    }
+    CHECK(histogram.count == sizeof(cases) / sizeof(cases[0]));
+    CHECK(histogram.sum == sum);
+    CHECK(histogram.buckets[1] == 1 && histogram.buckets[2] == 2 && histogram.buckets[4] == 0);
+    CHECK(histogram.buckets[HLOOP_HISTOGRAM_BUCKETS] == 2);
+}
+
+static void on_timer(htimer_t* timer) {
+    if (hevent_userdata(timer)) {
+        hloop_stop(hevent_loop(timer));
+    }
+}
+
+static void on_custom_event(hevent_t* ev) {
+    (void)ev;
+}
+
+static void find_loop(hloop_t* loop, hloop_metrics_t* metrics, void* userdata) {
+    (void)metrics;
+    if (loop == *(hloop_t**)userdata) {
+        *(hloop_t**)userdata = NULL;
+    }
+}
+
+static bool is_reported(hloop_t* loop) {
+    hloop_t* found = loop;
+    hloop_metrics_foreach(find_loop, &found);
+    return found == NULL;
+}
+
+// every sample line is name{labels} value, after the HELP and TYPE of its name
+static bool is_prometheus_text(const std::string& text) {
+    std::string type_name;
+    for (const auto& line : hv::split(text, '\n')) {
+        if (line.empty()) continue;
+        if (hv::startswith(line, "# HELP ")) continue;
+        if (hv::startswith(line, "# TYPE ")) {
+            type_name = line.substr(7, line.find(' ', 7) - 7);
+            continue;
+        }
+        size_t lbrace = line.find('{');
+        size_t rbrace = line.find("} ");
+        if (lbrace == std::string::npos || rbrace == std::string::npos || lbrace > rbrace) return false;
+        if (line.compare(0, type_name.size(), type_name) != 0) return false;
+        if (line.find_first_not_of("0123456789.", rbrace + 2) != std::string::npos) return false;
+    }
+    return true;
+}
+
+static void test_loop() {
+    hloop_t* loop = hloop_new(0);
+    CHECK(hloop_metrics(loop) == NULL);
+    CHECK(!is_reported(loop));
+    hloop_enable_metrics(loop);
+    hloop_metrics_t* metrics = hloop_metrics(loop);
+    CHECK(metrics != NULL);
+    CHECK(is_reported(loop));
+
+    htimer_add(loop, on_timer, 10, TIMER_REPEAT);
+    htimer_t* timer = htimer_add(loop, on_timer, 10 * TIMER_REPEAT + 50, 1);
+    hevent_set_userdata(timer, (void*)1);
+    for (int i = 0; i < CUSTOM_EVENTS; ++i) {
+        hevent_t ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.cb = on_custom_event;
+        hloop_post_event(loop, &ev);
+    }
+    hloop_run(loop);
+
+    CHECK(metrics->custom_events_posted == CUSTOM_EVENTS);
+    CHECK(metrics->custom_events == CUSTOM_EVENTS);
+    CHECK(metrics->loops >= TIMER_REPEAT + 1);
+    CHECK(metrics->poll_wait.count == metrics->loops);
+    // lag of each timer callback
+    CHECK(metrics->lag.count >= TIMER_REPEAT + 1);
+    // custom events are handled in one read callback of the eventfds
+    CHECK(metrics->callback.count >= TIMER_REPEAT + 1 + 1);
+    CHECK(metrics->reads >= 1);
+    CHECK(metrics->accepts == 0 && metrics->connects == 0 && metrics->closes == 0);
+
+    std::string text;
+    hv::HttpMetrics::DumpLoops(text);
+    CHECK(is_prometheus_text(text));
+    CHECK(text.find("# TYPE hv_loop_poll_wait_seconds histogram\n") != std::string::npos);
+    std::string label = "{loop=\"" + hv::to_string(hloop_tid(loop)) + "\"}";
+    CHECK(text.find("hv_loop_custom_events_total" + label + " " + hv::to_string(CUSTOM_EVENTS) + "\n") != std::string::npos);
+    CHECK(text.find("hv_loop_iterations_total" + label + " " + hv::to_string(metrics->loops) + "\n") != std::string::npos);
+    CHECK(text.find("hv_loop_pending_custom_events" + label + " 0\n") != std::string::npos);
+
+    hloop_free(&loop);
+    text.clear();
+    hv::HttpMetrics::DumpLoops(text);
+    CHECK(text.empty());
+}
+
+static void test_http() {
+    static const std::string ping("/ping");
+    hv::HttpMetrics::ObserveRequest(HTTP_GET, &ping, 200, 1);
+    hv::HttpMetrics::ObserveRequest(HTTP_GET, &ping, 200, 3);
+    // another shard
+    std::thread([]() {
+        hv::HttpMetrics::ObserveRequest(HTTP_GET, &ping, 404, 1000);
+        hv::HttpMetrics::ObserveRequest(HTTP_GET, &ping, 500, 2000000);
+        hv::HttpMetrics::ObserveRequest(HTTP_POST, NULL, 0, 100000000);
+    }).join();
+
+    std::string text;
+    hv::HttpMetrics::DumpRoutes(text);
+    printf("%s", text.c_str());
+    CHECK(is_prometheus_text(text));
+    const char* lines[] = {
+        "# TYPE hv_http_request_duration_seconds histogram\n",
+        "hv_http_request_duration_seconds_bucket{method=\"GET\",route=\"/ping\",le=\"1e-06\"} 1\n",
+        "hv_http_request_duration_seconds_bucket{method=\"GET\",route=\"/ping\",le=\"2e-06\"} 1\n",
+        "hv_http_request_duration_seconds_bucket{method=\"GET\",route=\"/ping\",le=\"4e-06\"} 2\n",
+        "hv_http_request_duration_seconds_bucket{method=\"GET\",route=\"/ping\",le=\"0.000512\"} 2\n",
+        "hv_http_request_duration_seconds_bucket{method=\"GET\",route=\"/ping\",le=\"0.001024\"} 3\n",
+        "hv_http_request_duration_seconds_bucket{method=\"GET\",route=\"/ping\",le=\"2.09715\"} 4\n",
+        "hv_http_request_duration_seconds_bucket{method=\"GET\",route=\"/ping\",le=\"+Inf\"} 4\n",
+        "hv_http_request_duration_seconds_sum{method=\"GET\",route=\"/ping\"} 2.001004\n",
+        "hv_http_request_duration_seconds_count{method=\"GET\",route=\"/ping\"} 4\n",
+        "hv_http_request_duration_seconds_bucket{method=\"POST\",route=\"*\",le=\"16.7772\"} 0\n",
+        "hv_http_request_duration_seconds_bucket{method=\"POST\",route=\"*\",le=\"+Inf\"} 1\n",
+        "# TYPE hv_http_requests_total counter\n",
+        "hv_http_requests_total{method=\"GET\",route=\"/ping\",code=\"2xx\"} 2\n",
+        "hv_http_requests_total{method=\"GET\",route=\"/ping\",code=\"4xx\"} 1\n",
+        "hv_http_requests_total{method=\"GET\",route=\"/ping\",code=\"5xx\"} 1\n",
+        "hv_http_requests_total{method=\"POST\",route=\"*\",code=\"other\"} 1\n",
+    };
+    for (auto line : lines) {
+        if (text.find(line) == std::string::npos) {
+            printf("missing: %s", line);
+            ++s_failed;
+        }
+    }
+    CHECK(text.find("code=\"3xx\"") == std::string::npos);
+}
+
+int main() {
+    test_histogram();
+    test_loop();
+    test_http();
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed;
+}
@@ -0,0 +1,220 @@
+/*
+ * MultipartParser test
+ *
+ * @build   make unittest
+ * @run     bin/multipart_test
+ *
+ * - split:     the body is fed in two chunks split at every offset, and byte by byte,
+ *              boundary-like bytes in the file part must not end it.
+ * - caps:      part headers, in-memory parts and file parts over the limits => 413.
+ * - malformed: a body not starting with the boundary => 400, a truncated body is not complete.
+ * - server:    the same over HttpServer with upload_dir set.
+ * - save:      SaveFormFile moves the temp file, by copy and remove across devices (/dev/shm on linux).
+ *
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "HttpServer.h"
+#include "requests.h"
+
+#include "hfile.h"
+#include "hsocket.h"
+
+#include "unittest.h"
+
+using namespace hv;
+
+#define BOUNDARY    "XyZ"
+
+// NOTE: prefixes of the delimiter "\r\n--XyZ", and the boundary not after CRLF
+static const char* s_file_content = "line1\r\n--Xy\r\n--XyW--XyZ\r\n-\r\n--";
+
+static std::string text_part(const std::string& name, const std::string& value) {
+    return "--" BOUNDARY "\r\n"
+           "Content-Disposition: form-data; name=\"" + name + "\"\r\n\r\n" + value + "\r\n";
+}
+
+static std::string file_part(const std::string& name, const std::string& filename, const std::string& content) {
+    return "--" BOUNDARY "\r\n"
+           "Content-Disposition: form-data; name=\"" + name + "\"; filename=\"" + filename + "\"\r\n"
+           "Content-Type: text/plain\r\n\r\n" + content + "\r\n";
+}
+
+static std::string close_delimiter() {
+    return "--" BOUNDARY "--\r\n";
+}
+
+static std::string read_file(const std::string& filepath) {
+    HFile file;
+    std::string content;
+    if (file.open(filepath.c_str(), "rb") == 0) {
+        file.readall(content);
+    }
+    return content;
+}
+
+// @retval 0 if parsed as expected
+static int check_parsed(MultipartParser& parser, MultiPart& mp) {
+    if (!parser.IsComplete()) return -1;
+    if (mp["text"].content != "hello" || !mp["text"].filepath.empty()) return -2;
+    if (mp["file"].filename != "a.txt" || mp["file"].filepath.empty()) return -3;
+    if (read_file(mp["file"].filepath) != s_file_content) return -4;
+    return 0;
+}
+
+static void test_split() {
+    std::string body = text_part("text", "hello") + file_part("file", "a.txt", s_file_content) + close_delimiter();
+    int failures = 0;
+    for (size_t i = 0; i <= body.size(); ++i) {
+        MultiPart mp;
+        MultipartParser parser(&mp, BOUNDARY);
+        int ret = parser.Feed(body.data(), i);
+        if (ret == 0) ret = parser.Feed(body.data() + i, body.size() - i);
+        if (ret != 0 || check_parsed(parser, mp) != 0) {
+            printf("split at %u failed\n", (unsigned)i);
+            ++failures;
+        }
+    }
+    CHECK(failures == 0);
+
+    MultiPart mp;
+    std::string filepath;
+    {
+        MultipartParser parser(&mp, BOUNDARY);
+        for (size_t i = 0; i < body.size(); ++i) {
+            CHECK(parser.Feed(body.data() + i, 1) == 0);
+        }
+        CHECK(check_parsed(parser, mp) == 0);
+        filepath = mp["file"].filepath;
+    }
+    // temp files are removed by destructor
+    CHECK(!HPath::exists(filepath.c_str()));
+    printf("split: %u offsets\n", (unsigned)body.size() + 1);
+}
+
+static int parse(const std::string& body, size_t max_memory_size, size_t max_file_size, bool* complete = NULL) {
+    MultiPart mp;
+    MultipartParser parser(&mp, BOUNDARY);
+    parser.max_memory_size = max_memory_size;
+    parser.max_file_size = max_file_size;
+    int ret = parser.Feed(body.data(), body.size());
+    if (complete) *complete = parser.IsComplete();
+    return ret;
+}
+
+static void test_caps() {
+    std::string value(100, 'v');
+    // in-memory part
+    CHECK(parse(text_part("text", value) + close_delimiter(), 200, 0) == 0);
+    CHECK(parse(text_part("text", value) + close_delimiter(), 64, 0) == HTTP_STATUS_PAYLOAD_TOO_LARGE);
+    // part headers
+    CHECK(parse(text_part(std::string(100, 'n'), "v") + close_delimiter(), 64, 0) == HTTP_STATUS_PAYLOAD_TOO_LARGE);
+    // in-memory parts add up
+    CHECK(parse(text_part("a", value) + text_part("b", value) + close_delimiter(), 300, 0) == 0);
+    CHECK(parse(text_part("a", value) + text_part("b", value) + close_delimiter(), 200, 0) == HTTP_STATUS_PAYLOAD_TOO_LARGE);
+    // file part: not counted in memory
+    CHECK(parse(file_part("file", "a.txt", value) + close_delimiter(), 200, 100) == 0);
+    CHECK(parse(file_part("file", "a.txt", value) + close_delimiter(), 200, 99) == HTTP_STATUS_PAYLOAD_TOO_LARGE);
+    CHECK(parse(file_part("file", "a.txt", std::string(1000, 'f')) + close_delimiter(), 200, 0) == 0);
+}
+
+static void test_malformed() {
+    std::string body = text_part("text", "hello") + close_delimiter();
+    bool complete = true;
+    CHECK(parse("garbage\r\n" + body, 1024, 0) == HTTP_STATUS_BAD_REQUEST);
+    CHECK(parse("--XyW\r\n" + body.substr(7), 1024, 0) == HTTP_STATUS_BAD_REQUEST);
+    // truncated: no error yet, but not complete
+    CHECK(parse(body.substr(0, body.size() - 8), 1024, 0, &complete) == 0);
+    CHECK(!complete);
+    CHECK(parse(body, 1024, 0, &complete) == 0);
+    CHECK(complete);
+}
+
+static void test_server() {
+    HttpService service;
+    service.enable_access_log = 0;
+    service.upload_dir = ".";
+    service.upload_max_memory_size = 1024;
+    service.upload_max_file_size = 4096;
+    service.POST("/upload", [](const HttpContextPtr& ctx) {
+        MultiPart& form = ctx->request->form;
+        std::string filepath = form["file"].filepath;
+        std::string content = filepath.empty() ? "" : read_file(filepath);
+        return ctx->send(form["text"].content + ":" + hv::to_string(content.size()));
+    });
+    HttpServer server(&service);
+    int port = 0;
+    server.setListenFD(listen_any(&port));
+    std::string url = "http://127.0.0.1:" + hv::to_string(port) + "/upload";
+    server.setThreadNum(1);
+    server.start();
+
+    http_headers headers;
+    headers["Content-Type"] = "multipart/form-data; boundary=" BOUNDARY;
+    auto upload = [&](const std::string& body) -> requests::Response {
+        return requests::post(url.c_str(), body, headers);
+    };
+    std::string body = text_part("text", "hello") + file_part("file", "a.txt", std::string(4096, 'f')) + close_delimiter();
+    auto resp = upload(body);
+    CHECK(resp && resp->status_code == HTTP_STATUS_OK && resp->body == "hello:4096");
+    // file part over upload_max_file_size
+    body = text_part("text", "hello") + file_part("file", "a.txt", std::string(4097, 'f')) + close_delimiter();
+    resp = upload(body);
+    CHECK(resp && resp->status_code == HTTP_STATUS_PAYLOAD_TOO_LARGE);
+    // in-memory part over upload_max_memory_size
+    body = text_part("text", std::string(2048, 't')) + close_delimiter();
+    resp = upload(body);
+    CHECK(resp && resp->status_code == HTTP_STATUS_PAYLOAD_TOO_LARGE);
+    // malformed
+    resp = upload("garbage\r\n" + text_part("text", "hello") + close_delimiter());
+    CHECK(resp && resp->status_code == HTTP_STATUS_BAD_REQUEST);
+    // truncated
+    body = text_part("text", "hello");
+    resp = upload(body);
+    CHECK(resp && resp->status_code == HTTP_STATUS_BAD_REQUEST);
+
+    server.stop();
+}
+
+static void write_file(const char* filepath, const std::string& content) {
+    HFile file;
+    if (file.open(filepath, "wb") == 0) {
+        file.write(content.data(), content.size());
+    }
+}
+
+static void test_save() {
+    std::string content(100000, 's');
+    HttpRequest req;
+    req.content_type = MULTIPART_FORM_DATA;
+    FormData& formdata = req.form["file"];
+    formdata.filename = "a.txt";
+    formdata.filepath = "multipart_test.tmp";
+    std::vector<std::string> paths = { "multipart_test.saved" };
+    if (HPath::isdir("/dev/shm")) paths.push_back("/dev/shm/multipart_test.saved");
+    for (const auto& path : paths) {
+        write_file(formdata.filepath.c_str(), content);
+        CHECK(req.SaveFormFile("file", path.c_str()) == 200);
+        CHECK(read_file(path) == content);
+        CHECK(!HPath::exists(formdata.filepath.c_str()));
+        remove(path.c_str());
+    }
+    // the source is kept if it can not be saved
+    write_file(formdata.filepath.c_str(), content);
+    CHECK(req.SaveFormFile("file", "nonexistent_dir/multipart_test.saved") == HTTP_STATUS_INTERNAL_SERVER_ERROR);
+    CHECK(HPath::exists(formdata.filepath.c_str()));
+    remove(formdata.filepath.c_str());
+}
+
+int main() {
+    test_split();
+    test_caps();
+    test_malformed();
+    test_server();
+    test_save();
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed;
+}
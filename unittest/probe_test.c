@@ -0,0 +1,166 @@
+/*
+ * hprober test
+ *
+ * @build   make unittest
+ * @run     bin/probe_test [seconds]
+ *
+ * Targets on 127.0.0.0/8 are probed every 100ms by one prober of max_concurrency 2:
+ * - icmp:        127.0.0.2, skipped if ICMP sockets are not permitted.
+ * - tcp_up:      a listening port, connected by the kernel backlog.
+ * - tcp_down:    a closed port, refused.
+ * - http_200:    GET /health of a tiny in-loop HTTP server.
+ * - http_404:    GET /404 of the same server.
+ * - http_mute:   GET of the listening port never answered, timed out.
+ *
+ */
+
+#include "hloop.h"
+#include "hsocket.h"
+#include "herr.h"
+#include "probe.h"
+
+#define PROBE_INTERVAL_MS   100
+#define PROBE_TIMEOUT_MS    50
+#define MAX_CONCURRENCY     2
+
+typedef struct {
+    const char*     name;
+    hprobe_type_e   type;
+    const char*     host;
+    int             port;
+    const char*     path;
+    int             expect_ok;
+    int             expect_error;
+    int             expect_status;
+    // results
+    int             results;
+    int             errors;
+    int             changed;
+    int             icmp_unavailable;
+} probe_case_t;
+
+static hprober_t* s_prober = NULL;
+static int s_max_inflight = 0;
+
+static int listen_port(int* listenfd) {
+    *listenfd = Listen(0, "127.0.0.1");
+    if (*listenfd < 0) return -1;
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(*listenfd, &addr.sa, &addrlen);
+    return ntohs(addr.sin.sin_port);
+}
+
+//-----------------HTTP server---------------------------------------------
+static void on_http_request(hio_t* io, void* buf, int readbytes) {
+    const char* response = strstr((const char*)buf, "GET /404 ") ?
+        "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n" :
+        "HTTP/1.1 200 OK\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    hio_write(io, response, strlen(response));
+    hio_close(io);
+}
+
+static void on_http_accept(hio_t* io) {
+    hio_setcb_read(io, on_http_request);
+    hio_read_start(io);
+}
+
+//-----------------test---------------------------------------------
+static void on_probe(hprobe_target_t* target, const hprobe_result_t* result) {
+    probe_case_t* c = (probe_case_t*)hprobe_target_userdata(target);
+    int inflight = hprober_inflight(s_prober) + 1;
+    if (inflight > s_max_inflight) s_max_inflight = inflight;
+    ++c->results;
+    if (c->type == HPROBE_ICMP && !result->ok &&
+        (result->error == EPERM || result->error == EACCES || result->error == EPROTONOSUPPORT)) {
+        c->icmp_unavailable = 1;
+        return;
+    }
+    if (result->changed) ++c->changed;
+    if (result->ok != c->expect_ok ||
+        (c->expect_error && result->error != c->expect_error) ||
+        (c->expect_status && result->status_code != c->expect_status) ||
+        result->up != c->expect_ok) {
+        printf("%s: ok=%d error=%d status_code=%d up=%d\n", c->name,
+                result->ok, result->error, result->status_code, result->up);
+        ++c->errors;
+    }
+}
+
+static void on_stop(htimer_t* timer) {
+    hloop_stop(hevent_loop(timer));
+}
+
+int main(int argc, char** argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 1;
+
+    hloop_t* loop = hloop_new(0);
+    int mute_fd = -1, http_fd = -1, closed_fd = -1;
+    int mute_port = listen_port(&mute_fd);
+    int http_port = listen_port(&http_fd);
+    int closed_port = listen_port(&closed_fd);
+    closesocket(closed_fd);
+    if (mute_port < 0 || http_port < 0 || closed_port < 0) {
+        perror("listen");
+        return -1;
+    }
+    hio_t* listenio = hio_get(loop, http_fd);
+    hio_setcb_accept(listenio, on_http_accept);
+    hio_accept(listenio);
+
+    probe_case_t cases[] = {
+        { "icmp",       HPROBE_ICMP, "127.0.0.2", 0,            NULL,       1, 0,           0   },
+        { "tcp_up",     HPROBE_TCP,  "127.0.0.1", mute_port,    NULL,       1, 0,           0   },
+        { "tcp_down",   HPROBE_TCP,  "127.0.0.1", closed_port,  NULL,       0, ECONNREFUSED, 0  },
+        { "http_200",   HPROBE_HTTP, "127.0.0.1", http_port,    "/health",  1, 0,           200 },
+        { "http_404",   HPROBE_HTTP, "127.0.0.1", http_port,    "/404",     0, ERR_RESPONSE, 404 },
+        { "http_mute",  HPROBE_HTTP, "127.0.0.1", mute_port,    "/",        0, ETIMEDOUT,   0   },
+    };
+    int ncases = sizeof(cases) / sizeof(cases[0]);
+
+    s_prober = hprober_new(loop, MAX_CONCURRENCY);
+    for (int i = 0; i < ncases; ++i) {
+        hprobe_setting_t setting;
+        hprobe_setting_init(&setting);
+        setting.type = cases[i].type;
+        setting.host = cases[i].host;
+        setting.port = cases[i].port;
+        setting.path = cases[i].path;
+        setting.interval_ms = PROBE_INTERVAL_MS;
+        setting.timeout_ms = PROBE_TIMEOUT_MS;
+        if (hprober_add(s_prober, &setting, on_probe, &cases[i]) == NULL) {
+            printf("hprober_add %s failed!\n", cases[i].name);
+            return -1;
+        }
+    }
+    htimer_add(loop, on_stop, seconds * 1000, 1);
+    hloop_run(loop);
+
+    int failed = 0;
+    printf("%-12s %8s %8s %8s\n", "target", "results", "errors", "changed");
+    for (int i = 0; i < ncases; ++i) {
+        probe_case_t* c = &cases[i];
+        if (c->icmp_unavailable) {
+            printf("%-12s skipped, ICMP sockets are not permitted\n", c->name);
+            continue;
+        }
+        printf("%-12s %8d %8d %8d\n", c->name, c->results, c->errors, c->changed);
+        // every target is probed, up ones change once only
+        if (c->results < 2 || c->errors || c->changed != c->expect_ok) ++failed;
+    }
+
+    hprobe_stats_t stats;
+    hprober_stats(s_prober, &stats);
+    printf("probes=%llu successes=%llu failures=%llu timeouts=%llu skipped=%llu rtt_count=%llu rtt_avg=%lluus\n",
+            (unsigned long long)stats.probes, (unsigned long long)stats.successes,
+            (unsigned long long)stats.failures, (unsigned long long)stats.timeouts,
+            (unsigned long long)stats.skipped, (unsigned long long)stats.rtt.count,
+            stats.rtt.count ? (unsigned long long)(stats.rtt.sum / stats.rtt.count) : 0ULL);
+    printf("max inflight=%d\n", s_max_inflight);
+    if (s_max_inflight > MAX_CONCURRENCY || stats.rtt.count != stats.successes) ++failed;
+
+    hprober_free(s_prober);
+    hloop_free(&loop);
+    closesocket(mute_fd);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,295 @@
+/*
+ * HttpProxyCache test
+ *
+ * @build   make unittest
+ * @run     bin/proxy_cache_test
+ *
+ * A caching reverse proxy HttpServer in front of a local upstream HttpServer,
+ * which counts the fetches of each path:
+ * - hit:       a hit after a miss, and concurrent misses coalesced into one upstream fetch.
+ * - vary:      Vary: Accept-Encoding keeps one entry per encoding, no-store is never cached.
+ * - etag:      stale entries are revalidated by If-None-Match, upstream 304 => REVALIDATED.
+ * - lru:       the least recently used entry is evicted by the byte budget.
+ * - disk:      large bodies are written to disk_path by the writer thread and served by mmap,
+ *              the mapped entry replaces only the entry written, and is refreshed with it.
+ *
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "EventLoop.h"
+#include "HttpServer.h"
+#include "requests.h"
+
+#include "hbase.h"
+#include "hsocket.h"
+#include "htime.h"
+
+#include "unittest.h"
+
+using namespace hv;
+
+#define MEMORY_SIZE         (256 << 10)
+#define MEMORY_OBJECT_SIZE  (64 << 10)
+#define LRU_OBJECT_SIZE     (60 << 10)
+#define DISK_OBJECT_SIZE    (1 << 20)
+#define DISK_PATH           "proxy_cache_test.d"
+
+class Upstream {
+public:
+    Upstream() {
+        service.enable_access_log = 0;
+        service.GET("/hit", [this](const HttpContextPtr& ctx) {
+            ctx->setHeader("Cache-Control", "max-age=60");
+            return ctx->send("hit" + hv::to_string(fetched(ctx)));
+        });
+        service.GET("/slow", [this](const HttpContextPtr& ctx) {
+            fetched(ctx);
+            setTimeout(200, [ctx](TimerID) {
+                ctx->setHeader("Cache-Control", "max-age=60");
+                ctx->send("slow");
+            });
+            return HTTP_STATUS_UNFINISHED;
+        });
+        service.GET("/vary", [this](const HttpContextPtr& ctx) {
+            fetched(ctx);
+            ctx->setHeader("Cache-Control", "max-age=60");
+            ctx->setHeader("Vary", "Accept-Encoding");
+            return ctx->send(ctx->header("Accept-Encoding"));
+        });
+        service.GET("/nostore", [this](const HttpContextPtr& ctx) {
+            fetched(ctx);
+            ctx->setHeader("Cache-Control", "no-store");
+            return ctx->send("nostore");
+        });
+        service.GET("/etag", [this](const HttpContextPtr& ctx) {
+            fetched(ctx);
+            ctx->setHeader("Cache-Control", "max-age=0");
+            ctx->setHeader("Etag", "\"v1\"");
+            if (ctx->header("If-None-Match") == "\"v1\"") {
+                ++revalidations;
+                ctx->setStatus(HTTP_STATUS_NOT_MODIFIED);
+                return ctx->send();
+            }
+            return ctx->send("etag");
+        });
+        service.GET("/lru/:name", [this](const HttpContextPtr& ctx) {
+            fetched(ctx);
+            ctx->setHeader("Cache-Control", "max-age=60");
+            return ctx->send(std::string(LRU_OBJECT_SIZE, ctx->param("name")[0]));
+        });
+        service.GET("/disk", [this](const HttpContextPtr& ctx) {
+            fetched(ctx);
+            ctx->setHeader("Cache-Control", "max-age=60");
+            return ctx->send(disk_body());
+        });
+        server.registerHttpService(&service);
+        server.setListenFD(listen_any(&port));
+        server.setThreadNum(1);
+        server.start();
+    }
+
+    // @return fetches of the path
+    int fetched(const HttpContextPtr& ctx) {
+        std::lock_guard<std::mutex> locker(mutex);
+        return ++fetches[ctx->path()];
+    }
+
+    int count(const std::string& path) {
+        std::lock_guard<std::mutex> locker(mutex);
+        return fetches[path];
+    }
+
+    static std::string disk_body() {
+        std::string body(DISK_OBJECT_SIZE, '\0');
+        for (size_t i = 0; i < body.size(); ++i) {
+            body[i] = 'a' + i % 26;
+        }
+        return body;
+    }
+
+    HttpService                 service;
+    HttpServer                  server;
+    int                         port;
+    std::mutex                  mutex;
+    std::map<std::string, int>  fetches;
+    std::atomic<int>            revalidations{0};
+};
+
+static int s_proxy_port = 0;
+
+static requests::Response proxy_get(const std::string& path, const http_headers& headers = DefaultHeaders) {
+    std::string url = "http://127.0.0.1:" + hv::to_string(s_proxy_port) + path;
+    return requests::get(url.c_str(), headers);
+}
+
+#ifdef OS_UNIX
+// @return the entry of key once replaced by the mapped one
+static HttpCacheEntryPtr wait_mapped(HttpProxyCache* cache, const std::string& key) {
+    HttpRequest req;
+    HttpCacheEntryPtr entry;
+    for (int i = 0; i < 200; ++i) {
+        entry = cache->Get(key, &req);
+        if (entry && entry->mapped) break;
+        hv_msleep(10);
+    }
+    return entry;
+}
+
+static HttpCacheEntryPtr store_disk(HttpProxyCache* cache, const std::string& key, const char* cache_control) {
+    HttpRequest req;
+    HttpResponse resp;
+    resp.SetHeader("Cache-Control", cache_control);
+    resp.SetHeader("Etag", "\"v1\"");
+    resp.body = Upstream::disk_body();
+    return cache->Store(key, &req, &resp);
+}
+#endif
+
+// @return X-Cache-Status
+static std::string cache_status(const std::string& path, const http_headers& headers = DefaultHeaders) {
+    auto resp = proxy_get(path, headers);
+    return resp ? resp->GetHeader("X-Cache-Status") : "";
+}
+
+int main() {
+    Upstream upstream;
+    std::string upstream_url = "http://127.0.0.1:" + hv::to_string(upstream.port) + "/";
+
+    HttpService service;
+    service.enable_access_log = 0;
+    service.proxy_cache = std::make_shared<HttpProxyCache>(MEMORY_SIZE, 1);
+    HttpProxyCache* cache = service.proxy_cache.get();
+    cache->max_memory_object_size = MEMORY_OBJECT_SIZE;
+    cache->disk_path = DISK_PATH;
+    service.Proxy("/", upstream_url.c_str());
+    HttpServer proxy(&service);
+    proxy.setListenFD(listen_any(&s_proxy_port));
+    proxy.setThreadNum(4);
+    proxy.start();
+
+    // a hit after a miss
+    auto resp = proxy_get("/hit");
+    CHECK(resp && resp->body == "hit1" && resp->GetHeader("X-Cache-Status") == "MISS");
+    resp = proxy_get("/hit");
+    CHECK(resp && resp->body == "hit1" && resp->GetHeader("X-Cache-Status") == "HIT");
+    CHECK(upstream.count("/hit") == 1);
+
+    // concurrent misses wait for one upstream fetch
+    std::vector<std::thread> clients;
+    std::atomic<int> slow_ok(0);
+    for (int i = 0; i < 8; ++i) {
+        clients.emplace_back([&slow_ok]() {
+            auto resp = proxy_get("/slow");
+            if (resp && resp->status_code == HTTP_STATUS_OK && resp->body == "slow") ++slow_ok;
+        });
+    }
+    for (auto& client : clients) client.join();
+    printf("slow: %d ok, %d fetches, %d coalesced\n", slow_ok.load(), upstream.count("/slow"), (int)cache->stats.coalesced);
+    CHECK(slow_ok == 8);
+    CHECK(upstream.count("/slow") == 1);
+    CHECK(cache->stats.coalesced >= 1);
+
+    // Vary: Accept-Encoding
+    http_headers gzip = {{"Accept-Encoding", "gzip"}};
+    http_headers br = {{"Accept-Encoding", "br"}};
+    CHECK(cache_status("/vary", gzip) == "MISS");
+    resp = proxy_get("/vary", gzip);
+    CHECK(resp && resp->body == "gzip" && resp->GetHeader("X-Cache-Status") == "HIT");
+    resp = proxy_get("/vary", br);
+    CHECK(resp && resp->body == "br" && resp->GetHeader("X-Cache-Status") == "MISS");
+    CHECK(upstream.count("/vary") == 2);
+
+    // no-store: response never cached, request bypasses the cache
+    CHECK(cache_status("/nostore") == "MISS");
+    CHECK(cache_status("/nostore") == "MISS");
+    CHECK(upstream.count("/nostore") == 2);
+    uint64_t bypasses = cache->stats.bypasses;
+    http_headers no_store = {{"Cache-Control", "no-store"}};
+    resp = proxy_get("/hit", no_store);
+    CHECK(resp && resp->body == "hit2");
+    CHECK(cache->stats.bypasses == bypasses + 1);
+
+    // revalidation: If-None-Match => 304
+    CHECK(cache_status("/etag") == "MISS");
+    hv_msleep(1100);
+    resp = proxy_get("/etag");
+    CHECK(resp && resp->body == "etag" && resp->GetHeader("X-Cache-Status") == "REVALIDATED");
+    CHECK(upstream.revalidations == 1);
+    // client validator against the cached entry
+    http_headers if_none_match = {{"If-None-Match", "\"v1\""}};
+    resp = proxy_get("/etag", if_none_match);
+    CHECK(resp && resp->status_code == HTTP_STATUS_NOT_MODIFIED);
+
+    // LRU: 4 objects fit the budget, the 5th one evicts the least recently used
+    cache->Clear();
+    uint64_t evictions = cache->stats.evictions;
+    const char* names[] = { "a", "b", "c", "d" };
+    for (const char* name : names) {
+        CHECK(cache_status(std::string("/lru/") + name) == "MISS");
+    }
+    CHECK(cache_status("/lru/a") == "HIT");
+    CHECK(cache_status("/lru/e") == "MISS");
+    CHECK(cache->stats.evictions == evictions + 1);
+    CHECK(cache_status("/lru/a") == "HIT");
+    CHECK(cache_status("/lru/c") == "HIT");
+    CHECK(cache_status("/lru/b") == "MISS");
+    CHECK(cache->stats.memory_size <= MEMORY_SIZE);
+    printf("lru: memory_size=%llu evictions=%llu\n",
+            (unsigned long long)cache->stats.memory_size, (unsigned long long)cache->stats.evictions);
+
+#ifdef OS_UNIX
+    // disk tier
+    std::string disk_body = Upstream::disk_body();
+    resp = proxy_get("/disk");
+    CHECK(resp && resp->body == disk_body && resp->GetHeader("X-Cache-Status") == "MISS");
+    CHECK(cache->stats.disk_size == DISK_OBJECT_SIZE);
+    // written by the writer thread, then replaced by a mapped entry
+    HttpCacheEntryPtr entry = wait_mapped(cache, upstream_url + "disk");
+    CHECK(entry && entry->mapped && entry->size() == DISK_OBJECT_SIZE);
+    CHECK(entry && access(entry->filepath.c_str(), F_OK) == 0);
+    resp = proxy_get("/disk");
+    CHECK(resp && resp->body == disk_body && resp->GetHeader("X-Cache-Status") == "HIT");
+    CHECK(upstream.count("/disk") == 1);
+    cache->Clear();
+    CHECK(entry && access(entry->filepath.c_str(), F_OK) != 0);
+    CHECK(cache->stats.disk_size == 0);
+
+    // stored again while the first one is written: only the second one is mapped
+    HttpCacheEntryPtr first = store_disk(cache, "replaced", "max-age=60");
+    HttpCacheEntryPtr second = store_disk(cache, "replaced", "max-age=60");
+    CHECK(first && second);
+    entry = wait_mapped(cache, "replaced");
+    CHECK(entry && entry->mapped && second && entry->filepath == second->filepath);
+    // the writer of first has removed its file, whenever it was done
+    for (int i = 0; i < 200 && first && access(first->filepath.c_str(), F_OK) == 0; ++i) hv_msleep(10);
+    CHECK(first && access(first->filepath.c_str(), F_OK) != 0);
+    CHECK(cache->stats.disk_size == DISK_OBJECT_SIZE);
+
+    // revalidated by a request holding the entry before it was mapped
+    HttpCacheEntryPtr stored = store_disk(cache, "refreshed", "max-age=0, must-revalidate");
+    CHECK(stored && !stored->IsFresh(time(NULL)));
+    entry = wait_mapped(cache, "refreshed");
+    CHECK(entry && entry->mapped && !entry->IsFresh(time(NULL)));
+    HttpResponse not_modified;
+    not_modified.status_code = HTTP_STATUS_NOT_MODIFIED;
+    not_modified.SetHeader("Cache-Control", "max-age=60");
+    if (stored) cache->Refresh("refreshed", stored, &not_modified);
+    CHECK(stored && stored->IsFresh(time(NULL)));
+    CHECK(entry && entry->IsFresh(time(NULL)));
+    cache->Clear();
+
+    entry = first = second = stored = NULL;
+    rmdir(DISK_PATH);
+#endif
+
+    proxy.stop();
+    upstream.server.stop();
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed;
+}
@@ -0,0 +1,307 @@
+/*
+ * proxy_server test
+ *
+ * @build   make unittest
+ * @run     bin/proxy_server_test
+ *
+ * An echo server and two proxy_servers (open, and with username/password) run on a loop thread,
+ * blocking clients in the main thread tunnel to the echo server by SOCKS5 and HTTP CONNECT:
+ * - 1M echoed through each tunnel, then shutdown(SHUT_WR) is relayed, so all bytes come back before EOF.
+ * - early data sent with the SOCKS5 request.
+ * - a domain name resolved off the loop, and one that cannot be resolved.
+ * - wrong password, no acceptable methods, 407, 405, connection refused.
+ * Tunnel callbacks and stats are checked, with level-triggered and edge-triggered loops.
+ *
+ */
+
+#include "hloop.h"
+#include "hsocket.h"
+#include "hthread.h"
+#include "htime.h"
+#include "base64.h"
+
+#include "proxy_server.h"
+
+#include "unittest.h"
+
+#define ECHO_BYTES  (1 << 20)
+
+static int s_echo_port = 0;
+static int s_closed_port = 0;
+static int s_open_port = 0;
+static int s_auth_port = 0;
+
+// written by the loop thread, read after the tunnels are closed
+static int      s_tunnels = 0;
+static int      s_spliced = 0;
+static uint64_t s_bytes_up = 0;
+static uint64_t s_bytes_down = 0;
+
+//-----------------loop thread---------------------------------------------
+static void on_echo(hio_t* io, void* buf, int readbytes) {
+    hio_write(io, buf, readbytes);
+}
+
+static void on_echo_accept(hio_t* io) {
+    hio_setcb_read(io, on_echo);
+    hio_read(io);
+}
+
+static void on_tunnel(proxy_server_t* server, const proxy_tunnel_t* tunnel) {
+    ++s_tunnels;
+    s_spliced += tunnel->spliced;
+    s_bytes_up += tunnel->bytes_up;
+    s_bytes_down += tunnel->bytes_down;
+}
+
+static HTHREAD_ROUTINE(loop_thread) {
+    hloop_run((hloop_t*)userdata);
+    return 0;
+}
+
+//-----------------clients---------------------------------------------
+static int recv_n(int fd, void* buf, int len) {
+    int nread = 0;
+    while (nread < len) {
+        int n = recv(fd, (char*)buf + nread, len - nread, 0);
+        if (n <= 0) return nread;
+        nread += n;
+    }
+    return nread;
+}
+
+static int connect_proxy(int port) {
+    int fd = Connect("127.0.0.1", port, 0);
+    if (fd >= 0) so_rcvtimeo(fd, 5000);
+    return fd;
+}
+
+/*
+ * @param domain: ATYP DOMAINNAME, else IPV4
+ * @param early:  sent with the request
+ * @retval reply code of CONNECT, -1 if the proxy closed, -2 if no acceptable methods, -3 if auth failed
+ */
+static int socks5_connect(int fd, const char* username, const char* password,
+                          int domain, const char* host, int port, const char* early) {
+    unsigned char buf[600];
+    unsigned char method = username ? 0x02 : 0x00;
+    unsigned char methods[3] = { 0x05, 0x01, method };
+    send(fd, methods, 3, 0);
+    if (recv_n(fd, buf, 2) != 2) return -1;
+    if (buf[1] != method) return -2;
+    if (username) {
+        int ulen = strlen(username);
+        int plen = strlen(password);
+        int len = 0;
+        buf[len++] = 0x01;
+        buf[len++] = ulen;
+        memcpy(buf + len, username, ulen); len += ulen;
+        buf[len++] = plen;
+        memcpy(buf + len, password, plen); len += plen;
+        send(fd, buf, len, 0);
+        if (recv_n(fd, buf, 2) != 2) return -1;
+        if (buf[1] != 0x00) return -3;
+    }
+    int len = 0;
+    buf[len++] = 0x05;
+    buf[len++] = 0x01;
+    buf[len++] = 0x00;
+    if (domain) {
+        buf[len++] = 0x03;
+        buf[len++] = strlen(host);
+        memcpy(buf + len, host, strlen(host)); len += strlen(host);
+    } else {
+        buf[len++] = 0x01;
+        inet_pton(AF_INET, host, buf + len); len += 4;
+    }
+    buf[len++] = port >> 8;
+    buf[len++] = port & 0xFF;
+    if (early) {
+        memcpy(buf + len, early, strlen(early));
+        len += strlen(early);
+    }
+    send(fd, buf, len, 0);
+    // VER REP RSV ATYP BND.ADDR(4) BND.PORT
+    if (recv_n(fd, buf, 10) != 10) return -1;
+    return buf[1];
+}
+
+// @retval status code, -1 if the proxy closed
+static int http_connect(int fd, const char* method, const char* authority, const char* userpass) {
+    char req[512];
+    char auth[256] = {0};
+    if (userpass) {
+        char encoded[128] = {0};
+        hv_base64_encode((const unsigned char*)userpass, strlen(userpass), encoded);
+        snprintf(auth, sizeof(auth), "Proxy-Authorization: Basic %s\r\n", encoded);
+    }
+    int len = snprintf(req, sizeof(req), "%s %s HTTP/1.1\r\nHost: %s\r\n%s\r\n", method, authority, authority, auth);
+    send(fd, req, len, 0);
+    // read the header byte by byte, not to eat the tunnel bytes
+    char resp[512];
+    int n = 0;
+    while (n < (int)sizeof(resp) - 1) {
+        if (recv(fd, resp + n, 1, 0) != 1) return -1;
+        ++n;
+        if (n >= 4 && memcmp(resp + n - 4, "\r\n\r\n", 4) == 0) break;
+    }
+    resp[n] = '\0';
+    int status_code = -1;
+    sscanf(resp, "HTTP/1.1 %d", &status_code);
+    return status_code;
+}
+
+// @param prefix: echoed bytes expected before the payload
+static int echo_check(int fd, const char* prefix) {
+    static char payload[ECHO_BYTES];
+    static char echoed[ECHO_BYTES + 64];
+    for (int i = 0; i < ECHO_BYTES; ++i) {
+        payload[i] = (char)(i * 7);
+    }
+    int plen = prefix ? strlen(prefix) : 0;
+    if (send(fd, payload, ECHO_BYTES, 0) != ECHO_BYTES) return -1;
+    // half-close: the echo server sees EOF after all bytes
+    shutdown(fd, SHUT_WR);
+    int n = recv_n(fd, echoed, plen + ECHO_BYTES + 1);
+    if (n != plen + ECHO_BYTES) {
+        printf("echoed %d bytes, expected %d\n", n, plen + ECHO_BYTES);
+        return -1;
+    }
+    if (plen && memcmp(echoed, prefix, plen) != 0) return -1;
+    if (memcmp(echoed + plen, payload, ECHO_BYTES) != 0) return -1;
+    return 0;
+}
+
+//-----------------test---------------------------------------------
+static void test_proxy(int flags) {
+    s_tunnels = s_spliced = 0;
+    s_bytes_up = s_bytes_down = 0;
+    hloop_t* loop = hloop_new(flags);
+    hio_t* echo = hloop_create_tcp_server(loop, "127.0.0.1", 0, on_echo_accept);
+    s_echo_port = sockaddr_port((sockaddr_u*)hio_localaddr(echo));
+    // a port nobody listens on
+    int closedfd = Listen(0, "127.0.0.1");
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(closedfd, &addr.sa, &addrlen);
+    s_closed_port = sockaddr_port(&addr);
+    closesocket(closedfd);
+
+    proxy_server_setting_t setting;
+    proxy_server_setting_init(&setting);
+    setting.host = "127.0.0.1";
+    setting.port = 0;
+    setting.connect_timeout = 3000;
+    proxy_server_t* open_server = proxy_server_new(loop, &setting);
+    setting.username = "user";
+    setting.password = "secret";
+    proxy_server_t* auth_server = proxy_server_new(loop, &setting);
+    CHECK(open_server && auth_server);
+    proxy_server_setcb_tunnel(open_server, on_tunnel);
+    proxy_server_setcb_tunnel(auth_server, on_tunnel);
+    s_open_port = proxy_server_port(open_server);
+    s_auth_port = proxy_server_port(auth_server);
+    hthread_t th = hthread_create(loop_thread, loop);
+
+    char target[64];
+    snprintf(target, sizeof(target), "127.0.0.1:%d", s_echo_port);
+    int fd;
+
+    // SOCKS5
+    fd = connect_proxy(s_open_port);
+    CHECK(socks5_connect(fd, NULL, NULL, 0, "127.0.0.1", s_echo_port, NULL) == 0x00);
+    CHECK(echo_check(fd, NULL) == 0);
+    closesocket(fd);
+
+    fd = connect_proxy(s_open_port);
+    CHECK(socks5_connect(fd, NULL, NULL, 1, "127.0.0.1", s_echo_port, "early") == 0x00);
+    CHECK(echo_check(fd, "early") == 0);
+    closesocket(fd);
+
+    fd = connect_proxy(s_open_port);
+    CHECK(socks5_connect(fd, NULL, NULL, 1, "localhost", s_echo_port, NULL) == 0x00);
+    CHECK(echo_check(fd, NULL) == 0);
+    closesocket(fd);
+
+    fd = connect_proxy(s_open_port);
+    CHECK(socks5_connect(fd, NULL, NULL, 1, "nonexistent.invalid", s_echo_port, NULL) == 0x04);
+    closesocket(fd);
+
+    fd = connect_proxy(s_auth_port);
+    CHECK(socks5_connect(fd, "user", "secret", 0, "127.0.0.1", s_echo_port, NULL) == 0x00);
+    CHECK(echo_check(fd, NULL) == 0);
+    closesocket(fd);
+
+    fd = connect_proxy(s_auth_port);
+    CHECK(socks5_connect(fd, "user", "wrong", 0, "127.0.0.1", s_echo_port, NULL) == -3);
+    closesocket(fd);
+
+    fd = connect_proxy(s_auth_port);
+    CHECK(socks5_connect(fd, NULL, NULL, 0, "127.0.0.1", s_echo_port, NULL) == -2);
+    closesocket(fd);
+
+    fd = connect_proxy(s_open_port);
+    CHECK(socks5_connect(fd, NULL, NULL, 0, "127.0.0.1", s_closed_port, NULL) == 0x05);
+    closesocket(fd);
+
+    // HTTP CONNECT
+    fd = connect_proxy(s_open_port);
+    CHECK(http_connect(fd, "CONNECT", target, NULL) == 200);
+    CHECK(echo_check(fd, NULL) == 0);
+    closesocket(fd);
+
+    fd = connect_proxy(s_auth_port);
+    CHECK(http_connect(fd, "CONNECT", target, "user:secret") == 200);
+    CHECK(echo_check(fd, NULL) == 0);
+    closesocket(fd);
+
+    fd = connect_proxy(s_auth_port);
+    CHECK(http_connect(fd, "CONNECT", target, NULL) == 407);
+    closesocket(fd);
+
+    fd = connect_proxy(s_open_port);
+    CHECK(http_connect(fd, "GET", "http://127.0.0.1/", NULL) == 405);
+    closesocket(fd);
+
+    snprintf(target, sizeof(target), "127.0.0.1:%d", s_closed_port);
+    fd = connect_proxy(s_open_port);
+    CHECK(http_connect(fd, "CONNECT", target, NULL) == 502);
+    closesocket(fd);
+
+    fd = connect_proxy(s_open_port);
+    CHECK(http_connect(fd, "CONNECT", "nonexistent.invalid:443", NULL) == 502);
+    closesocket(fd);
+
+    // wait for the tunnels closed
+    for (int i = 0; i < 100 && s_tunnels < 6; ++i) hv_msleep(10);
+    hloop_stop(loop);
+    hthread_join(th);
+
+    proxy_server_stats_t open_stats, auth_stats;
+    proxy_server_get_stats(open_server, &open_stats);
+    proxy_server_get_stats(auth_server, &auth_stats);
+    printf("%s: tunnels=%d spliced=%d up=%llu down=%llu open: accepted=%llu failed=%llu active=%llu auth: accepted=%llu failed=%llu active=%llu\n",
+            flags & HLOOP_FLAG_EDGE_TRIGGERED ? "ET" : "LT",
+            s_tunnels, s_spliced, (unsigned long long)s_bytes_up, (unsigned long long)s_bytes_down,
+            (unsigned long long)open_stats.accepted, (unsigned long long)open_stats.failed, (unsigned long long)open_stats.active,
+            (unsigned long long)auth_stats.accepted, (unsigned long long)auth_stats.failed, (unsigned long long)auth_stats.active);
+    CHECK(s_tunnels == 6);
+#ifdef OS_LINUX
+    CHECK(s_spliced == 6);
+#endif
+    CHECK(s_bytes_up == 6ULL * ECHO_BYTES + 5);
+    CHECK(s_bytes_down == 6ULL * ECHO_BYTES + 5);
+    CHECK(open_stats.accepted == 9 && open_stats.tunnels == 4 && open_stats.failed == 5 && open_stats.active == 0);
+    CHECK(auth_stats.accepted == 5 && auth_stats.tunnels == 2 && auth_stats.failed == 3 && auth_stats.active == 0);
+
+    proxy_server_free(open_server);
+    proxy_server_free(auth_server);
+    hloop_free(&loop);
+}
+
+int main(int argc, char** argv) {
+    test_proxy(0);
+    test_proxy(HLOOP_FLAG_EDGE_TRIGGERED);
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed;
+}
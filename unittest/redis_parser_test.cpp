@@ -0,0 +1,182 @@
+/*
+ * RedisParser test
+ *
+ * @build   make unittest
+ * @run     bin/redis_parser_test
+ *
+ * - types:     RESP2 and RESP3 replies are dumped as redis-cli does.
+ * - split:     a stream of replies fed in two chunks split at every offset, and byte by byte,
+ *              gives the same replies as fed at once, views are copied before Feed returns.
+ * - attribute: RESP3 attributes are discarded, also when the next reply spans reads.
+ * - limits:    bulk length, aggregate elements, type line and nesting over the limits => -1,
+ *              and the parser is reset.
+ *
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "RedisParser.h"
+#include "hdef.h"
+
+#include "unittest.h"
+
+using namespace hv;
+
+static std::string s_stream =
+    "+OK\r\n"
+    "-ERR unknown command\r\n"
+    ":-42\r\n"
+    "$5\r\nhello\r\n"
+    "$0\r\n\r\n"
+    "$-1\r\n"
+    "*-1\r\n"
+    "*0\r\n"
+    "*3\r\n:1\r\n$3\r\nfoo\r\n*2\r\n+a\r\n$1\r\nb\r\n"
+    "_\r\n"
+    ",3.14\r\n"
+    "#t\r\n"
+    "(3492890328409238509324850943850943825024385\r\n"
+    "!21\r\nSYNTAX invalid syntax\r\n"
+    "=15\r\ntxt:Some string\r\n"
+    "%2\r\n+first\r\n:1\r\n+second\r\n:2\r\n"
+    "~2\r\n+orange\r\n+apple\r\n"
+    ">3\r\n+message\r\n+news\r\n$5\r\nhello\r\n"
+    "|1\r\n+key-popularity\r\n*2\r\n$1\r\na\r\n,0.1923\r\n$5\r\nworld\r\n";
+
+static const char* s_dumps[] = {
+    "OK",
+    "(error) ERR unknown command",
+    "(integer) -42",
+    "\"hello\"",
+    "\"\"",
+    "(nil)",
+    "(nil)",
+    "(empty array)",
+    "1) (integer) 1\n2) \"foo\"\n3) 1) a\n   2) \"b\"",
+    "(nil)",
+    "(double) 3.14",
+    "(true)",
+    "(big number) 3492890328409238509324850943850943825024385",
+    "(error) SYNTAX invalid syntax",
+    "\"Some string\"",
+    "1) first => (integer) 1\n2) second => (integer) 2",
+    "1) orange\n2) apple",
+    "1) message\n2) news\n3) \"hello\"",
+    "\"world\"",
+};
+
+// @return dumps of the replies, "error" after a protocol error
+static std::vector<std::string> feed(RedisParser& parser, const std::vector<std::string>& chunks) {
+    std::vector<std::string> dumps;
+    parser.onReply = [&dumps](RedisReply* reply) {
+        dumps.push_back(reply->Dump());
+    };
+    for (const auto& chunk : chunks) {
+        if (parser.Feed(chunk.data(), chunk.size()) != 0) {
+            dumps.push_back("error");
+            break;
+        }
+    }
+    return dumps;
+}
+
+static std::vector<std::string> feed(const std::vector<std::string>& chunks) {
+    RedisParser parser;
+    return feed(parser, chunks);
+}
+
+static void test_types() {
+    std::vector<std::string> expected(s_dumps, s_dumps + ARRAY_SIZE(s_dumps));
+    std::vector<std::string> dumps = feed({s_stream});
+    CHECK(dumps == expected);
+    for (size_t i = 0; i < dumps.size() && i < expected.size(); ++i) {
+        if (dumps[i] != expected[i]) {
+            printf("reply %u: %s\n", (unsigned)i, dumps[i].c_str());
+        }
+    }
+}
+
+static void test_split() {
+    std::vector<std::string> expected(s_dumps, s_dumps + ARRAY_SIZE(s_dumps));
+    int failures = 0;
+    for (size_t i = 0; i <= s_stream.size(); ++i) {
+        // copies, so views into the first chunk dangle once it is freed
+        std::string* first = new std::string(s_stream.substr(0, i));
+        RedisParser parser;
+        std::vector<std::string> dumps;
+        parser.onReply = [&dumps](RedisReply* reply) {
+            dumps.push_back(reply->Dump());
+        };
+        int ret = parser.Feed(first->data(), first->size());
+        first->assign(first->size(), 'x');
+        delete first;
+        std::string second = s_stream.substr(i);
+        if (ret == 0) ret = parser.Feed(second.data(), second.size());
+        if (ret != 0 || dumps != expected) {
+            printf("split at %u failed\n", (unsigned)i);
+            ++failures;
+        }
+    }
+    CHECK(failures == 0);
+
+    std::vector<std::string> chunks;
+    for (size_t i = 0; i < s_stream.size(); ++i) {
+        chunks.push_back(s_stream.substr(i, 1));
+    }
+    CHECK(feed(chunks) == expected);
+    printf("split: %u offsets\n", (unsigned)s_stream.size() + 1);
+}
+
+static void test_attribute() {
+    // the reply after the attribute spans two reads
+    std::vector<std::string> dumps = feed({"|1\r\n+key-popularity\r\n+hello\r\n*2\r\n:1\r\n", ":2\r\n"});
+    CHECK(dumps.size() == 1 && dumps[0] == "1) (integer) 1\n2) (integer) 2");
+    dumps = feed({"|1\r\n+key\r\n$5\r\nvalue\r\n*2\r\n$1\r\na\r\n", "$1\r\nb\r\n"});
+    CHECK(dumps.size() == 1 && dumps[0] == "1) \"a\"\n2) \"b\"");
+    // attribute inside an aggregate
+    dumps = feed({"*2\r\n:1\r\n|1\r\n+ttl\r\n:3600\r\n+two\r\n"});
+    CHECK(dumps.size() == 1 && dumps[0] == "1) (integer) 1\n2) two");
+    // attribute spanning reads
+    dumps = feed({"|1\r\n+key\r\n$5\r\nva", "lue\r\n+OK\r\n"});
+    CHECK(dumps.size() == 1 && dumps[0] == "OK");
+}
+
+static void test_limits() {
+    RedisParser parser;
+    parser.max_bulk_len = 4;
+    CHECK(feed(parser, {"$4\r\nabcd\r\n"}) == std::vector<std::string>({"\"abcd\""}));
+    CHECK(feed(parser, {"$5\r\nabcde\r\n"}) == std::vector<std::string>({"error"}));
+
+    parser.max_elements = 2;
+    CHECK(feed(parser, {"*2\r\n:1\r\n:2\r\n"}).size() == 1);
+    CHECK(feed(parser, {"*3\r\n:1\r\n:2\r\n:3\r\n"}) == std::vector<std::string>({"error"}));
+    CHECK(feed(parser, {"%1\r\n:1\r\n:2\r\n"}).size() == 1);
+    CHECK(feed(parser, {"%2\r\n:1\r\n:2\r\n:3\r\n:4\r\n"}) == std::vector<std::string>({"error"}));
+
+    // type line in one read, and spanning reads without CRLF
+    parser.max_line_len = 16;
+    CHECK(feed(parser, {"+" + std::string(13, 's') + "\r\n"}).size() == 1);
+    CHECK(feed(parser, {"+" + std::string(14, 's') + "\r\n"}) == std::vector<std::string>({"error"}));
+    CHECK(feed(parser, {"+sss", std::string(13, 's'), "\r\n"}) == std::vector<std::string>({"error"}));
+    CHECK(feed(parser, {"+sss", std::string(100, 's')}) == std::vector<std::string>({"error"}));
+
+    parser.max_depth = 2;
+    CHECK(feed(parser, {"*1\r\n*1\r\n:1\r\n"}).size() == 1);
+    CHECK(feed(parser, {"*1\r\n*1\r\n*1\r\n:1\r\n"}) == std::vector<std::string>({"error"}));
+    CHECK(feed(parser, {"*1\r\n|1\r\n+a\r\n+b\r\n:1\r\n"}).size() == 1);
+    CHECK(feed(parser, {"*1\r\n*1\r\n|1\r\n+a\r\n+b\r\n:1\r\n"}) == std::vector<std::string>({"error"}));
+
+    // reset after the error
+    CHECK(feed(parser, {"+OK\r\n"}) == std::vector<std::string>({"OK"}));
+}
+
+int main() {
+    test_types();
+    test_split();
+    test_attribute();
+    test_limits();
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed;
+}
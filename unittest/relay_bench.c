@@ -0,0 +1,198 @@
+/*
+ * hio_setup_relay benchmark
+ *
+ * @build   make unittest
+ * @run     bin/relay_bench [connections] [MB]
+ *
+ * client => [ proxy loop ] => sink over loopback tcp connections:
+ * a thread writes to all clients round-robin, a thread drains all sinks,
+ * the loop relays them by:
+ * - upstream:  hio_setup_upstream + hio_write_upstream, as hio_setup_tcp_upstream does.
+ * - copy:      hio_setup_relay(io1, io2, 0)
+ * - splice:    hio_setup_relay(io1, io2, 1)
+ * and prints throughput with the cpu time of the loop thread.
+ *
+ */
+
+#include "hloop.h"
+#include "hsocket.h"
+#include "hthread.h"
+#include "htime.h"
+
+#ifdef OS_UNIX
+#include <poll.h>
+#endif
+
+#define CHUNK_SIZE  (64 * 1024)
+
+enum relay_mode {
+    RELAY_UPSTREAM,
+    RELAY_COPY,
+    RELAY_SPLICE,
+};
+
+typedef struct bench_s {
+    hloop_t*    loop;
+    int         conns;
+    int*        client_fds;
+    int*        sink_fds;
+    uint64_t    per_conn;   // bytes
+    uint64_t    total;
+    uint64_t    done;
+    char*       chunk;
+} bench_t;
+
+static bench_t s_bench;
+
+static int connect_pairs(hloop_t* loop, hio_t** ios) {
+    int listenfd = Listen(0, "127.0.0.1");
+    if (listenfd < 0) return -1;
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(listenfd, &addr.sa, &addrlen);
+    int port = ntohs(addr.sin.sin_port);
+    for (int i = 0; i < s_bench.conns; ++i) {
+        // client => proxy
+        s_bench.client_fds[i] = Connect("127.0.0.1", port, 0);
+        int fd1 = accept(listenfd, NULL, NULL);
+        // proxy => sink
+        int fd2 = Connect("127.0.0.1", port, 0);
+        s_bench.sink_fds[i] = accept(listenfd, NULL, NULL);
+        if (s_bench.client_fds[i] < 0 || fd1 < 0 || fd2 < 0 || s_bench.sink_fds[i] < 0) return -1;
+        ios[2 * i] = hio_get(loop, fd1);
+        ios[2 * i + 1] = hio_get(loop, fd2);
+    }
+    closesocket(listenfd);
+    return 0;
+}
+
+static HTHREAD_ROUTINE(writer_thread) {
+    for (uint64_t written = 0; written < s_bench.per_conn; written += CHUNK_SIZE) {
+        for (int i = 0; i < s_bench.conns; ++i) {
+            if (send(s_bench.client_fds[i], s_bench.chunk, CHUNK_SIZE, 0) != CHUNK_SIZE) return 0;
+        }
+    }
+    return 0;
+}
+
+static HTHREAD_ROUTINE(reader_thread) {
+#ifdef OS_UNIX
+    struct pollfd* pfds = (struct pollfd*)malloc(sizeof(struct pollfd) * s_bench.conns);
+    for (int i = 0; i < s_bench.conns; ++i) {
+        pfds[i].fd = s_bench.sink_fds[i];
+        pfds[i].events = POLLIN;
+    }
+    char* buf = (char*)malloc(CHUNK_SIZE);
+    while (s_bench.done < s_bench.total) {
+        if (poll(pfds, s_bench.conns, 1000) <= 0) break;
+        for (int i = 0; i < s_bench.conns; ++i) {
+            if (pfds[i].revents == 0) continue;
+            int n = recv(pfds[i].fd, buf, CHUNK_SIZE, 0);
+            if (n <= 0) goto end;
+            s_bench.done += n;
+        }
+    }
+end:
+    free(buf);
+    free(pfds);
+#endif
+    hloop_stop(s_bench.loop);
+    return 0;
+}
+
+static uint64_t thread_cputime_us() {
+#ifdef OS_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+#else
+    return 0;
+#endif
+}
+
+static void run(const char* name, int mode, int flags) {
+    hloop_t* loop = hloop_new(flags);
+    s_bench.loop = loop;
+    hio_t** ios = (hio_t**)malloc(sizeof(hio_t*) * s_bench.conns * 2);
+    hrelay_t** relays = (hrelay_t**)calloc(s_bench.conns, sizeof(hrelay_t*));
+    if (connect_pairs(loop, ios) != 0) {
+        printf("connect failed!\n");
+        exit(1);
+    }
+    s_bench.done = 0;
+    for (int i = 0; i < s_bench.conns; ++i) {
+        hio_t* io1 = ios[2 * i];
+        hio_t* io2 = ios[2 * i + 1];
+        if (mode == RELAY_UPSTREAM) {
+            hio_setup_upstream(io1, io2);
+            hio_setcb_read(io1, hio_write_upstream);
+            hio_setcb_read(io2, hio_write_upstream);
+            hio_setcb_close(io1, hio_close_upstream);
+            hio_setcb_close(io2, hio_close_upstream);
+            hio_read_upstream(io1);
+        } else {
+            relays[i] = hio_setup_relay(io1, io2, mode == RELAY_SPLICE);
+        }
+    }
+    uint64_t start_us = gethrtime_us();
+    uint64_t start_cpu_us = thread_cputime_us();
+    hthread_t writer = hthread_create(writer_thread, NULL);
+    hthread_t reader = hthread_create(reader_thread, NULL);
+    hloop_run(loop);
+    uint64_t cpu_us = thread_cputime_us() - start_cpu_us;
+    uint64_t us = gethrtime_us() - start_us;
+    hthread_join(writer);
+    hthread_join(reader);
+
+    int spliced = 0;
+    uint64_t relayed = 0;
+    for (int i = 0; i < s_bench.conns; ++i) {
+        if (relays[i] == NULL) continue;
+        hrelay_stats_t stats;
+        hrelay_get_stats(relays[i], &stats);
+        spliced += stats.spliced;
+        relayed += stats.bytes[0];
+    }
+    if (mode != RELAY_UPSTREAM && relayed != s_bench.done) {
+        printf("relayed %llu bytes, but %llu received!\n", (unsigned long long)relayed, (unsigned long long)s_bench.done);
+    }
+    for (int i = 0; i < s_bench.conns; ++i) {
+        closesocket(s_bench.client_fds[i]);
+        closesocket(s_bench.sink_fds[i]);
+    }
+    hloop_free(&loop);
+
+    double mb = (double)s_bench.done / (1 << 20);
+    printf("%-12s %10.2f %10.1f %12.1f %8d\n", name,
+            us ? (double)s_bench.done / us : 0,
+            us ? cpu_us * 100.0 / us : 0,
+            mb ? cpu_us / 1000.0 / mb * 1024 : 0,
+            spliced);
+    free(relays);
+    free(ios);
+}
+
+int main(int argc, char** argv) {
+    s_bench.conns = argc > 1 ? atoi(argv[1]) : 16;
+    uint64_t total_mb = argc > 2 ? atoi(argv[2]) : 1024;
+    s_bench.per_conn = (total_mb << 20) / s_bench.conns / CHUNK_SIZE * CHUNK_SIZE;
+    if (s_bench.per_conn == 0) s_bench.per_conn = CHUNK_SIZE;
+    s_bench.total = s_bench.per_conn * s_bench.conns;
+    s_bench.client_fds = (int*)malloc(sizeof(int) * s_bench.conns);
+    s_bench.sink_fds = (int*)malloc(sizeof(int) * s_bench.conns);
+    s_bench.chunk = (char*)malloc(CHUNK_SIZE);
+    memset(s_bench.chunk, 'x', CHUNK_SIZE);
+
+    printf("%d connections, %d MB, cpu=loop thread cpu time\n", s_bench.conns, (int)(s_bench.total >> 20));
+    printf("%-12s %10s %10s %12s %8s\n", "mode", "MB/s", "cpu%", "cpu ms/GB", "spliced");
+    run("upstream",     RELAY_UPSTREAM, 0);
+    run("copy",         RELAY_COPY,     0);
+    run("splice",       RELAY_SPLICE,   0);
+    run("copy/ET",      RELAY_COPY,     HLOOP_FLAG_EDGE_TRIGGERED);
+    run("splice/ET",    RELAY_SPLICE,   HLOOP_FLAG_EDGE_TRIGGERED);
+
+    free(s_bench.chunk);
+    free(s_bench.client_fds);
+    free(s_bench.sink_fds);
+    return 0;
+}
@@ -0,0 +1,310 @@
+/*
+ * ServiceDiscovery test
+ *
+ * @build   make unittest
+ * @run     bin/service_discovery_test
+ *
+ * A fake consul registry is written with HttpServer, it supports blocking queries:
+ * GET /v1/health/service/:name?index=&wait= is held until the service changes, or wait timeout.
+ * - consul: watch "web" bound to an upstream group, register and deregister instances,
+ *           reader threads Get and Select all the time,
+ *           registry failures keep the last instances.
+ * - file:   watch a JSON file, rewrite it.
+ *
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <list>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "HttpServer.h"
+#include "requests.h"
+#include "ServiceDiscovery.h"
+
+#include "hfile.h"
+#include "hsocket.h"
+#include "htime.h"
+
+#include "unittest.h"
+
+using namespace hv;
+
+#define WAIT_MS     2000
+
+//-----------------fake registry---------------------------------------------
+// NOTE: one worker thread, so no lock needed except for the counters.
+class FakeRegistry {
+public:
+    struct Waiter {
+        HttpContextPtr  ctx;
+        std::string     service;
+        TimerID         timerID;
+    };
+
+    FakeRegistry() : index(1), failing(false), queries(0), blocked(0) {
+        service.enable_access_log = 0;
+        service.GET("/v1/health/service/:name", [this](const HttpContextPtr& ctx) {
+            return onQuery(ctx);
+        });
+        service.PUT("/v1/agent/service/register", [this](const HttpContextPtr& ctx) {
+            Json jservice = Json::parse(ctx->body());
+            services[jservice["Name"].get<std::string>()][jservice["ID"].get<std::string>()] = jservice;
+            change();
+            return ctx->send("{}");
+        });
+        service.PUT("/v1/agent/service/deregister/:id", [this](const HttpContextPtr& ctx) {
+            std::string id = ctx->param("id");
+            for (auto& pair : services) {
+                pair.second.erase(id);
+            }
+            change();
+            return ctx->send("{}");
+        });
+        service.PUT("/fail/:on", [this](const HttpContextPtr& ctx) {
+            failing = ctx->param("on") == "1";
+            if (failing) change();
+            return ctx->send("{}");
+        });
+        server.registerHttpService(&service);
+        server.setListenFD(listen_any(&port));
+        server.setThreadNum(1);
+        server.start();
+    }
+
+    int onQuery(const HttpContextPtr& ctx) {
+        ++queries;
+        std::string name = ctx->param("name");
+        uint64_t req_index = strtoull(ctx->param("index", "0").c_str(), NULL, 10);
+        if (req_index != 0 && req_index == index && !failing) {
+            // blocking query
+            ++blocked;
+            int wait_ms = atoi(ctx->param("wait", "1000").c_str());
+            waiters.emplace_back();
+            Waiter& waiter = waiters.back();
+            waiter.ctx = ctx;
+            waiter.service = name;
+            HttpContextPtr held = ctx;
+            waiter.timerID = setTimeout(wait_ms, [this, held](TimerID timerID) {
+                for (auto iter = waiters.begin(); iter != waiters.end(); ++iter) {
+                    if (iter->ctx == held) {
+                        reply(iter->ctx, iter->service);
+                        waiters.erase(iter);
+                        break;
+                    }
+                }
+            });
+            return HTTP_STATUS_UNFINISHED;
+        }
+        return reply(ctx, name);
+    }
+
+    int reply(const HttpContextPtr& ctx, const std::string& name) {
+        if (failing) {
+            ctx->setStatus(HTTP_STATUS_INTERNAL_SERVER_ERROR);
+            return ctx->send("registry failure", TEXT_PLAIN);
+        }
+        Json jentries = Json::array();
+        for (const auto& pair : services[name]) {
+            const Json& jservice = pair.second;
+            Json jentry;
+            jentry["Node"]["Node"] = "node1";
+            jentry["Node"]["Address"] = "127.0.0.1";
+            jentry["Service"]["ID"] = jservice["ID"];
+            jentry["Service"]["Service"] = name;
+            jentry["Service"]["Address"] = jservice.value("Address", "");
+            jentry["Service"]["Port"] = jservice["Port"];
+            if (jservice.contains("Weights")) {
+                jentry["Service"]["Weights"] = jservice["Weights"];
+            }
+            jentries.push_back(jentry);
+        }
+        ctx->setHeader("X-Consul-Index", hv::to_string(index));
+        return ctx->send(jentries.dump());
+    }
+
+    void change() {
+        ++index;
+        for (auto& waiter : waiters) {
+            killTimer(waiter.timerID);
+            reply(waiter.ctx, waiter.service);
+        }
+        waiters.clear();
+    }
+
+    HttpService         service;
+    HttpServer          server;
+    int                 port;
+    // name => id => service
+    std::map<std::string, std::map<std::string, Json>> services;
+    uint64_t            index;
+    bool                failing;
+    std::list<Waiter>   waiters;
+    std::atomic<int>    queries;
+    std::atomic<int>    blocked;
+};
+
+//-----------------test---------------------------------------------
+// @retval ms waited, -1 if timeout
+static int wait_instances(ServiceDiscovery* discovery, const char* service, size_t n, int timeout_ms = 3000) {
+    uint64_t start_ms = gethrtime_us() / 1000;
+    while (1) {
+        ServiceInstancesPtr instances = discovery->Get(service);
+        int elapsed_ms = gethrtime_us() / 1000 - start_ms;
+        if (instances && instances->size() == n) return elapsed_ms;
+        if (elapsed_ms > timeout_ms) return -1;
+        hv_msleep(1);
+    }
+}
+
+static int registry_put(int port, const std::string& path, const std::string& body = "") {
+    std::string url = "http://127.0.0.1:" + hv::to_string(port) + path;
+    auto resp = requests::put(url.c_str(), body);
+    return resp ? resp->status_code : -1;
+}
+
+static void register_web(int port, const char* id, int web_port, int weight) {
+    Json jservice;
+    jservice["ID"] = id;
+    jservice["Name"] = "web";
+    jservice["Address"] = "127.0.0.1";
+    jservice["Port"] = web_port;
+    jservice["Weights"]["Passing"] = weight;
+    registry_put(port, "/v1/agent/service/register", jservice.dump());
+}
+
+static void test_consul() {
+    FakeRegistry registry;
+    register_web(registry.port, "web1", 8001, 1);
+
+    HttpService service;
+    UpstreamGroupPtr upstream = service.Upstream("web");
+    std::string url = "http://127.0.0.1:" + hv::to_string(registry.port);
+    ServiceDiscovery discovery(std::make_shared<ConsulDiscoveryBackend>(url.c_str()));
+    discovery.wait_ms = WAIT_MS;
+    discovery.retry_interval = 50;
+    discovery.BindUpstream("web", upstream);
+    std::atomic<int> updates(0);
+    discovery.Watch("web", [&updates](const std::string& name, const ServiceInstancesPtr& instances) {
+        ++updates;
+    });
+    discovery.Start();
+
+    int ms = wait_instances(&discovery, "web", 1);
+    printf("consul: 1 instance in %dms\n", ms);
+    CHECK(ms >= 0);
+    UpstreamServerPtr web1 = upstream->Select();
+    CHECK(web1 && web1->port == 8001);
+
+    // readers on other threads
+    std::atomic<bool> running(true);
+    std::atomic<long> reads(0), misses(0);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&]() {
+            while (running) {
+                ServiceInstancesPtr instances = discovery.Get("web");
+                UpstreamServerPtr server = upstream->Select();
+                if (instances == NULL || instances->empty() || server == NULL) ++misses;
+                ++reads;
+            }
+        });
+    }
+
+    // register: pushed by the blocking query at once
+    register_web(registry.port, "web2", 8002, 3);
+    ms = wait_instances(&discovery, "web", 2);
+    printf("consul: 2 instances in %dms\n", ms);
+    CHECK(ms >= 0 && ms < WAIT_MS / 2);
+    CHECK(upstream->Servers()->servers.size() == 2);
+    // kept the state of web1
+    bool kept = false;
+    for (const auto& server : upstream->Servers()->servers) {
+        if (server == web1) kept = true;
+    }
+    CHECK(kept);
+    int n8002 = 0;
+    for (int i = 0; i < 400; ++i) {
+        if (upstream->Select()->port == 8002) ++n8002;
+    }
+    // weight 3:1, readers Select too
+    CHECK(n8002 > 250 && n8002 < 350);
+
+    // registry failure: keep the last instances
+    registry_put(registry.port, "/fail/1");
+    hv_msleep(200);
+    ServiceInstancesPtr instances = discovery.Get("web");
+    CHECK(instances && instances->size() == 2);
+    CHECK(upstream->Servers()->servers.size() == 2);
+    registry_put(registry.port, "/fail/0");
+
+    // deregister
+    registry_put(registry.port, "/v1/agent/service/deregister/web1");
+    ms = wait_instances(&discovery, "web", 1);
+    printf("consul: 1 instance in %dms after recovery\n", ms);
+    CHECK(ms >= 0);
+    CHECK(discovery.Get("web")->at(0).port == 8002);
+    CHECK(upstream->Select()->port == 8002);
+    // a snapshot stays valid while held
+    CHECK(instances->size() == 2);
+
+    // idle: blocking queries return after wait
+    int queries = registry.queries;
+    hv_msleep(WAIT_MS + 500);
+    int idle_queries = registry.queries - queries;
+    printf("consul: %d queries in %dms idle\n", idle_queries, WAIT_MS + 500);
+    CHECK(idle_queries <= 2);
+
+    running = false;
+    for (auto& reader : readers) reader.join();
+    printf("consul: reads=%ld misses=%ld updates=%d queries=%d blocked=%d\n",
+            reads.load(), misses.load(), updates.load(), registry.queries.load(), registry.blocked.load());
+    CHECK(misses == 0);
+    CHECK(updates == 3);
+    discovery.Stop();
+    registry.server.stop();
+}
+
+static void write_file(const char* filepath, const char* content) {
+    HFile file;
+    file.open(filepath, "wb");
+    file.write(content, strlen(content));
+    file.close();
+}
+
+static void test_file() {
+    const char* filepath = "service_discovery_test.json";
+    write_file(filepath, R"({ "web": [ { "address": "127.0.0.1", "port": 8001 } ] })");
+    ServiceDiscovery discovery(std::make_shared<FileDiscoveryBackend>(filepath, 20));
+    discovery.wait_ms = WAIT_MS;
+    discovery.Watch("web");
+    discovery.Watch("none");
+    discovery.Start();
+    int ms = wait_instances(&discovery, "web", 1);
+    printf("file: 1 instance in %dms\n", ms);
+    CHECK(ms >= 0);
+    CHECK(wait_instances(&discovery, "none", 0) >= 0);
+
+    write_file(filepath, R"({ "web": [ { "address": "127.0.0.1", "port": 8001 },
+                                       { "address": "127.0.0.1", "port": 8002, "weight": 2, "tags": ["v2"] } ] })");
+    ms = wait_instances(&discovery, "web", 2);
+    printf("file: 2 instances in %dms\n", ms);
+    CHECK(ms >= 0);
+    ServiceInstancesPtr instances = discovery.Get("web");
+    CHECK(instances->at(1).weight == 2 && instances->at(1).tags.size() == 1);
+
+    // removed: keep the last instances
+    remove(filepath);
+    hv_msleep(100);
+    CHECK(discovery.Get("web")->size() == 2);
+    discovery.Stop();
+}
+
+int main(int argc, char** argv) {
+    test_consul();
+    test_file();
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed;
+}
@@ -0,0 +1,104 @@
+/*
+ * HttpSharedStats test
+ *
+ * @build   make unittest
+ * @run     bin/shared_stats_test
+ *
+ * Forked processes take tokens from the same buckets concurrently,
+ * the total taken must equal the burst, then the buckets refill.
+ *
+ */
+
+#include <stdio.h>
+#include <string>
+
+#include "HttpSharedStats.h"
+
+#include "hplatform.h"
+#include "hdef.h"
+#include "htime.h"
+
+#include "unittest.h"
+
+#ifdef OS_UNIX
+#include <sys/wait.h>
+#endif
+
+using namespace hv;
+
+#define NPROCS      4
+#define NKEYS       100
+#define BURST       1000
+#define TRIES       (BURST * 2 / NPROCS)
+
+static std::string key_of(int i) {
+    return "10.0.0." + std::to_string(i);
+}
+
+// @return tokens taken
+static int take(double rate) {
+    int taken = 0;
+    for (int n = 0; n < TRIES; ++n) {
+        for (int i = 0; i < NKEYS; ++i) {
+            if (HttpSharedStats::RateLimit(key_of(i), rate, BURST)) ++taken;
+        }
+    }
+    return taken;
+}
+
+int main() {
+    int ret = HttpSharedStats::Init(1024);
+    if (ret != 0) {
+        printf("HttpSharedStats::Init failed: %d\n", ret);
+        return -1;
+    }
+
+#ifdef OS_UNIX
+    int total = 0;
+    int fds[NPROCS][2];
+    for (int i = 0; i < NPROCS; ++i) {
+        if (pipe(fds[i]) != 0) return -1;
+        if (fork() == 0) {
+            HttpSharedStats::OnAccept();
+            int taken = take(0);
+            if (write(fds[i][1], &taken, sizeof(taken)) != sizeof(taken)) _exit(1);
+            _exit(0);
+        }
+    }
+    for (int i = 0; i < NPROCS; ++i) {
+        int taken = 0;
+        if (read(fds[i][0], &taken, sizeof(taken)) != sizeof(taken)) return -1;
+        total += taken;
+        wait(NULL);
+    }
+    printf("%d processes took %d tokens of %d keys, burst=%d\n", NPROCS, total, NKEYS, BURST);
+    CHECK(total == NKEYS * BURST);
+    CHECK(HttpSharedStats::Connections() == NPROCS);
+#endif
+
+    // refill: 100 tokens per second
+    uint64_t drain_begin_us = gethrtime_us();
+    bool drained = HttpSharedStats::RateLimit("refill", 100, 10, 10);
+    CHECK(drained);
+    bool limited = !HttpSharedStats::RateLimit("refill", 100, 10);
+    CHECK(limited);
+    uint64_t drain_end_us = gethrtime_us();
+    hv_msleep(50);
+    uint64_t take_begin_us = gethrtime_us();
+    int taken = 0;
+    while (HttpSharedStats::RateLimit("refill", 100, 10)) ++taken;
+    uint64_t take_end_us = gethrtime_us();
+    // NOTE: the sleep may oversleep, expect elapsed time * rate, 1 token tolerance for ms clock.
+    int min_taken = (int)((take_begin_us - drain_end_us) * 100 / 1000000) - 1;
+    int max_taken = (int)MIN((take_end_us - drain_begin_us) * 100 / 1000000 + 1, 10);
+    printf("refilled %d tokens in %dms, expect [%d, %d]\n", taken,
+            (int)((take_begin_us - drain_end_us) / 1000), min_taken, max_taken);
+    CHECK(taken >= min_taken && taken <= max_taken);
+
+    std::string out;
+    HttpSharedStats::Dump(out);
+    CHECK(out.find("hv_shared_rate_limit_keys") != std::string::npos);
+    HttpSharedStats::Cleanup();
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed;
+}
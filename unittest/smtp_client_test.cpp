@@ -0,0 +1,229 @@
+/*
+ * smtp_client test
+ *
+ * @build   make unittest
+ * @run     bin/smtp_client_test
+ *
+ * Stub SMTP servers are written with TcpServer:
+ * - pipelining: advertises PIPELINING, and holds the replies of MAIL and RCPT until DATA,
+ *               so a client waiting for them would time out.
+ * - plain:      no PIPELINING, rejects RCPT TO:<bad@...>.
+ * Mails are sent by smtp_client on the main loop, bodies are checked by the stub,
+ * lines starting with '.' included.
+ * At last mails to a closed port fail with ECONNREFUSED.
+ *
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <string>
+
+#include "TcpServer.h"
+#include "herr.h"
+#include "htime.h"
+
+#include "smtp_client.h"
+
+using namespace hv;
+
+#define NMAILS              200
+#define MAX_CONNECTIONS     2
+
+static const char* s_body = "Hello,\r\n.hidden line\r\n..two dots\r\nBye.";
+
+struct SmtpSession {
+    bool        data;
+    bool        rejected;   // RCPT is rejected
+    std::string held;       // replies held until DATA
+    std::string message;
+};
+
+class SmtpStub {
+public:
+    SmtpStub(bool pipelining) : pipelining(pipelining), connections(0), max_connections(0), accepted(0), bad_bodies(0) {
+        int listenfd = server.createsocket(0, "127.0.0.1");
+        sockaddr_u addr;
+        socklen_t addrlen = sizeof(addr);
+        getsockname(listenfd, &addr.sa, &addrlen);
+        port = ntohs(addr.sin.sin_port);
+        unpack_setting_t unpack;
+        unpack.mode = UNPACK_BY_DELIMITER;
+        unpack.package_max_length = DEFAULT_PACKAGE_MAX_LENGTH;
+        unpack.delimiter[0] = '\r';
+        unpack.delimiter[1] = '\n';
+        unpack.delimiter_bytes = 2;
+        server.setUnpack(&unpack);
+        server.onConnection = [this](const SocketChannelPtr& channel) {
+            if (channel->isConnected()) {
+                int n = ++connections;
+                if (n > max_connections) max_connections = n;
+                SmtpSession* session = channel->newContext<SmtpSession>();
+                session->data = false;
+                session->rejected = false;
+                tcp_nodelay(channel->fd(), 1);
+                channel->write("220 Ready\r\n");
+            } else {
+                --connections;
+                channel->deleteContext<SmtpSession>();
+            }
+        };
+        server.onMessage = [this](const SocketChannelPtr& channel, Buffer* buf) {
+            onLine(channel, std::string((char*)buf->data(), buf->size()));
+        };
+        server.start();
+    }
+
+    void onLine(const SocketChannelPtr& channel, const std::string& line) {
+        SmtpSession* session = channel->getContext<SmtpSession>();
+        if (session->data) {
+            if (line == ".\r\n") {
+                session->data = false;
+                // From:from\r\nTo:to\r\nSubject:subject\r\n\r\nbody
+                size_t pos = session->message.find("\r\n\r\n");
+                std::string body = pos == std::string::npos ? "" : session->message.substr(pos + 4);
+                if (body != std::string(s_body) + "\r\n") ++bad_bodies;
+                session->message.clear();
+                ++accepted;
+                channel->write("250 OK\r\n");
+            } else {
+                // dot-stuffing
+                session->message += line[0] == '.' ? line.substr(1) : line;
+            }
+            return;
+        }
+        std::string cmd = line.substr(0, 4);
+        std::string reply;
+        if (cmd == "EHLO") {
+            reply = pipelining ? "250-localhost\r\n250-PIPELINING\r\n250 AUTH PLAIN\r\n" : "500 Bad syntax\r\n";
+        } else if (cmd == "HELO") {
+            reply = "250 localhost\r\n";
+        } else if (cmd == "AUTH") {
+            reply = "235 Authentication success\r\n";
+        } else if (cmd == "MAIL") {
+            reply = "250 OK\r\n";
+        } else if (cmd == "RCPT") {
+            session->rejected = line.find("<bad@") != std::string::npos;
+            reply = session->rejected ? "550 No such user\r\n" : "250 OK\r\n";
+        } else if (cmd == "DATA") {
+            if (session->rejected) {
+                session->rejected = false;
+                reply = "554 No valid recipients\r\n";
+            } else {
+                session->data = true;
+                reply = "354 End with <CR><LF>.<CR><LF>\r\n";
+            }
+        } else if (cmd == "RSET") {
+            session->rejected = false;
+            reply = "250 OK\r\n";
+        } else if (cmd == "QUIT") {
+            channel->write("221 Bye\r\n");
+            channel->close();
+            return;
+        } else {
+            reply = "500 Bad syntax\r\n";
+        }
+        if (pipelining && (cmd == "MAIL" || cmd == "RCPT")) {
+            // NOTE: held until DATA, RFC 2920 allows the server to buffer replies.
+            session->held += reply;
+            return;
+        }
+        channel->write(session->held + reply);
+        session->held.clear();
+    }
+
+    TcpServer           server;
+    int                 port;
+    bool                pipelining;
+    std::atomic<int>    connections;
+    std::atomic<int>    max_connections;
+    std::atomic<int>    accepted;
+    std::atomic<int>    bad_bodies;
+};
+
+//-----------------test---------------------------------------------
+struct result_t {
+    int ok;
+    int rejected;   // 550, 554
+    int refused;    // ECONNREFUSED
+    int others;
+};
+
+static result_t s_result;
+static hloop_t* s_loop = NULL;
+
+static void on_sent(smtp_client_t* cli, int ret, void*) {
+    if (ret == 0) ++s_result.ok;
+    else if (ret == 550 || ret == 554) ++s_result.rejected;
+    else if (ret == ECONNREFUSED) ++s_result.refused;
+    else {
+        printf("unexpected ret=%d\n", ret);
+        ++s_result.others;
+    }
+    if (smtp_client_pending(cli) == 0) {
+        hloop_stop(s_loop);
+    }
+}
+
+// @param nbad: mails to bad@
+static result_t send_mails(int port, int nmails, int nbad, uint32_t* max_connections) {
+    memset(&s_result, 0, sizeof(s_result));
+    s_loop = hloop_new(0);
+    smtp_client_setting_t setting;
+    smtp_client_setting_init(&setting);
+    setting.host = "127.0.0.1";
+    setting.port = port;
+    setting.username = "user";
+    setting.password = "secret";
+    setting.max_connections = MAX_CONNECTIONS;
+    setting.timeout_ms = 3000;
+    smtp_client_t* cli = smtp_client_new(s_loop, &setting);
+    mail_t mail;
+    mail.from = (char*)"alert@example.com";
+    mail.subject = (char*)"test";
+    mail.body = (char*)s_body;
+    for (int i = 0; i < nmails; ++i) {
+        mail.to = (char*)(i < nbad ? "bad@example.com" : "ops@example.com");
+        smtp_client_send(cli, &mail, on_sent, NULL);
+    }
+    *max_connections = smtp_client_connections(cli);
+    hloop_run(s_loop);
+    smtp_client_free(cli);
+    hloop_free(&s_loop);
+    return s_result;
+}
+
+int main() {
+    SmtpStub pipelining_stub(true);
+    SmtpStub plain_stub(false);
+    hv_msleep(100);
+    int failed = 0;
+    uint32_t nconns = 0;
+
+    uint64_t start_us = gethrtime_us();
+    result_t r = send_mails(pipelining_stub.port, NMAILS, 10, &nconns);
+    printf("pipelining: ok=%d rejected=%d others=%d connections=%u/%d accepted=%d bad_bodies=%d %.1fms\n",
+            r.ok, r.rejected, r.others, nconns, pipelining_stub.max_connections.load(),
+            pipelining_stub.accepted.load(), pipelining_stub.bad_bodies.load(), (gethrtime_us() - start_us) / 1000.0);
+    if (r.ok != NMAILS - 10 || r.rejected != 10 || r.others ||
+        pipelining_stub.accepted != NMAILS - 10 || pipelining_stub.bad_bodies ||
+        pipelining_stub.max_connections > MAX_CONNECTIONS) ++failed;
+
+    start_us = gethrtime_us();
+    r = send_mails(plain_stub.port, NMAILS, 10, &nconns);
+    printf("plain:      ok=%d rejected=%d others=%d connections=%u/%d accepted=%d bad_bodies=%d %.1fms\n",
+            r.ok, r.rejected, r.others, nconns, plain_stub.max_connections.load(),
+            plain_stub.accepted.load(), plain_stub.bad_bodies.load(), (gethrtime_us() - start_us) / 1000.0);
+    if (r.ok != NMAILS - 10 || r.rejected != 10 || r.others ||
+        plain_stub.accepted != NMAILS - 10 || plain_stub.bad_bodies ||
+        plain_stub.max_connections > MAX_CONNECTIONS) ++failed;
+
+    int closed_port = plain_stub.port;
+    plain_stub.server.stop();
+    hv_msleep(100);
+    r = send_mails(closed_port, 10, 0, &nconns);
+    printf("refused:    refused=%d others=%d\n", r.refused, r.others);
+    if (r.refused != 10) ++failed;
+
+    printf("%s\n", failed ? "FAILED" : "OK");
+    return failed;
+}
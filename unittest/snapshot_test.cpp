@@ -0,0 +1,90 @@
+/*
+ * HSnapshot test
+ *
+ * @build   make unittest
+ * @run     bin/snapshot_test
+ *
+ * - store:   Load in the storing thread sees the new snapshot at once.
+ * - threads: readers never see the version go backwards while a writer stores,
+ *            and all see the last snapshot once the writer is done.
+ * - release: replaced snapshots and those of destroyed HSnapshots are released
+ *            by the next refresh of the thread cache.
+ *
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "hsnapshot.h"
+
+#include "unittest.h"
+
+#define WRITES  10000
+#define READERS 4
+
+struct Value {
+    int version;
+    Value(int version = 0) : version(version) {}
+};
+
+static void test_store() {
+    HSnapshot<Value> snapshot;
+    CHECK(snapshot.Load()->version == 0);
+    CHECK(snapshot.Load() == snapshot.Load());
+    snapshot.Store(std::make_shared<Value>(1));
+    CHECK(snapshot.Load()->version == 1);
+    CHECK(snapshot.Latest()->version == 1);
+}
+
+static void test_threads() {
+    HSnapshot<Value> snapshot;
+    std::atomic<bool> done(false);
+    std::atomic<int> backwards(0);
+    std::atomic<int> last(0);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < READERS; ++i) {
+        readers.emplace_back([&]() {
+            int version = 0;
+            while (!done) {
+                int current = snapshot.Load()->version;
+                if (current < version) ++backwards;
+                version = current;
+            }
+            if (snapshot.Load()->version == WRITES) ++last;
+        });
+    }
+    for (int i = 1; i <= WRITES; ++i) {
+        snapshot.Store(std::make_shared<Value>(i));
+    }
+    done = true;
+    for (auto& reader : readers) reader.join();
+    CHECK(backwards == 0);
+    CHECK(last == READERS);
+}
+
+static void test_release() {
+    std::weak_ptr<const Value> replaced;
+    std::weak_ptr<const Value> destroyed;
+    HSnapshot<Value> snapshot;
+    replaced = snapshot.Load();
+    {
+        HSnapshot<Value> other(std::make_shared<Value>(1));
+        destroyed = other.Load();
+    }
+    snapshot.Store(std::make_shared<Value>(1));
+    // cached by this thread until its next refresh
+    CHECK(!replaced.expired() && !destroyed.expired());
+    CHECK(snapshot.Load()->version == 1);
+    CHECK(replaced.expired() && destroyed.expired());
+}
+
+int main() {
+    test_store();
+    test_threads();
+    test_release();
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed;
+}
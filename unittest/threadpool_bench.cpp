@@ -0,0 +1,181 @@
+/*
+ * HThreadPool microbenchmark
+ *
+ * @build   make unittest
+ * @run     bin/threadpool_bench [tasks] [producers]
+ *
+ * Compares HThreadPool (work-stealing) with a pool of one mutex-protected queue,
+ * which is what HThreadPool used to be, at 1..64 threads:
+ * - inject: producers outside the pool (like io loops) post small tasks.
+ * - spawn:  tasks post subtasks from inside the pool (fan-out).
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <queue>
+
+#include "hthreadpool.h"
+#include "htime.h"
+
+// single queue + mutex + condition_variable, packaged_task + shared_ptr per task.
+class MutexThreadPool {
+public:
+    explicit MutexThreadPool(int thread_num) : stopped(false), running(0) {
+        for (int i = 0; i < thread_num; ++i) {
+            threads.emplace_back([this] {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> locker(task_mutex);
+                        task_cond.wait(locker, [this]() {
+                            return stopped || !tasks.empty();
+                        });
+                        if (stopped && tasks.empty()) return;
+                        task = std::move(tasks.front());
+                        tasks.pop();
+                        ++running;
+                    }
+                    task();
+                    --running;
+                }
+            });
+        }
+    }
+    ~MutexThreadPool() {
+        {
+            std::lock_guard<std::mutex> locker(task_mutex);
+            stopped = true;
+        }
+        task_cond.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    template<class Fn>
+    std::future<void> commit(Fn&& fn) {
+        auto task = std::make_shared<std::packaged_task<void()> >(std::forward<Fn>(fn));
+        std::future<void> future = task->get_future();
+        {
+            std::lock_guard<std::mutex> locker(task_mutex);
+            tasks.emplace([task]{
+                (*task)();
+            });
+        }
+        task_cond.notify_one();
+        return future;
+    }
+    template<class Fn>
+    void post(Fn&& fn) {
+        commit(std::forward<Fn>(fn));
+    }
+
+    void wait() {
+        while (true) {
+            {
+                std::lock_guard<std::mutex> locker(task_mutex);
+                if (tasks.empty() && running == 0) break;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    bool                                stopped;
+    std::atomic<int>                    running;
+    std::vector<std::thread>            threads;
+    std::queue<std::function<void()> >  tasks;
+    std::mutex                          task_mutex;
+    std::condition_variable             task_cond;
+};
+
+static void work() {
+    volatile unsigned int x = 0;
+    for (int i = 0; i < 100; ++i) {
+        x = x * 31 + i;
+    }
+}
+
+template<class Pool>
+static void inject(Pool& pool, int tasks, int producers, bool use_post) {
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&pool, tasks, producers, use_post]() {
+            for (int i = 0; i < tasks / producers; ++i) {
+                if (use_post) {
+                    pool.post(work);
+                } else {
+                    pool.commit(work);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    pool.wait();
+}
+
+template<class Pool>
+static void spawn(Pool& pool, int tasks) {
+    // each root task posts 64 children
+    int roots = tasks / 64;
+    for (int i = 0; i < roots; ++i) {
+        pool.post([&pool]() {
+            for (int j = 0; j < 64; ++j) {
+                pool.post(work);
+            }
+        });
+    }
+    pool.wait();
+}
+
+static double rate(int tasks, uint64_t start_us) {
+    uint64_t us = gethrtime_us() - start_us;
+    return us ? (double)tasks / us : 0;
+}
+
+int main(int argc, char** argv) {
+    int tasks = argc > 1 ? atoi(argv[1]) : 1000000;
+    int producers = argc > 2 ? atoi(argv[2]) : 4;
+    printf("%d tasks, %d producers, Mtasks/s\n", tasks, producers);
+    printf("%8s %14s %14s %14s %14s %14s\n", "threads",
+            "mutex:inject", "ws:commit", "ws:post", "mutex:spawn", "ws:spawn");
+    for (int thread_num = 1; thread_num <= 64; thread_num *= 2) {
+        double results[5];
+        uint64_t start_us;
+        {
+            MutexThreadPool pool(thread_num);
+            start_us = gethrtime_us();
+            inject(pool, tasks, producers, false);
+            results[0] = rate(tasks, start_us);
+        }
+        {
+            HThreadPool pool(thread_num, thread_num);
+            pool.start();
+            start_us = gethrtime_us();
+            inject(pool, tasks, producers, false);
+            results[1] = rate(tasks, start_us);
+            start_us = gethrtime_us();
+            inject(pool, tasks, producers, true);
+            results[2] = rate(tasks, start_us);
+        }
+        {
+            MutexThreadPool pool(thread_num);
+            start_us = gethrtime_us();
+            spawn(pool, tasks);
+            results[3] = rate(tasks, start_us);
+        }
+        {
+            HThreadPool pool(thread_num, thread_num);
+            pool.start();
+            start_us = gethrtime_us();
+            spawn(pool, tasks);
+            results[4] = rate(tasks, start_us);
+        }
+        printf("%8d %14.2f %14.2f %14.2f %14.2f %14.2f\n", thread_num,
+                results[0], results[1], results[2], results[3], results[4]);
+    }
+    return 0;
+}
@@ -26,5 +26,13 @@ int main(int argc, char** argv) {
 
     tp.wait();
 
+    // workers are allocated by start, more threads need restart
+    int ret = tp.setMaxThreadNum(8);
+    printf("setMaxThreadNum(8) => %d, max_thread_num=%d\n", ret, tp.max_thread_num);
+    tp.stop();
+    ret = tp.setMaxThreadNum(8);
+    printf("setMaxThreadNum(8) => %d, max_thread_num=%d\n", ret, tp.max_thread_num);
+    tp.start();
+
     return 0;
 }
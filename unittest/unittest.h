@@ -0,0 +1,36 @@
+#ifndef HV_UNITTEST_H_
+#define HV_UNITTEST_H_
+
+/*
+ * Helpers shared by the self-checking tests:
+ * CHECK(cond) prints the failed condition and counts it in s_failed,
+ * main prints OK or FAILED and returns s_failed.
+ *
+ */
+
+#include <stdio.h>
+
+#include "hsocket.h"
+
+static int s_failed = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++s_failed; \
+        } \
+    } while (0)
+
+// listen on 127.0.0.1 with a port picked by the system
+// @return listenfd, *port is the port picked
+static inline int listen_any(int* port) {
+    int listenfd = Listen(0, "127.0.0.1");
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(listenfd, &addr.sa, &addrlen);
+    *port = ntohs(addr.sin.sin_port);
+    return listenfd;
+}
+
+#endif // HV_UNITTEST_H_
@@ -0,0 +1,180 @@
+/*
+ * hio_set_unpack microbenchmark
+ *
+ * @build   make unittest
+ * @run     bin/unpack_bench [MB]
+ *
+ * A thread writes framed data into a socketpair as fast as it can,
+ * the loop unpacks it and counts packages, for each unpack mode:
+ * - fixed:     64 bytes packages
+ * - delimiter: CRLF lines of 16~128 bytes, and of 4K bytes
+ * - length:    2 bytes big-endian length + 16~128 bytes body, and 64K bytes body
+ *
+ */
+
+#include "hloop.h"
+#include "hsocket.h"
+#include "hthread.h"
+#include "htime.h"
+
+typedef struct bench_s {
+    const char*         name;
+    unpack_setting_t    setting;
+    char*               data;
+    int                 datalen;
+    int                 npackages;
+    // results
+    uint64_t            total_bytes;
+    uint64_t            read_bytes;
+    uint64_t            read_packages;
+    int                 error;
+} bench_t;
+
+static int s_fds[2];
+
+static HTHREAD_ROUTINE(writer_thread) {
+    bench_t* bench = (bench_t*)userdata;
+    uint64_t written = 0;
+    while (written < bench->total_bytes) {
+        int nwrite = write(s_fds[1], bench->data, bench->datalen);
+        if (nwrite != bench->datalen) break;
+        written += nwrite;
+    }
+    return 0;
+}
+
+static void on_read(hio_t* io, void* buf, int readbytes) {
+    bench_t* bench = (bench_t*)hevent_userdata(io);
+    const char* p = (const char*)buf;
+    // verify package
+    switch (bench->setting.mode) {
+    case UNPACK_BY_DELIMITER:
+        if (p[readbytes - 2] != '\r' || p[readbytes - 1] != '\n' || p[0] != '#') ++bench->error;
+        break;
+    case UNPACK_BY_LENGTH_FIELD:
+        if (((unsigned char)p[0] << 8 | (unsigned char)p[1]) + 2 != readbytes) ++bench->error;
+        break;
+    default:
+        if (readbytes != bench->setting.fixed_length || p[0] != '#') ++bench->error;
+        break;
+    }
+    ++bench->read_packages;
+    bench->read_bytes += readbytes;
+    if (bench->read_bytes >= bench->total_bytes) {
+        hloop_stop(hevent_loop(io));
+    }
+}
+
+static void run_bench(bench_t* bench) {
+    if (Socketpair(AF_UNIX, SOCK_STREAM, 0, s_fds) != 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    int bufsize = 1 << 20;
+    setsockopt(s_fds[0], SOL_SOCKET, SO_RCVBUF, (const char*)&bufsize, sizeof(int));
+    setsockopt(s_fds[1], SOL_SOCKET, SO_SNDBUF, (const char*)&bufsize, sizeof(int));
+    bench->total_bytes -= bench->total_bytes % bench->datalen;
+    bench->read_bytes = bench->read_packages = 0;
+    bench->error = 0;
+
+    hloop_t* loop = hloop_new(0);
+    hio_t* io = hio_get(loop, s_fds[0]);
+    hevent_set_userdata(io, bench);
+    hio_set_unpack(io, &bench->setting);
+    hio_setcb_read(io, on_read);
+    hio_read_start(io);
+
+    uint64_t start_us = gethrtime_us();
+    hthread_t th = hthread_create(writer_thread, bench);
+    hloop_run(loop);
+    uint64_t us = gethrtime_us() - start_us;
+    hthread_join(th);
+    hloop_free(&loop);
+    closesocket(s_fds[1]);
+
+    printf("%-16s %10.2f MB/s %10.2f Mpkg/s %s\n", bench->name,
+            us ? (double)bench->read_bytes / us : 0,
+            us ? (double)bench->read_packages / us : 0,
+            bench->error || bench->read_packages != bench->total_bytes / bench->datalen * bench->npackages ? "FAILED" : "");
+}
+
+// packages are concatenated up to about 1M
+static void fill(bench_t* bench, int min_body, int max_body) {
+    int cap = (1 << 20) + max_body + 16;
+    bench->data = (char*)malloc(cap);
+    bench->datalen = 0;
+    bench->npackages = 0;
+    unsigned int seed = 1;
+    while (bench->datalen < (1 << 20)) {
+        seed = seed * 1103515245 + 12345;
+        int body = min_body + (int)((seed >> 16) % (max_body - min_body + 1));
+        char* p = bench->data + bench->datalen;
+        switch (bench->setting.mode) {
+        case UNPACK_BY_DELIMITER:
+            memset(p, 'x', body);
+            p[0] = '#';
+            p[body] = '\r';
+            p[body + 1] = '\n';
+            bench->datalen += body + 2;
+            break;
+        case UNPACK_BY_LENGTH_FIELD:
+            p[0] = (char)(body >> 8);
+            p[1] = (char)(body & 0xFF);
+            memset(p + 2, 'x', body);
+            bench->datalen += body + 2;
+            break;
+        default:
+            memset(p, 'x', bench->setting.fixed_length);
+            p[0] = '#';
+            bench->datalen += bench->setting.fixed_length;
+            break;
+        }
+        ++bench->npackages;
+    }
+}
+
+int main(int argc, char** argv) {
+    uint64_t total_bytes = (uint64_t)(argc > 1 ? atoi(argv[1]) : 256) << 20;
+#ifdef SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    bench_t benches[5];
+    memset(benches, 0, sizeof(benches));
+    for (int i = 0; i < 5; ++i) {
+        benches[i].total_bytes = total_bytes;
+        benches[i].setting.package_max_length = DEFAULT_PACKAGE_MAX_LENGTH;
+    }
+
+    benches[0].name = "fixed/64";
+    benches[0].setting.mode = UNPACK_BY_FIXED_LENGTH;
+    benches[0].setting.fixed_length = 64;
+    fill(&benches[0], 0, 0);
+
+    benches[1].name = "delimiter/128";
+    benches[1].setting.mode = UNPACK_BY_DELIMITER;
+    strcpy((char*)benches[1].setting.delimiter, "\r\n");
+    benches[1].setting.delimiter_bytes = 2;
+    fill(&benches[1], 16, 128);
+    benches[2] = benches[1];
+    benches[2].name = "delimiter/4K";
+    fill(&benches[2], 4096, 4096);
+
+    benches[3].name = "length/128";
+    benches[3].setting.mode = UNPACK_BY_LENGTH_FIELD;
+    benches[3].setting.body_offset = 2;
+    benches[3].setting.length_field_offset = 0;
+    benches[3].setting.length_field_bytes = 2;
+    benches[3].setting.length_field_coding = ENCODE_BY_BIG_ENDIAN;
+    fill(&benches[3], 16, 128);
+    benches[4] = benches[3];
+    benches[4].name = "length/64K";
+    fill(&benches[4], 65000, 65000);
+
+    printf("%d MB per mode\n", (int)(total_bytes >> 20));
+    for (int i = 0; i < 5; ++i) {
+        run_bench(&benches[i]);
+        free(benches[i].data);
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * multipart/form-data upload benchmark
+ *
+ * @build   make unittest
+ * @run     bin/upload_bench [MB] [upload_dir]
+ *
+ * A client thread streams a multi-GB file part to HttpServer with upload_dir set,
+ * the handler checks the size of the temp file written by MultipartParser,
+ * and the peak RSS of the process must stay bounded, i.e. the body is never buffered.
+ *
+ */
+
+#include <stdio.h>
+#include <string>
+
+#include "HttpServer.h"
+
+#include "hsocket.h"
+#include "hthread.h"
+#include "htime.h"
+#include "hfile.h"
+
+using namespace hv;
+
+#define BOUNDARY        "----libhvUploadBench"
+#define CHUNK_SIZE      (64 * 1024)
+#define MAX_RSS_GROWTH  (64 << 20)  // bytes
+
+static int          s_port = 0;
+static uint64_t     s_file_size = 0;
+static std::string  s_response;
+
+// @return kB of VmRSS or VmHWM, 0 if unknown
+static long proc_status_kb(const char* field) {
+    long kb = 0;
+#ifdef OS_LINUX
+    FILE* fp = fopen("/proc/self/status", "r");
+    if (fp == NULL) return 0;
+    char line[256];
+    size_t len = strlen(field);
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, field, len) == 0 && line[len] == ':') {
+            kb = atol(line + len + 1);
+            break;
+        }
+    }
+    fclose(fp);
+#endif
+    return kb;
+}
+
+static HTHREAD_ROUTINE(upload_thread) {
+    int connfd = Connect("127.0.0.1", s_port, 0);
+    if (connfd < 0) return 0;
+    std::string head = "--" BOUNDARY "\r\n"
+        "Content-Disposition: form-data; name=\"file\"; filename=\"bench.bin\"\r\n"
+        "Content-Type: application/octet-stream\r\n\r\n";
+    std::string tail = "\r\n--" BOUNDARY "--\r\n";
+    uint64_t content_length = head.size() + s_file_size + tail.size();
+    char header[512];
+    int len = snprintf(header, sizeof(header),
+        "POST /upload HTTP/1.1\r\n"
+        "Host: 127.0.0.1:%d\r\n"
+        "Content-Type: multipart/form-data; boundary=" BOUNDARY "\r\n"
+        "Content-Length: %llu\r\n"
+        "Connection: close\r\n\r\n",
+        s_port, (unsigned long long)content_length);
+    send(connfd, header, len, 0);
+    send(connfd, head.data(), head.size(), 0);
+    char* chunk = (char*)malloc(CHUNK_SIZE);
+    memset(chunk, 'x', CHUNK_SIZE);
+    for (uint64_t sent = 0; sent < s_file_size; ) {
+        int n = (int)MIN((uint64_t)CHUNK_SIZE, s_file_size - sent);
+        n = send(connfd, chunk, n, 0);
+        if (n <= 0) break;
+        sent += n;
+    }
+    send(connfd, tail.data(), tail.size(), 0);
+    while ((len = recv(connfd, chunk, CHUNK_SIZE, 0)) > 0) {
+        s_response.append(chunk, len);
+    }
+    free(chunk);
+    closesocket(connfd);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int mb = argc > 1 ? atoi(argv[1]) : 2048;
+    s_file_size = (uint64_t)mb << 20;
+
+    HttpService service;
+    service.enable_access_log = 0;
+#ifdef OS_WIN
+    service.upload_dir = ".";
+#else
+    service.upload_dir = argc > 2 ? argv[2] : "/tmp";
+#endif
+    service.POST("/upload", [](const HttpContextPtr& ctx) {
+        const std::string& filepath = ctx->request->form["file"].filepath;
+        HFile file;
+        size_t filesize = file.open(filepath.c_str(), "rb") == 0 ? file.size() : 0;
+        return ctx->send(hv::to_string(filesize));
+    });
+    HttpServer server(&service);
+    int listenfd = Listen(0, "127.0.0.1");
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(listenfd, &addr.sa, &addrlen);
+    s_port = ntohs(addr.sin.sin_port);
+    server.setListenFD(listenfd);
+    server.setThreadNum(1);
+    server.start();
+
+    long start_rss_kb = proc_status_kb("VmRSS");
+    uint64_t start_us = gethrtime_us();
+    hthread_t thrd = hthread_create(upload_thread, NULL);
+    hthread_join(thrd);
+    uint64_t us = gethrtime_us() - start_us;
+    long peak_rss_kb = proc_status_kb("VmHWM");
+    server.stop();
+
+    bool ok = s_response.find("200 OK") != std::string::npos &&
+              s_response.find("\r\n\r\n" + hv::to_string(s_file_size)) != std::string::npos;
+    printf("upload %d MB to %s in %.2fs, %.2f MB/s\n", mb, service.upload_dir.c_str(),
+            us / 1e6, us ? (double)s_file_size / us : 0);
+    printf("rss: start=%ldkB peak=%ldkB\n", start_rss_kb, peak_rss_kb);
+    if (!ok) {
+        printf("upload failed: %s\n", s_response.c_str());
+        return 1;
+    }
+    if (peak_rss_kb && (peak_rss_kb - start_rss_kb) * 1024 > MAX_RSS_GROWTH) {
+        printf("peak rss grows more than %dMB!\n", MAX_RSS_GROWTH >> 20);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * UpstreamGroup test
+ *
+ * @build   make unittest
+ * @run     bin/upstream_test
+ *
+ * A reverse proxy HttpServer balances requests across local backend HttpServers,
+ * which answer GET /port with their own port:
+ * - rr:        round robin, weighted round robin.
+ * - hash:      consistent hash by path, stable when a server is added.
+ * - retry:     the first server refuses connections, the request is retried on the next one,
+ *              and the refused server is marked down.
+ * - health:    active health check marks a server down and back up,
+ *              probed once per interval no matter how many worker threads.
+ * - resolve:   CreateSocket fails fast for an unresolved host, which is then resolved on hv::async.
+ *
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "HttpServer.h"
+#include "requests.h"
+
+#include "hsocket.h"
+#include "htime.h"
+
+#include "unittest.h"
+
+using namespace hv;
+
+#define HEALTH_CHECK_INTERVAL   100 // ms
+
+static std::string local_url(int port) {
+    return "http://127.0.0.1:" + hv::to_string(port);
+}
+
+class Backend {
+public:
+    Backend() : healthy(true), health_checks(0) {
+        service.enable_access_log = 0;
+        service.GET("/port", [this](const HttpContextPtr& ctx) {
+            return ctx->send(hv::to_string(port));
+        });
+        service.GET("/health", [this](const HttpContextPtr& ctx) {
+            ++health_checks;
+            if (!healthy) ctx->setStatus(HTTP_STATUS_SERVICE_UNAVAILABLE);
+            return ctx->send(healthy ? "ok" : "down");
+        });
+        server.registerHttpService(&service);
+        server.setListenFD(listen_any(&port));
+        server.setThreadNum(1);
+        server.start();
+    }
+
+    HttpService         service;
+    HttpServer          server;
+    int                 port;
+    std::atomic<bool>   healthy;
+    std::atomic<int>    health_checks;
+};
+
+// @retval port of the backend, 0 if failed
+static int proxy_get(int proxy_port, const std::string& path) {
+    auto resp = requests::get((local_url(proxy_port) + path).c_str());
+    if (resp == NULL || resp->status_code != HTTP_STATUS_OK) return 0;
+    return atoi(resp->body.c_str());
+}
+
+static UpstreamServerPtr find_server(const UpstreamGroupPtr& group, int port) {
+    for (const auto& server : group->Servers()->servers) {
+        if (server->port == port) return server;
+    }
+    return NULL;
+}
+
+// @retval ms waited, -1 if timeout
+static int wait_healthy(const UpstreamServerPtr& server, bool healthy, int timeout_ms = 2000) {
+    uint64_t start_ms = gethrtime_us() / 1000;
+    while (1) {
+        int elapsed_ms = gethrtime_us() / 1000 - start_ms;
+        if (server->healthy == healthy) return elapsed_ms;
+        if (elapsed_ms > timeout_ms) return -1;
+        hv_msleep(10);
+    }
+}
+
+int main() {
+    Backend backends[3];
+    int port0 = backends[0].port, port1 = backends[1].port, port2 = backends[2].port;
+    int refused_port = 0;
+    closesocket(listen_any(&refused_port));
+
+    HttpService service;
+    service.enable_access_log = 0;
+    UpstreamGroupPtr rr = service.Upstream("rr");
+    UpstreamGroupPtr weighted = service.Upstream("weighted");
+    UpstreamGroupPtr hash = service.Upstream("hash", LB_UrlHash);
+    UpstreamGroupPtr retry = service.Upstream("retry");
+    UpstreamGroupPtr health = service.Upstream("health");
+    for (int i = 0; i < 3; ++i) {
+        rr->AddServer(local_url(backends[i].port).c_str());
+        hash->AddServer(local_url(backends[i].port).c_str());
+    }
+    weighted->AddServer(local_url(port0).c_str(), 3);
+    weighted->AddServer(local_url(port1).c_str(), 1);
+    retry->AddServer(local_url(refused_port).c_str(), 1, 1, 10000);
+    retry->AddServer(local_url(port0).c_str());
+    retry->retries = 1;
+    health->AddServer(local_url(port1).c_str());
+    health->AddServer(local_url(port2).c_str());
+    health->health_check_interval = HEALTH_CHECK_INTERVAL;
+    health->health_check_timeout = 1000;
+    health->health_check_path = "/health";
+    service.Proxy("/rr/", "http://rr/");
+    service.Proxy("/weighted/", "http://weighted/");
+    service.Proxy("/hash/", "http://hash/");
+    service.Proxy("/retry/", "http://retry/");
+    service.Proxy("/health/", "http://health/");
+
+    HttpServer proxy(&service);
+    int proxy_port = 0;
+    proxy.setListenFD(listen_any(&proxy_port));
+    proxy.setThreadNum(4);
+    proxy.start();
+
+    // round robin
+    std::map<int, int> hits;
+    for (int i = 0; i < 30; ++i) {
+        ++hits[proxy_get(proxy_port, "/rr/port")];
+    }
+    printf("rr: %d %d %d\n", hits[port0], hits[port1], hits[port2]);
+    CHECK(hits[port0] == 10 && hits[port1] == 10 && hits[port2] == 10);
+
+    // weighted round robin 3:1
+    hits.clear();
+    for (int i = 0; i < 40; ++i) {
+        ++hits[proxy_get(proxy_port, "/weighted/port")];
+    }
+    printf("weighted: %d %d\n", hits[port0], hits[port1]);
+    CHECK(hits[port0] == 30 && hits[port1] == 10);
+
+    // consistent hash: the same path goes to the same server
+    int first = proxy_get(proxy_port, "/hash/port");
+    CHECK(first != 0);
+    for (int i = 0; i < 10; ++i) {
+        CHECK(proxy_get(proxy_port, "/hash/port") == first);
+    }
+    std::vector<int> mapped;
+    hits.clear();
+    for (int i = 0; i < 3000; ++i) {
+        std::string key = "/key" + hv::to_string(i);
+        mapped.push_back(hash->Select(key.c_str())->port);
+        ++hits[mapped.back()];
+    }
+    printf("hash: %d %d %d\n", hits[port0], hits[port1], hits[port2]);
+    CHECK(hits[port0] > 300 && hits[port1] > 300 && hits[port2] > 300);
+    // add a server: keys only move to the new server
+    std::vector<std::pair<std::string, int>> urls;
+    for (int i = 0; i < 3; ++i) {
+        urls.emplace_back(local_url(backends[i].port), 1);
+    }
+    urls.emplace_back(local_url(refused_port), 1);
+    hash->SetServers(urls);
+    int moved = 0, misplaced = 0;
+    for (int i = 0; i < 3000; ++i) {
+        std::string key = "/key" + hv::to_string(i);
+        int port = hash->Select(key.c_str())->port;
+        if (port == mapped[i]) continue;
+        if (port == refused_port) ++moved;
+        else ++misplaced;
+    }
+    printf("hash: %d/3000 keys moved to the new server, %d misplaced\n", moved, misplaced);
+    CHECK(misplaced == 0);
+    CHECK(moved > 150 && moved < 1500);
+
+    // retry after a refused connect, then the refused server is down
+    for (int i = 0; i < 6; ++i) {
+        CHECK(proxy_get(proxy_port, "/retry/port") == port0);
+    }
+    UpstreamServerPtr refused = find_server(retry, refused_port);
+    CHECK(refused && !refused->IsAvailable(gethrtime_us() / 1000));
+
+    // active health check: down and back up
+    UpstreamServerPtr server2 = find_server(health, port2);
+    backends[2].healthy = false;
+    int ms = wait_healthy(server2, false);
+    printf("health: down in %dms\n", ms);
+    CHECK(ms >= 0);
+    for (int i = 0; i < 6; ++i) {
+        CHECK(proxy_get(proxy_port, "/health/port") == port1);
+    }
+    backends[2].healthy = true;
+    ms = wait_healthy(server2, true);
+    printf("health: up in %dms\n", ms);
+    CHECK(ms >= 0);
+    hits.clear();
+    for (int i = 0; i < 6; ++i) {
+        ++hits[proxy_get(proxy_port, "/health/port")];
+    }
+    CHECK(hits[port1] == 3 && hits[port2] == 3);
+    // probed once per interval, not once per worker thread
+    int checks = backends[1].health_checks;
+    hv_msleep(HEALTH_CHECK_INTERVAL * 10);
+    checks = backends[1].health_checks - checks;
+    printf("health: %d checks in %dms by %d worker threads\n", checks, HEALTH_CHECK_INTERVAL * 10, 4);
+    CHECK(checks >= 5 && checks <= 15);
+
+    // unresolved host: NULL at once, then resolved asynchronously and cached
+    hloop_t* loop = hloop_new(0);
+    UpstreamServerPtr unresolved = std::make_shared<UpstreamServer>();
+    unresolved->host = "localhost";
+    unresolved->port = port0;
+    CHECK(unresolved->CreateSocket(loop) == NULL);
+    for (int i = 0; i < 100 && !unresolved->resolved; ++i) hv_msleep(10);
+    hio_t* io = unresolved->CreateSocket(loop);
+    CHECK(io != NULL && sockaddr_port((sockaddr_u*)hio_peeraddr(io)) == port0);
+    hloop_free(&loop);
+
+    proxy.stop();
+    for (int i = 0; i < 3; ++i) {
+        backends[i].server.stop();
+    }
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed;
+}
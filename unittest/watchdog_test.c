@@ -0,0 +1,84 @@
+/*
+ * hloop watchdog test
+ *
+ * @build   make unittest
+ * @run     bin/watchdog_test
+ *
+ * Timer callbacks block the loop thread, busy not to sleep, with the watchdog enabled:
+ * - a callback shorter than stall_ms is not reported.
+ * - a callback longer than stall_ms is reported once, with its event type and
+ *   the stack of the loop thread on linux, and counted in metrics->stalls.
+ * - the resume is reported after the callback returns.
+ *
+ */
+
+#include <string.h>
+
+#include "hloop.h"
+#include "hbase.h"
+#include "hlog.h"
+#include "hmutex.h"
+#include "htime.h"
+
+#include "unittest.h"
+
+#define STALL_MS    50
+
+static hmutex_t s_log_mutex;
+static char     s_log[65536];
+static int      s_loglen = 0;
+
+static void on_log(int loglevel, const char* buf, int len) {
+    (void)loglevel;
+    hmutex_lock(&s_log_mutex);
+    if (s_loglen + len < (int)sizeof(s_log)) {
+        memcpy(s_log + s_loglen, buf, len);
+        s_loglen += len;
+        s_log[s_loglen] = '\0';
+    }
+    hmutex_unlock(&s_log_mutex);
+}
+
+static void block_ms(int ms) {
+    uint64_t end_us = gethrtime_us() + ms * 1000;
+    while (gethrtime_us() < end_us);
+}
+
+static void on_block(htimer_t* timer) {
+    block_ms((int)(intptr_t)hevent_userdata(timer));
+}
+
+static void on_stop(htimer_t* timer) {
+    hloop_stop(hevent_loop(timer));
+}
+
+int main() {
+    hmutex_init(&s_log_mutex);
+    hlog_set_handler(on_log);
+
+    hloop_t* loop = hloop_new(0);
+    hloop_enable_metrics(loop);
+    hloop_enable_watchdog(loop, STALL_MS);
+    htimer_t* timer = htimer_add(loop, on_block, 10, 1);
+    hevent_set_userdata(timer, (intptr_t)(STALL_MS / 5));
+    timer = htimer_add(loop, on_block, 100, 1);
+    hevent_set_userdata(timer, (intptr_t)(STALL_MS * 6));
+    htimer_add(loop, on_stop, 800, 1);
+    hloop_run(loop);
+
+    hloop_metrics_t* metrics = hloop_metrics(loop);
+    CHECK(metrics && metrics->stalls == 1);
+    hmutex_lock(&s_log_mutex);
+    printf("%s", s_log);
+    CHECK(strstr(s_log, "stalled") && strstr(s_log, "in timeout callback"));
+    CHECK(strstr(s_log, "resumed after stalled"));
+#if defined(OS_LINUX) && defined(__GLIBC__) && (defined(__x86_64__) || defined(__aarch64__))
+    CHECK(strstr(s_log, "#0 ") != NULL);
+#endif
+    hmutex_unlock(&s_log_mutex);
+
+    hloop_disable_watchdog(loop);
+    hloop_free(&loop);
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed;
+}
@@ -0,0 +1,167 @@
+/*
+ * WebSocketDeflate test
+ *
+ * @build   ./configure --with-zlib && make unittest
+ * @run     bin/websocket_deflate_test
+ *
+ * - negotiate: client offer => server AcceptOffer => ToResponse => client AcceptResponse,
+ *              window bits, fallback offers, and offers or responses to decline.
+ * - roundtrip: server Compress => client Decompress and back, with and without context takeover,
+ *              for empty, small, large and incompressible messages.
+ * - max_len:   a message inflated over max_len fails, and the next one is still decompressed.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "hstring.h"
+#include "WebSocketDeflate.h"
+
+#include "unittest.h"
+
+static void test_negotiate() {
+    WebSocketDeflateOptions client, server, negotiated, accepted;
+
+    std::string offer = client.ToOffer();
+    CHECK(offer == "permessage-deflate; client_max_window_bits; server_no_context_takeover; client_no_context_takeover");
+    CHECK(server.AcceptOffer(offer, &negotiated));
+    CHECK(negotiated.server_no_context_takeover && negotiated.client_no_context_takeover);
+    CHECK(negotiated.server_max_window_bits == 15 && negotiated.client_max_window_bits == 15);
+    std::string response = negotiated.ToResponse();
+    CHECK(response == "permessage-deflate; server_no_context_takeover; client_no_context_takeover");
+    CHECK(client.AcceptResponse(response, &accepted));
+    CHECK(accepted.server_no_context_takeover && accepted.client_no_context_takeover);
+
+    // window bits: the smaller of offer and server options
+    client.server_max_window_bits = 10;
+    client.client_max_window_bits = 12;
+    client.server_no_context_takeover = client.client_no_context_takeover = false;
+    server.server_no_context_takeover = server.client_no_context_takeover = false;
+    offer = client.ToOffer();
+    CHECK(offer == "permessage-deflate; client_max_window_bits=12; server_max_window_bits=10");
+    CHECK(server.AcceptOffer(offer, &negotiated));
+    CHECK(negotiated.server_max_window_bits == 10 && negotiated.client_max_window_bits == 12);
+    CHECK(!negotiated.server_no_context_takeover && !negotiated.client_no_context_takeover);
+    response = negotiated.ToResponse();
+    CHECK(response == "permessage-deflate; server_max_window_bits=10; client_max_window_bits=12");
+    CHECK(client.AcceptResponse(response, &accepted));
+    CHECK(accepted.server_max_window_bits == 10 && accepted.client_max_window_bits == 12);
+
+    // client_max_window_bits not offered: not responded
+    WebSocketDeflateOptions small_window;
+    small_window.client_max_window_bits = 10;
+    CHECK(small_window.AcceptOffer("permessage-deflate", &negotiated));
+    CHECK(negotiated.client_max_window_bits == 15);
+    CHECK(negotiated.ToResponse().find("client_max_window_bits") == std::string::npos);
+
+    // zlib can not deflate with a window of 8: decline, and accept the fallback offer
+    CHECK(!server.AcceptOffer("permessage-deflate; server_max_window_bits=8", NULL));
+    CHECK(server.AcceptOffer("permessage-deflate; server_max_window_bits=8, permessage-deflate", &negotiated));
+    CHECK(negotiated.server_max_window_bits == 15);
+    CHECK(server.AcceptOffer("x-webkit-deflate-frame, permessage-deflate; client_max_window_bits=\"9\"", &negotiated));
+    CHECK(negotiated.client_max_window_bits == 9);
+
+    // offers to decline
+    CHECK(!server.AcceptOffer("", NULL));
+    CHECK(!server.AcceptOffer("x-webkit-deflate-frame", NULL));
+    CHECK(!server.AcceptOffer("permessage-deflate; unknown_param", NULL));
+    CHECK(!server.AcceptOffer("permessage-deflate; server_max_window_bits=abc", NULL));
+    CHECK(!server.AcceptOffer("permessage-deflate; client_max_window_bits=16", NULL));
+
+    // responses to fail the connection
+    CHECK(!client.AcceptResponse("x-webkit-deflate-frame", NULL));
+    CHECK(!client.AcceptResponse("permessage-deflate; unknown_param", NULL));
+    CHECK(!client.AcceptResponse("permessage-deflate; server_max_window_bits=abc", NULL));
+    CHECK(!client.AcceptResponse("permessage-deflate; client_max_window_bits=8", NULL));
+    // server_no_context_takeover is only set if responded
+    CHECK(client.AcceptResponse("permessage-deflate", &accepted));
+    CHECK(!accepted.server_no_context_takeover && accepted.server_max_window_bits == 15);
+}
+
+static std::vector<std::string> messages() {
+    std::vector<std::string> msgs;
+    msgs.push_back("");
+    msgs.push_back("hello");
+    std::string text;
+    while (text.size() < (1 << 20)) {
+        text += "{\"id\":" + hv::to_string(text.size()) + ",\"name\":\"websocket deflate\"}\n";
+    }
+    msgs.push_back(text);
+    std::string random(64 << 10, '\0');
+    for (size_t i = 0; i < random.size(); ++i) random[i] = (char)rand();
+    msgs.push_back(random);
+    // again, with the context of the previous messages if takeover
+    msgs.push_back(text.substr(0, 4096));
+    msgs.push_back(text.substr(0, 4096));
+    return msgs;
+}
+
+static void test_roundtrip(bool no_context_takeover, int window_bits) {
+    WebSocketDeflateOptions options;
+    options.server_no_context_takeover = options.client_no_context_takeover = no_context_takeover;
+    options.server_max_window_bits = options.client_max_window_bits = window_bits;
+    WebSocketDeflate server(options, WS_SERVER);
+    WebSocketDeflate client(options, WS_CLIENT);
+    std::vector<size_t> sizes;
+    for (const auto& msg : messages()) {
+        std::string compressed, decompressed;
+        // server => client
+        CHECK(server.Compress(msg.data(), msg.size(), compressed));
+        CHECK(client.Decompress(compressed.data(), compressed.size(), decompressed));
+        CHECK(decompressed == msg);
+        sizes.push_back(compressed.size());
+        // client => server
+        CHECK(client.Compress(msg.data(), msg.size(), compressed));
+        CHECK(server.Decompress(compressed.data(), compressed.size(), decompressed));
+        CHECK(decompressed == msg);
+    }
+    // the repeated message refers to the previous one only with context takeover
+    size_t n = sizes.size();
+    if (no_context_takeover) {
+        CHECK(sizes[n - 1] == sizes[n - 2]);
+    } else {
+        CHECK(sizes[n - 1] < sizes[n - 2]);
+    }
+    printf("roundtrip no_context_takeover=%d window_bits=%d: %u bytes => %u bytes\n",
+           (int)no_context_takeover, window_bits, 1U << 20, (unsigned)sizes[2]);
+}
+
+static void test_max_len() {
+    WebSocketDeflateOptions options;
+    WebSocketDeflate server(options, WS_SERVER);
+    WebSocketDeflate client(options, WS_CLIENT);
+    std::string bomb(1 << 20, 'a');
+    std::string compressed, decompressed;
+    CHECK(server.Compress(bomb.data(), bomb.size(), compressed));
+    CHECK(compressed.size() < 4096);
+    CHECK(!client.Decompress(compressed.data(), compressed.size(), decompressed, 64 << 10));
+    CHECK(client.Decompress(compressed.data(), compressed.size(), decompressed, bomb.size()));
+    CHECK(decompressed == bomb);
+    std::string hello = "hello";
+    CHECK(server.Compress(hello.data(), hello.size(), compressed));
+    CHECK(client.Decompress(compressed.data(), compressed.size(), decompressed, hello.size()));
+    CHECK(decompressed == hello);
+    // not deflate data
+    std::string garbage = "\xff\xff\xff\xff garbage";
+    CHECK(!client.Decompress(garbage.data(), garbage.size(), decompressed));
+    CHECK(client.Decompress(compressed.data(), compressed.size(), decompressed));
+    CHECK(decompressed == hello);
+}
+
+int main() {
+    test_negotiate();
+    if (WebSocketDeflate::IsSupported()) {
+        test_roundtrip(true, 15);
+        test_roundtrip(false, 15);
+        test_roundtrip(true, 9);
+        test_roundtrip(false, 9);
+        test_max_len();
+    } else {
+        printf("WebSocketDeflate not supported, build with zlib to test compression\n");
+    }
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed;
+}
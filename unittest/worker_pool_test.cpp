@@ -0,0 +1,125 @@
+/*
+ * HttpWorkerPool test
+ *
+ * @build   make unittest
+ * @run     bin/worker_pool_test
+ *
+ * Routes with http_exec_policy::POOL run on worker pools, and their responses
+ * go through the same tail as inline handlers on the IO thread:
+ * - status:    a pooled handler returning 404 with an empty body gets the errorHandler body.
+ * - postprocessor: runs after the pooled handler, not before it.
+ * - overload:  a pool with max_queue_size handlers in flight answers 503.
+ * - keepalive: responses on one connection stay in order, Connection: close is closed after it.
+ *
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+
+#include "HttpServer.h"
+#include "HttpClient.h"
+#include "requests.h"
+
+#include "hsocket.h"
+#include "htime.h"
+
+#include "unittest.h"
+
+using namespace hv;
+
+#define SLOW_HANDLER_MS     500
+
+static std::string s_url;
+
+static requests::Response get(const char* path) {
+    return requests::get((s_url + path).c_str());
+}
+
+int main() {
+    std::atomic<int> slow_running(0);
+
+    HttpService service;
+    service.enable_access_log = 0;
+    service.AddWorkerPool("slow", 1, 1);
+    service.errorHandler = [](HttpRequest*, HttpResponse* resp) {
+        return resp->String("error " + hv::to_string(resp->status_code));
+    };
+    service.postprocessor = [](HttpRequest*, HttpResponse* resp) {
+        // sees the status and body set by the pooled handler
+        resp->headers["X-Post-Status"] = hv::to_string(resp->status_code);
+        resp->headers["X-Post-Body"] = hv::to_string(resp->body.size());
+        return HTTP_STATUS_NEXT;
+    };
+    service.GET("/sync", [](HttpRequest*, HttpResponse* resp) {
+        return resp->String("sync");
+    }, http_exec_policy::POOL);
+    service.GET("/notfound", [](HttpRequest*, HttpResponse*) {
+        return HTTP_STATUS_NOT_FOUND;
+    }, http_exec_policy::POOL);
+    service.GET("/ctx", [](const HttpContextPtr& ctx) {
+        ctx->setContentType(TEXT_PLAIN);
+        ctx->response->body = "ctx";
+        return 201;
+    }, http_exec_policy::POOL);
+    service.GET("/slow", [&slow_running](HttpRequest*, HttpResponse* resp) {
+        ++slow_running;
+        hv_msleep(SLOW_HANDLER_MS);
+        return resp->String("slow");
+    }, "slow");
+
+    HttpServer server(&service);
+    int port = 0;
+    server.setListenFD(listen_any(&port));
+    s_url = "http://127.0.0.1:" + hv::to_string(port);
+    server.setThreadNum(2);
+    server.start();
+
+    // postprocessor after the pooled handler
+    auto resp = get("/sync");
+    CHECK(resp && resp->status_code == HTTP_STATUS_OK && resp->body == "sync");
+    CHECK(resp && resp->GetHeader("X-Post-Status") == "200" && resp->GetHeader("X-Post-Body") == "4");
+
+    // status code from the pooled handler, empty body => errorHandler
+    resp = get("/notfound");
+    CHECK(resp && resp->status_code == HTTP_STATUS_NOT_FOUND && resp->body == "error 404");
+    CHECK(resp && resp->GetHeader("X-Post-Status") == "404");
+
+    resp = get("/ctx");
+    CHECK(resp && resp->status_code == 201 && resp->body == "ctx");
+    CHECK(resp && resp->GetHeader("X-Post-Status") == "201");
+
+    http_headers close_headers = {{"Connection", "close"}};
+    resp = requests::get((s_url + "/notfound").c_str(), close_headers);
+    CHECK(resp && resp->status_code == HTTP_STATUS_NOT_FOUND && resp->body == "error 404");
+
+    // keepalive: the same connection serves pooled requests in order
+    HttpClient client;
+    for (int i = 0; i < 10; ++i) {
+        HttpRequest req;
+        req.url = s_url + (i % 2 ? "/sync" : "/notfound");
+        HttpResponse res;
+        int ret = client.send(&req, &res);
+        CHECK(ret == 0 && res.status_code == (i % 2 ? HTTP_STATUS_OK : HTTP_STATUS_NOT_FOUND));
+        CHECK(res.body == (i % 2 ? "sync" : "error 404"));
+    }
+
+    // overload: max_queue_size=1, the second concurrent request => 503
+    std::thread slow_client([]() {
+        auto resp = get("/slow");
+        CHECK(resp && resp->status_code == HTTP_STATUS_OK && resp->body == "slow");
+    });
+    while (slow_running == 0) hv_msleep(1);
+    resp = get("/slow");
+    CHECK(resp && resp->status_code == HTTP_STATUS_SERVICE_UNAVAILABLE);
+    CHECK(resp && resp->body == "error 503" && resp->GetHeader("X-Post-Status") == "503");
+    slow_client.join();
+    CHECK(slow_running == 1);
+    // released after the handler returned
+    resp = get("/slow");
+    CHECK(resp && resp->status_code == HTTP_STATUS_OK);
+
+    server.stop();
+    printf("%s\n", s_failed ? "FAILED" : "OK");
+    return s_failed;
+}